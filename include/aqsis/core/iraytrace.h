@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+/**
+ *	@file	iraytrace.h
+ *	@author	Paul Gregory
+ *	@brief	Declare the interface class for common raytracer access.
+ *
+ *	Last change by:		$Author$
+ *	Last change date:	$Date$
+ */
+//------------------------------------------------------------------------------
+
+
+#ifndef	___iraytrace_Loaded___
+#define	___iraytrace_Loaded___
+
+#include	<aqsis/aqsis.h>
+#include	<boost/shared_ptr.hpp>
+
+#include	<aqsis/math/color.h>
+#include	<aqsis/math/vector3d.h>
+
+namespace Aqsis {
+
+class IqSurface;
+
+/** \brief Description of the nearest surface hit by a ray.
+ *
+ * Shaders aren't run at ray hits; the colour and opacity are the Cs and Os of
+ * the primitive hit, interpolated at the hit point.
+ */
+struct SqRayHit
+{
+	/// Distance along the (normalised) ray to the hit point.
+	TqFloat distance;
+	/// Normalised geometric normal at the hit point.
+	CqVector3D normal;
+	/// Surface colour (Cs) at the hit point.
+	CqColor color;
+	/// Surface opacity (Os) at the hit point.
+	CqColor opacity;
+};
+
+class IqRaytrace
+{
+public:
+	virtual ~IqRaytrace()
+	{}
+
+
+	/** Initialise the raytracing subsystem.
+	 */
+	virtual	void	Initialise()=0;
+
+	/** Add a primitive to the raytracing space subdivision structure.
+	 */
+	virtual	void	AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface)=0;
+
+	/** Prepare the structure for raytrace queries.
+	 */
+	virtual void	Finalise()=0;
+
+	/** Find the nearest surface hit by a ray.
+	 *
+	 * Queries may be made concurrently once Finalise() has been called.
+	 * All quantities are in camera space.
+	 *
+	 * \param origin - ray origin
+	 * \param direction - normalised ray direction
+	 * \param maxDist - ignore surfaces further than this along the ray
+	 * \param hit - filled in with a description of the hit, if any
+	 * \return true if the ray hit a surface
+	 */
+	virtual bool	intersect(const CqVector3D& origin, const CqVector3D& direction,
+			TqFloat maxDist, SqRayHit& hit) const = 0;
+
+	/** Determine whether any surface lies along a ray.
+	 *
+	 * This is cheaper than intersect(), since the search can stop at the
+	 * first surface found.
+	 */
+	virtual bool	occluded(const CqVector3D& origin, const CqVector3D& direction,
+			TqFloat maxDist) const = 0;
+};
+
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
+
+#endif	//	___iraytrace_Loaded___
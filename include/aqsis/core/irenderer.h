@@ -23,8 +23,8 @@
 
 namespace Aqsis {
 
-struct IqTextureMapOld;
 struct IqTextureCache;
+class IqRaytrace;
 
 class IqRenderer
 {
@@ -69,13 +69,6 @@ public:
 	 * \return the texture sampler (always valid).
 	 */
 	virtual	IqTextureCache& textureCache() = 0;
-
-	/// \deprecated
-	virtual	IqTextureMapOld* GetEnvironmentMap( const CqString& fileName ) = 0;
-	/// \deprecated
-	virtual	IqTextureMapOld* GetOcclusionMap( const CqString& fileName ) = 0;
-	/// \deprecated
-	virtual	IqTextureMapOld* GetLatLongMap( const CqString& fileName ) = 0;
 	//@}
 
 	virtual	bool	GetBasisMatrix( CqMatrix& matBasis, const CqString& name ) = 0;
@@ -90,6 +83,12 @@ public:
 	virtual	TqFloat	Time() const = 0;
 
 	virtual	bool	IsWorldBegin() const = 0;
+
+	/** \brief Get the raytracing subsystem.
+	 *
+	 * \return the raytracer, or null if raytracing is unavailable.
+	 */
+	virtual	IqRaytrace*	pRaytracer() const = 0;
 };
 
 AQSIS_CORE_SHARE IqRenderer* QGetRenderContextI();
@@ -113,6 +113,18 @@ class AQSIS_MATH_SHARE CqRandom
 		TqFloat	RandomFloat( TqFloat Range );
 
 		void    Reseed(TqUint Seek);
+
+		/** Restart the calling thread's stream from the Reseed() seed mixed
+		 * with a key.
+		 *
+		 * Each thread draws from its own stream, so the numbers seen by a
+		 * piece of work depend on which thread runs it and what that thread
+		 * did before.  Restarting the stream from a key identifying the work
+		 * makes the numbers the same whichever thread runs it.
+		 *
+		 * \param key - stable identifier of the work about to draw numbers.
+		 */
+		void    ReseedStream(TqUlong key);
 	protected:
 		void NextState();
 };
@@ -233,7 +233,10 @@ typedef boost::function<bool(const char*)> IfElseTestCallback;
 /// archive nesting level.
 ///
 /// The object instancing mechanism is so similar to inline archive handling
-/// that we use the same machinary for both.
+/// that we use the same machinary for both.  Renderers which retain objects
+/// natively can pass expandObjects = false, in which case ObjectBegin,
+/// ObjectEnd and ObjectInstance are passed through to the next filter
+/// (except when they are being cached inside an inline archive).
 ///
 /// Conditional RIB handling is also performed, before the archive and object
 /// steps handling steps.  The callback provided should take a condition
@@ -242,7 +245,8 @@ typedef boost::function<bool(const char*)> IfElseTestCallback;
 ///
 AQSIS_RIUTIL_SHARE
 Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback =
-                                   IfElseTestCallback());
+                                   IfElseTestCallback(),
+                                   bool expandObjects = true);
 
 //------------------------------------------------------------------------------
 /// Empty implementation of Ri::Renderer
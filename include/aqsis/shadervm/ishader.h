@@ -126,6 +126,13 @@ public:
 	 * \return A pointer to a new shader.
 	 */
 	virtual boost::shared_ptr<IqShader> Clone() const = 0;
+	/** Duplicate this prepared shader instance for use by another thread.
+	 *
+	 * Unlike Clone(), the copy keeps the instance parameters of this
+	 * shader, so it's ready to shade grids concurrently with the original.
+	 * The original must outlive the copy.
+	 */
+	virtual boost::shared_ptr<IqShader> Duplicate() const = 0;
 	/** Determine whether this shader uses the specified system variable.
 	 * \param Var ID of the variable from EqEnvVars.
 	 */
@@ -165,9 +172,14 @@ public:
 
 //@{
 /** \brief Factory functions for CqShaderVM instances
+ *
+ * The shader program may be in either the text or binary slx format.  When
+ * it's given by file name the file is memory mapped, so binary programs are
+ * loaded without being copied.
  *
  * \param renderContext - Context within which the shader will operate
  * \param programFile - file from which to read the shader program
+ * \param programFileName - path of the file containing the shader program
  * \param dsoPath - search path for DSO shadeops.
  */
 AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext);
@@ -175,6 +187,10 @@ AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* rend
 AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
 										   std::istream& programFile,
 										   const std::string& dsoPath);
+
+AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
+										   const std::string& programFileName,
+										   const std::string& dsoPath);
 //@}
 
 /** \brief Reset ShaderVM static variables
@@ -57,7 +57,15 @@ class AQSIS_SLCOMP_SHARE IqCodeGen
 class AQSIS_SLCOMP_SHARE CqCodeGenVM : public IqCodeGen
 {
 	public:
+		/** \param binaryOutput - write the program in the pre-tokenised
+		 *                       binary slx format (see slxbinary.h) instead
+		 *                       of as text.
+		 */
+		CqCodeGenVM( bool binaryOutput = false );
 		virtual void OutputTree( IqParseNode* pNode, std::string strOutName );
+
+	private:
+		bool m_binaryOutput;
 };
 
 
@@ -43,6 +43,8 @@
 
 #include <limits>
 
+#include <boost/type_traits/remove_const.hpp>
+
 namespace Aqsis {
 
 //------------------------------------------------------------------------------
@@ -94,10 +96,11 @@ inline TqFloat CqSampleVector<T>::operator[](TqInt index) const
 	// for all texture filtering operations.
 	//
 	// The if statement here should be optimised away.
-	if(std::numeric_limits<T>::is_integer)
+	typedef std::numeric_limits<typename boost::remove_const<T>::type> TqLimits;
+	if(TqLimits::is_integer)
 	{
 		// The following division should also be optimized away.
-		const TqFloat scale = 1.0/std::numeric_limits<T>::max();
+		const TqFloat scale = 1.0/TqLimits::max();
 		return scale*m_sampleData[index];
 	}
 	else
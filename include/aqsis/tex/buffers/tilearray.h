@@ -41,16 +41,25 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
+#include <boost/bind.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 //#include <aqsis/util/memorysentry.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include <aqsis/tex/buffers/texturebuffer.h>
+#include <aqsis/tex/buffers/tilecache.h>
+#include <aqsis/tex/buffers/tileprefetcher.h>
 #include "randomtable.h"
 #include <aqsis/util/smartptr.h>
 
@@ -83,12 +92,28 @@ class CqTextureTile;
  * iterator mechanism for traversing all pixels within a given region.  This
  * allows for efficient filtering to be performed over the texture, without
  * worrying about the underlying tiled structure.
+ *
+ * Tiles are read from the file on demand, and registered with the global
+ * CqTileCache which may evict them again to keep within the texture memory
+ * limit.  Pixel iterators hold a reference to the tile they're traversing, so
+ * eviction never invalidates an iterator in use.
+ *
+ * The array may be used from several threads at once.  Each thread remembers
+ * the last tile it used, so repeated lookups into the same tile take no locks.
+ * Other lookups lock only a small group of tiles, and each tile is read from
+ * the file exactly once even when several threads ask for it together.
+ *
+ * Tiles which are known to be needed soon may be read in the background with
+ * prefetch().  A thread which wants a tile while it's being prefetched simply
+ * waits for the read to finish.
  */
 template<typename T>
-class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
+class CqTileArray : public IqTileOwner, boost::noncopyable
 {
 	private:
-		typedef CqTextureTile<CqTextureBuffer<T> > TqTile;
+		/// Tiles are read-only, since they may be used in place from a
+		/// mapped file.
+		typedef CqTextureTile<CqTextureBuffer<const T> > TqTile;
 	public:
 		class CqIterator;
 		class CqStochasticIterator;
@@ -105,6 +130,12 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		 */
 		CqTileArray(const boost::shared_ptr<IqTiledTexInputFile>& inFile,
 				TqInt subImageIdx);
+		/** \brief Remove any remaining tiles from the tile cache.
+		 *
+		 * This waits for any prefetches of the array's tiles which are still
+		 * queued or running.
+		 */
+		virtual ~CqTileArray();
 
 		//--------------------------------------------------
 		/// \name Access to buffer dimensions & metadata
@@ -154,12 +185,86 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqStochasticIterator beginStochastic(const SqFilterSupport& support,
 				TqInt numSamples) const;
 		//@}
+
+		/** \brief Start reading the tiles covering the given supports.
+		 *
+		 * The tiles which aren't already loaded are read on the threads of
+		 * the CqTilePrefetcher; this returns without waiting for them.  Reads
+		 * are queued in the order the supports first touch the tiles, so
+		 * supports should be given in the order they'll be used.  Parts of
+		 * the supports outside the array are ignored.
+		 *
+		 * \param supports - regions of the array which will be needed soon.
+		 */
+		void prefetch(const std::vector<SqFilterSupport>& supports) const;
+
+		/// Release the given tile on behalf of the tile cache.
+		virtual void evictTile(TqInt tileIndex, TqUlong generation);
 	private:
 		/** \brief Access to the underlying tiles
 		 *
 		 * \return The tile holding the underlying data at the given indices.
 		 */
 		boost::intrusive_ptr<TqTile> getTile(const TqInt x, const TqInt y) const;
+		/** \brief Find the given tile, reading it from the file if necessary.
+		 *
+		 * Unlike getTile() this ignores the tile last used by the thread.
+		 *
+		 * \param tileIndex - index of the tile in m_tiles.
+		 * \param handle - set to the cache handle of the tile, with a null
+		 *                 slot if unknown.
+		 */
+		boost::intrusive_ptr<TqTile> findTile(TqInt tileIndex,
+				CqTileCache::SqHandle& handle) const;
+		/// Read the given tile for prefetch() on an I/O thread.
+		void prefetchTile(TqInt tileIndex) const;
+		/// Record that a read queued by prefetch() has finished.
+		void prefetchDone() const;
+		/** \brief Point pixels at the data for a tile held in memory by
+		 * the file, if the file supports it.
+		 *
+		 * \return false if the tile must be read with readTile() instead.
+		 */
+		bool mapTile(CqTextureBuffer<const T>& pixels, TqInt x, TqInt y) const;
+		/// Read the pixels for a tile from the file.
+		void readTile(CqTextureBuffer<const T>& pixels, TqInt x, TqInt y) const;
+		/// Get the mutex protecting the tile with the given index.
+		boost::mutex& tileMutex(TqInt tileIndex) const;
+
+		/// Deleter for tile data owned by another object, which it keeps alive.
+		template<typename OwnerT>
+		struct SqDataRef
+		{
+			OwnerT owner;
+			SqDataRef(const OwnerT& owner)
+				: owner(owner) {}
+			void operator()(const T*) const {}
+		};
+		/// A loaded tile and its handle in the tile cache.
+		struct SqTileEntry
+		{
+			boost::intrusive_ptr<TqTile> tile;
+			/// Cache handle, with a null slot if not yet known.
+			CqTileCache::SqHandle cacheHandle;
+			/// True if a read of the tile has been queued by prefetch().
+			bool prefetching;
+			SqTileEntry() : tile(), cacheHandle(), prefetching(false) {}
+		};
+		/// The tile most recently used by a thread, from any array.
+		struct SqLastTile
+		{
+			TqUlong arrayId;
+			TqInt tileIndex;
+			boost::intrusive_ptr<TqTile> tile;
+			CqTileCache::SqHandle cacheHandle;
+		};
+
+		/// Number of mutexes used to protect the tiles of each array.
+		static const TqInt m_numTileMutexes = 16;
+		/// Source of unique array ids
+		static boost::detail::atomic_count m_nextId;
+		/// Last tile used by each thread.
+		static boost::thread_specific_ptr<SqLastTile> m_lastTile;
 
 		/// Underlying texture file.
 		boost::shared_ptr<IqTiledTexInputFile> m_inFile;
@@ -179,8 +284,25 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqInt m_widthInTiles;
 		/// Height of the array
 		TqInt m_heightInTiles;
-		/// "2D" array of tiles.  Tiles may be founnd in O(1) time using this array.
-		boost::scoped_array<boost::intrusive_ptr<TqTile> > m_tiles;
+		/** \brief "2D" array of tiles.  Tiles may be found in O(1) time using
+		 * this array.
+		 *
+		 * Tile i is protected by the mutex m_tileMutexes[i % m_numTileMutexes].
+		 */
+		boost::scoped_array<SqTileEntry> m_tiles;
+		mutable boost::mutex m_tileMutexes[m_numTileMutexes];
+		/** \brief Unique id for the array.
+		 *
+		 * This identifies tiles in m_lastTile, where the address of the array
+		 * could be reused by a new array once this one is destroyed.
+		 */
+		const TqUlong m_id;
+		/// Protects m_numPrefetches.
+		mutable boost::mutex m_prefetchMutex;
+		/// Signalled when m_numPrefetches drops to zero.
+		mutable boost::condition m_prefetchesDone;
+		/// Number of reads queued by prefetch() which haven't finished.
+		mutable TqInt m_numPrefetches;
 };
 
 
@@ -243,6 +365,8 @@ class CqTileArray<T>::CqIterator
 		/// Current tile y-coordinate
 		TqInt m_tileY;
 
+		/// Current tile, kept alive in case it's evicted from the cache.
+		boost::intrusive_ptr<TqTile> m_currTile;
 		/// Current position in the underlying tiles.
 		TqBaseIter m_currPos;
 
@@ -300,9 +424,6 @@ class CqTileArray<T>::CqStochasticIterator
 		/// Iterator type for the underlying tiles
 		typedef typename TqTile::TqStochasticIterator TqBaseIter;
 
-		/// Random number stream for partitioning samples into tiles (see nextTile)
-		static CqRandom m_random;
-
 		/// Support region to iterate over.
 		SqFilterSupport m_support;
 		/// Parent array to obtain tiles from.
@@ -321,6 +442,8 @@ class CqTileArray<T>::CqStochasticIterator
 		TqFloat m_remainingArea;
 		/// Number of samples remaining for tiles yet to be filtered over.
 		TqInt m_remainingSamples;
+		/// Current tile, kept alive in case it's evicted from the cache.
+		boost::intrusive_ptr<TqTile> m_currTile;
 		/// Current position in the underlying tiles.
 		TqBaseIter m_currPos;
 
@@ -339,14 +462,16 @@ class CqTileArray<T>::CqStochasticIterator
  *
  * The wrapper adds two things to the underlying array:
  *   - Adjust the origin of the array to some point (x0, y0)
- *   - Facilities to enable being held by a tiled array (intrusive reference
- *     counting, and support for determining recent usage for tile cache
- *     rejection (FIXME coming soon) )
+ *   - Facilities to enable being held by a tiled array (thread safe
+ *     intrusive reference counting, so that tiles evicted by CqTileCache live
+ *     on while iterators in any thread still refer to them)
  */
 template<typename ArrayT>
-class CqTextureTile : public CqIntrusivePtrCounted
+class CqTextureTile : boost::noncopyable
 {
 	private:
+		/// Reference count for boost::intrusive_ptr
+		mutable boost::detail::atomic_count m_refCount;
 		/// Underlying array of pixels
 		boost::scoped_ptr<ArrayT> m_pixels;
 		/// x-coordinate of origin (top left of array)
@@ -365,7 +490,8 @@ class CqTextureTile : public CqIntrusivePtrCounted
 
 		/// Construct a texture tile with the given origin (x0,y0)
 		CqTextureTile(TqInt x0, TqInt y0)
-			: m_pixels(new ArrayT()),
+			: m_refCount(0),
+			m_pixels(new ArrayT()),
 			m_x0(x0),
 			m_y0(y0)
 		{ }
@@ -404,6 +530,16 @@ class CqTextureTile : public CqIntrusivePtrCounted
 						SqFilterSupport(support.sx.start - m_x0, support.sx.end - m_x0,
 						support.sy.start - m_y0, support.sy.end - m_y0), numSamps) );
 		}
+
+		friend void intrusive_ptr_add_ref(const CqTextureTile* tile)
+		{
+			++tile->m_refCount;
+		}
+		friend void intrusive_ptr_release(const CqTextureTile* tile)
+		{
+			if(--tile->m_refCount == 0)
+				delete tile;
+		}
 };
 
 
@@ -482,14 +618,43 @@ CqTileArray<T>::CqTileArray(const boost::shared_ptr<IqTiledTexInputFile>& inFile
 	m_subImageIdx(subImageIdx),
 	m_width(inFile->width(subImageIdx)),
 	m_height(inFile->height(subImageIdx)),
-	m_numChannels(inFile->header().channelList().numChannels()),
+	m_numChannels(inFile->header(subImageIdx).channelList().numChannels()),
 	m_tileWidth(inFile->tileInfo().width),
 	m_tileHeight(inFile->tileInfo().height),
 	m_widthInTiles((m_width-1)/m_tileWidth + 1), // "ceil(m_width/m_tileWidth)"
 	m_heightInTiles((m_height-1)/m_tileHeight + 1),
-	m_tiles(new boost::intrusive_ptr<TqTile>[m_widthInTiles*m_heightInTiles])
+	m_tiles(new SqTileEntry[m_widthInTiles*m_heightInTiles]),
+	m_id(++m_nextId),
+	m_prefetchMutex(),
+	m_prefetchesDone(),
+	m_numPrefetches(0)
 { }
 
+template<typename T>
+CqTileArray<T>::~CqTileArray()
+{
+	// Queued prefetches refer to the array, so must finish first.
+	{
+		boost::mutex::scoped_lock lock(m_prefetchMutex);
+		while(m_numPrefetches > 0)
+			m_prefetchesDone.wait(lock);
+	}
+	CqTileCache& cache = CqTileCache::instance();
+	for(TqInt i = 0, numTiles = m_widthInTiles*m_heightInTiles; i < numTiles; ++i)
+	{
+		if(m_tiles[i].cacheHandle.slot)
+			cache.remove(this, m_tiles[i].cacheHandle);
+	}
+	cache.waitForEvictions(this);
+}
+
+template<typename T>
+boost::detail::atomic_count CqTileArray<T>::m_nextId(0);
+
+template<typename T>
+boost::thread_specific_ptr<typename CqTileArray<T>::SqLastTile>
+	CqTileArray<T>::m_lastTile;
+
 template<typename T>
 inline TqInt CqTileArray<T>::width() const
 {
@@ -537,14 +702,218 @@ boost::intrusive_ptr<typename CqTileArray<T>::TqTile> CqTileArray<T>::getTile(
 {
 	assert(x < m_widthInTiles);
 	assert(y < m_heightInTiles);
-	boost::intrusive_ptr<TqTile>& tilePtr = m_tiles[y*m_widthInTiles + x];
-	if(!tilePtr)
+	const TqInt tileIndex = y*m_widthInTiles + x;
+	CqTileCache& cache = CqTileCache::instance();
+	// Fast path: the tile was the last one used by this thread.  It may have
+	// been evicted since, but the reference held here keeps it valid.
+	SqLastTile* last = m_lastTile.get();
+	if(last && last->arrayId == m_id && last->tileIndex == tileIndex)
+	{
+		if(last->cacheHandle.slot)
+			cache.touch(last->cacheHandle);
+		return last->tile;
+	}
+	CqTileCache::SqHandle handle;
+	boost::intrusive_ptr<TqTile> tile = findTile(tileIndex, handle);
+	if(!last)
 	{
-		tilePtr = boost::intrusive_ptr<TqTile>(
-				new TqTile(x*m_tileWidth, y*m_tileHeight));
-		m_inFile->readTile(tilePtr->pixels(), x, y, m_subImageIdx);
+		last = new SqLastTile();
+		m_lastTile.reset(last);
 	}
-	return tilePtr;
+	last->arrayId = m_id;
+	last->tileIndex = tileIndex;
+	last->tile = tile;
+	last->cacheHandle = handle;
+	return tile;
+}
+
+template<typename T>
+boost::intrusive_ptr<typename CqTileArray<T>::TqTile> CqTileArray<T>::findTile(
+		TqInt tileIndex, CqTileCache::SqHandle& handle) const
+{
+	CqTileCache& cache = CqTileCache::instance();
+	boost::intrusive_ptr<TqTile> tile;
+	handle = CqTileCache::SqHandle();
+	bool loaded = false;
+	{
+		boost::mutex::scoped_lock lock(tileMutex(tileIndex));
+		SqTileEntry& entry = m_tiles[tileIndex];
+		if(entry.tile)
+		{
+			tile = entry.tile;
+			handle = entry.cacheHandle;
+		}
+		else
+		{
+			// Read the tile while holding the lock, so that other threads
+			// wanting it wait rather than reading it again.
+			const TqInt x = tileIndex % m_widthInTiles;
+			const TqInt y = tileIndex / m_widthInTiles;
+			tile = new TqTile(x*m_tileWidth, y*m_tileHeight);
+			// Tiles used in place from a mapped file are held by the page
+			// cache, so they stay out of the tile cache.
+			if(!mapTile(tile->pixels(), x, y))
+			{
+				readTile(tile->pixels(), x, y);
+				loaded = true;
+			}
+			entry.tile = tile;
+			entry.cacheHandle = CqTileCache::SqHandle();
+			entry.prefetching = false;
+		}
+	}
+	if(loaded)
+	{
+		const CqTextureBuffer<const T>& pixels = tile->pixels();
+		std::size_t tileBytes = std::size_t(pixels.width())*pixels.height()
+			*pixels.numChannels()*sizeof(T);
+		// Inserting the tile may evict other tiles from this array, so it
+		// must be done without holding a tile lock.
+		handle = cache.insert(const_cast<CqTileArray<T>*>(this), tileIndex,
+				tileBytes);
+		boost::mutex::scoped_lock lock(tileMutex(tileIndex));
+		// The tile may already have been evicted by another thread, in
+		// which case the handle is stale.
+		if(m_tiles[tileIndex].tile == tile)
+			m_tiles[tileIndex].cacheHandle = handle;
+		else
+			handle = CqTileCache::SqHandle();
+	}
+	else if(handle.slot)
+		cache.touch(handle);
+	return tile;
+}
+
+template<typename T>
+bool CqTileArray<T>::mapTile(CqTextureBuffer<const T>& pixels, TqInt x, TqInt y) const
+{
+	typedef boost::shared_ptr<const TqUint8> TqMappedData;
+	TqMappedData data = m_inFile->mappedTile(x, y, m_subImageIdx);
+	if(!data)
+		return false;
+	pixels = CqTextureBuffer<const T>(
+			boost::shared_array<const T>(reinterpret_cast<const T*>(data.get()),
+				SqDataRef<TqMappedData>(data)),
+			min(m_tileWidth, m_width - x*m_tileWidth),
+			min(m_tileHeight, m_height - y*m_tileHeight), m_numChannels);
+	return true;
+}
+
+template<typename T>
+void CqTileArray<T>::readTile(CqTextureBuffer<const T>& pixels, TqInt x, TqInt y) const
+{
+	CqTextureBuffer<T> buf;
+	m_inFile->readTile(buf, x, y, m_subImageIdx);
+	// Share the data read, rather than copying it.
+	pixels = CqTextureBuffer<const T>(
+			boost::shared_array<const T>(buf.value(0,0),
+				SqDataRef<CqTextureBuffer<T> >(buf)),
+			buf.width(), buf.height(), buf.numChannels());
+}
+
+template<typename T>
+void CqTileArray<T>::prefetch(const std::vector<SqFilterSupport>& supports) const
+{
+	CqTilePrefetcher& prefetcher = CqTilePrefetcher::instance();
+	if(!prefetcher.enabled())
+		return;
+	// Collect the tiles touched by the supports, along with the order they're
+	// first needed in.  Supports for neighbouring shading points overlap
+	// heavily, so remove duplicates before locking.
+	std::vector<std::pair<TqInt, TqInt> > tileIndices;
+	const SqFilterSupport arraySupport(0,m_width, 0,m_height);
+	for(TqInt i = 0, end = supports.size(); i < end; ++i)
+	{
+		SqFilterSupport support = intersect(supports[i], arraySupport);
+		if(support.isEmpty())
+			continue;
+		TqInt endX = (support.sx.end-1)/m_tileWidth;
+		TqInt endY = (support.sy.end-1)/m_tileHeight;
+		for(TqInt y = support.sy.start/m_tileHeight; y <= endY; ++y)
+		{
+			for(TqInt x = support.sx.start/m_tileWidth; x <= endX; ++x)
+			{
+				tileIndices.push_back(std::make_pair(y*m_widthInTiles + x,
+							TqInt(tileIndices.size())));
+			}
+		}
+	}
+	std::sort(tileIndices.begin(), tileIndices.end());
+	TqInt numTiles = 0;
+	for(TqInt i = 0, end = tileIndices.size(); i < end; ++i)
+	{
+		if(i == 0 || tileIndices[i].first != tileIndices[i-1].first)
+			tileIndices[numTiles++] = std::make_pair(tileIndices[i].second,
+					tileIndices[i].first);
+	}
+	tileIndices.resize(numTiles);
+	std::sort(tileIndices.begin(), tileIndices.end());
+	for(TqInt i = 0; i < numTiles; ++i)
+	{
+		const TqInt tileIndex = tileIndices[i].second;
+		{
+			boost::mutex::scoped_lock lock(tileMutex(tileIndex));
+			SqTileEntry& entry = m_tiles[tileIndex];
+			if(entry.tile || entry.prefetching)
+				continue;
+			entry.prefetching = true;
+		}
+		{
+			boost::mutex::scoped_lock lock(m_prefetchMutex);
+			++m_numPrefetches;
+		}
+		prefetcher.run(boost::bind(&CqTileArray<T>::prefetchTile, this,
+					tileIndex));
+	}
+}
+
+template<typename T>
+void CqTileArray<T>::prefetchTile(TqInt tileIndex) const
+{
+	try
+	{
+		CqTileCache::SqHandle handle;
+		findTile(tileIndex, handle);
+	}
+	catch(...)
+	{
+		// Allow the tile to be read again when it's used, so that the error
+		// is reported to the thread needing it.
+		{
+			boost::mutex::scoped_lock lock(tileMutex(tileIndex));
+			m_tiles[tileIndex].prefetching = false;
+		}
+		prefetchDone();
+		throw;
+	}
+	prefetchDone();
+}
+
+template<typename T>
+void CqTileArray<T>::prefetchDone() const
+{
+	boost::mutex::scoped_lock lock(m_prefetchMutex);
+	if(--m_numPrefetches == 0)
+		m_prefetchesDone.notify_all();
+}
+
+template<typename T>
+inline boost::mutex& CqTileArray<T>::tileMutex(TqInt tileIndex) const
+{
+	return m_tileMutexes[tileIndex % m_numTileMutexes];
+}
+
+template<typename T>
+void CqTileArray<T>::evictTile(TqInt tileIndex, TqUlong generation)
+{
+	boost::mutex::scoped_lock lock(tileMutex(tileIndex));
+	SqTileEntry& entry = m_tiles[tileIndex];
+	// A tile whose handle isn't known yet is still being inserted by
+	// findTile(), so the eviction is for that tile.  Otherwise the eviction
+	// may be for an earlier copy of the tile, which must be ignored.
+	if(entry.cacheHandle.generation == generation
+			|| (entry.tile && !entry.cacheHandle.slot))
+		entry = SqTileEntry();
 }
 
 
@@ -578,7 +947,8 @@ void CqTileArray<T>::CqIterator::nextTile()
 	{
 		// Grab the next tile as long as we're within the overall
 		// filter support.
-		m_currPos = m_tileArray->getTile(m_tileX,m_tileY)->begin(m_support);
+		m_currTile = m_tileArray->getTile(m_tileX,m_tileY);
+		m_currPos = m_currTile->begin(m_support);
 	}
 }
 
@@ -619,8 +989,9 @@ CqTileArray<T>::CqIterator::CqIterator(const CqTileArray<T>& tileArray,
 	m_tileY(support.sy.start/tileArray.m_tileHeight),
 	// Check support.sx.empty() etc in order to make sure the tile
 	// index is still valid when the support is outside the buffer
-	m_currPos(m_tileArray->getTile(support.sx.isEmpty() ? 0 : m_tileX,
-				support.sy.isEmpty() ? 0 : m_tileY)->begin(m_support))
+	m_currTile(m_tileArray->getTile(support.sx.isEmpty() ? 0 : m_tileX,
+				support.sy.isEmpty() ? 0 : m_tileY)),
+	m_currPos(m_currTile->begin(m_support))
 {
 	// Make sure that inSupport() works correctly when the support is empty.
 	if(support.isEmpty())
@@ -630,9 +1001,6 @@ CqTileArray<T>::CqIterator::CqIterator(const CqTileArray<T>& tileArray,
 
 //------------------------------------------------------------------------------
 // CqTileArray<T>::CqStochasticIterator implementation
-template<typename T>
-CqRandom CqTileArray<T>::CqStochasticIterator::m_random;
-
 template<typename T>
 inline typename CqTileArray<T>::CqStochasticIterator&
 CqTileArray<T>::CqStochasticIterator::operator++()
@@ -681,16 +1049,20 @@ void CqTileArray<T>::CqStochasticIterator::nextTile()
 		// 2) For any fractional part of the desired samples which remains, we
 		//    accept an extra sample with probability proportional to the
 		//    fractional part.
-		// TODO: Investigate the performance impact of using RandomFloat() here.
-		numSamples += m_random.RandomFloat() < desiredSamples-numSamples;
+		//    The random number is hashed from the support and the tile, so
+		//    the iterator needs no shared random number state.
+		TqUint h = hashMix(hashMix(hashMix(hashMix(hashMix(hashMix(0,
+								m_support.sx.start), m_support.sx.end),
+							m_support.sy.start), m_support.sy.end), m_tileX), m_tileY);
+		numSamples += hashToUnitFloat(h) < desiredSamples-numSamples;
 		// Note that this scheme is actually biased toward tiles which are
 		// found later in the support in the case that a very small number of
 		// samples is used.  This may not matter in practise...
 		m_remainingArea -= area;
 	}
 	// Grab the underlying iterator for the next tile
-	m_currPos = m_tileArray->getTile(m_tileX,m_tileY)->beginStochastic(m_support,
-			numSamples);
+	m_currTile = m_tileArray->getTile(m_tileX,m_tileY);
+	m_currPos = m_currTile->beginStochastic(m_support, numSamples);
 	m_remainingSamples -= numSamples;
 }
 
@@ -731,6 +1103,7 @@ CqTileArray<T>::CqStochasticIterator::CqStochasticIterator(const CqTileArray<T>&
 	m_tileY(support.sy.start/tileArray.m_tileHeight),
 	m_remainingArea(support.area()),
 	m_remainingSamples(numSamps),
+	m_currTile(),
 	m_currPos()
 {
 	// Make sure that inSupport() works correctly when the support region is
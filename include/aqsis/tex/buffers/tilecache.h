@@ -0,0 +1,297 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/**
+ * \file
+ *
+ * \brief A global cache limiting the memory used by texture tiles.
+ */
+
+#ifndef TILECACHE_H_INCLUDED
+#define TILECACHE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Interface for objects holding tiles which are managed by CqTileCache.
+ */
+class AQSIS_TEX_SHARE IqTileOwner
+{
+	public:
+		virtual ~IqTileOwner() {}
+		/** \brief Release the tile with the given index.
+		 *
+		 * This is called by the cache when the tile is chosen for eviction.
+		 * The owner should drop its reference to the tile and forget the
+		 * associated cache handle, but must not call CqTileCache::remove().
+		 * Any users of the tile which still hold a reference keep it alive
+		 * until they're done with it.
+		 *
+		 * The cache doesn't hold its own lock during the call, so the owner
+		 * is free to lock its tiles, and the call may come from any thread.
+		 * The call may therefore arrive after the owner has loaded the tile
+		 * again; owners should ignore it unless the generation matches the
+		 * handle they hold for the tile.
+		 *
+		 * \param tileIndex - index of the tile, as passed to CqTileCache::insert()
+		 * \param generation - generation of the handle returned by insert()
+		 */
+		virtual void evictTile(TqInt tileIndex, TqUlong generation) = 0;
+};
+
+
+/// Counters describing the use of the tile cache.
+struct SqTileCacheStats
+{
+	/// Number of tile lookups which found the tile already loaded.
+	TqUlong hits;
+	/// Number of tiles which had to be loaded.
+	TqUlong misses;
+	/// Number of tiles evicted to keep within the memory limit.
+	TqUlong evictions;
+	/// Largest amount of tile memory in use at once.
+	std::size_t peakMemory;
+
+	SqTileCacheStats();
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Cache limiting the total memory used by texture tiles.
+ *
+ * Tiles from all open texture files are registered with a single cache, which
+ * evicts tiles when the total size of the loaded tiles would exceed the
+ * memory limit.  Tiles to evict are chosen using the CLOCK algorithm: each
+ * access to a tile marks it as referenced, and the clock hand sweeps around
+ * the tiles evicting the first one which hasn't been referenced since the
+ * hand last passed.  This approximates least recently used eviction, but
+ * marking a tile as used is very cheap.
+ *
+ * All methods may be called concurrently.  touch() is lock free since it's
+ * called for every tile access; inserting and removing tiles takes a lock.
+ *
+ * Slots are reused for new tiles once their tile is evicted or removed, so
+ * owners refer to their tiles with a handle holding the slot and the
+ * generation of the tile in it.  Stale handles are ignored by remove().
+ */
+class AQSIS_TEX_SHARE CqTileCache : boost::noncopyable
+{
+	public:
+		/// Cache record for a single tile.
+		struct SqSlot;
+		/// Handle to a tile in the cache, returned from insert().
+		struct SqHandle
+		{
+			/// Slot holding the tile, or null for no tile.
+			SqSlot* slot;
+			/// Unique number identifying this insertion of a tile.
+			TqUlong generation;
+			SqHandle() : slot(0), generation(0) {}
+			SqHandle(SqSlot* slot, TqUlong generation)
+				: slot(slot), generation(generation) {}
+		};
+
+		/// Memory limit used when none is set explicitly (1 GiB)
+		static const std::size_t defaultMaxMemory = 1024*1024*1024;
+
+		/** \brief Construct an empty tile cache.
+		 *
+		 * \param maxMemory - maximum number of bytes of tile data to hold.
+		 */
+		CqTileCache(std::size_t maxMemory = defaultMaxMemory);
+		~CqTileCache();
+
+		/// Get the cache which is shared by all tiled textures.
+		static CqTileCache& instance();
+
+		//--------------------------------------------------
+		/// \name Memory limits
+		//@{
+		/** \brief Set the maximum memory for tiles, evicting tiles if necessary.
+		 *
+		 * \param maxMemory - maximum number of bytes of tile data to hold.
+		 */
+		void setMaxMemory(std::size_t maxMemory);
+		/// Get the maximum memory for tiles.
+		std::size_t maxMemory() const;
+		/// Get the memory used by the tiles currently in the cache.
+		std::size_t memoryUsed() const;
+		//@}
+
+		//--------------------------------------------------
+		/// \name Tile management
+		//@{
+		/** \brief Add a newly loaded tile to the cache.
+		 *
+		 * Other tiles are evicted first if the new tile would take the cache
+		 * over its memory limit.  The new tile itself is never evicted by this
+		 * call, even if it's larger than the memory limit, but may be evicted
+		 * by a concurrent insertion as soon as this returns.
+		 *
+		 * \param owner - owner of the tile, which will be asked to release it
+		 *                on eviction.
+		 * \param tileIndex - index identifying the tile to the owner.
+		 * \param size - size of the tile data in bytes.
+		 * \return The handle for the tile, to be passed to touch() and
+		 * remove().
+		 */
+		SqHandle insert(IqTileOwner* owner, TqInt tileIndex, std::size_t size);
+		/** \brief Mark a tile as recently used.
+		 *
+		 * Slots are never deallocated while the cache exists, so it's safe to
+		 * touch a stale handle; at worst this keeps the tile which now uses
+		 * the slot a little longer.
+		 *
+		 * \param handle - handle returned from insert()
+		 */
+		void touch(const SqHandle& handle);
+		/** \brief Remove a tile from the cache without evicting it.
+		 *
+		 * This should be called by owners when they release a tile of their
+		 * own accord, for instance on destruction.  Nothing is done if the
+		 * tile has already been evicted, even when its slot has been reused.
+		 *
+		 * \param owner - owner of the tile, as passed to insert()
+		 * \param handle - handle returned from insert()
+		 */
+		void remove(IqTileOwner* owner, const SqHandle& handle);
+		/** \brief Wait until any evictions of the owner's tiles are finished.
+		 *
+		 * Evictions are delivered without the cache lock held, so a tile may
+		 * have been chosen for eviction just before its owner removed it.
+		 * Owners must call this before being destroyed, after removing their
+		 * tiles.
+		 */
+		void waitForEvictions(IqTileOwner* owner);
+		//@}
+
+		//--------------------------------------------------
+		/// \name Statistics
+		//@{
+		/// Get the counters for the cache.
+		SqTileCacheStats stats() const;
+		/// Reset the counters for the cache.
+		void resetStats();
+		//@}
+
+	private:
+		/// Tile chosen for eviction, to be released once the lock is dropped.
+		struct SqVictim
+		{
+			IqTileOwner* owner;
+			TqInt tileIndex;
+			TqUlong generation;
+		};
+
+		/** \brief Choose tiles to evict so there's space for the given number
+		 * of bytes.  Must be called with m_mutex held.
+		 */
+		void makeSpace(std::size_t required, std::vector<SqVictim>& victims);
+		/** \brief Ask the owners of the given tiles to release them.
+		 *
+		 * Must be called without m_mutex held for every set of victims from
+		 * makeSpace(), since owners may be waiting for them.
+		 */
+		void evict(const std::vector<SqVictim>& victims);
+		/// Release a slot, returning the memory it used.  Requires m_mutex.
+		void freeSlot(SqSlot* slot);
+
+		/// Protects everything except the hit count and slot reference flags.
+		mutable boost::mutex m_mutex;
+		/// Signalled when evictions chosen by makeSpace() have been delivered.
+		boost::condition m_evictionsDone;
+		/// Owners of the tiles chosen for eviction and not yet released.
+		std::vector<IqTileOwner*> m_evicting;
+		/// Records for all tiles, in clock order.
+		std::vector<SqSlot*> m_slots;
+		/// Unused slots, available for reuse.
+		std::vector<SqSlot*> m_freeSlots;
+		/// Current position of the clock hand in m_slots.
+		TqInt m_clockHand;
+		std::size_t m_maxMemory;
+		std::size_t m_memoryUsed;
+		/// Generation of the most recently inserted tile.
+		TqUlong m_lastGeneration;
+		/// Usage counters, except for the hits.
+		SqTileCacheStats m_stats;
+		/// Number of hits, updated without locking.
+		boost::detail::atomic_count m_hits;
+		/// Value of m_hits when the stats were last reset.
+		long m_hitsAtReset;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+struct CqTileCache::SqSlot
+{
+	/// Owner of the tile, or null for an unused slot.
+	IqTileOwner* owner;
+	TqInt tileIndex;
+	/// Generation of the tile in the slot, or 0 for an unused slot.
+	TqUlong generation;
+	std::size_t size;
+	/// True if the tile has been used since the clock hand passed.
+	volatile bool referenced;
+};
+
+inline SqTileCacheStats::SqTileCacheStats()
+	: hits(0),
+	misses(0),
+	evictions(0),
+	peakMemory(0)
+{ }
+
+inline void CqTileCache::touch(const SqHandle& handle)
+{
+	assert(handle.slot);
+	// Races here are harmless - at worst a tile is evicted slightly earlier
+	// or later than it should be.  Only writing the flag when it changes
+	// avoids bouncing the cache line between threads.
+	if(!handle.slot->referenced)
+		handle.slot->referenced = true;
+	++m_hits;
+}
+
+} // namespace Aqsis
+
+#endif // TILECACHE_H_INCLUDED
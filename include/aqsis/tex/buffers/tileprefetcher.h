@@ -0,0 +1,116 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+/**
+ * \file
+ *
+ * \brief Background reading of texture tiles.
+ */
+
+#ifndef TILEPREFETCHER_H_INCLUDED
+#define TILEPREFETCHER_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <aqsis/util/threadpool.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Worker threads which read texture tiles ahead of their use.
+ *
+ * Texture samplers work out which tiles a grid of shading points will need
+ * before filtering, and queue reads of the missing ones here.  The reads run
+ * on a small set of I/O threads which are separate from any rendering
+ * threads, so that decoding overlaps with shading.
+ *
+ * When aqsis is built without ENABLE_THREADING there are no I/O threads and
+ * the prefetcher is disabled; tiles are then read when first used as usual.
+ */
+class AQSIS_TEX_SHARE CqTilePrefetcher : boost::noncopyable
+{
+	public:
+		/// Number of I/O threads used by the shared prefetcher.
+		static const TqInt defaultNumThreads = 4;
+
+		/** \brief Start the I/O threads.
+		 *
+		 * \param numThreads - number of threads to read tiles with.
+		 */
+		CqTilePrefetcher(TqInt numThreads = defaultNumThreads);
+		/// Wait for any outstanding reads before stopping the threads.
+		~CqTilePrefetcher();
+
+		/// Get the prefetcher which is shared by all tiled textures.
+		static CqTilePrefetcher& instance();
+
+		/** \brief Determine whether reads may be run in the background.
+		 *
+		 * Callers should skip working out what to prefetch if this is false.
+		 */
+		bool enabled() const;
+
+		/** \brief Queue a tile read.
+		 *
+		 * Exceptions thrown by the task are discarded, so any error reading
+		 * the tile will surface again when the tile is actually used.
+		 *
+		 * \param task - function reading the tile.
+		 */
+		void run(const boost::function0<void>& task);
+		/** \brief Wait for all queued reads to finish.
+		 *
+		 * This must be called before destroying anything which queued reads
+		 * may refer to.
+		 */
+		void wait();
+
+	private:
+		/// Run a read, discarding any exception it throws.
+		static void runTask(const boost::function0<void>& task);
+
+		CqThreadPool m_pool;
+		CqTaskGroup m_tasks;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline bool CqTilePrefetcher::enabled() const
+{
+	return m_pool.numThreads() > 0;
+}
+
+} // namespace Aqsis
+
+#endif // TILEPREFETCHER_H_INCLUDED
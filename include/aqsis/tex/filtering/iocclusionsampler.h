@@ -66,6 +66,25 @@ class AQSIS_TEX_SHARE IqOcclusionSampler
 				const CqVector3D& normal, const CqShadowSampleOptions& sampleOpts,
 				TqFloat* outSamps) const = 0;
 
+		/** \brief Sample the texture over a batch of parallelogram regions
+		 *
+		 * This is equivalent to calling sample() for each region in turn,
+		 * but lets the sampler share work between the regions.  Shading code
+		 * uses it for all the points of a grid when the sample options don't
+		 * vary across the grid.
+		 *
+		 * The default implementation calls sample() for each region.
+		 *
+		 * \param regions - array of parallelograms to sample over
+		 * \param normals - surface normal for each region
+		 * \param numRegions - length of the regions and normals arrays
+		 * \param sampleOpts - options to the sampler, including filter widths etc.
+		 * \param outSamps - one sample for each region is placed here.
+		 */
+		virtual void sampleBatch(const Sq3DSamplePllgram* regions,
+				const CqVector3D* normals, TqInt numRegions,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		/** \brief Get the default sample options for this texture.
 		 *
 		 * The default implementation returns texture sample options
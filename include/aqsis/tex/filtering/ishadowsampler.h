@@ -82,6 +82,22 @@ class AQSIS_TEX_SHARE IqShadowSampler
 		 */
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
 
+		/** \brief Find how far a point lies behind the surface in the map.
+		 *
+		 * The distance is measured along the light-space z axis between the
+		 * point and the depths stored in the map near the projected position
+		 * of the point.  Only map depths which occlude the point contribute,
+		 * so the distance is zero for unoccluded points and never negative.
+		 *
+		 * The default implementation returns false.
+		 *
+		 * \param P - point in "current" coordinates.
+		 * \param depth - return parameter for the distance.
+		 * \return false if the point lies behind the light or outside the
+		 * map, in which case depth is left untouched.
+		 */
+		virtual bool depthBehindSurface(const CqVector3D& P, TqFloat& depth) const;
+
 		//--------------------------------------------------
 		/// \name Factory functions
 		//@{
@@ -91,6 +91,41 @@ class AQSIS_TEX_SHARE IqTextureSampler
 		virtual void sample(const SqSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const = 0;
 
+		/** \brief Filter the texture over a batch of parallelogram regions
+		 *
+		 * This is equivalent to calling sample() for each region in turn,
+		 * but lets the sampler share work between the regions.  Shading code
+		 * uses it for all the points of a grid when the sample options don't
+		 * vary across the grid.
+		 *
+		 * The default implementation calls sample() for each region.
+		 *
+		 * \param regions - array of parallelograms to sample over
+		 * \param numRegions - length of the regions array
+		 * \param sampleOpts - options to the sampler, including filter widths etc.
+		 * \param outSamps - sampleOpts.numChannels() samples for each region
+		 *                   are placed here.
+		 */
+		virtual void sampleBatch(const SqSamplePllgram* regions,
+				TqInt numRegions, const CqTextureSampleOptions& sampleOpts,
+				TqFloat* outSamps) const;
+
+		/** \brief Start reading the texture data for a set of regions.
+		 *
+		 * Shading code calls this with the filter regions for a whole grid
+		 * before sampling them, so that the texture data can be read in the
+		 * background while other shading work proceeds.  It's only a hint:
+		 * the results of sample() are the same whether or not it's called.
+		 *
+		 * The default implementation does nothing.
+		 *
+		 * \param regions - array of parallelograms which will be sampled soon
+		 * \param numRegions - length of the regions array
+		 * \param sampleOpts - options which will be used for sampling.
+		 */
+		virtual void prefetch(const SqSamplePllgram* regions, TqInt numRegions,
+				const CqTextureSampleOptions& sampleOpts) const;
+
 		/** \brief Get the default sample options for this texture.
 		 *
 		 * The default implementation returns texture sample options
@@ -0,0 +1,133 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/**
+ * \file
+ *
+ * \brief A global limit on the number of open texture file handles.
+ */
+
+#ifndef FILEHANDLECACHE_H_INCLUDED
+#define FILEHANDLECACHE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <list>
+#include <map>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Interface for files whose handles are managed by CqFileHandleCache.
+ *
+ * Owners should reopen their handle transparently the next time they need it,
+ * and must keep any metadata they report (eg, headers) so that closing the
+ * handle is invisible to their users.
+ */
+class AQSIS_TEX_SHARE IqFileHandleOwner
+{
+	public:
+		virtual ~IqFileHandleOwner() {}
+		/** \brief Close the underlying file handle, unless it's in use.
+		 *
+		 * This may be called from any thread, and must not block: owners
+		 * which are busy reading from the handle should simply refuse.  The
+		 * cache holds its lock during the call, so owners mustn't call back
+		 * into the cache.
+		 *
+		 * \return false if the handle is in use and couldn't be closed.
+		 */
+		virtual bool closeHandle() = 0;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Cache limiting the number of texture files held open at once.
+ *
+ * Owners report each use of their handle with markUsed().  When more handles
+ * are open than the limit allows, the least recently used handles are closed.
+ * All methods may be called concurrently.
+ */
+class AQSIS_TEX_SHARE CqFileHandleCache : boost::noncopyable
+{
+	public:
+		/// Limit on the number of open files used when none is set explicitly.
+		static const TqInt defaultMaxOpenFiles = 512;
+
+		/** \brief Construct an empty cache.
+		 *
+		 * \param maxOpenFiles - maximum number of file handles to keep open.
+		 */
+		CqFileHandleCache(TqInt maxOpenFiles = defaultMaxOpenFiles);
+
+		/// Get the cache which is shared by all texture files.
+		static CqFileHandleCache& instance();
+
+		/// Set the maximum number of open files, closing some if necessary.
+		void setMaxOpenFiles(TqInt maxOpenFiles);
+		/// Get the maximum number of open files.
+		TqInt maxOpenFiles() const;
+		/// Get the number of files currently recorded as open.
+		TqInt numOpenFiles() const;
+
+		/** \brief Record that an owner has just used its file handle.
+		 *
+		 * This should be called whenever the handle is opened or used.  It
+		 * may close the handles of other owners, but never that of the
+		 * calling owner.
+		 */
+		void markUsed(IqFileHandleOwner* owner);
+		/** \brief Forget an owner, for instance when it's destroyed.
+		 *
+		 * Once this returns the cache won't call the owner again.
+		 */
+		void remove(IqFileHandleOwner* owner);
+
+	private:
+		typedef std::list<IqFileHandleOwner*> TqLruList;
+		typedef std::map<IqFileHandleOwner*, TqLruList::iterator> TqOwnerMap;
+
+		/// Close handles until the limit is respected; m_mutex must not be held.
+		void closeExcess(IqFileHandleOwner* current);
+
+		mutable boost::mutex m_mutex;
+		/// Owners with open handles, most recently used first.
+		TqLruList m_lruList;
+		/// Position of each owner in m_lruList.
+		TqOwnerMap m_owners;
+		TqInt m_maxOpenFiles;
+};
+
+} // namespace Aqsis
+
+#endif // FILEHANDLECACHE_H_INCLUDED
@@ -146,6 +146,25 @@ class AQSIS_TEX_SHARE IqTiledTexInputFile
 		void readTile(ArrayT& buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx) const;
 
+		/** \brief Direct access to tile data held in memory by the file.
+		 *
+		 * File types which keep their tiles uncompressed in memory (for
+		 * instance by mapping the file) can hand out the tile data in place
+		 * rather than copying it with readTile().  The layout is the same as
+		 * the data placed in the buffer by readTile().
+		 *
+		 * The default implementation returns null, meaning that readTile()
+		 * must be used.
+		 *
+		 * \param tileX - horizontal tile coordinate, starting from 0 in the top left.
+		 * \param tileY - vertical tile coordinate, starting from 0 in the top left.
+		 * \param subImageIdx - subimage index of the tile.
+		 * \return The tile data, or null.  The data remains valid for as long
+		 * as the returned pointer is held.
+		 */
+		virtual boost::shared_ptr<const TqUint8> mappedTile(TqInt tileX,
+				TqInt tileY, TqInt subImageIdx) const;
+
 		/** \brief Open a tiled input file.
 		 *
 		 * Uses magic numbers to determine the file format of the file given by
@@ -209,7 +228,7 @@ void IqTiledTexInputFile::readTile(ArrayT& buffer, TqInt tileX, TqInt tileY,
 	assert(tInfo.height > 0);
 	assert(subImageIdx >= 0);
 	assert(subImageIdx < numSubImages());
-	buffer.resize(tInfo.width, tInfo.height, header().channelList());
+	buffer.resize(tInfo.width, tInfo.height, header(subImageIdx).channelList());
 	readTileImpl(buffer.rawData(), tileX, tileY, subImageIdx, tInfo);
 }
 
@@ -84,6 +84,8 @@ enum EqTextureFormat
 	TextureFormat_LatLongEnvironment,
 	TextureFormat_Shadow,
 	TextureFormat_Occlusion,
+	/// min/max depth pyramid level following a shadow map subimage
+	TextureFormat_ShadowDepthRange,
 	TextureFormat_Unknown
 };
 
@@ -79,6 +79,12 @@ struct SqFilterInfo
  * input file, so stuff like transformation matrices will be preserved where
  * possible.
  *
+ * The string parameter "format" selects the output container for this and
+ * the other texture creation functions.  "tiff" (the default) gives a tiled
+ * TIFF file, while "aqsistex" gives an uncompressed aqsis texture file which
+ * the renderer maps into memory rather than reading, so that its tiles are
+ * shared between render processes.
+ *
  * \param inFileName - full path to the input texture file.
  * \param outFileName - full path to the output texture map file.
  * \param filterInfo - information about which filter type and size to use
@@ -169,6 +175,12 @@ AQSIS_TEX_SHARE void makeLatLongEnvironment(
  * input file where possible so the transformation matrices (among other
  * things) are preserved where possible.
  *
+ * If the float parameter "depthrange" is nonzero, the depth map is followed
+ * by a pyramid of subimages holding the minimum and maximum depth over
+ * successively larger blocks of the map.  Shadow lookups use these to skip
+ * percentage closer filtering for regions which are wholly lit or wholly in
+ * shadow.
+ *
  * \param inFileName - full path to the input texture file.
  * \param outFileName - full path to the output texture map file.
  * \param paramList - A renderman param list of extra optional control
@@ -247,6 +247,13 @@ class AQSIS_UTIL_SHARE CqBitVector
 		{
 			return ( m_aBits );
 		}
+		/** Get a pointer to the ints representing the bitvector.
+		 * \return a pointer to the char array.
+		 */
+		const bit* IntArray() const
+		{
+			return ( m_aBits );
+		}
 		/** Get the number of bytes required to represent the specified number of bits.
 		 * \param size the required size of the bitvector.
 		 * \return an integer count of bytes needed.
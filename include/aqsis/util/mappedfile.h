@@ -0,0 +1,83 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Read-only memory mapping of whole files.
+ */
+
+#ifndef AQSIS_MAPPEDFILE_H_INCLUDED
+#define AQSIS_MAPPEDFILE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief A file mapped read-only into memory.
+ *
+ * The whole file is mapped on construction and unmapped again on destruction,
+ * so pages are only read from disk as they are touched, and are shared
+ * between all processes mapping the same file.  The system specific parts
+ * live in posix/mappedfile_system.cpp and win32/mappedfile_system.cpp.
+ */
+class AQSIS_UTIL_SHARE CqMappedFile : boost::noncopyable
+{
+	public:
+		/** \brief Map the named file into memory.
+		 *
+		 * \throw XqInvalidFile if the file can't be opened or mapped.
+		 */
+		CqMappedFile(const std::string& fileName);
+		~CqMappedFile();
+
+		/// Start of the file contents; null for an empty file.
+		const char* data() const;
+		/// Length of the file in bytes.
+		std::size_t size() const;
+
+	private:
+		const char* m_data;
+		std::size_t m_size;
+		/// System specific handle for the mapping.
+		void* m_handle;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline const char* CqMappedFile::data() const
+{
+	return m_data;
+}
+
+inline std::size_t CqMappedFile::size() const
+{
+	return m_size;
+}
+
+} // namespace Aqsis
+
+#endif // AQSIS_MAPPEDFILE_H_INCLUDED
@@ -29,6 +29,13 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<cstddef>
+#include	<vector>
+
+#include	<boost/noncopyable.hpp>
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/tss.hpp>
+
 namespace Aqsis {
 
 template <class T, TqInt CS=8>
@@ -124,6 +131,171 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 };
 
 
+//-----------------------------------------------------------------------
+/** \brief A fixed size object pool with a separate free list for each thread.
+ *
+ * Memory is carved out of large chunks as for CqObjectPool, but each thread
+ * allocates from and frees to its own free list, so no locking is needed in
+ * the common case.  The pool mutex is only taken when a thread's free list
+ * runs dry, and when a thread exits and hands its free list back to the pool.
+ *
+ * Objects may be freed by a different thread from the one which allocated
+ * them; the memory then migrates to the free list of the freeing thread.  To
+ * stop a thread which frees more than it allocates from hoarding memory, each
+ * free list is capped at two chunks worth of elements; beyond that, a chunk
+ * worth of elements is handed back to the shared pool under the mutex where
+ * any thread can pick it up.  Chunks are only returned to the system when the
+ * pool is destroyed.
+ */
+template <class T, TqInt CS=8>
+class CqThreadLocalObjectPool : boost::noncopyable
+{
+		struct SqLink
+		{
+			SqLink* m_next;
+		};
+		/// A singly linked list of free elements, with its length.
+		struct SqFreeList
+		{
+			SqLink* m_head;
+			std::size_t m_count;
+		};
+		/// Free list for a single thread.
+		struct SqThreadFreeList : SqFreeList
+		{
+			CqThreadLocalObjectPool* m_pool;
+		};
+		enum { chunkSize = CS*1024-16, };
+
+		const std::size_t m_esize;
+		/// Number of elements carved out of each chunk.
+		const std::size_t m_chunkElems;
+		/// All chunks allocated by the pool.
+		std::vector<char*> m_chunks;
+		/// Free lists handed back by threads, available to any thread.
+		std::vector<SqFreeList> m_orphans;
+		/// Protects m_chunks and m_orphans.
+		boost::mutex m_mutex;
+		/// Free list for the current thread.
+		boost::thread_specific_ptr<SqThreadFreeList> m_freeList;
+
+		/// Get the free list for the current thread, creating it if necessary.
+		SqThreadFreeList* freeList()
+		{
+			SqThreadFreeList* list = m_freeList.get();
+			if(!list)
+			{
+				list = new SqThreadFreeList();
+				list->m_pool = this;
+				list->m_head = 0;
+				list->m_count = 0;
+				m_freeList.reset(list);
+			}
+			return list;
+		}
+
+		/// Get a new list of free elements, from an orphaned list or a new chunk.
+		SqFreeList refill()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(!m_orphans.empty())
+			{
+				SqFreeList orphan = m_orphans.back();
+				m_orphans.pop_back();
+				return orphan;
+			}
+			char* start = new char[chunkSize];
+			m_chunks.push_back(start);
+			char* last = &start[(m_chunkElems-1)*m_esize];
+			for (char* p = start; p<last; p+=m_esize)
+				reinterpret_cast<SqLink*>(p)->m_next = reinterpret_cast<SqLink*>(p+m_esize);
+			reinterpret_cast<SqLink*>(last)->m_next = 0;
+			SqFreeList chunk;
+			chunk.m_head = reinterpret_cast<SqLink*>(start);
+			chunk.m_count = m_chunkElems;
+			return chunk;
+		}
+
+		/// Split a chunk worth of elements off the given free list and hand
+		/// them back to the pool.
+		void spill(SqFreeList* list)
+		{
+			SqFreeList surplus;
+			surplus.m_head = list->m_head;
+			surplus.m_count = m_chunkElems;
+			SqLink* tail = list->m_head;
+			for(std::size_t i = 1; i < m_chunkElems; ++i)
+				tail = tail->m_next;
+			list->m_head = tail->m_next;
+			list->m_count -= m_chunkElems;
+			tail->m_next = 0;
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_orphans.push_back(surplus);
+		}
+
+		/// Hand the free list of an exiting thread back to the pool.
+		static void releaseFreeList(SqThreadFreeList* list)
+		{
+			if(list->m_head)
+			{
+				boost::mutex::scoped_lock lock(list->m_pool->m_mutex);
+				list->m_pool->m_orphans.push_back(*list);
+			}
+			delete list;
+		}
+
+	public:
+		CqThreadLocalObjectPool()
+			: m_esize(sizeof(T)<sizeof(SqLink)?sizeof(SqLink):sizeof(T)),
+			m_chunkElems(chunkSize/m_esize),
+			m_chunks(),
+			m_orphans(),
+			m_mutex(),
+			m_freeList(&releaseFreeList)
+		{ }
+
+		~CqThreadLocalObjectPool() // free all chunks
+		{
+			// Release the free list of this thread while the pool is intact.
+			m_freeList.reset();
+			for(std::vector<char*>::iterator i = m_chunks.begin(); i != m_chunks.end(); ++i)
+				delete[] *i;
+		}
+
+		// See the note on CqObjectPool::alloc() regarding inlining.
+#		if AQSIS_COMPILER_GCC
+		__attribute__((noinline))
+#		endif
+		void* alloc()
+		{
+			SqThreadFreeList* list = freeList();
+			if(list->m_head==0)
+				static_cast<SqFreeList&>(*list) = refill();
+			SqLink* p = list->m_head;
+			list->m_head = p->m_next;
+			--list->m_count;
+			return(p);
+		}
+
+		void free(void* b)
+		{
+			SqThreadFreeList* list = freeList();
+			SqLink* p = static_cast<SqLink*>(b);
+			p->m_next = list->m_head;
+			list->m_head = p;
+			if(++list->m_count > 2*m_chunkElems)
+				spill(list);
+		}
+
+		/// Number of chunks allocated by the pool so far.
+		std::size_t numChunks()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			return m_chunks.size();
+		}
+};
+
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
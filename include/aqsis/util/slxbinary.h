@@ -0,0 +1,257 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Readers for the text and binary forms of compiled slx shaders.
+ *
+ * A binary slx file holds exactly the token sequence of the equivalent text
+ * file, but with the lexing already done: words are interned in a string
+ * table, numbers are stored already converted and string literals have their
+ * escapes decoded.  The layout is designed to be used in place from a memory
+ * mapped file:
+ *
+ * \verbatim
+ *   SqSlxBinaryHeader   header
+ *   TqUint32            stringOffsets[header.numStrings]
+ *   SqSlxBinaryToken    tokens[header.numTokens]
+ *   char                stringData[header.stringDataSize]
+ * \endverbatim
+ *
+ * Each string in stringData is nul terminated.  All values are stored in the
+ * byte order of the machine which wrote the file; files with a different
+ * byte order are rejected, and should be recompiled.
+ *
+ * Both the compiler, which writes the binary form, and the shader VM, which
+ * reads either form, use these classes, so they live in the util library.
+ */
+
+#ifndef SLXBINARY_H_INCLUDED
+#define SLXBINARY_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+namespace Aqsis {
+
+/// Version of the binary slx container, independent of AQSIS_SLX_VERSION.
+#define AQSIS_SLX_BINARY_VERSION 1
+
+/// Header at the start of a binary slx file.
+struct SqSlxBinaryHeader
+{
+	/// Always "AQSLXBIN".
+	char magic[8];
+	/// AQSIS_SLX_BINARY_VERSION of the writer.
+	TqUint32 version;
+	/// 0x01020304 in the byte order of the writer.
+	TqUint32 byteOrder;
+	TqUint32 numStrings;
+	TqUint32 numTokens;
+	TqUint32 stringDataSize;
+	TqUint32 reserved;
+};
+
+/// Kinds of token held in a binary slx file.
+enum EqSlxTokenType
+{
+	SlxToken_Word = 0,		///< Whitespace delimited word.
+	SlxToken_Number,		///< Word which may also be read as a number.
+	SlxToken_String			///< Quoted string literal.
+};
+
+/// A single token of a binary slx file.
+struct SqSlxBinaryToken
+{
+	/// EqSlxTokenType of the token.
+	TqUint32 type;
+	/// Index of the token text in the string table.
+	TqUint32 text;
+	/// Value of the word read as an integer, if it's numeric.
+	TqInt32 intValue;
+	/// Value of the word read as a float, if it's numeric.
+	TqFloat floatValue;
+};
+
+/** \brief Determine whether a block of memory holds a binary slx file.
+ *
+ * Only the magic number is checked; the rest of the file is validated by
+ * CqSlxBinaryReader.
+ */
+AQSIS_UTIL_SHARE bool isSlxBinary(const char* data, std::size_t size);
+
+/** \brief Convert a text slx program into the binary format.
+ *
+ * \param text - stream containing the text form of the compiled shader.
+ * \param out - binary stream to write the tokenised program to.
+ */
+AQSIS_UTIL_SHARE void slxTextToBinary(std::istream& text, std::ostream& out);
+
+//------------------------------------------------------------------------------
+/** \brief Sequential reader for the tokens of a binary slx file.
+ *
+ * The reader doesn't copy the data it's given, which must stay valid for the
+ * lifetime of the reader.  Strings returned by the reader point directly into
+ * the data.
+ */
+class AQSIS_UTIL_SHARE CqSlxBinaryReader
+{
+	public:
+		/** \brief Check the header and layout of a binary slx file.
+		 *
+		 * \throw XqInvalidFile if the data isn't a valid binary slx file
+		 * for this version of aqsis.
+		 */
+		CqSlxBinaryReader(const char* data, std::size_t size);
+
+		/// Determine whether all tokens have been read.
+		bool atEnd() const;
+
+		/** \brief Read the next token as a word.
+		 *
+		 * Numbers are also words, so they may be read this way too.
+		 *
+		 * \param id - if non-null, filled in with the index of the word in
+		 *             the string table.  Identical words have the same index.
+		 *
+		 * \throw XqInvalidFile if the next token isn't a word.
+		 */
+		const char* word(TqInt* id = 0);
+		//@{
+		/** \brief Read the next token as a number.
+		 *
+		 * \throw XqInvalidFile if the next token isn't numeric.
+		 */
+		TqFloat number();
+		TqInt integer();
+		//@}
+		/** \brief Read the next token as a decoded string literal.
+		 *
+		 * \throw XqInvalidFile if the next token isn't a string.
+		 */
+		const char* string();
+
+		/// Number of distinct strings in the file.
+		TqInt numStrings() const;
+
+	private:
+		const SqSlxBinaryToken& next(EqSlxTokenType minType, EqSlxTokenType maxType);
+
+		const TqUint32* m_stringOffsets;
+		const SqSlxBinaryToken* m_tokens;
+		const char* m_stringData;
+		TqInt m_numStrings;
+		TqInt m_numTokens;
+		TqInt m_pos;
+};
+
+//------------------------------------------------------------------------------
+/** \brief Sequential reader for the tokens of a text slx file.
+ *
+ * The interface is the same as CqSlxBinaryReader, so that the shader VM can
+ * load either form with the same code, but the text is tokenised as it's
+ * read instead of being converted to the binary form first.
+ *
+ * The data isn't copied and must stay valid for the lifetime of the reader.
+ * Strings returned by the reader are only valid until the next token is
+ * read.
+ */
+class AQSIS_UTIL_SHARE CqSlxTextReader
+{
+	public:
+		CqSlxTextReader(const char* data, std::size_t size);
+
+		/// Determine whether all tokens have been read.
+		bool atEnd();
+
+		/** \brief Read the next token as a word.
+		 *
+		 * \param id - if non-null, set to -1 since text files have no
+		 *             string table.
+		 *
+		 * \throw XqInvalidFile if the next token isn't a word.
+		 */
+		const char* word(TqInt* id = 0);
+		//@{
+		/** \brief Read the next token as a number.
+		 *
+		 * \throw XqInvalidFile if the next token isn't numeric.
+		 */
+		TqFloat number();
+		TqInt integer();
+		//@}
+		/** \brief Read the next token as a decoded string literal.
+		 *
+		 * \throw XqInvalidFile if the next token isn't a string.
+		 */
+		const char* string();
+
+		/// Text files have no string table, so this is always zero.
+		TqInt numStrings() const;
+
+		/** \brief Read the next token, whatever its type.
+		 *
+		 * \return SlxToken_String for string literals, and SlxToken_Word for
+		 * everything else, including numbers.  The text of the token is
+		 * available from token().
+		 */
+		EqSlxTokenType nextToken();
+		/// Text of the token most recently read.
+		const char* token() const;
+
+	private:
+		void skipSpace();
+		void readStringLiteral();
+		const char* numericWord();
+
+		const char* m_pos;
+		const char* m_end;
+		std::string m_token;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline bool CqSlxBinaryReader::atEnd() const
+{
+	return m_pos >= m_numTokens;
+}
+
+inline TqInt CqSlxBinaryReader::numStrings() const
+{
+	return m_numStrings;
+}
+
+inline TqInt CqSlxTextReader::numStrings() const
+{
+	return 0;
+}
+
+inline const char* CqSlxTextReader::token() const
+{
+	return m_token.c_str();
+}
+
+} // namespace Aqsis
+
+#endif // SLXBINARY_H_INCLUDED
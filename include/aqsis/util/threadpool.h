@@ -0,0 +1,199 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Persistent work-stealing thread pool.
+ */
+
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <deque>
+#include <vector>
+
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace Aqsis {
+
+class CqThreadPool;
+
+//------------------------------------------------------------------------------
+/** \brief A set of tasks run on a thread pool which may be waited on together.
+ *
+ * Typical use:
+ *
+ * \code
+ *   CqTaskGroup group(pool);
+ *   for(int i = 0; i < n; ++i)
+ *       group.run(boost::bind(&doWork, i));
+ *   group.wait();
+ * \endcode
+ *
+ * Tasks may themselves create task groups.  Waiting from inside a pool
+ * thread runs the thread's own queued tasks, or tasks queued by other pool
+ * threads, rather than blocking.
+ */
+class AQSIS_UTIL_SHARE CqTaskGroup : boost::noncopyable
+{
+	public:
+		/// Create an empty group of tasks which will run on the given pool.
+		CqTaskGroup(CqThreadPool& pool);
+		/// Wait for all tasks to finish, discarding any exceptions.
+		~CqTaskGroup();
+
+		/// Queue a task for execution.
+		void run(const boost::function0<void>& task);
+		/** \brief Wait until all tasks queued on the group have finished.
+		 *
+		 * If any of the tasks threw, the first exception is rethrown here.
+		 */
+		void wait();
+
+	private:
+		friend class CqThreadPool;
+		/// Called by the pool when one of our tasks has run.
+		void taskFinished(const boost::exception_ptr& error);
+		/// Determine whether all tasks queued on the group have finished.
+		bool finished();
+
+		CqThreadPool& m_pool;
+		/// Number of queued or running tasks.
+		TqInt m_pending;
+		/// First exception thrown by a task.
+		boost::exception_ptr m_error;
+		boost::mutex m_mutex;
+		boost::condition m_finished;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Fixed set of worker threads executing tasks from per-thread deques.
+ *
+ * Each worker owns a deque of tasks.  Tasks submitted from a worker go onto
+ * the back of its own deque and are run in LIFO order, which keeps nested
+ * work cache-warm; idle workers steal from the front of other deques (and of
+ * the shared queue used by non-pool threads) so that tasks of very uneven
+ * cost are balanced automatically.  Workers sleep when there's no work.
+ *
+ * When aqsis is built without ENABLE_THREADING the pool has no workers and
+ * tasks run immediately in the submitting thread.
+ */
+class AQSIS_UTIL_SHARE CqThreadPool : boost::noncopyable
+{
+	public:
+		/** \brief Start the worker threads.
+		 *
+		 * \param numThreads - number of workers; values less than one select
+		 *                     the number of hardware threads.
+		 */
+		CqThreadPool(TqInt numThreads);
+		/// Stop and join the workers.  All task groups must have finished.
+		~CqThreadPool();
+
+		/// Number of worker threads (zero when tasks run inline).
+		TqInt numThreads() const;
+		/// Number of hardware threads available to the process.
+		static TqInt hardwareThreads();
+
+	private:
+		friend class CqTaskGroup;
+
+		struct SqTask
+		{
+			boost::function0<void> func;
+			CqTaskGroup* group;
+		};
+		struct SqTaskQueue
+		{
+			boost::mutex mutex;
+			std::deque<SqTask> tasks;
+		};
+
+		/// Queue a task, onto the local deque if called from a worker.
+		void submit(const SqTask& task);
+		/// Run a task and notify its group.
+		static void runTask(SqTask& task);
+		/// Pop from the back of the calling worker's own deque.
+		bool popLocal(SqTask& task);
+		/** \brief Take a task from the front of any queue other than our own.
+		 *
+		 * \param includeShared - also take tasks queued by non-pool threads.
+		 */
+		bool steal(SqTask& task, TqInt thief, bool includeShared);
+		/** \brief Run tasks on behalf of a worker waiting for a task group.
+		 *
+		 * Tasks are taken from the worker's own deque, then from the other
+		 * workers' deques.  Tasks queued by non-pool threads are left alone,
+		 * since they may wait for work further down the waiting worker's
+		 * stack.  Sleeps when there's nothing to run.
+		 */
+		void helpUntilFinished(CqTaskGroup& group);
+		/// Wake workers waiting in helpUntilFinished() after a group finishes.
+		void notifyGroupFinished();
+		/// Determine whether the calling thread is a worker.
+		bool isWorker() const;
+		/// Main loop of each worker thread.
+		void workerLoop(TqInt index);
+
+		/// One deque per worker, plus a final shared queue for other threads.
+		std::vector<SqTaskQueue*> m_queues;
+		/// Index of the calling worker in m_queues.
+		boost::thread_specific_ptr<TqInt> m_workerIndex;
+		boost::thread_group m_threads;
+		TqInt m_numThreads;
+
+		/// Lock and condition used to put idle workers to sleep.
+		boost::mutex m_sleepMutex;
+		boost::condition m_workAvailable;
+		/// Number of tasks queued but not yet taken.
+		TqInt m_numQueued;
+		/// Number of those tasks which were queued by workers.
+		TqInt m_numWorkerQueued;
+		/// Signalled for workers waiting on a task group when workers queue
+		/// tasks, or when a group finishes.
+		boost::condition m_helpAvailable;
+		bool m_shutdown;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline TqInt CqThreadPool::numThreads() const
+{
+	return m_numThreads;
+}
+
+inline bool CqThreadPool::isWorker() const
+{
+	return m_workerIndex.get() != 0;
+}
+
+} // namespace Aqsis
+
+#endif // THREADPOOL_H_INCLUDED
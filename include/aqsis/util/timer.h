@@ -40,6 +40,7 @@
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/timer.hpp>
 
 namespace Aqsis {
@@ -65,6 +66,12 @@ class CqTimer
 		void start();
 		/// Stop the timer; accumulate time since start() was called into the total
 		void stop();
+		/** Accumulate a sample timed elsewhere into the total.
+		 *
+		 * Unlike start() and stop(), this may be called from several threads
+		 * at once.
+		 */
+		void addSample(double time);
 		/// Return total time counted by this timer between start() and stop() calls.
 		double totalTime() const;
 		/// Return average time between start() and stop() calls.
@@ -76,6 +83,7 @@ class CqTimer
 		double m_totalTime;    ///< total time
 		long m_numSamples;     ///< total number of samples
 		boost::timer m_timer;  ///< current timer
+		boost::mutex m_mutex;  ///< lock for the totals in addSample()
 };
 
 
@@ -138,6 +146,9 @@ class CqTimerSet
  *   // ...
  *
  * } // someTimer is automatically stopped here.
+ *
+ * The time for the scope is measured separately from the timer, so the same
+ * timer may be used by scopes running in several threads.
  */
 class CqScopeTimer
 {
@@ -146,6 +157,7 @@ class CqScopeTimer
 		~CqScopeTimer();
 	private:
 		CqTimer& m_timer;
+		boost::timer m_scopeTimer;
 };
 
 
@@ -182,6 +194,13 @@ inline double CqTimer::averageTime() const
 		return m_totalTime/m_numSamples;
 }
 
+inline void CqTimer::addSample(double time)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_totalTime += time;
+	++m_numSamples;
+}
+
 inline long CqTimer::numSamples() const
 {
 	return m_numSamples;
@@ -284,14 +303,13 @@ std::string CqTimerSet<EnumClassT>::timeToString(double time)
 //------------------------------------------------------------------------------
 // CqScopeTimer implementation
 inline CqScopeTimer::CqScopeTimer(CqTimer& timer)
-	: m_timer(timer)
-{
-	m_timer.start();
-}
+	: m_timer(timer),
+	m_scopeTimer()
+{ }
 
 inline CqScopeTimer::~CqScopeTimer()
 {
-	m_timer.stop();
+	m_timer.addSample(m_scopeTimer.elapsed());
 }
 
 } // namespace Aqsis
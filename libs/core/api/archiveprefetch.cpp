@@ -0,0 +1,2053 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Parsing of RIB archives in parallel with the main RIB stream.
+ */
+
+#include "archiveprefetch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <aqsis/riutil/errorhandler.h>
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ricxxutil.h>
+#include <aqsis/riutil/risyms.h>
+#include <aqsis/riutil/tokendictionary.h>
+#include <aqsis/util/exception.h>
+#include <aqsis/util/logging.h>
+#include <aqsis/util/threadpool.h>
+#include "../../riutil/ricxx_cache.h"
+
+#include "renderer.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Get the modification time of a file, or 0 if it can't be determined.
+std::time_t lastModified(const boost::filesystem::path& path)
+{
+	boost::system::error_code err;
+	std::time_t modified = boost::filesystem::last_write_time(path, err);
+	return err ? 0 : modified;
+}
+
+/// Get the size of a file, or 0 if it can't be determined.
+std::size_t fileSize(const boost::filesystem::path& path)
+{
+	boost::system::error_code err;
+	boost::uintmax_t size = boost::filesystem::file_size(path, err);
+	return err ? 0 : static_cast<std::size_t>(size);
+}
+
+/// True if the token is a bare name rather than an inline declaration.
+inline bool isBareName(const char* token)
+{
+	return !std::strpbrk(token, " \t\n\r");
+}
+
+//------------------------------------------------------------------------------
+/// An error report, kept in order with the surrounding deferred calls.
+class CachedError : public CachedRequest
+{
+	public:
+		CachedError(Ri::ErrorHandler& handler, int code,
+				const std::string& message)
+			: m_handler(handler),
+			m_code(code),
+			m_message(message)
+		{ }
+
+		virtual void reCall(Ri::Renderer& /*context*/) const
+		{
+			m_handler.log(m_code, "%s", m_message);
+		}
+		virtual size_t memoryUsage() const
+		{
+			return sizeof(*this) + m_message.capacity();
+		}
+
+	private:
+		Ri::ErrorHandler& m_handler;
+		int m_code;
+		std::string m_message;
+};
+
+
+/** \brief A procedural from a stream which is only replayed once.
+ *
+ * RiCache::Procedural keeps the procedural data so that it can be replayed
+ * any number of times, whereas this hands the data over to the renderer
+ * when replayed, as if the procedural had been passed straight on.
+ */
+class CachedProcedural : public CachedRequest
+{
+	public:
+		CachedProcedural(RtPointer data, RtConstBound bound,
+				RtProcSubdivFunc refineproc, RtProcFreeFunc freeproc)
+			: m_data(data),
+			m_bound(bound),
+			m_refineproc(refineproc),
+			m_freeproc(freeproc)
+		{ }
+		virtual ~CachedProcedural()
+		{
+			if(m_freeproc)
+				m_freeproc(m_data);
+		}
+
+		virtual void reCall(Ri::Renderer& context) const
+		{
+			RtProcFreeFunc freeproc = m_freeproc;
+			m_freeproc = 0;
+			context.Procedural(m_data, m_bound, m_refineproc, freeproc);
+		}
+		// The procedural data is opaque, so isn't counted.
+		virtual size_t memoryUsage() const
+		{
+			return sizeof(*this);
+		}
+
+	private:
+		RtPointer m_data;
+		RiCache::CachedFloatTuple<6> m_bound;
+		RtProcSubdivFunc m_refineproc;
+		/// Function to free the data, or null once the data is handed over.
+		mutable RtProcFreeFunc m_freeproc;
+};
+
+
+//------------------------------------------------------------------------------
+/// An archive read and parsed into memory, either on a worker thread or in
+/// place.
+struct SqArchiveJob : boost::noncopyable
+{
+	/// Name of the archive, as passed to ReadArchive.
+	std::string name;
+	/// Location of the archive file.
+	boost::filesystem::path path;
+	/** \brief Token dictionary for parsing, initially a copy of the
+	 * renderer's.  Released once parsed.
+	 */
+	boost::scoped_ptr<TokenDict> dict;
+
+	// The following are written by the worker thread once it has read the
+	// file, and may only be read after waitLoaded().
+
+	/// Modification time of the archive file.
+	std::time_t modified;
+	/// Size of the archive file.
+	std::size_t size;
+	/// Set if the archive file could be read.
+	bool readable;
+	/** \brief Set if the archive may change the token dictionary, either
+	 * with Declare or by reading further archives.
+	 */
+	bool mayDeclare;
+
+	// The following are written by the worker thread, and may only be read
+	// once the job has finished.
+
+	/// Parsed calls.
+	CachedRiStream calls;
+	/** \brief Bare token names which were looked up in the renderer's
+	 * dictionary, with the types they were found to have.
+	 *
+	 * Names declared by the archive before they were used aren't included.
+	 * Names which weren't found have type Ri::TypeSpec::Unknown.
+	 */
+	std::map<std::string, Ri::TypeSpec> usedNames;
+	/// Names declared by the archive.
+	std::set<std::string> declaredNames;
+	/// Set if the archive reads other archives.
+	bool hasNestedArchives;
+	/** \brief Set if the archive contains procedurals, which refer to data
+	 * held by the parsed calls.
+	 */
+	bool hasProcedurals;
+	/// Set if tokens were looked up after reading another archive.
+	bool lookupAfterNested;
+	/// Exception which aborted parsing, if any.
+	boost::exception_ptr error;
+
+	SqArchiveJob(const std::string& archiveName,
+			const boost::filesystem::path& archivePath)
+		: name(archiveName),
+		path(archivePath),
+		dict(),
+		modified(0),
+		size(0),
+		readable(false),
+		mayDeclare(true),
+		calls(name.c_str()),
+		usedNames(),
+		declaredNames(),
+		hasNestedArchives(false),
+		hasProcedurals(false),
+		lookupAfterNested(false),
+		error(),
+		m_loaded(false),
+		m_finished(false),
+		m_task()
+	{ }
+
+	/// Start parsing on the given pool.
+	void start(CqThreadPool& pool, Ri::ErrorHandler& errorHandler);
+	/// Parse on the calling thread.
+	void run(Ri::ErrorHandler& errorHandler)
+	{
+		parse(&errorHandler);
+	}
+	/// Wait until the archive file has been read.
+	void waitLoaded()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		while(!m_loaded)
+			m_loadedCond.wait(lock);
+	}
+	/// Return true if parsing has finished.
+	bool finished()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_finished;
+	}
+	/// Wait until parsing has finished.
+	void wait()
+	{
+		if(m_task)
+		{
+			m_task->wait();
+			// Finished jobs may be cached beyond the life of the pool.
+			m_task.reset();
+		}
+	}
+
+	private:
+		/// Read the archive file, returning false if it can't be read.
+		bool load(std::string& contents);
+		/// Read and parse the archive; run on a worker thread.
+		void parse(Ri::ErrorHandler* errorHandler);
+
+		boost::mutex m_mutex;
+		boost::condition m_loadedCond;
+		bool m_loaded;
+		bool m_finished;
+		// Declared last so that the destructor waits for the parse to finish
+		// before anything else is destroyed.
+		boost::scoped_ptr<CqTaskGroup> m_task;
+};
+
+
+/// Error handler recording errors from a worker parse into the call stream.
+class CqRecordingErrorHandler : public Ri::ErrorHandler
+{
+	public:
+		CqRecordingErrorHandler(CachedRiStream& calls, Ri::ErrorHandler& target)
+			: Ri::ErrorHandler(Debug),
+			m_calls(calls),
+			m_target(target)
+		{ }
+
+	protected:
+		virtual void dispatch(int code, const std::string& message)
+		{
+			m_calls.push_back(new CachedError(m_target, code, message));
+		}
+
+	private:
+		CachedRiStream& m_calls;
+		Ri::ErrorHandler& m_target;
+};
+
+
+/// Renderer recording parsed calls, and tracking changes to the dictionary.
+class CqArchiveRecorder : public CachingRenderer
+{
+	public:
+		CqArchiveRecorder(SqArchiveJob& job)
+			: CachingRenderer(job.calls),
+			m_job(job)
+		{ }
+
+		virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+		{
+			CachingRenderer::Declare(name, declaration);
+			m_job.declaredNames.insert(name);
+			try
+			{
+				if(declaration)
+					m_job.dict->declare(name, declaration);
+			}
+			catch(XqException& /*e*/)
+			{
+				// The renderer reports bad declarations when the call is
+				// replayed.
+			}
+		}
+		virtual RtVoid ReadArchive(RtConstToken name,
+							RtArchiveCallback callback,
+							const ParamList& pList)
+		{
+			CachingRenderer::ReadArchive(name, callback, pList);
+			m_job.hasNestedArchives = true;
+		}
+		virtual RtVoid Procedural(RtPointer data, RtConstBound bound,
+							RtProcSubdivFunc refineproc,
+							RtProcFreeFunc freeproc)
+		{
+			CachingRenderer::Procedural(data, bound, refineproc, freeproc);
+			m_job.hasProcedurals = true;
+		}
+
+	private:
+		SqArchiveJob& m_job;
+};
+
+
+/// Services for parsing an archive on a worker thread.
+class CqArchiveParseServices : public StubRendererServices
+{
+	public:
+		CqArchiveParseServices(SqArchiveJob& job, Ri::ErrorHandler& target)
+			: m_job(job),
+			m_recorder(job),
+			m_errorHandler(job.calls, target)
+		{ }
+
+		virtual Ri::ErrorHandler& errorHandler()
+		{
+			return m_errorHandler;
+		}
+		virtual RtFilterFunc getFilterFunc(RtConstToken name) const
+		{
+			return getFilterFuncByName(name);
+		}
+		virtual RtConstBasis* getBasis(RtConstToken name) const
+		{
+			return getBasisByName(name);
+		}
+		virtual RtErrorFunc getErrorFunc(RtConstToken name) const
+		{
+			return getErrorFuncByName(name);
+		}
+		virtual RtProcSubdivFunc getProcSubdivFunc(RtConstToken name) const
+		{
+			return getProcSubdivFuncByName(name);
+		}
+		virtual Ri::TypeSpec getDeclaration(RtConstToken token,
+										const char** nameBegin = 0,
+										const char** nameEnd = 0) const
+		{
+			if(!isBareName(token))
+				return m_job.dict->lookup(token, nameBegin, nameEnd);
+			if(m_job.hasNestedArchives)
+				m_job.lookupAfterNested = true;
+			if(m_job.declaredNames.count(token) || m_job.usedNames.count(token))
+				return m_job.dict->lookup(token, nameBegin, nameEnd);
+			// First use of a name from the renderer's dictionary.
+			Ri::TypeSpec& type = m_job.usedNames[token];
+			try
+			{
+				type = m_job.dict->lookup(token, nameBegin, nameEnd);
+			}
+			catch(XqValidation& /*e*/)
+			{
+				type = Ri::TypeSpec();
+				throw;
+			}
+			return type;
+		}
+		virtual Ri::Renderer& firstFilter()
+		{
+			return m_recorder;
+		}
+
+	private:
+		SqArchiveJob& m_job;
+		CqArchiveRecorder m_recorder;
+		CqRecordingErrorHandler m_errorHandler;
+};
+
+
+void SqArchiveJob::start(CqThreadPool& pool, Ri::ErrorHandler& errorHandler)
+{
+	m_task.reset(new CqTaskGroup(pool));
+	m_task->run(boost::bind(&SqArchiveJob::parse, this, &errorHandler));
+}
+
+bool SqArchiveJob::load(std::string& contents)
+{
+	modified = lastModified(path);
+	boost::filesystem::ifstream archiveFile(path, std::ios::binary);
+	if(!archiveFile)
+		return false;
+	archiveFile.seekg(0, std::ios::end);
+	std::streamoff fileLength = archiveFile.tellg();
+	archiveFile.seekg(0, std::ios::beg);
+	if(fileLength > 0)
+	{
+		contents.resize(fileLength);
+		archiveFile.read(&contents[0], fileLength);
+		contents.resize(archiveFile.gcount());
+	}
+	size = contents.size();
+	// Compressed archives can't be scanned without decompressing them, so
+	// are conservatively assumed to declare tokens.
+	bool compressed = contents.size() >= 2
+		&& static_cast<unsigned char>(contents[0]) == 0x1f
+		&& static_cast<unsigned char>(contents[1]) == 0x8b;
+	mayDeclare = compressed || contents.find("Declare") != std::string::npos
+		|| contents.find("ReadArchive") != std::string::npos;
+	return true;
+}
+
+void SqArchiveJob::parse(Ri::ErrorHandler* errorHandler)
+{
+	std::string contents;
+	try
+	{
+		readable = load(contents);
+	}
+	catch(...)
+	{
+		error = boost::current_exception();
+	}
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_loaded = true;
+		m_loadedCond.notify_all();
+	}
+	if(readable)
+	{
+		try
+		{
+			std::istringstream in(contents);
+			std::string().swap(contents);
+			CqArchiveParseServices services(*this, *errorHandler);
+			boost::scoped_ptr<RibParser> parser(RibParser::create(services));
+			parser->parseStream(in, name, services.firstFilter());
+		}
+		catch(...)
+		{
+			error = boost::current_exception();
+		}
+	}
+	dict.reset();
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_finished = true;
+}
+
+
+//------------------------------------------------------------------------------
+class CqArchivePrefetcherImpl : public CqArchivePrefetcher
+{
+	public:
+		CqArchivePrefetcherImpl()
+			: m_pool(),
+			m_deferred(),
+			m_deferredBase(0),
+			m_declarers(),
+			m_numJobs(0),
+			m_maxJobs(0),
+			m_currentJob(),
+			m_cache(),
+			m_cacheOrder(),
+			m_cacheSize(0),
+			m_pinnedJobs(),
+			m_parseDepth(0),
+			m_flushing(false),
+			m_warnedNoThreads(false)
+		{ }
+
+		//--------------------------------------------------
+		// from CqArchivePrefetcher
+		virtual void beginParse()
+		{
+			++m_parseDepth;
+		}
+		virtual void endParse()
+		{
+			--m_parseDepth;
+			if(m_parseDepth == 0 && !m_flushing)
+				flush(m_deferred.size());
+		}
+		virtual void syncDeclaration(const char* token);
+		virtual bool deferError(int code, const std::string& message)
+		{
+			if(!deferring())
+				return false;
+			defer(new CachedError(services().errorHandler(), code, message));
+			return true;
+		}
+		virtual bool replayArchive(const char* name,
+				const boost::filesystem::path& path, Ri::Renderer& context);
+
+		//--------------------------------------------------
+		// from Ri::Renderer
+		virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+		{
+			// The parser needs the dictionary to be up to date, so
+			// declarations can't be deferred.
+			if(deferring())
+			{
+				// Archives read while flushing may reuse the parser, which
+				// owns the arguments, so they're copied first.
+				RiCache::Declare request(name, declaration);
+				flush(m_deferred.size());
+				request.reCall(nextFilter());
+			}
+			else
+				nextFilter().Declare(name, declaration);
+		}
+		virtual RtVoid ReadArchive(RtConstToken name,
+							RtArchiveCallback callback,
+							const ParamList& pList);
+		virtual RtVoid WorldEnd()
+		{
+			// Rendering may read further archives via procedurals.
+			if(deferring())
+				defer(new CachedWorldEnd(*this), true);
+			else
+			{
+				// Procedurals must be expanded immediately, so pass all
+				// calls straight through while rendering.
+				bool flushing = m_flushing;
+				m_flushing = true;
+				try
+				{
+					nextFilter().WorldEnd();
+				}
+				catch(...)
+				{
+					m_flushing = flushing;
+					m_pinnedJobs.clear();
+					throw;
+				}
+				m_flushing = flushing;
+				// The renderer has finished with the procedurals.
+				m_pinnedJobs.clear();
+			}
+		}
+		virtual RtVoid Procedural(RtPointer data, RtConstBound bound,
+		                    RtProcSubdivFunc refineproc,
+		                    RtProcFreeFunc freeproc)
+		{
+			if(deferring())
+				defer(new CachedProcedural(data, bound, refineproc, freeproc));
+			else
+				nextFilter().Procedural(data, bound, refineproc, freeproc);
+		}
+		virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
+		{
+			if(deferring())
+				defer(new RiCache::ArchiveRecord(type, string));
+			else
+				nextFilter().ArchiveRecord(type, string);
+		}
+
+		// Code generator for autogenerated method declarations
+		/*[[[cog
+		from codegenutils import *
+		riXml = parseXml(riXmlPath)
+		from Cheetah.Template import Template
+
+		exclude = set(('Declare', 'ReadArchive', 'WorldEnd', 'Procedural'))
+
+		methodTemplate = r'''
+		virtual $wrapDecl($riCxxMethodDecl($proc), 72, wrapIndent=20)
+		{
+			if(deferring())
+				defer(new RiCache::${procName}($callArgs));
+			else
+				nextFilter().${procName}($callArgs);
+		}
+		'''
+
+		for proc in riXml.findall('Procedures/Procedure'):
+			procName = proc.findtext('Name')
+			if proc.findall('Rib') and procName not in exclude:
+				callArgs = ', '.join(wrapperCallArgList(proc))
+				cog.out(str(Template(methodTemplate, searchList=locals())));
+
+		]]]*/
+
+		virtual RtVoid FrameBegin(RtInt number)
+		{
+			if(deferring())
+				defer(new RiCache::FrameBegin(number));
+			else
+				nextFilter().FrameBegin(number);
+		}
+
+		virtual RtVoid FrameEnd()
+		{
+			if(deferring())
+				defer(new RiCache::FrameEnd());
+			else
+				nextFilter().FrameEnd();
+		}
+
+		virtual RtVoid WorldBegin()
+		{
+			if(deferring())
+				defer(new RiCache::WorldBegin());
+			else
+				nextFilter().WorldBegin();
+		}
+
+		virtual RtVoid IfBegin(RtConstString condition)
+		{
+			if(deferring())
+				defer(new RiCache::IfBegin(condition));
+			else
+				nextFilter().IfBegin(condition);
+		}
+
+		virtual RtVoid ElseIf(RtConstString condition)
+		{
+			if(deferring())
+				defer(new RiCache::ElseIf(condition));
+			else
+				nextFilter().ElseIf(condition);
+		}
+
+		virtual RtVoid Else()
+		{
+			if(deferring())
+				defer(new RiCache::Else());
+			else
+				nextFilter().Else();
+		}
+
+		virtual RtVoid IfEnd()
+		{
+			if(deferring())
+				defer(new RiCache::IfEnd());
+			else
+				nextFilter().IfEnd();
+		}
+
+		virtual RtVoid Format(RtInt xresolution, RtInt yresolution,
+		                    RtFloat pixelaspectratio)
+		{
+			if(deferring())
+				defer(new RiCache::Format(xresolution, yresolution, pixelaspectratio));
+			else
+				nextFilter().Format(xresolution, yresolution, pixelaspectratio);
+		}
+
+		virtual RtVoid FrameAspectRatio(RtFloat frameratio)
+		{
+			if(deferring())
+				defer(new RiCache::FrameAspectRatio(frameratio));
+			else
+				nextFilter().FrameAspectRatio(frameratio);
+		}
+
+		virtual RtVoid ScreenWindow(RtFloat left, RtFloat right, RtFloat bottom,
+		                    RtFloat top)
+		{
+			if(deferring())
+				defer(new RiCache::ScreenWindow(left, right, bottom, top));
+			else
+				nextFilter().ScreenWindow(left, right, bottom, top);
+		}
+
+		virtual RtVoid CropWindow(RtFloat xmin, RtFloat xmax, RtFloat ymin,
+		                    RtFloat ymax)
+		{
+			if(deferring())
+				defer(new RiCache::CropWindow(xmin, xmax, ymin, ymax));
+			else
+				nextFilter().CropWindow(xmin, xmax, ymin, ymax);
+		}
+
+		virtual RtVoid Projection(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Projection(name, pList));
+			else
+				nextFilter().Projection(name, pList);
+		}
+
+		virtual RtVoid Clipping(RtFloat cnear, RtFloat cfar)
+		{
+			if(deferring())
+				defer(new RiCache::Clipping(cnear, cfar));
+			else
+				nextFilter().Clipping(cnear, cfar);
+		}
+
+		virtual RtVoid ClippingPlane(RtFloat x, RtFloat y, RtFloat z, RtFloat nx,
+		                    RtFloat ny, RtFloat nz)
+		{
+			if(deferring())
+				defer(new RiCache::ClippingPlane(x, y, z, nx, ny, nz));
+			else
+				nextFilter().ClippingPlane(x, y, z, nx, ny, nz);
+		}
+
+		virtual RtVoid DepthOfField(RtFloat fstop, RtFloat focallength,
+		                    RtFloat focaldistance)
+		{
+			if(deferring())
+				defer(new RiCache::DepthOfField(fstop, focallength, focaldistance));
+			else
+				nextFilter().DepthOfField(fstop, focallength, focaldistance);
+		}
+
+		virtual RtVoid Shutter(RtFloat opentime, RtFloat closetime)
+		{
+			if(deferring())
+				defer(new RiCache::Shutter(opentime, closetime));
+			else
+				nextFilter().Shutter(opentime, closetime);
+		}
+
+		virtual RtVoid PixelVariance(RtFloat variance)
+		{
+			if(deferring())
+				defer(new RiCache::PixelVariance(variance));
+			else
+				nextFilter().PixelVariance(variance);
+		}
+
+		virtual RtVoid PixelSamples(RtFloat xsamples, RtFloat ysamples)
+		{
+			if(deferring())
+				defer(new RiCache::PixelSamples(xsamples, ysamples));
+			else
+				nextFilter().PixelSamples(xsamples, ysamples);
+		}
+
+		virtual RtVoid PixelFilter(RtFilterFunc function, RtFloat xwidth,
+		                    RtFloat ywidth)
+		{
+			if(deferring())
+				defer(new RiCache::PixelFilter(function, xwidth, ywidth));
+			else
+				nextFilter().PixelFilter(function, xwidth, ywidth);
+		}
+
+		virtual RtVoid Exposure(RtFloat gain, RtFloat gamma)
+		{
+			if(deferring())
+				defer(new RiCache::Exposure(gain, gamma));
+			else
+				nextFilter().Exposure(gain, gamma);
+		}
+
+		virtual RtVoid Imager(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Imager(name, pList));
+			else
+				nextFilter().Imager(name, pList);
+		}
+
+		virtual RtVoid Quantize(RtConstToken type, RtInt one, RtInt min, RtInt max,
+		                    RtFloat ditheramplitude)
+		{
+			if(deferring())
+				defer(new RiCache::Quantize(type, one, min, max, ditheramplitude));
+			else
+				nextFilter().Quantize(type, one, min, max, ditheramplitude);
+		}
+
+		virtual RtVoid Display(RtConstToken name, RtConstToken type, RtConstToken mode,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Display(name, type, mode, pList));
+			else
+				nextFilter().Display(name, type, mode, pList);
+		}
+
+		virtual RtVoid Hider(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Hider(name, pList));
+			else
+				nextFilter().Hider(name, pList);
+		}
+
+		virtual RtVoid ColorSamples(const FloatArray& nRGB, const FloatArray& RGBn)
+		{
+			if(deferring())
+				defer(new RiCache::ColorSamples(nRGB, RGBn));
+			else
+				nextFilter().ColorSamples(nRGB, RGBn);
+		}
+
+		virtual RtVoid RelativeDetail(RtFloat relativedetail)
+		{
+			if(deferring())
+				defer(new RiCache::RelativeDetail(relativedetail));
+			else
+				nextFilter().RelativeDetail(relativedetail);
+		}
+
+		virtual RtVoid Option(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Option(name, pList));
+			else
+				nextFilter().Option(name, pList);
+		}
+
+		virtual RtVoid AttributeBegin()
+		{
+			if(deferring())
+				defer(new RiCache::AttributeBegin());
+			else
+				nextFilter().AttributeBegin();
+		}
+
+		virtual RtVoid AttributeEnd()
+		{
+			if(deferring())
+				defer(new RiCache::AttributeEnd());
+			else
+				nextFilter().AttributeEnd();
+		}
+
+		virtual RtVoid Color(RtConstColor Cq)
+		{
+			if(deferring())
+				defer(new RiCache::Color(Cq));
+			else
+				nextFilter().Color(Cq);
+		}
+
+		virtual RtVoid Opacity(RtConstColor Os)
+		{
+			if(deferring())
+				defer(new RiCache::Opacity(Os));
+			else
+				nextFilter().Opacity(Os);
+		}
+
+		virtual RtVoid TextureCoordinates(RtFloat s1, RtFloat t1, RtFloat s2,
+		                    RtFloat t2, RtFloat s3, RtFloat t3, RtFloat s4,
+		                    RtFloat t4)
+		{
+			if(deferring())
+				defer(new RiCache::TextureCoordinates(s1, t1, s2, t2, s3, t3, s4, t4));
+			else
+				nextFilter().TextureCoordinates(s1, t1, s2, t2, s3, t3, s4, t4);
+		}
+
+		virtual RtVoid LightSource(RtConstToken shadername, RtConstToken name,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::LightSource(shadername, name, pList));
+			else
+				nextFilter().LightSource(shadername, name, pList);
+		}
+
+		virtual RtVoid AreaLightSource(RtConstToken shadername, RtConstToken name,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::AreaLightSource(shadername, name, pList));
+			else
+				nextFilter().AreaLightSource(shadername, name, pList);
+		}
+
+		virtual RtVoid Illuminate(RtConstToken name, RtBoolean onoff)
+		{
+			if(deferring())
+				defer(new RiCache::Illuminate(name, onoff));
+			else
+				nextFilter().Illuminate(name, onoff);
+		}
+
+		virtual RtVoid Surface(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Surface(name, pList));
+			else
+				nextFilter().Surface(name, pList);
+		}
+
+		virtual RtVoid Displacement(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Displacement(name, pList));
+			else
+				nextFilter().Displacement(name, pList);
+		}
+
+		virtual RtVoid Atmosphere(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Atmosphere(name, pList));
+			else
+				nextFilter().Atmosphere(name, pList);
+		}
+
+		virtual RtVoid Interior(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Interior(name, pList));
+			else
+				nextFilter().Interior(name, pList);
+		}
+
+		virtual RtVoid Exterior(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Exterior(name, pList));
+			else
+				nextFilter().Exterior(name, pList);
+		}
+
+		virtual RtVoid ShaderLayer(RtConstToken type, RtConstToken name,
+		                    RtConstToken layername, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::ShaderLayer(type, name, layername, pList));
+			else
+				nextFilter().ShaderLayer(type, name, layername, pList);
+		}
+
+		virtual RtVoid ConnectShaderLayers(RtConstToken type, RtConstToken layer1,
+		                    RtConstToken variable1, RtConstToken layer2,
+		                    RtConstToken variable2)
+		{
+			if(deferring())
+				defer(new RiCache::ConnectShaderLayers(type, layer1, variable1, layer2, variable2));
+			else
+				nextFilter().ConnectShaderLayers(type, layer1, variable1, layer2, variable2);
+		}
+
+		virtual RtVoid ShadingRate(RtFloat size)
+		{
+			if(deferring())
+				defer(new RiCache::ShadingRate(size));
+			else
+				nextFilter().ShadingRate(size);
+		}
+
+		virtual RtVoid ShadingInterpolation(RtConstToken type)
+		{
+			if(deferring())
+				defer(new RiCache::ShadingInterpolation(type));
+			else
+				nextFilter().ShadingInterpolation(type);
+		}
+
+		virtual RtVoid Matte(RtBoolean onoff)
+		{
+			if(deferring())
+				defer(new RiCache::Matte(onoff));
+			else
+				nextFilter().Matte(onoff);
+		}
+
+		virtual RtVoid Bound(RtConstBound bound)
+		{
+			if(deferring())
+				defer(new RiCache::Bound(bound));
+			else
+				nextFilter().Bound(bound);
+		}
+
+		virtual RtVoid Detail(RtConstBound bound)
+		{
+			if(deferring())
+				defer(new RiCache::Detail(bound));
+			else
+				nextFilter().Detail(bound);
+		}
+
+		virtual RtVoid DetailRange(RtFloat offlow, RtFloat onlow, RtFloat onhigh,
+		                    RtFloat offhigh)
+		{
+			if(deferring())
+				defer(new RiCache::DetailRange(offlow, onlow, onhigh, offhigh));
+			else
+				nextFilter().DetailRange(offlow, onlow, onhigh, offhigh);
+		}
+
+		virtual RtVoid GeometricApproximation(RtConstToken type, RtFloat value)
+		{
+			if(deferring())
+				defer(new RiCache::GeometricApproximation(type, value));
+			else
+				nextFilter().GeometricApproximation(type, value);
+		}
+
+		virtual RtVoid Orientation(RtConstToken orientation)
+		{
+			if(deferring())
+				defer(new RiCache::Orientation(orientation));
+			else
+				nextFilter().Orientation(orientation);
+		}
+
+		virtual RtVoid ReverseOrientation()
+		{
+			if(deferring())
+				defer(new RiCache::ReverseOrientation());
+			else
+				nextFilter().ReverseOrientation();
+		}
+
+		virtual RtVoid Sides(RtInt nsides)
+		{
+			if(deferring())
+				defer(new RiCache::Sides(nsides));
+			else
+				nextFilter().Sides(nsides);
+		}
+
+		virtual RtVoid Identity()
+		{
+			if(deferring())
+				defer(new RiCache::Identity());
+			else
+				nextFilter().Identity();
+		}
+
+		virtual RtVoid Transform(RtConstMatrix transform)
+		{
+			if(deferring())
+				defer(new RiCache::Transform(transform));
+			else
+				nextFilter().Transform(transform);
+		}
+
+		virtual RtVoid ConcatTransform(RtConstMatrix transform)
+		{
+			if(deferring())
+				defer(new RiCache::ConcatTransform(transform));
+			else
+				nextFilter().ConcatTransform(transform);
+		}
+
+		virtual RtVoid Perspective(RtFloat fov)
+		{
+			if(deferring())
+				defer(new RiCache::Perspective(fov));
+			else
+				nextFilter().Perspective(fov);
+		}
+
+		virtual RtVoid Translate(RtFloat dx, RtFloat dy, RtFloat dz)
+		{
+			if(deferring())
+				defer(new RiCache::Translate(dx, dy, dz));
+			else
+				nextFilter().Translate(dx, dy, dz);
+		}
+
+		virtual RtVoid Rotate(RtFloat angle, RtFloat dx, RtFloat dy, RtFloat dz)
+		{
+			if(deferring())
+				defer(new RiCache::Rotate(angle, dx, dy, dz));
+			else
+				nextFilter().Rotate(angle, dx, dy, dz);
+		}
+
+		virtual RtVoid Scale(RtFloat sx, RtFloat sy, RtFloat sz)
+		{
+			if(deferring())
+				defer(new RiCache::Scale(sx, sy, sz));
+			else
+				nextFilter().Scale(sx, sy, sz);
+		}
+
+		virtual RtVoid Skew(RtFloat angle, RtFloat dx1, RtFloat dy1, RtFloat dz1,
+		                    RtFloat dx2, RtFloat dy2, RtFloat dz2)
+		{
+			if(deferring())
+				defer(new RiCache::Skew(angle, dx1, dy1, dz1, dx2, dy2, dz2));
+			else
+				nextFilter().Skew(angle, dx1, dy1, dz1, dx2, dy2, dz2);
+		}
+
+		virtual RtVoid CoordinateSystem(RtConstToken space)
+		{
+			if(deferring())
+				defer(new RiCache::CoordinateSystem(space));
+			else
+				nextFilter().CoordinateSystem(space);
+		}
+
+		virtual RtVoid CoordSysTransform(RtConstToken space)
+		{
+			if(deferring())
+				defer(new RiCache::CoordSysTransform(space));
+			else
+				nextFilter().CoordSysTransform(space);
+		}
+
+		virtual RtVoid TransformBegin()
+		{
+			if(deferring())
+				defer(new RiCache::TransformBegin());
+			else
+				nextFilter().TransformBegin();
+		}
+
+		virtual RtVoid TransformEnd()
+		{
+			if(deferring())
+				defer(new RiCache::TransformEnd());
+			else
+				nextFilter().TransformEnd();
+		}
+
+		virtual RtVoid Resource(RtConstToken handle, RtConstToken type,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Resource(handle, type, pList));
+			else
+				nextFilter().Resource(handle, type, pList);
+		}
+
+		virtual RtVoid ResourceBegin()
+		{
+			if(deferring())
+				defer(new RiCache::ResourceBegin());
+			else
+				nextFilter().ResourceBegin();
+		}
+
+		virtual RtVoid ResourceEnd()
+		{
+			if(deferring())
+				defer(new RiCache::ResourceEnd());
+			else
+				nextFilter().ResourceEnd();
+		}
+
+		virtual RtVoid Attribute(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Attribute(name, pList));
+			else
+				nextFilter().Attribute(name, pList);
+		}
+
+		virtual RtVoid Polygon(const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Polygon(pList));
+			else
+				nextFilter().Polygon(pList);
+		}
+
+		virtual RtVoid GeneralPolygon(const IntArray& nverts, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::GeneralPolygon(nverts, pList));
+			else
+				nextFilter().GeneralPolygon(nverts, pList);
+		}
+
+		virtual RtVoid PointsPolygons(const IntArray& nverts, const IntArray& verts,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::PointsPolygons(nverts, verts, pList));
+			else
+				nextFilter().PointsPolygons(nverts, verts, pList);
+		}
+
+		virtual RtVoid PointsGeneralPolygons(const IntArray& nloops,
+		                    const IntArray& nverts, const IntArray& verts,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::PointsGeneralPolygons(nloops, nverts, verts, pList));
+			else
+				nextFilter().PointsGeneralPolygons(nloops, nverts, verts, pList);
+		}
+
+		virtual RtVoid Basis(RtConstBasis ubasis, RtInt ustep, RtConstBasis vbasis,
+		                    RtInt vstep)
+		{
+			if(deferring())
+				defer(new RiCache::Basis(ubasis, ustep, vbasis, vstep));
+			else
+				nextFilter().Basis(ubasis, ustep, vbasis, vstep);
+		}
+
+		virtual RtVoid Patch(RtConstToken type, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Patch(type, pList));
+			else
+				nextFilter().Patch(type, pList);
+		}
+
+		virtual RtVoid PatchMesh(RtConstToken type, RtInt nu, RtConstToken uwrap,
+		                    RtInt nv, RtConstToken vwrap,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::PatchMesh(type, nu, uwrap, nv, vwrap, pList));
+			else
+				nextFilter().PatchMesh(type, nu, uwrap, nv, vwrap, pList);
+		}
+
+		virtual RtVoid NuPatch(RtInt nu, RtInt uorder, const FloatArray& uknot,
+		                    RtFloat umin, RtFloat umax, RtInt nv, RtInt vorder,
+		                    const FloatArray& vknot, RtFloat vmin, RtFloat vmax,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::NuPatch(nu, uorder, uknot, umin, umax, nv, vorder, vknot, vmin, vmax, pList));
+			else
+				nextFilter().NuPatch(nu, uorder, uknot, umin, umax, nv, vorder, vknot, vmin, vmax, pList);
+		}
+
+		virtual RtVoid TrimCurve(const IntArray& ncurves, const IntArray& order,
+		                    const FloatArray& knot, const FloatArray& min,
+		                    const FloatArray& max, const IntArray& n,
+		                    const FloatArray& u, const FloatArray& v,
+		                    const FloatArray& w)
+		{
+			if(deferring())
+				defer(new RiCache::TrimCurve(ncurves, order, knot, min, max, n, u, v, w));
+			else
+				nextFilter().TrimCurve(ncurves, order, knot, min, max, n, u, v, w);
+		}
+
+		virtual RtVoid SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices,
+		                    const IntArray& vertices, const TokenArray& tags,
+		                    const IntArray& nargs, const IntArray& intargs,
+		                    const FloatArray& floatargs,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::SubdivisionMesh(scheme, nvertices, vertices, tags, nargs, intargs, floatargs, pList));
+			else
+				nextFilter().SubdivisionMesh(scheme, nvertices, vertices, tags, nargs, intargs, floatargs, pList);
+		}
+
+		virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+		                    RtFloat thetamax, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Sphere(radius, zmin, zmax, thetamax, pList));
+			else
+				nextFilter().Sphere(radius, zmin, zmax, thetamax, pList);
+		}
+
+		virtual RtVoid Cone(RtFloat height, RtFloat radius, RtFloat thetamax,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Cone(height, radius, thetamax, pList));
+			else
+				nextFilter().Cone(height, radius, thetamax, pList);
+		}
+
+		virtual RtVoid Cylinder(RtFloat radius, RtFloat zmin, RtFloat zmax,
+		                    RtFloat thetamax, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Cylinder(radius, zmin, zmax, thetamax, pList));
+			else
+				nextFilter().Cylinder(radius, zmin, zmax, thetamax, pList);
+		}
+
+		virtual RtVoid Hyperboloid(RtConstPoint point1, RtConstPoint point2,
+		                    RtFloat thetamax, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Hyperboloid(point1, point2, thetamax, pList));
+			else
+				nextFilter().Hyperboloid(point1, point2, thetamax, pList);
+		}
+
+		virtual RtVoid Paraboloid(RtFloat rmax, RtFloat zmin, RtFloat zmax,
+		                    RtFloat thetamax, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Paraboloid(rmax, zmin, zmax, thetamax, pList));
+			else
+				nextFilter().Paraboloid(rmax, zmin, zmax, thetamax, pList);
+		}
+
+		virtual RtVoid Disk(RtFloat height, RtFloat radius, RtFloat thetamax,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Disk(height, radius, thetamax, pList));
+			else
+				nextFilter().Disk(height, radius, thetamax, pList);
+		}
+
+		virtual RtVoid Torus(RtFloat majorrad, RtFloat minorrad, RtFloat phimin,
+		                    RtFloat phimax, RtFloat thetamax,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Torus(majorrad, minorrad, phimin, phimax, thetamax, pList));
+			else
+				nextFilter().Torus(majorrad, minorrad, phimin, phimax, thetamax, pList);
+		}
+
+		virtual RtVoid Points(const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Points(pList));
+			else
+				nextFilter().Points(pList);
+		}
+
+		virtual RtVoid Curves(RtConstToken type, const IntArray& nvertices,
+		                    RtConstToken wrap, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Curves(type, nvertices, wrap, pList));
+			else
+				nextFilter().Curves(type, nvertices, wrap, pList);
+		}
+
+		virtual RtVoid Blobby(RtInt nleaf, const IntArray& code,
+		                    const FloatArray& floats, const TokenArray& strings,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Blobby(nleaf, code, floats, strings, pList));
+			else
+				nextFilter().Blobby(nleaf, code, floats, strings, pList);
+		}
+
+		virtual RtVoid Geometry(RtConstToken type, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::Geometry(type, pList));
+			else
+				nextFilter().Geometry(type, pList);
+		}
+
+		virtual RtVoid SolidBegin(RtConstToken type)
+		{
+			if(deferring())
+				defer(new RiCache::SolidBegin(type));
+			else
+				nextFilter().SolidBegin(type);
+		}
+
+		virtual RtVoid SolidEnd()
+		{
+			if(deferring())
+				defer(new RiCache::SolidEnd());
+			else
+				nextFilter().SolidEnd();
+		}
+
+		virtual RtVoid ObjectBegin(RtConstToken name)
+		{
+			if(deferring())
+				defer(new RiCache::ObjectBegin(name));
+			else
+				nextFilter().ObjectBegin(name);
+		}
+
+		virtual RtVoid ObjectEnd()
+		{
+			if(deferring())
+				defer(new RiCache::ObjectEnd());
+			else
+				nextFilter().ObjectEnd();
+		}
+
+		virtual RtVoid ObjectInstance(RtConstToken name)
+		{
+			if(deferring())
+				defer(new RiCache::ObjectInstance(name));
+			else
+				nextFilter().ObjectInstance(name);
+		}
+
+		virtual RtVoid MotionBegin(const FloatArray& times)
+		{
+			if(deferring())
+				defer(new RiCache::MotionBegin(times));
+			else
+				nextFilter().MotionBegin(times);
+		}
+
+		virtual RtVoid MotionEnd()
+		{
+			if(deferring())
+				defer(new RiCache::MotionEnd());
+			else
+				nextFilter().MotionEnd();
+		}
+
+		virtual RtVoid MakeTexture(RtConstString imagefile, RtConstString texturefile,
+		                    RtConstToken swrap, RtConstToken twrap,
+		                    RtFilterFunc filterfunc, RtFloat swidth,
+		                    RtFloat twidth, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::MakeTexture(imagefile, texturefile, swrap, twrap, filterfunc, swidth, twidth, pList));
+			else
+				nextFilter().MakeTexture(imagefile, texturefile, swrap, twrap, filterfunc, swidth, twidth, pList);
+		}
+
+		virtual RtVoid MakeLatLongEnvironment(RtConstString imagefile,
+		                    RtConstString reflfile, RtFilterFunc filterfunc,
+		                    RtFloat swidth, RtFloat twidth,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::MakeLatLongEnvironment(imagefile, reflfile, filterfunc, swidth, twidth, pList));
+			else
+				nextFilter().MakeLatLongEnvironment(imagefile, reflfile, filterfunc, swidth, twidth, pList);
+		}
+
+		virtual RtVoid MakeCubeFaceEnvironment(RtConstString px, RtConstString nx,
+		                    RtConstString py, RtConstString ny,
+		                    RtConstString pz, RtConstString nz,
+		                    RtConstString reflfile, RtFloat fov,
+		                    RtFilterFunc filterfunc, RtFloat swidth,
+		                    RtFloat twidth, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::MakeCubeFaceEnvironment(px, nx, py, ny, pz, nz, reflfile, fov, filterfunc, swidth, twidth, pList));
+			else
+				nextFilter().MakeCubeFaceEnvironment(px, nx, py, ny, pz, nz, reflfile, fov, filterfunc, swidth, twidth, pList);
+		}
+
+		virtual RtVoid MakeShadow(RtConstString picfile, RtConstString shadowfile,
+		                    const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::MakeShadow(picfile, shadowfile, pList));
+			else
+				nextFilter().MakeShadow(picfile, shadowfile, pList);
+		}
+
+		virtual RtVoid MakeOcclusion(const StringArray& picfiles,
+		                    RtConstString shadowfile, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::MakeOcclusion(picfiles, shadowfile, pList));
+			else
+				nextFilter().MakeOcclusion(picfiles, shadowfile, pList);
+		}
+
+		virtual RtVoid ErrorHandler(RtErrorFunc handler)
+		{
+			if(deferring())
+				defer(new RiCache::ErrorHandler(handler));
+			else
+				nextFilter().ErrorHandler(handler);
+		}
+
+		virtual RtVoid ArchiveBegin(RtConstToken name, const ParamList& pList)
+		{
+			if(deferring())
+				defer(new RiCache::ArchiveBegin(name, pList));
+			else
+				nextFilter().ArchiveBegin(name, pList);
+		}
+
+		virtual RtVoid ArchiveEnd()
+		{
+			if(deferring())
+				defer(new RiCache::ArchiveEnd());
+			else
+				nextFilter().ArchiveEnd();
+		}
+		///[[[end]]]
+
+	private:
+		/// A deferred call, and the prefetched archive if it's a ReadArchive.
+		struct SqDeferredCall
+		{
+			boost::shared_ptr<CachedRequest> request;
+			boost::shared_ptr<SqArchiveJob> job;
+		};
+		/// Deferred call which may change the token dictionary.
+		struct SqDeclarer
+		{
+			/// Position of the call, counting calls flushed before it.
+			TqInt position;
+			/// Prefetched archive, or null for other calls.
+			boost::shared_ptr<SqArchiveJob> job;
+		};
+
+		/// Parsed archive kept between frames.
+		struct SqCacheEntry
+		{
+			/// Name the archive was read with.
+			std::string name;
+			/// Modification time and size of the archive file.
+			std::time_t modified;
+			std::size_t size;
+			/// Memory held by the parsed archive.
+			std::size_t memory;
+			/// Parsed archive, or null if it can't be replayed.
+			boost::shared_ptr<SqArchiveJob> job;
+			/// Position in m_cacheOrder.
+			std::list<std::string>::iterator orderPos;
+		};
+		typedef std::map<std::string, SqCacheEntry> TqArchiveCache;
+
+		/// WorldEnd, replayed via the prefetcher so that it's seen here.
+		class CachedWorldEnd : public CachedRequest
+		{
+			public:
+				CachedWorldEnd(CqArchivePrefetcherImpl& prefetcher)
+					: m_prefetcher(prefetcher)
+				{ }
+				virtual void reCall(Ri::Renderer& /*context*/) const
+				{
+					m_prefetcher.WorldEnd();
+				}
+				virtual size_t memoryUsage() const
+				{
+					return sizeof(*this);
+				}
+			private:
+				CqArchivePrefetcherImpl& m_prefetcher;
+		};
+
+		/// True if calls should be deferred rather than passed on.
+		bool deferring() const
+		{
+			return !m_flushing && !m_deferred.empty();
+		}
+		/** \brief Add a call to the back of the deferred calls.
+		 *
+		 * \param mayDeclare - true if the call may change the token
+		 * dictionary.
+		 */
+		void defer(CachedRequest* request, bool mayDeclare = false);
+		/// Add a prefetched archive to the back of the deferred calls.
+		void deferJob(const boost::shared_ptr<CachedRequest>& request,
+				const boost::shared_ptr<SqArchiveJob>& job);
+		/** \brief Start parsing an archive in the background.
+		 *
+		 * \return the new job, or null if the archive can't be prefetched.
+		 */
+		boost::shared_ptr<SqArchiveJob> startJob(RtConstToken name);
+		/// Replay the first numCalls deferred calls.
+		void flush(TqInt numCalls);
+		/// Replay deferred calls until reaching an archive still being parsed.
+		void flushReady();
+		/** \brief Create a job to read and parse an archive file.
+		 *
+		 * The file is read by the job, so that file I/O happens on the
+		 * worker threads.
+		 */
+		boost::shared_ptr<SqArchiveJob> createJob(RtConstToken name,
+				const boost::filesystem::path& path) const;
+		/// Check that a job parsed with the declarations now current.
+		bool declarationsUnchanged(const SqArchiveJob& job) const;
+		/// Get the memory budget of the archive cache, in bytes.
+		std::size_t cacheBudget() const;
+		/** \brief Look up an archive in the cache.
+		 *
+		 * Entries for archives which have been modified since they were
+		 * cached are removed.
+		 *
+		 * \return the cache entry, or null if there isn't one.
+		 */
+		SqCacheEntry* findCached(RtConstToken name,
+				const boost::filesystem::path& path);
+		/** \brief Add an archive which has been read to the cache.
+		 *
+		 * The least recently used archives are evicted to keep within the
+		 * memory budget.
+		 */
+		void addToCache(const boost::shared_ptr<SqArchiveJob>& job);
+		/** \brief Remove a cache entry.
+		 *
+		 * Archives with procedurals replayed in the current world stay
+		 * alive until WorldEnd; see pinProcedurals().
+		 */
+		void removeFromCache(TqArchiveCache::iterator entry);
+		/** \brief Keep an archive containing procedurals until the end of
+		 * the world.
+		 *
+		 * Procedurals replayed from an archive refer to data held by the
+		 * parsed calls, so the archive mustn't be destroyed while the
+		 * renderer may still expand them.
+		 */
+		void pinProcedurals(const boost::shared_ptr<SqArchiveJob>& job);
+
+		// Declared first, so that jobs are destroyed before the pool.
+		boost::scoped_ptr<CqThreadPool> m_pool;
+		/// Calls waiting to be passed on, in order.
+		std::deque<SqDeferredCall> m_deferred;
+		/// Number of deferred calls flushed before the first in m_deferred.
+		TqInt m_deferredBase;
+		/** Deferred calls which may declare tokens, in order.  Archives are
+		 * removed once they're known not to declare anything.
+		 */
+		std::list<SqDeclarer> m_declarers;
+		/// Number of deferred calls which are prefetched archives.
+		TqInt m_numJobs;
+		/// Maximum number of archives to parse ahead.
+		TqInt m_maxJobs;
+		/// Prefetched archive for the ReadArchive currently being replayed.
+		boost::shared_ptr<SqArchiveJob> m_currentJob;
+		/// Parsed archives, by file path.
+		TqArchiveCache m_cache;
+		/// Paths of cached archives, most recently used first.
+		std::list<std::string> m_cacheOrder;
+		/// Total memory held by the cached archives.
+		std::size_t m_cacheSize;
+		/// Replayed archives containing procedurals, kept until WorldEnd.
+		std::vector<boost::shared_ptr<SqArchiveJob> > m_pinnedJobs;
+		/// Nesting depth of RIB parsing.
+		TqInt m_parseDepth;
+		/// True while deferred calls are being replayed or while rendering.
+		bool m_flushing;
+		bool m_warnedNoThreads;
+};
+
+
+RtVoid CqArchivePrefetcherImpl::ReadArchive(RtConstToken name,
+		RtArchiveCallback callback, const ParamList& pList)
+{
+	if(m_flushing || m_parseDepth == 0)
+	{
+		nextFilter().ReadArchive(name, callback, pList);
+		return;
+	}
+	// Archives read while flushing may reuse the parser, which owns the
+	// arguments, so they're copied first.
+	boost::shared_ptr<CachedRequest> request(
+			new RiCache::ReadArchive(name, callback, pList));
+	std::string archiveName = name;
+	boost::shared_ptr<SqArchiveJob> job = startJob(archiveName.c_str());
+	if(!job)
+	{
+		// Read the archive in place, so that any errors are reported by the
+		// parser with the position of the request.
+		flush(m_deferred.size());
+		request->reCall(nextFilter());
+		return;
+	}
+	deferJob(request, job);
+	// Bound the number of archives held in memory.
+	while(m_numJobs > m_maxJobs)
+		flush(1);
+	flushReady();
+}
+
+boost::shared_ptr<SqArchiveJob> CqArchivePrefetcherImpl::startJob(
+		RtConstToken name)
+{
+	boost::shared_ptr<SqArchiveJob> job;
+	const TqInt* threadsOpt = QGetRenderContext()->poptCurrent()->
+		GetIntegerOption("limits", "archivethreads");
+	if(!threadsOpt)
+		return job;
+#ifndef ENABLE_THREADING
+	if(!m_warnedNoThreads)
+	{
+		Aqsis::log() << warning << "Multithreading is not enabled in this "
+			"build, archives will be parsed serially" << std::endl;
+		m_warnedNoThreads = true;
+	}
+	return job;
+#else
+	TqInt numThreads = threadsOpt[0];
+	if(numThreads <= 0)
+		numThreads = CqThreadPool::hardwareThreads();
+	if(!m_pool || m_pool->numThreads() != numThreads)
+	{
+		// Jobs refer to the pool, so must finish before it's replaced.
+		flush(m_deferred.size());
+		m_pool.reset();
+		m_pool.reset(new CqThreadPool(numThreads));
+	}
+	m_maxJobs = 2*numThreads;
+
+	boost::filesystem::path path = QGetRenderContext()->poptCurrent()->
+		findRiFileNothrow(name, "archive");
+	if(path.empty())
+		return job;
+	// Archives cached by an earlier frame don't need parsing again.
+	SqCacheEntry* entry = findCached(name, path);
+	if(entry && entry->job)
+		return entry->job;
+	job = createJob(name, path);
+	job->start(*m_pool, services().errorHandler());
+	return job;
+#endif
+}
+
+boost::shared_ptr<SqArchiveJob> CqArchivePrefetcherImpl::createJob(
+		RtConstToken name, const boost::filesystem::path& path) const
+{
+	boost::shared_ptr<SqArchiveJob> job(new SqArchiveJob(name, path));
+	job->dict.reset(new TokenDict(QGetRenderContext()->tokenDict()));
+	return job;
+}
+
+void CqArchivePrefetcherImpl::defer(CachedRequest* request, bool mayDeclare)
+{
+	if(mayDeclare)
+	{
+		SqDeclarer declarer;
+		declarer.position = m_deferredBase + m_deferred.size();
+		m_declarers.push_back(declarer);
+	}
+	SqDeferredCall call;
+	call.request.reset(request);
+	m_deferred.push_back(call);
+	flushReady();
+}
+
+void CqArchivePrefetcherImpl::deferJob(
+		const boost::shared_ptr<CachedRequest>& request,
+		const boost::shared_ptr<SqArchiveJob>& job)
+{
+	SqDeclarer declarer;
+	declarer.position = m_deferredBase + m_deferred.size();
+	declarer.job = job;
+	m_declarers.push_back(declarer);
+	SqDeferredCall call;
+	call.request = request;
+	call.job = job;
+	m_deferred.push_back(call);
+	++m_numJobs;
+}
+
+void CqArchivePrefetcherImpl::flush(TqInt numCalls)
+{
+	m_flushing = true;
+	try
+	{
+		for(TqInt i = 0; i < numCalls && !m_deferred.empty(); ++i)
+		{
+			SqDeferredCall call = m_deferred.front();
+			m_deferred.pop_front();
+			++m_deferredBase;
+			if(!m_declarers.empty() && m_declarers.front().position < m_deferredBase)
+				m_declarers.pop_front();
+			if(call.job)
+				--m_numJobs;
+			m_currentJob = call.job;
+			try
+			{
+				call.request->reCall(nextFilter());
+			}
+			catch(XqException& e)
+			{
+				// Report errors the same way the parser would have.
+				services().errorHandler().error(e.code(), "%s", e.what());
+			}
+			m_currentJob.reset();
+		}
+		if(m_deferred.empty())
+			m_deferredBase = 0;
+	}
+	catch(...)
+	{
+		// Calls after the failure would never have been made.
+		m_deferred.clear();
+		m_deferredBase = 0;
+		m_declarers.clear();
+		m_numJobs = 0;
+		m_currentJob.reset();
+		m_flushing = false;
+		throw;
+	}
+	m_flushing = false;
+}
+
+void CqArchivePrefetcherImpl::flushReady()
+{
+	TqInt numReady = 0;
+	for(std::deque<SqDeferredCall>::iterator i = m_deferred.begin();
+			i != m_deferred.end(); ++i, ++numReady)
+	{
+		if(i->job && !i->job->finished())
+			break;
+	}
+	if(numReady > 0)
+		flush(numReady);
+}
+
+void CqArchivePrefetcherImpl::syncDeclaration(const char* token)
+{
+	if(!deferring() || !isBareName(token))
+		return;
+	// Find the last deferred call which may declare the token.
+	TqInt numToFlush = 0;
+	for(std::list<SqDeclarer>::iterator i = m_declarers.begin();
+			i != m_declarers.end(); )
+	{
+		if(SqArchiveJob* job = i->job.get())
+		{
+			job->waitLoaded();
+			if(!job->mayDeclare)
+			{
+				// The archive never needs checking again.
+				i = m_declarers.erase(i);
+				continue;
+			}
+			job->wait();
+			if(!job->hasNestedArchives && !job->declaredNames.count(token))
+			{
+				++i;
+				continue;
+			}
+		}
+		numToFlush = i->position - m_deferredBase + 1;
+		++i;
+	}
+	flush(numToFlush);
+}
+
+bool CqArchivePrefetcherImpl::declarationsUnchanged(const SqArchiveJob& job) const
+{
+	if(job.lookupAfterNested)
+		return false;
+	const TokenDict& dict = QGetRenderContext()->tokenDict();
+	for(std::map<std::string, Ri::TypeSpec>::const_iterator i = job.usedNames.begin(),
+			end = job.usedNames.end(); i != end; ++i)
+	{
+		Ri::TypeSpec type;
+		try
+		{
+			type = dict.lookup(i->first.c_str());
+		}
+		catch(XqValidation& /*e*/)
+		{ }
+		if(!(type == i->second))
+			return false;
+	}
+	return true;
+}
+
+bool CqArchivePrefetcherImpl::replayArchive(const char* name,
+		const boost::filesystem::path& path, Ri::Renderer& context)
+{
+	boost::shared_ptr<SqArchiveJob> job;
+	job.swap(m_currentJob);
+	bool useCache = cacheBudget() > 0;
+	if(!useCache && !m_cache.empty())
+	{
+		m_cache.clear();
+		m_cacheOrder.clear();
+		m_cacheSize = 0;
+	}
+	if(!job || job->path != path)
+	{
+		job.reset();
+		if(!useCache)
+			return false;
+		if(SqCacheEntry* entry = findCached(name, path))
+		{
+			// Archives without a job are known not to be replayable.
+			if(!entry->job)
+				return false;
+			job = entry->job;
+		}
+		else
+		{
+			// Parse into memory rather than straight into the renderer, so
+			// that later frames can use the parsed archive.
+			job = createJob(name, path);
+			job->run(services().errorHandler());
+		}
+	}
+	job->wait();
+	// Let the renderer report archives which couldn't be read.
+	if(!job->readable)
+		return false;
+	if(!declarationsUnchanged(*job))
+	{
+		// Tokens used by the archive have been redeclared since it was
+		// parsed, or may be declared by the archives it reads, so it has
+		// to be parsed again.
+		if(useCache)
+		{
+			if(job->lookupAfterNested)
+				addToCache(job);
+			else
+			{
+				TqArchiveCache::iterator i = m_cache.find(path.string());
+				if(i != m_cache.end() && i->second.job == job)
+					removeFromCache(i);
+			}
+		}
+		return false;
+	}
+	pinProcedurals(job);
+	// Archives read by the replayed calls are treated as if they were read
+	// while parsing.
+	beginParse();
+	try
+	{
+		const CachedRiStream& calls = job->calls;
+		for(int i = 0, iend = calls.size(); i < iend; ++i)
+		{
+			try
+			{
+				calls[i].reCall(context);
+			}
+			catch(XqException& e)
+			{
+				services().errorHandler().error(e.code(), "%s: %s",
+						job->name, e.what());
+			}
+		}
+	}
+	catch(...)
+	{
+		endParse();
+		throw;
+	}
+	endParse();
+	if(job->error)
+		boost::rethrow_exception(job->error);
+	if(useCache)
+		addToCache(job);
+	return true;
+}
+
+std::size_t CqArchivePrefetcherImpl::cacheBudget() const
+{
+	const TqInt* budget = QGetRenderContext()->poptCurrent()->
+		GetIntegerOption("limits", "archivememory");
+	if(!budget || budget[0] <= 0)
+		return 0;
+	return static_cast<std::size_t>(budget[0])*1024;
+}
+
+CqArchivePrefetcherImpl::SqCacheEntry* CqArchivePrefetcherImpl::findCached(
+		RtConstToken name, const boost::filesystem::path& path)
+{
+	TqArchiveCache::iterator i = m_cache.find(path.string());
+	if(i == m_cache.end())
+		return 0;
+	SqCacheEntry& entry = i->second;
+	if(entry.name != name || entry.modified != lastModified(path)
+		|| entry.size != fileSize(path))
+	{
+		removeFromCache(i);
+		return 0;
+	}
+	return &entry;
+}
+
+void CqArchivePrefetcherImpl::addToCache(
+		const boost::shared_ptr<SqArchiveJob>& job)
+{
+	std::string key = job->path.string();
+	TqArchiveCache::iterator i = m_cache.find(key);
+	if(i != m_cache.end())
+	{
+		if(i->second.job == job)
+		{
+			// Mark as most recently used.
+			m_cacheOrder.splice(m_cacheOrder.begin(), m_cacheOrder,
+					i->second.orderPos);
+			return;
+		}
+		removeFromCache(i);
+	}
+	std::size_t budget = cacheBudget();
+	SqCacheEntry entry;
+	entry.name = job->name;
+	entry.modified = job->modified;
+	entry.size = job->size;
+	entry.memory = 0;
+	// Archives which can't be replayed are remembered, but not their
+	// contents, so that they aren't parsed twice.
+	if(!job->lookupAfterNested && !job->error)
+	{
+		entry.memory = job->calls.memoryUsage();
+		if(entry.memory > budget)
+			return;
+		entry.job = job;
+		m_cacheSize += entry.memory;
+	}
+	m_cacheOrder.push_front(key);
+	entry.orderPos = m_cacheOrder.begin();
+	m_cache.insert(std::make_pair(key, entry));
+	// Evict the least recently used archives.
+	while(m_cacheSize > budget)
+		removeFromCache(m_cache.find(m_cacheOrder.back()));
+}
+
+void CqArchivePrefetcherImpl::removeFromCache(TqArchiveCache::iterator entry)
+{
+	m_cacheSize -= entry->second.memory;
+	m_cacheOrder.erase(entry->second.orderPos);
+	m_cache.erase(entry);
+}
+
+void CqArchivePrefetcherImpl::pinProcedurals(
+		const boost::shared_ptr<SqArchiveJob>& job)
+{
+	if(job->hasProcedurals && std::find(m_pinnedJobs.begin(),
+				m_pinnedJobs.end(), job) == m_pinnedJobs.end())
+		m_pinnedJobs.push_back(job);
+}
+
+} // anonymous namespace
+
+
+//------------------------------------------------------------------------------
+CqArchivePrefetcher* CqArchivePrefetcher::create()
+{
+	return new CqArchivePrefetcherImpl();
+}
+
+} // namespace Aqsis
@@ -0,0 +1,121 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Parsing of RIB archives in parallel with the main RIB stream.
+ *
+ * When Option "limits" "archivethreads" is set, archives named by
+ * ReadArchive are parsed on worker threads into in-memory caches while
+ * parsing of the main stream continues.  All calls following a prefetched
+ * ReadArchive are deferred, and the cached archive is replayed at the point
+ * where the archive would have been read, so the renderer sees exactly the
+ * same sequence of calls as it would with serial parsing.
+ *
+ * When Option "limits" "archivememory" is set, parsed archives are also kept
+ * between frames, so that archives which haven't changed on disk are only
+ * parsed once.
+ */
+
+#ifndef ARCHIVEPREFETCH_H_INCLUDED
+#define ARCHIVEPREFETCH_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+#include <aqsis/riutil/ricxx_filter.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Filter which defers RI calls while archives are parsed ahead.
+ *
+ * The prefetcher must sit in the filter chain upstream of any filter which
+ * depends on the renderer state (such as the conditional RIB filter), since
+ * everything downstream sees calls later than they were parsed.
+ *
+ * Calls are only deferred while a RIB stream is being parsed, as marked by
+ * beginParse() and endParse().  The parser's dictionary lookups must go via
+ * syncDeclaration() so that declarations made inside deferred archives are
+ * applied before they're needed.
+ */
+class CqArchivePrefetcher : public Ri::Filter
+{
+	public:
+		/// Create a prefetcher.
+		static CqArchivePrefetcher* create();
+
+		virtual ~CqArchivePrefetcher() {}
+
+		/// Note that parsing of a RIB stream has started.
+		virtual void beginParse() = 0;
+		/** \brief Note that parsing of a RIB stream has finished.
+		 *
+		 * All deferred calls are replayed when the outermost parse finishes.
+		 */
+		virtual void endParse() = 0;
+
+		/** \brief Make sure a token has its final declaration.
+		 *
+		 * If any deferred archive may declare the token, calls are replayed
+		 * up to and including that archive.
+		 */
+		virtual void syncDeclaration(const char* token) = 0;
+		/** \brief Defer an error report if there are deferred calls.
+		 *
+		 * \return true if the error was deferred and shouldn't be reported
+		 * immediately.
+		 */
+		virtual bool deferError(int code, const std::string& message) = 0;
+
+		/** \brief Replay the archive currently being read, if it has been
+		 * prefetched or cached.
+		 *
+		 * This is called by the renderer from within ReadArchive.  If the
+		 * archive cache is enabled, archives which are neither prefetched
+		 * nor cached are parsed into the cache and replayed from there.
+		 *
+		 * \param name - name of the archive, as passed to ReadArchive.
+		 * \param path - location of the archive file.
+		 * \param context - renderer to receive the calls in the archive.
+		 * \return true if a parsed copy of the archive was replayed, false
+		 * if the archive must be parsed as usual.
+		 */
+		virtual bool replayArchive(const char* name,
+				const boost::filesystem::path& path,
+				Ri::Renderer& context) = 0;
+};
+
+} // namespace Aqsis
+
+#endif // ARCHIVEPREFETCH_H_INCLUDED
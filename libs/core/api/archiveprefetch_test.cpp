@@ -0,0 +1,364 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for parsing archives ahead of ReadArchive.
+ */
+
+#include "archiveprefetch.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdarg>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <aqsis/ri/ri.h>
+#include <aqsis/util/exception.h>
+
+#include "instance.h"
+#include "renderer.h"
+
+BOOST_AUTO_TEST_SUITE(archiveprefetch_tests)
+using namespace Aqsis;
+
+namespace {
+
+inline char* tok(const char* str)
+{
+	return const_cast<char*>(str);
+}
+
+void writeFile(const char* fileName, const std::string& contents)
+{
+	std::ofstream out(fileName, std::ios::binary);
+	out.write(contents.data(), contents.size());
+}
+
+std::string g_trace;
+
+/** Archive callback recording the value of the user attribute named by
+ * each comment of the form "#name" in the archive read by the test.
+ */
+RtVoid recordAttribute(RtToken type, char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	std::string name = va_arg(args, char*);
+	va_end(args);
+	const CqString* value = QGetRenderContext()->pattrCurrent()->
+		GetStringAttribute("user", name.c_str());
+	g_trace += name + "=" + (value ? value->c_str() : "") + "|";
+}
+
+/** Read the given RIB stream with the given number of archive threads,
+ * returning the trace of user attributes seen by the renderer.
+ */
+std::string readTrace(const std::string& rib, TqInt numThreads)
+{
+	writeFile("archiveprefetch_test.rib", rib);
+	g_trace.clear();
+	RiBegin(RI_NULL);
+	if(numThreads > 0)
+		RiOption(tok("limits"), tok("archivethreads"), &numThreads, RI_NULL);
+	RiWorldBegin();
+	RiReadArchive(tok("./archiveprefetch_test.rib"), recordAttribute, RI_NULL);
+	QGetRenderContext()->EndWorldModeBlock();
+	RiEnd();
+	return g_trace;
+}
+
+/// Check that a RIB stream gives the expected trace with and without
+/// prefetching.
+void checkTrace(const std::string& rib, const std::string& expected)
+{
+	BOOST_CHECK_EQUAL(readTrace(rib, 0), expected);
+	BOOST_CHECK_EQUAL(readTrace(rib, 2), expected);
+}
+
+/// Start a world with the archive cache budget set to the given size in kB.
+void beginCachedWorld(TqInt budget)
+{
+	RiBegin(RI_NULL);
+	RiOption(tok("limits"), tok("archivememory"), &budget, RI_NULL);
+	RiWorldBegin();
+}
+
+void endCachedWorld()
+{
+	QGetRenderContext()->EndWorldModeBlock();
+	RiEnd();
+}
+
+/// Read an archive, returning the trace of user attributes it records.
+std::string readArchive(const char* name)
+{
+	g_trace.clear();
+	RiReadArchive(tok(name), recordAttribute, RI_NULL);
+	return g_trace;
+}
+
+/** Archive setting the user attribute "tag" and recording it, padded with
+ * the given number of floats.
+ */
+std::string taggedArchive(const char* tag, int numFloats = 0)
+{
+	std::string rib;
+	if(numFloats > 0)
+	{
+		rib += "Attribute \"user\" \"uniform float[";
+		rib += boost::lexical_cast<std::string>(numFloats) + "] padding\" [";
+		for(int i = 0; i < numFloats; ++i)
+			rib += "0 ";
+		rib += "]\n";
+	}
+	return rib + "Attribute \"user\" \"uniform string tag\" \"" + tag + "\"\n#tag\n";
+}
+
+/** Change a file without changing its size or modification time, so that a
+ * cached copy can be told apart from the file.
+ */
+void rewriteFile(const char* fileName, const std::string& contents)
+{
+	std::time_t modified = boost::filesystem::last_write_time(fileName);
+	writeFile(fileName, contents);
+	boost::filesystem::last_write_time(fileName, modified);
+}
+
+/** Expand the procedural retained as the given object, returning true if
+ * the archive it reads declared the given token.
+ */
+bool expandObject(const char* object, const char* token)
+{
+	boost::shared_ptr<const CqObjectPrototype> prototype =
+		QGetRenderContext()->findObject(object);
+	BOOST_REQUIRE_EQUAL(prototype->entries().size(), 1U);
+	std::vector<boost::shared_ptr<CqSurface> > splits;
+	prototype->entries()[0].surface->Split(splits);
+	try
+	{
+		QGetRenderContext()->tokenDict().lookup(token);
+	}
+	catch(XqValidation& /*e*/)
+	{
+		return false;
+	}
+	return true;
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_replay_order)
+{
+	writeFile("archiveprefetch_test_a.rib",
+		"Attribute \"user\" \"uniform string tag\" \"a\"\n");
+	writeFile("archiveprefetch_test_b.rib",
+		"Attribute \"user\" \"uniform string tag\" \"b1\"\n"
+		"Attribute \"user\" \"uniform string tag\" \"b2\"\n");
+	// Calls after each archive are replayed after the archive contents.
+	checkTrace(
+		"#tag\n"
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"#tag\n"
+		"ReadArchive \"./archiveprefetch_test_b.rib\"\n"
+		"#tag\n"
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"Attribute \"user\" \"uniform string tag\" \"main\"\n"
+		"#tag\n",
+		"tag=|tag=a|tag=b2|tag=main|");
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_nested_archives)
+{
+	writeFile("archiveprefetch_test_c.rib",
+		"Attribute \"user\" \"uniform string tag\" \"c\"\n");
+	writeFile("archiveprefetch_test_b.rib",
+		"ReadArchive \"./archiveprefetch_test_c.rib\"\n"
+		"Attribute \"user\" \"uniform string tag\" \"b\"\n");
+	writeFile("archiveprefetch_test_a.rib",
+		"Attribute \"user\" \"uniform string tag\" \"a\"\n"
+		"ReadArchive \"./archiveprefetch_test_c.rib\"\n");
+	// Archives read by archives are replayed in place.
+	checkTrace(
+		"ReadArchive \"./archiveprefetch_test_b.rib\"\n"
+		"#tag\n"
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"#tag\n",
+		"tag=b|tag=c|");
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_declare_interleaving)
+{
+	writeFile("archiveprefetch_test_a.rib",
+		"Declare \"prefetchDeclared\" \"uniform string\"\n"
+		"Attribute \"user\" \"prefetchDeclared\" \"a\"\n");
+	writeFile("archiveprefetch_test_b.rib",
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"Declare \"prefetchNested\" \"uniform string\"\n");
+	writeFile("archiveprefetch_test_c.rib",
+		"Attribute \"user\" \"prefetchMain\" \"c\"\n");
+	checkTrace(
+		// A token declared by a deferred archive is used by the main stream
+		// in the middle of a request.
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"#prefetchDeclared\n"
+		"Attribute \"user\" \"uniform string tag\" \"main\" "
+			"\"prefetchDeclared\" \"main\"\n"
+		"#prefetchDeclared\n"
+		// Declarations made by nested archives are seen too.
+		"ReadArchive \"./archiveprefetch_test_b.rib\"\n"
+		"Attribute \"user\" \"prefetchNested\" \"main\"\n"
+		"#prefetchNested\n"
+		// Tokens used by an archive are declared by the main stream before
+		// the archive is read.
+		"Declare \"prefetchMain\" \"uniform string\"\n"
+		"ReadArchive \"./archiveprefetch_test_c.rib\"\n"
+		"#prefetchMain\n",
+		"prefetchDeclared=a|prefetchDeclared=main|prefetchNested=main|"
+		"prefetchMain=c|");
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_cache_hits)
+{
+	const char* name = "./archiveprefetch_test_a.rib";
+	writeFile(name, taggedArchive("a1"));
+	beginCachedWorld(1024);
+	BOOST_CHECK_EQUAL(readArchive(name), "tag=a1|");
+	// Unchanged files are replayed from the cache...
+	rewriteFile(name, taggedArchive("a2"));
+	BOOST_CHECK_EQUAL(readArchive(name), "tag=a1|");
+	// ...but not once the modification time changes...
+	boost::filesystem::last_write_time(name,
+			boost::filesystem::last_write_time(name) - 10);
+	BOOST_CHECK_EQUAL(readArchive(name), "tag=a2|");
+	// ...or the size changes.
+	rewriteFile(name, taggedArchive("a33"));
+	BOOST_CHECK_EQUAL(readArchive(name), "tag=a33|");
+	endCachedWorld();
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_cache_evicts_least_recently_used)
+{
+	// Each archive holds 4000 bytes of floats once parsed, but is only half
+	// that size on disk, so the budget holds one parsed archive.
+	const char* nameA = "./archiveprefetch_test_a.rib";
+	const char* nameB = "./archiveprefetch_test_b.rib";
+	writeFile(nameA, taggedArchive("a1", 1000));
+	writeFile(nameB, taggedArchive("b1", 1000));
+	beginCachedWorld(6);
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a1|");
+	BOOST_CHECK_EQUAL(readArchive(nameB), "tag=b1|");
+	rewriteFile(nameA, taggedArchive("a2", 1000));
+	rewriteFile(nameB, taggedArchive("b2", 1000));
+	// Caching B evicted A.
+	BOOST_CHECK_EQUAL(readArchive(nameB), "tag=b1|");
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a2|");
+	// Archives larger than the whole budget aren't cached.
+	writeFile(nameA, taggedArchive("a3", 2000));
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a3|");
+	rewriteFile(nameA, taggedArchive("a4", 2000));
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a4|");
+	endCachedWorld();
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_procedurals_outlive_parsing)
+{
+	writeFile("archiveprefetch_test_b.rib",
+		"Declare \"prefetchDeferredProc\" \"uniform float\"\n");
+	writeFile("archiveprefetch_test_c.rib",
+		"Declare \"prefetchArchivedProc\" \"uniform float\"\n");
+	// The archive is large enough that the calls after it are deferred.
+	writeFile("archiveprefetch_test_a.rib", taggedArchive("a", 20000) +
+		"ObjectBegin \"archived\"\n"
+		"Procedural \"DelayedReadArchive\" [\"./archiveprefetch_test_c.rib\"] "
+			"[-1 1 -1 1 -1 1]\n"
+		"ObjectEnd\n");
+	writeFile("archiveprefetch_test.rib",
+		"ReadArchive \"./archiveprefetch_test_a.rib\"\n"
+		"ObjectBegin \"deferred\"\n"
+		"Procedural \"DelayedReadArchive\" [\"./archiveprefetch_test_b.rib\"] "
+			"[-1 1 -1 1 -1 1]\n"
+		"ObjectEnd\n");
+	RiBegin(RI_NULL);
+	TqInt numThreads = 2;
+	RiOption(tok("limits"), tok("archivethreads"), &numThreads, RI_NULL);
+	RiWorldBegin();
+	RiReadArchive(tok("./archiveprefetch_test.rib"), 0, RI_NULL);
+	// Procedurals deferred by the prefetcher or replayed from a prefetched
+	// archive keep their data once parsing has finished.
+	BOOST_CHECK(expandObject("deferred", "prefetchDeferredProc"));
+	BOOST_CHECK(expandObject("archived", "prefetchArchivedProc"));
+	QGetRenderContext()->EndWorldModeBlock();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(archiveprefetch_cache_removal_keeps_procedurals)
+{
+	const char* nameA = "./archiveprefetch_test_a.rib";
+	const char* nameB = "./archiveprefetch_test_b.rib";
+	writeFile("archiveprefetch_test_c.rib",
+		"Declare \"prefetchEvictedProc\" \"uniform float\"\n");
+	writeFile("archiveprefetch_test_d.rib",
+		"Declare \"prefetchStaleProc\" \"uniform float\"\n");
+	writeFile(nameA, taggedArchive("a", 1000) +
+		"ObjectBegin \"evicted\"\n"
+		"Procedural \"DelayedReadArchive\" [\"./archiveprefetch_test_c.rib\"] "
+			"[-1 1 -1 1 -1 1]\n"
+		"ObjectEnd\n");
+	writeFile(nameB, taggedArchive("b", 1000));
+	beginCachedWorld(6);
+	// Caching B evicts A while its procedural is still to be expanded.
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a|");
+	BOOST_CHECK_EQUAL(readArchive(nameB), "tag=b|");
+	BOOST_CHECK(expandObject("evicted", "prefetchEvictedProc"));
+	// Likewise when a cached archive is found to be out of date.
+	writeFile(nameA,
+		"ObjectBegin \"stale\"\n"
+		"Procedural \"DelayedReadArchive\" [\"./archiveprefetch_test_d.rib\"] "
+			"[-1 1 -1 1 -1 1]\n"
+		"ObjectEnd\n");
+	readArchive(nameA);
+	writeFile(nameA, taggedArchive("a2"));
+	boost::filesystem::last_write_time(nameA,
+			boost::filesystem::last_write_time(nameA) - 10);
+	BOOST_CHECK_EQUAL(readArchive(nameA), "tag=a2|");
+	BOOST_CHECK(expandObject("stale", "prefetchStaleProc"));
+	endCachedWorld();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -235,8 +235,9 @@ CqSolidModeBlock::~CqSolidModeBlock()
 
 CqObjectModeBlock::CqObjectModeBlock( const boost::shared_ptr<CqModeBlock>& pconParent ) : CqModeBlock( pconParent, Object )
 {
-	// Create new Attributes as they must be pushed/popped by the state change.
-	m_pattrCurrent.reset(new CqAttributes());
+	// Share the parent attributes; they are copied on the first write inside
+	// the definition, so the parent state is restored at ObjectEnd.
+	m_pattrCurrent = pconParent->m_pattrCurrent;
 	m_ptransCurrent.reset( new CqTransform(*pconParent->m_ptransCurrent.get() ) );
 	m_poptCurrent.reset( new CqOptions(*pconParent->m_poptCurrent.get() ) );
 }
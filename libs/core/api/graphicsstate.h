@@ -727,22 +727,6 @@ class CqObjectModeBlock : public CqModeBlock
 		{
 			return(pconParent()->popOptions());
 		}
-		/** Get a pointer suitable for writing to the attributes at the parent context, as object context doesn't store attributes.
-		 * \return an attributes pointer.
-		 */
-		virtual	CqAttributesPtr	pattrCurrent() const
-		{
-			return ( pconParent() ->pattrCurrent() );
-		}
-		/** Get a pointer to the attributes at the parent context, as object context doesn't store attributes.
-		 * \return an attributes pointer.
-		 */
-		virtual	CqAttributesPtr	pattrWriteCurrent()
-		{
-			assert( false );
-			return CqAttributesPtr();
-		}	// Illegal to change attributes here.
-
 	private:
 };
 
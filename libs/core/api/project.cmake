@@ -1,4 +1,5 @@
 set(api_srcs
+	archiveprefetch.cpp
 	condition.cpp
 	genpoly.cpp
 	graphicsstate.cpp
@@ -10,6 +11,7 @@ set(api_srcs
 make_absolute(api_srcs ${api_SOURCE_DIR})
 
 set(api_hdrs
+	archiveprefetch.h
 	condition.h
 	genpoly.h
 	graphicsstate.h
@@ -20,6 +22,7 @@ include_directories(${api_SOURCE_DIR})
 include_directories(${api_BINARY_DIR})
 
 set(api_test_srcs
+	archiveprefetch_test.cpp
 	rif_test.cpp
 )
 make_absolute(api_test_srcs ${api_SOURCE_DIR})
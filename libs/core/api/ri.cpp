@@ -49,6 +49,8 @@
 #include	"points.h"
 #include	"curves.h"
 #include	"procedural.h"
+#include	"instance.h"
+#include	"archiveprefetch.h"
 #include	<aqsis/core/corecontext.h>
 #include	<aqsis/riutil/ri2ricxx.h>
 #include	<aqsis/riutil/ricxxutil.h>
@@ -61,6 +63,8 @@
 #include	<aqsis/util/logging_streambufs.h>
 #include	<aqsis/util/smartptr.h>
 #include	<aqsis/tex/maketexture.h>
+#include	<aqsis/tex/buffers/tilecache.h>
+#include	<aqsis/tex/io/filehandlecache.h>
 #include	"stats.h"
 #include	<aqsis/math/random.h>
 #include	"../../riutil/errorhandlerimpl.h"
@@ -108,9 +112,16 @@ class RiCxxCore : public Ri::Renderer
 	public:
 		RiCxxCore(Ri::RendererServices& apiServices)
 			: m_apiServices(apiServices),
-			m_archiveCallback(0)
+			m_archiveCallback(0),
+			m_archivePrefetcher(0)
 		{ }
 
+		/// Set the source of archives parsed ahead of ReadArchive.
+		void setArchivePrefetcher(CqArchivePrefetcher* prefetcher)
+		{
+			m_archivePrefetcher = prefetcher;
+		}
+
         virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
 		{
 			if(m_archiveCallback)
@@ -318,6 +329,7 @@ class RiCxxCore : public Ri::Renderer
 
 		Ri::RendererServices& m_apiServices;
 		RtArchiveCallback m_archiveCallback;
+		CqArchivePrefetcher* m_archivePrefetcher;
 };
 
 //------------------------------------------------------------------------------
@@ -351,6 +363,7 @@ RtVoid	CreateGPrim( const boost::shared_ptr<T>& pSurface )
 //
 RtVoid RiCxxCore::Declare(RtConstString name, RtConstString declaration)
 {
+	QGetRenderContext()->noteGlobalRequest();
 	if(declaration)
 		QGetRenderContext()->tokenDict().declare(name, declaration);
 	else // declaration is allowed to be RI_NULL
@@ -627,6 +640,18 @@ RtVoid RiCxxCore::WorldBegin()
 	QGetRenderContext()->matSpaceToSpace("current", "world", NULL, NULL, 0, currToWorldMat);
 	QGetRenderContext()->textureCache().setCurrToWorldMatrix(currToWorldMat);
 
+	// Limit the memory used by texture tiles.  The option is given in kB.
+	std::size_t textureMemory = CqTileCache::defaultMaxMemory;
+	const TqInt* poptTextureMemory = QGetRenderContext()->poptCurrent()->GetIntegerOption( "limits", "texturememory" );
+	if( NULL != poptTextureMemory )
+		textureMemory = std::size_t(max(poptTextureMemory[0], 0))*1024;
+	CqTileCache::instance().setMaxMemory(textureMemory);
+	CqTileCache::instance().resetStats();
+	// Limit the number of texture files held open at once.
+	const TqInt* poptTextureFiles = QGetRenderContext()->poptCurrent()->GetIntegerOption( "limits", "texturefiles" );
+	CqFileHandleCache::instance().setMaxOpenFiles( poptTextureFiles ?
+			poptTextureFiles[0] : CqFileHandleCache::defaultMaxOpenFiles );
+
 	// Reset the current transformation to identity, this now represents the object-->world transform.
 	QGetRenderContext() ->ptransSetTime( CqMatrix() );
 
@@ -696,7 +721,13 @@ RtVoid RiCxxCore::WorldEnd()
 		fFailed = true;
 	}
 
-	// Remove all cached textures.
+	// Record the texture tile cache statistics, then remove all cached
+	// textures.
+	SqTileCacheStats tileStats = CqTileCache::instance().stats();
+	STATS_SETI( TEX_tile_hits, tileStats.hits );
+	STATS_SETI( TEX_tile_misses, tileStats.misses );
+	STATS_SETI( TEX_tile_evictions, tileStats.evictions );
+	STATS_SETI( TEX_tile_peak_kb, tileStats.peakMemory/1024 );
 	QGetRenderContext()->textureCache().flush();
 
 	// Clear out point cloud caches, etc.
@@ -1265,6 +1296,7 @@ RtVoid RiCxxCore::TextureCoordinates(RtFloat s1, RtFloat t1,
 //
 RtVoid RiCxxCore::LightSource(RtConstToken shadername, RtConstToken name, const ParamList& pList)
 {
+	QGetRenderContext()->noteGlobalRequest();
 	// Find the lightsource shader.
 	boost::shared_ptr<IqShader> pShader = QGetRenderContext()->CreateShader( shadername, Type_Lightsource );
 	if(!pShader)
@@ -1701,6 +1733,7 @@ RtVoid RiCxxCore::Displacement(RtConstToken name, const ParamList& pList)
 //
 RtVoid RiCxxCore::CoordinateSystem(RtConstToken space)
 {
+	QGetRenderContext()->noteGlobalRequest();
 	// Insert the named coordinate system into the list help on the renderer.
 	QGetRenderContext() ->SetCoordSystem( space, QGetRenderContext() ->matCurrent( QGetRenderContext() ->Time() ) );
 	QGetRenderContext() ->AdvanceTime();
@@ -3129,18 +3162,44 @@ RtVoid RiCxxCore::SolidEnd()
 
 //----------------------------------------------------------------------
 // Object retention and instancing.
+//
+// Gprims created between ObjectBegin and ObjectEnd are retained in a shared
+// prototype instead of being rendered.  Each ObjectInstance then posts one
+// CqInstance per prototype gprim, which refers to the prototype geometry and
+// carries only the instance transformation and attributes.
 RtVoid RiCxxCore::ObjectBegin(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug, "ObjectBegin should be handled by a filter");
+	QGetRenderContext()->noteGlobalRequest();
+	QGetRenderContext() ->beginObjectDefinition(name);
+	QGetRenderContext() ->BeginObjectModeBlock();
 }
 RtVoid RiCxxCore::ObjectEnd()
 {
-	errorHandler().error(EqE_Bug, "ObjectEnd should be handled by a filter");
+	QGetRenderContext() ->endObjectDefinition();
+	QGetRenderContext() ->EndObjectModeBlock();
 }
 RtVoid RiCxxCore::ObjectInstance(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug,
-						 "ObjectInstance should be handled by a filter");
+	boost::shared_ptr<const CqObjectPrototype> prototype
+		= QGetRenderContext()->findObject(name);
+
+	TqFloat time = QGetRenderContext()->Time();
+	CqTransformPtr instanceTrans = QGetRenderContext()->ptransCurrent();
+	CqMatrix matTx = prototype->matDefinitionToInstance(
+			instanceTrans->matObjectToWorld(time));
+
+	const std::vector<CqObjectPrototype::SqEntry>& entries = prototype->entries();
+	for(TqInt i = 0, nEntries = entries.size(); i < nEntries; ++i)
+	{
+		// Gprims with their own transformation inside the definition get
+		// the instance transformation concatenated with it.
+		CqTransformPtr trans = instanceTrans;
+		if(!entries[i].matRelative.fIdentity())
+			trans.reset(new CqTransform(instanceTrans, time,
+						entries[i].matRelative, CqTransform::ConcatCurrent()));
+		CreateGPrim(boost::shared_ptr<CqInstance>(
+					new CqInstance(prototype, i, trans, matTx)));
+	}
 }
 
 
@@ -3276,6 +3335,7 @@ RtVoid RiCxxCore::IfEnd()
 //
 RtVoid RiCxxCore::ErrorHandler(RtErrorFunc handler)
 {
+	QGetRenderContext()->noteGlobalRequest();
 	QGetRenderContext()->SetpErrorHandler( handler );
 }
 
@@ -3424,14 +3484,18 @@ RtVoid RiCxxCore::SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices
 
 RtVoid RiCxxCore::ReadArchive(RtConstToken name, RtArchiveCallback callback, const ParamList& pList)
 {
-	// Open the archive file
-	boost::filesystem::ifstream archiveFile(
-			QGetRenderContext()->poptCurrent()->findRiFile(name, "archive"),
-			std::ios::binary);
-	// Parse the archive
+	boost::filesystem::path archivePath =
+		QGetRenderContext()->poptCurrent()->findRiFile(name, "archive");
 	RtArchiveCallback savedCallback = m_archiveCallback;
 	m_archiveCallback = callback;
-	m_apiServices.parseRib(archiveFile, name);
+	// Use the archive if it's already been parsed in the background or by
+	// an earlier frame; otherwise parse it now.
+	if(!m_archivePrefetcher || !m_archivePrefetcher->replayArchive(name,
+				archivePath, m_apiServices.firstFilter()))
+	{
+		boost::filesystem::ifstream archiveFile(archivePath, std::ios::binary);
+		m_apiServices.parseRib(archiveFile, name);
+	}
 	m_archiveCallback = savedCallback;
 }
 
@@ -3829,13 +3893,44 @@ RtVoid	CreateGPrim( const boost::shared_ptr<CqSurface>& pSurface )
 		QGetRenderContext()->StorePrimitive( pSurface );
 		STATS_INC( GPR_created );
 
-		// Add to the raytracer database also
-		if(QGetRenderContext()->pRaytracer())
+		// Add to the raytracer database also, unless the primitive is being
+		// retained in an object definition.
+		if(QGetRenderContext()->pRaytracer() && !QGetRenderContext()->isDefiningObject())
 			QGetRenderContext()->pRaytracer()->AddPrimitive(pSurface);
 	}
 }
 
 
+//==============================================================================
+/// Error handler for the core renderer.
+///
+/// Errors are reported via Aqsis::log(), but are deferred along with the RI
+/// calls around them while archives are being parsed in the background.
+class CoreErrorHandler : public AqsisLogErrorHandler
+{
+	public:
+		CoreErrorHandler()
+			: m_archivePrefetcher(0)
+		{ }
+
+		void setArchivePrefetcher(CqArchivePrefetcher* prefetcher)
+		{
+			m_archivePrefetcher = prefetcher;
+		}
+
+	protected:
+		virtual void dispatch(int code, const std::string& message)
+		{
+			if(!m_archivePrefetcher
+				|| !m_archivePrefetcher->deferError(code, message))
+				AqsisLogErrorHandler::dispatch(code, message);
+		}
+
+	private:
+		CqArchivePrefetcher* m_archivePrefetcher;
+};
+
+
 //==============================================================================
 /// Api services for the core renderer.
 class CoreRendererServices : public Ri::RendererServices
@@ -3846,16 +3941,28 @@ class CoreRendererServices : public Ri::RendererServices
 			m_api(),
 			m_parser(),
 			m_filterChain(),
+			m_archivePrefetcher(),
+			m_inDeclarationSync(false),
 			m_errorHandler()
 		{
 			m_api.reset(new RiCxxCore(*this));
 			// Add renderer utility filter.  We do this here rather than in
 			// addFilter() because this is a special filter which should only
 			// be added once.
-			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition);
+			// Object instancing is handled natively by the core, so the
+			// filter passes object calls through rather than expanding them.
+			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition, false);
 			utilFilter->setNextFilter(*m_api);
 			utilFilter->setRendererServices(*this);
 			m_filterChain.push_back(boost::shared_ptr<Ri::Renderer>(utilFilter));
+			// Add archive prefetching.  This defers calls, so must come
+			// before the utility filter which inspects the renderer state.
+			m_archivePrefetcher.reset(CqArchivePrefetcher::create());
+			m_archivePrefetcher->setNextFilter(*utilFilter);
+			m_archivePrefetcher->setRendererServices(*this);
+			m_filterChain.push_back(m_archivePrefetcher);
+			m_api->setArchivePrefetcher(m_archivePrefetcher.get());
+			m_errorHandler.setArchivePrefetcher(m_archivePrefetcher.get());
 			// Add RI validation
 			addFilter("validate");
 		}
@@ -3893,6 +4000,20 @@ class CoreRendererServices : public Ri::RendererServices
 										const char** nameBegin = 0,
 										const char** nameEnd = 0) const
 		{
+			// Deferred archives replayed here may need parsing while the
+			// parser is part way through a request; see parseRib().
+			bool inSync = m_inDeclarationSync;
+			m_inDeclarationSync = true;
+			try
+			{
+				m_archivePrefetcher->syncDeclaration(token);
+			}
+			catch(...)
+			{
+				m_inDeclarationSync = inSync;
+				throw;
+			}
+			m_inDeclarationSync = inSync;
 			return m_renderContext->tokenDict().lookup(token, nameBegin,
 													   nameEnd);
         }
@@ -3952,7 +4073,22 @@ class CoreRendererServices : public Ri::RendererServices
         {
             if(!m_parser)
                 m_parser.reset(RibParser::create(*this));
-            m_parser->parseStream(ribStream, name, context);
+            boost::shared_ptr<RibParser> parser = m_parser;
+            // The main parser can't be reentered in the middle of reading a
+            // request's parameter list.
+            if(m_inDeclarationSync)
+                parser.reset(RibParser::create(*this));
+            m_archivePrefetcher->beginParse();
+            try
+            {
+                parser->parseStream(ribStream, name, context);
+            }
+            catch(...)
+            {
+                m_archivePrefetcher->endParse();
+                throw;
+            }
+            m_archivePrefetcher->endParse();
         }
 
     private:
@@ -3966,8 +4102,12 @@ class CoreRendererServices : public Ri::RendererServices
         boost::shared_ptr<RibParser> m_parser;
         /// Chain of filters
         std::vector<boost::shared_ptr<Ri::Renderer> > m_filterChain;
+        /// Filter parsing archives in the background.
+        boost::shared_ptr<CqArchivePrefetcher> m_archivePrefetcher;
+        /// True while deferred calls are replayed for a declaration lookup.
+        mutable bool m_inDeclarationSync;
         /// Error handler.
-        AqsisLogErrorHandler m_errorHandler;
+        CoreErrorHandler m_errorHandler;
 };
 
 } // namespace Aqsis;
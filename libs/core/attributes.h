@@ -41,6 +41,7 @@
 #include	<aqsis/ri/ri.h>
 #include	<aqsis/math/matrix.h>
 #include	"options.h"
+#include	"shadingstate.h"
 #include	<aqsis/math/spline.h>
 #include	"trimcurve.h"
 #include	<aqsis/core/iattributes.h>
@@ -171,7 +172,7 @@ class CqAttributes : public IqAttributes, public boost::enable_shared_from_this<
 
 		virtual boost::shared_ptr<IqShader> pshadDisplacement( TqFloat /* time */) const
 		{
-			return ( m_pshadDisplacement );
+			return ( CqShadingState::shader(m_pshadDisplacement) );
 		}
 		virtual void SetpshadDisplacement( const boost::shared_ptr<IqShader>& pshadDisplacement, TqFloat /* time */ )
 		{
@@ -187,7 +188,7 @@ class CqAttributes : public IqAttributes, public boost::enable_shared_from_this<
 		}
 		virtual boost::shared_ptr<IqShader> pshadSurface( TqFloat /* time */ ) const
 		{
-			return ( m_pshadSurface );
+			return ( CqShadingState::shader(m_pshadSurface) );
 		}
 		virtual void SetpshadSurface( const boost::shared_ptr<IqShader>& pshadSurface, TqFloat /* time */ )
 		{
@@ -195,7 +196,7 @@ class CqAttributes : public IqAttributes, public boost::enable_shared_from_this<
 		}
 		virtual boost::shared_ptr<IqShader> pshadAtmosphere( TqFloat /* time */ ) const
 		{
-			return ( m_pshadAtmosphere );
+			return ( CqShadingState::shader(m_pshadAtmosphere) );
 		}
 		virtual void SetpshadAtmosphere( const boost::shared_ptr<IqShader>& pshadAtmosphere, TqFloat /* time */ )
 		{
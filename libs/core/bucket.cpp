@@ -55,6 +55,8 @@ namespace Aqsis {
 //----------------------------------------------------------------------
 CqBucket::CqBucket()
 	: m_bProcessed(false),
+	m_bStarted(false),
+	m_reach(),
 	m_col(0),
 	m_row(0),
 	m_xPosition(0),
@@ -106,6 +108,22 @@ void CqBucket::SetProcessed( bool bProc )
 	}
 }
 
+//----------------------------------------------------------------------
+/** Extend the range of buckets reached by geometry in this bucket.
+ */
+void CqBucket::extendReach(const CqRegion& buckets)
+{
+	if(m_reach.area() == 0)
+		m_reach = buckets;
+	else if(buckets.area() > 0)
+	{
+		m_reach = CqRegion(std::min(m_reach.xMin(), buckets.xMin()),
+				std::min(m_reach.yMin(), buckets.yMin()),
+				std::max(m_reach.xMax(), buckets.xMax()),
+				std::max(m_reach.yMax(), buckets.yMax()));
+	}
+}
+
 //----------------------------------------------------------------------
 /** Check if there are any surfaces in this bucket to be processed.
  */
@@ -118,7 +136,7 @@ bool CqBucket::hasPendingSurfaces() const
 //----------------------------------------------------------------------
 /** Add an MP to the list of deferred MPs.
  */
-void CqBucket::AddMP( boost::shared_ptr<CqMicroPolygon>& pMP )
+void CqBucket::AddMP( CqMicroPolygonPtr& pMP )
 {
 	m_micropolygons.push_back( pMP );
 }
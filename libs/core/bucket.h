@@ -127,7 +127,38 @@ class CqBucket
 		/** Mark this bucket as processed
 		 */
 		void SetProcessed( bool bProc =  true);
+		/** Get the flag that indicates if a bucket processor has been
+		 * assigned to this bucket.
+		 *
+		 * Started buckets may still receive geometry until they're marked as
+		 * processed, but their cache segments have already been applied so
+		 * they must not receive new ones.
+		 */
+		bool IsStarted() const
+		{
+			return( m_bStarted );
+		}
+		/** Mark this bucket as started
+		 */
+		void SetStarted( bool bStarted = true )
+		{
+			m_bStarted = bStarted;
+		}
 
+		/** Get the range of buckets which geometry posted into this bucket
+		 * may reach, as bucket columns and rows.
+		 *
+		 * Split geometry, reposted surfaces and micropolygons stay inside the
+		 * bound of the surface they came from, so no other bucket can receive
+		 * geometry from this one.  The range is empty if nothing was posted.
+		 */
+		const CqRegion& reach() const;
+		/** Extend the reach of this bucket to include the given range of
+		 * buckets.
+		 */
+		void extendReach(const CqRegion& buckets);
+		/** Forget the reach of this bucket, ready for a new image */
+		void clearReach();
 		/** Get the column of the bucket in the image */
 		TqInt getCol() const;
 		/** Set the column of the bucket in the image */
@@ -151,9 +182,9 @@ class CqBucket
 
 		/** Add an MP to the list of deferred MPs.
 		 */
-		void	AddMP( boost::shared_ptr<CqMicroPolygon>& pMP );
+		void	AddMP( CqMicroPolygonPtr& pMP );
 
-		std::vector<boost::shared_ptr<CqMicroPolygon> >& micropolygons();
+		std::vector<CqMicroPolygonPtr>& micropolygons();
 
 		const TqCache& cacheSegments() const;
 		void setCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg);
@@ -177,7 +208,11 @@ class CqBucket
 
 		/// Flag indicating if this bucket has been processed yet.
 		bool	m_bProcessed;
+		/// Flag indicating if a bucket processor has started on this bucket.
+		bool	m_bStarted;
 
+		/// Range of buckets reached by geometry posted into this bucket.
+		CqRegion m_reach;
 		/// Bucket column in the image
 		TqInt m_col;
 		/// Bucket row in the image
@@ -192,7 +227,7 @@ class CqBucket
 		TqInt m_ySize;
 
 		/// Vector of vectors of waiting micropolygons in this bucket
-		typedef std::vector<boost::shared_ptr<CqMicroPolygon> > TqPolyStorage;
+		typedef std::vector<CqMicroPolygonPtr> TqPolyStorage;
 		TqPolyStorage m_micropolygons;
 
 		/// A sorted list of primitives for this bucket
@@ -212,7 +247,7 @@ class CqBucket
 // Implementation details
 //------------------------------------------------------------
 
-inline std::vector<boost::shared_ptr<CqMicroPolygon> >& CqBucket::micropolygons()
+inline std::vector<CqMicroPolygonPtr>& CqBucket::micropolygons()
 {
 	return m_micropolygons;
 }
@@ -229,6 +264,16 @@ inline const CqBucket::TqCache& CqBucket::cacheSegments() const
 	return m_cacheSegments;
 }
 
+inline const CqRegion& CqBucket::reach() const
+{
+	return m_reach;
+}
+
+inline void CqBucket::clearReach()
+{
+	m_reach = CqRegion();
+}
+
 inline TqInt CqBucket::getXPosition() const
 {
 	return m_xPosition;
@@ -18,16 +18,111 @@
 
 #include	"bucketprocessor.h"
 
+#include	<algorithm>
+#include	<cstring>
 #include	<valarray>
 
+#include	<boost/bind.hpp>
+#include	<boost/ref.hpp>
+
 #include	<aqsis/math/math.h>
+#include	<aqsis/math/random.h>
 #include	"bucket.h"
 #include	"imagebuffer.h"
+#include	"procedural.h"
+#include	<aqsis/util/threadpool.h>
 #include	<aqsis/util/timer.h>
 
 
 namespace Aqsis {
 
+/// Minimum number of micropolygons worth sampling in a separate task.
+static const TqInt minMPsPerStrip = 64;
+
+/** Determine whether a pixel filter is a product of a function of x and a
+ * function of y.
+ *
+ * The triangle filter is the minimum of two such functions rather than their
+ * product, and the disk, bessel and catmull-rom filters are radial, so none of
+ * those are separable.  User defined filters are assumed not to be either.
+ */
+static bool isSeparableFilter(RtFilterFunc filter)
+{
+	return filter == RiBoxFilter || filter == RiGaussianFilter
+		|| filter == RiSincFilter || filter == RiMitchellFilter;
+}
+
+/** Store the filtered samples for a pixel into a channel buffer.
+ *
+ * \param x, y - position of the pixel in the channel buffer.
+ * \param samples - weighted sum of the sample data.
+ * \param gTot - sum of the filter weights inside the filter window.
+ * \param sampleCount - number of samples with a valid hit in the window.
+ * \param numSubPixels - number of samples in each pixel.
+ * \return the coverage of the pixel.
+ */
+static TqFloat storeFilteredPixel(CqChannelBuffer& channelBuffer, TqInt x, TqInt y,
+		const TqFloat* samples, TqFloat gTot, TqInt sampleCount, TqInt numSubPixels,
+		const std::map<TqInt, CqRenderer::SqOutputDataEntry>& channelMap, TqInt depthIndex)
+{
+	std::map<TqInt, CqRenderer::SqOutputDataEntry>::const_iterator channel_i;
+	// Set depth to infinity if no samples.
+	if ( sampleCount == 0 )
+	{
+		for( channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
+		{
+			for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
+				channelBuffer(x, y, channel_i->first)[i] = 0.0f;
+		}
+		// Set the depth to infinity.
+		channelBuffer(x, y, depthIndex)[0] = FLT_MAX;
+		return 0.0f;
+	}
+
+	float oneOverGTot = 1.0 / gTot;
+	// Copy the filtered sample data into the channel buffer.
+	for( channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
+	{
+		for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
+			channelBuffer(x, y, channel_i->first)[i] = samples[channel_i->second.m_Offset + i] * oneOverGTot;
+	}
+
+	if ( sampleCount >= numSubPixels)
+		return 1.0f;
+	return ( TqFloat ) sampleCount / ( TqFloat ) (numSubPixels );
+}
+
+/// Mix the bits of a value into a hash.
+static TqUint hashCombine(TqUint h, TqUint value)
+{
+	h ^= value + 0x9e3779b9U + (h << 6) + (h >> 2);
+	return h;
+}
+
+/** Restart the calling thread's random number stream before shading a grid.
+ *
+ * Grids are shaded on whichever thread is free, and each thread draws from
+ * its own stream, so without this the values of random() in the shaders
+ * would change from run to run.  The key depends only on the bucket and the
+ * raster bound of the diced surface, which are the same in every run and for
+ * any number of threads.
+ */
+static void seedGridStream(const CqBucket& bucket, CqSurface& surface)
+{
+	TqUint key = hashCombine(bucket.getCol(), bucket.getRow());
+	if ( surface.fCachedBound() )
+	{
+		CqBound bound = surface.GetCachedRasterBound();
+		TqFloat coords[6] = { bound.vecMin().x(), bound.vecMin().y(), bound.vecMin().z(),
+		                      bound.vecMax().x(), bound.vecMax().y(), bound.vecMax().z() };
+		TqUint bits[6];
+		std::memcpy(bits, coords, sizeof(bits));
+		for ( TqInt i = 0; i < 6; ++i )
+			key = hashCombine(key, bits[i]);
+	}
+	CqRandom().ReseedStream(key);
+}
+
 CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
                                      const SqOptionCache& optCache)
 	: m_bucket(0),
@@ -40,13 +135,16 @@ CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
 	m_aieImage(),
 	m_pixelPool(optCache.xSamps, optCache.ySamps),
 	m_aFilterValues(),
-	m_CurrentMpgSampleInfo(),
+	m_aFilterValuesX(),
+	m_aFilterValuesY(),
+	m_separableFilter(false),
 	m_OcclusionTree(),
 	m_DataRegion(),
 	m_SampleRegion(),
 	m_DisplayRegion(),
 	m_hasValidSamples(false),
-	m_channelBuffer()
+	m_channelBuffer(),
+	m_shadingState()
 {
 	setupCacheInformation();
 }
@@ -160,7 +258,10 @@ void CqBucketProcessor::preProcess(IqSampler* sampler)
 
 
 		// Clear the sample points and and adjust them for the new bucket
-		// position, jittering the samples if necessary.
+		// position, jittering the samples if necessary.  The jitter is
+		// drawn from a stream restarted for the bucket, so it doesn't depend
+		// on the thread preparing it.
+		CqRandom().ReseedStream( hashCombine( m_bucket->getCol(), m_bucket->getRow() ) );
 		TqInt which = 0;
 		TqInt originY = DisplayRegion().yMin();
 		TqInt originX = DisplayRegion().xMin();
@@ -210,32 +311,35 @@ void CqBucketProcessor::process()
 	if (!m_bucket)
 		return;
 
+	// Grids which this processor shades itself use its own shader instances.
+	CqShadingState::Scope shadingScope(m_shadingState);
+	boost::mutex::scoped_lock lock(m_imageBuf.pipelineMutex());
+	while(true)
 	{
-		AQSIS_TIME_SCOPE(Render_MPGs);
-		RenderWaitingMPs();
-	}
-
-	// Render any waiting subsurfaces.
-	// \todo Need to refine the exit condition, to ensure that all previous buckets have been
-	// duly processed.
-	while ( m_bucket->hasPendingSurfaces() )
-	{
-		boost::shared_ptr<CqSurface> surface = m_bucket->pTopSurface();
-		if (surface)
+		if(!m_bucket->micropolygons().empty())
 		{
-			// Advance to next surface
-			m_bucket->popSurface();
-			RenderSurface( surface );
-			{
-				AQSIS_TIME_SCOPE(Render_MPGs);
-				RenderWaitingMPs();
-			}
+			AQSIS_TIME_SCOPE(Render_MPGs);
+			RenderWaitingMPs(lock);
+		}
+		else if(m_bucket->hasPendingSurfaces())
+		{
+			// Advance to the next surfaces
+			RenderSurfaces( lock );
+			m_imageBuf.notifyPipeline();
+		}
+		else if(m_imageBuf.canCloseBucket(*m_bucket))
+			break;
+		else
+		{
+			// Buckets processed concurrently ahead of this one may still post
+			// geometry here, so wait for them.
+			m_imageBuf.waitForPipeline(lock);
 		}
 	}
-	{
-		AQSIS_TIME_SCOPE(Render_MPGs);
-		RenderWaitingMPs();
-	}
+
+	// Close the bucket to further geometry.
+	m_bucket->SetProcessed();
+	m_imageBuf.notifyPipeline();
 }
 
 void CqBucketProcessor::postProcess()
@@ -256,11 +360,14 @@ void CqBucketProcessor::postProcess()
 		ExposeBucket();
 	}
 
+	// Cache segments are only handed to neighbours which haven't been started
+	// by another processor yet.
+	boost::mutex::scoped_lock lock(m_imageBuf.pipelineMutex());
 	boost::shared_ptr<SqBucketCacheSegment> top_left, top_right, bottom_left, bottom_right;
 
 	std::vector<CqBucket*> neighbours;
 	m_imageBuf.axialNeighbours(*m_bucket, neighbours);
-	if(neighbours[CqImageBuffer::left] && !neighbours[CqImageBuffer::left]->IsProcessed())
+	if(neighbours[CqImageBuffer::left] && !neighbours[CqImageBuffer::left]->IsStarted())
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::left, cacheSegment);
@@ -279,7 +386,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::left]->setCacheSegment(SqBucketCacheSegment::bottom_right, bottom_left);
 		}
 	}
-	if(neighbours[CqImageBuffer::right] && !neighbours[CqImageBuffer::right]->IsProcessed())
+	if(neighbours[CqImageBuffer::right] && !neighbours[CqImageBuffer::right]->IsStarted())
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::right, cacheSegment);
@@ -297,7 +404,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::right]->setCacheSegment(SqBucketCacheSegment::bottom_left, bottom_right);
 		}
 	}
-	if(neighbours[CqImageBuffer::above] && !neighbours[CqImageBuffer::above]->IsProcessed())
+	if(neighbours[CqImageBuffer::above] && !neighbours[CqImageBuffer::above]->IsStarted())
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::top, cacheSegment);
@@ -321,7 +428,7 @@ void CqBucketProcessor::postProcess()
 			neighbours[CqImageBuffer::above]->setCacheSegment(SqBucketCacheSegment::bottom_right, top_right);
 		}
 	}
-	if(neighbours[CqImageBuffer::below] && !neighbours[CqImageBuffer::below]->IsProcessed())
+	if(neighbours[CqImageBuffer::below] && !neighbours[CqImageBuffer::below]->IsStarted())
 	{
 		boost::shared_ptr<SqBucketCacheSegment> cacheSegment(new SqBucketCacheSegment);
 		buildCacheSegment(SqBucketCacheSegment::bottom, cacheSegment);
@@ -353,9 +460,6 @@ void CqBucketProcessor::postProcess()
 	}
 
 	m_bucket->clearCache();
-
-	assert(!m_bucket->IsProcessed());
-	m_bucket->SetProcessed();
 }
 
 //----------------------------------------------------------------------
@@ -423,159 +527,117 @@ void CqBucketProcessor::FilterBucket()
 	TqInt endy = DisplayRegion().yMax();
 	TqInt endx = DisplayRegion().xMax();
 
-	bool useSeperable = true;
-
 	if(m_hasValidSamples)
 	{
-		// non-seperable is faster for very small filter widths.
-		if(m_optCache.xFiltSize <= 16.0 || m_optCache.yFiltSize <= 16.0)
-			useSeperable = false;
-
-		// FIXME: Separable filters currently crash!  Additionally,
-		// * Some filter types are inherently unseparable (eg, disk, catmull-rom)
-		// * Separable filters are a lot faster where applicable.  The comment
-		//   & heuristic above appears to be incorrect.
-		useSeperable = false;
-
-		if(useSeperable)
+		if(m_separableFilter)
 		{
-			// seperable filter. filtering by fx,fy is equivalent to filtering
-			// by fx,1 followed by 1,fy.
-
-			TqInt size = DisplayRegion().width() * DisplayRegion().height() * m_optCache.ySamps;
-			std::valarray<TqFloat> intermediateSamples( 0.0f, size * datasize);
-			std::valarray<TqInt> sampleCounts(0, size);
-			for ( y = DisplayRegion().yMin() - ymax; y < endy + ymax ; y++ )
+			// Separable filter.  Filtering by f(x,y) = fx(x)*fy(y) is
+			// equivalent to filtering each row of samples by fx and then
+			// filtering the results down each column by fy.
+			//
+			// The rows are filtered for each sample row of each pixel.
+			// Samples in the top and bottom halves of each pixel are kept
+			// apart, since for even filter widths the filter window edge
+			// runs through the middle of the outermost pixels.  Like the
+			// non-separable path, the window is the filter width rounded up
+			// to whole pixels, so fractional widths are approximated in the
+			// same way by both paths.  The only difference is for samples
+			// lying exactly on the centre line of the last row, which the
+			// non-separable path includes.
+			TqInt displayWidth = DisplayRegion().width();
+			TqInt rowStart = DisplayRegion().yMin() - ymax;
+			TqInt numRows = DisplayRegion().height() + 2*ymax;
+			TqInt numBins = numRows * displayWidth * m_optCache.ySamps * 2;
+			std::vector<TqFloat> rowWeights(numBins, 0.0f);
+			std::vector<TqInt> rowCounts(numBins, 0);
+			std::vector<TqFloat> rowSamples(numBins * datasize, 0.0f);
+
+			for ( y = rowStart; y < endy + ymax; y++ )
 			{
-				TqFloat ycent = y + 0.5f;
-				TqInt pixelRow = (y-(DisplayRegion().yMin()-ymax)) * m_optCache.ySamps;
+				TqInt rowBin = (y - rowStart) * displayWidth;
 				for ( x = DisplayRegion().xMin(); x < endx ; x++ )
 				{
 					TqFloat xcent = x + 0.5f;
+					TqInt bin = (rowBin + x - DisplayRegion().xMin()) * m_optCache.ySamps * 2;
 
 					// Get the element at the left side of the filter area.
 					ImageElement( x - xmax, y, pie );
-
-					TqInt pixelIndex = pixelRow*DisplayRegion().width() + x-DisplayRegion().xMin();
-
-					// filter just in x first
-					for ( TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
+					for ( TqInt fx = -xmax; fx <= xmax; fx++, ++pie )
 					{
-						TqFloat gTot = 0.0;
-						SampleCount = 0;
-						std::valarray<TqFloat> samples( 0.0f, datasize);
-
-						CqImagePixelPtr* pie2 = pie;
-						for ( TqInt fx = -xmax; fx <= xmax; fx++ )
+						const TqFloat* weights = &m_aFilterValuesX[(fx + xmax) * m_optCache.xSamps];
+						TqInt sampleIndex = 0;
+						for ( TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
 						{
-							TqInt index = (ymax*(2*xmax + 1) + fx + xmax) * numSubPixels;
-							// Now go over each subsample within the pixel
-							TqInt sampleIndex = sy * m_optCache.xSamps;
-
-							for ( TqInt sx = 0; sx < m_optCache.xSamps; sx++ )
+							for ( TqInt sx = 0; sx < m_optCache.xSamps; sx++, sampleIndex++ )
 							{
-								SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
-								CqVector2D vecS = sampleData.position;
-								vecS -= CqVector2D( xcent, ycent );
-								if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
+								const CqVector2D& pos = (*pie)->SampleData( sampleIndex ).position;
+								TqFloat dx = pos.x() - xcent;
+								if ( dx < -xfwo2 || dx > xfwo2 )
+									continue;
+								TqInt half = (pos.y() - y >= 0.5f) ? 1 : 0;
+								TqInt sampleBin = bin + sy*2 + half;
+								TqFloat g = weights[sx];
+								rowWeights[sampleBin] += g;
+								SqImageSample& opv = (*pie)->occludingHit(sampleIndex);
+								if ( opv.flags & SqImageSample::Flag_Valid )
 								{
-									TqFloat g = m_aFilterValues[index + sampleIndex];
-									gTot += g;
-									SqImageSample& opv = (*pie2)->occludingHit(sampleIndex);
-									if ( opv.flags & SqImageSample::Flag_Valid )
-									{
-										TqFloat* data = (*pie2)->sampleHitData(opv);
-										for ( TqInt k = 0; k < datasize; ++k )
-											samples[k] += data[k] * g;
-										sampleCounts[pixelIndex]++;
-									}
+									TqFloat* data = (*pie)->sampleHitData(opv);
+									TqFloat* dest = &rowSamples[sampleBin * datasize];
+									for ( TqInt k = 0; k < datasize; ++k )
+										dest[k] += data[k] * g;
+									rowCounts[sampleBin]++;
 								}
-								sampleIndex++;
 							}
-							pie2++;
 						}
-
-						// store the intermediate result
-						for ( TqInt k = 0; k < datasize; k ++)
-							intermediateSamples[pixelIndex*datasize + k] = samples[k] / gTot;
-
-						pixelIndex += DisplayRegion().width();
 					}
 				}
 			}
 
-			// now filter in y.
+			// Now filter the rows in y.
+			bool splitEdgeRows = yfwo2 < ymax + 0.5f;
+			std::vector<TqFloat> samples(datasize);
 			for ( y = DisplayRegion().yMin(); y < endy ; y++ )
 			{
-				TqFloat ycent = y + 0.5f;
 				for ( x = DisplayRegion().xMin(); x < endx ; x++ )
 				{
-					TqFloat xcent = x + 0.5f;
 					TqFloat gTot = 0.0;
 					SampleCount = 0;
-					std::valarray<TqFloat> samples( 0.0f, datasize);
-
-					TqInt fy;
-					// Get the element at the top of the filter area.
-					ImageElement( x, y - ymax, pie );
-					for ( fy = -ymax; fy <= ymax; fy++ )
+					std::fill(samples.begin(), samples.end(), 0.0f);
+					for ( TqInt fy = -ymax; fy <= ymax; fy++ )
 					{
-						CqImagePixelPtr* pie2 = pie;
-
-						TqInt index = ((fy + ymax)*(2*xmax + 1) + xmax) * numSubPixels;
-						// Now go over each y subsample within the pixel
-						TqInt sx = m_optCache.xSamps / 2; // use the samples in the centre of the pixel.
-						TqInt sy = 0;
-						TqInt sampleIndex = sx;
-						TqInt pixelRow = (y + fy - (DisplayRegion().yMin()-ymax)) * m_optCache.ySamps;
-						TqInt pixelIndex = pixelRow*DisplayRegion().width() + x-DisplayRegion().xMin();
-
-						for ( sy = 0; sy < m_optCache.ySamps; sy++ )
+						// Only the half of an edge pixel nearest the centre
+						// may lie inside the filter window.
+						TqInt firstHalf = 0;
+						TqInt lastHalf = 1;
+						if ( splitEdgeRows && fy == -ymax )
+							firstHalf = 1;
+						if ( splitEdgeRows && fy == ymax )
+							lastHalf = 0;
+						const TqFloat* weights = &m_aFilterValuesY[(fy + ymax) * m_optCache.ySamps];
+						TqInt bin = ((y + fy - rowStart) * displayWidth + x - DisplayRegion().xMin())
+							* m_optCache.ySamps * 2;
+						for ( TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
 						{
-							SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
-							CqVector2D vecS = sampleData.position;
-							vecS -= CqVector2D( xcent, ycent );
-							if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
+							TqFloat g = weights[sy];
+							for ( TqInt half = firstHalf; half <= lastHalf; half++ )
 							{
-								TqFloat g = m_aFilterValues[index + sampleIndex];
-								gTot += g;
-								if(sampleCounts[pixelIndex] > 0)
+								TqInt sampleBin = bin + sy*2 + half;
+								gTot += g * rowWeights[sampleBin];
+								if ( rowCounts[sampleBin] > 0 )
 								{
-									SampleCount += sampleCounts[pixelIndex];
-									for ( TqInt k = 0; k < datasize; k++)
-										samples[k] += intermediateSamples[pixelIndex * datasize + k] * g;
+									SampleCount += rowCounts[sampleBin];
+									const TqFloat* src = &rowSamples[sampleBin * datasize];
+									for ( TqInt k = 0; k < datasize; ++k )
+										samples[k] += src[k] * g;
 								}
 							}
-							sampleIndex += m_optCache.xSamps;
-							pixelIndex += DisplayRegion().width();
-						}
-
-						pie += xlen;
-					}
-
-					// Set depth to infinity if no samples.
-					if ( SampleCount == 0 )
-					{
-						aCoverages[i] = 0.0;
-					}
-					else
-					{
-						float oneOverGTot = 1.0 / gTot;
-
-						// Copy the filtered sample data into the channel buffer.
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x, y, channel_i->first)[i] = samples[channel_i->second.m_Offset + i] * oneOverGTot;
 						}
-
-						if ( SampleCount >= numSubPixels)
-							aCoverages[ i ] = 1.0;
-						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
 					}
 
-					i++;
+					aCoverages[i++] = storeFilteredPixel(m_channelBuffer,
+							x - DisplayRegion().xMin(), y - DisplayRegion().yMin(),
+							&samples[0], gTot, SampleCount, numSubPixels,
+							channelMap, depthIndex);
 				}
 			}
 		}
@@ -628,37 +690,10 @@ void CqBucketProcessor::FilterBucket()
 						}
 					}
 
-
-					// Set depth to infinity if no samples.
-					if ( SampleCount == 0 )
-					{
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), channel_i->first)[i] = 0.0f;
-						}
-						// Set the depth to infinity.
-						m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), depthIndex)[0] = FLT_MAX;
-						aCoverages[i] = 0.0;
-					}
-					else
-					{
-						float oneOverGTot = 1.0 / gTot;
-						
-						// Copy the filtered sample data into the channel buffer.
-						for( std::map<TqInt, CqRenderer::SqOutputDataEntry>::iterator channel_i = channelMap.begin(); channel_i != channelMap.end(); ++channel_i )
-						{
-							for(TqInt i = 0; i < channel_i->second.m_NumSamples; ++i)
-								m_channelBuffer(x-DisplayRegion().xMin(), y-DisplayRegion().yMin(), channel_i->first)[i] = samples[channel_i->second.m_Offset + i] * oneOverGTot;
-						}
-
-						if ( SampleCount >= numSubPixels)
-							aCoverages[ i ] = 1.0;
-						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
-					}
-
-					i++;
+					aCoverages[i++] = storeFilteredPixel(m_channelBuffer,
+							x - DisplayRegion().xMin(), y - DisplayRegion().yMin(),
+							&samples[0], gTot, SampleCount, numSubPixels,
+							channelMap, depthIndex);
 				}
 			}
 		}
@@ -711,8 +746,9 @@ void CqBucketProcessor::FilterBucket()
 
 	if ( QGetRenderContext() ->poptCurrent()->pshadImager() )
 	{
-		// Init & Execute the imager shader
-
+		// Init & Execute the imager shader.  The shader instance is shared
+		// between all bucket processors.
+		boost::mutex::scoped_lock lock(m_imageBuf.pipelineMutex());
 		QGetRenderContext() ->poptCurrent()->InitialiseColorImager( DisplayRegion(), &m_channelBuffer );
 		AQSIS_TIME_SCOPE(Imager_shading);
 
@@ -853,6 +889,43 @@ void CqBucketProcessor::InitialiseFilterValues()
 			}
 		}
 	}
+
+	// Separable filters can also be applied as a filter in x followed by a
+	// filter in y, with weights
+	//   fx(x) = f(x,0)
+	//   fy(y) = f(0,y) / f(0,0)
+	// so that fx(x)*fy(y) = f(x,y).
+	TqFloat xWidth = std::ceil(m_optCache.xFiltSize);
+	TqFloat yWidth = std::ceil(m_optCache.yFiltSize);
+	TqFloat centreValue = ( *pFilter ) ( 0, 0, xWidth, yWidth );
+	m_separableFilter = isSeparableFilter(pFilter) && centreValue != 0;
+	if(m_separableFilter)
+	{
+		m_aFilterValuesX.resize((2*xmax+1) * m_optCache.xSamps);
+		for(TqInt px = -xmax; px <= xmax; px++)
+		{
+			for (TqInt sx = 0; sx < m_optCache.xSamps; sx++ )
+			{
+				TqFloat fx = (sx + 0.5f) / m_optCache.xSamps + px - 0.5f;
+				TqFloat w = 0;
+				if ( fx >= -xfwo2 && fx <= xfwo2 )
+					w = ( *pFilter ) ( fx, 0, xWidth, yWidth );
+				m_aFilterValuesX[(px + xmax) * m_optCache.xSamps + sx] = w;
+			}
+		}
+		m_aFilterValuesY.resize((2*ymax+1) * m_optCache.ySamps);
+		for(TqInt py = -ymax; py <= ymax; py++)
+		{
+			for (TqInt sy = 0; sy < m_optCache.ySamps; sy++ )
+			{
+				TqFloat fy = (sy + 0.5f) / m_optCache.ySamps + py - 0.5f;
+				TqFloat w = 0;
+				if ( fy >= -yfwo2 && fy <= yfwo2 )
+					w = ( *pFilter ) ( 0, fy, xWidth, yWidth ) / centreValue;
+				m_aFilterValuesY[(py + ymax) * m_optCache.ySamps + sy] = w;
+			}
+		}
+	}
 }
 
 void CqBucketProcessor::CalculateDofBounds()
@@ -921,99 +994,200 @@ void CqBucketProcessor::CalculateDofBounds()
     moment
  */
 
-void CqBucketProcessor::RenderWaitingMPs()
+void CqBucketProcessor::RenderWaitingMPs(boost::mutex::scoped_lock& lock)
 {
-	for ( std::vector<boost::shared_ptr<CqMicroPolygon> >::iterator itMP = m_bucket->micropolygons().begin();
-			itMP != m_bucket->micropolygons().end();
+	// Take the waiting micropolygons so that other processors can carry on
+	// posting into the bucket while we sample without holding the lock.
+	m_waitingMPs.swap(m_bucket->micropolygons());
+	lock.unlock();
+
+	// Moving micropolygons build their list of sub-bounds lazily; make sure
+	// that happens before they're shared between sampling tasks.
+	const TqInt timeRanges = std::max(4, m_optCache.xSamps * m_optCache.ySamps);
+	for ( std::vector<CqMicroPolygonPtr>::iterator itMP = m_waitingMPs.begin();
+			itMP != m_waitingMPs.end();
 			itMP++ )
 	{
-		CqMicroPolygon* mp = (*itMP).get();
-		RenderMicroPoly( mp );
+		if((*itMP)->IsMoving())
+			(*itMP)->cSubBounds( timeRanges );
 	}
-	m_bucket->micropolygons().clear();
 
+	// Split the sample region into strips of pixel rows which are sampled in
+	// parallel.  Small batches aren't worth the overhead of the tasks.
+	const TqInt yMin = SampleRegion().yMin();
+	const TqInt yMax = SampleRegion().yMax();
+	TqInt numStrips = std::min<TqInt>(m_imageBuf.threadPool().numThreads(), yMax - yMin);
+	if(static_cast<TqInt>(m_waitingMPs.size()) < minMPsPerStrip*numStrips)
+		numStrips = static_cast<TqInt>(m_waitingMPs.size())/minMPsPerStrip;
+	std::vector<SqSampleCounts> counts(std::max<TqInt>(numStrips, 1));
+	if(numStrips > 1)
+	{
+		CqTaskGroup strips(m_imageBuf.threadPool());
+		for(TqInt i = 0; i < numStrips; ++i)
+		{
+			strips.run(boost::bind(&CqBucketProcessor::SampleWaitingMPs, this,
+						yMin + (yMax - yMin)*i/numStrips,
+						yMin + (yMax - yMin)*(i+1)/numStrips,
+						boost::ref(counts[i])));
+		}
+		strips.wait();
+	}
+	else
+		SampleWaitingMPs(yMin, yMax, counts[0]);
+
+	// The strips set leaf depths concurrently, so the change is recorded
+	// once they've all finished.
+	m_OcclusionTree.markChanged();
 	m_OcclusionTree.updateTree();
+
+	// The micropolygon pools are per thread, but releasing the last
+	// micropolygon of a grid destroys the grid, which isn't thread safe, so
+	// this must happen with the lock held.  The stats and hit flags are
+	// shared with other buckets too.
+	lock.lock();
+	for(std::vector<SqSampleCounts>::const_iterator i = counts.begin();
+			i != counts.end(); ++i)
+		mergeSampleCounts(*i);
+	m_waitingMPs.clear();
+}
+
+void CqBucketProcessor::SampleWaitingMPs( TqInt yMin, TqInt yMax, SqSampleCounts& counts )
+{
+	for ( TqInt i = 0, numMPs = m_waitingMPs.size(); i < numMPs; ++i )
+	{
+		counts.currentHit = false;
+		RenderMicroPoly( m_waitingMPs[i].get(), yMin, yMax, counts );
+		if(counts.currentHit)
+			counts.hitMPs.push_back(i);
+	}
 }
 
+void CqBucketProcessor::mergeSampleCounts(const SqSampleCounts& counts)
+{
+	CqStats::AddI( CqStats::SPL_count, counts.samples );
+	CqStats::AddI( CqStats::SPL_bound_hits, counts.boundHits );
+	CqStats::AddI( CqStats::SPL_hits, counts.hits );
+	for(std::vector<TqInt>::const_iterator i = counts.hitMPs.begin();
+			i != counts.hitMPs.end(); ++i)
+		m_waitingMPs[*i]->MarkHit();
+	// Record the fact that we have valid samples in the bucket.
+	if(counts.hits > 0)
+		m_hasValidSamples = true;
+}
 
 //----------------------------------------------------------------------
 /** Render the given Surface
  */
-void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
+void CqBucketProcessor::RenderSurfaces( boost::mutex::scoped_lock& lock )
 {
-	// Cull surface if it's hidden
-	if ( !surface->pCSGNode() && !( (m_optCache.displayMode & DMode_Z) &&
-	                                (m_optCache.depthFilter == Filter_Max ||
-	                                 m_optCache.depthFilter == Filter_Average) ) )
+	// Take the reentrant surfaces at the top of the queue, one per thread.
+	const TqInt maxBatch = std::max<TqInt>(1, m_imageBuf.threadPool().numThreads());
+	m_surfaceWork.clear();
+	while ( m_bucket->hasPendingSurfaces() &&
+	        static_cast<TqInt>(m_surfaceWork.size()) < maxBatch )
 	{
-		AQSIS_TIME_SCOPE(Occlusion_culling);
-		if ( surface->fCachedBound() &&
-			 ( surface->pAttributes()->GetIntegerAttributeDef( "cull", "hidden", 1 ) == 1 ) &&
-		     m_OcclusionTree.canCull(surface->GetCachedRasterBound()) )
+		boost::shared_ptr<CqSurface> surface = m_bucket->pTopSurface();
+		if ( !surface->isReentrant() )
 		{
-			m_imageBuf.RepostSurface(*m_bucket, surface);
-			STATS_INC( GPR_occlusion_culled );
-			return;
+			if ( m_surfaceWork.empty() )
+			{
+				m_bucket->popSurface();
+				RenderSurface( surface, lock );
+			}
+			break;
 		}
+		m_bucket->popSurface();
+		if ( !CullHiddenSurface( surface ) )
+			m_surfaceWork.push_back( SqSurfaceWork( surface ) );
 	}
+	if ( m_surfaceWork.empty() )
+		return;
 
-	// If the epsilon check has deemed this surface to be undiceable, don't bother asking.
-	bool fDiceable = false;
+	// The surfaces were taken off the bucket queue, so no other processor
+	// can work on them.
+	m_imageBuf.beginSurfaceWork(lock);
+	lock.unlock();
+	if ( m_surfaceWork.size() > 1 )
 	{
-		AQSIS_TIME_SCOPE(Dicable_check);
-		CqMatrix diceCoords;
-		QGetRenderContext()->matSpaceToSpace("camera", "raster", NULL, NULL,
-											 QGetRenderContextI()->Time(),
-											 diceCoords);
-		const TqInt* rasterOrient = surface->pAttributes()->
-								GetIntegerAttribute("dice", "rasterorient");
-		if(rasterOrient && *rasterOrient == 0)
+		CqTaskGroup surfaceTasks(m_imageBuf.threadPool());
+		for ( std::vector<SqSurfaceWork>::iterator work = m_surfaceWork.begin();
+				work != m_surfaceWork.end(); ++work )
 		{
-			// Non raster-oriented dicing: dice the object as if all parts of
-			// the surface face the camera.  When dicing in raster space, the
-			// object dimension along the view direction is neglected from the
-			// calculation.  In contrast, here we measure the dice size in a
-			// scaled version of camera space, so the dimension along the view
-			// direction is equally important.
-			//
-			// Assuming the standard camera model (TODO: What about nonstandard
-			// projections?), xscale and yscale are the scaling factors for
-			// raster space, before projection.
-			TqFloat xscale = diceCoords[0][0];
-			TqFloat yscale = diceCoords[1][1];
-			if(m_optCache.projectionType == ProjectionPerspective)
-			{
-				// For perspective projections, the amount of scaling depends
-				// on the distance of the object from the origin in camera
-				// space, just as for dicing in raster space.  To approximate
-				// extra scaling due to projection, we use the z coordinate at
-				// the centre of the object's bounding box.
-				//
-				// TODO: It's not nice recomputing the bound here.  Perhaps it
-				// would be better to cache it (along with the cached raster
-				// bound?)
-				CqBound bound;
-				surface->Bound(&bound);
-				TqFloat midz = 0.5f*(bound.vecMin().z() + bound.vecMax().z());
-				xscale /= midz;
-				yscale /= midz;
-			}
-			TqFloat zscale = std::max(fabs(xscale), fabs(yscale));
-			diceCoords = CqMatrix(xscale, yscale, zscale);
+			surfaceTasks.run(boost::bind(&CqBucketProcessor::RunSurfaceTask,
+						this, boost::ref(*work)));
 		}
-		else
+		surfaceTasks.wait();
+	}
+	else
+		ProcessSurface( m_surfaceWork.front() );
+	lock.lock();
+	m_imageBuf.endSurfaceWork();
+
+	// Post the results in the order the surfaces came off the queue.
+	for ( std::vector<SqSurfaceWork>::iterator work = m_surfaceWork.begin();
+			work != m_surfaceWork.end(); ++work )
+	{
+		if ( work->grid )
+			PostGrid( work->grid );
+		else if ( work->split )
 		{
-			// Else dice happens in raster space: Zero out z-components of
-			// the transformation, since we don't want it to effect the dice
-			// resolution.
-			diceCoords[0][2] = diceCoords[1][2] = 0;
-			diceCoords[2][2] = diceCoords[3][2] = 0;
+			// Decrease the total gprim count since this gprim is replaced by other gprims
+			STATS_DEC( GPR_created_total );
+			for ( std::vector<boost::shared_ptr<CqSurface> >::iterator split =
+					work->splits.begin(); split != work->splits.end(); ++split )
+				m_imageBuf.PostSurface( *split );
 		}
-		fDiceable = surface->Diceable(diceCoords);
 	}
+	m_surfaceWork.clear();
+}
 
+void CqBucketProcessor::RunSurfaceTask( SqSurfaceWork& work )
+{
+	// The task may run on any render thread, including one shading grids
+	// for another processor, so it can't share that thread's shaders.
+	boost::shared_ptr<CqShadingState> state = m_imageBuf.acquireShadingState();
+	{
+		CqShadingState::Scope shadingScope(*state);
+		ProcessSurface( work );
+	}
+	m_imageBuf.releaseShadingState( state );
+}
+
+void CqBucketProcessor::ProcessSurface( SqSurfaceWork& work )
+{
 	// Dice & shade the surface if it's small enough...
-	if ( fDiceable )
+	if ( IsDiceable( *work.surface ) )
+	{
+		{
+			AQSIS_TIME_SCOPE(Dicing);
+			work.grid = work.surface->Dice();
+		}
+		if ( work.grid )
+		{
+			// Only shade in all cases since the Displacement could be called in the shadow map creation too.
+			// \note Timings for shading are broken down into component parts within this function.
+			seedGridStream( *m_bucket, *work.surface );
+			work.grid->Shade();
+			work.grid->TransferOutputVariables();
+		}
+	}
+	// The surface is not small enough, so split it...
+	else if ( !work.surface->fDiscard() )
+	{
+		AQSIS_TIME_SCOPE(Splitting);
+		work.surface->Split( work.splits );
+		work.split = true;
+	}
+}
+
+void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface,
+                                       boost::mutex::scoped_lock& lock )
+{
+	if ( CullHiddenSurface( surface ) )
+		return;
+
+	// Dice & shade the surface if it's small enough...
+	if ( IsDiceable( *surface ) )
 	{
 		CqMicroPolyGridBase* pGrid = 0;
 		{
@@ -1023,20 +1197,19 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 
 		if ( NULL != pGrid )
 		{
-			ADDREF( pGrid );
+			// The grid is private to this processor until it's split, and
+			// the shaders are this thread's instances, so shade it without
+			// the lock.
+			m_imageBuf.beginSurfaceWork(lock);
+			lock.unlock();
 			// Only shade in all cases since the Displacement could be called in the shadow map creation too.
 			// \note Timings for shading are broken down into component parts within this function.
+			seedGridStream( *m_bucket, *surface );
 			pGrid->Shade();
 			pGrid->TransferOutputVariables();
-
-			if ( pGrid->vfCulled() == false )
-			{
-				AQSIS_TIME_SCOPE(Bust_grids);
-				// Split any grids in this bucket waiting to be processed.
-				pGrid->Split( SampleRegion().xMin(), SampleRegion().xMax(), SampleRegion().yMin(), SampleRegion().yMax());
-			}
-
-			RELEASEREF( pGrid );
+			lock.lock();
+			m_imageBuf.endSurfaceWork();
+			PostGrid( pGrid );
 		}
 	}
 	// The surface is not small enough, so split it...
@@ -1045,17 +1218,151 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 		// Decrease the total gprim count since this gprim is replaced by other gprims
 		STATS_DEC( GPR_created_total );
 
+		// Delayed archives may be expanded one bucket row at a time so that
+		// geometry in later rows isn't held in memory.  Only the geometry
+		// starting in the current row is kept, and the archive is read again
+		// in the next row in which geometry starts.
+		CqProcedural* archive = 0;
+		if ( m_optCache.rereadArchives && !surface->IsUndiceable() &&
+		     !surface->pCSGNode() )
+		{
+			archive = dynamic_cast<CqProcedural*>(surface.get());
+			if ( archive && !archive->isDelayedArchive() )
+				archive = 0;
+		}
+		TqInt nextRow = -1;
+
 		// Split it
 		{
 			AQSIS_TIME_SCOPE(Splitting);
+			// Procedurals replace the render context while they're
+			// expanded, so they mustn't run alongside any other surface work.
+			bool procedural = archive || dynamic_cast<CqProcedural*>(surface.get());
+			if ( procedural )
+				m_imageBuf.beginExpansion(lock);
 			std::vector<boost::shared_ptr<CqSurface> > aSplits;
+			// Geometry for other rows is held back on the first expansion,
+			// in case the archive turns out not to be expandable again.
+			bool firstExpansion = archive && archive->lastExpandedRow() < 0;
+			TqInt globalRequests = QGetRenderContext()->globalRequests();
+			if ( archive )
+				m_imageBuf.beginRowExpansion(archive->lastExpandedRow() + 1,
+				                             m_bucket->getRow(), firstExpansion);
 			TqInt cSplits = surface->Split( aSplits );
+			if ( archive )
+			{
+				// Archives making requests which outlast the expansion, such
+				// as Declare or LightSource, are only expanded once.
+				bool expandOnce = firstExpansion &&
+					QGetRenderContext()->globalRequests() != globalRequests;
+				nextRow = m_imageBuf.endRowExpansion(expandOnce);
+				if ( expandOnce )
+					nextRow = -1;
+			}
+			if ( procedural )
+				m_imageBuf.endExpansion();
 			for ( TqInt i = 0; i < cSplits; i++ )
 			{
 				m_imageBuf.PostSurface( aSplits[ i ] );
 			}
 		}
+		if ( archive )
+		{
+			archive->setLastExpandedRow(m_bucket->getRow());
+			if ( nextRow >= 0 && m_imageBuf.PostSurfaceToRow(nextRow, surface) )
+				STATS_INC( GPR_created_total );
+		}
+	}
+}
+
+bool CqBucketProcessor::CullHiddenSurface( const boost::shared_ptr<CqSurface>& surface )
+{
+	// Cull surface if it's hidden
+	if ( !surface->pCSGNode() && !( (m_optCache.displayMode & DMode_Z) &&
+	                                (m_optCache.depthFilter == Filter_Max ||
+	                                 m_optCache.depthFilter == Filter_Average) ) )
+	{
+		AQSIS_TIME_SCOPE(Occlusion_culling);
+		if ( surface->fCachedBound() &&
+			 ( surface->pAttributes()->GetIntegerAttributeDef( "cull", "hidden", 1 ) == 1 ) &&
+		     m_OcclusionTree.canCull(surface->GetCachedRasterBound()) )
+		{
+			m_imageBuf.RepostSurface(*m_bucket, surface);
+			STATS_INC( GPR_occlusion_culled );
+			return true;
+		}
 	}
+	return false;
+}
+
+bool CqBucketProcessor::IsDiceable( CqSurface& surface ) const
+{
+	// If the epsilon check has deemed this surface to be undiceable, don't bother asking.
+	AQSIS_TIME_SCOPE(Dicable_check);
+	CqMatrix diceCoords;
+	QGetRenderContext()->matSpaceToSpace("camera", "raster", NULL, NULL,
+										 QGetRenderContextI()->Time(),
+										 diceCoords);
+	const TqInt* rasterOrient = surface.pAttributes()->
+							GetIntegerAttribute("dice", "rasterorient");
+	if(rasterOrient && *rasterOrient == 0)
+	{
+		// Non raster-oriented dicing: dice the object as if all parts of
+		// the surface face the camera.  When dicing in raster space, the
+		// object dimension along the view direction is neglected from the
+		// calculation.  In contrast, here we measure the dice size in a
+		// scaled version of camera space, so the dimension along the view
+		// direction is equally important.
+		//
+		// Assuming the standard camera model (TODO: What about nonstandard
+		// projections?), xscale and yscale are the scaling factors for
+		// raster space, before projection.
+		TqFloat xscale = diceCoords[0][0];
+		TqFloat yscale = diceCoords[1][1];
+		if(m_optCache.projectionType == ProjectionPerspective)
+		{
+			// For perspective projections, the amount of scaling depends
+			// on the distance of the object from the origin in camera
+			// space, just as for dicing in raster space.  To approximate
+			// extra scaling due to projection, we use the z coordinate at
+			// the centre of the object's bounding box.
+			//
+			// TODO: It's not nice recomputing the bound here.  Perhaps it
+			// would be better to cache it (along with the cached raster
+			// bound?)
+			CqBound bound;
+			surface.Bound(&bound);
+			TqFloat midz = 0.5f*(bound.vecMin().z() + bound.vecMax().z());
+			xscale /= midz;
+			yscale /= midz;
+		}
+		TqFloat zscale = std::max(fabs(xscale), fabs(yscale));
+		diceCoords = CqMatrix(xscale, yscale, zscale);
+	}
+	else
+	{
+		// Else dice happens in raster space: Zero out z-components of
+		// the transformation, since we don't want it to effect the dice
+		// resolution.
+		diceCoords[0][2] = diceCoords[1][2] = 0;
+		diceCoords[2][2] = diceCoords[3][2] = 0;
+	}
+	return surface.Diceable(diceCoords);
+}
+
+void CqBucketProcessor::PostGrid( CqMicroPolyGridBase* pGrid )
+{
+	ADDREF( pGrid );
+	pGrid->recordShadingStats();
+
+	if ( pGrid->vfCulled() == false )
+	{
+		AQSIS_TIME_SCOPE(Bust_grids);
+		// Split any grids in this bucket waiting to be processed.
+		pGrid->Split( SampleRegion().xMin(), SampleRegion().xMax(), SampleRegion().yMin(), SampleRegion().yMax());
+	}
+
+	RELEASEREF( pGrid );
 }
 
 //----------------------------------------------------------------------
@@ -1064,42 +1371,46 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
  * \param pMP Pointer to the micropolygon to process.
    \see CqBucket, CqImagePixel
  */
-void CqBucketProcessor::RenderMicroPoly( CqMicroPolygon* pMP )
+void CqBucketProcessor::RenderMicroPoly( CqMicroPolygon* pMP, TqInt yMin, TqInt yMax,
+		SqSampleCounts& counts )
 {
 	bool UsingDof = QGetRenderContext()->UsingDepthOfField();
 	bool IsMoving = pMP->IsMoving();
 
-	m_CurrentMpgSampleInfo.smoothInterpolation =
+	SqMpgSampleInfo sampleInfo;
+	sampleInfo.smoothInterpolation =
 		pMP->pGrid()->GetCachedGridInfo().useSmoothShading;
 
 	// Samples hitting the micropoly are occlusion cullable if
 	// 1) The micropoly is not part of a CSG
 	// 2) We don't need the entire set of samples for depth filtering.
-	m_CurrentMpgSampleInfo.isCullable = !pMP->pGrid()->usesCSG() &&
+	sampleInfo.isCullable = !pMP->pGrid()->usesCSG() &&
 	                  !( (m_optCache.displayMode & DMode_Z) &&
 	                     (m_optCache.depthFilter == Filter_Max ||
 	                      m_optCache.depthFilter == Filter_Average) );
 
 	// Cache output sample info for this mpg so we don't have to keep fetching
 	// it for each sample.
-	pMP->CacheOutputInterpCoeffs(m_CurrentMpgSampleInfo);
+	pMP->CacheOutputInterpCoeffs(sampleInfo);
 
 	if(IsMoving || UsingDof)
-		RenderMPG_MBOrDof( pMP, IsMoving, UsingDof );
+		RenderMPG_MBOrDof( pMP, IsMoving, UsingDof, sampleInfo, yMin, yMax, counts );
 	else
-		RenderMPG_Static( pMP );
+		RenderMPG_Static( pMP, sampleInfo, yMin, yMax, counts );
 }
 
 
 
 // this function assumes that neither dof or mb are being used. it is much
 // simpler than the general case dealt with above.
-void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
+void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG,
+		const SqMpgSampleInfo& sampleInfo, TqInt yMin, TqInt yMax,
+		SqSampleCounts& counts )
 {
 	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
     const TqFloat* LodBounds = currentGridInfo.lodBounds;
     bool UsingLevelOfDetail = LodBounds[ 0 ] >= 0.0f;
-	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
+	bool isCullable = sampleInfo.isCullable;
 
     TqInt sample_hits = 0;
 
@@ -1120,11 +1431,11 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 	TqInt eX = lceil( bmaxx );
 	TqInt eY = lceil( bmaxy );
 	if ( eX > SampleRegion().xMax() ) eX = SampleRegion().xMax();
-	if ( eY > SampleRegion().yMax() ) eY = SampleRegion().yMax();
+	if ( eY > yMax ) eY = yMax;
 
 	TqInt sX = static_cast<TqInt>(std::floor( bminx ));
 	TqInt sY = static_cast<TqInt>(std::floor( bminy ));
-	if ( sY < SampleRegion().yMin() ) sY = SampleRegion().yMin();
+	if ( sY < yMin ) sY = yMin;
 	if ( sX < SampleRegion().xMin() ) sX = SampleRegion().xMin();
 
 	CqImagePixelPtr* pie, *pie2;
@@ -1169,14 +1480,14 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 					const CqVector2D& vecP = sampleData.position;
 					const TqFloat time = 0.0;
 
-					CqStats::IncI( CqStats::SPL_count );
+					++counts.samples;
 
 					if(!Bound.Contains2D( vecP ))
 						continue;
 
 					// Occlusion cull the micropoly bound against the current
 					// opaque sample hit.
-					if(isCullable && Bound.vecMin().z() > sampleData.occlZ)
+					if(isCullable && Bound.vecMin().z() > (*pie2)->occlZ( index ))
 						continue;
 
 					// Check to see if the sample is within the sample's level of detail
@@ -1189,7 +1500,7 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 						}
 					}
 
-					CqStats::IncI( CqStats::SPL_bound_hits );
+					++counts.boundHits;
 
 					// Now check if the subsample hits the micropoly
 					bool SampleHit;
@@ -1201,7 +1512,7 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 					if ( SampleHit )
 					{
 						sample_hits++;
-						StoreSample( pMPG, pie2->get(), index, D, uv );
+						StoreSample( pMPG, sampleInfo, pie2->get(), index, D, uv, counts );
 					}
 				}
 				index_start += iXSamples;
@@ -1218,13 +1529,15 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 }
 
 // this function assumes that either dof or mb or both are being used.
-void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving, bool UsingDof )
+void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
+		bool UsingDof, const SqMpgSampleInfo& sampleInfo, TqInt yMin, TqInt yMax,
+		SqSampleCounts& counts )
 {
 	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
 
     const TqFloat* LodBounds = currentGridInfo.lodBounds;
     bool UsingLevelOfDetail = LodBounds[ 0 ] >= 0.0f;
-	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
+	bool isCullable = sampleInfo.isCullable;
 
     TqInt sample_hits = 0;
 
@@ -1336,11 +1649,11 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 			TqInt eX = lceil( bmaxx );
 			TqInt eY = lceil( bmaxy );
 			if ( eX > SampleRegion().xMax() ) eX = SampleRegion().xMax();
-			if ( eY > SampleRegion().yMax() ) eY = SampleRegion().yMax();
+			if ( eY > yMax ) eY = yMax;
 
 			TqInt sX = static_cast<TqInt>(std::floor( bminx ));
 			TqInt sY = static_cast<TqInt>(std::floor( bminy ));
-			if ( sY < SampleRegion().yMin() ) sY = SampleRegion().yMin();
+			if ( sY < yMin ) sY = yMin;
 			if ( sX < SampleRegion().xMin() ) sX = SampleRegion().xMin();
 
 			CqImagePixelPtr* pie, *pie2;
@@ -1382,7 +1695,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 
 						index++;
 
-						CqStats::IncI( CqStats::SPL_count );
+						++counts.samples;
 
 						if(IsMoving && (time < time0 || time > time1))
 						{
@@ -1398,7 +1711,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 								continue;
 							// Occlusion cull the micropoly bound against the
 							// current opaque sample hit.
-							if(isCullable && Bound.vecMin().z() > sampleData.occlZ)
+							if(isCullable && Bound.vecMin().z() > (*pie2)->occlZ( index - 1 ))
 								continue;
 
 							// Check to see if the sample is within the sample's level of detail
@@ -1412,7 +1725,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 							}
 
 
-							CqStats::IncI( CqStats::SPL_bound_hits );
+							++counts.boundHits;
 
 							// Now check if the subsample hits the micropoly
 							bool SampleHit;
@@ -1424,7 +1737,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 							{
 								sample_hits++;
 								// note index has already been incremented, so we use the previous value.
-								StoreSample( pMPG, pie2->get(), index-1, D, uv );
+								StoreSample( pMPG, sampleInfo, pie2->get(), index-1, D, uv, counts );
 							}
 						}
 						else
@@ -1433,7 +1746,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 								continue;
 							// Occlusion cull the micropoly bound against the
 							// current opaque sample hit.
-							if(isCullable && Bound.vecMin().z() > sampleData.occlZ)
+							if(isCullable && Bound.vecMin().z() > (*pie2)->occlZ( index - 1 ))
 								continue;
 
 							// Check to see if the sample is within the sample's level of detail
@@ -1446,7 +1759,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 								}
 							}
 
-							CqStats::IncI( CqStats::SPL_bound_hits );
+							++counts.boundHits;
 
 							// Now check if the subsample hits the micropoly
 							bool SampleHit;
@@ -1458,7 +1771,7 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 							{
 								sample_hits++;
 								// note index has already been incremented, so we use the previous value.
-								StoreSample( pMPG, pie2->get(), index-1, D, uv );
+								StoreSample( pMPG, sampleInfo, pie2->get(), index-1, D, uv, counts );
 							}
 						}
 					} while (!UsingDof && index < indexT1);
@@ -1468,26 +1781,27 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
     }
 }
 
-void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, TqInt index, TqFloat D, const CqVector2D& uv )
+void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, const SqMpgSampleInfo& sampleInfo,
+		CqImagePixel* pie2, TqInt index, TqFloat D, const CqVector2D& uv,
+		SqSampleCounts& counts )
 {
-	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
-	SqSampleData& sampleData = pie2->SampleData( index );
-	if(isCullable && sampleData.occlZ <= D)
+	bool isCullable = sampleInfo.isCullable;
+	const SqSampleData& sampleData = pie2->SampleData( index );
+	TqFloat& occlZ = pie2->occlZ( index );
+	if(isCullable && occlZ <= D)
 	{
 		// If the sample hit is occluded and can be culled then we return early
 		// without storing the hit data at all.
 		return;
 	}
-	// Record the sample hit in the stats.
-	CqStats::IncI( CqStats::SPL_hits );
-	pMPG->MarkHit();
-	// Record the fact that we have valid samples in the bucket.
-	m_hasValidSamples = true;
+	// Record the sample hit, see mergeSampleCounts().
+	++counts.hits;
+	counts.currentHit = true;
 
 	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
 	// Get a pointer to the hit storage.
 	SqImageSample* hit = 0;
-	if((m_CurrentMpgSampleInfo.isOpaque || (currentGridInfo.matteFlag
+	if((sampleInfo.isOpaque || (currentGridInfo.matteFlag
 				& SqImageSample::Flag_MatteAlpha)) && isCullable)
 	{
 		// Use the occluding sample storage when possible, since this is
@@ -1511,8 +1825,8 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 			if(hitPrevZ < D)
 			{
 				// view -->      |          |          |
-				// direc      hitPrevZ      D     sampleData.occlZ
-				sampleData.occlZ = D;
+				// direc      hitPrevZ      D     occlZ
+				occlZ = D;
 				m_OcclusionTree.setSampleDepth(D, sampleData.occlusionIndex);
 				// In this special case, we don't actually have to store the
 				// hit since the depth is greater than the occluding surface,
@@ -1522,31 +1836,29 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 			else
 			{
 				// view -->      |          |          |
-				// direc         D      hitPrevZ    sampleData.occlZ
-				sampleData.occlZ = hitPrevZ;
+				// direc         D      hitPrevZ    occlZ
+				occlZ = hitPrevZ;
 				m_OcclusionTree.setSampleDepth(hitPrevZ, sampleData.occlusionIndex);
 			}
 		}
 		else
 		{
-			sampleData.occlZ = D;
+			occlZ = D;
 			m_OcclusionTree.setSampleDepth(D, sampleData.occlusionIndex);
 		}
 		hit->flags = SqImageSample::Flag_Valid;
 	}
 	else
 	{
-		// Otherwise create some new storage for the hit data in sample hit
-		// vector.
-		pie2->Values(index).push_back(SqImageSample());
-		hit = &pie2->Values(index).back();
-		pie2->allocateHitData(*hit);
+		// Otherwise create some new storage for the hit data in the pixel's
+		// hit arena.
+		hit = &pie2->addHit(index);
 	}
 
 	// Compute the color and opacity of the micropolygon at the hit point.
 	CqColor col;
 	CqColor opa;
-	pMPG->InterpolateOutputs(m_CurrentMpgSampleInfo, uv, col, opa);
+	pMPG->InterpolateOutputs(sampleInfo, uv, col, opa);
 
 	// Store the hit data for later use.
 	TqFloat* hitData = pie2->sampleHitData(*hit);
@@ -1560,8 +1872,10 @@ void CqBucketProcessor::StoreSample( CqMicroPolygon* pMPG, CqImagePixel* pie2, T
 	if(currentGridInfo.usesDataMap)
 		StoreExtraData(pMPG, hitData);
 
-	// Update CSG pointer and flags.
-	hit->csgNode = pMPG->pGrid()->pCSGNode();
+	// Update CSG node and flags.  Hits start with no CSG node, so the node
+	// only needs looking up when CSG is in use.
+	if(CqCSGTreeNode::IsRequired())
+		hit->csgNode = pie2->csgNodeIndex(pMPG->pGrid()->pCSGNode());
 	hit->flags |= currentGridInfo.matteFlag;
 
 	// Mark the pixel as containing valid samples, used later for the cacheing and reuse.
@@ -29,6 +29,7 @@
 #include	<aqsis/aqsis.h>
 
 #include	<boost/array.hpp>
+#include	<boost/thread/mutex.hpp>
 
 #include	"bucket.h"
 #include	"channelbuffer.h"
@@ -36,6 +37,7 @@
 #include	"isampler.h"
 #include	"occlusion.h"
 #include	"optioncache.h"
+#include	"shadingstate.h"
 
 
 namespace Aqsis {
@@ -73,6 +75,15 @@ class CqBucketProcessor
 		void preProcess(IqSampler* sampler);
 
 		/** Process the bucket, basically rendering the waiting MPs
+		 *
+		 * Rendering continues until the image buffer allows the bucket to be
+		 * closed, at which point it's marked as processed.
+		 *
+		 * The image buffer pipeline mutex is only held while taking work from
+		 * the bucket and posting the results.  Batches of the waiting
+		 * surfaces are split, or diced and shaded, in parallel tasks without
+		 * it (see RenderSurfaces()), and the waiting micropolygons are
+		 * sampled without it in parallel strips of the bucket.
 		 */
 		void process();
 
@@ -102,6 +113,56 @@ class CqBucketProcessor
 		//--------------------------------------------------
 		friend class CqSampleIterator;
 
+		/** \brief Results of sampling the waiting micropolygons.
+		 *
+		 * Rows of a bucket are sampled concurrently, and other buckets may
+		 * share the same micropolygons, so the sampling code doesn't touch
+		 * the global stats or the micropolygon hit flags directly.  Each row
+		 * range counts into its own copy instead, and the copies are merged
+		 * by mergeSampleCounts() with the pipeline lock held.
+		 */
+		struct SqSampleCounts
+		{
+			TqInt	samples;		///< Samples tested against a micropolygon.
+			TqInt	boundHits;		///< Samples inside a micropolygon bound.
+			TqInt	hits;			///< Samples stored.
+			/// Indices into m_waitingMPs of the micropolygons with stored samples.
+			std::vector<TqInt>	hitMPs;
+			/// True if the current micropolygon has a stored sample.
+			bool	currentHit;
+
+			SqSampleCounts()
+				: samples(0),
+				boundHits(0),
+				hits(0),
+				hitMPs(),
+				currentHit(false)
+			{ }
+		};
+
+		/** \brief A surface taken from the bucket by RenderSurfaces().
+		 *
+		 * The surfaces of a batch are split, or diced and shaded, by separate
+		 * tasks, which leave the results here to be posted in the order the
+		 * surfaces were taken.
+		 */
+		struct SqSurfaceWork
+		{
+			boost::shared_ptr<CqSurface>	surface;
+			/// Shaded grid, or null if the surface wasn't diced.
+			CqMicroPolyGridBase*	grid;
+			/// True if the surface was split into splits.
+			bool	split;
+			std::vector<boost::shared_ptr<CqSurface> >	splits;
+
+			SqSurfaceWork(const boost::shared_ptr<CqSurface>& surface)
+				: surface(surface),
+				grid(0),
+				split(false),
+				splits()
+			{ }
+		};
+
 		void	InitialiseFilterValues();
 		void	CalculateDofBounds();
 		void	CombineElements();
@@ -116,25 +177,81 @@ class CqBucketProcessor
 
 		CqImagePixel& ImageElement(TqUint index) const;
 		/** Render any waiting MPs.
+		 *
+		 * \param lock - lock held on the image buffer pipeline mutex; it's
+		 *                released while the micropolygons are sampled.
+		 */
+		void RenderWaitingMPs(boost::mutex::scoped_lock& lock);
+		/** Sample all waiting MPs against the pixel rows [yMin, yMax) of the
+		 * sample region.
+		 *
+		 * Disjoint row ranges touch disjoint samples, so several ranges may
+		 * be sampled concurrently.  Each pixel still sees the micropolygons
+		 * in the same order, which keeps the result deterministic.
+		 *
+		 * \param counts - statistics and hits for this row range only.
+		 */
+		void SampleWaitingMPs( TqInt yMin, TqInt yMax, SqSampleCounts& counts );
+		/** Take a batch of surfaces from the bucket and split, or dice and
+		 * shade, them.
+		 *
+		 * The batch holds up to one reentrant surface per render thread (see
+		 * CqSurface::isReentrant()), which are worked on in parallel tasks.
+		 * The grids and split surfaces are posted in the order the surfaces
+		 * were taken, so the result doesn't depend on which task finishes
+		 * first.  A surface which isn't reentrant is rendered on its own by
+		 * RenderSurface().
+		 *
+		 * \param lock - lock held on the image buffer pipeline mutex; it's
+		 *                released while the batch is worked on.
 		 */
-		void RenderWaitingMPs();
-		void RenderSurface( boost::shared_ptr<CqSurface>& surface);
+		void RenderSurfaces( boost::mutex::scoped_lock& lock );
+		/** Split, or dice and shade, a surface which isn't reentrant.
+		 *
+		 * \param lock - lock held on the image buffer pipeline mutex; it's
+		 *                released only while the grid is shaded.
+		 */
+		void RenderSurface( boost::shared_ptr<CqSurface>& surface,
+		                    boost::mutex::scoped_lock& lock );
+		/** Repost a surface to later buckets if it's hidden in this one.
+		 *
+		 * \return true if the surface was culled.
+		 */
+		bool CullHiddenSurface( const boost::shared_ptr<CqSurface>& surface );
+		/// Determine whether a surface is small enough to be diced.
+		bool IsDiceable( CqSurface& surface ) const;
+		/** Split, or dice and shade, a reentrant surface without the
+		 * pipeline lock, using the calling thread's shading state.
+		 */
+		void ProcessSurface( SqSurfaceWork& work );
+		/// Run ProcessSurface() as a task, with a shading state of its own.
+		void RunSurfaceTask( SqSurfaceWork& work );
+		/// Split a shaded grid into micropolygons and post them; lock held.
+		void PostGrid( CqMicroPolyGridBase* pGrid );
 		void ImageElement( TqInt iXPos, TqInt iYPos, CqImagePixel*& pie ) const;
 		/** Render a particular micropolygon.
 		 *
 		 * \param pMPG Pointer to the micropolygon to process.
+		 * \param yMin, yMax Range of pixel rows to sample.
 		 * \see CqBucket, CqImagePixel
 		 */
-		void	RenderMicroPoly( CqMicroPolygon* pMP );
+		void	RenderMicroPoly( CqMicroPolygon* pMP, TqInt yMin, TqInt yMax,
+							SqSampleCounts& counts );
 		/** This function assumes that either dof or mb or
 		 * both are being used. */
-		void	RenderMPG_MBOrDof( CqMicroPolygon* pMP, bool IsMoving, bool UsingDof );
+		void	RenderMPG_MBOrDof( CqMicroPolygon* pMP, bool IsMoving, bool UsingDof,
+							const SqMpgSampleInfo& sampleInfo, TqInt yMin, TqInt yMax,
+							SqSampleCounts& counts );
 		/** This function assumes that neither dof or mb are
 		 * being used. It is much simpler than the general
 		 * case dealt with above. */
-		void	RenderMPG_Static( CqMicroPolygon* pMPG);
-		void	StoreSample(CqMicroPolygon* pMPG, CqImagePixel* pie2, TqInt index,
-							TqFloat D, const CqVector2D& uv);
+		void	RenderMPG_Static( CqMicroPolygon* pMPG, const SqMpgSampleInfo& sampleInfo,
+							TqInt yMin, TqInt yMax, SqSampleCounts& counts );
+		void	StoreSample(CqMicroPolygon* pMPG, const SqMpgSampleInfo& sampleInfo,
+							CqImagePixel* pie2, TqInt index, TqFloat D, const CqVector2D& uv,
+							SqSampleCounts& counts);
+		/// Add the counts gathered by sampling to the stats and micropolygons.
+		void	mergeSampleCounts(const SqSampleCounts& counts);
 		void	StoreExtraData( CqMicroPolygon* pMPG, TqFloat* hitData);
 		const CqBound& DofSubBound(TqInt index) const;
 
@@ -161,8 +278,16 @@ class CqBucketProcessor
 
 		/// Vector of precalculated filter weights
 		std::vector<TqFloat>	m_aFilterValues;
+		/// Precalculated 1D filter weights in x and y, for separable filters.
+		std::vector<TqFloat>	m_aFilterValuesX;
+		std::vector<TqFloat>	m_aFilterValuesY;
+		/// True if the pixel filter can be applied in x and y separately.
+		bool	m_separableFilter;
 
-		SqMpgSampleInfo m_CurrentMpgSampleInfo;
+		/// Micropolygons taken from the bucket for sampling.
+		std::vector<CqMicroPolygonPtr> m_waitingMPs;
+		/// Surfaces taken from the bucket by RenderSurfaces().
+		std::vector<SqSurfaceWork> m_surfaceWork;
 
 		CqOcclusionTree m_OcclusionTree;
 
@@ -179,6 +304,10 @@ class CqBucketProcessor
 		CqChannelBuffer	m_channelBuffer;
 
 		boost::array<CqRegion, SqBucketCacheSegment::last> m_cacheRegions;
+
+		/// Shader instances used by this processor for the grids it shades
+		/// itself, see process().
+		CqShadingState m_shadingState;
 };
 
 
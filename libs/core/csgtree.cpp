@@ -140,8 +140,10 @@ TqInt CqCSGTreeNode::cChildren()
  *	there using ProcessSampleList.
  *
  *	@param	samples	Array of samples to pass through the CSG tree.
+ *	@param	nodes	Table of the CSG nodes referenced by the samples.
  */
-void CqCSGTreeNode::ProcessTree( std::vector<SqImageSample>& samples )
+void CqCSGTreeNode::ProcessTree( std::vector<SqImageSample>& samples,
+		TqCSGNodeTable& nodes )
 {
 	// Follow the tree back up to the top, then process the list from there
 	boost::shared_ptr<CqCSGTreeNode> pTop = shared_from_this();
@@ -150,7 +152,7 @@ void CqCSGTreeNode::ProcessTree( std::vector<SqImageSample>& samples )
 		pTop = pTop->pParent();
 	}
 
-	pTop->ProcessSampleList( samples );
+	pTop->ProcessSampleList( samples, nodes );
 }
 
 
@@ -162,8 +164,10 @@ void CqCSGTreeNode::ProcessTree( std::vector<SqImageSample>& samples )
  *	this node for further processing up the tree.
  *
  *	@param	samples	Array of samples to process.
+ *	@param	nodes	Table of the CSG nodes referenced by the samples.
  */
-void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
+void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples,
+		TqCSGNodeTable& nodes )
 {
 	// First process any children nodes.
 	// Process all nodes depth first.
@@ -177,7 +181,7 @@ void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
 		boost::shared_ptr<CqCSGTreeNode> pChild = ii->lock()
 		        ;
 		if ( pChild.get() && pChild->NodeType() != CSGNodeType_Primitive )
-			pChild->ProcessSampleList( samples );
+			pChild->ProcessSampleList( samples, nodes );
 	}
 
 	std::vector<bool> abChildState( cChildren() );
@@ -195,10 +199,11 @@ void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
 	TqInt j = 0;
 	for ( i = samples.begin(); i != samples.end(); ++i, ++j )
 	{
-		if ( ( aChildIndex[j] = isChild( i->csgNode.get() ) ) >= 0 )
+		CqCSGTreeNode* pNode = i->csgNode >= 0 ? nodes[ i->csgNode ].get() : 0;
+		if ( ( aChildIndex[j] = isChild( pNode ) ) >= 0 )
 		{
-			if ( ((i->csgNode.get())->NodeType() == CSGNodeType_Primitive ) &&
-			        ((i->csgNode.get())->NodeType() == CSGNodeType_Union ) )
+			if ( ( pNode->NodeType() == CSGNodeType_Primitive ) &&
+			        ( pNode->NodeType() == CSGNodeType_Union ) )
 			{
 				abChildState[ aChildIndex[j] ] = !abChildState[ aChildIndex[j] ];
 			}
@@ -209,6 +214,7 @@ void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
 
 	// Now go through samples, clearing any where the state doesn't change, and
 	// promoting any where it does to this node.
+	TqInt thisIndex = pParent() ? nodeIndex( nodes, shared_from_this() ) : -1;
 	for ( i = samples.begin(), j = 0; i != samples.end(); ++j )
 	{
 		// Find out if sample is in out children nodes, if so are we entering or leaving.
@@ -230,14 +236,7 @@ void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
 			// Otherwise promote it to this node unless we are a the top.
 		{
 			bCurrentI = bNewI;
-			if ( pParent() )
-			{
-				i->csgNode = shared_from_this();
-			}
-			else
-			{
-				i->csgNode = boost::shared_ptr<CqCSGTreeNode>();
-			}
+			i->csgNode = thisIndex;
 			i++;
 		}
 	}
@@ -250,21 +249,48 @@ void CqCSGTreeNode::ProcessSampleList( std::vector<SqImageSample>& samples )
  *	\note This should only be called if the Primitive node is the top level parent.
  *
  *	@param	samples	Array of samples to process.
+ *	@param	nodes	Table of the CSG nodes referenced by the samples.
  */
-void CqCSGNodePrimitive::ProcessSampleList( std::vector<SqImageSample>& samples )
+void CqCSGNodePrimitive::ProcessSampleList( std::vector<SqImageSample>& samples,
+		TqCSGNodeTable& nodes )
 {
 	// Now go through samples, clearing samples related to this node.
 	std::vector<SqImageSample>::iterator i;
 	for ( i = samples.begin(); i != samples.end(); ++i )
 	{
-		if ( i->csgNode.get() == this )
+		if ( i->csgNode >= 0 && nodes[ i->csgNode ].get() == this )
 		{
-			i->csgNode = boost::shared_ptr<CqCSGTreeNode>();
+			i->csgNode = -1;
 		}
 	}
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *	Find the index of a node in a CSG node table, adding it if necessary.
+ *	The tables are per pixel, and so only ever hold a handful of nodes.
+ *
+ *	@param	nodes	Table of CSG nodes.
+ *	@param	node	Node to look up; may be null.
+ *
+ *	@return			Index of the node in the table, or -1 for a null node.
+ */
+TqInt CqCSGTreeNode::nodeIndex( TqCSGNodeTable& nodes,
+		const boost::shared_ptr<CqCSGTreeNode>& node )
+{
+	if ( !node )
+		return ( -1 );
+	for ( TqInt i = 0, n = nodes.size(); i < n; ++i )
+	{
+		if ( nodes[ i ] == node )
+			return ( i );
+	}
+	nodes.push_back( node );
+	return ( nodes.size() - 1 );
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *	Evaluate the in/out state of the children and determine if the result is
@@ -41,6 +41,10 @@
 namespace Aqsis {
 
 struct SqImageSample;
+class CqCSGTreeNode;
+
+/// Table of CSG nodes, which sample hits refer to by index.
+typedef std::vector<boost::shared_ptr<CqCSGTreeNode> > TqCSGNodeTable;
 
 
 //------------------------------------------------------------------------------
@@ -107,9 +111,14 @@ class CqCSGTreeNode : public boost::enable_shared_from_this<CqCSGTreeNode>
 		 */
 		virtual	bool	EvaluateState( std::vector<bool>& abChildStates ) = 0;
 
-		virtual	void	ProcessSampleList( std::vector<SqImageSample>& samples );
+		virtual	void	ProcessSampleList( std::vector<SqImageSample>& samples,
+				TqCSGNodeTable& nodes );
+
+		void	ProcessTree( std::vector<SqImageSample>& samples,
+				TqCSGNodeTable& nodes );
 
-		void	ProcessTree( std::vector<SqImageSample>& samples );
+		static TqInt nodeIndex( TqCSGNodeTable& nodes,
+				const boost::shared_ptr<CqCSGTreeNode>& node );
 
 		static boost::shared_ptr<CqCSGTreeNode> CreateNode( CqString& type );
 		static bool IsRequired();
@@ -161,7 +170,8 @@ class CqCSGNodePrimitive : public CqCSGTreeNode
 		{
 			return ( CSGNodeType_Primitive );
 		}
-		virtual	void	ProcessSampleList( std::vector<SqImageSample>& samples );
+		virtual	void	ProcessSampleList( std::vector<SqImageSample>& samples,
+				TqCSGNodeTable& nodes );
 		
 		/**
 		* @todo Review: Unused parameter abChildStates
@@ -37,7 +37,8 @@
 #include <limits>
 
 #include <aqsis/util/file.h>
-#include "itexturemap_old.h"
+#include <aqsis/tex/filtering/itexturecache.h>
+#include <aqsis/tex/filtering/ishadowsampler.h>
 #include "marchingcubes.h"
 #include <aqsis/math/matrix.h>
 #include <aqsis/util/plugins.h>
@@ -627,35 +628,18 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point, TqInt n, std::vector
 					TqInt which = (TqInt) m_instructions[pc++].value;
 					TqInt n = (TqInt) m_instructions[pc++].value;
 
-					CqString depthname = m_strings[which];
-					/** \todo Fix to use the new-style texture maps.  Using
-					 * GetOcclusionMap happens to access the old texture
-					 * sampling machinary through GetShadowMap()
-					 */
-					IqTextureMapOld* pMap = QGetRenderContextI() ->GetOcclusionMap( depthname );
+					const IqShadowSampler& depthMap = QGetRenderContextI()
+						->textureCache().findShadowSampler(m_strings[which]);
 
 					TqFloat A, B, C, D;
-					std::valarray<TqFloat> fv;
-					TqFloat avg, depth;
-
-					depth = -Point.z();
-
-					fv.resize(1);
-					fv[0]= 0.0f;
-
+					TqFloat depth = -Point.z();
 
 					A = m_floats[n];
 					B = m_floats[n+1];
 					C = m_floats[n+2];
 					D = m_floats[n+3];
 
-					if ( pMap != 0 && pMap->IsValid() )
-					{
-						CqVector3D swidth(0.0f);
-						CqVector3D twidth(0.0f);
-						CqVector3D aq_P = Point;
-						pMap->SampleMap( aq_P, swidth, twidth, fv, 0, &avg, &depth );
-					}
+					depthMap.depthBehindSurface(Point, depth);
 
 
 					result = repulsion(depth, A, B, C, D);
@@ -818,34 +802,18 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
 					TqInt which = (TqInt) m_instructions[pc++].value;
 					TqInt n = (TqInt) m_instructions[pc++].value;
 
-					CqString depthname = m_strings[which];
-					/** \todo Fix to use the new-style texture maps.  Using
-					 * GetOcclusionMap happens to access the old texture
-					 * sampling machinary through GetShadowMap()
-					 */
-					IqTextureMapOld* pMap = QGetRenderContextI() ->GetOcclusionMap( depthname );
+					const IqShadowSampler& depthMap = QGetRenderContextI()
+						->textureCache().findShadowSampler(m_strings[which]);
 
 					TqFloat A, B, C, D;
-					std::valarray<TqFloat> fv;
-					TqFloat avg, depth;
-					depth = -Point.z();
-
-					fv.resize(1);
-					fv[0]= 0.0f;
-
+					TqFloat depth = -Point.z();
 
 					A = m_floats[n];
 					B = m_floats[n+1];
 					C = m_floats[n+2];
 					D = m_floats[n+3];
 
-					if ( pMap != 0 && pMap->IsValid() )
-					{
-						CqVector3D swidth(0.0f);
-						CqVector3D twidth(0.0f);
-						CqVector3D aq_P = Point;
-						pMap->SampleMap( aq_P, swidth, twidth, fv, 0, &avg, &depth);
-					}
+					depthMap.depthBehindSurface(Point, depth);
 
 					//Aqsis::log() << info << "A " << A << " B " << B << " C " << C << " D " << D << std::endl;
 					result = repulsion(depth, A, B, C, D);
@@ -79,6 +79,11 @@ class CqBlobby : public CqSurface
 
 		// Overrides from CqSurface
 		virtual TqInt Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+		/// The implicit field plugin is loaded into shared state while splitting.
+		virtual bool	isReentrant() const
+		{
+			return false;
+		}
 		virtual void	Bound(CqBound* bound) const
 		{
 			bound->vecMin() = m_bbox.vecMin();
@@ -0,0 +1,158 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Retained geometry for RiObjectBegin/RiObjectInstance.
+ */
+
+#include "instance.h"
+
+#include <aqsis/util/logging.h>
+
+#include "renderer.h"
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+// CqObjectPrototype
+
+CqObjectPrototype::CqObjectPrototype(const char* name)
+	: m_name(name),
+	m_entries(),
+	m_matBegin(QGetRenderContext()->ptransCurrent()->matObjectToWorld(
+				QGetRenderContext()->Time())),
+	m_matWorldToBegin(),
+	m_pattrBegin(QGetRenderContext()->pattrCurrent()),
+	m_attributesWritten(false),
+	m_bindsAttributes(false)
+{
+	m_matWorldToBegin = m_matBegin.Inverse();
+}
+
+void CqObjectPrototype::addSurface(const boost::shared_ptr<CqSurface>& surface)
+{
+	m_entries.push_back(SqEntry());
+	SqEntry& entry = m_entries.back();
+	entry.surface = surface;
+	surface->Bound(&entry.bound);
+	// Instances copy only the variables they transform.
+	surface->SharePrimitiveVariables();
+	// Gprims defined directly in the ObjectBegin coordinate system (the
+	// common case) need no extra transformation per instance.
+	IqTransformPtr trans = surface->pTransform();
+	CqMatrix matObjectToWorld = trans->matObjectToWorld(trans->Time(0));
+	if(!(matObjectToWorld == m_matBegin))
+		entry.matRelative = m_matWorldToBegin * matObjectToWorld;
+	// Attributes only need to be kept with the gprim when something inside
+	// the definition changed them; otherwise instances use their own.
+	entry.bindsAttributes = m_attributesWritten
+		&& surface->pAttributes().get() != m_pattrBegin.get();
+	m_bindsAttributes |= entry.bindsAttributes;
+}
+
+void CqObjectPrototype::close()
+{
+	m_pattrBegin.reset();
+	if(m_bindsAttributes)
+	{
+		Aqsis::log() << warning << "Attributes set inside object \"" << m_name
+			<< "\" are bound at definition time" << std::endl;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// CqInstance
+
+CqInstance::CqInstance(const boost::shared_ptr<const CqObjectPrototype>& prototype,
+		TqInt index, const CqTransformPtr& trans, const CqMatrix& matTx)
+	: CqSurface(),
+	m_prototype(prototype),
+	m_index(index),
+	m_matTx(matTx)
+{
+	m_pTransform = trans;
+	if(entry().bindsAttributes)
+	{
+		m_pAttributes = boost::static_pointer_cast<CqAttributes>(
+				entry().surface->pAttributes());
+	}
+	STATS_INC( GEO_ins_created );
+}
+
+TqInt CqInstance::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
+{
+	const CqObjectPrototype::SqEntry& protoEntry = entry();
+	boost::shared_ptr<CqSurface> pSurface(protoEntry.surface->Clone());
+	if(!pSurface)
+	{
+		Aqsis::log() << warning << "Cannot instance gprim of type "
+			<< protoEntry.surface->strName() << std::endl;
+		return 0;
+	}
+	pSurface->SetSurfaceParameters( *this );
+
+	// Matrices for normals and vectors, as in CqRenderer::matNSpaceToSpace().
+	CqMatrix matRTx = m_matTx;
+	matRTx[ 3 ][ 0 ] = matRTx[ 3 ][ 1 ] = matRTx[ 3 ][ 2 ] = matRTx[ 0 ][ 3 ] = matRTx[ 1 ][ 3 ] = matRTx[ 2 ][ 3 ] = 0.0;
+	matRTx[ 3 ][ 3 ] = 1.0;
+	CqMatrix matITTx = matRTx.Inverse().Transpose();
+	pSurface->Transform( m_matTx, matITTx, matRTx );
+	pSurface->PrepareTrimCurve();
+
+	aSplits.push_back(pSurface);
+	STATS_INC( GEO_ins_split );
+	return 1;
+}
+
+void CqInstance::Bound(CqBound* bound) const
+{
+	CqBound b = entry().bound;
+	b.Transform( m_matTx );
+	bound->vecMin() = b.vecMin();
+	bound->vecMax() = b.vecMax();
+	AdjustBoundForTransformationMotion( bound );
+}
+
+void CqInstance::Transform( const CqMatrix& matTx, const CqMatrix& /*matITTx*/,
+		const CqMatrix& /*matRTx*/, TqInt /*iTime*/ )
+{
+	m_matTx = matTx * m_matTx;
+}
+
+CqSurface* CqInstance::Clone() const
+{
+	CqInstance* clone = new CqInstance(m_prototype, m_index, m_pTransform, m_matTx);
+	CloneData( clone );
+	return clone;
+}
+
+} // namespace Aqsis
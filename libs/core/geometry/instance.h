@@ -0,0 +1,223 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Retained geometry for RiObjectBegin/RiObjectInstance.
+ *
+ * An object definition is captured once as a CqObjectPrototype holding the
+ * gprims created between ObjectBegin and ObjectEnd.  Each ObjectInstance
+ * then posts one lightweight CqInstance per prototype gprim which refers to
+ * the shared prototype and carries only the instance transformation and
+ * attributes.  The prototype geometry is copied only when an instance is
+ * split in the bucket which first needs it, and that copy is released once
+ * the bucket has diced it.  Only the points, normals and vectors are copied;
+ * the other primitive variables are shared with the prototype.
+ */
+
+#ifndef INSTANCE_H_INCLUDED
+#define INSTANCE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "surface.h"
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Immutable geometry captured between RiObjectBegin and RiObjectEnd.
+ *
+ * Gprims are stored in the world space of the definition.  The prototype
+ * remembers the object to world transformation in effect at ObjectBegin so
+ * that instances can map the stored geometry into the coordinate system
+ * current at ObjectInstance time.
+ */
+class CqObjectPrototype
+{
+	public:
+		/// A single gprim of the definition.
+		struct SqEntry
+		{
+			/// Gprim in definition world space; never split or transformed.
+			boost::shared_ptr<CqSurface> surface;
+			/// Bound of the gprim in definition world space.
+			CqBound bound;
+			/// Gprim object space relative to the ObjectBegin coordinate system.
+			CqMatrix matRelative;
+			/// True if the gprim was affected by attribute calls in the definition.
+			bool bindsAttributes;
+		};
+
+		/** \brief Start a definition in the current graphics state.
+		 *
+		 * \param name - handle of the object.
+		 */
+		CqObjectPrototype(const char* name);
+
+		/// Add a gprim created during the definition.
+		void addSurface(const boost::shared_ptr<CqSurface>& surface);
+		/// Record that the attribute state was written during the definition.
+		void noteAttributeWrite();
+		/// Finish the definition; the prototype is immutable afterwards.
+		void close();
+
+		/// Object handle.
+		const std::string& name() const;
+		/// Gprims making up the object.
+		const std::vector<SqEntry>& entries() const;
+		/** \brief Matrix mapping definition world space into the world space
+		 * of an instance made with the given object to world transformation.
+		 */
+		CqMatrix matDefinitionToInstance(const CqMatrix& matInstanceToWorld) const;
+
+	private:
+		std::string m_name;
+		std::vector<SqEntry> m_entries;
+		/// Object to world transformation at ObjectBegin, and its inverse.
+		CqMatrix m_matBegin;
+		CqMatrix m_matWorldToBegin;
+		/// Attributes current at ObjectBegin.
+		CqAttributesPtr m_pattrBegin;
+		/// Set once any attribute call happens inside the definition.
+		bool m_attributesWritten;
+		/// Set to true once any gprim binds its own attributes.
+		bool m_bindsAttributes;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief A single gprim of an object instance.
+ *
+ * The instance references one entry of a shared CqObjectPrototype and stores
+ * only the transformation needed to map it into the instance coordinate
+ * system.  Splitting the instance yields a copy of the prototype gprim,
+ * transformed into the current space and carrying the instance attributes,
+ * which shares the untransformed primitive variables of the prototype.
+ */
+class CqInstance : public CqSurface
+{
+	public:
+		/** \brief Instance a prototype entry in the current graphics state.
+		 *
+		 * \param prototype - object definition to instance.
+		 * \param index - entry of the prototype represented by this gprim.
+		 * \param trans - object to world transformation for the entry.
+		 * \param matTx - matrix mapping definition world space to world space.
+		 */
+		CqInstance(const boost::shared_ptr<const CqObjectPrototype>& prototype,
+				TqInt index, const CqTransformPtr& trans, const CqMatrix& matTx);
+
+		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+		virtual void	Bound(CqBound* bound) const;
+		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 );
+
+		/// Instances are never diced directly; they are always split first.
+		virtual bool Diceable(const CqMatrix& /*matCtoR*/)
+		{
+			return false;
+		}
+		virtual CqMicroPolyGridBase* Dice()
+		{
+			return NULL;
+		}
+		virtual bool	IsMotionBlurMatch( CqSurface* /*pSurf*/ )
+		{
+			return false;
+		}
+		virtual CqString strName() const
+		{
+			return "CqInstance";
+		}
+		virtual TqUint  cUniform() const
+		{
+			return 0;
+		}
+		virtual TqUint  cVarying() const
+		{
+			return 0;
+		}
+		virtual TqUint  cVertex() const
+		{
+			return 0;
+		}
+		virtual TqUint  cFaceVarying() const
+		{
+			return 0;
+		}
+		virtual CqSurface* Clone() const;
+
+	private:
+		const CqObjectPrototype::SqEntry& entry() const;
+
+		boost::shared_ptr<const CqObjectPrototype> m_prototype;
+		TqInt m_index;
+		/// Accumulated transformation from definition world space.
+		CqMatrix m_matTx;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline const std::string& CqObjectPrototype::name() const
+{
+	return m_name;
+}
+
+inline const std::vector<CqObjectPrototype::SqEntry>&
+CqObjectPrototype::entries() const
+{
+	return m_entries;
+}
+
+inline void CqObjectPrototype::noteAttributeWrite()
+{
+	m_attributesWritten = true;
+}
+
+inline CqMatrix CqObjectPrototype::matDefinitionToInstance(
+		const CqMatrix& matInstanceToWorld) const
+{
+	return matInstanceToWorld * m_matWorldToBegin;
+}
+
+inline const CqObjectPrototype::SqEntry& CqInstance::entry() const
+{
+	return m_prototype->entries()[m_index];
+}
+
+} // namespace Aqsis
+
+#endif // INSTANCE_H_INCLUDED
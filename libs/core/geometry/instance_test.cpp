@@ -0,0 +1,157 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for retained objects and their instances.
+ */
+
+#include "instance.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/ri/ri.h>
+#include <aqsis/util/exception.h>
+
+#include "renderer.h"
+
+BOOST_AUTO_TEST_SUITE(instance_tests)
+using namespace Aqsis;
+
+namespace {
+
+inline char* tok(const char* str)
+{
+	return const_cast<char*>(str);
+}
+
+/// Retain an object holding a single triangle with a colour and an id.
+boost::shared_ptr<const CqObjectPrototype> defineTriangle(const char* name)
+{
+	RtPoint P[] = { {0, 0, 0}, {1, 0, 0}, {0, 1, 0} };
+	RtColor Cs[] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
+	RtFloat id = 42;
+	RiDeclare(tok("id"), tok("constant float"));
+	QGetRenderContext()->beginObjectDefinition(name);
+	RiPolygon(3, RI_P, P, RI_CS, Cs, "id", &id, RI_NULL);
+	QGetRenderContext()->endObjectDefinition();
+	return QGetRenderContext()->findObject(name);
+}
+
+boost::shared_ptr<CqSurface> splitInstance(
+		const boost::shared_ptr<const CqObjectPrototype>& prototype,
+		const CqMatrix& matTx)
+{
+	CqInstance instance(prototype, 0, QGetRenderContext()->ptransCurrent(), matTx);
+	std::vector<boost::shared_ptr<CqSurface> > splits;
+	BOOST_REQUIRE_EQUAL(instance.Split(splits), 1);
+	return splits[0];
+}
+
+TqFloat idValue(const CqSurface& surface)
+{
+	CqParameter* id = surface.FindUserParam("id");
+	BOOST_REQUIRE(id);
+	return *static_cast<CqParameterTyped<TqFloat, TqFloat>*>(id)->pValue(0);
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(instance_shares_untransformed_variables)
+{
+	RiBegin(RI_NULL);
+	RiWorldBegin();
+	boost::shared_ptr<const CqObjectPrototype> prototype = defineTriangle("tri");
+	BOOST_REQUIRE_EQUAL(prototype->entries().size(), 1U);
+	CqSurface& protoSurface = *prototype->entries()[0].surface;
+
+	boost::shared_ptr<CqSurface> split = splitInstance(prototype,
+			CqMatrix(CqVector3D(1, 2, 3)));
+	// Variables which aren't transformed refer to the prototype ones.
+	BOOST_CHECK(split->FindUserParam("id") == protoSurface.FindUserParam("id"));
+	BOOST_CHECK(split->Cs() == protoSurface.Cs());
+	BOOST_CHECK(split->IsSharedPrimitiveVariable(split->Cs()));
+	// Points are copied and transformed into the instance space.
+	BOOST_REQUIRE(split->P() != protoSurface.P());
+	BOOST_CHECK(!split->IsSharedPrimitiveVariable(split->P()));
+	BOOST_CHECK_EQUAL(split->P()->pValue(1)->x(), 2);
+	BOOST_CHECK_EQUAL(split->P()->pValue(1)->y(), 2);
+	BOOST_CHECK_EQUAL(split->P()->pValue(1)->z(), 3);
+	BOOST_CHECK_EQUAL(protoSurface.P()->pValue(1)->x(), 1);
+	BOOST_CHECK_EQUAL(protoSurface.P()->pValue(1)->z(), 0);
+
+	// Clones of the instance copy everything again.
+	boost::shared_ptr<CqSurface> clone(split->Clone());
+	BOOST_CHECK(clone->Cs() != split->Cs());
+	BOOST_CHECK(!clone->IsSharedPrimitiveVariable(clone->Cs()));
+
+	// Destroying the instance gprims leaves the prototype variables intact.
+	split.reset();
+	clone.reset();
+	BOOST_CHECK_EQUAL(idValue(protoSurface), 42);
+
+	QGetRenderContext()->EndWorldModeBlock();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(instance_objects_released_at_world_end)
+{
+	RiBegin(RI_NULL);
+	RiWorldBegin();
+	boost::shared_ptr<CqSurface> split;
+	{
+		boost::shared_ptr<const CqObjectPrototype> prototype = defineTriangle("tri");
+		split = splitInstance(prototype, CqMatrix());
+	}
+	QGetRenderContext()->EndWorldModeBlock();
+
+	// The renderer forgets the object at the end of the world...
+	BOOST_CHECK_THROW(QGetRenderContext()->findObject("tri"), XqValidation);
+	// ...while gprims still in the pipeline keep the shared prototype alive.
+	BOOST_CHECK_EQUAL(idValue(*split), 42);
+	split.reset();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(instance_unfinished_definition_released_at_world_end)
+{
+	RiBegin(RI_NULL);
+	RiWorldBegin();
+	QGetRenderContext()->beginObjectDefinition("open");
+	BOOST_CHECK(QGetRenderContext()->isDefiningObject());
+	QGetRenderContext()->EndWorldModeBlock();
+	BOOST_CHECK(!QGetRenderContext()->isDefiningObject());
+	BOOST_CHECK_THROW(QGetRenderContext()->findObject("open"), XqValidation);
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
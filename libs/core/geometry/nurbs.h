@@ -361,6 +361,14 @@ class CqSurfaceNURBS : public CqSurface
 			m_TrimLoops.Prepare( this );
 		}
 		virtual CqSurface* Clone() const;
+		/** Knot insertion rewrites the vertex class variables in place, so
+		 * those are never shared.
+		 */
+		virtual bool SharesPrimitiveVariable( const CqParameter* pParam ) const
+		{
+			return ( pParam->Class() != class_vertex
+					 && CqSurface::SharesPrimitiveVariable( pParam ) );
+		}
 
 
 	protected:
@@ -385,18 +385,10 @@ bool	CqSurfacePatchBicubic::Diceable(const CqMatrix& matCtoR)
 
 void CqSurfacePatchBicubic::ConvertToBezierBasis( CqMatrix& matuBasis, CqMatrix& matvBasis )
 {
-	static CqMatrix matMim1;
+	// Inverse of the bezier basis (only computed once).
+	static const CqMatrix matMim1(CqMatrix(RiBezierBasis).Inverse());
 	TqInt i, j;
 
-	if ( matMim1.fIdentity() )
-	{
-		for ( i = 0; i < 4; i++ )
-			for ( j = 0; j < 4; j++ )
-				matMim1[ i ][ j ] = RiBezierBasis[ i ][ j ];
-		matMim1.SetfIdentity( false );
-		matMim1 = matMim1.Inverse();
-	}
-
 	CqMatrix matuMj = matuBasis;
 	CqMatrix matvMj = matvBasis;
 
@@ -39,9 +39,9 @@
 
 namespace Aqsis {
 
-CqObjectPool<CqMovingMicroPolygonKeyPoints>	CqMovingMicroPolygonKeyPoints::m_thePool;
-CqObjectPool<CqMicroPolygonPoints>	CqMicroPolygonPoints::m_thePool;
-CqObjectPool<CqMicroPolygonMotionPoints>	CqMicroPolygonMotionPoints::m_thePool;
+CqThreadLocalObjectPool<CqMovingMicroPolygonKeyPoints>	CqMovingMicroPolygonKeyPoints::m_thePool;
+CqThreadLocalObjectPool<CqMicroPolygonPoints>	CqMicroPolygonPoints::m_thePool;
+CqThreadLocalObjectPool<CqMicroPolygonMotionPoints>	CqMicroPolygonMotionPoints::m_thePool;
 
 class CqPointsKDTreeData::CqPointsKDTreeDataComparator
 {
@@ -582,7 +582,7 @@ void CqMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long ymax )
 
 				pNew->AppendKey( Point, radius, keyTimes[iTime] );
 			}
-			boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+			CqMicroPolygonPtr pMP( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pMP );
 		}
 	}
@@ -641,7 +641,7 @@ void CqMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long ymax )
 			CqMicroPolygonPoints* pNew = new CqMicroPolygonPoints(this, iu);
 			pNew->Initialise( radius );
 
-			boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+			CqMicroPolygonPtr pMP( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pMP );
 		}
 	}
@@ -815,7 +815,7 @@ void CqMotionMicroPolyGridPoints::Split( long xmin, long xmax, long ymin, long y
 
 			pNew->AppendKey( Point, radius, Time( iTime ) );
 		}
-		boost::shared_ptr<CqMicroPolygon> pMP( pNew );
+		CqMicroPolygonPtr pMP( pNew );
 		QGetRenderContext()->pImage()->AddMPG( pMP );
 	}
 
@@ -367,7 +367,7 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 	private:
 		TqFloat	m_radius;
 
-		static	CqObjectPool<CqMicroPolygonPoints>	m_thePool;
+		static	CqThreadLocalObjectPool<CqMicroPolygonPoints>	m_thePool;
 }
 ;
 
@@ -423,7 +423,7 @@ class CqMovingMicroPolygonKeyPoints
 		CqVector3D	m_Point0;
 		TqFloat		m_radius;
 
-		static	CqObjectPool<CqMovingMicroPolygonKeyPoints>	m_thePool;
+		static	CqThreadLocalObjectPool<CqMovingMicroPolygonKeyPoints>	m_thePool;
 }
 ;
 
@@ -499,7 +499,7 @@ class CqMicroPolygonMotionPoints : public CqMicroPolygon
 		std::vector<TqFloat> m_Times;
 		std::vector<CqMovingMicroPolygonKeyPoints*>	m_Keys;
 
-		static	CqObjectPool<CqMicroPolygonMotionPoints>	m_thePool;
+		static	CqThreadLocalObjectPool<CqMicroPolygonMotionPoints>	m_thePool;
 
 };
 
@@ -625,6 +625,13 @@ class CqSurfacePointsPolygons : public CqSurface
 			return ( m_pPoints->cFaceVarying() );
 		}
 		virtual CqSurface* Clone() const;
+		/** The variables are held by the points, so share those as well.
+		 */
+		virtual void SharePrimitiveVariables()
+		{
+			CqSurface::SharePrimitiveVariables();
+			m_pPoints->SharePrimitiveVariables();
+		}
 
 	private:
 		TqInt	m_NumPolys;
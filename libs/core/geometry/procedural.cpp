@@ -47,7 +47,8 @@ namespace Aqsis {
 /**
  * CqProcedural constructor.
  */
-CqProcedural::CqProcedural() : CqSurface()
+CqProcedural::CqProcedural() : CqSurface(),
+	m_lastExpandedRow(-1)
 {
 	STATS_INC( GEO_prc_created );
 }
@@ -55,7 +56,8 @@ CqProcedural::CqProcedural() : CqSurface()
 /**
  * CqProcedural copy constructor.
  */
-CqProcedural::CqProcedural(RtPointer data, CqBound &B, RtProcSubdivFunc subfunc, RtProcFreeFunc freefunc ) : CqSurface()
+CqProcedural::CqProcedural(RtPointer data, CqBound &B, RtProcSubdivFunc subfunc, RtProcFreeFunc freefunc ) : CqSurface(),
+	m_lastExpandedRow(-1)
 {
 	m_pData = data;
 	m_Bound = B;
@@ -103,6 +105,12 @@ TqInt CqProcedural::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
 }
 
 
+bool CqProcedural::isDelayedArchive() const
+{
+	return m_pSubdivFunc == RiProcDelayedReadArchive;
+}
+
+
 //---------------------------------------------------------------------
 /** Transform the quadric primitive by the specified matrix.
  */
@@ -56,6 +56,27 @@ class CqProcedural : public CqSurface
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
 		virtual ~CqProcedural();
 
+		/** \brief Determine whether the procedural may be expanded again.
+		 *
+		 * Only RiProcDelayedReadArchive generates the same geometry each
+		 * time it is expanded.  An archive which makes requests outlasting
+		 * the expansion, such as Declare, LightSource, CoordinateSystem or
+		 * ObjectBegin, is still only expanded once; see
+		 * CqRenderer::noteGlobalRequest().
+		 */
+		bool	isDelayedArchive() const;
+		/** \brief Last bucket row for which the procedural has been expanded,
+		 * or -1 if it hasn't been expanded yet.
+		 */
+		TqInt	lastExpandedRow() const
+		{
+			return m_lastExpandedRow;
+		}
+		void	setLastExpandedRow(TqInt row)
+		{
+			m_lastExpandedRow = row;
+		}
+
 		//---------------------------------------------- Inlined Public Methods
 	public:
 		void	Bound(CqBound* bound) const
@@ -76,6 +97,12 @@ class CqProcedural : public CqSurface
 		{
 			return NULL;
 		}
+		/*  Expansion replaces the render context.
+		 */
+		virtual bool	isReentrant() const
+		{
+			return false;
+		}
 
 		/** Determine whether the passed surface is valid to be used as a
 		 *  frame in motion blur for this surface.
@@ -121,6 +148,8 @@ class CqProcedural : public CqSurface
 		RtProcSubdivFunc m_pSubdivFunc;
 		RtProcFreeFunc m_pFreeFunc;
 
+		/* Row of buckets for which the procedural was last expanded */
+		TqInt m_lastExpandedRow;
 };
 
 
@@ -3,6 +3,7 @@ set(geometry_srcs
 	bunny.cpp
 	cubiccurves.cpp
 	curves.cpp
+	instance.cpp
 	jules_bloomenthal.cpp
 	lath.cpp
 	linearcurves.cpp
@@ -24,6 +25,7 @@ set(geometry_hdrs
 	blobby.h
 	bunny.h
 	curves.h
+	instance.h
 	jules_bloomenthal.h
 	kdtree.h
 	lath.h
@@ -44,3 +46,8 @@ make_absolute(geometry_hdrs ${geometry_SOURCE_DIR})
 
 include_directories(${geometry_SOURCE_DIR})
 
+
+set(geometry_test_srcs
+	instance_test.cpp
+)
+make_absolute(geometry_test_srcs ${geometry_SOURCE_DIR})
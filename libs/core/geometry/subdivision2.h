@@ -301,6 +301,11 @@ class CqSurfaceSubdivisionPatch : public CqSurface
 		virtual	CqMicroPolyGridBase* Dice();
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
 		virtual bool	Diceable(const CqMatrix& matCtoR);
+		/// Splitting and dicing subdivide the topology shared with other faces.
+		virtual bool	isReentrant() const
+		{
+			return false;
+		}
 
 		/** Determine whether the passed surface is valid to be used as a
 		 *  frame in motion blur for this surface.
@@ -376,6 +381,12 @@ class CqSurfaceSubdivisionMesh : public CqSurface
 		{
 			return( false );
 		}
+		/** Splitting builds the topology shared by the resulting faces.
+		 */
+		virtual bool	isReentrant() const
+		{
+			return( false );
+		}
 
 		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 )
 		{
@@ -24,6 +24,7 @@
 */
 
 #include	<aqsis/aqsis.h>
+#include	<algorithm>
 #include	"renderer.h"
 #include	"micropolygon.h"
 #include	"surface.h"
@@ -159,7 +160,10 @@ CqSurface::CqSurface()
 	m_SplitDir(SplitDir_U),
 	m_CachedBound(false),
 	m_Bound(),
-	m_pCSGNode()
+	m_pCSGNode(),
+	m_fSharePrimitiveVariables(false),
+	m_pSharedVariablesOwner(),
+	m_aSharedParams()
 {
 	// Set a refernce with the current attributes.
 	m_pAttributes = QGetRenderContext() ->pattrCurrent();
@@ -222,12 +226,26 @@ void CqSurface::CloneData( CqSurface* clone ) const
 
 void CqSurface::ClonePrimitiveVariables( const CqSurface& From )
 {
-	// Clone any primitive variables.
+	// Clone any primitive variables, referring to those which the donor
+	// shares instead.
 	m_aUserParams.clear();
+	m_aSharedParams.clear();
+	if ( From.m_fSharePrimitiveVariables )
+		m_pSharedVariablesOwner = From.shared_from_this();
 	std::vector<CqParameter*>::const_iterator iUP;
 	std::vector<CqParameter*>::const_iterator end = From.m_aUserParams.end() ;
 	for ( iUP = From.m_aUserParams.begin(); iUP != end; iUP++ )
-		AddPrimitiveVariable( ( *iUP ) ->Clone() );
+	{
+		if ( From.SharesPrimitiveVariable( *iUP ) )
+		{
+			m_aSharedParams.push_back( *iUP );
+			AddPrimitiveVariable( *iUP );
+		}
+		else
+			AddPrimitiveVariable( ( *iUP ) ->Clone() );
+	}
+	// Sorted, so that IsSharedPrimitiveVariable() is a binary search.
+	std::sort( m_aSharedParams.begin(), m_aSharedParams.end() );
 
 	// Copy the standard primitive variables index table.
 	TqInt i;
@@ -235,6 +253,41 @@ void CqSurface::ClonePrimitiveVariables( const CqSurface& From )
 		m_aiStdPrimitiveVars[ i ] = From.m_aiStdPrimitiveVars[ i ];
 }
 
+//---------------------------------------------------------------------
+/** Make clones of this surface share its unchanging primitive variables.
+ */
+
+void CqSurface::SharePrimitiveVariables()
+{
+	m_fSharePrimitiveVariables = true;
+}
+
+bool CqSurface::SharesPrimitiveVariable( const CqParameter* pParam ) const
+{
+	if ( !m_fSharePrimitiveVariables )
+		return ( false );
+	switch ( pParam->Type() )
+	{
+		case type_point:
+		case type_normal:
+		case type_vector:
+		case type_hpoint:
+			return ( false );
+		default:
+			return ( true );
+	}
+}
+
+//---------------------------------------------------------------------
+/** Determine whether a primitive variable is owned by the surface this one
+ *  was cloned from, rather than by this surface.
+ */
+
+bool CqSurface::IsSharedPrimitiveVariable( const CqParameter* pParam ) const
+{
+	return ( std::binary_search( m_aSharedParams.begin(), m_aSharedParams.end(), pParam ) );
+}
+
 //---------------------------------------------------------------------
 /** Set the default values (where available) from the attribute state for all standard
  * primitive variables.
@@ -63,7 +63,7 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		{
 			std::vector<CqParameter*>::iterator iUP;
 			for ( iUP = m_aUserParams.begin(); iUP != m_aUserParams.end(); iUP++ )
-				if ( NULL != ( *iUP ) )
+				if ( NULL != ( *iUP ) && !IsSharedPrimitiveVariable( *iUP ) )
 					delete( *iUP );
 			STATS_DEC( GPR_current );
 		}
@@ -230,6 +230,21 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 
 		void ClonePrimitiveVariables( const CqSurface& From );
 
+		/** \brief Let clones of this surface share its primitive variables.
+		 *
+		 * Clones refer to the shared variables of this surface, and keep it
+		 * alive, instead of copying them.  The surface must be held by a
+		 * shared pointer and its variables must not change afterwards.
+		 */
+		virtual void SharePrimitiveVariables();
+		/** Determine whether clones may refer to the given variable of this
+		 * surface.  Points, normals and vectors are always copied, since
+		 * clones transform them.
+		 */
+		virtual bool SharesPrimitiveVariable( const CqParameter* pParam ) const;
+		/// Whether the given variable belongs to the surface this was cloned from.
+		bool IsSharedPrimitiveVariable( const CqParameter* pParam ) const;
+
 		/** Get a reference the to P default parameter.
 		 */
 		virtual CqParameterTyped<CqVector4D, CqVector3D>* P()
@@ -553,6 +568,17 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		{
 			return m_pTransform->isMoving();
 		}
+		/** Determine whether this GPrim can be split and diced concurrently
+		 * with other GPrims.
+		 *
+		 * GPrims sharing modifiable data with other GPrims, or using
+		 * renderer-global state, return false and are split and diced with
+		 * the image buffer's pipelineMutex() held.
+		 */
+		virtual bool	isReentrant() const
+		{
+			return true;
+		}
 
 		/**
 		 * Decide whether the geometry is diceable in the given coordinate system.
@@ -608,6 +634,9 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		bool	m_CachedBound;		///< Whether or not the bound has been cached
 		CqBound	m_Bound;			///< The cached object bound
 		boost::shared_ptr<CqCSGTreeNode>	m_pCSGNode;		///< Pointer to the 'primitive' CSG node this surface belongs to, NULL if not part of a solid.
+		bool	m_fSharePrimitiveVariables;	///< Whether clones share the primitive variables of this surface.
+		boost::shared_ptr<const CqSurface>	m_pSharedVariablesOwner;	///< Surface owning the shared primitive variables, if any.
+		std::vector<const CqParameter*>	m_aSharedParams;	///< Sorted list of the variables owned by m_pSharedVariablesOwner.
 }
 ;
 
@@ -696,6 +725,10 @@ class CqDeformingSurface : public CqSurface, public CqMotionSpec<boost::shared_p
 		 * determines the dicing rate, which is then copied to the other times.
 		 * \return Boolean indicating GPrim is diceable.
 		 */
+		virtual bool	isReentrant() const
+		{
+			return ( GetMotionObject( Time( 0 ) ) ->isReentrant() );
+		}
 		virtual bool	Diceable(const CqMatrix& matCtoR)
 		{
 			bool f = GetMotionObject( Time( 0 ) ) ->Diceable(matCtoR);
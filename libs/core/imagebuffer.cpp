@@ -31,15 +31,16 @@
 #include	<math.h>
 
 #include	<aqsis/math/math.h>
+#include	<aqsis/util/threadpool.h>
 #include	"stats.h"
 #include	"options.h"
 #include	"renderer.h"
 #include	"surface.h"
 #include	"micropolygon.h"
 #include	"bucketprocessor.h"
-#include	"threadscheduler.h"
 #include	"multijitter.h"
 #include	"grid.h"
+#include	"shadingstate.h"
 
 
 namespace Aqsis {
@@ -47,113 +48,86 @@ namespace Aqsis {
 static TqInt bucketmodulo = -1;
 //static TqInt bucketdirection = -1;
 
-#define MULTIPROCESSING_NBUCKETS 1
-/** Implementing a work unit for a boost::thread (the operator()()
- * method), that is, a piece of code that will run in parallel.
+/** \brief State shared between the render threads of CqImageBuffer::RenderImage()
+ *
+ * Buckets are handed out in NextBucket() order under dispatchMutex, which
+ * also serialises use of the (stateful) sampler.  Display and progress
+ * reporting are serialised by displayMutex.
  */
-class CqThreadProcessor
+struct CqImageBuffer::SqBucketDispatch
 {
-public:
-	CqThreadProcessor(CqBucketProcessor* bucketProcessor) :
-		m_bucketProcessor(bucketProcessor) { }
-	void operator()()
-	{
-		// printf("%p > start\n", m_bucketProcessor);
-		m_bucketProcessor->process();
-		// printf("%p < stop\n", m_bucketProcessor);
-	}
-
-private:
-	CqBucketProcessor* m_bucketProcessor;
+	SqBucketDispatch(IqSampler* sampler, EqBucketOrder order,
+			RtProgressFunc progressHandler)
+		: sampler(sampler),
+		order(order),
+		progressHandler(progressHandler),
+		pendingBuckets(true),
+		numFinished(0)
+	{ }
+
+	IqSampler* sampler;
+	EqBucketOrder order;
+	RtProgressFunc progressHandler;
+	/// True while there are buckets left to dispatch.
+	bool pendingBuckets;
+	/// Number of buckets sent to the display so far.
+	TqInt numFinished;
+	boost::mutex dispatchMutex;
+	boost::mutex displayMutex;
 };
 
 
-/* mafm: implementation of a processor (work unit for a boost::thread)
- * where it takes buckets ready to process and does so continuously.
- * One simple addition would be to wait for new available buckets
- * which are provided dynamically.  This is not applicable at the
- * moment though, it would need RenderSurfaces() to process all of the
- * surfaces of the buckets before assigning them as ready; but at the
- * moment RenderSurfaces() can't run before assigning the bucket to
- * the bucket processor, and it doesn't seem possible to break this
- * interdependency.
-
-boost::mutex displayMutex;
-
-class CqThreadProcessor2
+/** Implementing a task for the render thread pool (the operator()()
+ * method), that is, a piece of code that will run in parallel.
+ *
+ * Each task owns a bucket processor and keeps taking buckets from the
+ * shared dispatch state until none are left.
+ */
+class CqThreadProcessor
 {
 public:
-	CqThreadProcessor2(const CqImageBuffer* imageBuffer,
-			   std::vector<CqBucket*>& bucketList,
-			   bool fImager,
-			   const CqColor& zThreshold,
-			   EqDepthFilter depthfilter,
-			   const CqVector2D& bHalf) :
+	CqThreadProcessor(CqImageBuffer* imageBuffer,
+			CqBucketProcessor* bucketProcessor,
+			CqImageBuffer::SqBucketDispatch* dispatch) :
 		m_imageBuffer(imageBuffer),
-		m_bucketList(bucketList),
-		m_fImager(fImager),
-		m_zThreshold(zThreshold),
-		m_depthfilter(depthfilter),
-		m_bHalf(bHalf) { }
-
+		m_bucketProcessor(bucketProcessor),
+		m_dispatch(dispatch) { }
 	void operator()()
 	{
-		while ( !m_bucketList.empty() )
-		{
-			CqBucket* bucket = m_bucketList.front();
-			m_bucketList.erase( m_bucketList.begin() );
-
-			m_bucketProcessor.setBucket( bucket );
-			if ( m_fImager )
-				m_bucketProcessor.setInitiallyEmpty(false);
-			
-			// Set up some bounds for the bucket.
-			const CqVector2D bPos = m_imageBuffer->BucketPosition( bucket->getCol(),
-									       bucket->getRow() );
-			const CqVector2D bSize = m_imageBuffer->BucketSize( bucket->getCol(),
-									    bucket->getRow() );
-			const CqVector2D vecMin = bPos - m_bHalf;
-			const CqVector2D vecMax = bPos + bSize + m_bHalf;
-
-			TqInt xmin = static_cast<TqInt>( vecMin.x() );
-			TqInt ymin = static_cast<TqInt>( vecMin.y() );
-			TqInt xmax = static_cast<TqInt>( vecMax.x() );
-			TqInt ymax = static_cast<TqInt>( vecMax.y() );
-			if ( xmin < m_imageBuffer->CropWindowXMin() - m_imageBuffer->FilterXWidth() / 2 )
-				xmin = static_cast<TqInt>(m_imageBuffer->CropWindowXMin() - m_imageBuffer->FilterXWidth() / 2.0f);
-			if ( ymin < m_imageBuffer->CropWindowYMin() - m_imageBuffer->FilterYWidth() / 2 )
-				ymin = static_cast<TqInt>(m_imageBuffer->CropWindowYMin() - m_imageBuffer->FilterYWidth() / 2.0f);
-			if ( xmax > m_imageBuffer->CropWindowXMax() + m_imageBuffer->FilterXWidth() / 2 )
-				xmax = static_cast<TqInt>(m_imageBuffer->CropWindowXMax() + m_imageBuffer->FilterXWidth() / 2.0f);
-			if ( ymax > m_imageBuffer->CropWindowYMax() + m_imageBuffer->FilterYWidth() / 2 )
-				ymax = static_cast<TqInt>(m_imageBuffer->CropWindowYMax() + m_imageBuffer->FilterYWidth() / 2.0f);
-
-			m_bucketProcessor.preProcess( bPos, bSize,
-						      m_imageBuffer->PixelXSamples(), m_imageBuffer->PixelYSamples(), m_imageBuffer->FilterXWidth(), m_imageBuffer->FilterYWidth(),
-						      xmin, xmax, ymin, ymax,
-						      m_imageBuffer->ClippingNear(), m_imageBuffer->ClippingFar() );
-			m_bucketProcessor.process();
-			m_bucketProcessor.postProcess( m_fImager, m_depthfilter, m_zThreshold );
-			{
-				TIME_SCOPE("Display bucket");
-				boost::mutex::scoped_lock lock(displayMutex);
-				QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucket );
-			}
-			m_bucketProcessor.reset();
-		}
+		m_imageBuffer->renderBuckets(*m_bucketProcessor, *m_dispatch);
 	}
 
 private:
-	CqBucketProcessor m_bucketProcessor;
-	const CqImageBuffer* m_imageBuffer;
-	std::vector<CqBucket*> m_bucketList;
-	bool m_fImager;
-	CqColor m_zThreshold;
-	EqDepthFilter m_depthfilter;
-	CqVector2D m_bHalf;
+	CqImageBuffer* m_imageBuffer;
+	CqBucketProcessor* m_bucketProcessor;
+	CqImageBuffer::SqBucketDispatch* m_dispatch;
 };
 
-*/
+
+//----------------------------------------------------------------------
+/** Constructor
+ */
+
+CqImageBuffer::CqImageBuffer()
+	: m_fQuit( false ),
+	m_cXBuckets( 0 ),
+	m_cYBuckets( 0 ),
+	m_CurrentBucketCol( 0 ),
+	m_CurrentBucketRow( 0 ),
+	m_rowExpansion( false ),
+	m_expansionFirstRow( 0 ),
+	m_expansionLastRow( 0 ),
+	m_expansionNextRow( -1 ),
+	m_expansionHold( false ),
+	m_expansionHeld(),
+	m_firstOpenBucket( 0 ),
+	m_activeWorkers( 0 ),
+	m_expanding( false ),
+	m_threadPool(),
+	m_threadPoolRequest( 0 ),
+	m_shadingStateMutex(),
+	m_shadingStates()
+{}
 
 
 //----------------------------------------------------------------------
@@ -209,6 +183,8 @@ void	CqImageBuffer::SetImage()
 		for ( b = i->begin(); b!=i->end(); b++ )
 		{
 			b->SetProcessed( false );
+			b->SetStarted( false );
+			b->clearReach();
 			b->setCol( column );
 			b->setRow( row );
 			TqInt colSize = xRes - colPos;
@@ -225,6 +201,7 @@ void	CqImageBuffer::SetImage()
 
 	m_CurrentBucketCol = m_bucketRegion.xMin();
 	m_CurrentBucketRow = m_bucketRegion.yMin();
+	m_firstOpenBucket = 0;
 }
 
 
@@ -415,6 +392,28 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 	XMaxb = clamp( XMaxb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
 	YMaxb = clamp( YMaxb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
 
+	if ( m_rowExpansion && ( YMinb < m_expansionFirstRow || YMinb > m_expansionLastRow ) )
+	{
+		// Another expansion of the procedural is responsible for surfaces
+		// starting in other rows.
+		if ( YMinb > m_expansionLastRow &&
+		     ( m_expansionNextRow < 0 || YMinb < m_expansionNextRow ) )
+			m_expansionNextRow = YMinb;
+		if ( m_expansionHold )
+		{
+			SqHeldSurface held = { pSurface, XMinb, YMinb, XMaxb, YMaxb };
+			m_expansionHeld.push_back( held );
+		}
+		return;
+	}
+
+	PostToUnprocessedBucket( pSurface, XMinb, YMinb, XMaxb, YMaxb );
+}
+
+
+bool CqImageBuffer::PostToUnprocessedBucket( const boost::shared_ptr<CqSurface>& pSurface,
+                                             TqInt XMinb, TqInt YMinb, TqInt XMaxb, TqInt YMaxb )
+{
 	// Sanity check we are not putting into a bucket that has already been processed.
 	CqBucket* bucket = &Bucket( XMinb, YMinb );
 	if ( bucket->IsProcessed() )
@@ -422,27 +421,51 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 		// Scan over the buckets that the bound touches, looking for the first one that isn't processed.
 		TqInt yb = YMinb;
 		TqInt xb = XMinb + 1;
-		bool done = false;
-		while(!done && yb <= YMaxb)
+		while(yb <= YMaxb)
 		{
-			while(!done && xb <= XMaxb)
+			while(xb <= XMaxb)
 			{
 				CqBucket& availBucket = Bucket(xb, yb);
 				if(!availBucket.IsProcessed())
 				{
-					availBucket.AddGPrim(pSurface);
-					done = true;
+					AddToBucket(availBucket, pSurface);
+					return true;
 				}
 				++xb;
 			}
 			xb = XMinb;
 			++yb;
 		}
+		return false;
 	}
-	else
+	AddToBucket( *bucket, pSurface );
+	return true;
+}
+
+
+void CqImageBuffer::AddToBucket( CqBucket& bucket, const boost::shared_ptr<CqSurface>& pSurface )
+{
+	bucket.AddGPrim( pSurface );
+
+	// Surfaces crossing the eye plane have no raster bound, so their pieces
+	// could go anywhere.
+	if ( pSurface->IsUndiceable() || !pSurface->fCachedBound() )
 	{
-		bucket->AddGPrim( pSurface );
+		bucket.extendReach( m_bucketRegion );
+		return;
 	}
+	// The cached bound already includes the filter width, as used for the
+	// micropolygons by AddMPG().
+	const CqBound& bound = pSurface->GetCachedRasterBound();
+	TqInt XMinb = lfloor( bound.vecMin().x() ) / m_optCache.xBucketSize;
+	TqInt YMinb = lfloor( bound.vecMin().y() ) / m_optCache.yBucketSize;
+	TqInt XMaxb = lfloor( bound.vecMax().x() ) / m_optCache.xBucketSize;
+	TqInt YMaxb = lfloor( bound.vecMax().y() ) / m_optCache.yBucketSize;
+	XMinb = clamp( XMinb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
+	YMinb = clamp( YMinb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
+	XMaxb = clamp( XMaxb, XMinb, m_bucketRegion.xMax()-1 );
+	YMaxb = clamp( YMaxb, YMinb, m_bucketRegion.yMax()-1 );
+	bucket.extendReach( CqRegion( XMinb, YMinb, XMaxb + 1, YMaxb + 1 ) );
 }
 
 
@@ -461,7 +484,7 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 	TqInt xpos = oldBucket.getXPosition() + oldBucket.getXSize();
 	if ( nextBucketX < m_bucketRegion.xMax() && rasterBound.vecMax().x() >= xpos )
 	{
-		Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
+		AddToBucket( Bucket( nextBucketX, nextBucketY ), surface );
 		wasPosted = true;
 	}
 	else
@@ -477,7 +500,7 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 			( nextBucketY  < m_bucketRegion.yMax() ) &&
 			( rasterBound.vecMax().y() >= ypos ) )
 		{
-			Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
+			AddToBucket( Bucket( nextBucketX, nextBucketY ), surface );
 			wasPosted = true;
 		}
 	}
@@ -506,12 +529,55 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 #endif
 }
 
+bool CqImageBuffer::PostSurfaceToRow(TqInt row,
+                                     const boost::shared_ptr<CqSurface>& surface)
+{
+	const CqBound rasterBound = surface->GetCachedRasterBound();
+	if ( row < m_bucketRegion.yMin() || row >= m_bucketRegion.yMax() ||
+	     rasterBound.vecMax().y() < row*m_optCache.yBucketSize )
+		return false;
+	// Start at the bucket containing left side of bound
+	TqInt XMinb = max<TqInt>( m_bucketRegion.xMin(),
+			lfloor(rasterBound.vecMin().x())/m_optCache.xBucketSize );
+	if ( XMinb >= m_bucketRegion.xMax() )
+		return false;
+	TqInt XMaxb = clamp<TqInt>( lfloor(rasterBound.vecMax().x())/m_optCache.xBucketSize,
+			XMinb, m_bucketRegion.xMax()-1 );
+	TqInt YMaxb = clamp<TqInt>( lfloor(rasterBound.vecMax().y())/m_optCache.yBucketSize,
+			row, m_bucketRegion.yMax()-1 );
+	return PostToUnprocessedBucket( surface, XMinb, row, XMaxb, YMaxb );
+}
+
+void CqImageBuffer::beginRowExpansion(TqInt firstRow, TqInt lastRow, bool holdOtherRows)
+{
+	m_rowExpansion = true;
+	m_expansionFirstRow = firstRow;
+	m_expansionLastRow = lastRow;
+	m_expansionNextRow = -1;
+	m_expansionHold = holdOtherRows;
+}
+
+TqInt CqImageBuffer::endRowExpansion(bool postHeld)
+{
+	m_rowExpansion = false;
+	std::vector<SqHeldSurface> held;
+	held.swap(m_expansionHeld);
+	if ( postHeld )
+	{
+		for ( std::vector<SqHeldSurface>::const_iterator i = held.begin(),
+		      end = held.end(); i != end; ++i )
+			PostToUnprocessedBucket( i->surface, i->XMinb, i->YMinb,
+			                         i->XMaxb, i->YMaxb );
+	}
+	return m_expansionNextRow;
+}
+
 //----------------------------------------------------------------------
 /** Add a new micro polygon to the list of waiting ones.
  * \param pmpgNew Pointer to a CqMicroPolygon derived class.
  */
 
-void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
+void CqImageBuffer::AddMPG( CqMicroPolygonPtr& pmpgNew )
 {
 	CqRenderer* renderContext = QGetRenderContext();
 	CqBound B = pmpgNew->GetBound();
@@ -597,6 +663,9 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
     Starting from the upper left corner of the image every bucket is
     processed by computing its extent and calling RenderSurfaces().
     After the image is complete ImageComplete() is called.
+
+    Option "limits" "threads" sets the number of buckets processed
+    concurrently; values less than one select the number of available cores.
  
     It will be nice to be able to remove Occlusion at demands.
 	However I did not see a case when Occlusion took longer without occlusion.
@@ -656,37 +725,27 @@ void CqImageBuffer::RenderImage()
 #endif
 	}
 
-	// A counter for the number of processed buckets (used for progress reporting)
-	TqInt iBucket = 0;
-
-	std::vector<boost::shared_ptr<CqBucketProcessor> > bucketProcessors;
-	TqInt numConcurrentBuckets = 1;
-
-/* mafm: Sample code to use with the CqThreadProcessor2 alternative
- * approach.
-
-	std::vector<std::vector<CqBucket*> > bucketLists;
-	bucketLists.resize(MULTIPROCESSING_NBUCKETS);
-	int index = 0;
-	do
-	{
-		bucketLists[index % MULTIPROCESSING_NBUCKETS].push_back( &(CurrentBucket()) );
-		++index;
-	} while ( NextBucket(order) );
-	boost::thread_group threadGroup;
-	for (int i = 0; i < MULTIPROCESSING_NBUCKETS; ++i)
+	// Determine the number of buckets to render concurrently.
+	TqInt numThreads = 1;
+	if(const TqInt* threads = QGetRenderContext()->poptCurrent()->
+			GetIntegerOption("limits", "threads"))
 	{
-		threadGroup.create_thread( CqThreadProcessor2(this, bucketLists[i], fImager, zThreshold, depthfilter, bHalf) );
-	}
-	threadGroup.join_all();
-	return;
-*/
-
-#ifdef		ENABLE_THREADING
-	numConcurrentBuckets = MULTIPROCESSING_NBUCKETS;
+		numThreads = threads[0];
+#ifdef	ENABLE_THREADING
+		if(numThreads <= 0)
+			numThreads = CqThreadPool::hardwareThreads();
+#else
+		if(numThreads != 1)
+			Aqsis::log() << warning << "Multithreaded rendering is not enabled "
+				"in this build, rendering with a single thread" << std::endl;
+		numThreads = 1;
 #endif
+	}
+	if(numThreads > m_bucketRegion.area())
+		numThreads = max<TqInt>(1, m_bucketRegion.area());
 
-	for(int i = 0; i < numConcurrentBuckets; ++i)
+	std::vector<boost::shared_ptr<CqBucketProcessor> > bucketProcessors;
+	for(TqInt i = 0; i < numThreads; ++i)
 	{
 		bucketProcessors.push_back(boost::shared_ptr<CqBucketProcessor>(
 					new CqBucketProcessor(*this, m_optCache)));
@@ -703,72 +762,156 @@ void CqImageBuffer::RenderImage()
 			sampler = &gridSampler;
 	}
 
-	// Iterate over all buckets...
-	bool pendingBuckets = true;
-	while ( pendingBuckets && !m_fQuit )
+	// The pool persists across frames; only restart the workers when the
+	// requested number of threads changes.  This compares against the
+	// request rather than CqThreadPool::numThreads(), which is zero in builds
+	// without threading.
+	if(!m_threadPool || m_threadPoolRequest != numThreads)
 	{
-		CqThreadScheduler threadScheduler(numConcurrentBuckets);
-		std::vector<CqThreadProcessor> threadProcessors;
+		m_threadPool.reset();
+		m_threadPool.reset(new CqThreadPool(numThreads));
+		m_threadPoolRequest = numThreads;
+	}
 
-		for (int i = 0; pendingBuckets && i < numConcurrentBuckets; ++i)
+	// Iterate over all buckets, one pool task per bucket processor.
+	SqBucketDispatch dispatch(sampler, order, pProgressHandler);
+	{
+		CqTaskGroup renderTasks(*m_threadPool);
+		for(TqInt i = 0; i < numThreads; ++i)
 		{
-			bucketProcessors[i]->setBucket(&CurrentBucket());
+			renderTasks.run( CqThreadProcessor(this,
+						bucketProcessors[i].get(), &dispatch) );
+		}
+		renderTasks.wait();
+	}
+	// The shading states hold copies of this frame's shaders.
+	m_shadingStates.clear();
+
+	// Pass >100 through to progress to allow it to indicate completion.
+	if ( pProgressHandler )
+	{
+		( *pProgressHandler ) ( 100.0f, QGetRenderContext() ->CurrentFrame() );
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Render buckets with the given processor until there are none left.
+ *
+ * Preparing a bucket uses the shared sampler and the cache segments left by
+ * its neighbours, so buckets are taken and prepared one at a time.  The bulk
+ * of the work in process() and postProcess() then runs concurrently with the
+ * other render threads.
+ */
+void CqImageBuffer::renderBuckets(CqBucketProcessor& processor, SqBucketDispatch& dispatch)
+{
+	while(true)
+	{
+		{
+			boost::mutex::scoped_lock dispatchLock(dispatch.dispatchMutex);
+			if(!dispatch.pendingBuckets || m_fQuit)
+				return;
+
+			CqBucket& bucket = CurrentBucket();
+			{
+				// Once started, neighbours must not hand us any more cache
+				// segments.
+				boost::mutex::scoped_lock lock(m_pipelineMutex);
+				bucket.SetStarted();
+			}
+			processor.setBucket(&bucket);
 
 			// Prepare the bucket processor
-			bucketProcessors[i]->preProcess(sampler);
+			processor.preProcess(dispatch.sampler);
 
 #if ENABLE_MPDUMP
 			// Dump the pixel sample positions into a dump file
 			if(m_mpdump.IsOpen())
-				m_mpdump.dumpPixelSamples(*bucketProcessors[i]);
+				m_mpdump.dumpPixelSamples(processor);
 #endif
 
-			// Kick off a thread to process this bucket.
-			threadProcessors.push_back( CqThreadProcessor( bucketProcessors[i].get() ) );
-			threadScheduler.addWorkUnit( threadProcessors.back() );
-
 			// Advance to next bucket, quit if nothing left
-			iBucket += 1;
-			pendingBuckets = NextBucket(order);
+			dispatch.pendingBuckets = NextBucket(dispatch.order);
 		}
 
-		// Wait for all current buckets to complete before allocating more to the available threads.
-		threadScheduler.joinAll();
-		threadProcessors.clear();
-
-		for (int i = 0; !m_fQuit && i < numConcurrentBuckets; ++i)
+		processor.process();
+		if(!m_fQuit)
 		{
-			bucketProcessors[i]->postProcess();
+			processor.postProcess();
+
+			boost::mutex::scoped_lock displayLock(dispatch.displayMutex);
 			{
 				AQSIS_TIME_SCOPE(Display_bucket);
-				const CqBucket* bucket = bucketProcessors[i]->getBucket();
-				if (bucket)
-				{
-					QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucketProcessors[i]->DisplayRegion(), &(bucketProcessors[i]->getChannelBuffer()) );
-				}
+				QGetRenderContext() ->pDDmanager() ->DisplayBucket( processor.DisplayRegion(), &(processor.getChannelBuffer()) );
 			}
-			bucketProcessors[i]->reset();
+			++dispatch.numFinished;
 
-			if ( pProgressHandler )
+			if ( dispatch.progressHandler )
 			{
 				// Inform the status class how far we have got, and update UI.
-				float Complete = (100.0f * iBucket) / static_cast<float> ( m_bucketRegion.area() );
+				float Complete = (100.0f * dispatch.numFinished) / static_cast<float> ( m_bucketRegion.area() );
 				QGetRenderContext() ->Stats().SetComplete( Complete );
-				( *pProgressHandler ) ( Complete, QGetRenderContext() ->CurrentFrame() );
+				( *dispatch.progressHandler ) ( Complete, QGetRenderContext() ->CurrentFrame() );
 			}
 
 #ifdef WIN32
-			if ( !( iBucket % bucketmodulo ) )
+			if ( !( dispatch.numFinished % bucketmodulo ) )
 				SetProcessWorkingSetSize( GetCurrentProcess(), 0xffffffff, 0xffffffff );
 #endif
 		}
+		processor.reset();
 	}
+}
 
-	// Pass >100 through to progress to allow it to indicate completion.
-	if ( pProgressHandler )
+
+//----------------------------------------------------------------------
+/** Take a shading state for a task, creating a new one if none are free.
+ */
+boost::shared_ptr<CqShadingState> CqImageBuffer::acquireShadingState()
+{
+	boost::mutex::scoped_lock lock(m_shadingStateMutex);
+	if(m_shadingStates.empty())
+		return boost::shared_ptr<CqShadingState>(new CqShadingState());
+	boost::shared_ptr<CqShadingState> state = m_shadingStates.back();
+	m_shadingStates.pop_back();
+	return state;
+}
+
+void CqImageBuffer::releaseShadingState(const boost::shared_ptr<CqShadingState>& state)
+{
+	boost::mutex::scoped_lock lock(m_shadingStateMutex);
+	m_shadingStates.push_back(state);
+}
+
+
+//----------------------------------------------------------------------
+/** Determine whether a bucket may be marked as processed.
+ *
+ * Geometry is always posted into the first unprocessed bucket it overlaps in
+ * bucket order, so only buckets before this one can post into it, and only
+ * if it lies in their reach.  Those buckets have all been dispatched, since
+ * NextBucket() hands them out in order, so waiting for them can't deadlock.
+ */
+bool CqImageBuffer::canCloseBucket(const CqBucket& bucket)
+{
+	const TqInt width = m_bucketRegion.width();
+	const TqInt index = (bucket.getRow() - m_bucketRegion.yMin())*width
+		+ bucket.getCol() - m_bucketRegion.xMin();
+	// Skip over the leading buckets which are already closed.
+	while(m_firstOpenBucket < index && Bucket(m_bucketRegion.xMin() + m_firstOpenBucket%width,
+				m_bucketRegion.yMin() + m_firstOpenBucket/width).IsProcessed())
+		++m_firstOpenBucket;
+	for(TqInt i = m_firstOpenBucket; i < index; ++i)
 	{
-		( *pProgressHandler ) ( 100.0f, QGetRenderContext() ->CurrentFrame() );
+		const CqBucket& other = Bucket(m_bucketRegion.xMin() + i%width,
+				m_bucketRegion.yMin() + i/width);
+		const CqRegion& reach = other.reach();
+		if(!other.IsProcessed()
+			&& reach.xMin() <= bucket.getCol() && bucket.getCol() < reach.xMax()
+			&& reach.yMin() <= bucket.getRow() && bucket.getRow() < reach.yMax())
+			return false;
 	}
+	return true;
 }
 
 
@@ -32,6 +32,10 @@
 
 #include	<vector>
 
+#include	<boost/scoped_ptr.hpp>
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/condition.hpp>
+
 #include	"surface.h"
 #include	<aqsis/math/vector2d.h>
 #include   	"bucket.h"
@@ -42,6 +46,10 @@ namespace Aqsis {
 
 
 class CqMicroPolygon;
+class CqBucketProcessor;
+class CqShadingState;
+class CqThreadPool;
+class IqSampler;
 
 
 // Enumeration of the type of rendering order of the buckets (experimental)
@@ -71,7 +79,10 @@ enum EqBucketOrder {
   the first bucket that touches its bound.
  
   Once all the gprims are posted to the buffer the image can be rendered by calling
-  RenderImage(). Now all buckets will be processed one after another. 
+  RenderImage(). Buckets are handed out to a number of bucket processors (one
+  per worker of a persistent thread pool, see Option "limits" "threads") in
+  the order given by NextBucket(), and are closed to further geometry in that
+  same order.
  
   \see CqBucket, CqSurface, CqRenderer
  */
@@ -79,16 +90,10 @@ enum EqBucketOrder {
 class CqImageBuffer
 {
 	public:
-		CqImageBuffer() :
-				m_fQuit( false ),
-				m_cXBuckets( 0 ),
-				m_cYBuckets( 0 ),
-				m_CurrentBucketCol( 0 ),
-				m_CurrentBucketRow( 0 )
-		{}
+		CqImageBuffer();
 		~CqImageBuffer();
 
-		void AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew );
+		void AddMPG( CqMicroPolygonPtr& pmpgNew );
 		void PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		/** \brief Repost a previously posted surface into the next unfinished bucket.
 		 *
@@ -102,6 +107,37 @@ class CqImageBuffer
 		 */
 		void RepostSurface( const CqBucket& oldBucket,
 		                    const boost::shared_ptr<CqSurface>& surface );
+		/** \brief Post a previously posted surface into the given bucket row.
+		 *
+		 * The surface goes into the first unprocessed bucket it overlaps,
+		 * starting from the bucket containing the left side of its bound in
+		 * the given row.
+		 *
+		 * \param row - bucket row to post into.
+		 * \param surface - surface to post
+		 * \return true if the surface was posted.
+		 */
+		bool PostSurfaceToRow( TqInt row, const boost::shared_ptr<CqSurface>& surface );
+		/** \brief Only accept surfaces starting in the given bucket rows.
+		 *
+		 * This is used while a procedural is expanded one bucket row at a
+		 * time: surfaces posted before endRowExpansion() which start in
+		 * other rows are left to another expansion of the procedural.  Must
+		 * be called with pipelineMutex() held.
+		 *
+		 * \param firstRow, lastRow - inclusive range of bucket rows
+		 * \param holdOtherRows - keep surfaces starting in other rows until
+		 * endRowExpansion() rather than discarding them.
+		 */
+		void beginRowExpansion(TqInt firstRow, TqInt lastRow, bool holdOtherRows);
+		/** \brief Accept surfaces in any bucket row again.
+		 *
+		 * \param postHeld - post the surfaces held since beginRowExpansion()
+		 * rather than discarding them.
+		 * \return the first row after the accepted ones in which a surface
+		 * starts, or -1 if there is none.
+		 */
+		TqInt endRowExpansion(bool postHeld);
 		void RenderImage();
 
 		void SetImage();
@@ -122,7 +158,78 @@ class CqImageBuffer
 		 */
 		void	axialNeighbours(CqBucket const& bucket, std::vector<CqBucket*>& neighbours);
 
+		/** \brief Get the lock guarding the shared bucket posting state.
+		 *
+		 * This covers the bucket queues, flags, reach and cache segments, the
+		 * row expansion state, and the reference counts of grids and
+		 * micropolygons, which are shared between buckets.  Bucket processors
+		 * hold it while taking work from or posting into the buckets, and
+		 * while splitting or dicing surfaces which aren't reentrant (see
+		 * CqSurface::isReentrant()), such as procedurals.
+		 */
+		boost::mutex& pipelineMutex();
+		/** \brief Announce that a surface is about to be split, diced or
+		 * shaded outside pipelineMutex().
+		 *
+		 * This reads the render context, which procedurals replace while
+		 * they're expanded, so this waits for any expansion in progress.
+		 *
+		 * \param lock - lock held on pipelineMutex()
+		 */
+		void beginSurfaceWork(boost::mutex::scoped_lock& lock);
+		/// Announce that work started by beginSurfaceWork() is done; lock held.
+		void endSurfaceWork();
+		/** \brief Wait until no surfaces are being worked on outside the lock,
+		 * and keep new work from starting until endExpansion(), so a
+		 * procedural can be expanded.
+		 *
+		 * \param lock - lock held on pipelineMutex()
+		 */
+		void beginExpansion(boost::mutex::scoped_lock& lock);
+		/// Let surfaces be worked on again after beginExpansion(); lock held.
+		void endExpansion();
+		/** \brief Determine whether a bucket may be marked as processed.
+		 *
+		 * A bucket is closed once no open bucket before it in the bucket
+		 * order has it in its reach (see CqBucket::reach()), rather than
+		 * waiting for all of them.  The caller checks that the bucket has no
+		 * work left.  Must be called with pipelineMutex() held.
+		 */
+		bool canCloseBucket(const CqBucket& bucket);
+		/** \brief Block until another processor posts geometry or closes a
+		 * bucket.
+		 *
+		 * \param lock - lock held on pipelineMutex()
+		 */
+		void waitForPipeline(boost::mutex::scoped_lock& lock);
+		/// Wake any processors blocked in waitForPipeline()
+		void notifyPipeline();
+		/** \brief Get the pool of render threads.
+		 *
+		 * Only valid during RenderImage(); bucket processors use it to split
+		 * up the work inside a single bucket.
+		 */
+		CqThreadPool& threadPool();
+		/** \brief Take a set of shader instances for a task shading a grid.
+		 *
+		 * Grids of one bucket are diced and shaded by pool tasks which may
+		 * run on any render thread, so the tasks can't use the shader
+		 * instances of the bucket processor.  The states are reused by later
+		 * tasks, and dropped at the end of RenderImage().
+		 */
+		boost::shared_ptr<CqShadingState> acquireShadingState();
+		/// Return a state taken with acquireShadingState().
+		void releaseShadingState(const boost::shared_ptr<CqShadingState>& state);
+
 	private:
+		friend class CqThreadProcessor;
+
+		struct SqBucketDispatch;
+		/** Process buckets until none are left; the body of each render
+		 * thread.
+		 */
+		void renderBuckets(CqBucketProcessor& processor, SqBucketDispatch& dispatch);
+
 		/// Get a pointer to the bucket at position x,y in the grid.
 		CqBucket& Bucket( TqInt x, TqInt y)
 		{
@@ -143,12 +250,49 @@ class CqImageBuffer
 		std::vector<std::vector<CqBucket> >	m_Buckets; ///< Array of bucket storage classes (row/col)
 		TqInt	m_CurrentBucketCol;	///< Column index of the bucket currently being processed.
 		TqInt	m_CurrentBucketRow;	///< Row index of the bucket currently being processed.
+		bool	m_rowExpansion;		///< True while posting is restricted to some rows.
+		TqInt	m_expansionFirstRow;	///< First row accepted during row expansion.
+		TqInt	m_expansionLastRow;	///< Last row accepted during row expansion.
+		TqInt	m_expansionNextRow;	///< First row after m_expansionLastRow holding a surface.
+		bool	m_expansionHold;	///< True if surfaces in other rows are held.
+		/// Surface held during row expansion, with its range of buckets.
+		struct SqHeldSurface
+		{
+			boost::shared_ptr<CqSurface> surface;
+			TqInt XMinb;
+			TqInt YMinb;
+			TqInt XMaxb;
+			TqInt YMaxb;
+		};
+		std::vector<SqHeldSurface> m_expansionHeld;	///< Surfaces held during row expansion.
+
+		boost::mutex m_pipelineMutex;	///< Lock for the shared pipeline state, see pipelineMutex().
+		boost::condition m_pipelineChanged;	///< Signalled when geometry is posted or a bucket closes.
+		TqInt	m_firstOpenBucket;	///< Index in bucket order before which all buckets are closed.
+		TqInt	m_activeWorkers;	///< Number of surfaces being worked on outside the lock.
+		bool	m_expanding;		///< True while a procedural waits for or does its expansion.
+		/// Render threads, kept alive between frames.
+		boost::scoped_ptr<CqThreadPool> m_threadPool;
+		/// Number of threads requested when m_threadPool was created.
+		TqInt	m_threadPoolRequest;
+		boost::mutex m_shadingStateMutex;	///< Lock for m_shadingStates.
+		/// Shading states not in use by a task, see acquireShadingState().
+		std::vector<boost::shared_ptr<CqShadingState> > m_shadingStates;
 
 #if ENABLE_MPDUMP
 		CqMPDump	m_mpdump;
 #endif
 
 		bool	CullSurface( CqBound& Bound, const boost::shared_ptr<CqSurface>& pSurface );
+		/** Add a surface to the first unprocessed bucket in the given range,
+		 * returning false if they have all been processed.
+		 */
+		bool	PostToUnprocessedBucket( const boost::shared_ptr<CqSurface>& pSurface,
+		                                 TqInt XMinb, TqInt YMinb, TqInt XMaxb, TqInt YMaxb );
+		/** Add a surface to a bucket, extending the bucket's reach by the
+		 * buckets the surface overlaps.
+		 */
+		void	AddToBucket( CqBucket& bucket, const boost::shared_ptr<CqSurface>& pSurface );
 		void	DeleteImage();
 
 		/** Move to the next bucket to process.
@@ -161,6 +305,9 @@ class CqImageBuffer
 		{
 			return( m_Buckets[m_CurrentBucketRow][m_CurrentBucketCol] );
 		}
+	public:
+		/// Class to expose private functions for testing.
+		struct Test;
 };
 
 //-----------------------------------------------------------------------
@@ -187,6 +334,55 @@ inline void CqImageBuffer::axialNeighbours(CqBucket const& bucket, std::vector<C
 		neighbours[below] = &Bucket(bx, by+1);
 }
 
+inline boost::mutex& CqImageBuffer::pipelineMutex()
+{
+	return m_pipelineMutex;
+}
+
+inline void CqImageBuffer::waitForPipeline(boost::mutex::scoped_lock& lock)
+{
+	m_pipelineChanged.wait(lock);
+}
+
+inline void CqImageBuffer::notifyPipeline()
+{
+	m_pipelineChanged.notify_all();
+}
+
+inline void CqImageBuffer::beginSurfaceWork(boost::mutex::scoped_lock& lock)
+{
+	while(m_expanding)
+		m_pipelineChanged.wait(lock);
+	++m_activeWorkers;
+}
+
+inline void CqImageBuffer::endSurfaceWork()
+{
+	--m_activeWorkers;
+	m_pipelineChanged.notify_all();
+}
+
+inline void CqImageBuffer::beginExpansion(boost::mutex::scoped_lock& lock)
+{
+	while(m_expanding)
+		m_pipelineChanged.wait(lock);
+	m_expanding = true;
+	while(m_activeWorkers > 0)
+		m_pipelineChanged.wait(lock);
+}
+
+inline void CqImageBuffer::endExpansion()
+{
+	m_expanding = false;
+	m_pipelineChanged.notify_all();
+}
+
+inline CqThreadPool& CqImageBuffer::threadPool()
+{
+	assert(m_threadPool);
+	return *m_threadPool;
+}
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
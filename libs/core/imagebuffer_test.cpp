@@ -0,0 +1,210 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for posting surfaces to the image buffer buckets.
+ */
+
+#include "imagebuffer.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <fstream>
+#include <string>
+
+#include <aqsis/ri/ri.h>
+
+#include "procedural.h"
+#include "renderer.h"
+
+namespace Aqsis
+{
+// Expose private methods of CqImageBuffer for testing.
+struct CqImageBuffer::Test
+{
+	static CqBucket& bucket(CqImageBuffer& image, TqInt x, TqInt y)
+	{
+		return image.Bucket(x, y);
+	}
+};
+}
+
+BOOST_AUTO_TEST_SUITE(imagebuffer_tests)
+using namespace Aqsis;
+
+namespace {
+
+inline char* tok(const char* str)
+{
+	return const_cast<char*>(str);
+}
+
+/** Set up an image of two columns by four rows of 16x16 buckets, where
+ * camera space y = 1.5 - row is the centre of each bucket row.
+ */
+CqImageBuffer& beginImage()
+{
+	RiBegin(RI_NULL);
+	RiFormat(32, 64, 1);
+	RiScreenWindow(-1, 1, -2, 2);
+	RiProjection(tok("orthographic"), RI_NULL);
+	RiWorldBegin();
+	QGetRenderContext()->initialiseCropWindow();
+	QGetRenderContext()->poptCurrent()->InitialiseCamera();
+	CqImageBuffer& image = *QGetRenderContext()->pImage();
+	image.SetImage();
+	return image;
+}
+
+void endImage()
+{
+	QGetRenderContext()->EndWorldModeBlock();
+	RiEnd();
+}
+
+/// Procedural in the left column of buckets, covering the given rows.
+boost::shared_ptr<CqSurface> procedural(TqInt firstRow, TqInt lastRow)
+{
+	CqBound bound(-0.9f, 1.2f - lastRow, 1, -0.1f, 1.8f - firstRow, 2);
+	return boost::shared_ptr<CqSurface>(new CqProcedural(0, bound, 0, 0));
+}
+
+TqInt numGPrims(CqImageBuffer& image, TqInt x, TqInt y)
+{
+	return CqImageBuffer::Test::bucket(image, x, y).cGPrims();
+}
+
+void writeFile(const char* fileName, const std::string& contents)
+{
+	std::ofstream out(fileName, std::ios::binary);
+	out.write(contents.data(), contents.size());
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(imagebuffer_row_expansion_discards_other_rows)
+{
+	CqImageBuffer& image = beginImage();
+	image.beginRowExpansion(1, 1, false);
+	image.PostSurface(procedural(0, 0));
+	image.PostSurface(procedural(1, 2));
+	image.PostSurface(procedural(3, 3));
+	// Only surfaces starting in the expanded row are kept, and the next
+	// expansion is in the next row where a surface starts.
+	BOOST_CHECK_EQUAL(image.endRowExpansion(false), 3);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 0), 0);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 1), 1);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 2), 0);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 3), 0);
+	// Outside row expansion all surfaces are posted.
+	image.PostSurface(procedural(3, 3));
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 3), 1);
+	endImage();
+}
+
+BOOST_AUTO_TEST_CASE(imagebuffer_row_expansion_holds_other_rows)
+{
+	CqImageBuffer& image = beginImage();
+	image.beginRowExpansion(0, 0, true);
+	image.PostSurface(procedural(0, 1));
+	image.PostSurface(procedural(2, 2));
+	image.PostSurface(procedural(3, 3));
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 0), 1);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 2), 0);
+	// Held surfaces are posted when the procedural can't be expanded again.
+	BOOST_CHECK_EQUAL(image.endRowExpansion(true), 2);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 2), 1);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 3), 1);
+
+	// With nothing in later rows, there's no next expansion.
+	image.beginRowExpansion(1, 3, true);
+	image.PostSurface(procedural(0, 0));
+	BOOST_CHECK_EQUAL(image.endRowExpansion(false), -1);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 0), 1);
+	endImage();
+}
+
+BOOST_AUTO_TEST_CASE(imagebuffer_post_to_row_skips_processed_buckets)
+{
+	CqImageBuffer& image = beginImage();
+	boost::shared_ptr<CqSurface> surface = procedural(1, 3);
+	image.PostSurface(surface);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 1), 1);
+
+	CqImageBuffer::Test::bucket(image, 0, 2).SetProcessed();
+	BOOST_CHECK(image.PostSurfaceToRow(2, surface));
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 2), 0);
+	BOOST_CHECK_EQUAL(numGPrims(image, 0, 3), 1);
+
+	// Nowhere to go once all the buckets it overlaps are processed.
+	CqImageBuffer::Test::bucket(image, 0, 3).SetProcessed();
+	BOOST_CHECK(!image.PostSurfaceToRow(2, surface));
+	BOOST_CHECK(!image.PostSurfaceToRow(4, surface));
+	// Rows below the surface are never posted to.
+	boost::shared_ptr<CqSurface> upper = procedural(0, 1);
+	image.PostSurface(upper);
+	BOOST_CHECK(!image.PostSurfaceToRow(2, upper));
+	endImage();
+}
+
+BOOST_AUTO_TEST_CASE(imagebuffer_close_bucket_waits_for_buckets_reaching_it)
+{
+	CqImageBuffer& image = beginImage();
+	image.PostSurface(procedural(0, 1));
+	CqBucket& first = CqImageBuffer::Test::bucket(image, 0, 0);
+	// Only the bucket below is in reach of the surface.
+	BOOST_CHECK(!image.canCloseBucket(CqImageBuffer::Test::bucket(image, 0, 1)));
+	BOOST_CHECK(image.canCloseBucket(CqImageBuffer::Test::bucket(image, 1, 0)));
+	BOOST_CHECK(image.canCloseBucket(CqImageBuffer::Test::bucket(image, 1, 1)));
+	BOOST_CHECK(image.canCloseBucket(CqImageBuffer::Test::bucket(image, 0, 2)));
+
+	first.popSurface();
+	first.SetProcessed();
+	BOOST_CHECK(image.canCloseBucket(CqImageBuffer::Test::bucket(image, 0, 1)));
+	endImage();
+}
+
+BOOST_AUTO_TEST_CASE(imagebuffer_archive_global_requests_are_counted)
+{
+	// Only requests which outlast an archive expansion are counted, since
+	// archives making them can't be expanded again.
+	writeFile("imagebuffer_test_geometry.rib",
+		"AttributeBegin\n"
+		"Translate 0 1 0\n"
+		"Attribute \"user\" \"uniform float id\" [1]\n"
+		"AttributeEnd\n");
+	writeFile("imagebuffer_test_declare.rib",
+		"Declare \"imagebufferTestToken\" \"uniform float\"\n");
+	writeFile("imagebuffer_test_coordsys.rib",
+		"CoordinateSystem \"imagebufferTestSpace\"\n");
+	beginImage();
+	TqInt requests = QGetRenderContext()->globalRequests();
+	RiReadArchive(tok("./imagebuffer_test_geometry.rib"), 0, RI_NULL);
+	BOOST_CHECK_EQUAL(QGetRenderContext()->globalRequests(), requests);
+	RiReadArchive(tok("./imagebuffer_test_declare.rib"), 0, RI_NULL);
+	BOOST_CHECK_EQUAL(QGetRenderContext()->globalRequests(), requests + 1);
+	RiReadArchive(tok("./imagebuffer_test_coordsys.rib"), 0, RI_NULL);
+	BOOST_CHECK_EQUAL(QGetRenderContext()->globalRequests(), requests + 2);
+	endImage();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -48,6 +48,13 @@ CqImagePixel::CqImagePixel(TqInt xSamples, TqInt ySamples)
 		: m_XSamples(xSamples),
 		m_YSamples(ySamples),
 		m_samples(new SqSampleData[xSamples*ySamples]),
+		m_occlZ(new TqFloat[xSamples*ySamples]),
+		m_occludingHits(new SqImageSample[xSamples*ySamples]),
+		m_lastHit(new TqInt[xSamples*ySamples]),
+		m_hits(),
+		m_prevHit(),
+		m_csgNodes(),
+		m_combineHits(),
 		m_hitSamples(),
 		m_DofOffsetIndices(new TqInt[xSamples*ySamples]),
 		m_refCount(0),
@@ -56,12 +63,7 @@ CqImagePixel::CqImagePixel(TqInt xSamples, TqInt ySamples)
 	assert(xSamples > 0);
 	assert(ySamples > 0);
 
-	TqInt nSamples = numSamples();
-	// Allocate sample storage for all the occluding hits.
-	TqInt sampSize = SqImageSample::sampleSize;
-	m_hitSamples.resize(nSamples*sampSize);
-	for(TqInt i = 0; i < nSamples; ++i)
-		m_samples[i].occludingHit.index = i*sampSize;
+	clear();
 }
 
 void CqImagePixel::swap(CqImagePixel& other)
@@ -71,6 +73,12 @@ void CqImagePixel::swap(CqImagePixel& other)
 
 	m_hitSamples.swap(other.m_hitSamples);
 	m_samples.swap(other.m_samples);
+	m_occlZ.swap(other.m_occlZ);
+	m_occludingHits.swap(other.m_occludingHits);
+	m_lastHit.swap(other.m_lastHit);
+	m_hits.swap(other.m_hits);
+	m_prevHit.swap(other.m_prevHit);
+	m_csgNodes.swap(other.m_csgNodes);
 	m_DofOffsetIndices.swap(other.m_DofOffsetIndices);
 	m_hasValidSamples = other.m_hasValidSamples;
 }
@@ -106,18 +114,24 @@ void CqImagePixel::clear()
 {
 	TqInt nSamples = numSamples();
 	TqInt sampSize = SqImageSample::sampleSize;
+	// Allocate sample storage for all the occluding hits.  The hit arena
+	// keeps its capacity, so once a pixel has been recycled through the
+	// pipeline a few times no further allocation is necessary.
 	m_hitSamples.resize(nSamples*sampSize);
+	m_hits.clear();
+	m_prevHit.clear();
+	m_csgNodes.clear();
 	m_hasValidSamples = false;
 	for(TqInt i = 0; i < nSamples; ++i)
 	{
-		if(!m_samples[i].data.empty())
-			m_samples[i].data.clear();
-		m_samples[i].occludingHit.flags = 0;
+		m_lastHit[i] = -1;
+		m_occludingHits[i].flags = 0;
+		m_occludingHits[i].csgNode = -1;
 		// Reallocate the occluding samples, as their storage indices may have
 		// changed during the Combine() stage.
-		m_samples[i].occludingHit.index = i*sampSize;
+		m_occludingHits[i].index = i*sampSize;
 		// Reset the occluding depth to the maximum.
-		m_samples[i].occlZ = FLT_MAX;
+		m_occlZ[i] = FLT_MAX;
 	}
 }
 
@@ -148,20 +162,25 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 	TqInt nSamples = numSamples();
 	for(TqInt sampIdx = 0; sampIdx < nSamples; ++sampIdx)
 	{
-		SqSampleData& sampleData = m_samples[sampIdx];
-
-		SqImageSample& occlHit = sampleData.occludingHit;
+		SqImageSample& occlHit = m_occludingHits[sampIdx];
 		sampleIndex++;
 
-		if(!sampleData.data.empty())
+		if(m_lastHit[sampIdx] >= 0)
 		{
+			// Gather the hits for this sample out of the arena, in the order
+			// they were added.
+			std::vector<SqImageSample>& hits = m_combineHits;
+			hits.clear();
+			for(TqInt h = m_lastHit[sampIdx]; h >= 0; h = m_prevHit[h])
+				hits.push_back(m_hits[h]);
+			std::reverse(hits.begin(), hits.end());
 			if (occlHit.flags & SqImageSample::Flag_Valid)
 			{
 				//	insert occlHit into samples if it holds valid data.
-				sampleData.data.push_back(occlHit);
+				hits.push_back(occlHit);
 			}
 			// Sort the samples by depth.
-			std::sort(sampleData.data.begin(), sampleData.data.end(), CqAscendingDepthSort(*this));
+			std::sort(hits.begin(), hits.end(), CqAscendingDepthSort(*this));
 
 			// Find out if any of the samples are in a CSG tree.
 			bool bProcessed;
@@ -173,13 +192,16 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 					bProcessed = false;
 					//Warning ProcessTree add or remove elements in samples list
 					//We could not optimized the for loop here at all.
-					for ( std::vector<SqImageSample>::iterator isample = sampleData.data.begin();
-					        isample != sampleData.data.end();
+					for ( std::vector<SqImageSample>::iterator isample = hits.begin();
+					        isample != hits.end();
 					        ++isample )
 					{
-						if ( isample->csgNode )
+						if ( isample->csgNode >= 0 )
 						{
-							isample->csgNode->ProcessTree( sampleData.data );
+							// Hold onto the node, since processing may add
+							// entries to the node table.
+							boost::shared_ptr<CqCSGTreeNode> node = m_csgNodes[isample->csgNode];
+							node->ProcessTree( hits, m_csgNodes );
 							bProcessed = true;
 							break;
 						}
@@ -191,11 +213,11 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 			CqColor samplecolor;
 			CqColor sampleopacity;
 			bool samplehit = false;
-			TqFloat opaqueDepths[2] = { sampleData.occlZ, FLT_MAX };
+			TqFloat opaqueDepths[2] = { m_occlZ[sampIdx], FLT_MAX };
 			TqFloat maxOpaqueDepth = FLT_MAX;
 
-			for ( std::vector<SqImageSample>::reverse_iterator sample = sampleData.data.rbegin();
-			        sample != sampleData.data.rend();
+			for ( std::vector<SqImageSample>::reverse_iterator sample = hits.rbegin();
+			        sample != hits.rend();
 			        sample++ )
 			{
 				TqFloat* sample_data = sampleHitData(*sample);
@@ -246,11 +268,11 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 			}
 
 			// Write the collapsed color values back into the occluding entry.
-			if ( !sampleData.data.empty() )
+			if ( !hits.empty() )
 			{
 				// Make sure the extra sample data from the top entry is copied
 				// to the occluding sample, which is then sent to the display.
-				occlHit = *sampleData.data.begin();
+				occlHit = *hits.begin();
 				TqFloat* occlData = sampleHitData(occlHit);
 				// Set the color and opacity.
 				occlData[Sample_Red] = samplecolor.r();
@@ -267,7 +289,7 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 					if ( depthfilter == Filter_MidPoint )
 					{
 						// Use midpoint for depth
-						if ( sampleData.data.size() > 1 )
+						if ( hits.size() > 1 )
 							occlDepth = ( ( opaqueDepths[0] + opaqueDepths[1] ) * 0.5f );
 						else
 							occlDepth = FLT_MAX;
@@ -281,7 +303,7 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 						std::vector<SqImageSample>::iterator sample;
 						TqFloat totDepth = 0.0f;
 						TqInt totCount = 0;
-						for ( sample = sampleData.data.begin(); sample != sampleData.data.end(); sample++ )
+						for ( sample = hits.begin(); sample != hits.end(); sample++ )
 						{
 							TqFloat* sample_data = sampleHitData(*sample);
 							if(sample_data[Sample_ORed] >= zThreshold.r() || sample_data[Sample_OGreen] >= zThreshold.g() || sample_data[Sample_OBlue] >= zThreshold.b())
@@ -323,7 +345,7 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 					// represents one surface *behind* the opaque depth in this
 					// case.
 					occlData[Sample_Depth] = 0.5*(occlData[Sample_Depth]
-					                              + sampleData.occlZ);
+					                              + m_occlZ[sampIdx]);
 				}
 				samplecount++;
 			}
@@ -79,10 +79,10 @@ struct SqImageSample
 	TqInt index;
 	/// Flags for this sample, using the anonymous enum below.
 	TqUint flags;
-	/// A shared pointer to the CSG node for this sample.
-	/// If the sample originated from a surface that was part of a CSG tree
-	/// this pointer will be valid, otherwise, it will be null.
-	boost::shared_ptr<CqCSGTreeNode> csgNode;
+	/// Index of the CSG node for this sample in the CSG node table of the
+	/// associated CqImagePixel.  If the sample originated from a surface that
+	/// was part of a CSG tree this index will be valid, otherwise, it will be -1.
+	TqInt csgNode;
 
 	/** \brief Flags indicating the type of sample.
 	 *
@@ -103,50 +103,25 @@ struct SqImageSample
 	/** \brief Default constructor.
  	 */
 	SqImageSample();
-	/** \brief Copy constructor.
- 	 */
-	SqImageSample(const SqImageSample& from);
-
-	/** \brief Assignment operator overload.
- 	 *  Does a deep copy of the data assigned to the sample.
- 	 *
- 	 *  \param from - The sample to copy from.
- 	 */
-	SqImageSample& operator=(const SqImageSample& from);
 };
 
 
-/** Structure to hold the info about a sample point.
+/** Structure to hold the camera info about a sample point.
+ *
+ * This only holds the data which is fixed once the sample pattern has been
+ * set up; the hits and depths accumulated during sampling are held by the
+ * CqImagePixel in separate arrays, so that the sample data stays compact.
  */
 
-struct SqSampleData : private boost::noncopyable
+struct SqSampleData
 {
 	CqVector2D	position;			///< Sample position
 	CqVector2D	dofOffset;			///< Dof lens offset.
 	TqUint      occlusionIndex;     ///< Index for sample in occlusion tree.
 	TqFloat		time;				///< Float sample time.
 	TqFloat		detailLevel;		///< Float level-of-detail sample.
-	std::vector<SqImageSample> data;	///< Array of surface "hits" for this sample.
-	/** \brief Minimum depth hit which occludes any hits further away
-	 *
-	 * During micropolygon sampling, occludingHit is used to store the surface
-	 * hit which is closest to the camera for the sample point.  Any
-	 * micropolygon hits further away than this can be culled without being
-	 * stored.  A micropolygon hit can occlude other surfaces when
-	 * 1) The micropoly is opaque
-	 * 2) The micropoly does not participate in CSG
-	 * 3) The z depthfilter is "min" or "midpoint" (midpoint uses special case code).
-	 */
-	SqImageSample occludingHit;
-	/** \brief Occluding depth.
-	 *
-	 * This should be the same as the depth in occludingHit, *except* when a
-	 * depth filter mode not equal to "min" is enabled.  (ie, the "midpoint"
-	 * or other more exotic depth filters)
-	 */
-	TqFloat occlZ;
 
-	/// Default construct members & set numeric members to 0 except occlZ=FLT_MAX.
+	/// Default construct members & set numeric members to 0.
 	SqSampleData();
 };
 
@@ -216,18 +191,48 @@ class CqImagePixel : private boost::noncopyable
 		 */
 		void clear();
 
-		/** \brief Get a reference to the array of values for the specified sample.
-		 * \param index the index of the sample point within the pixel
+		/** \brief Add a semitransparent hit to the specified sample.
+		 *
+		 * The hit has its data allocated, and has no CSG node.  Hits are
+		 * stored in a single arena for the whole pixel which is reset by
+		 * clear(), so the returned reference is only valid until the next
+		 * call to addHit().
+		 *
+		 * \param index - the index of the sample point within the pixel
 		 */
-		std::vector<SqImageSample>& Values( TqInt index );
+		SqImageSample& addHit( TqInt index );
+
+		/// Get the index of a CSG node in the node table of this pixel.
+		TqInt csgNodeIndex( const boost::shared_ptr<CqCSGTreeNode>& node );
 
 		/** \brief Get a reference to the image hit that represents the top
 		 * if the closest sample is occluding.
 		 *
+		 * During micropolygon sampling, the occluding hit is used to store the
+		 * surface hit which is closest to the camera for the sample point.  Any
+		 * micropolygon hits further away than this can be culled without being
+		 * stored.  A micropolygon hit can occlude other surfaces when
+		 * 1) The micropoly is opaque
+		 * 2) The micropoly does not participate in CSG
+		 * 3) The z depthfilter is "min" or "midpoint" (midpoint uses special case code).
+		 *
 		 *  \param index - The index of the sample within the pixel to query.
 		 */
 		SqImageSample& occludingHit( TqInt index );
 
+		//@{
+		/** \brief Get the occluding depth for the specified sample.
+		 *
+		 * This should be the same as the depth in the occluding hit, *except*
+		 * when a depth filter mode not equal to "min" is enabled.  (ie, the
+		 * "midpoint" or other more exotic depth filters)
+		 *
+		 *  \param index - The index of the sample within the pixel to query.
+		 */
+		TqFloat occlZ( TqInt index ) const;
+		TqFloat& occlZ( TqInt index );
+		//@}
+
 		//@{
 		/** \brief Return the sample data associated with a micropolygon sample hit.
 		 *
@@ -315,6 +320,20 @@ class CqImagePixel : private boost::noncopyable
 		TqInt m_YSamples;
 		/// Array of sample positions within this pixel
 		boost::scoped_array<SqSampleData> m_samples;
+		/// Occluding depth for each sample.
+		boost::scoped_array<TqFloat> m_occlZ;
+		/// Occluding hit for each sample.
+		boost::scoped_array<SqImageSample> m_occludingHits;
+		/// Index into m_hits of the most recent hit for each sample, or -1.
+		boost::scoped_array<TqInt> m_lastHit;
+		/// Semitransparent hits for all samples within the pixel.
+		std::vector<SqImageSample> m_hits;
+		/// Index into m_hits of the previous hit at the same sample, or -1.
+		std::vector<TqInt> m_prevHit;
+		/// CSG nodes referred to by the hits within the pixel.
+		TqCSGNodeTable m_csgNodes;
+		/// Scratch space for the hits at a single sample during Combine().
+		std::vector<SqImageSample> m_combineHits;
 		/// Vector storing sample data for the sample hits within the pixel.
 		std::vector<TqFloat> m_hitSamples;
 		/// A mapping from dof bounding-box index to the sample that contains a
@@ -371,24 +390,9 @@ class CqPixelPool
 inline SqImageSample::SqImageSample()
 	: index(-1),
 	flags(0),
-	csgNode()
+	csgNode(-1)
 { }
 
-inline SqImageSample::SqImageSample(const SqImageSample& from)
-	: index(from.index),
-	flags(from.flags),
-	csgNode(from.csgNode)
-{ }
-
-inline SqImageSample& SqImageSample::operator=(const SqImageSample& from)
-{
-	index = from.index;
-	flags = from.flags;
-	csgNode = from.csgNode;
-
-	return *this;
-}
-
 
 //------------------------------------------------------------------------------
 // SqSampleData implementation
@@ -397,10 +401,7 @@ inline SqSampleData::SqSampleData()
 	dofOffset(),
 	occlusionIndex(0),
 	time(0),
-	detailLevel(0),
-	data(),
-	occludingHit(),
-	occlZ(FLT_MAX)
+	detailLevel(0)
 { }
 
 
@@ -440,16 +441,43 @@ inline TqInt CqImagePixel::refCount() const
 	return m_refCount;
 }
 
-inline std::vector<SqImageSample>& CqImagePixel::Values( TqInt index )
+inline SqImageSample& CqImagePixel::addHit( TqInt index )
+{
+	assert(index < numSamples());
+	// Hits for each sample are chained together through m_prevHit, so that
+	// adding a hit never needs more than amortised constant time, and no
+	// per-sample allocations are made.
+	m_prevHit.push_back(m_lastHit[index]);
+	m_lastHit[index] = m_hits.size();
+	m_hits.push_back(SqImageSample());
+	SqImageSample& hit = m_hits.back();
+	allocateHitData(hit);
+	return hit;
+}
+
+inline TqInt CqImagePixel::csgNodeIndex( const boost::shared_ptr<CqCSGTreeNode>& node )
 {
-    assert(index < numSamples());
-	return m_samples[index].data;
+	if(!node)
+		return -1;
+	return CqCSGTreeNode::nodeIndex(m_csgNodes, node);
 }
 
 inline SqImageSample& CqImagePixel::occludingHit( TqInt index )
 {
 	assert(index < numSamples());
-	return m_samples[index].occludingHit;
+	return m_occludingHits[index];
+}
+
+inline TqFloat CqImagePixel::occlZ( TqInt index ) const
+{
+	assert(index < numSamples());
+	return m_occlZ[index];
+}
+
+inline TqFloat& CqImagePixel::occlZ( TqInt index )
+{
+	assert(index < numSamples());
+	return m_occlZ[index];
 }
 
 inline const TqFloat* CqImagePixel::sampleHitData(const SqImageSample& hit) const
@@ -65,14 +65,15 @@ CqLightsource::~CqLightsource()
 void CqLightsource::Initialise( TqInt uGridRes, TqInt vGridRes, TqInt microPolygonCount, TqInt shadingPointCount, bool hasValidDerivatives )
 {
 	TqInt Uses = gDefLightUses;
-	if ( m_pShader )
+	boost::shared_ptr<IqShader> shader = pShader();
+	if ( shader )
 	{
-		Uses |= m_pShader->Uses();
-		m_pShaderExecEnv->Initialise( uGridRes, vGridRes, microPolygonCount, shadingPointCount, hasValidDerivatives, m_pAttributes, boost::shared_ptr<IqTransform>(), m_pShader.get(), Uses );
+		Uses |= shader->Uses();
+		env()->Initialise( uGridRes, vGridRes, microPolygonCount, shadingPointCount, hasValidDerivatives, m_pAttributes, boost::shared_ptr<IqTransform>(), shader.get(), Uses );
 	}
 
-	if ( m_pShader )
-		m_pShader->Initialise( uGridRes, vGridRes, shadingPointCount, m_pShaderExecEnv.get() );
+	if ( shader )
+		shader->Initialise( uGridRes, vGridRes, shadingPointCount, env() );
 
 	if ( USES( Uses, EnvVars_L ) )
 		L() ->Initialise( shadingPointCount );
@@ -83,7 +84,7 @@ void CqLightsource::Initialise( TqInt uGridRes, TqInt vGridRes, TqInt microPolyg
 	if ( USES( Uses, EnvVars_P ) )
 	{
 		CqMatrix mat;
-		QGetRenderContext() ->matSpaceToSpace( "shader", "current", m_pShader->getTransform(), NULL, QGetRenderContextI()->Time(), mat );
+		QGetRenderContext() ->matSpaceToSpace( "shader", "current", shader->getTransform(), NULL, QGetRenderContextI()->Time(), mat );
 		P() ->SetPoint( mat * CqVector3D( 0.0f, 0.0f, 0.0f ) );
 	}
 	if ( USES( Uses, EnvVars_u ) )
@@ -44,6 +44,7 @@
 #include <aqsis/version.h>
 #include <aqsis/core/ilightsource.h>
 #include "attributes.h"
+#include "shadingstate.h"
 #include "transform.h"
 
 namespace Aqsis {
@@ -75,7 +76,7 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		 */
 		virtual boost::shared_ptr<IqShader>	pShader() const
 		{
-			return ( m_pShader );
+			return ( CqShadingState::shader(m_pShader) );
 		}
 		/** Initialise the shader execution environment.
 		 * \param uGridRes Integer grid size, not used.
@@ -90,8 +91,8 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		{
 			Ps() ->SetValueFromVariable( pPs );
 			Ns() ->SetValueFromVariable( pNs );
-			m_pShaderExecEnv->SetCurrentSurface(pSurface);
-			m_pShader->Evaluate( m_pShaderExecEnv.get() );
+			env()->SetCurrentSurface(pSurface);
+			pShader()->Evaluate( env() );
 		}
 		/** Get a pointer to the attributes state associated with this GPrim.
 		 * \return A pointer to a CqAttributes class.
@@ -111,156 +112,132 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		// Redirect acces via IqShaderExecEnv
 		virtual	TqInt	uGridRes() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->uGridRes() );
+			return ( env()->uGridRes() );
 		}
 		virtual	TqInt	vGridRes() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->vGridRes() );
+			return ( env()->vGridRes() );
 		}
 		virtual	TqInt	microPolygonCount() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->microPolygonCount() );
+			return ( env()->microPolygonCount() );
 		}
 		virtual	TqInt	shadingPointCount() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->shadingPointCount() );
+			return ( env()->shadingPointCount() );
 		}
 /*		virtual	const CqMatrix&	matObjectToWorld() const
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->matObjectToWorld() );
+			return ( env()->matObjectToWorld() );
 		}*/
 		virtual	IqShaderData* Cs()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Cs() );
+			return ( env()->Cs() );
 		}
 		virtual	IqShaderData* Os()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Os() );
+			return ( env()->Os() );
 		}
 		virtual	IqShaderData* Ng()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ng() );
+			return ( env()->Ng() );
 		}
 		virtual	IqShaderData* du()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->du() );
+			return ( env()->du() );
 		}
 		virtual	IqShaderData* dv()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dv() );
+			return ( env()->dv() );
 		}
 		virtual	IqShaderData* L()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->L() );
+			return ( env()->L() );
 		}
 		virtual	IqShaderData* Cl()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Cl() );
+			return ( env()->Cl() );
 		}
 		virtual IqShaderData* Ol()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ol() );
+			return ( env()->Ol() );
 		}
 		virtual IqShaderData* P()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->P() );
+			return ( env()->P() );
 		}
 		virtual IqShaderData* dPdu()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dPdu() );
+			return ( env()->dPdu() );
 		}
 		virtual IqShaderData* dPdv()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->dPdv() );
+			return ( env()->dPdv() );
 		}
 		virtual IqShaderData* N()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->N() );
+			return ( env()->N() );
 		}
 		virtual IqShaderData* u()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->u() );
+			return ( env()->u() );
 		}
 		virtual IqShaderData* v()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->v() );
+			return ( env()->v() );
 		}
 		virtual IqShaderData* s()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->s() );
+			return ( env()->s() );
 		}
 		virtual IqShaderData* t()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->t() );
+			return ( env()->t() );
 		}
 		virtual IqShaderData* I()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->I() );
+			return ( env()->I() );
 		}
 		virtual IqShaderData* Ci()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ci() );
+			return ( env()->Ci() );
 		}
 		virtual IqShaderData* Oi()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Oi() );
+			return ( env()->Oi() );
 		}
 		virtual IqShaderData* Ps()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ps() );
+			return ( env()->Ps() );
 		}
 		virtual IqShaderData* E()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->E() );
+			return ( env()->E() );
 		}
 		virtual IqShaderData* ncomps()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->ncomps() );
+			return ( env()->ncomps() );
 		}
 		virtual IqShaderData* time()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->time() );
+			return ( env()->time() );
 		}
 		virtual IqShaderData* alpha()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->alpha() );
+			return ( env()->alpha() );
 		}
 		virtual IqShaderData* Ns()
 		{
-			assert( m_pShaderExecEnv );
-			return ( m_pShaderExecEnv->Ns() );
+			return ( env()->Ns() );
 		}
 
 	private:
+		/// Get the execution environment for the calling thread.
+		IqShaderExecEnv* env() const
+		{
+			return ( CqShadingState::lightEnv( this, m_pShaderExecEnv.get() ) );
+		}
+
 		boost::shared_ptr<IqShader>	m_pShader;				///< Pointer to the associated shader.
 		CqAttributesPtr	m_pAttributes;			///< Pointer to the associated attributes.
 		CqTransformPtr m_pTransform;		///< Pointer to the transformation state associated with this GPrim.
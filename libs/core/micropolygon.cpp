@@ -40,8 +40,8 @@
 namespace Aqsis {
 
 
-CqObjectPool<CqMicroPolygon> CqMicroPolygon::m_thePool;
-CqObjectPool<CqMovingMicroPolygonKey>	CqMovingMicroPolygonKey::m_thePool;
+CqThreadLocalObjectPool<CqMicroPolygon> CqMicroPolygon::m_thePool;
+CqThreadLocalObjectPool<CqMovingMicroPolygonKey>	CqMovingMicroPolygonKey::m_thePool;
 
 void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>& surface)
 {
@@ -73,6 +73,7 @@ void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>
 CqMicroPolyGrid::CqMicroPolyGrid() : CqMicroPolyGridBase(),
 		m_bShadingNormals( false ),
 		m_bGeometricNormals( false ), 
+		m_backfaceCulledCount( 0 ),
 		m_pShaderExecEnv(IqShaderExecEnv::create(QGetRenderContextI()))
 {
 	STATS_INC( GRD_allocated );
@@ -458,16 +459,15 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 			if ( ( ( s * pNg[ i ] ) * pP[ i ] ) >= 0 )
 			{
 				cCulled++;
-				STATS_INC( MPG_culled );
 				m_CulledPolys.SetValue( i, true );
 			}
 		}
+		m_backfaceCulledCount = cCulled;
 
 		// If the whole grid is culled don't bother going any further.
 		if ( canCullGrid && cCulled == gs )
 		{
 			m_fCulled = true;
-			STATS_INC( GRD_culled );
 			DeleteVariables( true );
 			return ;
 		}
@@ -515,15 +515,25 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 		if ( canCullGrid && cCulled == gs )
 		{
 			m_fCulled = true;
-			STATS_INC( GRD_culled );
 			DeleteVariables( true );
 			return ;
 		}
 	}
 	DeleteVariables( false );
+}
 
-	STATS_INC( GRD_shd_size_4 + clamp<TqInt>( CqStats::stats_log2(
-					m_pShaderExecEnv->shadingPointCount() ) - 2, 0, 7 ) );
+//---------------------------------------------------------------------
+/** Add the counts gathered by Shade() to the global statistics.
+ */
+
+void CqMicroPolyGrid::recordShadingStats() const
+{
+	STATS_SETI( MPG_culled, STATS_GETI( MPG_culled ) + m_backfaceCulledCount );
+	if ( m_fCulled )
+		STATS_INC( GRD_culled );
+	else
+		STATS_INC( GRD_shd_size_4 + clamp<TqInt>( CqStats::stats_log2(
+						m_pShaderExecEnv->shadingPointCount() ) - 2, 0, 7 ) );
 }
 
 //---------------------------------------------------------------------
@@ -836,19 +846,19 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 
 			if ( tTime > 1 )
 			{
-				boost::shared_ptr<CqMicroPolygonMotion> pNew(new CqMicroPolygonMotion(this, iIndex));
+				CqMicroPolygonMotion* pNew = new CqMicroPolygonMotion(this, iIndex);
+				CqMicroPolygonPtr pTemp(pNew);
 				if ( fTrimmed )
 					pNew->MarkTrimmed();
 				std::map<TqFloat, TqInt>::iterator keyFrame;
 				for ( keyFrame = keyframeTimes.begin(); keyFrame!=keyframeTimes.end(); keyFrame++ )
 					pNew->AppendKey( aaPtimes[ keyFrame->second ][ iIndex ], aaPtimes[ keyFrame->second ][ iIndex + 1 ], aaPtimes[ keyFrame->second ][ iIndex + cu + 1 ], aaPtimes[ keyFrame->second ][ iIndex + cu + 2 ],  keyFrame->first);
 				pNew->Initialise();
-				boost::shared_ptr<CqMicroPolygon> pTemp(pNew);
 				QGetRenderContext()->pImage()->AddMPG( pTemp );
 			}
 			else
 			{
-				boost::shared_ptr<CqMicroPolygon> pNew(new CqMicroPolygon(this, iIndex));
+				CqMicroPolygonPtr pNew(new CqMicroPolygon(this, iIndex));
 				if ( fTrimmed )
 					pNew->MarkTrimmed();
 				pNew->Initialise();
@@ -935,6 +945,16 @@ void CqMotionMicroPolyGrid::TransferOutputVariables()
 }
 
 
+//---------------------------------------------------------------------
+/** Record the shading statistics of the primary grid.
+ */
+
+void CqMotionMicroPolyGrid::recordShadingStats() const
+{
+	static_cast<CqMicroPolyGrid*>( GetMotionObject( Time( 0 ) ) )->recordShadingStats();
+}
+
+
 //---------------------------------------------------------------------
 /** Split the micropolygrid into individual MPGs,
  * \param xmin Integer minimum extend of the image part being rendered, takes into account buckets and clipping.
@@ -1132,11 +1152,11 @@ void CqMotionMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 					fTrimmed = true;
 			}
 
-			boost::shared_ptr<CqMicroPolygonMotion> pNew( new CqMicroPolygonMotion( this, iIndex ) );
+			CqMicroPolygonMotion* pNew = new CqMicroPolygonMotion( this, iIndex );
+			CqMicroPolygonPtr pTemp( pNew );
 			for ( iTime = 0; iTime < cTimes(); iTime++ )
 				pNew->AppendKey( aaPtimes[ iTime ][ iIndex ], aaPtimes[ iTime ][ iIndex + 1 ], aaPtimes[ iTime ][ iIndex + cu + 1 ], aaPtimes[ iTime ][ iIndex + cu + 2 ], Time( iTime ) );
 			pNew->Initialise();
-			boost::shared_ptr<CqMicroPolygon> pTemp( pNew );
 			QGetRenderContext()->pImage()->AddMPG( pTemp );
 		}
 	}
@@ -1160,7 +1180,7 @@ void CqMotionMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 /** Default constructor
  */
 
-CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGrid( pGrid ), m_Index(Index), m_Flags( 0 )
+CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGrid( pGrid ), m_Index(Index), m_Flags( 0 ), m_refCount( 0 )
 {
 	STATS_INC( MPG_allocated );
 	STATS_INC( MPG_current );
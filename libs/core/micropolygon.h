@@ -29,6 +29,8 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<boost/smart_ptr/detail/atomic_count.hpp>
+#include	<boost/intrusive_ptr.hpp>
 #include	<boost/utility.hpp>
 
 #include	"bilinear.h"
@@ -117,6 +119,13 @@ class CqMicroPolyGridBase : public CqRefCount
 		 */
 		virtual	void	Shade(bool canCullGrid = true ) = 0;
 		virtual	void	TransferOutputVariables() = 0;
+		/** Pure virtual, add the counts gathered by Shade() to the global
+		 * statistics.
+		 *
+		 * Grids are shaded concurrently, so Shade() only counts into the
+		 * grid; this is called afterwards under the pipeline lock.
+		 */
+		virtual void	recordShadingStats() const = 0;
 		/*
 		 * Delete all the variables per grid 
 		 */
@@ -291,6 +300,7 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
 		virtual	void	Shade( bool canCullGrid = true );
 		virtual	void	TransferOutputVariables();
+		virtual void	recordShadingStats() const;
 
 		/** Get a pointer to the surface which this grid belongs.
 		 * \return Surface pointer, only valid during shading.
@@ -385,6 +395,7 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		boost::shared_ptr<CqSurface> m_pSurface;	///< Pointer to the surface for this grid.
 		boost::shared_ptr<CqCSGTreeNode> m_pCSGNode;	///< Pointer to the CSG tree node this grid belongs to, NULL if not part of a solid.
 		CqBitVector	m_CulledPolys;		///< Bitvector indicating whether the individual micro polygons are culled.
+		TqInt	m_backfaceCulledCount;	///< Number of micro polygons backface culled by Shade().
 		std::vector<IqShaderData*>	m_apShaderOutputVariables;	///< Vector of pointers to shader output variables.
 	protected:
 		boost::shared_ptr<IqShaderExecEnv> m_pShaderExecEnv;	///< Pointer to the shader execution environment for this grid.
@@ -410,6 +421,7 @@ class CqMotionMicroPolyGrid : public CqMicroPolyGridBase, public CqMotionSpec<Cq
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
 		virtual	void	Shade( bool canCullGrid = true );
 		virtual	void	TransferOutputVariables();
+		virtual void	recordShadingStats() const;
 		
 		/**
 		* \todo Review: Unused parameter all
@@ -812,10 +824,35 @@ class CqMicroPolygon : boost::noncopyable
 		void cachePointInPolyTest(CqHitTestCache& cache, CqVector3D* points) const;
 
 	private:
-		static	CqObjectPool<CqMicroPolygon> m_thePool;
+		/// boost::intrusive_ptr required function, to increment the reference count.
+		friend void intrusive_ptr_add_ref(CqMicroPolygon* p);
+		/// boost::intrusive_ptr required function, to decrement the reference
+		/// count and delete if necessary.
+		friend void intrusive_ptr_release(CqMicroPolygon* p);
+
+		/// Reference count for boost::intrusive_ptr.  Micropolygons are shared
+		/// between all the buckets they touch, which may be processed by
+		/// different threads.
+		boost::detail::atomic_count m_refCount;
+
+		static	CqThreadLocalObjectPool<CqMicroPolygon> m_thePool;
 }
 ;
 
+/// Intrusive reference counted pointer to a micropolygon.
+typedef boost::intrusive_ptr<CqMicroPolygon> CqMicroPolygonPtr;
+
+inline void intrusive_ptr_add_ref(CqMicroPolygon* p)
+{
+	++(p->m_refCount);
+}
+
+inline void intrusive_ptr_release(CqMicroPolygon* p)
+{
+	if(--(p->m_refCount) == 0)
+		delete p;
+}
+
 
 
 //----------------------------------------------------------------------
@@ -863,7 +900,7 @@ class CqMovingMicroPolygonKey
 		CqBound m_Bound;
 		bool	m_BoundReady;
 
-		static	CqObjectPool<CqMovingMicroPolygonKey>	m_thePool;
+		static	CqThreadLocalObjectPool<CqMovingMicroPolygonKey>	m_thePool;
 }
 ;
 
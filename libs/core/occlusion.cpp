@@ -111,6 +111,10 @@ void CqOcclusionTree::setSampleDepth(TqFloat depth, TqInt index)
 {
 	assert(m_depthTree[index] >= depth);
 	m_depthTree[index] = depth;
+}
+
+void CqOcclusionTree::markChanged()
+{
 	m_needsUpdate = true;
 }
 
@@ -104,18 +104,23 @@ class CqOcclusionTree
 		/** \brief Update the occlusion tree depth at the leaf node index.
 		 *
 		 * If the depth is smaller than the current depth at the given leaf
-		 * node index, the depth is stored in the tree.
+		 * node index, the depth is stored in the tree.  Disjoint leaves may
+		 * be set concurrently, so this doesn't record that the tree changed;
+		 * the caller calls markChanged() once it's done.
 		 *
 		 * \param depth - new depth for the leaf node
 		 * \param index - index of the leaf node.
 		 */
 		void setSampleDepth(TqFloat depth, TqInt index);
 
+		/// Record that setSampleDepth() may have changed the leaf nodes.
+		void markChanged();
+
 		/** \brief Update the occlusion tree if necessary.
 		 *
 		 * Depths are propagated from the leaf nodes down to the the root if
-		 * setSampleDepth() actually changed the tree since the last time
-		 * updateTree() was called.
+		 * markChanged() was called since the last time updateTree() was
+		 * called.
 		 */
 		void updateTree();
 
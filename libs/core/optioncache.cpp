@@ -40,6 +40,7 @@ SqOptionCache::SqOptionCache()
 	xBucketSize(16),
 	yBucketSize(16),
 	maxEyeSplits(1),
+	rereadArchives(false),
 	displayMode(DMode_None),
 	depthFilter(Filter_Min),
 	zThreshold()
@@ -86,6 +87,10 @@ void SqOptionCache::cacheOptions(const IqOptions& opts)
 	maxEyeSplits = 10;
 	if(const TqInt* splits = opts.GetIntegerOption("limits", "eyesplits"))
 		maxEyeSplits = splits[0];
+	// Row by row expansion of delayed archives
+	rereadArchives = false;
+	if(const TqInt* reread = opts.GetIntegerOption("limits", "rereadarchives"))
+		rereadArchives = reread[0] != 0;
 
 	// Display mode.
 	const TqInt* dMode = opts.GetIntegerOption("System", "DisplayMode");
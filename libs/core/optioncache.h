@@ -62,6 +62,7 @@ struct SqOptionCache
 	TqInt xBucketSize;  ///< Bucket size in the x-direction
 	TqInt yBucketSize;  ///< Bucket size in the y-direction
 	TqInt maxEyeSplits; ///< Maximum allowed number of eye splits
+	bool rereadArchives; ///< Expand delayed archives one bucket row at a time
 
 	EqDisplayMode displayMode; ///< Type of the connected displays
 
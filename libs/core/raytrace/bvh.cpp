@@ -0,0 +1,434 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Bounding volume hierarchy over triangles, for ray queries.
+ */
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace Aqsis {
+
+namespace {
+
+/// Number of bins used to evaluate candidate splits along each axis.
+const TqInt numBins = 16;
+/// Nodes with this many triangles or fewer are always leaves.
+const TqInt minLeafSize = 4;
+/// Nodes with more triangles than this are always split.
+const TqInt maxLeafSize = 16;
+/// Depth beyond which nodes are split at the median rather than by the SAH,
+/// which bounds the depth of pathological trees.
+const TqInt maxSahDepth = 64;
+/// Depth of the traversal stack; the tree can't be deeper than this.
+const TqInt maxStackDepth = maxSahDepth + 64;
+
+/// Axis aligned box used during the build.
+struct SqBox
+{
+	TqFloat min[3];
+	TqFloat max[3];
+
+	SqBox()
+	{
+		for(TqInt i = 0; i < 3; ++i)
+		{
+			min[i] = FLT_MAX;
+			max[i] = -FLT_MAX;
+		}
+	}
+	void extend(const TqFloat p[3])
+	{
+		for(TqInt i = 0; i < 3; ++i)
+		{
+			min[i] = std::min(min[i], p[i]);
+			max[i] = std::max(max[i], p[i]);
+		}
+	}
+	void extend(const SqBox& b)
+	{
+		for(TqInt i = 0; i < 3; ++i)
+		{
+			min[i] = std::min(min[i], b.min[i]);
+			max[i] = std::max(max[i], b.max[i]);
+		}
+	}
+	/// Half the surface area, which is all the SAH needs.
+	TqFloat halfArea() const
+	{
+		if(min[0] > max[0])
+			return 0;
+		TqFloat dx = max[0] - min[0];
+		TqFloat dy = max[1] - min[1];
+		TqFloat dz = max[2] - min[2];
+		return dx*dy + dy*dz + dz*dx;
+	}
+};
+
+} // anon namespace
+
+
+/// Per-triangle data needed only while building.
+struct CqBvh::SqBuildPrim
+{
+	SqBox bound;
+	TqFloat centroid[3];
+	TqInt triangle;
+};
+
+/// Order build primitives by centroid along an axis.
+struct CqBvh::SqCentroidLess
+{
+	TqInt axis;
+	SqCentroidLess(TqInt axis) : axis(axis) {}
+	bool operator()(const SqBuildPrim& a, const SqBuildPrim& b) const
+	{
+		return a.centroid[axis] < b.centroid[axis];
+	}
+};
+
+
+CqBvh::CqBvh()
+	: m_nodes(),
+	m_triangles()
+{ }
+
+void CqBvh::addTriangle(const CqVector3D& a, const CqVector3D& b,
+		const CqVector3D& c)
+{
+	SqTriangle tri;
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		tri.v0[i] = a[i];
+		tri.e1[i] = b[i] - a[i];
+		tri.e2[i] = c[i] - a[i];
+	}
+	tri.index = m_triangles.size();
+	m_triangles.push_back(tri);
+}
+
+void CqBvh::clear()
+{
+	std::vector<SqNode>().swap(m_nodes);
+	std::vector<SqTriangle>().swap(m_triangles);
+}
+
+void CqBvh::build()
+{
+	m_nodes.clear();
+	if(m_triangles.empty())
+		return;
+	TqInt numTris = m_triangles.size();
+	std::vector<SqBuildPrim> prims(numTris);
+	for(TqInt i = 0; i < numTris; ++i)
+	{
+		const SqTriangle& tri = m_triangles[i];
+		SqBuildPrim& prim = prims[i];
+		TqFloat v1[3], v2[3];
+		for(TqInt j = 0; j < 3; ++j)
+		{
+			v1[j] = tri.v0[j] + tri.e1[j];
+			v2[j] = tri.v0[j] + tri.e2[j];
+		}
+		prim.bound.extend(tri.v0);
+		prim.bound.extend(v1);
+		prim.bound.extend(v2);
+		for(TqInt j = 0; j < 3; ++j)
+			prim.centroid[j] = 0.5f*(prim.bound.min[j] + prim.bound.max[j]);
+		prim.triangle = i;
+	}
+	// A binary tree with at most minLeafSize triangles per leaf has fewer
+	// than 2*numTris/minLeafSize nodes in practice; reserve to avoid copies.
+	m_nodes.reserve(2*numTris/minLeafSize + 1);
+	std::vector<SqTriangle> orderedTris;
+	orderedTris.reserve(numTris);
+	buildRecursive(prims, 0, numTris, 0, orderedTris);
+	// Store the triangles in leaf order, so each leaf is contiguous.
+	m_triangles.swap(orderedTris);
+}
+
+TqInt CqBvh::buildRecursive(std::vector<SqBuildPrim>& prims, TqInt begin,
+		TqInt end, TqInt depth, std::vector<SqTriangle>& orderedTris)
+{
+	TqInt nodeIndex = m_nodes.size();
+	m_nodes.push_back(SqNode());
+
+	SqBox bound;
+	SqBox centroidBound;
+	for(TqInt i = begin; i < end; ++i)
+	{
+		bound.extend(prims[i].bound);
+		centroidBound.extend(prims[i].centroid);
+	}
+	TqInt count = end - begin;
+
+	// Find the best binned SAH split over all three axes.
+	TqInt bestAxis = -1;
+	TqInt bestBin = 0;
+	TqFloat bestCost = FLT_MAX;
+	if(count > minLeafSize && depth < maxSahDepth)
+	{
+		for(TqInt axis = 0; axis < 3; ++axis)
+		{
+			TqFloat extent = centroidBound.max[axis] - centroidBound.min[axis];
+			if(extent <= 0)
+				continue;
+			TqFloat binScale = numBins / extent;
+			SqBox binBounds[numBins];
+			TqInt binCounts[numBins] = {0};
+			for(TqInt i = begin; i < end; ++i)
+			{
+				TqInt b = std::min(numBins - 1, static_cast<TqInt>(
+					(prims[i].centroid[axis] - centroidBound.min[axis])*binScale));
+				++binCounts[b];
+				binBounds[b].extend(prims[i].bound);
+			}
+			// Sweep from the right to find the cost of each right side.
+			TqFloat rightCost[numBins];
+			SqBox rightBound;
+			TqInt rightCount = 0;
+			for(TqInt b = numBins - 1; b > 0; --b)
+			{
+				rightBound.extend(binBounds[b]);
+				rightCount += binCounts[b];
+				rightCost[b] = rightBound.halfArea()*rightCount;
+			}
+			// Then sweep from the left, splitting before bin b.
+			SqBox leftBound;
+			TqInt leftCount = 0;
+			for(TqInt b = 1; b < numBins; ++b)
+			{
+				leftBound.extend(binBounds[b-1]);
+				leftCount += binCounts[b-1];
+				if(leftCount == 0 || leftCount == count)
+					continue;
+				TqFloat cost = leftBound.halfArea()*leftCount + rightCost[b];
+				if(cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	TqInt mid = begin;
+	if(bestAxis >= 0)
+	{
+		// Compare against the cost of intersecting every triangle here,
+		// taking the cost of a box test to be one triangle test.
+		TqFloat area = bound.halfArea();
+		TqFloat splitCost = area > 0 ? 1 + bestCost/area : FLT_MAX;
+		if(splitCost < count || count > maxLeafSize)
+		{
+			TqFloat binScale = numBins / (centroidBound.max[bestAxis]
+					- centroidBound.min[bestAxis]);
+			for(TqInt i = begin; i < end; ++i)
+			{
+				TqInt b = std::min(numBins - 1, static_cast<TqInt>(
+					(prims[i].centroid[bestAxis]
+					 - centroidBound.min[bestAxis])*binScale));
+				if(b < bestBin)
+					std::swap(prims[i], prims[mid++]);
+			}
+		}
+	}
+	else if(count > maxLeafSize)
+	{
+		// Either the tree is already very deep, or all centroids coincide.
+		// Split at the median along the longest axis to keep the depth and
+		// the leaf sizes bounded.
+		bestAxis = 0;
+		for(TqInt axis = 1; axis < 3; ++axis)
+		{
+			if(centroidBound.max[axis] - centroidBound.min[axis] >
+				centroidBound.max[bestAxis] - centroidBound.min[bestAxis])
+				bestAxis = axis;
+		}
+		mid = begin + count/2;
+		std::nth_element(prims.begin() + begin, prims.begin() + mid,
+				prims.begin() + end, SqCentroidLess(bestAxis));
+	}
+
+	SqNode& node = m_nodes[nodeIndex];
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		node.boundMin[i] = bound.min[i];
+		node.boundMax[i] = bound.max[i];
+	}
+	if(mid == begin || mid == end)
+	{
+		// Leaf node
+		node.offset = orderedTris.size();
+		node.numTriangles = count;
+		node.axis = 0;
+		for(TqInt i = begin; i < end; ++i)
+			orderedTris.push_back(m_triangles[prims[i].triangle]);
+	}
+	else
+	{
+		node.numTriangles = 0;
+		node.axis = bestAxis;
+		// The first child immediately follows this node.  Note that the
+		// recursion may reallocate m_nodes, so node can't be used after it.
+		buildRecursive(prims, begin, mid, depth+1, orderedTris);
+		TqInt secondChild = buildRecursive(prims, mid, end, depth+1, orderedTris);
+		m_nodes[nodeIndex].offset = secondChild;
+	}
+	return nodeIndex;
+}
+
+bool CqBvh::intersect(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat maxDist, SqBvhHit& hit) const
+{
+	return traverse<false>(origin, direction, maxDist, hit);
+}
+
+bool CqBvh::occluded(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat maxDist) const
+{
+	SqBvhHit hit;
+	return traverse<true>(origin, direction, maxDist, hit);
+}
+
+template<bool anyHit>
+bool CqBvh::traverse(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat maxDist, SqBvhHit& hit) const
+{
+	if(m_nodes.empty())
+		return false;
+
+	TqFloat o[3] = {origin.x(), origin.y(), origin.z()};
+	TqFloat d[3] = {direction.x(), direction.y(), direction.z()};
+	TqFloat invDir[3];
+	bool dirIsNeg[3];
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		invDir[i] = d[i] != 0 ? 1/d[i] : FLT_MAX;
+		dirIsNeg[i] = invDir[i] < 0;
+	}
+
+	TqFloat tMax = maxDist;
+	const SqTriangle* hitTri = 0;
+	TqFloat hitU = 0;
+	TqFloat hitV = 0;
+	TqInt stack[maxStackDepth];
+	TqInt stackSize = 0;
+	TqInt nodeIndex = 0;
+	while(true)
+	{
+		const SqNode& node = m_nodes[nodeIndex];
+		// Slab test against the node bound.
+		TqFloat t0 = 0;
+		TqFloat t1 = tMax;
+		for(TqInt i = 0; i < 3 && t0 <= t1; ++i)
+		{
+			TqFloat tNear = (node.boundMin[i] - o[i])*invDir[i];
+			TqFloat tFar = (node.boundMax[i] - o[i])*invDir[i];
+			if(dirIsNeg[i])
+				std::swap(tNear, tFar);
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+		}
+		if(t0 <= t1)
+		{
+			if(node.numTriangles > 0)
+			{
+				const SqTriangle* tri = &m_triangles[node.offset];
+				const SqTriangle* triEnd = tri + node.numTriangles;
+				for(; tri != triEnd; ++tri)
+				{
+					// Moller-Trumbore ray/triangle test
+					TqFloat p[3] = {
+						d[1]*tri->e2[2] - d[2]*tri->e2[1],
+						d[2]*tri->e2[0] - d[0]*tri->e2[2],
+						d[0]*tri->e2[1] - d[1]*tri->e2[0]
+					};
+					TqFloat det = tri->e1[0]*p[0] + tri->e1[1]*p[1] + tri->e1[2]*p[2];
+					if(det == 0)
+						continue;
+					TqFloat invDet = 1/det;
+					TqFloat s[3] = {o[0] - tri->v0[0], o[1] - tri->v0[1], o[2] - tri->v0[2]};
+					TqFloat u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*invDet;
+					if(u < 0 || u > 1)
+						continue;
+					TqFloat q[3] = {
+						s[1]*tri->e1[2] - s[2]*tri->e1[1],
+						s[2]*tri->e1[0] - s[0]*tri->e1[2],
+						s[0]*tri->e1[1] - s[1]*tri->e1[0]
+					};
+					TqFloat v = (d[0]*q[0] + d[1]*q[1] + d[2]*q[2])*invDet;
+					if(v < 0 || u + v > 1)
+						continue;
+					TqFloat t = (tri->e2[0]*q[0] + tri->e2[1]*q[1] + tri->e2[2]*q[2])*invDet;
+					if(t <= 0 || t >= tMax)
+						continue;
+					if(anyHit)
+						return true;
+					tMax = t;
+					hitTri = tri;
+					hitU = u;
+					hitV = v;
+				}
+				if(stackSize == 0)
+					break;
+				nodeIndex = stack[--stackSize];
+			}
+			else
+			{
+				// Visit the near child first.
+				assert(stackSize < maxStackDepth);
+				if(dirIsNeg[node.axis])
+				{
+					stack[stackSize++] = nodeIndex + 1;
+					nodeIndex = node.offset;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					nodeIndex = nodeIndex + 1;
+				}
+			}
+		}
+		else
+		{
+			if(stackSize == 0)
+				break;
+			nodeIndex = stack[--stackSize];
+		}
+	}
+
+	if(!hitTri)
+		return false;
+	hit.distance = tMax;
+	hit.triangle = hitTri->index;
+	hit.normal = CqVector3D(hitTri->e1[0], hitTri->e1[1], hitTri->e1[2])
+		% CqVector3D(hitTri->e2[0], hitTri->e2[1], hitTri->e2[2]);
+	hit.normal.Unit();
+	hit.u = hitU;
+	hit.v = hitV;
+	return true;
+}
+
+} // namespace Aqsis
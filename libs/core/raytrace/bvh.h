@@ -0,0 +1,148 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Bounding volume hierarchy over triangles, for ray queries.
+ */
+
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <aqsis/math/vector3d.h>
+
+namespace Aqsis {
+
+/// Nearest intersection of a ray with the triangles held in a CqBvh.
+struct SqBvhHit
+{
+	/// Distance along the ray to the hit point.
+	TqFloat distance;
+	/// Index of the triangle hit, in the order the triangles were added.
+	TqInt triangle;
+	/// Normalised geometric normal of the triangle hit.
+	CqVector3D normal;
+	/// Barycentric coordinates of the hit point: it lies at
+	/// (1-u-v)*a + u*b + v*c for the triangle vertices a, b and c.
+	TqFloat u;
+	TqFloat v;
+};
+
+//------------------------------------------------------------------------------
+/** \brief Bounding volume hierarchy over a set of triangles.
+ *
+ * The tree is built top-down using the surface area heuristic, with the
+ * candidate splits evaluated over a fixed number of bins along each axis.
+ * Nodes are stored flattened in depth first order, so the first child of a
+ * node immediately follows it in memory and only the second child needs an
+ * explicit index.
+ *
+ * Once built, the hierarchy is immutable and may be queried concurrently
+ * from several threads.
+ */
+class CqBvh
+{
+	public:
+		CqBvh();
+
+		/** \brief Add a triangle to the set to be built into the tree.
+		 *
+		 * The triangle index reported by queries is the order in which
+		 * triangles were added.
+		 */
+		void addTriangle(const CqVector3D& a, const CqVector3D& b,
+				const CqVector3D& c);
+		/// Build the hierarchy over all added triangles.
+		void build();
+		/// Remove all triangles and nodes.
+		void clear();
+
+		/// Number of triangles in the tree.
+		TqInt numTriangles() const;
+
+		/** \brief Find the nearest intersection of a ray with the triangles.
+		 *
+		 * \param origin - ray origin
+		 * \param direction - ray direction; need not be normalised, in which
+		 *                    case distances are in units of its length.
+		 * \param maxDist - ignore hits further than this along the ray.
+		 * \param hit - filled in with the nearest hit, if any.
+		 * \return true if the ray hit something.
+		 */
+		bool intersect(const CqVector3D& origin, const CqVector3D& direction,
+				TqFloat maxDist, SqBvhHit& hit) const;
+		/** \brief Determine whether a ray hits anything at all.
+		 *
+		 * This is cheaper than intersect() since traversal stops at the
+		 * first hit found.
+		 */
+		bool occluded(const CqVector3D& origin, const CqVector3D& direction,
+				TqFloat maxDist) const;
+
+	private:
+		/// Flattened tree node; 32 bytes.
+		struct SqNode
+		{
+			TqFloat boundMin[3];
+			TqFloat boundMax[3];
+			/// First triangle for leaves; index of the second child otherwise.
+			TqInt offset;
+			/// Number of triangles for leaves, zero for interior nodes.
+			TqUshort numTriangles;
+			/// Split axis of interior nodes.
+			TqUshort axis;
+		};
+		/// Triangle stored as a vertex and two edges for fast intersection.
+		struct SqTriangle
+		{
+			TqFloat v0[3];
+			TqFloat e1[3];
+			TqFloat e2[3];
+			/// Index of the triangle in the order it was added.
+			TqInt index;
+		};
+		struct SqBuildPrim;
+		struct SqCentroidLess;
+
+		TqInt buildRecursive(std::vector<SqBuildPrim>& prims, TqInt begin,
+				TqInt end, TqInt depth, std::vector<SqTriangle>& orderedTris);
+		template<bool anyHit>
+		bool traverse(const CqVector3D& origin, const CqVector3D& direction,
+				TqFloat maxDist, SqBvhHit& hit) const;
+
+		std::vector<SqNode> m_nodes;
+		std::vector<SqTriangle> m_triangles;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline TqInt CqBvh::numTriangles() const
+{
+	return m_triangles.size();
+}
+
+} // namespace Aqsis
+
+#endif // BVH_H_INCLUDED
@@ -0,0 +1,155 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the triangle bounding volume hierarchy.
+ */
+
+#include "bvh.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cfloat>
+#include <cstdlib>
+
+BOOST_AUTO_TEST_SUITE(bvh_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+TqFloat randFloat()
+{
+	return std::rand()/(RAND_MAX + 1.0f);
+}
+
+CqVector3D randPoint(TqFloat scale)
+{
+	return scale*CqVector3D(randFloat() - 0.5f, randFloat() - 0.5f,
+			randFloat() - 0.5f);
+}
+
+// Brute force nearest hit, to compare against the tree.
+bool bruteForceIntersect(const std::vector<CqVector3D>& verts,
+		const CqVector3D& o, const CqVector3D& d, TqFloat& dist, TqInt& tri)
+{
+	CqBvh single;
+	bool hit = false;
+	dist = FLT_MAX;
+	for(TqInt i = 0, n = verts.size()/3; i < n; ++i)
+	{
+		single.clear();
+		single.addTriangle(verts[3*i], verts[3*i+1], verts[3*i+2]);
+		single.build();
+		SqBvhHit h;
+		if(single.intersect(o, d, dist, h))
+		{
+			hit = true;
+			dist = h.distance;
+			tri = i;
+		}
+	}
+	return hit;
+}
+
+} // anon namespace
+
+
+BOOST_AUTO_TEST_CASE(CqBvh_single_triangle)
+{
+	CqBvh bvh;
+	bvh.addTriangle(CqVector3D(0,0,1), CqVector3D(1,0,1), CqVector3D(0,1,1));
+	bvh.build();
+	SqBvhHit hit;
+	BOOST_CHECK(bvh.intersect(CqVector3D(0.2,0.2,0), CqVector3D(0,0,1), FLT_MAX, hit));
+	BOOST_CHECK_CLOSE(hit.distance, 1.0f, 1e-4f);
+	BOOST_CHECK_EQUAL(hit.triangle, 0);
+	BOOST_CHECK_CLOSE(std::fabs(hit.normal.z()), 1.0f, 1e-4f);
+	BOOST_CHECK_CLOSE(hit.u, 0.2f, 1e-3f);
+	BOOST_CHECK_CLOSE(hit.v, 0.2f, 1e-3f);
+	// Misses: outside the triangle, pointing away, and beyond maxDist.
+	BOOST_CHECK(!bvh.intersect(CqVector3D(0.8,0.8,0), CqVector3D(0,0,1), FLT_MAX, hit));
+	BOOST_CHECK(!bvh.intersect(CqVector3D(0.2,0.2,0), CqVector3D(0,0,-1), FLT_MAX, hit));
+	BOOST_CHECK(!bvh.occluded(CqVector3D(0.2,0.2,0), CqVector3D(0,0,1), 0.5f));
+	BOOST_CHECK(bvh.occluded(CqVector3D(0.2,0.2,0), CqVector3D(0,0,1), 1.5f));
+}
+
+BOOST_AUTO_TEST_CASE(CqBvh_empty)
+{
+	CqBvh bvh;
+	bvh.build();
+	SqBvhHit hit;
+	BOOST_CHECK(!bvh.intersect(CqVector3D(0,0,0), CqVector3D(0,0,1), FLT_MAX, hit));
+	BOOST_CHECK(!bvh.occluded(CqVector3D(0,0,0), CqVector3D(0,0,1), FLT_MAX));
+}
+
+BOOST_AUTO_TEST_CASE(CqBvh_matches_brute_force)
+{
+	std::srand(42);
+	std::vector<CqVector3D> verts;
+	CqBvh bvh;
+	const TqInt numTris = 500;
+	for(TqInt i = 0; i < numTris; ++i)
+	{
+		CqVector3D c = randPoint(10);
+		CqVector3D a = c + randPoint(1);
+		CqVector3D b = c + randPoint(1);
+		CqVector3D d = c + randPoint(1);
+		verts.push_back(a);
+		verts.push_back(b);
+		verts.push_back(d);
+		bvh.addTriangle(a, b, d);
+	}
+	bvh.build();
+	BOOST_CHECK_EQUAL(bvh.numTriangles(), numTris);
+
+	for(TqInt i = 0; i < 200; ++i)
+	{
+		CqVector3D o = randPoint(20);
+		CqVector3D d = randPoint(1) - 0.05f*o;
+		TqFloat dist = 0;
+		TqInt tri = -1;
+		bool expectHit = bruteForceIntersect(verts, o, d, dist, tri);
+		SqBvhHit hit;
+		BOOST_CHECK_EQUAL(bvh.intersect(o, d, FLT_MAX, hit), expectHit);
+		BOOST_CHECK_EQUAL(bvh.occluded(o, d, FLT_MAX), expectHit);
+		if(expectHit)
+		{
+			BOOST_CHECK_EQUAL(hit.triangle, tri);
+			BOOST_CHECK_CLOSE(hit.distance, dist, 1e-3f);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqBvh_coincident_triangles)
+{
+	// Many identical triangles can't be separated by the SAH; the build
+	// must still terminate with bounded leaves.
+	CqBvh bvh;
+	for(TqInt i = 0; i < 1000; ++i)
+		bvh.addTriangle(CqVector3D(0,0,1), CqVector3D(1,0,1), CqVector3D(0,1,1));
+	bvh.build();
+	SqBvhHit hit;
+	BOOST_CHECK(bvh.intersect(CqVector3D(0.2,0.2,0), CqVector3D(0,0,1), FLT_MAX, hit));
+	BOOST_CHECK_CLOSE(hit.distance, 1.0f, 1e-4f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
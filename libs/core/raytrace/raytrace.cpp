@@ -26,8 +26,25 @@
 #include	<aqsis/aqsis.h>
 #include	"raytrace.h"
 
+#include	<algorithm>
+#include	<cmath>
+
+#include	<aqsis/util/logging.h>
+#include	"micropolygon.h"
+#include	"points.h"
+#include	"procedural.h"
+#include	"renderer.h"
+#include	"surface.h"
+
 namespace Aqsis {
 
+namespace {
+
+/// Maximum number of times a primitive is split before it's given up on.
+const TqInt maxSplitDepth = 16;
+
+} // anon namespace
+
 
 /// Required function that implements Class Factory design pattern for Raytrace libraries
 IqRaytrace* CreateRaytracer()
@@ -36,14 +53,192 @@ IqRaytrace* CreateRaytracer()
 }
 
 
-void CqRaytrace::Initialise()
+CqRaytrace::CqRaytrace()
+	: m_surfaces(),
+	m_bvh(),
+	m_triVerts(),
+	m_vertexColors(),
+	m_vertexOpacities()
 {}
 
+void CqRaytrace::Initialise()
+{
+	m_surfaces.clear();
+	m_bvh.clear();
+	m_triVerts.clear();
+	m_vertexColors.clear();
+	m_vertexOpacities.clear();
+}
+
 void CqRaytrace::AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface)
-{}
+{
+	boost::shared_ptr<CqSurface> surface
+		= boost::dynamic_pointer_cast<CqSurface>(pSurface);
+	if(!surface || surface->pAttributes()->GetIntegerAttributeDef(
+				"visibility", "trace", 0) == 0)
+		return;
+	// Procedurals would be expanded by the tessellation, with all the side
+	// effects that implies, and points have no area to hit.
+	if(dynamic_cast<CqProcedural*>(surface.get())
+		|| dynamic_cast<CqPoints*>(surface.get()))
+		return;
+	m_surfaces.push_back(surface);
+}
 
 void CqRaytrace::Finalise()
-{}
+{
+	m_bvh.clear();
+	m_triVerts.clear();
+	m_vertexColors.clear();
+	m_vertexOpacities.clear();
+
+	// In multipass mode surfaces are held in world space until the render
+	// starts; see CqRenderer::StorePrimitive().
+	const TqInt* multipass = QGetRenderContext()->GetIntegerOption("Render", "multipass");
+	bool toCamera = multipass && multipass[0];
+
+	for(TqInt i = 0, end = m_surfaces.size(); i < end; ++i)
+	{
+		// Tessellate a copy so that the dice and split state of the
+		// primitive used for rendering is left untouched.
+		boost::shared_ptr<CqSurface> surface(m_surfaces[i]->Clone());
+		if(toCamera)
+		{
+			CqMatrix matWtoC, matNWtoC, matVWtoC;
+			QGetRenderContext()->matSpaceToSpace("world", "camera", NULL, surface->pTransform().get(), 0, matWtoC);
+			QGetRenderContext()->matNSpaceToSpace("world", "camera", NULL, surface->pTransform().get(), 0, matNWtoC);
+			QGetRenderContext()->matVSpaceToSpace("world", "camera", NULL, surface->pTransform().get(), 0, matVWtoC);
+			surface->Transform(matWtoC, matNWtoC, matVWtoC);
+		}
+
+		tessellate(surface, 0);
+	}
+	m_surfaces.clear();
+
+	m_bvh.build();
+	if(m_bvh.numTriangles() > 0)
+		Aqsis::log() << info << "Raytracer built with " << m_bvh.numTriangles()
+			<< " triangles" << std::endl;
+}
+
+bool CqRaytrace::intersect(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat maxDist, SqRayHit& hit) const
+{
+	SqBvhHit bvhHit;
+	if(!m_bvh.intersect(origin, direction, maxDist, bvhHit))
+		return false;
+	// Interpolate the colours at the corners of the triangle hit.
+	const TqInt* verts = &m_triVerts[3*bvhHit.triangle];
+	TqFloat w = 1 - bvhHit.u - bvhHit.v;
+	hit.distance = bvhHit.distance;
+	hit.normal = bvhHit.normal;
+	hit.color = w*m_vertexColors[verts[0]] + bvhHit.u*m_vertexColors[verts[1]]
+		+ bvhHit.v*m_vertexColors[verts[2]];
+	hit.opacity = w*m_vertexOpacities[verts[0]] + bvhHit.u*m_vertexOpacities[verts[1]]
+		+ bvhHit.v*m_vertexOpacities[verts[2]];
+	return true;
+}
+
+bool CqRaytrace::occluded(const CqVector3D& origin, const CqVector3D& direction,
+		TqFloat maxDist) const
+{
+	return m_bvh.occluded(origin, direction, maxDist);
+}
+
+/** \brief Dice or split a camera space primitive into triangles.
+ *
+ * The dicing rate is chosen as for non raster-oriented dicing in
+ * CqBucketProcessor::IsDiceable(), so that surfaces facing away from the
+ * camera are still tessellated finely enough to be hit by rays.  Displacement
+ * shaders aren't run on the grids, so traced geometry is undisplaced.
+ *
+ * Cs and Os are kept at each grid vertex.  They're only diced into the grid
+ * when the primitive's shaders use them; otherwise the values given by
+ * RiColor and RiOpacity are used.
+ */
+void CqRaytrace::tessellate(const boost::shared_ptr<CqSurface>& surface,
+		TqInt depth)
+{
+	if(surface->fDiscard())
+		return;
+
+	CqMatrix diceCoords;
+	QGetRenderContext()->matSpaceToSpace("camera", "raster", NULL, NULL,
+			QGetRenderContextI()->Time(), diceCoords);
+	TqFloat xscale = diceCoords[0][0];
+	TqFloat yscale = diceCoords[1][1];
+	if(QGetRenderContext()->GetIntegerOption("System", "Projection")[0]
+			== ProjectionPerspective)
+	{
+		// Surfaces behind the camera are diced as if at the near clipping
+		// plane, since rays may still hit them.
+		CqBound bound;
+		surface->Bound(&bound);
+		TqFloat midz = 0.5f*(bound.vecMin().z() + bound.vecMax().z());
+		midz = std::max(midz, QGetRenderContext()->GetFloatOption("System", "Clipping")[0]);
+		xscale /= midz;
+		yscale /= midz;
+	}
+	TqFloat zscale = std::max(std::fabs(xscale), std::fabs(yscale));
+
+	if(surface->Diceable(CqMatrix(xscale, yscale, zscale)))
+	{
+		CqMicroPolyGridBase* grid = surface->Dice();
+		if(!grid)
+			return;
+		ADDREF(grid);
+		IqShaderData* P = grid->pVar(EnvVars_P);
+		if(P)
+		{
+			TqInt nu = grid->uGridRes();
+			TqInt nv = grid->vGridRes();
+			const CqVector3D* Pv = 0;
+			P->GetPointPtr(Pv);
+
+			TqInt base = m_vertexColors.size();
+			TqInt numVerts = (nu+1)*(nv+1);
+			const CqColor* color = surface->pAttributes()->GetColorAttribute("System", "Color");
+			const CqColor* opacity = surface->pAttributes()->GetColorAttribute("System", "Opacity");
+			m_vertexColors.resize(base + numVerts, color ? color[0] : CqColor(1,1,1));
+			m_vertexOpacities.resize(base + numVerts, opacity ? opacity[0] : CqColor(1,1,1));
+			if(IqShaderData* Cs = grid->pVar(EnvVars_Cs))
+			{
+				for(TqInt i = 0; i < numVerts; ++i)
+					Cs->GetColor(m_vertexColors[base + i], i);
+			}
+			if(IqShaderData* Os = grid->pVar(EnvVars_Os))
+			{
+				for(TqInt i = 0; i < numVerts; ++i)
+					Os->GetColor(m_vertexOpacities[base + i], i);
+			}
+
+			for(TqInt v = 0; v < nv; ++v)
+			{
+				for(TqInt u = 0; u < nu; ++u)
+				{
+					TqInt i = v*(nu+1) + u;
+					const CqVector3D& a = Pv[i];
+					const CqVector3D& b = Pv[i+1];
+					const CqVector3D& c = Pv[i+nu+1];
+					const CqVector3D& d = Pv[i+nu+2];
+					m_bvh.addTriangle(a, b, d);
+					m_bvh.addTriangle(a, d, c);
+					TqInt verts[6] = {i, i+1, i+nu+2, i, i+nu+2, i+nu+1};
+					for(TqInt j = 0; j < 6; ++j)
+						m_triVerts.push_back(base + verts[j]);
+				}
+			}
+		}
+		RELEASEREF(grid);
+	}
+	else if(depth < maxSplitDepth)
+	{
+		std::vector<boost::shared_ptr<CqSurface> > splits;
+		TqInt numSplits = surface->Split(splits);
+		for(TqInt i = 0; i < numSplits; ++i)
+			tessellate(splits[i], depth + 1);
+	}
+}
 
 
 //---------------------------------------------------------------------
@@ -14,15 +14,26 @@
 #define	___raytrace_Loaded___
 
 #include	<aqsis/aqsis.h>
-#include	"iraytrace.h"
+
+#include	<vector>
+
+#include	<aqsis/core/iraytrace.h>
+#include	"bvh.h"
 
 namespace Aqsis {
 
+class CqSurface;
 
+/** \brief Raytracer holding a triangle tessellation of the traceable scene.
+ *
+ * Primitives with Attribute "visibility" "trace" set are collected as they
+ * are created, and are tessellated into micropolygon grids and built into a
+ * bounding volume hierarchy by Finalise().  The queries may then be used
+ * concurrently from the shading threads.
+ */
 struct CqRaytrace : public IqRaytrace
 {
-	CqRaytrace()
-	{}
+	CqRaytrace();
 	virtual ~CqRaytrace()
 	{}
 
@@ -31,6 +42,25 @@ struct CqRaytrace : public IqRaytrace
 	virtual	void	Initialise();
 	virtual	void	AddPrimitive(const boost::shared_ptr<IqSurface>& pSurface);
 	virtual void	Finalise();
+	virtual bool	intersect(const CqVector3D& origin, const CqVector3D& direction,
+			TqFloat maxDist, SqRayHit& hit) const;
+	virtual bool	occluded(const CqVector3D& origin, const CqVector3D& direction,
+			TqFloat maxDist) const;
+
+	private:
+		void	tessellate(const boost::shared_ptr<CqSurface>& surface,
+				TqInt depth);
+
+		/// Primitives waiting to be tessellated by Finalise().
+		std::vector<boost::shared_ptr<CqSurface> > m_surfaces;
+		/// Acceleration structure over the tessellated primitives.
+		CqBvh	m_bvh;
+		/// Indices into m_vertexColors of the three corners of each triangle
+		/// in m_bvh.
+		std::vector<TqInt> m_triVerts;
+		/// Cs and Os at each vertex of the tessellation.
+		std::vector<CqColor> m_vertexColors;
+		std::vector<CqColor> m_vertexOpacities;
 };
 
 
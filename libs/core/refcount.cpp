@@ -41,6 +41,8 @@
 #include <aqsis/util/sstring.h>
 #include <stdlib.h>
 
+#include <boost/thread/mutex.hpp>
+
 
 /**
  * \class RefCountTracker
@@ -99,10 +101,12 @@ class RefCountTracker
 	private:
 		void _addRefCountObj(CqRefCount *refCount)
 		{
+			boost::mutex::scoped_lock lock(m_mutex);
 			m_refCountObjs.push_back(refCount);
 		}
 		void _removeRefCountObj(CqRefCount *refCount)
 		{
+			boost::mutex::scoped_lock lock(m_mutex);
 			m_refCountObjs.remove(refCount);
 		}
 		void _report()
@@ -130,6 +134,8 @@ class RefCountTracker
 		}
 	private:
 		RefCountList m_refCountObjs;
+		/// Grids are created by several render threads at once.
+		boost::mutex m_mutex;
 		static RefCountTracker *m_tracker;
 
 		static RefCountTracker* theTracker()
@@ -28,7 +28,7 @@
 #include	<cstring> // for memcmp, strcmp
 #include	<time.h>
 #include	<boost/bind.hpp>
-#include	<boost/filesystem/fstream.hpp>
+#include	<boost/thread/tss.hpp>
 
 #include	"imagebuffer.h"
 #include	"lights.h"
@@ -37,8 +37,8 @@
 #include	"nurbs.h"
 #include	"points.h"
 #include	"lath.h"
+#include	"instance.h"
 #include	"transform.h"
-#include	"texturemap_old.h"
 #include	<aqsis/shadervm/ishader.h>
 #include	"tiffio.h"
 
@@ -63,8 +63,21 @@ static const TqUlong shash = CqString::hash( "shader" ); //< == "shader"
 static const TqUlong chash = CqString::hash( "camera" ); //< == "camera"
 static const TqUlong cuhash = CqString::hash( "current" ); //< == "current"
 
-static CqMatrix oldkey[2];  //< to eliminate Inverse(), Transpose() matrix ops.
-static CqMatrix oldresult[2];
+/// Last vector/normal space matrices, to eliminate Inverse(), Transpose()
+/// matrix ops.  Kept per thread since grids are shaded concurrently.
+struct SqSpaceMatrixCache
+{
+	CqMatrix oldkey[2];
+	CqMatrix oldresult[2];
+};
+
+static SqSpaceMatrixCache& spaceMatrixCache()
+{
+	static boost::thread_specific_ptr<SqSpaceMatrixCache> cache;
+	if(!cache.get())
+		cache.reset(new SqSpaceMatrixCache());
+	return *cache;
+}
 
 //---------------------------------------------------------------------
 /** Default constructor for the main renderer class. Initialises current state.
@@ -82,6 +95,9 @@ CqRenderer::CqRenderer()
 	m_Shaders(),
 	m_InstancedShaders(),
 	m_lights(),
+	m_objects(),
+	m_currentObject(),
+	m_globalRequests(0),
 	m_textureCache(),
 	m_fSaveGPrims(false),
 	m_pTransCamera(new CqTransform()),
@@ -393,6 +409,7 @@ void	CqRenderer::EndFrameModeBlock()
 {
 	if ( m_pconCurrent && (m_pconCurrent->Type() == Frame ))
 	{
+		clearObjects();
 		m_pconCurrent->EndFrameModeBlock();
 		m_pconCurrent = m_pconCurrent->pconParent();
 	}
@@ -407,6 +424,7 @@ void	CqRenderer::EndWorldModeBlock()
 {
 	if ( m_pconCurrent && (m_pconCurrent->Type() == World))
 	{
+		clearObjects();
 		m_pconCurrent->EndWorldModeBlock();
 		m_pconCurrent = m_pconCurrent->pconParent();
 	}
@@ -604,6 +622,8 @@ CqAttributesPtr CqRenderer::pattrCurrent() const
 
 CqAttributesPtr CqRenderer::pattrWriteCurrent() const
 {
+	if ( m_currentObject )
+		m_currentObject->noteAttributeWrite();
 	if ( m_pconCurrent )
 		return ( m_pconCurrent->pattrWriteCurrent() );
 	else
@@ -787,7 +807,6 @@ void CqRenderer::RenderAutoShadows()
 				delete(m_pDDManager);
 				m_pDDManager = realDDManager;
 
-				CqTextureMapOld::FlushCache();
 				m_textureCache->flush();
 				clippingVolume().clear();
 			}
@@ -943,8 +962,8 @@ bool	CqRenderer::matVSpaceToSpace( const char* strFrom, const char* strTo, const
 
 	result = matB * matA;
 
-
-
+	CqMatrix* oldkey = spaceMatrixCache().oldkey;
+	CqMatrix* oldresult = spaceMatrixCache().oldresult;
 	if (memcmp((void *) oldkey[0].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
 	{
 		oldkey[0] = result;
@@ -1013,6 +1032,8 @@ bool	CqRenderer::matNSpaceToSpace( const char* strFrom, const char* strTo, const
 
 
 	result = matB * matA;
+	CqMatrix* oldkey = spaceMatrixCache().oldkey;
+	CqMatrix* oldresult = spaceMatrixCache().oldresult;
 	if (memcmp((void *) oldkey[1].pElements(), (void *) result.pElements(), sizeof(TqFloat) * 16) != 0)
 	{
 		oldkey[1] = result;
@@ -1176,8 +1197,7 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 	fileName += RI_SHADER_EXTENSION;
 	boost::filesystem::path shaderPath
 		= poptCurrent()->findRiFileNothrow(fileName, "shader");
-	boost::filesystem::ifstream shaderFile(shaderPath);
-	if(shaderFile)
+	if(!shaderPath.empty())
 	{
 		Aqsis::log() << info << "Loading shader \"" << strName
 			<< "\" from file \"" << native(shaderPath)
@@ -1196,7 +1216,7 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 		boost::shared_ptr<IqShader> pShader;
 		try
 		{
-			pShader = createShaderVM(this, shaderFile, dsoPath);
+			pShader = createShaderVM(this, native(shaderPath), dsoPath);
 		}
 		catch(XqBadShader& e)
 		{
@@ -1258,6 +1278,12 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 
 void CqRenderer::StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface )
 {
+	// Primitives inside an object definition are retained for instancing.
+	if(m_currentObject)
+	{
+		m_currentObject->addSurface(pSurface);
+		return;
+	}
 	// If we are not in a mode that allows 'extra' passes, then fasttrack the primitive directly into the pipeline.
 	const TqInt* pMultipass = GetIntegerOption("Render", "multipass");
 	if(pMultipass && pMultipass[0])
@@ -1382,6 +1408,40 @@ CqLightsourcePtr CqRenderer::findLight(const char* name)
 	return i->second;
 }
 
+void CqRenderer::beginObjectDefinition(const char* name)
+{
+	if(m_currentObject)
+		AQSIS_THROW_XQERROR(XqValidation, EqE_Nesting,
+				"object \"" << name << "\" defined inside object \""
+				<< m_currentObject->name() << "\"");
+	m_currentObject.reset(new CqObjectPrototype(name));
+}
+
+void CqRenderer::endObjectDefinition()
+{
+	if(!m_currentObject)
+		return;
+	m_currentObject->close();
+	m_objects[m_currentObject->name()] = m_currentObject;
+	m_currentObject.reset();
+}
+
+void CqRenderer::clearObjects()
+{
+	// Instances still in the pipeline keep their prototypes alive.
+	m_objects.clear();
+	m_currentObject.reset();
+}
+
+boost::shared_ptr<const CqObjectPrototype> CqRenderer::findObject(const char* name)
+{
+	TqObjectMap::iterator i = m_objects.find(name);
+	if(i == m_objects.end())
+		AQSIS_THROW_XQERROR(XqValidation, EqE_BadHandle,
+				"unknown object \"" << name << "\" encountered");
+	return i->second;
+}
+
 //---------------------------------------------------------------------
 /** Add a new requested display driver to the list.
  */
@@ -1419,21 +1479,6 @@ IqTextureCache& CqRenderer::textureCache()
 	return *m_textureCache;
 }
 
-IqTextureMapOld* CqRenderer::GetEnvironmentMap( const CqString& strFileName )
-{
-	return ( CqTextureMapOld::GetEnvironmentMap( strFileName ) );
-}
-
-IqTextureMapOld* CqRenderer::GetOcclusionMap( const CqString& strFileName )
-{
-	return ( CqTextureMapOld::GetShadowMap( strFileName ) );
-}
-
-IqTextureMapOld* CqRenderer::GetLatLongMap( const CqString& strFileName )
-{
-	return ( CqTextureMapOld::GetLatLongMap( strFileName ) );
-}
-
 const char* CqRenderer::textureSearchPath()
 {
 	const CqString* pathPtr = poptCurrent()->GetStringOption("searchpath", "texture");
@@ -1460,25 +1505,14 @@ bool	CqRenderer::GetBasisMatrix( CqMatrix& matBasis, const CqString& name )
  */
 bool CqRenderer::WhichMatToWorld( CqMatrix &matA, TqUlong thash )
 {
-	static TqInt awhich = 0;
-	TqInt tmp = awhich;
-
-
-	for ( ; awhich >= 0; awhich-- )
+	// Coordinate system names are unique, so a plain search finds the
+	// one match.  (No cached search hint: this is called concurrently
+	// while shading.)
+	for ( TqInt i = m_aCoordSystems.size() - 1; i >= 0; i-- )
 	{
-		if ( m_aCoordSystems[ awhich ].m_hash == thash )
+		if ( m_aCoordSystems[ i ].m_hash == thash )
 		{
-			matA = m_aCoordSystems[ awhich ].m_matToWorld;
-			return(true);
-		}
-	}
-
-	TqInt size = m_aCoordSystems.size() - 1;
-	for ( awhich = size; awhich > tmp; awhich-- )
-	{
-		if ( m_aCoordSystems[ awhich ].m_hash == thash )
-		{
-			matA = m_aCoordSystems[ awhich ].m_matToWorld;
+			matA = m_aCoordSystems[ i ].m_matToWorld;
 			return(true);
 		}
 	}
@@ -1491,25 +1525,12 @@ bool CqRenderer::WhichMatToWorld( CqMatrix &matA, TqUlong thash )
 
 bool CqRenderer::WhichMatWorldTo( CqMatrix &matB, TqUlong thash )
 {
-	static TqInt bwhich = 0;
-	TqInt tmp = bwhich;
-
-
-	for ( ; bwhich >= 0; bwhich-- )
-	{
-		if ( m_aCoordSystems[ bwhich ].m_hash == thash )
-		{
-			matB = m_aCoordSystems[ bwhich ].m_matWorldTo;
-			return(true);
-		}
-	}
-
-	TqInt size = m_aCoordSystems.size() - 1;
-	for ( bwhich = size; bwhich > tmp; bwhich-- )
+	// See WhichMatToWorld().
+	for ( TqInt i = m_aCoordSystems.size() - 1; i >= 0; i-- )
 	{
-		if ( m_aCoordSystems[ bwhich ].m_hash == thash )
+		if ( m_aCoordSystems[ i ].m_hash == thash )
 		{
-			matB = m_aCoordSystems[ bwhich ].m_matWorldTo;
+			matB = m_aCoordSystems[ i ].m_matWorldTo;
 			return(true);
 		}
 	}
@@ -32,6 +32,8 @@
 #include	<iostream>
 #include	<time.h>
 
+#include	<boost/thread/mutex.hpp>
+
 #include	<aqsis/aqsis.h>
 
 #include	<aqsis/ri/ri.h>
@@ -43,8 +45,7 @@
 #include	<aqsis/riutil/tokendictionary.h>
 #include	"iddmanager.h"
 #include	<aqsis/core/irenderer.h>
-#include	"iraytrace.h"
-#include	"iraytrace.h"
+#include	<aqsis/core/iraytrace.h>
 #include	<aqsis/tex/filtering/itexturecache.h>
 #include	"lights.h"
 
@@ -54,6 +55,7 @@ namespace Aqsis {
 
 class CqImageBuffer;
 class CqModeBlock;
+class CqObjectPrototype;
 
 struct SqCoordSys
 {
@@ -199,13 +201,12 @@ class CqRenderer : public IqRenderer
 
 		virtual	void	PrintString( const char* str )
 		{
+			// printf() may be called from several shading threads at once.
+			boost::mutex::scoped_lock lock(m_printMutex);
 			std::cout << str;
 		}
 
 		virtual	IqTextureCache& textureCache();
-		virtual	IqTextureMapOld* GetEnvironmentMap( const CqString& strFileName );
-		virtual	IqTextureMapOld* GetOcclusionMap(const CqString& fileName);
-		virtual	IqTextureMapOld* GetLatLongMap( const CqString& strFileName );
 
 
 		/** \brief Return the current texture search path.
@@ -278,6 +279,43 @@ class CqRenderer : public IqRenderer
 		/// Find the light associated with the given name
 		CqLightsourcePtr findLight(const char* name);
 
+		/** \brief Start recording a retained object definition.
+		 *
+		 * Until endObjectDefinition() is called, primitives passed to
+		 * StorePrimitive() are captured into the definition rather than
+		 * rendered.
+		 */
+		void beginObjectDefinition(const char* name);
+		/// Finish the current object definition and register it by name.
+		void endObjectDefinition();
+		/// Return true between beginObjectDefinition() and endObjectDefinition()
+		bool isDefiningObject() const
+		{
+			return m_currentObject.get() != 0;
+		}
+		/// Find the retained object with the given name
+		boost::shared_ptr<const CqObjectPrototype> findObject(const char* name);
+		/// Forget all retained objects, as at the end of a world or frame.
+		void clearObjects();
+
+		/** \brief Note a request whose effects outlast the attribute block
+		 * it is made in.
+		 *
+		 * Declarations, light sources, named coordinate systems, retained
+		 * objects and error handlers all persist after the enclosing
+		 * AttributeEnd.  A procedural making such requests can't be expanded
+		 * a second time without repeating them.
+		 */
+		void noteGlobalRequest()
+		{
+			++m_globalRequests;
+		}
+		/// Number of requests passed to noteGlobalRequest() so far.
+		TqInt globalRequests() const
+		{
+			return m_globalRequests;
+		}
+
 		void	PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		void	StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface );
 		void	PostWorld();
@@ -542,6 +580,13 @@ class CqRenderer : public IqRenderer
 		typedef std::map<std::string, CqLightsourcePtr> TqLightMap;
 		TqLightMap m_lights;
 
+		typedef std::map<std::string, boost::shared_ptr<const CqObjectPrototype> > TqObjectMap;
+		TqObjectMap m_objects;
+		/// Object definition currently being recorded, if any.
+		boost::shared_ptr<CqObjectPrototype> m_currentObject;
+		/// Count of requests with effects beyond their attribute block.
+		TqInt m_globalRequests;
+
 		boost::shared_ptr<IqTextureCache> m_textureCache; ///< Cache for aqsistex texture access.
 		 
 
@@ -588,6 +633,8 @@ class CqRenderer : public IqRenderer
 		TqInt				m_cropWindowYMax;
 
 		std::vector<SqCoordSys>	m_aCoordSystems; ///< List of registered coordinate systems.
+
+		boost::mutex	m_printMutex;	///< Serialises PrintString().
 }
 ;
 
@@ -60,6 +60,20 @@ void CqLayeredShader::AddConnection(const CqString& layer1, const CqString& vari
 }
 
 
+boost::shared_ptr<IqShader> CqLayeredShader::Duplicate() const
+{
+	boost::shared_ptr<CqLayeredShader> shader(new CqLayeredShader(*this));
+	// Give the copy its own instance of each layer.
+	std::vector<std::pair<CqString, boost::shared_ptr<IqShader> > >::iterator i = shader->m_Layers.begin();
+	while( i != shader->m_Layers.end() )
+	{
+		i->second = i->second->Duplicate();
+		++i;
+	}
+	return shader;
+}
+
+
 bool LayerNameMatch(std::pair<CqString, boost::shared_ptr<IqShader> >& elem1, std::pair<CqString, boost::shared_ptr<IqShader> >& elem2 )
 {
 	return(elem1.first.compare(elem2.first) == 0);
@@ -153,8 +153,16 @@ class CqLayeredShader : public IqShader
 			m_outsideWorld = !QGetRenderContextI()->IsWorldBegin();
 		}
 		CqLayeredShader(const CqLayeredShader& from)
+			: m_Uses(from.m_Uses),
+			m_pTransform(from.m_pTransform),
+			m_strName(from.m_strName),
+			m_outsideWorld(from.m_outsideWorld),
+			m_Layers(from.m_Layers),
+			m_LayerMap(from.m_LayerMap),
+			m_Connections(from.m_Connections)
 		{
-			/// \todo Need to implement a proper copy constrctor, and operator=.
+			/// \todo The layers are shared with the copy; Clone() should
+			/// probably clone them.
 		}
 		virtual	~CqLayeredShader()
 		{}
@@ -274,6 +282,7 @@ class CqLayeredShader : public IqShader
 		{
 			return boost::shared_ptr<IqShader>(new CqLayeredShader(*this));
 		}
+		virtual boost::shared_ptr<IqShader> Duplicate() const;
 		virtual bool	Uses( TqInt Var ) const
 		{
 			assert( Var >= 0 && Var < EnvVars_Last );
@@ -0,0 +1,90 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Per-thread shader instances for concurrent grid shading.
+ */
+
+#include "shadingstate.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <aqsis/core/irenderer.h>
+#include <aqsis/shadervm/ishader.h>
+#include <aqsis/shadervm/ishaderexecenv.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// The states are owned by the bucket processors, so don't delete them when
+/// the thread exits.
+void noCleanup(CqShadingState*)
+{ }
+
+boost::thread_specific_ptr<CqShadingState> g_currentState(&noCleanup);
+
+} // anonymous namespace
+
+CqShadingState::CqShadingState()
+	: m_shaders(),
+	m_lightEnvs()
+{ }
+
+CqShadingState::~CqShadingState()
+{ }
+
+CqShadingState::Scope::Scope(CqShadingState& state)
+	: m_previous(g_currentState.get())
+{
+	g_currentState.reset(&state);
+}
+
+CqShadingState::Scope::~Scope()
+{
+	g_currentState.reset(m_previous);
+}
+
+boost::shared_ptr<IqShader> CqShadingState::shader(
+		const boost::shared_ptr<IqShader>& shader)
+{
+	CqShadingState* state = g_currentState.get();
+	if(!state || !shader)
+		return shader;
+	TqShaderMap::iterator i = state->m_shaders.find(shader);
+	if(i == state->m_shaders.end())
+		i = state->m_shaders.insert(TqShaderMap::value_type(shader,
+					shader->Duplicate())).first;
+	return i->second;
+}
+
+IqShaderExecEnv* CqShadingState::lightEnv(const CqLightsource* light,
+		IqShaderExecEnv* defaultEnv)
+{
+	CqShadingState* state = g_currentState.get();
+	if(!state)
+		return defaultEnv;
+	boost::shared_ptr<IqShaderExecEnv>& env = state->m_lightEnvs[light];
+	if(!env)
+		env = IqShaderExecEnv::create(QGetRenderContextI());
+	return env.get();
+}
+
+} // namespace Aqsis
@@ -0,0 +1,101 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Per-thread shader instances for concurrent grid shading.
+ */
+
+#ifndef SHADINGSTATE_H_INCLUDED
+#define SHADINGSTATE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <map>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace Aqsis {
+
+class IqShader;
+struct IqShaderExecEnv;
+class CqLightsource;
+
+/** \brief Shader instances private to one render thread.
+ *
+ * A shader instance holds the state of the grid it is shading: the values of
+ * its parameters and locals, and (for light sources) the execution
+ * environment.  Grids are diced and shaded by several bucket processors at
+ * once, so each processor installs one of these for the thread running it,
+ * and the shader accessors of CqAttributes and CqLightsource then hand out
+ * the thread's own copy of each shader, made with IqShader::Duplicate() the
+ * first time it's needed.
+ *
+ * Threads without an installed state (the main thread while parsing, for
+ * instance) get the shared shaders, as before.
+ */
+class CqShadingState : boost::noncopyable
+{
+	public:
+		CqShadingState();
+		~CqShadingState();
+
+		/// Install a shading state for the calling thread within a scope.
+		class Scope : boost::noncopyable
+		{
+			public:
+				Scope(CqShadingState& state);
+				~Scope();
+			private:
+				CqShadingState* m_previous;
+		};
+
+		/** \brief Get the calling thread's instance of a shader.
+		 *
+		 * \param shader - shared shader; may be null.
+		 * \return The thread's copy of shader, or shader itself if no state is
+		 * installed for this thread.
+		 */
+		static boost::shared_ptr<IqShader> shader(
+				const boost::shared_ptr<IqShader>& shader);
+		/** \brief Get the calling thread's execution environment for a light.
+		 *
+		 * \param light - light source asking for its environment.
+		 * \param defaultEnv - shared environment of the light, returned if no
+		 * state is installed for this thread.
+		 */
+		static IqShaderExecEnv* lightEnv(const CqLightsource* light,
+				IqShaderExecEnv* defaultEnv);
+
+	private:
+		typedef std::map<boost::shared_ptr<IqShader>,
+				boost::shared_ptr<IqShader> > TqShaderMap;
+		typedef std::map<const CqLightsource*,
+				boost::shared_ptr<IqShaderExecEnv> > TqLightEnvMap;
+
+		/// Map from shared shaders to this thread's copies.
+		TqShaderMap m_shaders;
+		/// Execution environments of the lights for this thread.
+		TqLightEnvMap m_lightEnvs;
+};
+
+} // namespace Aqsis
+
+#endif // SHADINGSTATE_H_INCLUDED
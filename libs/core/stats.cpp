@@ -28,6 +28,8 @@
 #include <cstring>
 #include <string>
 
+#include <boost/thread/mutex.hpp>
+
 #include "attributes.h"
 #include "imagebuffer.h"
 #include "renderer.h"
@@ -43,30 +45,39 @@ CqTimerSet<EqTimerStats> g_timerSet;
 
 #endif // USE_TIMERS
 
+/// Lock for the global accessors, which are used by concurrent render threads.
+static boost::mutex g_statsMutex;
+
 // Global accessor functions, defined like this so that other projects using libshadervm can
 // simply provide empty implementations and not have to link to libaqsis.
 void gStats_IncI( TqInt index )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	CqStats::IncI( index );
 }
 void gStats_DecI( TqInt index )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	CqStats::DecI( index );
 }
 TqInt gStats_getI( TqInt index )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	return( CqStats::getI( index ) );
 }
 void gStats_setI( TqInt index, TqInt value )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	CqStats::setI( index, value );
 }
 TqFloat gStats_getF( TqInt index )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	return( CqStats::getF( index ) );
 }
 void gStats_setF( TqInt index, TqFloat value )
 {
+	boost::mutex::scoped_lock lock(g_statsMutex);
 	CqStats::setF( index, value );
 }
 TqFloat	 CqStats::m_floatVars[ CqStats::_Last_float ];		///< Float variables
@@ -179,6 +190,10 @@ void CqStats::PrintStats( TqInt level ) const
 		TqFloat _geo_prc_s_q = 0.0f;
 		if (STATS_INT_GETI( GEO_prc_created ))
 			_geo_prc_s_q = 100.0f * STATS_INT_GETI( GEO_prc_split ) / STATS_INT_GETI( GEO_prc_created );
+		// Object instances
+		TqFloat _geo_ins_s_q = 0.0f;
+		if (STATS_INT_GETI( GEO_ins_created ))
+			_geo_ins_s_q = 100.0f * STATS_INT_GETI( GEO_ins_split ) / STATS_INT_GETI( GEO_ins_created );
 		MSG << "Geometry:\n\t"
 		// Curves
 		<< "Curves:\n"
@@ -191,7 +206,10 @@ void CqStats::PrintStats( TqInt level ) const
 		<<					"\t" << STATS_INT_GETI( GEO_prc_split ) << " split (" << _geo_prc_s_q << "%)\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dl ) << " dynamic load,\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dra ) << " dynamic read archive,\n\t\t"
-		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t\t"
+		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t"
+		<< "Object instances:\n"
+		<<					"\t\t" << STATS_INT_GETI( GEO_ins_created ) << " created\n\t"
+		<<					"\t" << STATS_INT_GETI( GEO_ins_split ) << " split (" << _geo_ins_s_q << "%)\n\t\t"
 		<< std::endl;
 		/*
 			GPrim stats - End
@@ -464,6 +482,10 @@ void CqStats::PrintStats( TqInt level ) const
 				MSG << 100.0f * ( ( float ) m_cTextureHits[ 1 ][ i ] / ( float ) ( m_cTextureHits[ 1 ][ i ] + m_cTextureMisses[ i ] ) ) << "%)" << std::endl;
 			}
 		}
+		MSG << "Texture tiles       : " << STATS_INT_GETI( TEX_tile_hits ) << " hits, "
+			<< STATS_INT_GETI( TEX_tile_misses ) << " misses, "
+			<< STATS_INT_GETI( TEX_tile_evictions ) << " evictions, "
+			<< STATS_INT_GETI( TEX_tile_peak_kb ) << " kB peak" << std::endl;
 		MSG << std::endl;
 	}
 }
@@ -202,6 +202,12 @@ class CqStats
 			m_intVars[ index ]++;
 		}
 
+		//! Increase an integer specified by an EqIntIndex value by count
+		static void AddI( const TqInt index, const TqInt count )
+		{
+			m_intVars[ index ] += count;
+		}
+
 		//! Decrease an integer specified by an EqIntIndex value by one
 		static void DecI( const TqInt index )
 		{
@@ -317,6 +323,11 @@ class CqStats
 		       GEO_prc_created_dra,
 		       GEO_prc_created_prp,
 
+		       // Object instances
+
+		       GEO_ins_created,
+		       GEO_ins_split,
+
 		       // Grid stats
 
 		       GRD_created,
@@ -386,6 +397,12 @@ class CqStats
 		       PRM_current,
 		       PRM_peak,
 
+		       // Texture tile cache
+		       TEX_tile_hits,
+		       TEX_tile_misses,
+		       TEX_tile_evictions,
+		       TEX_tile_peak_kb,
+
 		       _Last_int } EqIntIndex;
 
 
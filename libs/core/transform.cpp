@@ -26,6 +26,7 @@
 #include	<aqsis/aqsis.h>
 #include	"transform.h"
 #include	"renderer.h"
+#include	<boost/thread/tss.hpp>
 
 namespace Aqsis {
 
@@ -289,11 +290,14 @@ void CqTransform::ConcatCurrentTransform( TqFloat time, const CqMatrix& matTrans
 
 const CqMatrix& CqTransform::matObjectToWorld( TqFloat time ) const
 {
-	static CqMatrix matInt;
+	// Per thread, since transforms are queried while shading concurrently.
+	static boost::thread_specific_ptr<CqMatrix> matInt;
 	if( m_IsMoving )
 	{
-		matInt = GetMotionObjectInterpolated( time ).m_matTransform;
-		return ( matInt );
+		if(!matInt.get())
+			matInt.reset(new CqMatrix());
+		*matInt = GetMotionObjectInterpolated( time ).m_matTransform;
+		return ( *matInt );
 	}
 	else
 		return ( m_StaticMatrix );
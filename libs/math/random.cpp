@@ -34,6 +34,9 @@
 #include	<stdlib.h>
 #include	<stdio.h>
 
+#include	<boost/detail/atomic_count.hpp>
+#include	<boost/thread/tss.hpp>
+
 #include	<aqsis/math/random.h>
 #include	<aqsis/math/math.h>
 
@@ -94,13 +97,37 @@ namespace Aqsis {
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
-/// \todo <b>Code Review</b> Random number state shouldn't be stored in static storage - "independent" random number classes are not really independent in this case!  This will cause problems with reproducible sample patterns and big problems with future multithreading.
-static TqUlong mt[N];   /* the array for the state vector  */
-static TqInt   mti=N+1; /* mti==N+1 means mt[N] is not initialized */
+/// State of one generator stream.
+///
+/// Grids are shaded concurrently, so each thread draws from its own stream.
+/// The streams are all seeded from the seed set by CqRandom::Reseed(), offset
+/// by a per-thread stream number; the first thread to draw numbers gets
+/// stream 0 and so sees the same sequence as a single threaded render.  Work
+/// which must not depend on the thread running it restarts the stream with
+/// CqRandom::ReseedStream().
+struct SqMtState
+{
+	TqUlong mt[N];   /* the array for the state vector  */
+	TqInt   mti;     /* mti==N+1 means mt[N] is not initialized */
+	TqUlong stream;  /* offset applied to the global seed */
+	long    seedGeneration; /* value of g_seedGeneration when last seeded */
+
+	SqMtState(TqUlong stream)
+		: mti(N+1),
+		stream(stream),
+		seedGeneration(0)
+	{ }
+};
+
+static TqUlong g_seed = 5489UL; /* a default initial seed is used */
+static boost::detail::atomic_count g_seedGeneration(0);
+static boost::detail::atomic_count g_streamCount(0);
 
 /* initializes mt[N] with a seed */
-static void init_genrand(TqUlong s)
+static void init_genrand(SqMtState& state, TqUlong s)
 {
+	TqUlong* mt = state.mt;
+	TqInt& mti = state.mti;
 	mt[0]= s & 0xffffffffUL;
 	for (mti=1; mti<N; mti++)
 	{
@@ -115,20 +142,40 @@ static void init_genrand(TqUlong s)
 	}
 }
 
+/* get the calling thread's generator, seeding it if necessary */
+static SqMtState& genrand_state()
+{
+	static boost::thread_specific_ptr<SqMtState> threadState;
+	SqMtState* state = threadState.get();
+	if(!state)
+	{
+		state = new SqMtState(static_cast<TqUlong>(++g_streamCount - 1));
+		threadState.reset(state);
+	}
+	long generation = g_seedGeneration;
+	if(state->mti == N+1 || state->seedGeneration != generation)
+	{
+		init_genrand(*state, g_seed ^ (state->stream * 0x9e3779b9UL));
+		state->seedGeneration = generation;
+	}
+	return *state;
+}
+
 /* generates a random number on [0,0xffffffff]-interval */
 static TqUlong genrand_int32(void)
 {
 	TqUlong  y;
-	static TqUlong  mag01[2]={0x0UL, MATRIX_A};
+	static const TqUlong  mag01[2]={0x0UL, MATRIX_A};
 	/* mag01[x] = x * MATRIX_A  for x=0,1 */
 
+	SqMtState& state = genrand_state();
+	TqUlong* mt = state.mt;
+	TqInt& mti = state.mti;
+
 	if (mti >= N)
 	{ /* generate N words at one time */
 		TqInt kk;
 
-		if (mti == N+1)   /* if init_genrand() has not been called, */
-			init_genrand(5489UL); /* a default initial seed is used */
-
 		for (kk=0;kk<N-M;kk++)
 		{
 			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
@@ -220,7 +267,24 @@ TqFloat	CqRandom::RandomFloat( TqFloat Range )
  */
 void    CqRandom::Reseed(TqUint Seek)
 {
-	init_genrand((TqUlong) Seek);
+	// Every thread's stream picks up the new seed on its next draw.
+	g_seed = (TqUlong) Seek;
+	++g_seedGeneration;
+}
+
+/** Restart the calling thread's stream from the current seed and a key, so
+ * that the numbers drawn next don't depend on the thread.
+ * \param key Stable identifier of the work about to draw numbers.
+ */
+void    CqRandom::ReseedStream(TqUlong key)
+{
+	// Scramble the key so that nearby keys give unrelated streams.
+	key &= 0xffffffffUL;
+	key = ((key ^ (key >> 16)) * 0x7feb352dUL) & 0xffffffffUL;
+	key = ((key ^ (key >> 15)) * 0x846ca68bUL) & 0xffffffffUL;
+	key ^= key >> 16;
+	SqMtState& state = genrand_state();
+	init_genrand(state, g_seed ^ key);
 }
 
 /** Obsolete method
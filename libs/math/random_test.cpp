@@ -0,0 +1,76 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for CqRandom
+ */
+
+#include <aqsis/math/random.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(random_tests)
+
+static void drawAfterReseed(TqUlong key, TqInt skip, std::vector<TqUint>& values)
+{
+	Aqsis::CqRandom random;
+	// Advance the thread's stream so it's in a different state from the
+	// other threads when it's restarted.
+	for(TqInt i = 0; i < skip; ++i)
+		random.RandomInt();
+	random.ReseedStream(key);
+	for(TqInt i = 0; i < 10; ++i)
+		values.push_back(random.RandomInt());
+}
+
+BOOST_AUTO_TEST_CASE(CqRandom_ReseedStream_independent_of_thread)
+{
+	std::vector<TqUint> expected;
+	drawAfterReseed(42, 0, expected);
+
+	std::vector<TqUint> sameThread;
+	drawAfterReseed(42, 3, sameThread);
+	BOOST_CHECK(sameThread == expected);
+
+	std::vector<TqUint> otherThread;
+	boost::thread thread(boost::bind(&drawAfterReseed, 42, 7,
+				boost::ref(otherThread)));
+	thread.join();
+	BOOST_CHECK(otherThread == expected);
+}
+
+BOOST_AUTO_TEST_CASE(CqRandom_ReseedStream_keys_differ)
+{
+	std::vector<TqUint> values1;
+	drawAfterReseed(1, 0, values1);
+	std::vector<TqUint> values2;
+	drawAfterReseed(2, 0, values2);
+	BOOST_CHECK(values1 != values2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
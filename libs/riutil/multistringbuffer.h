@@ -84,6 +84,13 @@ class MultiStringBuffer
             m_offsets.clear();
         }
 
+        /// Approximate memory held by the buffer, in bytes.
+        size_t memoryUsage() const
+        {
+            return m_storage.capacity() + m_offsets.capacity()*sizeof(size_t)
+                + m_cStrings.capacity()*sizeof(const char*);
+        }
+
         /// Convert to an vector of C-strings
         const std::vector<const char*>& toCstringVec() const
         {
@@ -58,6 +58,7 @@ class RenderUtilFilter : public Ri::Filter
         CachedRiStream* m_currCache;
         int m_nested;
         bool m_inObject;
+        bool m_expandObjects;
         // Conditional testing stuff
         IfElseTestCallback m_ifElseTest;
         std::stack<bool> m_ifInactiveStack;
@@ -100,12 +101,14 @@ class RenderUtilFilter : public Ri::Filter
         }
 
     public:
-        RenderUtilFilter(const IfElseTestCallback& conditionTest)
+        RenderUtilFilter(const IfElseTestCallback& conditionTest,
+                         bool expandObjects)
             : m_archives(),
             m_objectInstances(),
             m_currCache(0),
             m_nested(0),
             m_inObject(false),
+            m_expandObjects(expandObjects),
             m_ifElseTest(conditionTest),
             m_ifInactiveStack(),
             m_trueClauseFound(false),
@@ -178,6 +181,8 @@ class RenderUtilFilter : public Ri::Filter
                 // call, don't instantiate it.
                 m_currCache->push_back(new RiCache::ObjectBegin(name));
             }
+            else if(!m_expandObjects)
+                nextFilter().ObjectBegin(name);
             else
             {
                 // If not currently in an archive, instantiate the object.
@@ -202,6 +207,8 @@ class RenderUtilFilter : public Ri::Filter
                 m_inObject = false;
                 m_currCache = 0;
             }
+            else if(!m_expandObjects)
+                nextFilter().ObjectEnd();
             // Else it's a scoping error; just ignore the ObjectEnd.
         }
 
@@ -213,6 +220,11 @@ class RenderUtilFilter : public Ri::Filter
                 m_currCache->push_back(new RiCache::ObjectInstance(name));
                 return;
             }
+            if(!m_expandObjects)
+            {
+                nextFilter().ObjectInstance(name);
+                return;
+            }
             // Search for the object instance name
             int index = findCachedStream(m_objectInstances, name);
             if(index >= 0)
@@ -1302,9 +1314,10 @@ class RenderUtilFilter : public Ri::Filter
 };
 
 
-Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback)
+Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback,
+                                   bool expandObjects)
 {
-    return new RenderUtilFilter(callback);
+    return new RenderUtilFilter(callback, expandObjects);
 }
 
 } // namespace Aqsis
@@ -91,6 +91,23 @@ class RibInputBuffer : boost::noncopyable
 		/// Put the last character back into the input stream
 		void unget();
 
+		/** \brief Access the characters already buffered after the current one.
+		 *
+		 * This allows scanners to run directly over the raw buffer rather than
+		 * making a get() call per character.  The returned range may be empty,
+		 * and does not necessarily extend to the end of the current token.
+		 *
+		 * \param numChars - set to the number of characters available.
+		 * \return pointer to the character which get() would return next.
+		 */
+		const CharType* bufferedChars(int& numChars) const;
+		/** \brief Consume characters obtained via bufferedChars()
+		 *
+		 * Equivalent to numChars calls to get(); the characters must not
+		 * contain line breaks.
+		 */
+		void skipInLine(int numChars);
+
 		/// Return the position of the previous character obtained with get()
 		SourcePos pos() const;
 		/// Return the name of the input stream
@@ -107,8 +124,9 @@ class RibInputBuffer : boost::noncopyable
 		/// gzip decompressor for compressed input
 		boost::scoped_ptr<std::istream> m_gzipStream;
 
-		/// Internal buffer size.
-		static const int m_bufSize = 256;
+		/// Internal buffer size.  Large enough that bulk numeric data is
+		/// mostly scanned in place by the fast paths in RibTokenizer.
+		static const int m_bufSize = 65536;
 		/// Internal buffer of characters.
 		CharType m_buffer[m_bufSize];
 		/// Position of current character [ie, last char returned with get() ]
@@ -157,6 +175,22 @@ inline void RibInputBuffer::unget()
 	m_currPos = m_prevPos;
 }
 
+inline const RibInputBuffer::CharType* RibInputBuffer::bufferedChars(
+		int& numChars) const
+{
+	numChars = m_bufEnd - m_bufPos - 1;
+	return m_buffer + m_bufPos + 1;
+}
+
+inline void RibInputBuffer::skipInLine(int numChars)
+{
+	assert(numChars > 0 && m_bufPos + numChars < m_bufEnd);
+	m_bufPos += numChars;
+	m_prevPos = m_currPos;
+	m_prevPos.col += numChars - 1;
+	m_currPos.col += numChars;
+}
+
 inline SourcePos RibInputBuffer::pos() const
 {
 	return m_currPos;
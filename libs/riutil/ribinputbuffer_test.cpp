@@ -100,14 +100,11 @@ BOOST_AUTO_TEST_CASE(RibInputBuffer_gzip_test)
 BOOST_AUTO_TEST_CASE(RibInputBuffer_bufwrap_test)
 {
 	// Test that buffer wrapping works correctly.
-	std::string inStr(
-		// 5*64 chars, which is enough to cause the buffer of 256 chars to wrap around.
-		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijkl"
-		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijkl"
-		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijkl"
-		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijkl"
-		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijkl"
-	);
+	// Enough chars to cause the internal buffer of 64k chars to wrap around
+	// several times.
+	std::string inStr;
+	for(int i = 0; i < 3*65536 + 100; ++i)
+		inStr += 'a' + i % 26;
 	std::istringstream in(inStr);
 	RibInputBuffer inBuf(in);
 
@@ -0,0 +1,178 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Throughput benchmark for the RIB parser.
+ *
+ * Parses either a RIB file given on the command line, or a synthetic RIB
+ * stream dominated by numeric mesh data, and reports the parsing rate.  The
+ * parsed requests are discarded so that only the tokenizer and parser are
+ * measured.
+ *
+ * Usage: ribparser_bench [file.rib] [repeats]
+ */
+
+#include <aqsis/aqsis.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <aqsis/riutil/errorhandler.h>
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ricxxutil.h>
+#include <aqsis/riutil/tokendictionary.h>
+
+using namespace Aqsis;
+
+namespace {
+
+class BenchErrorHandler : public Ri::ErrorHandler
+{
+    public:
+        BenchErrorHandler() : ErrorHandler(Warning) { }
+
+    protected:
+        virtual void dispatch(int code, const std::string& message)
+        {
+            std::cerr << message << "\n";
+        }
+};
+
+class BenchServices : public StubRendererServices
+{
+    public:
+        BenchServices(Ri::Renderer& renderer)
+            : m_renderer(renderer)
+        { }
+
+        virtual Ri::ErrorHandler& errorHandler() { return m_errorHandler; }
+        virtual Ri::TypeSpec getDeclaration(RtConstToken token,
+                                const char** nameBegin = 0,
+                                const char** nameEnd = 0) const
+        {
+            return m_tokenDict.lookup(token, nameBegin, nameEnd);
+        }
+        virtual Ri::Renderer& firstFilter() { return m_renderer; }
+
+    private:
+        Ri::Renderer& m_renderer;
+        TokenDict m_tokenDict;
+        BenchErrorHandler m_errorHandler;
+};
+
+/// Generate a RIB stream containing a large polygon mesh, in the style of
+/// typical exported geometry.
+std::string syntheticRib()
+{
+    std::ostringstream out;
+    const int gridSize = 300;
+    out << "WorldBegin\n";
+    out << "PointsPolygons [";
+    for(int i = 0; i < (gridSize-1)*(gridSize-1); ++i)
+        out << "4 ";
+    out << "]\n[";
+    for(int j = 0; j < gridSize-1; ++j)
+    {
+        for(int i = 0; i < gridSize-1; ++i)
+        {
+            int v = j*gridSize + i;
+            out << v << " " << v+1 << " " << v+gridSize+1 << " "
+                << v+gridSize << " ";
+        }
+        out << "\n";
+    }
+    out << "]\n\"P\" [";
+    std::srand(1);
+    for(int j = 0; j < gridSize; ++j)
+    {
+        for(int i = 0; i < gridSize; ++i)
+        {
+            out << i*0.0123456 << " " << j*-0.0234567 << " "
+                << std::rand()/double(RAND_MAX) << " ";
+        }
+        out << "\n";
+    }
+    out << "]\n\"N\" [";
+    for(int i = 0; i < gridSize*gridSize; ++i)
+        out << "0 0 -1 ";
+    out << "]\n";
+    out << "WorldEnd\n";
+    return out.str();
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+    std::string rib;
+    std::string name = "synthetic";
+    if(argc > 1)
+    {
+        name = argv[1];
+        std::ifstream inFile(argv[1], std::ios::in | std::ios::binary);
+        if(!inFile)
+        {
+            std::cerr << "Could not open \"" << argv[1] << "\"\n";
+            return 1;
+        }
+        std::ostringstream contents;
+        contents << inFile.rdbuf();
+        rib = contents.str();
+    }
+    else
+        rib = syntheticRib();
+    int repeats = argc > 2 ? std::atoi(argv[2]) : 10;
+    if(repeats < 1)
+        repeats = 1;
+
+    StubRenderer renderer;
+    BenchServices services(renderer);
+    boost::scoped_ptr<RibParser> parser(RibParser::create(services));
+
+    std::clock_t start = std::clock();
+    for(int i = 0; i < repeats; ++i)
+    {
+        std::istringstream in(rib);
+        parser->parseStream(in, name, renderer);
+    }
+    double seconds = double(std::clock() - start) / CLOCKS_PER_SEC;
+
+    double megabytes = double(rib.size()) * repeats / (1024*1024);
+    std::cout << name << ": " << rib.size() << " bytes x " << repeats
+        << " in " << seconds << "s = " << megabytes/seconds << " MB/s\n";
+    return 0;
+}
@@ -37,6 +37,9 @@
 
 #include <cctype>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -354,111 +357,271 @@ void RibTokenizer::scanNext(RibToken& tok)
 	}
 }
 
-/// Read in an ASCII number (integer or real)
-void RibTokenizer::readNumber(RibInputBuffer& inBuf, RibToken& tok)
+namespace {
+
+/** \brief Decimal digits of an ASCII number, accumulated during scanning.
+ *
+ * Up to 19 significant digits are kept in a 64 bit mantissa for the fast
+ * conversion of common numbers.  The significant digits are also kept as
+ * text so that the remaining numbers can be correctly rounded by strtof().
+ */
+struct DecimalNumber
+{
+	/// Halfway points between floats have at most 113 significant digits,
+	/// so digits beyond this only matter through being nonzero.
+	static const int maxDigits = 120;
+
+	boost::uint64_t mantissa;
+	int exp10;
+	int numSigDigits;
+	unsigned int intValue;
+	char digits[maxDigits];
+	int numDigits;
+	bool truncated;
+
+	DecimalNumber()
+		: mantissa(0),
+		exp10(0),
+		numSigDigits(0),
+		intValue(0),
+		numDigits(0),
+		truncated(false)
+	{}
+
+	void addDigit(int d, bool afterPoint)
+	{
+		if(numSigDigits < 19)
+		{
+			mantissa = 10*mantissa + d;
+			if(mantissa != 0)
+			{
+				++numSigDigits;
+				digits[numDigits++] = static_cast<char>('0' + d);
+			}
+			if(afterPoint)
+				--exp10;
+		}
+		else
+		{
+			if(numDigits < maxDigits)
+				digits[numDigits++] = static_cast<char>('0' + d);
+			else if(d != 0)
+				truncated = true;
+			if(!afterPoint)
+				++exp10;
+		}
+	}
+
+	/** \brief Convert to the nearest float.
+	 *
+	 * Uses a single float operation when the mantissa and power of ten are
+	 * both exactly representable as floats (Clinger's fast path), so that
+	 * the result is correctly rounded.  Everything else goes to strtof().
+	 */
+	float toFloat() const
+	{
+		static const float floatPow10[] = {
+			1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+		};
+		if(mantissa == 0)
+			return 0;
+		if(mantissa <= (boost::uint64_t(1) << 24) && exp10 >= -10 && exp10 <= 10)
+		{
+			float m = static_cast<float>(mantissa);
+			return exp10 < 0 ? m / floatPow10[-exp10] : m * floatPow10[exp10];
+		}
+		// Slow path: let the C library round the full digit string.  Any
+		// nonzero digits past maxDigits are represented by a trailing 1.
+		char buf[maxDigits + 16];
+		std::memcpy(buf, digits, numDigits);
+		int len = numDigits;
+		int exponent = exp10 - (numDigits - numSigDigits);
+		if(truncated)
+		{
+			buf[len++] = '1';
+			--exponent;
+		}
+		std::sprintf(buf + len, "e%d", exponent);
+#if defined(_MSC_VER) && _MSC_VER < 1800
+		// No strtof() in older MSVC runtimes.
+		return static_cast<float>(std::strtod(buf, 0));
+#else
+		return strtof(buf, 0);
+#endif
+	}
+};
+
+inline bool isDigit(int c)
+{
+	return static_cast<unsigned int>(c - '0') < 10;
+}
+
+/// Character source scanning directly over the RibInputBuffer internal buffer.
+class RawCharSource
+{
+	public:
+		RawCharSource(const RibInputBuffer::CharType* begin, int numChars)
+			: m_begin(begin),
+			m_pos(begin),
+			m_end(begin + numChars),
+			m_exhausted(false)
+		{ }
+		RibInputBuffer::CharType get()
+		{
+			// Running off the end of the buffered characters returns a
+			// character which terminates any number; the caller then checks
+			// exhausted() and rescans with the buffered input.
+			if(m_pos == m_end)
+			{
+				m_exhausted = true;
+				++m_pos;
+				return 0;
+			}
+			return *m_pos++;
+		}
+		void unget()
+		{
+			--m_pos;
+		}
+		bool exhausted() const
+		{
+			return m_exhausted;
+		}
+		int numRead() const
+		{
+			return m_pos - m_begin;
+		}
+	private:
+		const RibInputBuffer::CharType* m_begin;
+		const RibInputBuffer::CharType* m_pos;
+		const RibInputBuffer::CharType* m_end;
+		bool m_exhausted;
+};
+
+/** \brief Scan an ASCII integer or real number from the given source.
+ *
+ * This is a template so that the same scanner can run either over the raw
+ * input buffer or via RibInputBuffer::get().
+ */
+template<typename CharSourceT>
+void scanNumber(CharSourceT& src, RibToken& tok)
 {
-	RibInputBuffer::CharType c = 0;
-	int sign = 1;
-	int intResult = 0;
-	float floatResult = 0;
+	RibInputBuffer::CharType c = src.get();
+	bool negative = false;
 	bool haveReadDigit = false;
-	c = inBuf.get();
+	DecimalNumber num;
 	// deal with optional sign
 	switch(c)
 	{
 		case '+':
-			c = inBuf.get();
+			c = src.get();
 			break;
 		case '-':
-			sign = -1;
-			c = inBuf.get();
+			negative = true;
+			c = src.get();
 			break;
 	}
 	// deal with digits before decimal point
-	if(std::isdigit(c))
-		haveReadDigit = true;
-	// \todo: Think of a better way to handle the overflow below robustly?
-	while(std::isdigit(c))
+	while(isDigit(c))
 	{
-		intResult *= 10;
-		intResult += c - '0';
-		// this duplication seems like a waste, but it's robust against overflow...
-		floatResult *= 10;
-		floatResult += c - '0';
-		c = inBuf.get();
+		haveReadDigit = true;
+		num.intValue = 10*num.intValue + (c - '0');
+		num.addDigit(c - '0', false);
+		c = src.get();
 	}
 	switch(c)
 	{
 		case '.':
+			// deal with digits to right of decimal point
+			c = src.get();
+			if(!haveReadDigit && !isDigit(c))
 			{
-				// deal with digits to right of decimal point
-				c = inBuf.get();
-				if(!haveReadDigit && !std::isdigit(c))
-				{
-					tok.error("Expected at least one digit in float");
-					return;
-				}
-				float thisPlaceVal = 0.1;
-				while(std::isdigit(c))
-				{
-					floatResult += (c - '0') * thisPlaceVal;
-					thisPlaceVal *= 0.1;
-					c = inBuf.get();
-				}
-				floatResult *= sign;
-				if(c != 'e' && c != 'E')
-				{
-					inBuf.unget();
-					tok = floatResult;
-					return;
-				}
+				tok.error("Expected at least one digit in float");
+				return;
+			}
+			while(isDigit(c))
+			{
+				num.addDigit(c - '0', true);
+				c = src.get();
+			}
+			if(c != 'e' && c != 'E')
+			{
+				src.unget();
+				float f = num.toFloat();
+				tok = negative ? -f : f;
+				return;
 			}
 			break;
 		case 'e':
 		case 'E':
-			floatResult *= sign;
 			break;
 		default:
 			// Number is an integer
-			intResult *= sign;
 			if(!haveReadDigit)
 			{
 				tok.error("Expected a digit");
 				return;
 			}
-			inBuf.unget();
-			tok = intResult;
+			src.unget();
+			tok = static_cast<int>(negative ? 0u - num.intValue : num.intValue);
 			return;
 	}
 	// deal with the exponent
-	c = inBuf.get();
-	sign = 1;
+	c = src.get();
+	bool negativeExp = false;
 	switch(c)
 	{
 		case '+':
-			c = inBuf.get();
+			c = src.get();
 			break;
 		case '-':
-			sign = -1;
-			c = inBuf.get();
+			negativeExp = true;
+			c = src.get();
 			break;
 	}
-	if(!std::isdigit(c))
+	if(!isDigit(c))
 	{
 		tok.error("Expected digits in float exponent");
 		return;
 	}
 	int exponent = 0;
-	while(std::isdigit(c))
+	while(isDigit(c))
 	{
-		exponent *= 10;
-		exponent += c - '0';
-		c = inBuf.get();
+		// Clamp silly exponents; they overflow or underflow anyway.
+		if(exponent < 100000)
+			exponent = 10*exponent + (c - '0');
+		c = src.get();
 	}
-	exponent *= sign;
-	inBuf.unget();
-	floatResult *= std::pow(10.0,exponent);
-	tok = floatResult;
+	src.unget();
+	num.exp10 += negativeExp ? -exponent : exponent;
+	float f = num.toFloat();
+	tok = negative ? -f : f;
+}
+
+} // anonymous namespace
+
+/** \brief Read in an ASCII number (integer or real)
+ *
+ * Numbers are scanned in place in the input buffer where possible; numbers
+ * which straddle the end of the currently buffered data are rescanned
+ * character by character.
+ */
+void RibTokenizer::readNumber(RibInputBuffer& inBuf, RibToken& tok)
+{
+	int numChars = 0;
+	const RibInputBuffer::CharType* chars = inBuf.bufferedChars(numChars);
+	RawCharSource rawSrc(chars, numChars);
+	scanNumber(rawSrc, tok);
+	if(!rawSrc.exhausted() && tok.type() != RibToken::ERROR)
+	{
+		// The terminating character of a valid number is never consumed, so
+		// it remains in the buffer after the number.
+		inBuf.skipInLine(rawSrc.numRead());
+		return;
+	}
+	// Rescan numbers which straddle the end of the buffered data, and errors
+	// (which may consume a line break), via the general input path.
+	scanNumber(inBuf, tok);
 }
 
 /** \brief Read in a string
@@ -33,6 +33,7 @@
  * \author Chris Foster  [chris42f (at) gmail (dot) com]
  */
 
+#include <cstdlib>
 #include <sstream>
 
 #include "ribtokenizer.h"
@@ -153,6 +154,104 @@ BOOST_AUTO_TEST_CASE(RibTokenizer_float_test)
 	CHECK_EOF(f.t);
 }
 
+BOOST_AUTO_TEST_CASE(RibTokenizer_float_rounding_test)
+{
+	// Floats should be correctly rounded, ie, the same as the nearest float
+	// to the decimal value.  (Compare floatVal() directly here, since
+	// RibToken comparison is only approximate for floats.)
+	const char* floatStrs[] = {
+		"0.1", "3.14159274", "1e-3", "123456789.0", "0.3333333333333333333333",
+		"1.00000011920928955078125", "16777217.", "2.5e-40", "3.4028234e38",
+		"-0.0000123456789", "98765.4321e-20", "0.000000000000000000000000001",
+		"12345678901234567890123.5"
+	};
+	const int numFloats = sizeof(floatStrs)/sizeof(floatStrs[0]);
+	std::string str;
+	for(int i = 0; i < numFloats; ++i)
+		str += std::string(floatStrs[i]) + " ";
+	TokenizerFixture f(str);
+	for(int i = 0; i < numFloats; ++i)
+	{
+		RibToken tok = f.t.get();
+		BOOST_REQUIRE_EQUAL(tok.type(), RibToken::FLOAT);
+		BOOST_CHECK_EQUAL(tok.floatVal(),
+				static_cast<float>(std::strtod(floatStrs[i], 0)));
+	}
+	CHECK_EOF(f.t);
+}
+
+BOOST_AUTO_TEST_CASE(RibTokenizer_float_double_rounding_test)
+{
+	// Decimal values at and just to either side of points halfway between
+	// two floats.  Rounding the near misses to double first gives exactly the
+	// halfway point, which then rounds to even instead of to nearest.
+	const char* floatStrs[] = {
+		"1.00000005960464477539062500001",
+		"1.00000005960464477539062499999",
+		"1.000000059604644775390625000000000000000000000000000000000000000000"
+			"000000000000000000000000000000000000000000000000000000000000001",
+		"1.000000059604644775390625",
+		"3.00000011920928955078125",
+		// The same in the exponent form with leading zeros.
+		"0.000100000005960464477539062500001e4",
+		// Halfway between the two smallest denormals, and just below.
+		"2.1019476964872256063855943749348741969203929128147736576356024258346"
+			"86624028790902229957282543182373046875e-45",
+		"2.1019476964872256063855943749348741969203929128147736576356024258346"
+			"86624028790902229957282543182373046874e-45"
+	};
+	const float expected[] = {
+		1.00000012f, 1.0f, 1.00000012f, 1.0f, 3.0f, 1.00000012f,
+		2.80259693e-45f, 1.40129846e-45f
+	};
+	const int numFloats = sizeof(floatStrs)/sizeof(floatStrs[0]);
+	std::string str;
+	for(int i = 0; i < numFloats; ++i)
+		str += std::string(floatStrs[i]) + " ";
+	TokenizerFixture f(str);
+	for(int i = 0; i < numFloats; ++i)
+	{
+		RibToken tok = f.t.get();
+		BOOST_REQUIRE_EQUAL(tok.type(), RibToken::FLOAT);
+		BOOST_CHECK_EQUAL(tok.floatVal(), expected[i]);
+	}
+	CHECK_EOF(f.t);
+}
+
+BOOST_AUTO_TEST_CASE(RibTokenizer_long_number_stream_test)
+{
+	// Check numbers which straddle the boundaries of the input buffer.
+	std::ostringstream out;
+	const int numValues = 30000;
+	int lastLine = 1;
+	int lastLineStart = 0;
+	int lastFloatStart = 0;
+	for(int i = 0; i < numValues; ++i)
+	{
+		out << i << " ";
+		lastFloatStart = out.tellp();
+		out << i << ".25" << (i % 10 == 0 ? "\n" : " ");
+		if(i % 10 == 0 && i != numValues-1)
+		{
+			++lastLine;
+			lastLineStart = out.tellp();
+		}
+	}
+	TokenizerFixture f(out.str());
+	for(int i = 0; i < numValues; ++i)
+	{
+		BOOST_REQUIRE_EQUAL(f.t.get(), RibToken(i));
+		RibToken tok = f.t.get();
+		BOOST_REQUIRE_EQUAL(tok.type(), RibToken::FLOAT);
+		BOOST_REQUIRE_EQUAL(tok.floatVal(), i + 0.25f);
+	}
+	std::ostringstream expectedPos;
+	expectedPos << "test_stream:" << lastLine << " (col "
+		<< lastFloatStart - lastLineStart + 1 << ")";
+	BOOST_CHECK_EQUAL(f.t.streamPos(), expectedPos.str());
+	CHECK_EOF(f.t);
+}
+
 BOOST_AUTO_TEST_CASE(RibTokenizer_array_test)
 {
 	TokenizerFixture f("[ 1.0 -1 ]");
@@ -56,6 +56,8 @@ class CachedRequest
     public:
         /// Re-call the interface function on the given context.
         virtual void reCall(Ri::Renderer& context) const = 0;
+        /// Approximate memory held by the cached call, in bytes.
+        virtual size_t memoryUsage() const = 0;
 
         virtual ~CachedRequest() {}
 
@@ -93,6 +95,19 @@ class CachedRiStream
             for(int i = 0, iend = m_requests.size(); i < iend; ++i)
                 m_requests[i].reCall(context);
         }
+        /// Number of calls in the stream.
+        int size() const { return m_requests.size(); }
+        /// Approximate memory held by the stream, in bytes.
+        size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this) + m_name.capacity()
+                + m_requests.capacity()*sizeof(CachedRequest*);
+            for(int i = 0, iend = m_requests.size(); i < iend; ++i)
+                size += m_requests[i].memoryUsage();
+            return size;
+        }
+        /// Access a single call, for replaying calls individually.
+        const CachedRequest& operator[](int i) const { return m_requests[i]; }
         const std::string& name() const { return m_name; }
 };
 
@@ -120,6 +135,7 @@ class CachedString
         CachedString(RtConstString str) : m_str(str) {}
 
         operator RtConstString() const { return m_str.c_str(); }
+        size_t heapMemory() const { return m_str.capacity(); }
 };
 
 template<typename T>
@@ -136,6 +152,7 @@ class CachedArray
                 return Ri::Array<T>();
             return Ri::Array<T>(&m_vec[0], m_vec.size());
         }
+        size_t heapMemory() const { return m_vec.capacity()*sizeof(T); }
 };
 
 typedef CachedArray<RtInt> CachedIntArray;
@@ -158,6 +175,7 @@ class CachedStringArray
                 return Ri::StringArray();
             return Ri::StringArray(&strings[0], strings.size());
         }
+        size_t heapMemory() const { return m_buf.memoryUsage(); }
 };
 
 template<int N>
@@ -202,9 +220,11 @@ class CachedParamList
         boost::scoped_array<char> m_chars;
         boost::scoped_array<RtConstString> m_strings;
         std::vector<Ri::Param> m_pList;
+        size_t m_heapMemory;
 
     public:
         CachedParamList(const Ri::ParamList& pList)
+            : m_heapMemory(0)
         {
             if(pList.size() == 0)
                 return;
@@ -301,6 +321,10 @@ class CachedParamList
                 // Store parameter
                 m_pList.push_back(Ri::Param(pList[i].spec(), paramName, data, size));
             }
+            m_heapMemory = intCount*sizeof(RtInt) + floatCount*sizeof(RtFloat)
+                + ptrCount*sizeof(RtPointer) + charCount
+                + stringCount*sizeof(RtConstString)
+                + m_pList.capacity()*sizeof(Ri::Param);
         }
 
         operator Ri::ParamList() const
@@ -309,8 +333,19 @@ class CachedParamList
                 return Ri::ParamList();
             return Ri::ParamList(&m_pList[0], m_pList.size());
         }
+        size_t heapMemory() const { return m_heapMemory; }
 };
 
+// Memory held outside the cached argument objects themselves.  Value types
+// hold none.
+template<typename T>
+inline size_t heapMemory(const T&) { return 0; }
+inline size_t heapMemory(const CachedString& s) { return s.heapMemory(); }
+template<typename T>
+inline size_t heapMemory(const CachedArray<T>& a) { return a.heapMemory(); }
+inline size_t heapMemory(const CachedStringArray& a) { return a.heapMemory(); }
+inline size_t heapMemory(const CachedParamList& p) { return p.heapMemory(); }
+
 
 /*
 --------------------------------------------------------------------------------
@@ -341,6 +376,15 @@ class ${procName} : public CachedRequest
         {
             context.${procName}($callArgs);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+#for $type,$name in $memberData
+            size += heapMemory(m_${name});
+#end for
+            return size;
+        }
 };'''
 
 customImplementations = set(['Procedural'])
@@ -396,6 +440,14 @@ class Declare : public CachedRequest
         {
             context.Declare(m_name, m_declaration);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_declaration);
+            return size;
+        }
 };
 
 class FrameBegin : public CachedRequest
@@ -411,6 +463,13 @@ class FrameBegin : public CachedRequest
         {
             context.FrameBegin(m_number);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_number);
+            return size;
+        }
 };
 
 class FrameEnd : public CachedRequest
@@ -424,6 +483,12 @@ class FrameEnd : public CachedRequest
         {
             context.FrameEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class WorldBegin : public CachedRequest
@@ -437,6 +502,12 @@ class WorldBegin : public CachedRequest
         {
             context.WorldBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class WorldEnd : public CachedRequest
@@ -450,6 +521,12 @@ class WorldEnd : public CachedRequest
         {
             context.WorldEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class IfBegin : public CachedRequest
@@ -465,6 +542,13 @@ class IfBegin : public CachedRequest
         {
             context.IfBegin(m_condition);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_condition);
+            return size;
+        }
 };
 
 class ElseIf : public CachedRequest
@@ -480,6 +564,13 @@ class ElseIf : public CachedRequest
         {
             context.ElseIf(m_condition);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_condition);
+            return size;
+        }
 };
 
 class Else : public CachedRequest
@@ -493,6 +584,12 @@ class Else : public CachedRequest
         {
             context.Else();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class IfEnd : public CachedRequest
@@ -506,6 +603,12 @@ class IfEnd : public CachedRequest
         {
             context.IfEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Format : public CachedRequest
@@ -525,6 +628,15 @@ class Format : public CachedRequest
         {
             context.Format(m_xresolution, m_yresolution, m_pixelaspectratio);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_xresolution);
+            size += heapMemory(m_yresolution);
+            size += heapMemory(m_pixelaspectratio);
+            return size;
+        }
 };
 
 class FrameAspectRatio : public CachedRequest
@@ -540,6 +652,13 @@ class FrameAspectRatio : public CachedRequest
         {
             context.FrameAspectRatio(m_frameratio);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_frameratio);
+            return size;
+        }
 };
 
 class ScreenWindow : public CachedRequest
@@ -561,6 +680,16 @@ class ScreenWindow : public CachedRequest
         {
             context.ScreenWindow(m_left, m_right, m_bottom, m_top);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_left);
+            size += heapMemory(m_right);
+            size += heapMemory(m_bottom);
+            size += heapMemory(m_top);
+            return size;
+        }
 };
 
 class CropWindow : public CachedRequest
@@ -582,6 +711,16 @@ class CropWindow : public CachedRequest
         {
             context.CropWindow(m_xmin, m_xmax, m_ymin, m_ymax);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_xmin);
+            size += heapMemory(m_xmax);
+            size += heapMemory(m_ymin);
+            size += heapMemory(m_ymax);
+            return size;
+        }
 };
 
 class Projection : public CachedRequest
@@ -599,6 +738,14 @@ class Projection : public CachedRequest
         {
             context.Projection(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Clipping : public CachedRequest
@@ -616,6 +763,14 @@ class Clipping : public CachedRequest
         {
             context.Clipping(m_cnear, m_cfar);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_cnear);
+            size += heapMemory(m_cfar);
+            return size;
+        }
 };
 
 class ClippingPlane : public CachedRequest
@@ -641,6 +796,18 @@ class ClippingPlane : public CachedRequest
         {
             context.ClippingPlane(m_x, m_y, m_z, m_nx, m_ny, m_nz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_x);
+            size += heapMemory(m_y);
+            size += heapMemory(m_z);
+            size += heapMemory(m_nx);
+            size += heapMemory(m_ny);
+            size += heapMemory(m_nz);
+            return size;
+        }
 };
 
 class DepthOfField : public CachedRequest
@@ -660,6 +827,15 @@ class DepthOfField : public CachedRequest
         {
             context.DepthOfField(m_fstop, m_focallength, m_focaldistance);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_fstop);
+            size += heapMemory(m_focallength);
+            size += heapMemory(m_focaldistance);
+            return size;
+        }
 };
 
 class Shutter : public CachedRequest
@@ -677,6 +853,14 @@ class Shutter : public CachedRequest
         {
             context.Shutter(m_opentime, m_closetime);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_opentime);
+            size += heapMemory(m_closetime);
+            return size;
+        }
 };
 
 class PixelVariance : public CachedRequest
@@ -692,6 +876,13 @@ class PixelVariance : public CachedRequest
         {
             context.PixelVariance(m_variance);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_variance);
+            return size;
+        }
 };
 
 class PixelSamples : public CachedRequest
@@ -709,6 +900,14 @@ class PixelSamples : public CachedRequest
         {
             context.PixelSamples(m_xsamples, m_ysamples);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_xsamples);
+            size += heapMemory(m_ysamples);
+            return size;
+        }
 };
 
 class PixelFilter : public CachedRequest
@@ -728,6 +927,15 @@ class PixelFilter : public CachedRequest
         {
             context.PixelFilter(m_function, m_xwidth, m_ywidth);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_function);
+            size += heapMemory(m_xwidth);
+            size += heapMemory(m_ywidth);
+            return size;
+        }
 };
 
 class Exposure : public CachedRequest
@@ -745,6 +953,14 @@ class Exposure : public CachedRequest
         {
             context.Exposure(m_gain, m_gamma);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_gain);
+            size += heapMemory(m_gamma);
+            return size;
+        }
 };
 
 class Imager : public CachedRequest
@@ -762,6 +978,14 @@ class Imager : public CachedRequest
         {
             context.Imager(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Quantize : public CachedRequest
@@ -785,6 +1009,17 @@ class Quantize : public CachedRequest
         {
             context.Quantize(m_type, m_one, m_min, m_max, m_ditheramplitude);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_one);
+            size += heapMemory(m_min);
+            size += heapMemory(m_max);
+            size += heapMemory(m_ditheramplitude);
+            return size;
+        }
 };
 
 class Display : public CachedRequest
@@ -806,6 +1041,16 @@ class Display : public CachedRequest
         {
             context.Display(m_name, m_type, m_mode, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_type);
+            size += heapMemory(m_mode);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Hider : public CachedRequest
@@ -823,6 +1068,14 @@ class Hider : public CachedRequest
         {
             context.Hider(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ColorSamples : public CachedRequest
@@ -840,6 +1093,14 @@ class ColorSamples : public CachedRequest
         {
             context.ColorSamples(m_nRGB, m_RGBn);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nRGB);
+            size += heapMemory(m_RGBn);
+            return size;
+        }
 };
 
 class RelativeDetail : public CachedRequest
@@ -855,6 +1116,13 @@ class RelativeDetail : public CachedRequest
         {
             context.RelativeDetail(m_relativedetail);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_relativedetail);
+            return size;
+        }
 };
 
 class Option : public CachedRequest
@@ -872,6 +1140,14 @@ class Option : public CachedRequest
         {
             context.Option(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class AttributeBegin : public CachedRequest
@@ -885,6 +1161,12 @@ class AttributeBegin : public CachedRequest
         {
             context.AttributeBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class AttributeEnd : public CachedRequest
@@ -898,6 +1180,12 @@ class AttributeEnd : public CachedRequest
         {
             context.AttributeEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Color : public CachedRequest
@@ -913,6 +1201,13 @@ class Color : public CachedRequest
         {
             context.Color(m_Cq);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_Cq);
+            return size;
+        }
 };
 
 class Opacity : public CachedRequest
@@ -928,6 +1223,13 @@ class Opacity : public CachedRequest
         {
             context.Opacity(m_Os);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_Os);
+            return size;
+        }
 };
 
 class TextureCoordinates : public CachedRequest
@@ -957,6 +1259,20 @@ class TextureCoordinates : public CachedRequest
         {
             context.TextureCoordinates(m_s1, m_t1, m_s2, m_t2, m_s3, m_t3, m_s4, m_t4);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_s1);
+            size += heapMemory(m_t1);
+            size += heapMemory(m_s2);
+            size += heapMemory(m_t2);
+            size += heapMemory(m_s3);
+            size += heapMemory(m_t3);
+            size += heapMemory(m_s4);
+            size += heapMemory(m_t4);
+            return size;
+        }
 };
 
 class LightSource : public CachedRequest
@@ -976,6 +1292,15 @@ class LightSource : public CachedRequest
         {
             context.LightSource(m_shadername, m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_shadername);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class AreaLightSource : public CachedRequest
@@ -995,6 +1320,15 @@ class AreaLightSource : public CachedRequest
         {
             context.AreaLightSource(m_shadername, m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_shadername);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Illuminate : public CachedRequest
@@ -1012,6 +1346,14 @@ class Illuminate : public CachedRequest
         {
             context.Illuminate(m_name, m_onoff);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_onoff);
+            return size;
+        }
 };
 
 class Surface : public CachedRequest
@@ -1029,6 +1371,14 @@ class Surface : public CachedRequest
         {
             context.Surface(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Displacement : public CachedRequest
@@ -1046,6 +1396,14 @@ class Displacement : public CachedRequest
         {
             context.Displacement(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Atmosphere : public CachedRequest
@@ -1063,6 +1421,14 @@ class Atmosphere : public CachedRequest
         {
             context.Atmosphere(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Interior : public CachedRequest
@@ -1080,6 +1446,14 @@ class Interior : public CachedRequest
         {
             context.Interior(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Exterior : public CachedRequest
@@ -1097,6 +1471,14 @@ class Exterior : public CachedRequest
         {
             context.Exterior(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ShaderLayer : public CachedRequest
@@ -1118,6 +1500,16 @@ class ShaderLayer : public CachedRequest
         {
             context.ShaderLayer(m_type, m_name, m_layername, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_name);
+            size += heapMemory(m_layername);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ConnectShaderLayers : public CachedRequest
@@ -1141,6 +1533,17 @@ class ConnectShaderLayers : public CachedRequest
         {
             context.ConnectShaderLayers(m_type, m_layer1, m_variable1, m_layer2, m_variable2);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_layer1);
+            size += heapMemory(m_variable1);
+            size += heapMemory(m_layer2);
+            size += heapMemory(m_variable2);
+            return size;
+        }
 };
 
 class ShadingRate : public CachedRequest
@@ -1156,6 +1559,13 @@ class ShadingRate : public CachedRequest
         {
             context.ShadingRate(m_size);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_size);
+            return size;
+        }
 };
 
 class ShadingInterpolation : public CachedRequest
@@ -1171,6 +1581,13 @@ class ShadingInterpolation : public CachedRequest
         {
             context.ShadingInterpolation(m_type);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            return size;
+        }
 };
 
 class Matte : public CachedRequest
@@ -1186,6 +1603,13 @@ class Matte : public CachedRequest
         {
             context.Matte(m_onoff);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_onoff);
+            return size;
+        }
 };
 
 class Bound : public CachedRequest
@@ -1201,6 +1625,13 @@ class Bound : public CachedRequest
         {
             context.Bound(m_bound);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_bound);
+            return size;
+        }
 };
 
 class Detail : public CachedRequest
@@ -1216,6 +1647,13 @@ class Detail : public CachedRequest
         {
             context.Detail(m_bound);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_bound);
+            return size;
+        }
 };
 
 class DetailRange : public CachedRequest
@@ -1237,6 +1675,16 @@ class DetailRange : public CachedRequest
         {
             context.DetailRange(m_offlow, m_onlow, m_onhigh, m_offhigh);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_offlow);
+            size += heapMemory(m_onlow);
+            size += heapMemory(m_onhigh);
+            size += heapMemory(m_offhigh);
+            return size;
+        }
 };
 
 class GeometricApproximation : public CachedRequest
@@ -1254,6 +1702,14 @@ class GeometricApproximation : public CachedRequest
         {
             context.GeometricApproximation(m_type, m_value);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_value);
+            return size;
+        }
 };
 
 class Orientation : public CachedRequest
@@ -1269,6 +1725,13 @@ class Orientation : public CachedRequest
         {
             context.Orientation(m_orientation);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_orientation);
+            return size;
+        }
 };
 
 class ReverseOrientation : public CachedRequest
@@ -1282,6 +1745,12 @@ class ReverseOrientation : public CachedRequest
         {
             context.ReverseOrientation();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Sides : public CachedRequest
@@ -1297,6 +1766,13 @@ class Sides : public CachedRequest
         {
             context.Sides(m_nsides);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nsides);
+            return size;
+        }
 };
 
 class Identity : public CachedRequest
@@ -1310,6 +1786,12 @@ class Identity : public CachedRequest
         {
             context.Identity();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Transform : public CachedRequest
@@ -1325,6 +1807,13 @@ class Transform : public CachedRequest
         {
             context.Transform(m_transform);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_transform);
+            return size;
+        }
 };
 
 class ConcatTransform : public CachedRequest
@@ -1340,6 +1829,13 @@ class ConcatTransform : public CachedRequest
         {
             context.ConcatTransform(m_transform);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_transform);
+            return size;
+        }
 };
 
 class Perspective : public CachedRequest
@@ -1355,6 +1851,13 @@ class Perspective : public CachedRequest
         {
             context.Perspective(m_fov);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_fov);
+            return size;
+        }
 };
 
 class Translate : public CachedRequest
@@ -1374,6 +1877,15 @@ class Translate : public CachedRequest
         {
             context.Translate(m_dx, m_dy, m_dz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_dx);
+            size += heapMemory(m_dy);
+            size += heapMemory(m_dz);
+            return size;
+        }
 };
 
 class Rotate : public CachedRequest
@@ -1395,6 +1907,16 @@ class Rotate : public CachedRequest
         {
             context.Rotate(m_angle, m_dx, m_dy, m_dz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_angle);
+            size += heapMemory(m_dx);
+            size += heapMemory(m_dy);
+            size += heapMemory(m_dz);
+            return size;
+        }
 };
 
 class Scale : public CachedRequest
@@ -1414,6 +1936,15 @@ class Scale : public CachedRequest
         {
             context.Scale(m_sx, m_sy, m_sz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_sx);
+            size += heapMemory(m_sy);
+            size += heapMemory(m_sz);
+            return size;
+        }
 };
 
 class Skew : public CachedRequest
@@ -1441,6 +1972,19 @@ class Skew : public CachedRequest
         {
             context.Skew(m_angle, m_dx1, m_dy1, m_dz1, m_dx2, m_dy2, m_dz2);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_angle);
+            size += heapMemory(m_dx1);
+            size += heapMemory(m_dy1);
+            size += heapMemory(m_dz1);
+            size += heapMemory(m_dx2);
+            size += heapMemory(m_dy2);
+            size += heapMemory(m_dz2);
+            return size;
+        }
 };
 
 class CoordinateSystem : public CachedRequest
@@ -1456,6 +2000,13 @@ class CoordinateSystem : public CachedRequest
         {
             context.CoordinateSystem(m_space);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_space);
+            return size;
+        }
 };
 
 class CoordSysTransform : public CachedRequest
@@ -1471,6 +2022,13 @@ class CoordSysTransform : public CachedRequest
         {
             context.CoordSysTransform(m_space);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_space);
+            return size;
+        }
 };
 
 class TransformBegin : public CachedRequest
@@ -1484,6 +2042,12 @@ class TransformBegin : public CachedRequest
         {
             context.TransformBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class TransformEnd : public CachedRequest
@@ -1497,6 +2061,12 @@ class TransformEnd : public CachedRequest
         {
             context.TransformEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Resource : public CachedRequest
@@ -1516,6 +2086,15 @@ class Resource : public CachedRequest
         {
             context.Resource(m_handle, m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_handle);
+            size += heapMemory(m_type);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ResourceBegin : public CachedRequest
@@ -1529,6 +2108,12 @@ class ResourceBegin : public CachedRequest
         {
             context.ResourceBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ResourceEnd : public CachedRequest
@@ -1542,6 +2127,12 @@ class ResourceEnd : public CachedRequest
         {
             context.ResourceEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Attribute : public CachedRequest
@@ -1559,6 +2150,14 @@ class Attribute : public CachedRequest
         {
             context.Attribute(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Polygon : public CachedRequest
@@ -1574,6 +2173,13 @@ class Polygon : public CachedRequest
         {
             context.Polygon(m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class GeneralPolygon : public CachedRequest
@@ -1591,6 +2197,14 @@ class GeneralPolygon : public CachedRequest
         {
             context.GeneralPolygon(m_nverts, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nverts);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class PointsPolygons : public CachedRequest
@@ -1610,6 +2224,15 @@ class PointsPolygons : public CachedRequest
         {
             context.PointsPolygons(m_nverts, m_verts, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nverts);
+            size += heapMemory(m_verts);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class PointsGeneralPolygons : public CachedRequest
@@ -1631,6 +2254,16 @@ class PointsGeneralPolygons : public CachedRequest
         {
             context.PointsGeneralPolygons(m_nloops, m_nverts, m_verts, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nloops);
+            size += heapMemory(m_nverts);
+            size += heapMemory(m_verts);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Basis : public CachedRequest
@@ -1652,6 +2285,16 @@ class Basis : public CachedRequest
         {
             context.Basis(m_ubasis, m_ustep, m_vbasis, m_vstep);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_ubasis);
+            size += heapMemory(m_ustep);
+            size += heapMemory(m_vbasis);
+            size += heapMemory(m_vstep);
+            return size;
+        }
 };
 
 class Patch : public CachedRequest
@@ -1669,6 +2312,14 @@ class Patch : public CachedRequest
         {
             context.Patch(m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class PatchMesh : public CachedRequest
@@ -1694,6 +2345,18 @@ class PatchMesh : public CachedRequest
         {
             context.PatchMesh(m_type, m_nu, m_uwrap, m_nv, m_vwrap, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_nu);
+            size += heapMemory(m_uwrap);
+            size += heapMemory(m_nv);
+            size += heapMemory(m_vwrap);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class NuPatch : public CachedRequest
@@ -1729,6 +2392,23 @@ class NuPatch : public CachedRequest
         {
             context.NuPatch(m_nu, m_uorder, m_uknot, m_umin, m_umax, m_nv, m_vorder, m_vknot, m_vmin, m_vmax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nu);
+            size += heapMemory(m_uorder);
+            size += heapMemory(m_uknot);
+            size += heapMemory(m_umin);
+            size += heapMemory(m_umax);
+            size += heapMemory(m_nv);
+            size += heapMemory(m_vorder);
+            size += heapMemory(m_vknot);
+            size += heapMemory(m_vmin);
+            size += heapMemory(m_vmax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class TrimCurve : public CachedRequest
@@ -1760,6 +2440,21 @@ class TrimCurve : public CachedRequest
         {
             context.TrimCurve(m_ncurves, m_order, m_knot, m_min, m_max, m_n, m_u, m_v, m_w);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_ncurves);
+            size += heapMemory(m_order);
+            size += heapMemory(m_knot);
+            size += heapMemory(m_min);
+            size += heapMemory(m_max);
+            size += heapMemory(m_n);
+            size += heapMemory(m_u);
+            size += heapMemory(m_v);
+            size += heapMemory(m_w);
+            return size;
+        }
 };
 
 class SubdivisionMesh : public CachedRequest
@@ -1789,6 +2484,20 @@ class SubdivisionMesh : public CachedRequest
         {
             context.SubdivisionMesh(m_scheme, m_nvertices, m_vertices, m_tags, m_nargs, m_intargs, m_floatargs, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_scheme);
+            size += heapMemory(m_nvertices);
+            size += heapMemory(m_vertices);
+            size += heapMemory(m_tags);
+            size += heapMemory(m_nargs);
+            size += heapMemory(m_intargs);
+            size += heapMemory(m_floatargs);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Sphere : public CachedRequest
@@ -1812,6 +2521,17 @@ class Sphere : public CachedRequest
         {
             context.Sphere(m_radius, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_radius);
+            size += heapMemory(m_zmin);
+            size += heapMemory(m_zmax);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Cone : public CachedRequest
@@ -1833,9 +2553,19 @@ class Cone : public CachedRequest
         {
             context.Cone(m_height, m_radius, m_thetamax, m_pList);
         }
-};
 
-class Cylinder : public CachedRequest
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_height);
+            size += heapMemory(m_radius);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
+};
+
+class Cylinder : public CachedRequest
 {
     private:
         RtFloat m_radius;
@@ -1856,6 +2586,17 @@ class Cylinder : public CachedRequest
         {
             context.Cylinder(m_radius, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_radius);
+            size += heapMemory(m_zmin);
+            size += heapMemory(m_zmax);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Hyperboloid : public CachedRequest
@@ -1877,6 +2618,16 @@ class Hyperboloid : public CachedRequest
         {
             context.Hyperboloid(m_point1, m_point2, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_point1);
+            size += heapMemory(m_point2);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Paraboloid : public CachedRequest
@@ -1900,6 +2651,17 @@ class Paraboloid : public CachedRequest
         {
             context.Paraboloid(m_rmax, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_rmax);
+            size += heapMemory(m_zmin);
+            size += heapMemory(m_zmax);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Disk : public CachedRequest
@@ -1921,6 +2683,16 @@ class Disk : public CachedRequest
         {
             context.Disk(m_height, m_radius, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_height);
+            size += heapMemory(m_radius);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Torus : public CachedRequest
@@ -1946,6 +2718,18 @@ class Torus : public CachedRequest
         {
             context.Torus(m_majorrad, m_minorrad, m_phimin, m_phimax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_majorrad);
+            size += heapMemory(m_minorrad);
+            size += heapMemory(m_phimin);
+            size += heapMemory(m_phimax);
+            size += heapMemory(m_thetamax);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Points : public CachedRequest
@@ -1961,6 +2745,13 @@ class Points : public CachedRequest
         {
             context.Points(m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Curves : public CachedRequest
@@ -1982,6 +2773,16 @@ class Curves : public CachedRequest
         {
             context.Curves(m_type, m_nvertices, m_wrap, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_nvertices);
+            size += heapMemory(m_wrap);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Blobby : public CachedRequest
@@ -2005,6 +2806,17 @@ class Blobby : public CachedRequest
         {
             context.Blobby(m_nleaf, m_code, m_floats, m_strings, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_nleaf);
+            size += heapMemory(m_code);
+            size += heapMemory(m_floats);
+            size += heapMemory(m_strings);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class Geometry : public CachedRequest
@@ -2022,6 +2834,14 @@ class Geometry : public CachedRequest
         {
             context.Geometry(m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class SolidBegin : public CachedRequest
@@ -2037,6 +2857,13 @@ class SolidBegin : public CachedRequest
         {
             context.SolidBegin(m_type);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_type);
+            return size;
+        }
 };
 
 class SolidEnd : public CachedRequest
@@ -2050,6 +2877,12 @@ class SolidEnd : public CachedRequest
         {
             context.SolidEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ObjectBegin : public CachedRequest
@@ -2065,6 +2898,13 @@ class ObjectBegin : public CachedRequest
         {
             context.ObjectBegin(m_name);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            return size;
+        }
 };
 
 class ObjectEnd : public CachedRequest
@@ -2078,6 +2918,12 @@ class ObjectEnd : public CachedRequest
         {
             context.ObjectEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ObjectInstance : public CachedRequest
@@ -2093,6 +2939,13 @@ class ObjectInstance : public CachedRequest
         {
             context.ObjectInstance(m_name);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            return size;
+        }
 };
 
 class MotionBegin : public CachedRequest
@@ -2108,6 +2961,13 @@ class MotionBegin : public CachedRequest
         {
             context.MotionBegin(m_times);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_times);
+            return size;
+        }
 };
 
 class MotionEnd : public CachedRequest
@@ -2121,6 +2981,12 @@ class MotionEnd : public CachedRequest
         {
             context.MotionEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class MakeTexture : public CachedRequest
@@ -2150,6 +3016,20 @@ class MakeTexture : public CachedRequest
         {
             context.MakeTexture(m_imagefile, m_texturefile, m_swrap, m_twrap, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_imagefile);
+            size += heapMemory(m_texturefile);
+            size += heapMemory(m_swrap);
+            size += heapMemory(m_twrap);
+            size += heapMemory(m_filterfunc);
+            size += heapMemory(m_swidth);
+            size += heapMemory(m_twidth);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class MakeLatLongEnvironment : public CachedRequest
@@ -2175,6 +3055,18 @@ class MakeLatLongEnvironment : public CachedRequest
         {
             context.MakeLatLongEnvironment(m_imagefile, m_reflfile, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_imagefile);
+            size += heapMemory(m_reflfile);
+            size += heapMemory(m_filterfunc);
+            size += heapMemory(m_swidth);
+            size += heapMemory(m_twidth);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class MakeCubeFaceEnvironment : public CachedRequest
@@ -2212,6 +3104,24 @@ class MakeCubeFaceEnvironment : public CachedRequest
         {
             context.MakeCubeFaceEnvironment(m_px, m_nx, m_py, m_ny, m_pz, m_nz, m_reflfile, m_fov, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_px);
+            size += heapMemory(m_nx);
+            size += heapMemory(m_py);
+            size += heapMemory(m_ny);
+            size += heapMemory(m_pz);
+            size += heapMemory(m_nz);
+            size += heapMemory(m_reflfile);
+            size += heapMemory(m_fov);
+            size += heapMemory(m_filterfunc);
+            size += heapMemory(m_swidth);
+            size += heapMemory(m_twidth);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class MakeShadow : public CachedRequest
@@ -2231,6 +3141,15 @@ class MakeShadow : public CachedRequest
         {
             context.MakeShadow(m_picfile, m_shadowfile, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_picfile);
+            size += heapMemory(m_shadowfile);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class MakeOcclusion : public CachedRequest
@@ -2250,6 +3169,15 @@ class MakeOcclusion : public CachedRequest
         {
             context.MakeOcclusion(m_picfiles, m_shadowfile, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_picfiles);
+            size += heapMemory(m_shadowfile);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ErrorHandler : public CachedRequest
@@ -2265,6 +3193,13 @@ class ErrorHandler : public CachedRequest
         {
             context.ErrorHandler(m_handler);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_handler);
+            return size;
+        }
 };
 
 class ReadArchive : public CachedRequest
@@ -2284,6 +3219,15 @@ class ReadArchive : public CachedRequest
         {
             context.ReadArchive(m_name, m_callback, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_callback);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ArchiveBegin : public CachedRequest
@@ -2301,6 +3245,14 @@ class ArchiveBegin : public CachedRequest
         {
             context.ArchiveBegin(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapMemory(m_name);
+            size += heapMemory(m_pList);
+            return size;
+        }
 };
 
 class ArchiveEnd : public CachedRequest
@@ -2314,6 +3266,12 @@ class ArchiveEnd : public CachedRequest
         {
             context.ArchiveEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 //[[[end]]]
 
@@ -2350,11 +3308,688 @@ class Procedural : public CachedRequest
         {
             context.Procedural(m_data, m_bound, m_refineproc, &doNothingFreeProc);
         }
+
+        // The procedural data is opaque, so isn't counted.
+        virtual size_t memoryUsage() const
+        {
+            return sizeof(*this);
+        }
+};
+
+
+//------------------------------------------------------------------------------
+/// Special case for ArchiveRecord, which isn't part of the RIB binding.
+class ArchiveRecord : public CachedRequest
+{
+    private:
+        CachedString m_type;
+        CachedString m_string;
+    public:
+        ArchiveRecord(RtConstToken type, const char* string)
+            : m_type(type)
+            , m_string(string)
+        { }
+
+        virtual void reCall(Ri::Renderer& context) const
+        {
+            context.ArchiveRecord(m_type, m_string);
+        }
+
+        virtual size_t memoryUsage() const
+        {
+            return sizeof(*this) + heapMemory(m_type) + heapMemory(m_string);
+        }
 };
 
 
 } // namespace RiCache
 
+
+//------------------------------------------------------------------------------
+/// A Ri::Renderer which records all calls into a CachedRiStream.
+///
+/// This is useful for capturing a complete stream of calls, for example from
+/// a RibParser, so that they can be replayed into another context later.
+class CachingRenderer : public Ri::Renderer
+{
+    private:
+        CachedRiStream& m_stream;
+
+    public:
+        CachingRenderer(CachedRiStream& stream)
+            : m_stream(stream)
+        { }
+
+        virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
+        {
+            m_stream.push_back(new RiCache::ArchiveRecord(type, string));
+        }
+
+        // Code generator for autogenerated method declarations
+        /*[[[cog
+        from codegenutils import *
+        riXml = parseXml(riXmlPath)
+        from Cheetah.Template import Template
+
+        methodTemplate = r'''
+        virtual $wrapDecl($riCxxMethodDecl($proc), 72, wrapIndent=20)
+        {
+            m_stream.push_back(new RiCache::${procName}($callArgs));
+        }
+        '''
+
+        for proc in riXml.findall('Procedures/Procedure'):
+            procName = proc.findtext('Name')
+            if proc.findall('Rib'):
+                callArgs = ', '.join(wrapperCallArgList(proc))
+                cog.out(str(Template(methodTemplate, searchList=locals())));
+
+        ]]]*/
+
+        virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+        {
+            m_stream.push_back(new RiCache::Declare(name, declaration));
+        }
+
+        virtual RtVoid FrameBegin(RtInt number)
+        {
+            m_stream.push_back(new RiCache::FrameBegin(number));
+        }
+
+        virtual RtVoid FrameEnd()
+        {
+            m_stream.push_back(new RiCache::FrameEnd());
+        }
+
+        virtual RtVoid WorldBegin()
+        {
+            m_stream.push_back(new RiCache::WorldBegin());
+        }
+
+        virtual RtVoid WorldEnd()
+        {
+            m_stream.push_back(new RiCache::WorldEnd());
+        }
+
+        virtual RtVoid IfBegin(RtConstString condition)
+        {
+            m_stream.push_back(new RiCache::IfBegin(condition));
+        }
+
+        virtual RtVoid ElseIf(RtConstString condition)
+        {
+            m_stream.push_back(new RiCache::ElseIf(condition));
+        }
+
+        virtual RtVoid Else()
+        {
+            m_stream.push_back(new RiCache::Else());
+        }
+
+        virtual RtVoid IfEnd()
+        {
+            m_stream.push_back(new RiCache::IfEnd());
+        }
+
+        virtual RtVoid Format(RtInt xresolution, RtInt yresolution,
+                            RtFloat pixelaspectratio)
+        {
+            m_stream.push_back(new RiCache::Format(xresolution, yresolution, pixelaspectratio));
+        }
+
+        virtual RtVoid FrameAspectRatio(RtFloat frameratio)
+        {
+            m_stream.push_back(new RiCache::FrameAspectRatio(frameratio));
+        }
+
+        virtual RtVoid ScreenWindow(RtFloat left, RtFloat right, RtFloat bottom,
+                            RtFloat top)
+        {
+            m_stream.push_back(new RiCache::ScreenWindow(left, right, bottom, top));
+        }
+
+        virtual RtVoid CropWindow(RtFloat xmin, RtFloat xmax, RtFloat ymin,
+                            RtFloat ymax)
+        {
+            m_stream.push_back(new RiCache::CropWindow(xmin, xmax, ymin, ymax));
+        }
+
+        virtual RtVoid Projection(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Projection(name, pList));
+        }
+
+        virtual RtVoid Clipping(RtFloat cnear, RtFloat cfar)
+        {
+            m_stream.push_back(new RiCache::Clipping(cnear, cfar));
+        }
+
+        virtual RtVoid ClippingPlane(RtFloat x, RtFloat y, RtFloat z, RtFloat nx,
+                            RtFloat ny, RtFloat nz)
+        {
+            m_stream.push_back(new RiCache::ClippingPlane(x, y, z, nx, ny, nz));
+        }
+
+        virtual RtVoid DepthOfField(RtFloat fstop, RtFloat focallength,
+                            RtFloat focaldistance)
+        {
+            m_stream.push_back(new RiCache::DepthOfField(fstop, focallength, focaldistance));
+        }
+
+        virtual RtVoid Shutter(RtFloat opentime, RtFloat closetime)
+        {
+            m_stream.push_back(new RiCache::Shutter(opentime, closetime));
+        }
+
+        virtual RtVoid PixelVariance(RtFloat variance)
+        {
+            m_stream.push_back(new RiCache::PixelVariance(variance));
+        }
+
+        virtual RtVoid PixelSamples(RtFloat xsamples, RtFloat ysamples)
+        {
+            m_stream.push_back(new RiCache::PixelSamples(xsamples, ysamples));
+        }
+
+        virtual RtVoid PixelFilter(RtFilterFunc function, RtFloat xwidth,
+                            RtFloat ywidth)
+        {
+            m_stream.push_back(new RiCache::PixelFilter(function, xwidth, ywidth));
+        }
+
+        virtual RtVoid Exposure(RtFloat gain, RtFloat gamma)
+        {
+            m_stream.push_back(new RiCache::Exposure(gain, gamma));
+        }
+
+        virtual RtVoid Imager(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Imager(name, pList));
+        }
+
+        virtual RtVoid Quantize(RtConstToken type, RtInt one, RtInt min, RtInt max,
+                            RtFloat ditheramplitude)
+        {
+            m_stream.push_back(new RiCache::Quantize(type, one, min, max, ditheramplitude));
+        }
+
+        virtual RtVoid Display(RtConstToken name, RtConstToken type, RtConstToken mode,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Display(name, type, mode, pList));
+        }
+
+        virtual RtVoid Hider(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Hider(name, pList));
+        }
+
+        virtual RtVoid ColorSamples(const FloatArray& nRGB, const FloatArray& RGBn)
+        {
+            m_stream.push_back(new RiCache::ColorSamples(nRGB, RGBn));
+        }
+
+        virtual RtVoid RelativeDetail(RtFloat relativedetail)
+        {
+            m_stream.push_back(new RiCache::RelativeDetail(relativedetail));
+        }
+
+        virtual RtVoid Option(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Option(name, pList));
+        }
+
+        virtual RtVoid AttributeBegin()
+        {
+            m_stream.push_back(new RiCache::AttributeBegin());
+        }
+
+        virtual RtVoid AttributeEnd()
+        {
+            m_stream.push_back(new RiCache::AttributeEnd());
+        }
+
+        virtual RtVoid Color(RtConstColor Cq)
+        {
+            m_stream.push_back(new RiCache::Color(Cq));
+        }
+
+        virtual RtVoid Opacity(RtConstColor Os)
+        {
+            m_stream.push_back(new RiCache::Opacity(Os));
+        }
+
+        virtual RtVoid TextureCoordinates(RtFloat s1, RtFloat t1, RtFloat s2,
+                            RtFloat t2, RtFloat s3, RtFloat t3, RtFloat s4,
+                            RtFloat t4)
+        {
+            m_stream.push_back(new RiCache::TextureCoordinates(s1, t1, s2, t2, s3, t3, s4, t4));
+        }
+
+        virtual RtVoid LightSource(RtConstToken shadername, RtConstToken name,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::LightSource(shadername, name, pList));
+        }
+
+        virtual RtVoid AreaLightSource(RtConstToken shadername, RtConstToken name,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::AreaLightSource(shadername, name, pList));
+        }
+
+        virtual RtVoid Illuminate(RtConstToken name, RtBoolean onoff)
+        {
+            m_stream.push_back(new RiCache::Illuminate(name, onoff));
+        }
+
+        virtual RtVoid Surface(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Surface(name, pList));
+        }
+
+        virtual RtVoid Displacement(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Displacement(name, pList));
+        }
+
+        virtual RtVoid Atmosphere(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Atmosphere(name, pList));
+        }
+
+        virtual RtVoid Interior(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Interior(name, pList));
+        }
+
+        virtual RtVoid Exterior(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Exterior(name, pList));
+        }
+
+        virtual RtVoid ShaderLayer(RtConstToken type, RtConstToken name,
+                            RtConstToken layername, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ShaderLayer(type, name, layername, pList));
+        }
+
+        virtual RtVoid ConnectShaderLayers(RtConstToken type, RtConstToken layer1,
+                            RtConstToken variable1, RtConstToken layer2,
+                            RtConstToken variable2)
+        {
+            m_stream.push_back(new RiCache::ConnectShaderLayers(type, layer1, variable1, layer2, variable2));
+        }
+
+        virtual RtVoid ShadingRate(RtFloat size)
+        {
+            m_stream.push_back(new RiCache::ShadingRate(size));
+        }
+
+        virtual RtVoid ShadingInterpolation(RtConstToken type)
+        {
+            m_stream.push_back(new RiCache::ShadingInterpolation(type));
+        }
+
+        virtual RtVoid Matte(RtBoolean onoff)
+        {
+            m_stream.push_back(new RiCache::Matte(onoff));
+        }
+
+        virtual RtVoid Bound(RtConstBound bound)
+        {
+            m_stream.push_back(new RiCache::Bound(bound));
+        }
+
+        virtual RtVoid Detail(RtConstBound bound)
+        {
+            m_stream.push_back(new RiCache::Detail(bound));
+        }
+
+        virtual RtVoid DetailRange(RtFloat offlow, RtFloat onlow, RtFloat onhigh,
+                            RtFloat offhigh)
+        {
+            m_stream.push_back(new RiCache::DetailRange(offlow, onlow, onhigh, offhigh));
+        }
+
+        virtual RtVoid GeometricApproximation(RtConstToken type, RtFloat value)
+        {
+            m_stream.push_back(new RiCache::GeometricApproximation(type, value));
+        }
+
+        virtual RtVoid Orientation(RtConstToken orientation)
+        {
+            m_stream.push_back(new RiCache::Orientation(orientation));
+        }
+
+        virtual RtVoid ReverseOrientation()
+        {
+            m_stream.push_back(new RiCache::ReverseOrientation());
+        }
+
+        virtual RtVoid Sides(RtInt nsides)
+        {
+            m_stream.push_back(new RiCache::Sides(nsides));
+        }
+
+        virtual RtVoid Identity()
+        {
+            m_stream.push_back(new RiCache::Identity());
+        }
+
+        virtual RtVoid Transform(RtConstMatrix transform)
+        {
+            m_stream.push_back(new RiCache::Transform(transform));
+        }
+
+        virtual RtVoid ConcatTransform(RtConstMatrix transform)
+        {
+            m_stream.push_back(new RiCache::ConcatTransform(transform));
+        }
+
+        virtual RtVoid Perspective(RtFloat fov)
+        {
+            m_stream.push_back(new RiCache::Perspective(fov));
+        }
+
+        virtual RtVoid Translate(RtFloat dx, RtFloat dy, RtFloat dz)
+        {
+            m_stream.push_back(new RiCache::Translate(dx, dy, dz));
+        }
+
+        virtual RtVoid Rotate(RtFloat angle, RtFloat dx, RtFloat dy, RtFloat dz)
+        {
+            m_stream.push_back(new RiCache::Rotate(angle, dx, dy, dz));
+        }
+
+        virtual RtVoid Scale(RtFloat sx, RtFloat sy, RtFloat sz)
+        {
+            m_stream.push_back(new RiCache::Scale(sx, sy, sz));
+        }
+
+        virtual RtVoid Skew(RtFloat angle, RtFloat dx1, RtFloat dy1, RtFloat dz1,
+                            RtFloat dx2, RtFloat dy2, RtFloat dz2)
+        {
+            m_stream.push_back(new RiCache::Skew(angle, dx1, dy1, dz1, dx2, dy2, dz2));
+        }
+
+        virtual RtVoid CoordinateSystem(RtConstToken space)
+        {
+            m_stream.push_back(new RiCache::CoordinateSystem(space));
+        }
+
+        virtual RtVoid CoordSysTransform(RtConstToken space)
+        {
+            m_stream.push_back(new RiCache::CoordSysTransform(space));
+        }
+
+        virtual RtVoid TransformBegin()
+        {
+            m_stream.push_back(new RiCache::TransformBegin());
+        }
+
+        virtual RtVoid TransformEnd()
+        {
+            m_stream.push_back(new RiCache::TransformEnd());
+        }
+
+        virtual RtVoid Resource(RtConstToken handle, RtConstToken type,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Resource(handle, type, pList));
+        }
+
+        virtual RtVoid ResourceBegin()
+        {
+            m_stream.push_back(new RiCache::ResourceBegin());
+        }
+
+        virtual RtVoid ResourceEnd()
+        {
+            m_stream.push_back(new RiCache::ResourceEnd());
+        }
+
+        virtual RtVoid Attribute(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Attribute(name, pList));
+        }
+
+        virtual RtVoid Polygon(const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Polygon(pList));
+        }
+
+        virtual RtVoid GeneralPolygon(const IntArray& nverts, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::GeneralPolygon(nverts, pList));
+        }
+
+        virtual RtVoid PointsPolygons(const IntArray& nverts, const IntArray& verts,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PointsPolygons(nverts, verts, pList));
+        }
+
+        virtual RtVoid PointsGeneralPolygons(const IntArray& nloops,
+                            const IntArray& nverts, const IntArray& verts,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PointsGeneralPolygons(nloops, nverts, verts, pList));
+        }
+
+        virtual RtVoid Basis(RtConstBasis ubasis, RtInt ustep, RtConstBasis vbasis,
+                            RtInt vstep)
+        {
+            m_stream.push_back(new RiCache::Basis(ubasis, ustep, vbasis, vstep));
+        }
+
+        virtual RtVoid Patch(RtConstToken type, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Patch(type, pList));
+        }
+
+        virtual RtVoid PatchMesh(RtConstToken type, RtInt nu, RtConstToken uwrap,
+                            RtInt nv, RtConstToken vwrap,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PatchMesh(type, nu, uwrap, nv, vwrap, pList));
+        }
+
+        virtual RtVoid NuPatch(RtInt nu, RtInt uorder, const FloatArray& uknot,
+                            RtFloat umin, RtFloat umax, RtInt nv, RtInt vorder,
+                            const FloatArray& vknot, RtFloat vmin, RtFloat vmax,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::NuPatch(nu, uorder, uknot, umin, umax, nv, vorder, vknot, vmin, vmax, pList));
+        }
+
+        virtual RtVoid TrimCurve(const IntArray& ncurves, const IntArray& order,
+                            const FloatArray& knot, const FloatArray& min,
+                            const FloatArray& max, const IntArray& n,
+                            const FloatArray& u, const FloatArray& v,
+                            const FloatArray& w)
+        {
+            m_stream.push_back(new RiCache::TrimCurve(ncurves, order, knot, min, max, n, u, v, w));
+        }
+
+        virtual RtVoid SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices,
+                            const IntArray& vertices, const TokenArray& tags,
+                            const IntArray& nargs, const IntArray& intargs,
+                            const FloatArray& floatargs,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::SubdivisionMesh(scheme, nvertices, vertices, tags, nargs, intargs, floatargs, pList));
+        }
+
+        virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                            RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Sphere(radius, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Cone(RtFloat height, RtFloat radius, RtFloat thetamax,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Cone(height, radius, thetamax, pList));
+        }
+
+        virtual RtVoid Cylinder(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                            RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Cylinder(radius, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Hyperboloid(RtConstPoint point1, RtConstPoint point2,
+                            RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Hyperboloid(point1, point2, thetamax, pList));
+        }
+
+        virtual RtVoid Paraboloid(RtFloat rmax, RtFloat zmin, RtFloat zmax,
+                            RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Paraboloid(rmax, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Disk(RtFloat height, RtFloat radius, RtFloat thetamax,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Disk(height, radius, thetamax, pList));
+        }
+
+        virtual RtVoid Torus(RtFloat majorrad, RtFloat minorrad, RtFloat phimin,
+                            RtFloat phimax, RtFloat thetamax,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Torus(majorrad, minorrad, phimin, phimax, thetamax, pList));
+        }
+
+        virtual RtVoid Points(const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Points(pList));
+        }
+
+        virtual RtVoid Curves(RtConstToken type, const IntArray& nvertices,
+                            RtConstToken wrap, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Curves(type, nvertices, wrap, pList));
+        }
+
+        virtual RtVoid Blobby(RtInt nleaf, const IntArray& code,
+                            const FloatArray& floats, const TokenArray& strings,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Blobby(nleaf, code, floats, strings, pList));
+        }
+
+        virtual RtVoid Procedural(RtPointer data, RtConstBound bound,
+                            RtProcSubdivFunc refineproc,
+                            RtProcFreeFunc freeproc)
+        {
+            m_stream.push_back(new RiCache::Procedural(data, bound, refineproc, freeproc));
+        }
+
+        virtual RtVoid Geometry(RtConstToken type, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Geometry(type, pList));
+        }
+
+        virtual RtVoid SolidBegin(RtConstToken type)
+        {
+            m_stream.push_back(new RiCache::SolidBegin(type));
+        }
+
+        virtual RtVoid SolidEnd()
+        {
+            m_stream.push_back(new RiCache::SolidEnd());
+        }
+
+        virtual RtVoid ObjectBegin(RtConstToken name)
+        {
+            m_stream.push_back(new RiCache::ObjectBegin(name));
+        }
+
+        virtual RtVoid ObjectEnd()
+        {
+            m_stream.push_back(new RiCache::ObjectEnd());
+        }
+
+        virtual RtVoid ObjectInstance(RtConstToken name)
+        {
+            m_stream.push_back(new RiCache::ObjectInstance(name));
+        }
+
+        virtual RtVoid MotionBegin(const FloatArray& times)
+        {
+            m_stream.push_back(new RiCache::MotionBegin(times));
+        }
+
+        virtual RtVoid MotionEnd()
+        {
+            m_stream.push_back(new RiCache::MotionEnd());
+        }
+
+        virtual RtVoid MakeTexture(RtConstString imagefile, RtConstString texturefile,
+                            RtConstToken swrap, RtConstToken twrap,
+                            RtFilterFunc filterfunc, RtFloat swidth,
+                            RtFloat twidth, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeTexture(imagefile, texturefile, swrap, twrap, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeLatLongEnvironment(RtConstString imagefile,
+                            RtConstString reflfile, RtFilterFunc filterfunc,
+                            RtFloat swidth, RtFloat twidth,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeLatLongEnvironment(imagefile, reflfile, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeCubeFaceEnvironment(RtConstString px, RtConstString nx,
+                            RtConstString py, RtConstString ny,
+                            RtConstString pz, RtConstString nz,
+                            RtConstString reflfile, RtFloat fov,
+                            RtFilterFunc filterfunc, RtFloat swidth,
+                            RtFloat twidth, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeCubeFaceEnvironment(px, nx, py, ny, pz, nz, reflfile, fov, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeShadow(RtConstString picfile, RtConstString shadowfile,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeShadow(picfile, shadowfile, pList));
+        }
+
+        virtual RtVoid MakeOcclusion(const StringArray& picfiles,
+                            RtConstString shadowfile, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeOcclusion(picfiles, shadowfile, pList));
+        }
+
+        virtual RtVoid ErrorHandler(RtErrorFunc handler)
+        {
+            m_stream.push_back(new RiCache::ErrorHandler(handler));
+        }
+
+        virtual RtVoid ReadArchive(RtConstToken name, RtArchiveCallback callback,
+                            const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ReadArchive(name, callback, pList));
+        }
+
+        virtual RtVoid ArchiveBegin(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ArchiveBegin(name, pList));
+        }
+
+        virtual RtVoid ArchiveEnd()
+        {
+            m_stream.push_back(new RiCache::ArchiveEnd());
+        }
+        ///[[[end]]]
+};
+
 } // namespace Aqsis
 
 #endif // AQSIS_API_CACHE_H_INCLUDED
@@ -146,8 +146,13 @@ const CqPrimvarToken standardVarsInit[] = {
 	// Option "limits"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "gridsize"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "texturememory"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "texturefiles"),
 	CqPrimvarToken(class_uniform,  type_integer, 2, "bucketsize"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "eyesplits"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "threads"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "archivethreads"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "archivememory"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "rereadarchives"),
 	CqPrimvarToken(class_uniform,  type_color,   1, "zthreshold"),
 	// Option "searchpath"
 	CqPrimvarToken(class_uniform,  type_string,  1, "shader"),
@@ -192,6 +197,8 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 1, "enabled"),
 	// Attribute "derivatives"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "centered"),
+	// Attribute "visibility"
+	CqPrimvarToken(class_uniform,  type_integer, 1, "trace"),
 
 	//--------------------------------------------------
 	// Aqsis-specific options / attributes
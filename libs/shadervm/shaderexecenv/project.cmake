@@ -16,6 +16,7 @@ set(shaderexecenv_srcs
 make_absolute(shaderexecenv_srcs ${shaderexecenv_SOURCE_DIR})
 
 set(shaderexecenv_hdrs
+	raysample.h
 	shaderexecenv.h
 )
 make_absolute(shaderexecenv_hdrs ${shaderexecenv_SOURCE_DIR})
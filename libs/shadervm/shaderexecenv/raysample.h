@@ -0,0 +1,158 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Ray direction sampling for the raytracing shadeops.
+ */
+
+#ifndef RAYSAMPLE_H_INCLUDED
+#define RAYSAMPLE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cmath>
+#include <cstring>
+
+#include <aqsis/core/iattributes.h>
+#include <aqsis/math/math.h>
+#include <aqsis/math/vector3d.h>
+
+namespace Aqsis {
+
+/** \brief Generator of cosine weighted ray directions inside a cone.
+ *
+ * Directions come from a Hammersley point set, rotated by an offset hashed
+ * from the shading position so that neighbouring points don't share the
+ * same pattern.  Unlike CqRandom this holds no global state, so separate
+ * instances may be used from several threads.
+ */
+class CqConeSampler
+{
+	public:
+		/** \brief Set up sampling about an axis.
+		 *
+		 * \param P - position the rays start from; used only to scramble
+		 *            the sample pattern.
+		 * \param axis - cone axis; need not be normalised.
+		 * \param coneAngle - half angle of the cone, at most pi/2.
+		 * \param numSamples - number of directions to be generated.
+		 */
+		CqConeSampler(const CqVector3D& P, const CqVector3D& axis,
+				TqFloat coneAngle, TqInt numSamples);
+
+		/// Get the ith of the numSamples normalised directions.
+		CqVector3D direction(TqInt i) const;
+
+	private:
+		static TqUint hash(TqUint x);
+		static TqFloat radicalInverse(TqUint i);
+
+		CqVector3D m_axis;
+		CqVector3D m_tangent;
+		CqVector3D m_bitangent;
+		TqFloat m_sinMax2;
+		TqInt m_numSamples;
+		TqFloat m_offset1;
+		TqFloat m_offset2;
+};
+
+/** \brief Distance by which traced rays are started away from their origin.
+ *
+ * This avoids surfaces intersecting themselves.  It's taken from Attribute
+ * "trace" "bias".
+ */
+inline TqFloat traceBias(const IqAttributes* attributes)
+{
+	const TqFloat* bias = attributes ? attributes->GetFloatAttribute("trace", "bias") : 0;
+	return bias ? bias[0] : 0.01f;
+}
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline CqConeSampler::CqConeSampler(const CqVector3D& P, const CqVector3D& axis,
+		TqFloat coneAngle, TqInt numSamples)
+	: m_axis(axis),
+	m_tangent(),
+	m_bitangent(),
+	m_sinMax2(0),
+	m_numSamples(max(numSamples, 1)),
+	m_offset1(0),
+	m_offset2(0)
+{
+	m_axis.Unit();
+	// Any vector not parallel to the axis will do to build the frame.
+	if(std::fabs(m_axis.x()) < 0.5f)
+		m_tangent = m_axis % CqVector3D(1,0,0);
+	else
+		m_tangent = m_axis % CqVector3D(0,1,0);
+	m_tangent.Unit();
+	m_bitangent = m_axis % m_tangent;
+	TqFloat sinMax = std::sin(clamp(coneAngle, 0.0f, TqFloat(M_PI_2)));
+	m_sinMax2 = sinMax*sinMax;
+	// Hash the bits of the position into a pair of offsets in [0,1)
+	TqUint bits[3];
+	TqFloat coords[3] = {P.x(), P.y(), P.z()};
+	std::memcpy(bits, coords, sizeof(bits));
+	TqUint h = hash(bits[0] ^ hash(bits[1] ^ hash(bits[2])));
+	m_offset1 = (h & 0xffff)/65536.0f;
+	m_offset2 = (h >> 16)/65536.0f;
+}
+
+inline CqVector3D CqConeSampler::direction(TqInt i) const
+{
+	TqFloat u1 = (i + 0.5f)/m_numSamples + m_offset1;
+	TqFloat u2 = radicalInverse(i) + m_offset2;
+	u1 -= std::floor(u1);
+	u2 -= std::floor(u2);
+	// Cosine weighted directions: sin^2(theta) is uniform on [0, sinMax^2].
+	TqFloat sinTheta2 = u1*m_sinMax2;
+	TqFloat sinTheta = std::sqrt(sinTheta2);
+	TqFloat cosTheta = std::sqrt(max(0.0f, 1 - sinTheta2));
+	TqFloat phi = 2*M_PI*u2;
+	return cosTheta*m_axis + sinTheta*std::cos(phi)*m_tangent
+		+ sinTheta*std::sin(phi)*m_bitangent;
+}
+
+inline TqUint CqConeSampler::hash(TqUint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+inline TqFloat CqConeSampler::radicalInverse(TqUint i)
+{
+	// Reverse the bits of i to get the base 2 van der Corput sequence.
+	i = (i << 16) | (i >> 16);
+	i = ((i & 0x00ff00ffU) << 8) | ((i & 0xff00ff00U) >> 8);
+	i = ((i & 0x0f0f0f0fU) << 4) | ((i & 0xf0f0f0f0U) >> 4);
+	i = ((i & 0x33333333U) << 2) | ((i & 0xccccccccU) >> 2);
+	i = ((i & 0x55555555U) << 1) | ((i & 0xaaaaaaaaU) >> 1);
+	return i * (1.0f/4294967296.0f);
+}
+
+} // namespace Aqsis
+
+#endif // RAYSAMPLE_H_INCLUDED
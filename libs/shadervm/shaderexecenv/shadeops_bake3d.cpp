@@ -25,6 +25,7 @@
 #include <cstring>
 
 #include <Partio.h>
+#include <boost/thread/mutex.hpp>
 
 #include "shaderexecenv.h"
 
@@ -228,9 +229,16 @@ class Texture3dCache
 // TODO: Make non-global
 static Bake3dCache g_bakeCloudCache;
 static Texture3dCache g_texture3dCloudCache;
+// Grids are shaded concurrently.  The bake mutex covers the cache and the
+// point clouds in it, since bake3d() appends to them; texture3d() only reads
+// the clouds once they're loaded and sorted.
+static boost::mutex g_bakeCloudMutex;
+static boost::mutex g_texture3dCloudMutex;
 
 void flushBake3dCache()
 {
+    boost::mutex::scoped_lock bakeLock(g_bakeCloudMutex);
+    boost::mutex::scoped_lock texture3dLock(g_texture3dCloudMutex);
     g_bakeCloudCache.flush();
     g_texture3dCloudCache.clear();
 }
@@ -260,6 +268,7 @@ void CqShaderExecEnv::SO_bake3d( IqShaderData* ptc,
     const CqBitVector& RS = RunningState();
     CqString ptcName;
     ptc->GetString(ptcName);
+    boost::mutex::scoped_lock lock(g_bakeCloudMutex);
     // Find point cloud in cache, or create it if it doesn't exist.
     Partio::ParticlesDataMutable* pointFile = g_bakeCloudCache.find(ptcName);
     bool varying = position->Class() == class_varying ||
@@ -581,7 +590,11 @@ void CqShaderExecEnv::SO_texture3d(IqShaderData* ptc,
     CqString ptcName;
     ptc->GetString(ptcName);
 
-    Partio::ParticlesData* pointFile = g_texture3dCloudCache.find(ptcName);
+    Partio::ParticlesData* pointFile = 0;
+    {
+        boost::mutex::scoped_lock lock(g_texture3dCloudMutex);
+        pointFile = g_texture3dCloudCache.find(ptcName);
+    }
     bool varying = position->Class() == class_varying ||
                    normal->Class() == class_varying ||
                    Result->Class() == class_varying;
@@ -24,12 +24,15 @@
 */
 
 
+#include	<cfloat>
 #include	<string>
 #include	<stdio.h>
 
 #include	<aqsis/math/math.h>
 #include	"shaderexecenv.h"
+#include	"raysample.h"
 #include	<aqsis/core/ilightsource.h>
+#include	<aqsis/core/iraytrace.h>
 
 #include	"../../pointrender/microbuf_proj_func.h"
 
@@ -402,6 +405,7 @@ void CqShaderExecEnv::SO_ambient( IqShaderData* Result, IqShader* pShader )
 			IqLightsource* lp = m_pAttributes ->pLight( light_index );
 			if ( lp->pShader() ->fAmbient() )
 			{
+				IqShaderData* lightCl = lp->Cl();
 				__iGrid = 0;
 				const CqBitVector& RS = RunningState();
 				do
@@ -412,8 +416,8 @@ void CqShaderExecEnv::SO_ambient( IqShaderData* Result, IqShader* pShader )
 						CqColor _aq_Result;
 						(Result)->GetColor(_aq_Result,__iGrid);
 						CqColor colCl;
-						if ( NULL != lp->Cl() )
-							lp->Cl() ->GetColor( colCl, __iGrid );
+						if ( NULL != lightCl )
+							lightCl ->GetColor( colCl, __iGrid );
 						(Result)->SetColor(_aq_Result + colCl,__iGrid);
 
 					}
@@ -720,13 +724,30 @@ void CqShaderExecEnv::SO_trace( IqShaderData* P, IqShaderData* R, IqShaderData*
 	__fVarying=(R)->Class()==class_varying||__fVarying;
 	__fVarying=(Result)->Class()==class_varying||__fVarying;
 
+	const IqRaytrace* raytracer = getRenderContext() ? getRenderContext()->pRaytracer() : 0;
+	TqFloat bias = traceBias(m_pAttributes.get());
+
 	__iGrid = 0;
 	const CqBitVector& RS = RunningState();
 	do
 	{
 		if(!__fVarying || RS.Value( __iGrid ) )
 		{
-			(Result)->SetColor(CqColor( 0, 0, 0 ),__iGrid);
+			// Traced surfaces aren't shaded, so the colour returned is
+			// that of the surface hit.
+			CqColor col(0, 0, 0);
+			CqVector3D _aq_P;
+			(P)->GetPoint(_aq_P,__iGrid);
+			CqVector3D _aq_R;
+			(R)->GetVector(_aq_R,__iGrid);
+			SqRayHit hit;
+			if(raytracer && _aq_R.Magnitude2() > 0)
+			{
+				_aq_R.Unit();
+				if(raytracer->intersect(_aq_P + bias*_aq_R, _aq_R, FLT_MAX, hit))
+					col = hit.color;
+			}
+			(Result)->SetColor(col,__iGrid);
 		}
 	}
 	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
@@ -808,6 +829,10 @@ void CqShaderExecEnv::SO_illuminance( IqShaderData* Category, IqShaderData* P, I
 
 		if( exec )
 		{
+			// The light's variables are looked up per thread, so fetch
+			// them once for the grid.
+			IqShaderData* lightL = lp->L();
+			IqShaderData* lightCl = lp->Cl();
 			__iGrid = 0;
 			const CqBitVector& RS = RunningState();
 			do
@@ -816,13 +841,13 @@ void CqShaderExecEnv::SO_illuminance( IqShaderData* Category, IqShaderData* P, I
 				{
 
 					CqVector3D Ln;
-					lp->L() ->GetVector( Ln, __iGrid );
+					lightL ->GetVector( Ln, __iGrid );
 					Ln = -Ln;
 
 					// Store them locally on the surface.
 					L() ->SetVector( Ln, __iGrid );
 					CqColor colCl;
-					lp->Cl() ->GetColor( colCl, __iGrid );
+					lightCl ->GetColor( colCl, __iGrid );
 					Cl() ->SetColor( colCl, __iGrid );
 
 					// Check if its within the cone.
@@ -966,17 +991,81 @@ void CqShaderExecEnv::SO_gather( IqShaderData* category, IqShaderData* P, IqShad
 	bool __fVarying;
 	TqUint __iGrid;
 
+	const IqRaytrace* raytracer = getRenderContext() ? getRenderContext()->pRaytracer() : 0;
+	TqFloat bias = traceBias(m_pAttributes.get());
+	TqFloat maxDist = FLT_MAX;
+
+	// Sort the optional parameters into inputs and requested outputs.
+	IqShaderData* rayLength = 0;
+	IqShaderData* rayDirection = 0;
+	IqShaderData* surfaceColor = 0;
+	IqShaderData* surfaceOpacity = 0;
+	IqShaderData* surfaceNormal = 0;
+	CqString paramName;
+	for(int i = 0; i < cParams; i+=2)
+	{
+		apParams[i]->GetString(paramName, 0);
+		IqShaderData* paramValue = apParams[i+1];
+		if(paramName == "bias" && paramValue->Type() == type_float)
+			paramValue->GetFloat(bias);
+		else if(paramName == "maxdist" && paramValue->Type() == type_float)
+			paramValue->GetFloat(maxDist);
+		else if(paramName == "ray:length" && paramValue->Type() == type_float)
+			rayLength = paramValue;
+		else if(paramName == "ray:direction" && paramValue->Type() == type_vector)
+			rayDirection = paramValue;
+		else if((paramName == "surface:Ci" || paramName == "surface:Cs")
+				&& paramValue->Type() == type_color)
+			surfaceColor = paramValue;
+		else if((paramName == "surface:Oi" || paramName == "surface:Os")
+				&& paramValue->Type() == type_color)
+			surfaceOpacity = paramValue;
+		else if((paramName == "surface:N" || paramName == "surface:Ng"
+					|| paramName == "primitive:N")
+				&& paramValue->Type() == type_normal)
+			surfaceNormal = paramValue;
+	}
+
+	// The gather loop counts m_gatherSample down from the number of samples.
+	TqFloat _aq_samples;
+	(samples)->GetFloat(_aq_samples,0);
+	TqInt numSamples = static_cast<TqInt>(_aq_samples);
+	TqInt sampleIndex = numSamples - static_cast<TqInt>(m_gatherSample);
+
 	__iGrid = 0;
 	__fVarying = true;
 	const CqBitVector& RS = RunningState();
 	do
 	{
-		if(!__fVarying || RS.Value( __iGrid ) )
+		bool isHit = false;
+		if(RS.Value( __iGrid ) )
 		{
-			m_CurrentState.SetValue( __iGrid, false );
+			CqVector3D _aq_P;
+			(P)->GetPoint(_aq_P,__iGrid);
+			CqVector3D _aq_N;
+			(N)->GetVector(_aq_N,__iGrid);
+			TqFloat _aq_angle;
+			(angle)->GetFloat(_aq_angle,__iGrid);
+
+			CqVector3D dir = CqConeSampler(_aq_P, _aq_N, _aq_angle,
+					numSamples).direction(sampleIndex);
+			if(rayDirection)
+				rayDirection->SetVector(dir, __iGrid);
+			SqRayHit hit;
+			if(raytracer && raytracer->intersect(_aq_P + bias*dir, dir, maxDist, hit))
+			{
+				isHit = true;
+				if(rayLength)
+					rayLength->SetFloat(hit.distance + bias, __iGrid);
+				if(surfaceColor)
+					surfaceColor->SetColor(hit.color, __iGrid);
+				if(surfaceOpacity)
+					surfaceOpacity->SetColor(hit.opacity, __iGrid);
+				if(surfaceNormal)
+					surfaceNormal->SetNormal(hit.normal, __iGrid);
+			}
 		}
-		else
-			m_CurrentState.SetValue( __iGrid, false );
+		m_CurrentState.SetValue( __iGrid, isHit );
 	}
 	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
 }
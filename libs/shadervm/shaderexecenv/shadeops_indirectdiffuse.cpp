@@ -23,12 +23,17 @@
 		\author Paul C. Gregory (pgregory@aqsis.org)
 */
 
+#include	<cfloat>
 #include	<string>
 #include	<stdio.h>
 
 #include	<aqsis/math/math.h>
 #include	<aqsis/core/ilightsource.h>
+#include	<aqsis/core/iraytrace.h>
 #include	"shaderexecenv.h"
+#include	"raysample.h"
+
+#include <boost/thread/mutex.hpp>
 
 #include <OpenEXR/ImathMath.h>
 #include <OpenEXR/ImathVec.h>
@@ -71,9 +76,13 @@ void storeZeroResult<RadiosityIntegrator>(IqShaderData* result, int igrid)
 // Missing cache features:
 // * Ri search paths
 static DiffusePointOctreeCache g_pointOctreeCache;
+// Guards g_pointOctreeCache; the octrees themselves are read-only once
+// loaded, so concurrently shaded grids may share them.
+static boost::mutex g_pointOctreeCacheMutex;
 
 void clearPointCloudCache()
 {
+	boost::mutex::scoped_lock lock(g_pointOctreeCacheMutex);
 	g_pointOctreeCache.clear();
 }
 
@@ -111,6 +120,7 @@ void CqShaderExecEnv::pointCloudIntegrate(IqShaderData* P, IqShaderData* N,
 			{
 				CqString fileName;
 				paramValue->GetString(fileName, 0);
+				boost::mutex::scoped_lock lock(g_pointOctreeCacheMutex);
 				pointTree = g_pointOctreeCache.find(fileName);
 			}
 		}
@@ -273,11 +283,75 @@ static void storeIntegratedResult(const OcclusionIntegrator& integrator,
 	result->SetFloat(integrator.occlusion(N, coneAngle), igrid);
 }
 
+void CqShaderExecEnv::traceOcclusion(const IqRaytrace& raytracer,
+									  IqShaderData* P, IqShaderData* N,
+									  IqShaderData* samples,
+									  IqShaderData* result, int cParams,
+									  IqShaderData** apParams)
+{
+	CqString paramName;
+	float coneAngle = M_PI_2;
+	float bias = traceBias(m_pAttributes.get());
+	float maxDist = FLT_MAX;
+	for(int i = 0; i < cParams; i+=2)
+	{
+		apParams[i]->GetString(paramName, 0);
+		IqShaderData* paramValue = apParams[i+1];
+		if(paramValue->Type() != type_float)
+			continue;
+		if(paramName == "coneangle")
+			paramValue->GetFloat(coneAngle);
+		else if(paramName == "bias")
+			paramValue->GetFloat(bias);
+		else if(paramName == "maxdist")
+			paramValue->GetFloat(maxDist);
+	}
+
+	bool varying = result->Class() == class_varying;
+	const CqBitVector& RS = RunningState();
+	TqUint igrid = 0;
+	do
+	{
+		if(!varying || RS.Value(igrid))
+		{
+			CqVector3D Pval;  P->GetPoint(Pval, igrid);
+			CqVector3D Nval;  N->GetNormal(Nval, igrid);
+			float samplesVal = 1;
+			samples->GetFloat(samplesVal, igrid);
+			int numSamples = std::max(1, static_cast<int>(samplesVal));
+			CqConeSampler sampler(Pval, Nval, coneAngle, numSamples);
+			int numHits = 0;
+			for(int i = 0; i < numSamples; ++i)
+			{
+				CqVector3D dir = sampler.direction(i);
+				if(raytracer.occluded(Pval + bias*dir, dir, maxDist))
+					++numHits;
+			}
+			result->SetFloat(static_cast<float>(numHits)/numSamples, igrid);
+		}
+	}
+	while( ( ++igrid < shadingPointCount() ) && varying);
+}
+
 // occlusion(P,N,samples)
 void CqShaderExecEnv::SO_occlusion_rt( IqShaderData* P, IqShaderData* N, IqShaderData* samples, IqShaderData* Result, IqShader* pShader, int cParams, IqShaderData** apParams )
 {
-	pointCloudIntegrate<OcclusionIntegrator>(P, N, Result, cParams, apParams,
-											 pShader);
+	// Occlusion comes from a point cloud when one is named, otherwise from
+	// tracing rays against the scene.
+	bool usePointCloud = false;
+	CqString paramName;
+	for(int i = 0; i < cParams; i+=2)
+	{
+		apParams[i]->GetString(paramName, 0);
+		if(paramName == "filename")
+			usePointCloud = true;
+	}
+	const IqRaytrace* raytracer = getRenderContext() ? getRenderContext()->pRaytracer() : 0;
+	if(!usePointCloud && raytracer)
+		traceOcclusion(*raytracer, P, N, samples, Result, cParams, apParams);
+	else
+		pointCloudIntegrate<OcclusionIntegrator>(P, N, Result, cParams,
+												 apParams, pShader);
 }
 
 
@@ -28,6 +28,7 @@
 
 #include <aqsis/math/math.h>
 #include "shaderexecenv.h"
+#include "../simdops.h"
 #include <aqsis/util/logging.h>
 
 namespace Aqsis {
@@ -92,6 +93,21 @@ inline void domainError(const char* funcName, IqShaderData* var1, IqShaderData*
 	out << ") is undefined, result has been set to zero\n";
 }
 
+/// Apply op lane-wise to a, b and then each of the additional parameters.
+template<typename OpT>
+bool simdFold(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a, IqShaderData* b, int cParams, IqShaderData** apParams)
+{
+	if(!simdApply(op, res, mask, a, b))
+		return false;
+	for(int i = 0; i < cParams; ++i)
+	{
+		if(!simdApply(op, res, mask, res, apParams[i]))
+			return false;
+	}
+	return true;
+}
+
 } // unnamed namespace
 
 void	CqShaderExecEnv::SO_radians( IqShaderData* degrees, IqShaderData* Result, IqShader* pShader )
@@ -496,6 +512,9 @@ void	CqShaderExecEnv::SO_log( IqShaderData* x, IqShaderData* base, IqShaderData*
 
 void	CqShaderExecEnv::SO_abs( IqShaderData* x, IqShaderData* Result, IqShader* pShader )
 {
+	if(simdApply(SqSimdAbs(), Result, RunningState(), x))
+		return;
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -544,6 +563,9 @@ void	CqShaderExecEnv::SO_sign( IqShaderData* x, IqShaderData* Result, IqShader*
 
 void	CqShaderExecEnv::SO_min( IqShaderData* a, IqShaderData* b, IqShaderData* Result, IqShader* pShader, int cParams, IqShaderData** apParams )
 {
+	if(simdFold(SqSimdMin(), Result, RunningState(), a, b, cParams, apParams))
+		return;
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -576,6 +598,9 @@ void	CqShaderExecEnv::SO_min( IqShaderData* a, IqShaderData* b, IqShaderData* Re
 
 void	CqShaderExecEnv::SO_max( IqShaderData* a, IqShaderData* b, IqShaderData* Result, IqShader* pShader, int cParams, IqShaderData** apParams )
 {
+	if(simdFold(SqSimdMax(), Result, RunningState(), a, b, cParams, apParams))
+		return;
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -736,6 +761,9 @@ void	CqShaderExecEnv::SO_cmax( IqShaderData* a, IqShaderData* b, IqShaderData* R
 
 void	CqShaderExecEnv::SO_clamp( IqShaderData* a, IqShaderData* _min, IqShaderData* _max, IqShaderData* Result, IqShader* pShader )
 {
+	if(simdApply(SqSimdClamp(), Result, RunningState(), a, _min, _max))
+		return;
+
 	bool __fVarying;
 	TqUint __iGrid;
 
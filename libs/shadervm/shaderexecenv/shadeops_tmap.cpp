@@ -31,9 +31,12 @@
 
 #include	<map>
 #include	<string>
+#include	<vector>
 #include	<cstdio>
 #include	<cstring>
 
+#include	<boost/thread/mutex.hpp>
+
 #include	"shaderexecenv.h"
 #include	<aqsis/tex/filtering/ienvironmentsampler.h>
 #include	<aqsis/tex/filtering/iocclusionsampler.h>
@@ -185,6 +188,12 @@ class CqSampleOptionExtractorBase
 		/// Null destructor
 		virtual ~CqSampleOptionExtractorBase() {}
 
+		/// Determine whether any of the options vary across the grid.
+		bool hasVaryingOptions() const
+		{
+			return m_sBlur || m_tBlur || m_channel;
+		}
+
 		/** \brief Extract texture sample options from cached parameters
 		 *
 		 * \param gridIdx - index into varying shader parameter data.
@@ -255,9 +264,63 @@ class CqSampleOptionExtractor
 		}
 
 		using CqSampleOptionExtractorBase<CqTextureSampleOptions>::extractVarying;
+		using CqSampleOptionExtractorBase<CqTextureSampleOptions>::hasVaryingOptions;
 };
 
 
+/// Number of regions at the start of a grid whose tiles aren't prefetched.
+const TqInt numDirectlyReadRegions = 8;
+
+//------------------------------------------------------------------------------
+/** \brief Filter a texture over the regions for the running points of a grid.
+ *
+ * Regions are filtered in grid order, and the tiles they cover are queued for
+ * reading in the same order, so that the I/O threads work ahead of the
+ * filtering.  The tiles of the first few regions are needed straight away, so
+ * they're left for the filtering to read directly rather than queued.  When
+ * no options vary, the regions are filtered as a single batch; otherwise the
+ * varying options are extracted for each point before it's filtered.
+ *
+ * \param texSampler - texture to filter
+ * \param regions - filter regions for the running points, in grid order.
+ * \param RS - running state of the grid
+ * \param optExtractor - extractor for varying options
+ * \param sampleOpts - sample options; varying options are overwritten.
+ * \param texSamples - filled with sampleOpts.numChannels() results per region.
+ */
+void sampleTextureRegions(const IqTextureSampler& texSampler,
+		const std::vector<SqSamplePllgram>& regions, const CqBitVector& RS,
+		CqSampleOptionExtractor& optExtractor, CqTextureSampleOptions& sampleOpts,
+		std::vector<TqFloat>& texSamples)
+{
+	const TqInt numRegions = regions.size();
+	const TqInt numChannels = sampleOpts.numChannels();
+	texSamples.resize(numRegions*numChannels);
+	if(numRegions == 0)
+		return;
+	const TqInt numDirect = min(numRegions, numDirectlyReadRegions);
+	if(numDirect < numRegions)
+		texSampler.prefetch(&regions[numDirect], numRegions - numDirect, sampleOpts);
+	if(!optExtractor.hasVaryingOptions())
+	{
+		// Filter all the points together.
+		texSampler.sampleBatch(&regions[0], numRegions, sampleOpts,
+				&texSamples[0]);
+		return;
+	}
+	for(TqInt gridIdx = 0, regionIdx = 0; regionIdx < numRegions; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+		{
+			optExtractor.extractVarying(gridIdx, sampleOpts);
+			texSampler.sample(regions[regionIdx], sampleOpts,
+					&texSamples[regionIdx*numChannels]);
+			++regionIdx;
+		}
+	}
+}
+
+
 //------------------------------------------------------------------------------
 class CqShadowOptionExtractor
 	: private CqSampleOptionExtractorBase<CqShadowSampleOptions>
@@ -334,6 +397,13 @@ class CqShadowOptionExtractor
 			}
 			CqSampleOptionExtractorBase<CqShadowSampleOptions>::extractVarying(gridIdx, opts);
 		}
+
+		/// Determine whether any of the options vary across the grid.
+		bool hasVaryingOptions() const
+		{
+			return m_biasLow || m_biasHigh
+				|| CqSampleOptionExtractorBase<CqShadowSampleOptions>::hasVaryingOptions();
+		}
 };
 
 
@@ -352,6 +422,60 @@ void getRenderContextShadowOpts(const IqRenderer& context, CqShadowSampleOptions
 
 } // unnamed namespace.
 
+//----------------------------------------------------------------------
+// Texture helpers
+void CqShaderExecEnv::textureRegions(IqShaderData* s, IqShaderData* t,
+		std::vector<SqSamplePllgram>& regions)
+{
+	const CqBitVector& RS = RunningState();
+	const TqInt numPoints = shadingPointCount();
+	regions.reserve(numPoints);
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+		{
+			// Edges of region to be filtered.
+			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
+			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
+			// Centre of the texture region to be filtered.
+			TqFloat ss = 0;
+			TqFloat tt = 0;
+			s->GetFloat(ss,gridIdx);
+			t->GetFloat(tt,gridIdx);
+			regions.push_back(SqSamplePllgram(CqVector2D(ss,tt), diffUst, diffVst));
+		}
+	}
+}
+
+void CqShaderExecEnv::textureRegions(IqShaderData* s1, IqShaderData* t1,
+		IqShaderData* s2, IqShaderData* t2, IqShaderData* s3, IqShaderData* t3,
+		IqShaderData* s4, IqShaderData* t4, std::vector<SqSamplePllgram>& regions)
+{
+	const CqBitVector& RS = RunningState();
+	const TqInt numPoints = shadingPointCount();
+	regions.reserve(numPoints);
+	for(TqInt gridIdx = 0; gridIdx < numPoints; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+		{
+			// Compute the sample quadrilateral box.  Unfortunately we need all
+			// these temporaries because the shader data interface leaves a bit
+			// to be desired ;-)
+			TqFloat s1Val = 0;  s1->GetFloat(s1Val, gridIdx);
+			TqFloat s2Val = 0;  s2->GetFloat(s2Val, gridIdx);
+			TqFloat s3Val = 0;  s3->GetFloat(s3Val, gridIdx);
+			TqFloat s4Val = 0;  s4->GetFloat(s4Val, gridIdx);
+			TqFloat t1Val = 0;  t1->GetFloat(t1Val, gridIdx);
+			TqFloat t2Val = 0;  t2->GetFloat(t2Val, gridIdx);
+			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
+			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
+			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
+					CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
+			regions.push_back(SqSamplePllgram(sampleQuad));
+		}
+	}
+}
+
 //----------------------------------------------------------------------
 // texture(S)
 void CqShaderExecEnv::SO_ftexture1( IqShaderData* name, IqShaderData* Result, IqShader* pShader, TqInt cParams, IqShaderData** apParams )
@@ -385,27 +509,23 @@ void CqShaderExecEnv::SO_ftexture2(IqShaderData* name, IqShaderData* s, IqShader
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Compute the filter regions for the whole grid up front, so that they
+	// can be prefetched ahead of the filtering.
+	std::vector<SqSamplePllgram> regions;
+	textureRegions(s, t, regions);
+
 	const CqBitVector& RS = RunningState();
+	std::vector<TqFloat> texSamples;
+	sampleTextureRegions(texSampler, regions, RS, optExtractor, sampleOpts,
+			texSamples);
+
 	gridIdx = 0;
+	TqInt regionIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
-			// Edges of region to be filtered.
-			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
-			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
-			// Centre of the texture region to be filtered.
-			TqFloat ss = 0;
-			TqFloat tt = 0;
-			s->GetFloat(ss,gridIdx);
-			t->GetFloat(tt,gridIdx);
-			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(region, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
+			Result->SetFloat(texSamples[regionIdx++], gridIdx);
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
@@ -437,31 +557,23 @@ void CqShaderExecEnv::SO_ftexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Compute the filter regions for the whole grid up front, so that they
+	// can be prefetched ahead of the filtering.
+	std::vector<SqSamplePllgram> regions;
+	textureRegions(s1, t1, s2, t2, s3, t3, s4, t4, regions);
+
 	const CqBitVector& RS = RunningState();
+	std::vector<TqFloat> texSamples;
+	sampleTextureRegions(texSampler, regions, RS, optExtractor, sampleOpts,
+			texSamples);
+
 	gridIdx = 0;
+	TqInt regionIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
-			// Compute the sample quadrilateral box.  Unfortunately we need all
-			// these temporaries because the shader data interface leaves a bit
-			// to be desired ;-)
-			TqFloat s1Val = 0;  s1->GetFloat(s1Val, gridIdx);
-			TqFloat s2Val = 0;  s2->GetFloat(s2Val, gridIdx);
-			TqFloat s3Val = 0;  s3->GetFloat(s3Val, gridIdx);
-			TqFloat s4Val = 0;  s4->GetFloat(s4Val, gridIdx);
-			TqFloat t1Val = 0;  t1->GetFloat(t1Val, gridIdx);
-			TqFloat t2Val = 0;  t2->GetFloat(t2Val, gridIdx);
-			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
-			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
-			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
-						CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(sampleQuad, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
+			Result->SetFloat(texSamples[regionIdx++], gridIdx);
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
@@ -500,28 +612,26 @@ void CqShaderExecEnv::SO_ctexture2( IqShaderData* name, IqShaderData* s, IqShade
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Compute the filter regions for the whole grid up front, so that they
+	// can be prefetched ahead of the filtering.
+	std::vector<SqSamplePllgram> regions;
+	textureRegions(s, t, regions);
+
 	const CqBitVector& RS = RunningState();
+	std::vector<TqFloat> texSamples;
+	sampleTextureRegions(texSampler, regions, RS, optExtractor, sampleOpts,
+			texSamples);
+
 	gridIdx = 0;
+	TqInt regionIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
-			// Edges of region to be filtered.
-			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
-			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
-			// Centre of the texture region to be filtered.
-			TqFloat ss = 0;
-			TqFloat tt = 0;
-			s->GetFloat(ss,gridIdx);
-			t->GetFloat(tt,gridIdx);
-			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(region, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
+			CqColor resultCol(texSamples[3*regionIdx], texSamples[3*regionIdx+1],
+					texSamples[3*regionIdx+2]);
 			Result->SetColor(resultCol, gridIdx);
+			++regionIdx;
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
@@ -553,31 +663,26 @@ void CqShaderExecEnv::SO_ctexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Compute the filter regions for the whole grid up front, so that they
+	// can be prefetched ahead of the filtering.
+	std::vector<SqSamplePllgram> regions;
+	textureRegions(s1, t1, s2, t2, s3, t3, s4, t4, regions);
+
 	const CqBitVector& RS = RunningState();
+	std::vector<TqFloat> texSamples;
+	sampleTextureRegions(texSampler, regions, RS, optExtractor, sampleOpts,
+			texSamples);
+
 	gridIdx = 0;
+	TqInt regionIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
-			// Compute the sample quadrilateral box.  Unfortunately we need all
-			// these temporaries because the shader data interface leaves a bit
-			// to be desired ;-)
-			TqFloat s1Val = 0;  s1->GetFloat(s1Val, gridIdx);
-			TqFloat s2Val = 0;  s2->GetFloat(s2Val, gridIdx);
-			TqFloat s3Val = 0;  s3->GetFloat(s3Val, gridIdx);
-			TqFloat s4Val = 0;  s4->GetFloat(s4Val, gridIdx);
-			TqFloat t1Val = 0;  t1->GetFloat(t1Val, gridIdx);
-			TqFloat t2Val = 0;  t2->GetFloat(t2Val, gridIdx);
-			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
-			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
-			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
-					CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(sampleQuad, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
+			CqColor resultCol(texSamples[3*regionIdx], texSamples[3*regionIdx+1],
+					texSamples[3*regionIdx+2]);
 			Result->SetColor(resultCol, gridIdx);
+			++regionIdx;
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
@@ -957,7 +1062,9 @@ void CqShaderExecEnv::SO_shadow1( IqShaderData* name, IqShaderData* P1, IqShader
 // SIGGRAPH 2002; Larry G. Bake functions
 
 const int batchsize = 10240; // elements to buffer before writing
-// Make sure we're thread-safe on those file writes
+// Make sure we're thread-safe on those file writes (and on Existing below),
+// since grids are shaded concurrently.
+static boost::mutex g_bakeMutex;
 
 class BakingChannel
 {
@@ -1012,6 +1119,7 @@ class BakingChannel
 
 			if ( buffered > 0 && filename != NULL )
 			{
+				boost::mutex::scoped_lock lock(g_bakeMutex);
 				FILE * file = fopen ( filename, "a" );
 				float *f = data;
 				if (!fseek(file, 0, SEEK_END) && ftell(file) == 0)
@@ -1054,15 +1162,18 @@ extern "C" void bake ( BakingData *bd, const std::string &name,
 	                       float s, float t, int elsize, float *data )
 {
 	BakingData::iterator found = bd->find ( name );
-	BakingAccess::iterator exist = Existing->find ( name );
-
-        if (exist == Existing->end())
 	{
-		// Erase the bake file if they were not managed yet.
-		// The bake file must be already processed earlier and 
-		// it is time to start from stratch.
-		unlink ( name.c_str() );
-		(*Existing)[ name ] = true;
+		boost::mutex::scoped_lock lock(g_bakeMutex);
+		BakingAccess::iterator exist = Existing->find ( name );
+
+		if (exist == Existing->end())
+		{
+			// Erase the bake file if they were not managed yet.
+			// The bake file must be already processed earlier and 
+			// it is time to start from stratch.
+			unlink ( name.c_str() );
+			(*Existing)[ name ] = true;
+		}
 	}
 	if ( found == bd->end() )
 	{
@@ -1327,30 +1438,60 @@ void CqShaderExecEnv::SO_occlusion(IqShaderData* name, IqShaderData* P, IqShader
 	CqShadowOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
-	gridIdx = 0;
-	do
+	const TqInt numPoints = shadingPointCount();
+	// Regions and normals for the running points.
+	std::vector<Sq3DSamplePllgram> regions;
+	std::vector<CqVector3D> normals;
+	regions.reserve(numPoints);
+	normals.reserve(numPoints);
+	for(gridIdx = 0; gridIdx < numPoints; ++gridIdx)
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Get normal to region.
 			CqVector3D NN;
 			N->GetNormal(NN, gridIdx);
+			normals.push_back(NN);
 			// Get texture region to be filtered.
 			CqVector3D PP;
 			P->GetPoint(PP, gridIdx);
-			Sq3DSamplePllgram region(
+			regions.push_back(Sq3DSamplePllgram(
 				PP,
 				diffU<CqVector3D>(P, gridIdx),
 				diffV<CqVector3D>(P, gridIdx)
-			);
-			// length-1 "array" where filtered results will be placed.
-			TqFloat occSample = 0;
-			occSampler.sample(region, NN, sampleOpts, &occSample);
-			Result->SetFloat(occSample, gridIdx);
+			));
 		}
 	}
-	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+	const TqInt numRegions = regions.size();
+	if(numRegions == 0)
+		return;
+	std::vector<TqFloat> occSamples(numRegions, 0);
+	if(!optExtractor.hasVaryingOptions())
+	{
+		// Sample all the points together, one map view at a time.
+		occSampler.sampleBatch(&regions[0], &normals[0], numRegions,
+				sampleOpts, &occSamples[0]);
+	}
+	else
+	{
+		gridIdx = 0;
+		for(TqInt regionIdx = 0; regionIdx < numRegions; ++gridIdx)
+		{
+			if(RS.Value(gridIdx))
+			{
+				optExtractor.extractVarying(gridIdx, sampleOpts);
+				occSampler.sample(regions[regionIdx], normals[regionIdx],
+						sampleOpts, &occSamples[regionIdx]);
+				++regionIdx;
+			}
+		}
+	}
+	gridIdx = 0;
+	for(TqInt regionIdx = 0; regionIdx < numRegions; ++gridIdx)
+	{
+		if(RS.Value(gridIdx))
+			Result->SetFloat(occSamples[regionIdx++], gridIdx);
+	}
 }
 
 //----------------------------------------------------------------------
@@ -1405,6 +1546,7 @@ void CqShaderExecEnv::SO_textureinfo( IqShaderData* name, IqShaderData* dataName
 					formatStr = "environment";
 					break;
 				case TextureFormat_Shadow:
+				case TextureFormat_ShadowDepthRange:
 					formatStr = "shadow";
 					break;
 				case TextureFormat_Occlusion:
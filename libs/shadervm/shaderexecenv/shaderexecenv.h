@@ -53,6 +53,8 @@
 
 namespace Aqsis {
 
+struct SqSamplePllgram;
+
 //----------------------------------------------------------------------
 /** \class CqShaderExecEnv
  * Standard shader execution environment. Contains standard variables, and provides SIMD functionality.
@@ -383,6 +385,34 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 								 IqShaderData* result, int cParams,
 								 IqShaderData** apParams, IqShader* pShader);
 
+		/// Helper function for SO_occlusion_rt.
+		///
+		/// Computes occlusion by tracing rays against the geometry held by
+		/// the raytracer, using the parameters in the apParams list.
+		void traceOcclusion(const IqRaytrace& raytracer, IqShaderData* P,
+							IqShaderData* N, IqShaderData* samples,
+							IqShaderData* result, int cParams,
+							IqShaderData** apParams);
+
+		/// Helper function for the texture shadeops.
+		///
+		/// Computes the filter region for each running shading point, centred
+		/// on (s,t) with edges given by the differences of s and t across the
+		/// grid.  The regions are stored in grid order.
+		void textureRegions(IqShaderData* s, IqShaderData* t,
+							std::vector<SqSamplePllgram>& regions);
+
+		/// Helper function for the texture shadeops.
+		///
+		/// Computes the filter region for each running shading point from
+		/// the corners of a sampling quadrilateral.  The regions are stored
+		/// in grid order.
+		void textureRegions(IqShaderData* s1, IqShaderData* t1,
+							IqShaderData* s2, IqShaderData* t2,
+							IqShaderData* s3, IqShaderData* t3,
+							IqShaderData* s4, IqShaderData* t4,
+							std::vector<SqSamplePllgram>& regions);
+
 		/// Turn 1D iteration into 2D grid indices
 		///
 		/// u is the fast changing index; v is slow changing.
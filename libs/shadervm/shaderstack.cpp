@@ -25,6 +25,8 @@
 
 #include	<aqsis/aqsis.h>
 #include	"shaderstack.h"
+
+#include	<boost/thread/tss.hpp>
 #include	<aqsis/shadervm/ishaderdata.h>
 
 #undef SHADERSTACKSTATS /* define if you want to know at run-time the max. depth of stack */
@@ -33,23 +35,104 @@
 namespace Aqsis {
 
 TqUint   CqShaderStack::m_samples = 18;
-TqUint   CqShaderStack::m_maxsamples = 18;
 
-std::deque<CqShaderVariableUniformFloat*>			CqShaderStack::m_UFPool;
-std::deque<CqShaderVariableUniformPoint*>			CqShaderStack::m_UPPool;
-std::deque<CqShaderVariableUniformString*>			CqShaderStack::m_USPool;
-std::deque<CqShaderVariableUniformColor*>			CqShaderStack::m_UCPool;
-std::deque<CqShaderVariableUniformNormal*>			CqShaderStack::m_UNPool;
-std::deque<CqShaderVariableUniformVector*>			CqShaderStack::m_UVPool;
-std::deque<CqShaderVariableUniformMatrix*>			CqShaderStack::m_UMPool;
+//----------------------------------------------------------------------
+SqTempPools::~SqTempPools()
+{
+	clear();
+}
+
+void SqTempPools::clear()
+{
+	while( !m_UFPool.empty() )
+	{
+		delete(m_UFPool.front());
+		m_UFPool.pop_front();
+	}
+	while( !m_VFPool.empty() )
+	{
+		delete(m_VFPool.front());
+		m_VFPool.pop_front();
+	}
+
+	while( !m_UPPool.empty() )
+	{
+		delete(m_UPPool.front());
+		m_UPPool.pop_front();
+	}
+	while( !m_VPPool.empty() )
+	{
+		delete(m_VPPool.front());
+		m_VPPool.pop_front();
+	}
+
+	while( !m_USPool.empty() )
+	{
+		delete(m_USPool.front());
+		m_USPool.pop_front();
+	}
+	while( !m_VSPool.empty() )
+	{
+		delete(m_VSPool.front());
+		m_VSPool.pop_front();
+	}
+
+	while( !m_UCPool.empty() )
+	{
+		delete(m_UCPool.front());
+		m_UCPool.pop_front();
+	}
+	while( !m_VCPool.empty() )
+	{
+		delete(m_VCPool.front());
+		m_VCPool.pop_front();
+	}
+
+	while( !m_UNPool.empty() )
+	{
+		delete(m_UNPool.front());
+		m_UNPool.pop_front();
+	}
+	while( !m_VNPool.empty() )
+	{
+		delete(m_VNPool.front());
+		m_VNPool.pop_front();
+	}
+
+	while( !m_UVPool.empty() )
+	{
+		delete(m_UVPool.front());
+		m_UVPool.pop_front();
+	}
+	while( !m_VVPool.empty() )
+	{
+		delete(m_VVPool.front());
+		m_VVPool.pop_front();
+	}
+
+	while( !m_UMPool.empty() )
+	{
+		delete(m_UMPool.front());
+		m_UMPool.pop_front();
+	}
+	while( !m_VMPool.empty() )
+	{
+		delete(m_VMPool.front());
+		m_VMPool.pop_front();
+	}
+}
+
+//----------------------------------------------------------------------
+/** Get the pools of temporaries belonging to the calling thread.
+ */
+SqTempPools& CqShaderStack::pools()
+{
+	static boost::thread_specific_ptr<SqTempPools> threadPools;
+	if(!threadPools.get())
+		threadPools.reset(new SqTempPools());
+	return *threadPools;
+}
 
-std::deque<CqShaderVariableVaryingFloat*>			CqShaderStack::m_VFPool;
-std::deque<CqShaderVariableVaryingPoint*>			CqShaderStack::m_VPPool;
-std::deque<CqShaderVariableVaryingString*>			CqShaderStack::m_VSPool;
-std::deque<CqShaderVariableVaryingColor*>			CqShaderStack::m_VCPool;
-std::deque<CqShaderVariableVaryingNormal*>			CqShaderStack::m_VNPool;
-std::deque<CqShaderVariableVaryingVector*>			CqShaderStack::m_VVPool;
-std::deque<CqShaderVariableVaryingMatrix*>			CqShaderStack::m_VMPool;
 
 
 //----------------------------------------------------------------------
@@ -59,29 +142,30 @@ std::deque<CqShaderVariableVaryingMatrix*>			CqShaderStack::m_VMPool;
 
 IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _class )
 {
+	SqTempPools& p = pools();
 	switch ( type )
 	{
 			case type_float:
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UFPool.empty() )
+					if( p.m_UFPool.empty() )
 						return( new CqShaderVariableUniformFloat() );
 					else
 					{
-						IqShaderData* ret = m_UFPool.front();
-						m_UFPool.pop_front();
+						IqShaderData* ret = p.m_UFPool.front();
+						p.m_UFPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VFPool.empty() )
+					if( p.m_VFPool.empty() )
 						return( new CqShaderVariableVaryingFloat() );
 					else
 					{
-						IqShaderData* ret = m_VFPool.front();
-						m_VFPool.pop_front();
+						IqShaderData* ret = p.m_VFPool.front();
+						p.m_VFPool.pop_front();
 						return( ret );
 					}
 				}
@@ -91,23 +175,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UPPool.empty() )
+					if( p.m_UPPool.empty() )
 						return( new CqShaderVariableUniformPoint() );
 					else
 					{
-						IqShaderData* ret = m_UPPool.front();
-						m_UPPool.pop_front();
+						IqShaderData* ret = p.m_UPPool.front();
+						p.m_UPPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VPPool.empty() )
+					if( p.m_VPPool.empty() )
 						return( new CqShaderVariableVaryingPoint() );
 					else
 					{
-						IqShaderData* ret = m_VPPool.front();
-						m_VPPool.pop_front();
+						IqShaderData* ret = p.m_VPPool.front();
+						p.m_VPPool.pop_front();
 						return( ret );
 					}
 				}
@@ -117,23 +201,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_USPool.empty() )
+					if( p.m_USPool.empty() )
 						return( new CqShaderVariableUniformString() );
 					else
 					{
-						IqShaderData* ret = m_USPool.front();
-						m_USPool.pop_front();
+						IqShaderData* ret = p.m_USPool.front();
+						p.m_USPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VSPool.empty() )
+					if( p.m_VSPool.empty() )
 						return( new CqShaderVariableVaryingString() );
 					else
 					{
-						IqShaderData* ret = m_VSPool.front();
-						m_VSPool.pop_front();
+						IqShaderData* ret = p.m_VSPool.front();
+						p.m_VSPool.pop_front();
 						return( ret );
 					}
 				}
@@ -143,23 +227,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UCPool.empty() )
+					if( p.m_UCPool.empty() )
 						return( new CqShaderVariableUniformColor() );
 					else
 					{
-						IqShaderData* ret = m_UCPool.front();
-						m_UCPool.pop_front();
+						IqShaderData* ret = p.m_UCPool.front();
+						p.m_UCPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VCPool.empty() )
+					if( p.m_VCPool.empty() )
 						return( new CqShaderVariableVaryingColor() );
 					else
 					{
-						IqShaderData* ret = m_VCPool.front();
-						m_VCPool.pop_front();
+						IqShaderData* ret = p.m_VCPool.front();
+						p.m_VCPool.pop_front();
 						return( ret );
 					}
 				}
@@ -169,23 +253,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UNPool.empty() )
+					if( p.m_UNPool.empty() )
 						return( new CqShaderVariableUniformNormal() );
 					else
 					{
-						IqShaderData* ret = m_UNPool.front();
-						m_UNPool.pop_front();
+						IqShaderData* ret = p.m_UNPool.front();
+						p.m_UNPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VNPool.empty() )
+					if( p.m_VNPool.empty() )
 						return( new CqShaderVariableVaryingNormal() );
 					else
 					{
-						IqShaderData* ret = m_VNPool.front();
-						m_VNPool.pop_front();
+						IqShaderData* ret = p.m_VNPool.front();
+						p.m_VNPool.pop_front();
 						return( ret );
 					}
 				}
@@ -195,23 +279,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UVPool.empty() )
+					if( p.m_UVPool.empty() )
 						return( new CqShaderVariableUniformVector() );
 					else
 					{
-						IqShaderData* ret = m_UVPool.front();
-						m_UVPool.pop_front();
+						IqShaderData* ret = p.m_UVPool.front();
+						p.m_UVPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VVPool.empty() )
+					if( p.m_VVPool.empty() )
 						return( new CqShaderVariableVaryingVector() );
 					else
 					{
-						IqShaderData* ret = m_VVPool.front();
-						m_VVPool.pop_front();
+						IqShaderData* ret = p.m_VVPool.front();
+						p.m_VVPool.pop_front();
 						return( ret );
 					}
 				}
@@ -221,23 +305,23 @@ IqShaderData* CqShaderStack::GetNextTemp( EqVariableType type, EqVariableClass _
 			{
 				if ( _class == class_uniform )
 				{
-					if( m_UMPool.empty() )
+					if( p.m_UMPool.empty() )
 						return( new CqShaderVariableUniformMatrix() );
 					else
 					{
-						IqShaderData* ret = m_UMPool.front();
-						m_UMPool.pop_front();
+						IqShaderData* ret = p.m_UMPool.front();
+						p.m_UMPool.pop_front();
 						return( ret );
 					}
 				}
 				else
 				{
-					if( m_VMPool.empty() )
+					if( p.m_VMPool.empty() )
 						return( new CqShaderVariableVaryingMatrix() );
 					else
 					{
-						IqShaderData* ret = m_VMPool.front();
-						m_VMPool.pop_front();
+						IqShaderData* ret = p.m_VMPool.front();
+						p.m_VMPool.pop_front();
 						return( ret );
 					}
 				}
@@ -258,68 +342,69 @@ void CqShaderStack::Release( SqStackEntry s )
 {
 	if( s.m_IsTemp )
 	{
+		SqTempPools& p = pools();
 		switch( s.m_Data->Type() )
 		{
 				case type_float:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UFPool.push_back(reinterpret_cast<CqShaderVariableUniformFloat*>(s.m_Data) );
+						p.m_UFPool.push_back(reinterpret_cast<CqShaderVariableUniformFloat*>(s.m_Data) );
 					else
-						m_VFPool.push_back(reinterpret_cast<CqShaderVariableVaryingFloat*>(s.m_Data) );
+						p.m_VFPool.push_back(reinterpret_cast<CqShaderVariableVaryingFloat*>(s.m_Data) );
 					break;
 				}
 
 				case type_point:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UPPool.push_back(reinterpret_cast<CqShaderVariableUniformPoint*>(s.m_Data) );
+						p.m_UPPool.push_back(reinterpret_cast<CqShaderVariableUniformPoint*>(s.m_Data) );
 					else
-						m_VPPool.push_back(reinterpret_cast<CqShaderVariableVaryingPoint*>(s.m_Data) );
+						p.m_VPPool.push_back(reinterpret_cast<CqShaderVariableVaryingPoint*>(s.m_Data) );
 					break;
 				}
 
 				case type_string:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_USPool.push_back(reinterpret_cast<CqShaderVariableUniformString*>(s.m_Data) );
+						p.m_USPool.push_back(reinterpret_cast<CqShaderVariableUniformString*>(s.m_Data) );
 					else
-						m_VSPool.push_back(reinterpret_cast<CqShaderVariableVaryingString*>(s.m_Data) );
+						p.m_VSPool.push_back(reinterpret_cast<CqShaderVariableVaryingString*>(s.m_Data) );
 					break;
 				}
 
 				case type_color:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UCPool.push_back(reinterpret_cast<CqShaderVariableUniformColor*>(s.m_Data) );
+						p.m_UCPool.push_back(reinterpret_cast<CqShaderVariableUniformColor*>(s.m_Data) );
 					else
-						m_VCPool.push_back(reinterpret_cast<CqShaderVariableVaryingColor*>(s.m_Data) );
+						p.m_VCPool.push_back(reinterpret_cast<CqShaderVariableVaryingColor*>(s.m_Data) );
 					break;
 				}
 
 				case type_normal:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UNPool.push_back(reinterpret_cast<CqShaderVariableUniformNormal*>(s.m_Data) );
+						p.m_UNPool.push_back(reinterpret_cast<CqShaderVariableUniformNormal*>(s.m_Data) );
 					else
-						m_VNPool.push_back(reinterpret_cast<CqShaderVariableVaryingNormal*>(s.m_Data) );
+						p.m_VNPool.push_back(reinterpret_cast<CqShaderVariableVaryingNormal*>(s.m_Data) );
 					break;
 				}
 
 				case type_vector:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UVPool.push_back(reinterpret_cast<CqShaderVariableUniformVector*>(s.m_Data) );
+						p.m_UVPool.push_back(reinterpret_cast<CqShaderVariableUniformVector*>(s.m_Data) );
 					else
-						m_VVPool.push_back(reinterpret_cast<CqShaderVariableVaryingVector*>(s.m_Data) );
+						p.m_VVPool.push_back(reinterpret_cast<CqShaderVariableVaryingVector*>(s.m_Data) );
 					break;
 				}
 
 				case type_matrix:
 				{
 					if ( s.m_Data->Class() == class_uniform )
-						m_UMPool.push_back(reinterpret_cast<CqShaderVariableUniformMatrix*>(s.m_Data) );
+						p.m_UMPool.push_back(reinterpret_cast<CqShaderVariableUniformMatrix*>(s.m_Data) );
 					else
-						m_VMPool.push_back(reinterpret_cast<CqShaderVariableVaryingMatrix*>(s.m_Data) );
+						p.m_VMPool.push_back(reinterpret_cast<CqShaderVariableVaryingMatrix*>(s.m_Data) );
 					break;
 				}
 				
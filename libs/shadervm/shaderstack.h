@@ -42,6 +42,7 @@
 #include	<aqsis/util/bitvector.h>
 #include	"shadervariable.h"
 #include	"shadervm_common.h"
+#include	"simdops.h"
 #include	<aqsis/math/vectorcast.h>
 
 namespace Aqsis {
@@ -212,6 +213,45 @@ static CqMatrix temp_matrix;
 			} \
 		}
 
+//----------------------------------------------------------------------
+/** \brief Free lists of stack temporaries.
+ *
+ * Grids are shaded concurrently by the bucket processors, so each thread
+ * keeps its own pools; see CqShaderStack::pools().
+ */
+struct AQSIS_SHADERVM_SHARE SqTempPools
+{
+	std::deque<CqShaderVariableUniformFloat*>		m_UFPool;
+	// Integer
+	std::deque<CqShaderVariableUniformPoint*>		m_UPPool;
+	std::deque<CqShaderVariableUniformString*>		m_USPool;
+	std::deque<CqShaderVariableUniformColor*>		m_UCPool;
+	// Triple
+	// hPoint
+	std::deque<CqShaderVariableUniformNormal*>		m_UNPool;
+	std::deque<CqShaderVariableUniformVector*>		m_UVPool;
+	// Void
+	std::deque<CqShaderVariableUniformMatrix*>		m_UMPool;
+	// SixteenTuple
+
+	std::deque<CqShaderVariableVaryingFloat*>		m_VFPool;
+	// Integer
+	std::deque<CqShaderVariableVaryingPoint*>		m_VPPool;
+	std::deque<CqShaderVariableVaryingString*>		m_VSPool;
+	std::deque<CqShaderVariableVaryingColor*>		m_VCPool;
+	// Triple
+	// hPoint
+	std::deque<CqShaderVariableVaryingNormal*>		m_VNPool;
+	std::deque<CqShaderVariableVaryingVector*>		m_VVPool;
+	// Void
+	std::deque<CqShaderVariableVaryingMatrix*>		m_VMPool;
+	// SixteenTuple
+
+	~SqTempPools();
+	/// Delete all the pooled temporaries.
+	void clear();
+};
+
 //----------------------------------------------------------------------
 /** \class CqShaderStack
  * Class handling the shader execution stack.
@@ -226,9 +266,8 @@ struct	SqStackEntry
 class AQSIS_SHADERVM_SHARE CqShaderStack
 {
 	public:
-		CqShaderStack() : m_iTop( 0 )
+		CqShaderStack() : m_iTop( 0 ), m_maxsamples( m_samples )
 		{
-			m_maxsamples = max(m_maxsamples, m_samples);
 			m_Stack.resize( m_maxsamples);
 		}
 		virtual ~CqShaderStack()
@@ -321,7 +360,7 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 		/**
 		 * Print the max number of depth if compiled for it.
 		 */
-		static void Statistics();
+		void Statistics();
 
 		/** set the more efficient number of samples per type of variable at run-time.
 		 */
@@ -334,34 +373,10 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 		std::vector<SqStackEntry>	m_Stack;
 		TqUint	m_iTop;										///< Index of the top entry.
 
-		static std::deque<CqShaderVariableUniformFloat*>				m_UFPool;
-		// Integer
-		static std::deque<CqShaderVariableUniformPoint*>				m_UPPool;
-		static std::deque<CqShaderVariableUniformString*>			m_USPool;
-		static std::deque<CqShaderVariableUniformColor*>				m_UCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableUniformNormal*>			m_UNPool;
-		static std::deque<CqShaderVariableUniformVector*>			m_UVPool;
-		// Void
-		static std::deque<CqShaderVariableUniformMatrix*>			m_UMPool;
-		// SixteenTuple
-
-		static std::deque<CqShaderVariableVaryingFloat*>				m_VFPool;
-		// Integer
-		static std::deque<CqShaderVariableVaryingPoint*>				m_VPPool;
-		static std::deque<CqShaderVariableVaryingString*>			m_VSPool;
-		static std::deque<CqShaderVariableVaryingColor*>				m_VCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableVaryingNormal*>			m_VNPool;
-		static std::deque<CqShaderVariableVaryingVector*>			m_VVPool;
-		// Void
-		static std::deque<CqShaderVariableVaryingMatrix*>			m_VMPool;
-		// SixteenTuple
+		static SqTempPools& pools();
 
 		static TqUint    m_samples; // by default == 18 see shaderstack.cpp
-		static TqUint    m_maxsamples;
+		TqUint    m_maxsamples;	///< Deepest this stack has been.
 }
 ;
 
@@ -562,6 +577,28 @@ OpABRS( && , LAND )
  */
 OpABRS( || , LOR )
 
+//---------------------------------------------------------------------
+// Float-float versions of the arithmetic and comparison operators.  These
+// overloads are preferred to the templates above, and run several shading
+// points at once with the kernels from simdops.h.
+#define OpABRS_SIMD(NAME, SIMDOP) \
+		inline void	Op##NAME( TqFloat& a, TqFloat& b, TqFloat& r, IqShaderData* pA, IqShaderData* pB, IqShaderData* pRes, const CqBitVector& RunningState ) \
+		{ \
+			if( !simdApply( SIMDOP(), pRes, RunningState, pA, pB ) ) \
+				Op##NAME<TqFloat, TqFloat, TqFloat>( a, b, r, pA, pB, pRes, RunningState ); \
+		}
+
+OpABRS_SIMD( ADD, SqSimdAdd )
+OpABRS_SIMD( SUB, SqSimdSub )
+OpABRS_SIMD( MUL, SqSimdMul )
+OpABRS_SIMD( DIV, SqSimdDiv )
+OpABRS_SIMD( LSS, SqSimdLess )
+OpABRS_SIMD( GRT, SqSimdGreater )
+OpABRS_SIMD( LE, SqSimdLessEqual )
+OpABRS_SIMD( GE, SqSimdGreaterEqual )
+OpABRS_SIMD( EQ, SqSimdEqual )
+OpABRS_SIMD( NE, SqSimdNotEqual )
+
 /* Templatised negation operator. The template classes decide the cast used, there must be an appropriate operator between the two types.
  * \param a The type of the first operand, used to determine templateisation, needed by VC++..
  * \param pA The shader data to use as the second operand.
@@ -25,15 +25,18 @@
 
 #include "shadervm.h"
 
+#include <algorithm>
 #include <cstring>
 #include <ctype.h>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <stddef.h>
 
 #include <aqsis/core/isurface.h>
 #include <aqsis/slcomp/icodegen.h>
 #include <aqsis/util/logging.h>
+#include <aqsis/util/mappedfile.h>
 #include "shadervariable.h"
 #include <aqsis/util/sstring.h>
 
@@ -59,6 +62,26 @@ boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
 	return shader;
 }
 
+boost::shared_ptr<IqShader> createShaderVM(IqRenderer* renderContext,
+                                           const std::string& programFileName,
+                                           const std::string& dsoPath)
+{
+	boost::shared_ptr<CqShaderVM> shader(new CqShaderVM(renderContext));
+	if(!dsoPath.empty())
+		shader->SetDSOPath(dsoPath.c_str());
+	try
+	{
+		CqMappedFile programFile(programFileName);
+		// Binary programs are loaded in place from the mapping.
+		shader->LoadProgram(programFile.data(), programFile.size());
+	}
+	catch(XqInvalidFile& e)
+	{
+		AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader, e.what());
+	}
+	return shader;
+}
+
 void shutdownShaderVM()
 {
 	CqShaderVM::ShutdownShaderEngine();
@@ -864,59 +887,79 @@ void CqShaderVM::DefaultSurface()
 
 
 //---------------------------------------------------------------------
-/**
-* Function to determine if not the character is ' '
+/** Set the shader type important for Imager' shader
 */
-
-static bool notspace(char C)
+void CqShaderVM::SetType(EqShaderType type)
 {
-	bool retval = true;
-
-	if ((C == 0x20) ||
-	        (( C >= 0x09 ) && (C <= 0x0D)))
-		retval = false;
-
-	return retval;
+	m_Type = type;
 }
 
 //---------------------------------------------------------------------
-/** Set the shader type important for Imager' shader
+/** Load a program from a stream containing a compiled slx file.
 */
-void CqShaderVM::SetType(EqShaderType type)
+
+void CqShaderVM::LoadProgram( std::istream* pFile )
 {
-	m_Type = type;
+	std::string contents( ( std::istreambuf_iterator<char>( *pFile ) ),
+	                      std::istreambuf_iterator<char>() );
+	LoadProgram( contents.data(), contents.size() );
 }
 
+
 //---------------------------------------------------------------------
-/** Load a token from a compiled slx file.
+/** Load a program from a compiled slx file held in memory.
 */
 
-void CqShaderVM::GetToken( char* token, TqInt l, std::istream* pFile )
+void CqShaderVM::LoadProgram( const char* data, std::size_t size )
 {
-	char c;
-	TqInt i = 0;
-	( *pFile ) >> std::ws;
-	c = pFile->get();
-	if ( c == ':' && i == 0 )
+	try
 	{
-		token[ 0 ] = c;
-		token[ 1 ] = '\0';
-		return ;	// Special case for labels.
+		if ( isSlxBinary( data, size ) )
+		{
+			CqSlxBinaryReader program( data, size );
+			LoadProgram( program );
+		}
+		else
+		{
+			CqSlxTextReader program( data, size );
+			LoadProgram( program );
+		}
 	}
-	while ( notspace( c ) && i < l - 1 )
+	catch ( XqInvalidFile& e )
 	{
-		token[ i++ ] = c;
-		token[ i ] = '\0';
-		c = pFile->get();
+		AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader, e.what());
 	}
 }
 
 
 //---------------------------------------------------------------------
-/** Load a program from a compiled slx file.
+/** Find the entry for an opcode in the translation table.
 */
 
-void CqShaderVM::LoadProgram( std::istream* pFile )
+TqInt CqShaderVM::FindOpcode( TqUlong htoken, const char* token )
+{
+	for ( TqInt i = 0; i < m_cTransSize; i++ )
+	{
+		if ( !m_TransTable[ i ].m_hash )
+		{
+			m_TransTable[ i ].m_hash = CqString::hash(m_TransTable[ i ].m_strName);
+		}
+		if ( m_TransTable[ i ].m_hash == htoken )
+			return i;
+	}
+	// If we have not found the opcode, throw an error.
+	AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+		"Invalid opcode found: " << token);
+	return -1;
+}
+
+
+//---------------------------------------------------------------------
+/** Load a program from the tokens of a compiled slx file.
+*/
+
+template<typename ReaderT>
+void CqShaderVM::LoadProgram( ReaderT& program )
 {
 	enum EqSegment
 	{
@@ -924,18 +967,23 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 	    Seg_Init,
 	    Seg_Code,
 	};
-	char token[ 255 ];
+	const char* token = 0;
+	TqInt tokenId = 0;
 	EqSegment	Segment = Seg_Data;
 	std::vector<UsProgramElement>*	pProgramArea = NULL;
 	std::vector<TqInt>	aLabels;
+	// Translation table entry for each word of a binary program, so that
+	// each distinct opcode is only looked up once.  Words of text programs
+	// have no id, and are looked up every time.
+	std::vector<TqInt>	opcodes( program.numStrings(), -1 );
 	boost::shared_ptr<CqShaderExecEnv> StdEnv(new CqShaderExecEnv(m_pRenderContext));
 	TqInt	array_count = 0;
 	TqUlong  htoken, i;
 
 	bool fShaderSpec = false;
-	while ( !pFile->eof() )
+	while ( !program.atEnd() )
 	{
-		GetToken( token, 255, pFile );
+		token = program.word( &tokenId );
 
 		htoken = CqString::hash(token);
 
@@ -981,7 +1029,7 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 		if ( strcmp( token, "AQSIS_V" ) == 0 )
 		{
-			GetToken( token, 255, pFile );
+			token = program.word();
 			// Check that the version string matches the current one.  If not,
 			// fail fatally.
 			const char* slxVersion = AQSIS_XSTR(AQSIS_SLX_VERSION);
@@ -997,13 +1045,13 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 		if ( ushash == htoken) // == "USES"
 		{
-			( *pFile ) >> m_Uses;
+			m_Uses = program.integer();
 			continue;
 		}
 
 		if ( shash == htoken ) // == "segment"
 		{
-			GetToken( token, 255, pFile );
+			token = program.word();
 			htoken = CqString::hash(token);
 
 			if ( dhash == htoken ) // == "Data"
@@ -1030,6 +1078,7 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 			switch ( Segment )
 			{
 				case Seg_Data:
+				{
 					VarType = type_invalid;
 					VarClass = class_invalid;
 					while ( VarType == type_invalid )
@@ -1049,23 +1098,21 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 							VarClass = class_uniform;
 						else
 							VarType = enumCast<EqVariableType>(token);
-						GetToken( token, 255, pFile );
+						token = program.word();
 						htoken = CqString::hash(token);
 					}
+					std::string varName( token );
 					// Check for array type variable.
-					if ( token[ strlen( token ) - 1 ] == ']' )
+					if ( varName[ varName.size() - 1 ] == ']' )
 					{
-						unsigned int i = 0;
-						while ( i < strlen( token ) && token[ i ] != '[' ) i++;
-						if ( i == strlen( token ) )
+						std::string::size_type bracket = varName.find( '[' );
+						if ( bracket == std::string::npos )
 						{
 							AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
 								"Invalid variable specification in slx file");
 						}
-						token[ strlen( token ) - 1 ] = '\0';
-						token[ i ] = '\0';
-						i++;
-						array_count = atoi( &token[ i ] );
+						array_count = atoi( varName.c_str() + bracket + 1 );
+						varName.erase( bracket );
 						fVarArray = true;
 					}
 					// Check if there is a valid variable specifier
@@ -1074,192 +1121,63 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 						continue;
 
 					if ( fVarArray )
-						AddLocalVariable( CreateVariableArray( VarType, VarClass, token, array_count, varStorage ) );
+						AddLocalVariable( CreateVariableArray( VarType, VarClass, varName.c_str(), array_count, varStorage ) );
 					else
-						AddLocalVariable( CreateVariable( VarType, VarClass, token, varStorage ) );
+						AddLocalVariable( CreateVariable( VarType, VarClass, varName.c_str(), varStorage ) );
 					break;
+				}
 
 				case Seg_Init:
 				case Seg_Code:
 					// Check if it is a label
 					if ( strcmp( token, ":" ) == 0 )
 					{
-						( *pFile ) >> std::ws;
-						TqFloat f;
-						( *pFile ) >> f;
+						TqFloat f = program.number();
 						if ( aLabels.size() < ( f + 1 ) )
 							aLabels.resize( static_cast<TqInt>( f ) + 1 );
 						aLabels[ static_cast<TqInt>( f ) ] = pProgramArea->size();
 						AddCommand( &CqShaderVM::SO_nop, pProgramArea );
 						break;
 					}
+					if ( ehash == htoken )
+					{
+						LoadExternalCall( program, pProgramArea );
+						break;
+					}
 					// Find the opcode in the translation table.
-					TqInt i;
-					for ( i = 0; i < m_cTransSize; i++ )
+					TqInt opcodeIndex = tokenId >= 0 ? opcodes[ tokenId ] : -1;
+					if ( opcodeIndex < 0 )
 					{
-						if ( !m_TransTable[ i ].m_hash )
-						{
-							m_TransTable[ i ].m_hash = CqString::hash(m_TransTable[ i ].m_strName);
-						}
-
-						if ( ehash == htoken )
-						{
-							CqString strFunc, strRetType, strArgTypes ;
-							EqVariableType RetType;
-							std::list<EqVariableType> ArgTypes;
-
-							*pFile >> strFunc;
-							strFunc = strFunc.substr(1,strFunc.length() - 2);
-							std::list<SqDSOExternalCall*> *candidates = NULL;
-							m_itActiveDSOMap = m_ActiveDSOMap.find( strFunc );
-							if( m_itActiveDSOMap != m_ActiveDSOMap.end() )
-							{
-								candidates = ( *m_itActiveDSOMap ).second;
-							}
-							else
-							{
-								candidates = getShadeOpMethods(&strFunc);
-								if( candidates == NULL )
-								{
-									AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-										"\"" << strName().c_str() << "\": No DSO found for "
-										"external shadeop: \"" << strFunc.c_str() << "\"\n");
-								}
-								m_ActiveDSOMap[strFunc]=candidates;
-							};
-
-							// pick out the return type
-							*pFile >> strRetType;
-							m_itTypeIdMap = m_TypeIdMap.find( strRetType[1] );
-							if (m_itTypeIdMap != m_TypeIdMap.end())
-							{
-								RetType = (*m_itTypeIdMap).second;
-							}
-							else
-							{
-								//error, we dont know this return type
-								AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader, "\""
-									<< strName() << "\": Invalid return type in call to external"
-									" shadeop: \"" << strFunc << "\" : \"" << strRetType << "\"");
-							}
-
-							*pFile >> strArgTypes;
-							for ( TqUint x=1; x < strArgTypes.length()-1; x++ )
-							{
-								m_itTypeIdMap = m_TypeIdMap.find( strArgTypes[x] )
-								                ;
-								if ( m_itTypeIdMap != m_TypeIdMap.end() )
-								{
-									ArgTypes.push_back( ( *m_itTypeIdMap ).second );
-								}
-								else
-								{
-									// Error, unknown arg type
-									AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-										"\"" << strName() << "\": Invalid argument type in call "
-										"to external shadeop: \"" << strFunc << "\" : \""
-										<< strArgTypes[x] << "\"");
-								}
-
-							}
-
-							//Now we need to find a good candidate.
-							std::list<SqDSOExternalCall*>::iterator candidate;
-							candidate = candidates->begin();
-							while (candidate !=candidates->end())
-							{
-								// Do we have a match
-								if ((*candidate)->return_type == RetType &&
-								                        (*candidate)->arg_types == ArgTypes) break;
-								candidate++;
-							}
-
-							// If we are looking for a void return type but have not
-							// found an exact match, we will take the first match with
-							// suitable arguments and force the return value to be
-							// discarded.
-							if(candidate == candidates->end() && RetType == type_void)
-							{
-								candidate = candidates->begin()
-								            ;
-								while (candidate !=candidates->end())
-								{
-									// Do we have a match
-									if ( (*candidate)->arg_types == ArgTypes)
-									{
-										CqString strProto = strPrototype(&strFunc, (*candidate));
-										Aqsis::log() << info << "\"" << strName().c_str() << "\": Using non-void DSO shadeop:  \"" << strProto.c_str() << "\"" <<
-										"\"" << strName().c_str() << "\": In place of requested void shadeop: \"" << strFunc.c_str() << "\"" <<
-										"\"" << strName().c_str() << "\": If this is not the operation you intended you should force the correct shadeop in your shader source." << std::endl;
-										break;
-									}
-									candidate++;
-								}
-							}
-
-							if(candidate == candidates->end())
-							{
-								Aqsis::log() << error << "\"" << strName()
-									<< "\": No candidate found for call to external shadeop: \""
-									<< strFunc << "\"" << strName() << "\": Perhaps you need some casts?"
-									<< "\"" << strName() << "\": The following candidates are in you current DSO path:\n";
-								candidate = candidates->begin();
-								while (candidate !=candidates->end())
-								{
-									CqString strProto = strPrototype(&strFunc, (*candidate));
-									Aqsis::log() << info << "\"" << strName().c_str() << "\": \t" << strProto.c_str() << std::endl;
-									candidate++;
-								}
-								AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-									"External shadeop not found");
-							}
+						opcodeIndex = FindOpcode( htoken, token );
+						if ( tokenId >= 0 )
+							opcodes[ tokenId ] = opcodeIndex;
+					}
+					const SqOpCodeTrans& opcode = m_TransTable[ opcodeIndex ];
 
-							if(!(*candidate)->initialised )
-							{
-								// We have an initialiser we have not run yet
-								if((*candidate)->init)
-								{
-									// WARNING: future bug on x86_64 if threading is implemented:
-									//
-									// The first (int) parameter to the initialiser should be a _unique_ thread identifier.
-									// Casting to a smaller type (on x86_64, sizeof(int) < sizeof(void*) ) makes the result
-									// possibly non-unique per thread.
-									(*candidate)->initData =
-									    ((*candidate)->init)(static_cast<int>(reinterpret_cast<ptrdiff_t>(this)),NULL);
-								}
-								(*candidate)->initialised = true;
-							}
+					// If the opcodes command pointer is 0, just ignore this opcode.
+					if ( opcode.m_pCommand == 0 )
+						break;
 
-							AddCommand( &CqShaderVM::SO_external, pProgramArea );
-							AddDSOExternalCall( (*candidate),pProgramArea );
+					// If this is an 'illuminate' or 'solar' statement, then we can safely say this
+					// is not an ambient light.
+					if( &CqShaderVM::SO_illuminate == opcode.m_pCommand ||
+					        &CqShaderVM::SO_illuminate2 == opcode.m_pCommand ||
+					        &CqShaderVM::SO_solar == opcode.m_pCommand ||
+					        &CqShaderVM::SO_solar2 == opcode.m_pCommand )
+						m_fAmbient = false;
 
-							break;
-						}
+					// Add this opcode to the program segment.
+					AddCommand( opcode.m_pCommand, pProgramArea );
 
-						if ( m_TransTable[ i ].m_hash == htoken)
+					// Process this opcodes parameters.
+					TqInt p;
+					for ( p = 0; p < opcode.m_cParams; p++ )
+					{
+						switch ( opcode.m_aParamTypes[ p ] )
 						{
-							// If the opcodes command pointer is 0, just ignore this opcode.
-							if ( m_TransTable[ i ].m_pCommand == 0 )
-								break;
-
-							// If this is an 'illuminate' or 'solar' statement, then we can safely say this
-							// is not an ambient light.
-							if( &CqShaderVM::SO_illuminate == m_TransTable[ i ].m_pCommand ||
-							        &CqShaderVM::SO_illuminate2 == m_TransTable[ i ].m_pCommand ||
-							        &CqShaderVM::SO_solar == m_TransTable[ i ].m_pCommand ||
-							        &CqShaderVM::SO_solar2 == m_TransTable[ i ].m_pCommand )
-								m_fAmbient = false;
-
-							// Add this opcode to the program segment.
-							AddCommand( m_TransTable[ i ].m_pCommand, pProgramArea );
-
-							// Process this opcodes parameters.
-							TqInt p;
-							for ( p = 0; p < m_TransTable[ i ].m_cParams; p++ )
-							{
-								if ( m_TransTable[ i ].m_aParamTypes[ p ] == type_invalid )
+							case type_invalid:
 								{
-									GetToken( token, 255, pFile );
+									token = program.word();
 									TqInt iVar;
 									if ( ( iVar = FindLocalVarIndex( token ) ) >= 0 )
 										AddVariable( iVar, pProgramArea );
@@ -1269,51 +1187,24 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 										// TODO: Report error.
 										AddVariable( 0, pProgramArea );
 								}
-								else
-								{
-									switch ( m_TransTable[ i ].m_aParamTypes[ p ] )
-									{
-										case type_float:
-											{
-												( *pFile ) >> std::ws;
-												TqFloat f;
-												( *pFile ) >> f;
-												AddFloat( f, pProgramArea );
-											}
-											break;
-										case type_integer:
-											{
-												( *pFile ) >> std::ws;
-												TqInt i;
-												( *pFile ) >> i;
-												AddInteger( i, pProgramArea );
-											}
-											break;
-										case type_string:
-											{
-												CqString s = GetString(pFile);
-												AddString( s.c_str(), pProgramArea );
-											}
-											break;
-										default:
-											AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-												"Unknown literal type");
-									}
-								}
-							}
-							break;
+								break;
+							case type_float:
+								AddFloat( program.number(), pProgramArea );
+								break;
+							case type_integer:
+								AddInteger( program.integer(), pProgramArea );
+								break;
+							case type_string:
+								AddString( program.string(), pProgramArea );
+								break;
+							default:
+								AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+									"Unknown literal type");
 						}
 					}
-					if ( i == m_cTransSize )
-					{
-						// If we have not found the opcode, throw an error.
-						AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
-							"Invalid opcode found: " << token);
-					}
 					break;
 			}
 		}
-		( *pFile ) >> std::ws;
 	}
 	// Now we need to complete any label jump statements.
 	i = 0;
@@ -1349,126 +1240,144 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 	}
 }
 
-CqString CqShaderVM::GetString(std::istream* pFile)
+//---------------------------------------------------------------------
+/** Bind a call to an external DSO shadeop.
+ *
+ * The "external" opcode is followed by the name of the shadeop, its return
+ * type and its argument types.
+*/
+
+template<typename ReaderT>
+void CqShaderVM::LoadExternalCall( ReaderT& program,
+		std::vector<UsProgramElement>* pProgramArea )
 {
-	( *pFile ) >> std::ws;
-	char c;
-	CqString s( "" );
-	bool escapeChar = false;
+	CqString strFunc, strRetType, strArgTypes ;
+	EqVariableType RetType;
+	std::list<EqVariableType> ArgTypes;
+
+	strFunc = program.string();
+	std::list<SqDSOExternalCall*> *candidates = NULL;
+	m_itActiveDSOMap = m_ActiveDSOMap.find( strFunc );
+	if( m_itActiveDSOMap != m_ActiveDSOMap.end() )
+	{
+		candidates = ( *m_itActiveDSOMap ).second;
+	}
+	else
+	{
+		candidates = getShadeOpMethods(&strFunc);
+		if( candidates == NULL )
+		{
+			AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+				"\"" << strName().c_str() << "\": No DSO found for "
+				"external shadeop: \"" << strFunc.c_str() << "\"\n");
+		}
+		m_ActiveDSOMap[strFunc]=candidates;
+	};
+
+	// pick out the return type
+	strRetType = program.string();
+	if ( !strRetType.empty() &&
+	        (m_itTypeIdMap = m_TypeIdMap.find( strRetType[0] )) != m_TypeIdMap.end() )
+	{
+		RetType = (*m_itTypeIdMap).second;
+	}
+	else
+	{
+		//error, we dont know this return type
+		AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader, "\""
+			<< strName() << "\": Invalid return type in call to external"
+			" shadeop: \"" << strFunc << "\" : \"" << strRetType << "\"");
+	}
 
-	pFile->get();
-	while ( (( c = pFile->get() ) != '"') || escapeChar  )
+	strArgTypes = program.string();
+	for ( TqUint x=0; x < strArgTypes.length(); x++ )
 	{
-		if(escapeChar)
+		m_itTypeIdMap = m_TypeIdMap.find( strArgTypes[x] )
+		                ;
+		if ( m_itTypeIdMap != m_TypeIdMap.end() )
 		{
-			//Treatment for escape char
-			switch(c)
-			{
-				case 'a'://Bell (alert)
-					s += '\a';
-					escapeChar = false;
-					break;
-				case 'v'://Vertical tab
-					s += '\v';
-					escapeChar = false;
-					break;
-				case '\''://Single quotation mark
-					s += "'";
-					escapeChar = false;
-					break;
-				case '?'://Literal question mark
-					s += '\?';
-					escapeChar = false;
-					break;
-				case 'n'://New line
-					s += '\n';
-					escapeChar = false;
-					break;
-				case 'r'://Carriage return
-					s += '\r';
-					escapeChar = false;
-					break;
-				case 't'://Horizontal tab
-					s += '\t';
-					escapeChar = false;
-					break;
-				case 'b'://Backspace
-					s += '\b';
-					escapeChar = false;
-					break;
-				case 'f'://Formfeed
-					s += '\f';
-					escapeChar = false;
-					break;
-				case '"'://Double quotation mark
-					s += '"';
-					escapeChar = false;
-					break;
-				case '\\'://Backslash
-					s += '\\';
-					escapeChar = false;
-					break;
-				case 'x'://Hexadecimal
-				case '0'://octal
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-					GetNumericEscapeChar(pFile, s,  c);
-					escapeChar = false;
-					break;
-				default :
-					escapeChar = false;
-					break;
-			}
+			ArgTypes.push_back( ( *m_itTypeIdMap ).second );
 		}
 		else
-			if (c ==  '\\')
-				escapeChar = true;
-			else
-				s += c;
-	}
-	 return s;
-}
+		{
+			// Error, unknown arg type
+			AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+				"\"" << strName() << "\": Invalid argument type in call "
+				"to external shadeop: \"" << strFunc << "\" : \""
+				<< strArgTypes[x] << "\"");
+		}
 
-void CqShaderVM::GetNumericEscapeChar(std::istream* pFile, CqString &s, char c)
-{
-	CqString a("");
-	bool isHexadecimal = (c =='x');
-	unsigned int maxLength;
+	}
 
-	if (isHexadecimal)
+	//Now we need to find a good candidate.
+	std::list<SqDSOExternalCall*>::iterator candidate;
+	candidate = candidates->begin();
+	while (candidate !=candidates->end())
 	{
-		maxLength = 2;
+		// Do we have a match
+		if ((*candidate)->return_type == RetType &&
+		                        (*candidate)->arg_types == ArgTypes) break;
+		candidate++;
 	}
-	else
+
+	// If we are looking for a void return type but have not
+	// found an exact match, we will take the first match with
+	// suitable arguments and force the return value to be
+	// discarded.
+	if(candidate == candidates->end() && RetType == type_void)
 	{
-		a += c;
-		maxLength = 3;
+		candidate = candidates->begin()
+		            ;
+		while (candidate !=candidates->end())
+		{
+			// Do we have a match
+			if ( (*candidate)->arg_types == ArgTypes)
+			{
+				CqString strProto = strPrototype(&strFunc, (*candidate));
+				Aqsis::log() << info << "\"" << strName().c_str() << "\": Using non-void DSO shadeop:  \"" << strProto.c_str() << "\"" <<
+				"\"" << strName().c_str() << "\": In place of requested void shadeop: \"" << strFunc.c_str() << "\"" <<
+				"\"" << strName().c_str() << "\": If this is not the operation you intended you should force the correct shadeop in your shader source." << std::endl;
+				break;
+			}
+			candidate++;
+		}
 	}
-	c = pFile->get();
 
-	while ((( c >= '0' && c <= '9') || ((( c >= 'a' && c <= 'f') || ( c >= 'A' && c <= 'F')) && isHexadecimal)) && (a.length() <maxLength))
+	if(candidate == candidates->end())
 	{
-		a += c;
-		c = pFile->get();
+		Aqsis::log() << error << "\"" << strName()
+			<< "\": No candidate found for call to external shadeop: \""
+			<< strFunc << "\"" << strName() << "\": Perhaps you need some casts?"
+			<< "\"" << strName() << "\": The following candidates are in you current DSO path:\n";
+		candidate = candidates->begin();
+		while (candidate !=candidates->end())
+		{
+			CqString strProto = strPrototype(&strFunc, (*candidate));
+			Aqsis::log() << info << "\"" << strName().c_str() << "\": \t" << strProto.c_str() << std::endl;
+			candidate++;
+		}
+		AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
+			"External shadeop not found");
 	}
 
-	int numericalBase;
-
-	if(isHexadecimal)
-		numericalBase = 16;
-	else
-		numericalBase = 8;
-	char result = strtoul(a.c_str(), NULL, numericalBase);
+	if(!(*candidate)->initialised )
+	{
+		// We have an initialiser we have not run yet
+		if((*candidate)->init)
+		{
+			// WARNING: future bug on x86_64 if threading is implemented:
+			//
+			// The first (int) parameter to the initialiser should be a _unique_ thread identifier.
+			// Casting to a smaller type (on x86_64, sizeof(int) < sizeof(void*) ) makes the result
+			// possibly non-unique per thread.
+			(*candidate)->initData =
+			    ((*candidate)->init)(static_cast<int>(reinterpret_cast<ptrdiff_t>(this)),NULL);
+		}
+		(*candidate)->initialised = true;
+	}
 
-	if (result != 0) s += result;
-	pFile->unget();
+	AddCommand( &CqShaderVM::SO_external, pProgramArea );
+	AddDSOExternalCall( (*candidate),pProgramArea );
 }
 
 //---------------------------------------------------------------------
@@ -1529,6 +1438,32 @@ CqShaderVM&	CqShaderVM::operator=( const CqShaderVM& From )
 }
 
 
+//---------------------------------------------------------------------
+/**	Duplicate a prepared shader instance for another render thread.
+ *
+ * The copy gets its own locals (which hold the instance parameters already)
+ * and its own cache of instance parameters pointing at them.  The program
+ * strings and label addresses stay with this shader.
+ */
+
+boost::shared_ptr<IqShader> CqShaderVM::Duplicate() const
+{
+	boost::shared_ptr<CqShaderVM> shader(new CqShaderVM(*this));
+	shader->m_Type = m_Type;
+	shader->m_outsideWorld = m_outsideWorld;
+	for( std::vector<IqShaderData*>::const_iterator i = m_InstancedParams.begin();
+		 i < m_InstancedParams.end(); i+=2 )
+	{
+		TqUint j = std::find(m_LocalVars.begin(), m_LocalVars.end(), *(i+1))
+			- m_LocalVars.begin();
+		assert(j < m_LocalVars.size());
+		shader->m_InstancedParams.push_back((*i)->Clone());
+		shader->m_InstancedParams.push_back(shader->m_LocalVars[j]);
+	}
+	return shader;
+}
+
+
 //---------------------------------------------------------------------
 /**	Execute a series of shader language bytecodes.
 */
@@ -1935,83 +1870,9 @@ const std::vector<IqShaderData*>& CqShaderVM::GetArguments() const
 
 void CqShaderVM::ShutdownShaderEngine()
 {
-	// Free any temporary variables in the buckets.
-	while( !m_UFPool.empty() )
-	{
-		delete(m_UFPool.front());
-		m_UFPool.pop_front();
-	}
-	while( !m_VFPool.empty() )
-	{
-		delete(m_VFPool.front());
-		m_VFPool.pop_front();
-	}
-
-	while( !m_UPPool.empty() )
-	{
-		delete(m_UPPool.front());
-		m_UPPool.pop_front();
-	}
-	while( !m_VPPool.empty() )
-	{
-		delete(m_VPPool.front());
-		m_VPPool.pop_front();
-	}
-
-	while( !m_USPool.empty() )
-	{
-		delete(m_USPool.front());
-		m_USPool.pop_front();
-	}
-	while( !m_VSPool.empty() )
-	{
-		delete(m_VSPool.front());
-		m_VSPool.pop_front();
-	}
-
-	while( !m_UCPool.empty() )
-	{
-		delete(m_UCPool.front());
-		m_UCPool.pop_front();
-	}
-	while( !m_VCPool.empty() )
-	{
-		delete(m_VCPool.front());
-		m_VCPool.pop_front();
-	}
-
-	while( !m_UNPool.empty() )
-	{
-		delete(m_UNPool.front());
-		m_UNPool.pop_front();
-	}
-	while( !m_VNPool.empty() )
-	{
-		delete(m_VNPool.front());
-		m_VNPool.pop_front();
-	}
-
-	while( !m_UVPool.empty() )
-	{
-		delete(m_UVPool.front());
-		m_UVPool.pop_front();
-	}
-	while( !m_VVPool.empty() )
-	{
-		delete(m_VVPool.front());
-		m_VVPool.pop_front();
-	}
-
-	while( !m_UMPool.empty() )
-	{
-		delete(m_UMPool.front());
-		m_UMPool.pop_front();
-	}
-	while( !m_VMPool.empty() )
-	{
-		delete(m_VMPool.front());
-		m_VMPool.pop_front();
-	}
+	// Free any temporary variables in the calling thread's buckets; those
+	// of the worker threads go when the threads exit.
+	pools().clear();
 }
 
 
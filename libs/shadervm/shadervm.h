@@ -42,6 +42,7 @@
 #include	<aqsis/shadervm/ishaderdata.h>
 #include	<aqsis/shadervm/ishader.h>
 #include	<aqsis/core/irenderer.h>
+#include	<aqsis/util/slxbinary.h>
 #include	<aqsis/core/iparameter.h>
 #include	"shaderexecenv.h"
 #include	"shaderstack.h"
@@ -165,6 +166,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		{
 			return boost::shared_ptr<IqShader>(new CqShaderVM(*this));
 		}
+		virtual boost::shared_ptr<IqShader> Duplicate() const;
 		virtual bool	Uses( TqInt Var ) const
 		{
 			assert( Var >= 0 && Var < EnvVars_Last );
@@ -206,12 +208,27 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		CqShaderVM&	operator=( const CqShaderVM& From );
 
 	private:
-		/** \brief Load a compiled shader program from the given stream
+		//@{
+		/** \brief Load a compiled shader program
+		 *
+		 * The program may be in either the text or binary slx format.  Both
+		 * are read token by token with a reader of the same interface, either
+		 * CqSlxTextReader or CqSlxBinaryReader.
 		 *
 		 * \throw XqBadShader If the program was compiled with a different
 		 *   version of aqsis, or is invalid in any other way.
 		 */
 		void	LoadProgram( std::istream* pFile );
+		void	LoadProgram( const char* data, std::size_t size );
+		template<typename ReaderT>
+		void	LoadProgram( ReaderT& program );
+		//@}
+		/// Read the target of an "external" opcode and add the call to the program.
+		template<typename ReaderT>
+		void	LoadExternalCall( ReaderT& program,
+				std::vector<UsProgramElement>* pProgramArea );
+		/// Find the translation table index of the opcode with the given name hash.
+		static TqInt FindOpcode( TqUlong htoken, const char* token );
 		void	Execute( IqShaderExecEnv* pEnv );
 		void	ExecuteInit();
 
@@ -219,6 +236,9 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		friend boost::shared_ptr<IqShader> createShaderVM(
 				IqRenderer* renderContext, std::istream& programFile,
 				const std::string& dsoPath);
+		friend boost::shared_ptr<IqShader> createShaderVM(
+				IqRenderer* renderContext, const std::string& programFileName,
+				const std::string& dsoPath);
 
 		struct SqArgumentRecord
 		{
@@ -252,22 +272,6 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		IqRenderer*	m_pRenderContext;
 
 
-		/** \brief Get a string from a program file and interpret escaped chars
-		 *
-		 * Assumes the leading quote (") has already been removed from the
-		 * input, and reads up until the trailing quote
-		 *
-		 * \param pFile shader stream
-		 * \return String
-		 */
-		static CqString GetString(std::istream* pFile);
-		/** \brief Read in and interpret a numeric escape sequence as a character
-		 *
-		 * \param pFile shader stream
-		 * \param s result string
-		 * \param c, current character
-		 */
-		static void GetNumericEscapeChar(std::istream* pFile, CqString &s, char c);
 		/** Determine whether the program execution has finished.
 		 */
 		bool	fDone()
@@ -331,7 +335,6 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 					return ( m );
 			return ( -1 );
 		}
-		void	GetToken( char* token, TqInt l, std::istream* pFile );
 
 		/** Add a command to the program data area.
 		 * \param pCommand Pointer to the opcode function.
@@ -137,14 +137,23 @@ void CqShaderVM::SO_pop()
 	POPV( Val );
 	if(m_pEnv->IsRunning())
 	{
-		TqUint ext = max( m_pEnv->shadingPointCount(), pV->Size() );
-		bool fVarying = ext > 1;
-		TqUint i;
-		const CqBitVector& RS = m_pEnv->RunningState();
-		for ( i = 0; i < ext; i++ )
+		if(pV->Size() == 1 && Val->Size() == 1)
 		{
-			if(!fVarying || RS.Value( i ))
-				pV->SetValueFromVariable( Val, i );
+			// Uniform to uniform, which the compiler produces for locals it
+			// has found only ever hold uniform values.
+			pV->SetValueFromVariable( Val );
+		}
+		else
+		{
+			TqUint ext = max( m_pEnv->shadingPointCount(), pV->Size() );
+			bool fVarying = ext > 1;
+			TqUint i;
+			const CqBitVector& RS = m_pEnv->RunningState();
+			for ( i = 0; i < ext; i++ )
+			{
+				if(!fVarying || RS.Value( i ))
+					pV->SetValueFromVariable( Val, i );
+			}
 		}
 	}
 	RELEASE( Val );
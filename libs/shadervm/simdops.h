@@ -0,0 +1,365 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Lane-wise float kernels for shader variables, using SSE where
+ * available.
+ *
+ * The kernels operate directly on the contiguous storage of float shader
+ * variables, four shading points at a time.  The running state bitvector is
+ * used as the lane mask: shading points which aren't running are left
+ * untouched, exactly as for the scalar loops.
+ */
+
+#ifndef SIMDOPS_H_INCLUDED
+#define SIMDOPS_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define AQSIS_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+#include <aqsis/math/math.h>
+#include <aqsis/shadervm/ishaderdata.h>
+#include <aqsis/util/bitvector.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Apply a lane-wise float operation to shader variables.
+ *
+ * Each operand may be uniform, in which case its value is used for all
+ * lanes.  The result must be a varying float variable.
+ *
+ * \param op - operation functor; see SqSimdAdd for the required interface.
+ * \param res - variable to store the result in.
+ * \param mask - lanes to compute; all others keep their previous value.
+ *
+ * \return false without touching res if the variables aren't all floats of
+ * compatible size, in which case the caller should use its scalar code.
+ */
+template<typename OpT>
+bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a);
+/// \copydoc simdApply
+template<typename OpT>
+bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a, IqShaderData* b);
+/// \copydoc simdApply
+template<typename OpT>
+bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a, IqShaderData* b, IqShaderData* c);
+
+
+//------------------------------------------------------------------------------
+/** \name Lane-wise operation functors
+ *
+ * Each provides operator() for scalar floats and, when SSE2 is available,
+ * for __m128.  The scalar and vector versions must give identical results.
+ */
+//@{
+/// a + b
+struct SqSimdAdd
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return a + b; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_add_ps(a, b); }
+#	endif
+};
+/// a - b
+struct SqSimdSub
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return a - b; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_sub_ps(a, b); }
+#	endif
+};
+/// a * b
+struct SqSimdMul
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return a * b; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_mul_ps(a, b); }
+#	endif
+};
+/// a / b
+struct SqSimdDiv
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return a / b; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_div_ps(a, b); }
+#	endif
+};
+/// Aqsis::min(a, b)
+struct SqSimdMin
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return min(a, b); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_min_ps(a, b); }
+#	endif
+};
+/// Aqsis::max(a, b)
+struct SqSimdMax
+{
+	TqFloat operator()(TqFloat a, TqFloat b) const { return max(a, b); }
+#	ifdef AQSIS_SIMD_SSE2
+	// Operands are swapped so that equal and NaN inputs give the same
+	// result as max().
+	__m128 operator()(__m128 a, __m128 b) const { return _mm_max_ps(b, a); }
+#	endif
+};
+/// Aqsis::clamp(x, min, max)
+struct SqSimdClamp
+{
+	TqFloat operator()(TqFloat x, TqFloat lo, TqFloat hi) const { return clamp(x, lo, hi); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 x, __m128 lo, __m128 hi) const
+	{
+		__m128 below = _mm_cmplt_ps(x, lo);
+		__m128 above = _mm_cmpgt_ps(x, hi);
+		x = _mm_or_ps(_mm_and_ps(above, hi), _mm_andnot_ps(above, x));
+		return _mm_or_ps(_mm_and_ps(below, lo), _mm_andnot_ps(below, x));
+	}
+#	endif
+};
+/// fabs(a)
+struct SqSimdAbs
+{
+	TqFloat operator()(TqFloat a) const { return std::fabs(a); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a) const
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+	}
+#	endif
+};
+/// scale * a
+struct SqSimdScale
+{
+	TqFloat scale;
+	SqSimdScale(TqFloat scale) : scale(scale) {}
+	TqFloat operator()(TqFloat a) const { return scale * a; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 operator()(__m128 a) const { return _mm_mul_ps(_mm_set1_ps(scale), a); }
+#	endif
+};
+
+/// Comparisons, giving 1 where the comparison holds and 0 elsewhere.
+#ifdef AQSIS_SIMD_SSE2
+#	define AQSIS_SIMD_COMPARISON(NAME, OP, SSE_CMP) \
+	struct NAME \
+	{ \
+		TqFloat operator()(TqFloat a, TqFloat b) const { return a OP b; } \
+		__m128 operator()(__m128 a, __m128 b) const \
+		{ \
+			return _mm_and_ps(SSE_CMP(a, b), _mm_set1_ps(1.0f)); \
+		} \
+	};
+#else
+#	define AQSIS_SIMD_COMPARISON(NAME, OP, SSE_CMP) \
+	struct NAME \
+	{ \
+		TqFloat operator()(TqFloat a, TqFloat b) const { return a OP b; } \
+	};
+#endif
+AQSIS_SIMD_COMPARISON(SqSimdLess, <, _mm_cmplt_ps)
+AQSIS_SIMD_COMPARISON(SqSimdGreater, >, _mm_cmpgt_ps)
+AQSIS_SIMD_COMPARISON(SqSimdLessEqual, <=, _mm_cmple_ps)
+AQSIS_SIMD_COMPARISON(SqSimdGreaterEqual, >=, _mm_cmpge_ps)
+AQSIS_SIMD_COMPARISON(SqSimdEqual, ==, _mm_cmpeq_ps)
+AQSIS_SIMD_COMPARISON(SqSimdNotEqual, !=, _mm_cmpneq_ps)
+#undef AQSIS_SIMD_COMPARISON
+//@}
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+namespace detail {
+
+/// Float operand which is either varying or broadcast from a single value.
+struct SqSimdSource
+{
+	const TqFloat* data;
+	bool varying;
+
+	SqSimdSource() : data(0), varying(false) {}
+	TqFloat scalar(TqInt i) const { return data[varying ? i : 0]; }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 vec(TqInt i) const
+	{
+		return varying ? _mm_loadu_ps(data + i) : _mm_set1_ps(*data);
+	}
+#	endif
+};
+
+// Expressions binding an operation to its sources, so that the lane loop
+// below need only be written once.
+template<typename OpT>
+struct SqSimdExpr1
+{
+	const OpT& op;
+	SqSimdSource a;
+	SqSimdExpr1(const OpT& op) : op(op) {}
+	TqFloat scalar(TqInt i) const { return op(a.scalar(i)); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 vec(TqInt i) const { return op(a.vec(i)); }
+#	endif
+};
+template<typename OpT>
+struct SqSimdExpr2
+{
+	const OpT& op;
+	SqSimdSource a, b;
+	SqSimdExpr2(const OpT& op) : op(op) {}
+	TqFloat scalar(TqInt i) const { return op(a.scalar(i), b.scalar(i)); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 vec(TqInt i) const { return op(a.vec(i), b.vec(i)); }
+#	endif
+};
+template<typename OpT>
+struct SqSimdExpr3
+{
+	const OpT& op;
+	SqSimdSource a, b, c;
+	SqSimdExpr3(const OpT& op) : op(op) {}
+	TqFloat scalar(TqInt i) const { return op(a.scalar(i), b.scalar(i), c.scalar(i)); }
+#	ifdef AQSIS_SIMD_SSE2
+	__m128 vec(TqInt i) const { return op(a.vec(i), b.vec(i), c.vec(i)); }
+#	endif
+};
+
+#ifdef AQSIS_SIMD_SSE2
+/// Store the lanes of v selected by the low four bits of laneBits.
+inline void storeMasked(TqFloat* r, __m128 v, TqInt laneBits)
+{
+	if((laneBits & 0xf) == 0xf)
+	{
+		_mm_storeu_ps(r, v);
+		return;
+	}
+	const __m128i select = _mm_set_epi32(8, 4, 2, 1);
+	__m128 mask = _mm_castsi128_ps(_mm_cmpeq_epi32(
+			_mm_and_si128(_mm_set1_epi32(laneBits), select), select));
+	__m128 old = _mm_loadu_ps(r);
+	_mm_storeu_ps(r, _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, old)));
+}
+#endif
+
+/** Evaluate expr for the n lanes selected by the bits in mask.
+ *
+ * Bits are stored least significant first, eight lanes to a byte, as in
+ * CqBitVector.
+ */
+template<typename ExprT>
+void simdRunLanes(const ExprT& expr, TqFloat* r, TqInt n, const bit* mask)
+{
+	for(TqInt i = 0; i < n; i += CHAR_BIT)
+	{
+		TqInt laneBits = mask[i/CHAR_BIT];
+		if(laneBits == 0)
+			continue;
+#		ifdef AQSIS_SIMD_SSE2
+		if(i + CHAR_BIT <= n)
+		{
+			if(laneBits & 0xf)
+				storeMasked(r + i, expr.vec(i), laneBits);
+			if(laneBits & 0xf0)
+				storeMasked(r + i + 4, expr.vec(i + 4), laneBits >> 4);
+			continue;
+		}
+#		endif
+		for(TqInt j = i, end = min(i + CHAR_BIT, n); j < end; ++j, laneBits >>= 1)
+		{
+			if(laneBits & 1)
+				r[j] = expr.scalar(j);
+		}
+	}
+}
+
+/// Set up src from a, returning false if a isn't usable with n lanes.
+inline bool simdSource(SqSimdSource& src, IqShaderData* a, TqUint n)
+{
+	if(a->Type() != type_float || (a->Size() != 1 && a->Size() != n))
+		return false;
+	a->GetFloatPtr(src.data);
+	src.varying = a->Size() > 1;
+	return true;
+}
+
+/// Check that res can take a varying result, returning its storage.
+inline TqFloat* simdResult(IqShaderData* res, const CqBitVector& mask)
+{
+	if(res->Type() != type_float || res->Size() <= 1
+			|| static_cast<TqUint>(mask.Size()) < res->Size())
+		return 0;
+	TqFloat* r = 0;
+	res->GetFloatPtr(r);
+	return r;
+}
+
+} // namespace detail
+
+template<typename OpT>
+inline bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a)
+{
+	TqFloat* r = detail::simdResult(res, mask);
+	detail::SqSimdExpr1<OpT> expr(op);
+	if(!r || !detail::simdSource(expr.a, a, res->Size()))
+		return false;
+	detail::simdRunLanes(expr, r, res->Size(), mask.IntArray());
+	return true;
+}
+
+template<typename OpT>
+inline bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a, IqShaderData* b)
+{
+	TqFloat* r = detail::simdResult(res, mask);
+	detail::SqSimdExpr2<OpT> expr(op);
+	if(!r || !detail::simdSource(expr.a, a, res->Size())
+			|| !detail::simdSource(expr.b, b, res->Size()))
+		return false;
+	detail::simdRunLanes(expr, r, res->Size(), mask.IntArray());
+	return true;
+}
+
+template<typename OpT>
+inline bool simdApply(const OpT& op, IqShaderData* res, const CqBitVector& mask,
+		IqShaderData* a, IqShaderData* b, IqShaderData* c)
+{
+	TqFloat* r = detail::simdResult(res, mask);
+	detail::SqSimdExpr3<OpT> expr(op);
+	if(!r || !detail::simdSource(expr.a, a, res->Size())
+			|| !detail::simdSource(expr.b, b, res->Size())
+			|| !detail::simdSource(expr.c, c, res->Size()))
+		return false;
+	detail::simdRunLanes(expr, r, res->Size(), mask.IntArray());
+	return true;
+}
+
+} // namespace Aqsis
+
+#endif // SIMDOPS_H_INCLUDED
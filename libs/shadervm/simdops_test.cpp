@@ -0,0 +1,304 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests comparing the lane-wise float kernels with the scalar
+ * loops they replace.
+ */
+
+#include "simdops.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "shadervariable.h"
+
+BOOST_AUTO_TEST_SUITE(simdops_tests)
+using namespace Aqsis;
+
+namespace {
+
+// Lengths around the 4-wide SSE groups and the 8-lane mask bytes.
+const TqInt testLengths[] = {2, 3, 4, 5, 7, 8, 9, 13, 16, 17, 31, 64, 67};
+const TqInt numTestLengths = sizeof(testLengths)/sizeof(testLengths[0]);
+
+enum EqMaskPattern
+{
+	Mask_All,
+	Mask_None,
+	Mask_Alternate,
+	Mask_FirstLast,
+	Mask_Random,
+	Mask_Last
+};
+
+void setMask(CqBitVector& mask, TqInt n, EqMaskPattern pattern)
+{
+	mask.SetSize(n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		bool value = false;
+		switch(pattern)
+		{
+			case Mask_All: value = true; break;
+			case Mask_None: value = false; break;
+			case Mask_Alternate: value = (i % 2) == 0; break;
+			case Mask_FirstLast: value = i == 0 || i == n-1; break;
+			default: value = std::rand() % 3 != 0; break;
+		}
+		mask.SetValue(i, value);
+	}
+}
+
+// Fill a varying float with values including negatives, zeros and
+// duplicates, so that min, max, clamp and the comparisons see ties.
+void fillVarying(CqShaderVariableVaryingFloat& var, TqInt n, TqInt seed)
+{
+	var.SetSize(n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		TqFloat f = ((i*7 + seed*3) % 11) - 5.0f;
+		if((i + seed) % 5 == 0)
+			f *= 0.25f;
+		var.SetFloat(f, i);
+	}
+}
+
+// Exact comparison, where any two NaNs count as equal.
+bool sameFloat(TqFloat a, TqFloat b)
+{
+	if(a != a)
+		return b != b;
+	return a == b;
+}
+
+void checkResult(IqShaderData& res, const std::vector<TqFloat>& expected)
+{
+	const TqFloat* r = 0;
+	res.GetFloatPtr(r);
+	for(TqInt i = 0, n = expected.size(); i < n; ++i)
+	{
+		if(!sameFloat(r[i], expected[i]))
+			BOOST_ERROR("lane " << i << " of " << n << ": got " << r[i]
+					<< ", expected " << expected[i]);
+	}
+}
+
+// Run a binary op over all lengths, masks and uniform/varying operands,
+// comparing with the equivalent masked scalar loop.
+template<typename OpT>
+void checkBinaryOp(const OpT& op)
+{
+	for(TqInt l = 0; l < numTestLengths; ++l)
+	{
+		TqInt n = testLengths[l];
+		for(TqInt p = 0; p < Mask_Last; ++p)
+		{
+			CqBitVector mask;
+			setMask(mask, n, static_cast<EqMaskPattern>(p));
+			for(TqInt uniformOps = 0; uniformOps < 3; ++uniformOps)
+			{
+				CqShaderVariableVaryingFloat aVar("a"), bVar("b");
+				CqShaderVariableUniformFloat aUni("a"), bUni("b");
+				fillVarying(aVar, n, 1);
+				fillVarying(bVar, n, 2);
+				aUni.SetFloat(1.5f);
+				bUni.SetFloat(-0.5f);
+				IqShaderData* a = uniformOps == 1 ? static_cast<IqShaderData*>(&aUni) : &aVar;
+				IqShaderData* b = uniformOps == 2 ? static_cast<IqShaderData*>(&bUni) : &bVar;
+
+				CqShaderVariableVaryingFloat res("res");
+				fillVarying(res, n, 3);
+				std::vector<TqFloat> expected(n);
+				for(TqInt i = 0; i < n; ++i)
+				{
+					TqFloat fa, fb, fr;
+					a->GetFloat(fa, a->Size() > 1 ? i : 0);
+					b->GetFloat(fb, b->Size() > 1 ? i : 0);
+					res.GetFloat(fr, i);
+					expected[i] = mask.Value(i) ? op(fa, fb) : fr;
+				}
+
+				BOOST_REQUIRE(simdApply(op, &res, mask, a, b));
+				checkResult(res, expected);
+			}
+		}
+	}
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(simdops_arithmetic_matches_scalar)
+{
+	checkBinaryOp(SqSimdAdd());
+	checkBinaryOp(SqSimdSub());
+	checkBinaryOp(SqSimdMul());
+	checkBinaryOp(SqSimdDiv());
+}
+
+BOOST_AUTO_TEST_CASE(simdops_min_max_matches_scalar)
+{
+	checkBinaryOp(SqSimdMin());
+	checkBinaryOp(SqSimdMax());
+}
+
+BOOST_AUTO_TEST_CASE(simdops_comparisons_match_scalar)
+{
+	checkBinaryOp(SqSimdLess());
+	checkBinaryOp(SqSimdGreater());
+	checkBinaryOp(SqSimdLessEqual());
+	checkBinaryOp(SqSimdGreaterEqual());
+	checkBinaryOp(SqSimdEqual());
+	checkBinaryOp(SqSimdNotEqual());
+}
+
+BOOST_AUTO_TEST_CASE(simdops_unary_matches_scalar)
+{
+	SqSimdAbs absOp;
+	SqSimdScale scaleOp(-2.5f);
+	for(TqInt l = 0; l < numTestLengths; ++l)
+	{
+		TqInt n = testLengths[l];
+		for(TqInt p = 0; p < Mask_Last; ++p)
+		{
+			CqBitVector mask;
+			setMask(mask, n, static_cast<EqMaskPattern>(p));
+			CqShaderVariableVaryingFloat a("a"), absRes("abs"), scaleRes("scale");
+			fillVarying(a, n, 4);
+			a.SetFloat(-0.0f, n-1);
+			fillVarying(absRes, n, 5);
+			fillVarying(scaleRes, n, 6);
+			std::vector<TqFloat> absExpected(n), scaleExpected(n);
+			for(TqInt i = 0; i < n; ++i)
+			{
+				TqFloat fa, fr;
+				a.GetFloat(fa, i);
+				absRes.GetFloat(fr, i);
+				absExpected[i] = mask.Value(i) ? absOp(fa) : fr;
+				scaleRes.GetFloat(fr, i);
+				scaleExpected[i] = mask.Value(i) ? scaleOp(fa) : fr;
+			}
+			BOOST_REQUIRE(simdApply(absOp, &absRes, mask, &a));
+			checkResult(absRes, absExpected);
+			BOOST_REQUIRE(simdApply(scaleOp, &scaleRes, mask, &a));
+			checkResult(scaleRes, scaleExpected);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(simdops_clamp_matches_scalar)
+{
+	SqSimdClamp op;
+	for(TqInt l = 0; l < numTestLengths; ++l)
+	{
+		TqInt n = testLengths[l];
+		for(TqInt p = 0; p < Mask_Last; ++p)
+		{
+			CqBitVector mask;
+			setMask(mask, n, static_cast<EqMaskPattern>(p));
+			CqShaderVariableVaryingFloat x("x"), hi("hi"), res("res");
+			CqShaderVariableUniformFloat lo("lo");
+			fillVarying(x, n, 7);
+			fillVarying(hi, n, 8);
+			lo.SetFloat(-1.0f);
+			fillVarying(res, n, 9);
+			std::vector<TqFloat> expected(n);
+			for(TqInt i = 0; i < n; ++i)
+			{
+				TqFloat fx, fhi, fr;
+				x.GetFloat(fx, i);
+				hi.GetFloat(fhi, i);
+				res.GetFloat(fr, i);
+				expected[i] = mask.Value(i) ? op(fx, -1.0f, fhi) : fr;
+			}
+			BOOST_REQUIRE(simdApply(op, &res, mask, &x, &lo, &hi));
+			checkResult(res, expected);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(simdops_nan_min_max)
+{
+	// min() and max() pass the second operand through when the comparison
+	// fails, and the SSE versions must agree for NaN operands.
+	const TqFloat nan = std::numeric_limits<TqFloat>::quiet_NaN();
+	const TqInt n = 9;
+	CqBitVector mask;
+	setMask(mask, n, Mask_All);
+	CqShaderVariableVaryingFloat a("a"), b("b"), minRes("min"), maxRes("max");
+	fillVarying(a, n, 1);
+	fillVarying(b, n, 2);
+	a.SetFloat(nan, 1);
+	b.SetFloat(nan, 2);
+	a.SetFloat(nan, 8);
+	minRes.SetSize(n);
+	maxRes.SetSize(n);
+	std::vector<TqFloat> minExpected(n), maxExpected(n);
+	for(TqInt i = 0; i < n; ++i)
+	{
+		TqFloat fa, fb;
+		a.GetFloat(fa, i);
+		b.GetFloat(fb, i);
+		minExpected[i] = SqSimdMin()(fa, fb);
+		maxExpected[i] = SqSimdMax()(fa, fb);
+	}
+	BOOST_REQUIRE(simdApply(SqSimdMin(), &minRes, mask, &a, &b));
+	checkResult(minRes, minExpected);
+	BOOST_REQUIRE(simdApply(SqSimdMax(), &maxRes, mask, &a, &b));
+	checkResult(maxRes, maxExpected);
+}
+
+BOOST_AUTO_TEST_CASE(simdops_rejects_unsupported_operands)
+{
+	const TqInt n = 8;
+	CqBitVector mask;
+	setMask(mask, n, Mask_All);
+	CqShaderVariableVaryingFloat a("a"), res("res");
+	fillVarying(a, n, 1);
+	fillVarying(res, n, 2);
+
+	// Operand sizes which don't match the result.
+	CqShaderVariableVaryingFloat shortVar("short");
+	fillVarying(shortVar, n - 3, 3);
+	BOOST_CHECK(!simdApply(SqSimdAdd(), &res, mask, &a, &shortVar));
+
+	// A uniform result.
+	CqShaderVariableUniformFloat uniRes("uniRes");
+	BOOST_CHECK(!simdApply(SqSimdAdd(), &uniRes, mask, &a, &a));
+
+	// A mask which doesn't cover the result.
+	CqBitVector shortMask;
+	setMask(shortMask, n - 1, Mask_All);
+	BOOST_CHECK(!simdApply(SqSimdAdd(), &res, shortMask, &a, &a));
+
+	// The result is left untouched when the kernels refuse.
+	std::vector<TqFloat> expected(n);
+	for(TqInt i = 0; i < n; ++i)
+		res.GetFloat(expected[i], i);
+	BOOST_CHECK(!simdApply(SqSimdAbs(), &res, mask, &shortVar));
+	checkResult(res, expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
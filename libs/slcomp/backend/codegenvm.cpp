@@ -37,10 +37,14 @@
 
 namespace Aqsis {
 
+CqCodeGenVM::CqCodeGenVM( bool binaryOutput )
+	: m_binaryOutput( binaryOutput )
+{}
+
 void CqCodeGenVM::OutputTree( IqParseNode* pNode, std::string strOutName )
 {
 	CqCodeGenDataGather DG;
-	CqCodeGenOutput V( &DG, strOutName );
+	CqCodeGenOutput V( &DG, strOutName, m_binaryOutput );
 	pNode->Accept( DG );
 	pNode->Accept( V );
 }
@@ -39,6 +39,7 @@
 
 #include	"parsenode.h"
 #include	<aqsis/math/math.h>
+#include	<aqsis/util/slxbinary.h>
 #include	<aqsis/util/logging.h>
 
 namespace Aqsis {
@@ -76,8 +77,11 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	std::map<std::string, std::string> temp;
 	m_StackVarMap.push_back( temp );
 
-	m_slxFile.open( strOutName().c_str() );
-	if (m_slxFile.fail( ) )
+	std::ios::openmode mode = std::ios::out;
+	if ( m_binaryOutput )
+		mode |= std::ios::binary;
+	m_outFile.open( strOutName().c_str(), mode );
+	if (m_outFile.fail( ) )
 	{
 		std::cout << "Warning: Cannot open file \"" << strOutName().c_str() << "\"" << std::endl;
 		exit( 1 );
@@ -141,7 +145,11 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	/// \note There is another child here, it is the list of arguments, but they don't need to be
 	/// output as part of the code segment.
 
-	m_slxFile.close();
+	if ( m_binaryOutput )
+		slxTextToBinary( m_slxFile, m_outFile );
+	else
+		m_outFile << m_slxFile.rdbuf();
+	m_outFile.close();
 }
 
 void CqCodeGenOutput::Visit( IqParseNodeFunctionCall& FC )
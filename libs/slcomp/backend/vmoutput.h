@@ -30,6 +30,7 @@
 #include	<vector>
 #include	<deque>
 #include	<fstream>
+#include	<sstream>
 #include	<map>
 
 #include	<aqsis/aqsis.h>
@@ -49,10 +50,12 @@ namespace Aqsis {
 class CqCodeGenOutput : public IqParseNodeVisitor
 {
 	public:
-		CqCodeGenOutput( CqCodeGenDataGather* pDataGather, std::string strOutName ) :
+		CqCodeGenOutput( CqCodeGenDataGather* pDataGather, std::string strOutName,
+		                 bool binaryOutput = false ) :
 		       	m_strOutName( strOutName ),
 		       	m_gcLabels( 0 ),
-		       	m_pDataGather( pDataGather )
+		       	m_pDataGather( pDataGather ),
+		       	m_binaryOutput( binaryOutput )
 		{}
 
 		virtual	void Visit( IqParseNode& );
@@ -110,7 +113,9 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 		CqString	m_strOutName;
 		TqInt	m_gcLabels;
 		CqCodeGenDataGather*	m_pDataGather;
-		std::ofstream	m_slxFile;
+		bool	m_binaryOutput;		///< Write the binary rather than the text slx format.
+		std::ofstream	m_outFile;
+		std::stringstream	m_slxFile;	///< Text of the program, written to m_outFile when complete.
 
 		std::vector<std::vector<SqVarRefTranslator> > m_saTransTable;
 		std::deque<std::map<std::string, std::string> >	m_StackVarMap;
@@ -7,10 +7,128 @@
 ////---------------------------------------------------------------------
 
 #include	<aqsis/aqsis.h>
+
+#include	<cmath>
+#include	<cstring>
+#include	<limits>
+#include	<utility>
+#include	<vector>
+
+#include	<aqsis/math/math.h>
+
 #include	"parsenode.h"
 
 namespace Aqsis {
 
+namespace {
+
+/// Get the value of a node if it's a float constant.
+bool IsFloatConst( const CqParseNode* pNode, TqFloat& value )
+{
+	if ( pNode == 0 || pNode->NodeType() != ParseNode_ConstantFloat )
+		return ( false );
+	value = static_cast<const CqParseNodeFloatConst*>( pNode )->Value();
+	return ( true );
+}
+
+/// Folding mustn't introduce infinities or NaNs the shader would otherwise only produce at run time.
+bool IsFinite( TqFloat value )
+{
+	return ( std::fabs( value ) <= std::numeric_limits<TqFloat>::max() );
+}
+
+/// Evaluate a standard float function of constant arguments, returns false if it can't be done.
+bool EvaluateFloatFunction( const char* strName, const TqFloat* args, TqInt cArgs, TqFloat& result )
+{
+	if ( cArgs == 1 )
+	{
+		TqFloat a = args[ 0 ];
+		if ( std::strcmp( strName, "radians" ) == 0 )
+			result = degToRad( a );
+		else if ( std::strcmp( strName, "degrees" ) == 0 )
+			result = radToDeg( a );
+		else if ( std::strcmp( strName, "sin" ) == 0 )
+			result = std::sin( a );
+		else if ( std::strcmp( strName, "asin" ) == 0 && std::fabs( a ) <= 1 )
+			result = std::asin( a );
+		else if ( std::strcmp( strName, "cos" ) == 0 )
+			result = std::cos( a );
+		else if ( std::strcmp( strName, "acos" ) == 0 && std::fabs( a ) <= 1 )
+			result = std::acos( a );
+		else if ( std::strcmp( strName, "tan" ) == 0 )
+			result = std::tan( a );
+		else if ( std::strcmp( strName, "atan" ) == 0 )
+			result = std::atan( a );
+		else if ( std::strcmp( strName, "exp" ) == 0 )
+			result = std::exp( a );
+		else if ( std::strcmp( strName, "sqrt" ) == 0 && a >= 0 )
+			result = std::sqrt( a );
+		else if ( std::strcmp( strName, "abs" ) == 0 )
+			result = std::fabs( a );
+		else if ( std::strcmp( strName, "floor" ) == 0 )
+			result = std::floor( a );
+		else if ( std::strcmp( strName, "ceil" ) == 0 )
+			result = std::ceil( a );
+		else
+			return ( false );
+		return ( true );
+	}
+	if ( cArgs == 2 )
+	{
+		TqFloat a = args[ 0 ];
+		TqFloat b = args[ 1 ];
+		if ( std::strcmp( strName, "atan2" ) == 0 )
+			result = std::atan2( a, b );
+		else if ( std::strcmp( strName, "pow" ) == 0 && a > 0 )
+			result = std::pow( a, b );
+		else if ( std::strcmp( strName, "min" ) == 0 )
+			result = min( a, b );
+		else if ( std::strcmp( strName, "max" ) == 0 )
+			result = max( a, b );
+		else
+			return ( false );
+		return ( true );
+	}
+	return ( false );
+}
+
+} // anon namespace
+
+
+///---------------------------------------------------------------------
+/// CqParseNode::ReplaceWith
+/// Put another node in the tree in place of this one, this node is deleted.
+
+void CqParseNode::ReplaceWith( CqParseNode* pN )
+{
+	pN->UnLink();
+	if ( pN->m_LineNo < 0 )
+		pN->SetPos( m_LineNo, m_strFileName.c_str() );
+	pN->LinkAfter( this );
+	DeleteTree( this );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNode::DeleteTree
+/// The destructor doesn't delete children, so do it here.
+
+void CqParseNode::DeleteTree( CqParseNode* pNode )
+{
+	CqParseNode* pChild = pNode->m_pChild;
+	pNode->m_pChild = 0;
+	while ( pChild )
+	{
+		CqParseNode * pNext = pChild->pNext();
+		pChild->m_pParent = 0;
+		DeleteTree( pChild );
+		pChild = pNext;
+	}
+	pNode->UnLink();
+	delete( pNode );
+}
+
+
 ///---------------------------------------------------------------------
 /// CqParseNode::Optimise
 
@@ -38,7 +156,25 @@ bool CqParseNodeFunctionCall::Optimise()
 {
 	CqParseNode::Optimise();
 
-	return ( false );
+	// Evaluate standard float functions of constant arguments now.
+	if ( m_aFuncRef.empty() )
+		return ( false );
+	const IqFuncDef* pFunc = pFuncDef();
+	if ( pFunc == 0 || pFunc->fLocal() || ( pFunc->Type() & Type_Mask ) != Type_Float )
+		return ( false );
+	TqFloat args[ 2 ];
+	TqInt cArgs = 0;
+	for ( CqParseNode* pArg = m_pChild; pArg != 0; pArg = pArg->pNext() )
+	{
+		if ( cArgs == 2 || !IsFloatConst( pArg, args[ cArgs ] ) )
+			return ( false );
+		++cArgs;
+	}
+	TqFloat result;
+	if ( !EvaluateFloatFunction( pFunc->strVMName(), args, cArgs, result ) || !IsFinite( result ) )
+		return ( false );
+	ReplaceWith( new CqParseNodeFloatConst( result ) );
+	return ( true );
 }
 
 
@@ -117,5 +253,954 @@ bool CqParseNodeCast::Optimise()
 	return ( false );
 }
 
+
+///---------------------------------------------------------------------
+/// CqParseNodeMathOp::Optimise
+/// Fold arithmetic on constants, and remove additions of zero and
+/// multiplications by one.
+
+bool CqParseNodeMathOp::Optimise()
+{
+	CqParseNode::Optimise();
+
+	CqParseNode* pA = m_pChild;
+	CqParseNode* pB = pA ? pA->pNext() : 0;
+	if ( pB == 0 )
+		return ( false );
+
+	TqFloat a, b;
+	bool fConstA = IsFloatConst( pA, a );
+	bool fConstB = IsFloatConst( pB, b );
+	if ( fConstA && fConstB )
+	{
+		TqFloat result;
+		switch ( m_Operator )
+		{
+				case Op_Add:
+				result = a + b;
+				break;
+				case Op_Sub:
+				result = a - b;
+				break;
+				case Op_Mul:
+				result = a * b;
+				break;
+				case Op_Div:
+				if ( b == 0 )
+					return ( false );
+				result = a / b;
+				break;
+				default:
+				return ( false );
+		}
+		if ( !IsFinite( result ) )
+			return ( false );
+		ReplaceWith( new CqParseNodeFloatConst( result ) );
+		return ( true );
+	}
+
+	// Look for an operand which leaves the other unchanged.
+	CqParseNode* pKeep = 0;
+	switch ( m_Operator )
+	{
+			case Op_Add:
+			if ( fConstA && a == 0 )
+				pKeep = pB;
+			else if ( fConstB && b == 0 )
+				pKeep = pA;
+			break;
+			case Op_Sub:
+			if ( fConstB && b == 0 )
+				pKeep = pA;
+			break;
+			case Op_Mul:
+			if ( fConstA && a == 1 )
+				pKeep = pB;
+			else if ( fConstB && b == 1 )
+				pKeep = pA;
+			break;
+			case Op_Div:
+			if ( fConstB && b == 1 )
+				pKeep = pA;
+			break;
+			default:
+			break;
+	}
+	// Only if the result is the same type as the operand it would be replaced by.
+	if ( pKeep == 0 || ( pKeep->ResType() & Type_Mask ) != ( ResType() & Type_Mask ) )
+		return ( false );
+	ReplaceWith( pKeep );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeRelOp::Optimise
+/// Fold comparisons of constants.
+
+bool CqParseNodeRelOp::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat a, b;
+	if ( m_pChild == 0 || !IsFloatConst( m_pChild, a ) || !IsFloatConst( m_pChild->pNext(), b ) )
+		return ( false );
+	bool result;
+	switch ( m_Operator )
+	{
+			case Op_EQ:
+			result = ( a == b );
+			break;
+			case Op_NE:
+			result = ( a != b );
+			break;
+			case Op_L:
+			result = ( a < b );
+			break;
+			case Op_G:
+			result = ( a > b );
+			break;
+			case Op_GE:
+			result = ( a >= b );
+			break;
+			case Op_LE:
+			result = ( a <= b );
+			break;
+			default:
+			return ( false );
+	}
+	ReplaceWith( new CqParseNodeFloatConst( result ? 1.0f : 0.0f ) );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeUnaryOp::Optimise
+/// Fold unary operators applied to constants.
+
+bool CqParseNodeUnaryOp::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat a;
+	if ( !IsFloatConst( m_pChild, a ) )
+		return ( false );
+	TqFloat result;
+	switch ( m_Operator )
+	{
+			case Op_Plus:
+			result = a;
+			break;
+			case Op_Neg:
+			result = -a;
+			break;
+			case Op_LogicalNot:
+			result = ( a == 0 ) ? 1.0f : 0.0f;
+			break;
+			default:
+			return ( false );
+	}
+	ReplaceWith( new CqParseNodeFloatConst( result ) );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeLogicalOp::Optimise
+/// Fold logical operators applied to constants.
+
+bool CqParseNodeLogicalOp::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat a, b;
+	if ( m_pChild == 0 || !IsFloatConst( m_pChild, a ) || !IsFloatConst( m_pChild->pNext(), b ) )
+		return ( false );
+	bool result;
+	switch ( m_Operator )
+	{
+			case Op_LogAnd:
+			result = ( a != 0 && b != 0 );
+			break;
+			case Op_LogOr:
+			result = ( a != 0 || b != 0 );
+			break;
+			default:
+			return ( false );
+	}
+	ReplaceWith( new CqParseNodeFloatConst( result ? 1.0f : 0.0f ) );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeWhileConstruct::Optimise
+/// Remove loops which can never run.
+
+bool CqParseNodeWhileConstruct::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat cond;
+	if ( !IsFloatConst( m_pChild, cond ) || cond != 0 )
+		return ( false );
+	ReplaceWith( new CqParseNode() );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeConditional::Optimise
+/// Replace conditionals on a constant with the branch which is taken.
+
+bool CqParseNodeConditional::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat cond;
+	if ( !IsFloatConst( m_pChild, cond ) )
+		return ( false );
+	CqParseNode* pTrue = m_pChild->pNext();
+	CqParseNode* pFalse = pTrue ? pTrue->pNext() : 0;
+	CqParseNode* pTaken = ( cond != 0 ) ? pTrue : pFalse;
+	ReplaceWith( pTaken ? pTaken : new CqParseNode() );
+	return ( true );
+}
+
+
+///---------------------------------------------------------------------
+/// CqParseNodeQCond::Optimise
+/// Replace a ?: expression on a constant with the value chosen.
+
+bool CqParseNodeQCond::Optimise()
+{
+	CqParseNode::Optimise();
+
+	TqFloat cond;
+	if ( !IsFloatConst( m_pChild, cond ) )
+		return ( false );
+	CqParseNode* pTrue = m_pChild->pNext();
+	CqParseNode* pFalse = pTrue ? pTrue->pNext() : 0;
+	CqParseNode* pTaken = ( cond != 0 ) ? pTrue : pFalse;
+	if ( pTaken == 0 || ( pTaken->ResType() & Type_Mask ) != ( ResType() & Type_Mask ) )
+		return ( false );
+	ReplaceWith( pTaken );
+	return ( true );
+}
+
+//---------------------------------------------------------------------
+// Data flow optimisations over the whole shader.
+
+namespace {
+
+/// How a local variable is used across the whole shader.
+struct SqVariableUsage
+{
+	SqVariableUsage() :
+			m_cReads( 0 ),
+			m_cAssigns( 0 ),
+			m_fEscapes( false ),
+			m_fInFunction( false ),
+			m_fVaryingAssign( false )
+	{}
+
+	TqInt	m_cReads;			///< Number of places the value is read.
+	TqInt	m_cAssigns;			///< Number of assignments to the variable.
+	bool	m_fEscapes;			///< Passed somewhere which might modify it other than by assignment.
+	bool	m_fInFunction;		///< Referenced from the body of a local function.
+	bool	m_fVaryingAssign;	///< Assigned a varying value, or assigned under varying control flow.
+};
+
+/// Context of the walk which gathers variable usage.
+struct SqUsageContext
+{
+	bool	m_fVaryingFlow;		///< Running under control flow which may differ across the grid.
+	bool	m_fInFunction;		///< Walking a local function definition.
+	bool	m_fEscape;			///< Every variable seen may be modified.
+};
+
+/// Statements, paired with the node they belong to.
+typedef std::vector<std::pair<CqParseNode*, CqParseNode*> > TqStatementList;
+
+
+/// Find the index into gLocalVars of a variable reference, following externs.
+bool LocalIndex( SqVarRef ref, TqUint& index )
+{
+	while ( ref.m_Type == VarTypeLocal && ref.m_Index < gLocalVars.size() &&
+	        gLocalVars[ ref.m_Index ].fExtern() )
+		ref = gLocalVars[ ref.m_Index ].vrExtern();
+	if ( ref.m_Type != VarTypeLocal || ref.m_Index >= gLocalVars.size() )
+		return ( false );
+	index = ref.m_Index;
+	return ( true );
+}
+
+const IqFuncDef* CalledFunction( const CqParseNode* pNode )
+{
+	return ( static_cast<const CqParseNodeFunctionCall*>( pNode )->pFuncDef() );
+}
+
+/// Determine whether a function may modify its arguments.
+bool ModifiesArguments( const IqFuncDef* pFunc )
+{
+	if ( pFunc == 0 || pFunc->fLocal() )
+		return ( true );
+	// Output arguments are marked by an uppercase type.
+	for ( const char* pParam = pFunc->strParams(); *pParam != '\0'; ++pParam )
+	{
+		if ( *pParam >= 'A' && *pParam <= 'Z' )
+			return ( true );
+	}
+	const char* strName = pFunc->strName();
+	return ( std::strncmp( strName, "set", 3 ) == 0 || std::strcmp( strName, "texture3d" ) == 0 );
+}
+
+/// Determine whether a function depends only on its arguments, and leaves them alone.
+bool IsPureFunction( const IqFuncDef* pFunc )
+{
+	static const char* pureFunctions[] =
+	    {
+	        "radians", "degrees", "sin", "asin", "cos", "acos", "tan", "atan",
+	        "pow", "exp", "sqrt", "inversesqrt", "log", "mod", "abs", "sign",
+	        "min", "max", "clamp", "floor", "ceil", "round", "step", "smoothstep",
+	        "mix", "spline", "noise", "pnoise", "cellnoise",
+	        "xcomp", "ycomp", "zcomp", "comp", "length", "distance", "normalize",
+	        "reflect", "refract", "faceforward", "ptlined", "determinant",
+	        "translate", "rotate", "scale", "concat", "format", "match"
+	    };
+	if ( pFunc == 0 || pFunc->InternalUsage() != 0 || ModifiesArguments( pFunc ) )
+		return ( false );
+	for ( TqUint i = 0; i < sizeof( pureFunctions ) / sizeof( pureFunctions[ 0 ] ); ++i )
+	{
+		if ( std::strcmp( pFunc->strName(), pureFunctions[ i ] ) == 0 )
+			return ( true );
+	}
+	return ( false );
+}
+
+/// Determine whether an expression has no side effects, and depends only on its operands.
+bool IsPureExpr( const CqParseNode* pNode )
+{
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_ConstantFloat:
+			case ParseNode_ConstantString:
+			return ( true );
+			case ParseNode_FunctionCall:
+			if ( !IsPureFunction( CalledFunction( pNode ) ) )
+				return ( false );
+			break;
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			case ParseNode_MathOp:
+			case ParseNode_RelationalOp:
+			case ParseNode_UnaryOp:
+			case ParseNode_LogicalOp:
+			case ParseNode_TypeCast:
+			case ParseNode_Triple:
+			case ParseNode_SixteenTuple:
+			case ParseNode_ConditionalExpression:
+			break;
+			default:
+			return ( false );
+	}
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		if ( !IsPureExpr( pChild ) )
+			return ( false );
+	}
+	return ( true );
+}
+
+/// Determine whether an expression may give a different value at each shading point.
+bool IsVaryingExpr( const CqParseNode* pNode )
+{
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_ConstantFloat:
+			case ParseNode_ConstantString:
+			return ( false );
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			case ParseNode_VariableAssign:
+			case ParseNode_ArrayVariableAssign:
+			{
+				const CqVarDef* pVarDef = CqVarDef::GetVariablePtr(
+				                              static_cast<const CqParseNodeVariable*>( pNode )->VarRef() );
+				if ( pVarDef == 0 || ( pVarDef->Type() & Type_Varying ) != 0 )
+					return ( true );
+			}
+			break;
+			case ParseNode_FunctionCall:
+			if ( !IsPureFunction( CalledFunction( pNode ) ) )
+				return ( true );
+			break;
+			case ParseNode_Base:
+			case ParseNode_MathOp:
+			case ParseNode_RelationalOp:
+			case ParseNode_UnaryOp:
+			case ParseNode_LogicalOp:
+			case ParseNode_TypeCast:
+			case ParseNode_Triple:
+			case ParseNode_SixteenTuple:
+			case ParseNode_ConditionalExpression:
+			break;
+			default:
+			return ( true );
+	}
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		if ( IsVaryingExpr( pChild ) )
+			return ( true );
+	}
+	return ( false );
+}
+
+/// Determine whether a subtree might change the value of any variable.
+bool HasSideEffects( const CqParseNode* pNode )
+{
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_VariableAssign:
+			case ParseNode_ArrayVariableAssign:
+			case ParseNode_UnresolvedCall:
+			case ParseNode_MessagePassingFunction:
+			return ( true );
+			case ParseNode_FunctionCall:
+			if ( ModifiesArguments( CalledFunction( pNode ) ) )
+				return ( true );
+			break;
+			default:
+			break;
+	}
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		if ( HasSideEffects( pChild ) )
+			return ( true );
+	}
+	return ( false );
+}
+
+bool ContainsNodeType( const CqParseNode* pNode, TqInt type )
+{
+	if ( pNode->NodeType() == type )
+		return ( true );
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		if ( ContainsNodeType( pChild, type ) )
+			return ( true );
+	}
+	return ( false );
+}
+
+TqInt TreeSize( const CqParseNode* pNode )
+{
+	TqInt size = 1;
+	for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+		size += TreeSize( pChild );
+	return ( size );
+}
+
+/// Determine whether a variable used as an operand of this node is only read.
+bool PassesByValue( const CqParseNode* pParent )
+{
+	switch ( pParent->NodeType() )
+	{
+			case ParseNode_Base:
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			case ParseNode_VariableAssign:
+			case ParseNode_ArrayVariableAssign:
+			case ParseNode_MathOp:
+			case ParseNode_RelationalOp:
+			case ParseNode_UnaryOp:
+			case ParseNode_LogicalOp:
+			case ParseNode_DiscardResult:
+			case ParseNode_TypeCast:
+			case ParseNode_Triple:
+			case ParseNode_SixteenTuple:
+			case ParseNode_ConditionalExpression:
+			case ParseNode_Conditional:
+			case ParseNode_WhileConstruct:
+			case ParseNode_IlluminateConstruct:
+			case ParseNode_IlluminanceConstruct:
+			case ParseNode_SolarConstruct:
+			return ( true );
+			case ParseNode_FunctionCall:
+			return ( !ModifiesArguments( CalledFunction( pParent ) ) );
+			default:
+			return ( false );
+	}
+}
+
+void GatherUsage( const CqParseNode* pNode, const CqParseNode* pParent, SqUsageContext ctx,
+                  std::vector<SqVariableUsage>& usage )
+{
+	TqUint index;
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			if ( LocalIndex( static_cast<const CqParseNodeVariable*>( pNode )->VarRef(), index ) )
+			{
+				SqVariableUsage& use = usage[ index ];
+				++use.m_cReads;
+				use.m_fInFunction |= ctx.m_fInFunction;
+				if ( ctx.m_fEscape || pParent == 0 || !PassesByValue( pParent ) )
+					use.m_fEscapes = true;
+			}
+			break;
+			case ParseNode_VariableAssign:
+			case ParseNode_ArrayVariableAssign:
+			if ( LocalIndex( static_cast<const CqParseNodeVariable*>( pNode )->VarRef(), index ) )
+			{
+				SqVariableUsage& use = usage[ index ];
+				++use.m_cAssigns;
+				use.m_fInFunction |= ctx.m_fInFunction;
+				use.m_fEscapes |= ctx.m_fEscape;
+				bool fVarying = ctx.m_fVaryingFlow;
+				for ( const CqParseNode* pChild = pNode->pFirstChild(); pChild != 0 && !fVarying; pChild = pChild->pNext() )
+					fVarying = IsVaryingExpr( pChild );
+				use.m_fVaryingAssign |= fVarying;
+			}
+			break;
+			case ParseNode_MessagePassingFunction:
+			if ( LocalIndex( static_cast<const CqParseNodeCommFunction*>( pNode )->VarRef(), index ) )
+			{
+				SqVariableUsage& use = usage[ index ];
+				++use.m_cReads;
+				use.m_fInFunction |= ctx.m_fInFunction;
+				use.m_fEscapes = true;
+			}
+			break;
+			default:
+			break;
+	}
+
+	SqUsageContext childCtx = ctx;
+	const CqParseNode* pChild = pNode->pFirstChild();
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_Conditional:
+			case ParseNode_ConditionalExpression:
+			// The condition runs under the enclosing flow, the branches under its control.
+			if ( pChild != 0 )
+			{
+				GatherUsage( pChild, pNode, ctx, usage );
+				childCtx.m_fVaryingFlow |= IsVaryingExpr( pChild );
+				pChild = pChild->pNext();
+			}
+			break;
+			case ParseNode_WhileConstruct:
+			// Break and continue can stop some points before others.
+			childCtx.m_fVaryingFlow |= ( pChild != 0 && IsVaryingExpr( pChild ) ) ||
+			                           ContainsNodeType( pNode, ParseNode_LoopMod );
+			break;
+			case ParseNode_IlluminateConstruct:
+			case ParseNode_IlluminanceConstruct:
+			case ParseNode_SolarConstruct:
+			childCtx.m_fVaryingFlow = true;
+			break;
+			case ParseNode_GatherConstruct:
+			childCtx.m_fVaryingFlow = true;
+			// The arguments of gather include output variables.
+			if ( pChild != 0 )
+			{
+				SqUsageContext argCtx = childCtx;
+				argCtx.m_fEscape = true;
+				GatherUsage( pChild, pNode, argCtx, usage );
+				pChild = pChild->pNext();
+			}
+			break;
+			default:
+			break;
+	}
+	for ( ; pChild != 0; pChild = pChild->pNext() )
+		GatherUsage( pChild, pNode, childCtx, usage );
+}
+
+/// Find how each local variable is used by the shader and the functions it calls.
+void CollectUsage( const CqParseNode* pTree, std::vector<SqVariableUsage>& usage )
+{
+	usage.assign( gLocalVars.size(), SqVariableUsage() );
+	SqUsageContext ctx = { false, false, false };
+	GatherUsage( pTree, 0, ctx, usage );
+	// Local functions are inlined wherever they're called, so anything they touch is left alone.
+	ctx.m_fVaryingFlow = true;
+	ctx.m_fInFunction = true;
+	for ( TqUint i = 0; i < gLocalFuncs.size(); ++i )
+	{
+		if ( gLocalFuncs[ i ].pDefNode() )
+			GatherUsage( gLocalFuncs[ i ].pDefNode(), 0, ctx, usage );
+		if ( gLocalFuncs[ i ].pArgs() )
+			GatherUsage( gLocalFuncs[ i ].pArgs(), 0, ctx, usage );
+	}
+}
+
+/// Collect the simple statements of the shader bodies, along with their parents.
+void CollectStatements( CqParseNode* pNode, CqParseNode* pParent, TqStatementList& statements )
+{
+	CqParseNode* pChild = pNode->pFirstChild();
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_Base:
+			break;
+			case ParseNode_Shader:
+			// The body is followed by the formal arguments.
+			if ( pChild != 0 )
+				CollectStatements( pChild, pNode, statements );
+			return;
+			case ParseNode_Conditional:
+			case ParseNode_WhileConstruct:
+			case ParseNode_IlluminateConstruct:
+			case ParseNode_IlluminanceConstruct:
+			case ParseNode_GatherConstruct:
+			// Skip the condition or arguments.
+			pChild = pChild ? pChild->pNext() : 0;
+			break;
+			case ParseNode_SolarConstruct:
+			if ( pChild != 0 && pChild->pNext() != 0 )
+				pChild = pChild->pNext();
+			break;
+			default:
+			statements.push_back( std::make_pair( pNode, pParent ) );
+			return;
+	}
+	while ( pChild != 0 )
+	{
+		CqParseNode * pNext = pChild->pNext();
+		CollectStatements( pChild, pNode, statements );
+		pChild = pNext;
+	}
+}
+
+bool IsStatementAssign( const CqParseNode* pNode )
+{
+	return ( ( pNode->NodeType() == ParseNode_VariableAssign ||
+	           pNode->NodeType() == ParseNode_ArrayVariableAssign ) &&
+	         static_cast<const CqParseNodeAssign*>( pNode )->fDiscardResult() );
+}
+
+
+///---------------------------------------------------------------------
+/// Dead store elimination.
+
+bool IsDeadStore( const CqParseNode* pStmt, const std::vector<SqVariableUsage>& usage )
+{
+	TqUint index;
+	if ( !IsStatementAssign( pStmt ) ||
+	        !LocalIndex( static_cast<const CqParseNodeAssign*>( pStmt )->VarRef(), index ) )
+		return ( false );
+	if ( gLocalVars[ index ].Type() & ( Type_Param | Type_Output ) )
+		return ( false );
+	const SqVariableUsage& use = usage[ index ];
+	if ( use.m_cReads > 0 || use.m_fEscapes || use.m_fInFunction )
+		return ( false );
+	for ( const CqParseNode* pChild = pStmt->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+	{
+		if ( !IsPureExpr( pChild ) )
+			return ( false );
+	}
+	return ( true );
+}
+
+void EliminateDeadStores( CqParseNode* pTree )
+{
+	std::vector<SqVariableUsage> usage;
+	bool fChanged = true;
+	// Removing a store can leave the variables it read unused, so repeat until nothing changes.
+	while ( fChanged )
+	{
+		fChanged = false;
+		CollectUsage( pTree, usage );
+		TqStatementList statements;
+		CollectStatements( pTree, 0, statements );
+		for ( TqStatementList::iterator i = statements.begin(); i != statements.end(); ++i )
+		{
+			if ( !IsDeadStore( i->first, usage ) )
+				continue;
+			// Statement lists can just lose the statement, elsewhere leave an empty one.
+			if ( i->second != 0 && i->second->NodeType() == ParseNode_Base )
+				CqParseNode::DeleteTree( i->first );
+			else
+				i->first->ReplaceWith( new CqParseNode() );
+			fChanged = true;
+		}
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// Common subexpression elimination within a statement.
+
+bool IsCseCandidate( const CqParseNode* pNode )
+{
+	if ( pNode->NodeType() != ParseNode_MathOp && pNode->NodeType() != ParseNode_FunctionCall )
+		return ( false );
+	TqInt type = pNode->ResType();
+	if ( type & Type_Array )
+		return ( false );
+	switch ( type & Type_Mask )
+	{
+			case Type_Float:
+			case Type_Point:
+			case Type_Color:
+			case Type_Normal:
+			case Type_Vector:
+			case Type_Matrix:
+			break;
+			default:
+			return ( false );
+	}
+	return ( IsPureExpr( pNode ) );
+}
+
+/// Collect the expressions of a statement which could be hoisted out of it.
+/// The arms of a ?: are only run where the condition chooses them, so
+/// expressions in them would be run at points the condition excluded, where
+/// they may fail.  Only the condition of a ?: is searched.
+void CollectCseCandidates( CqParseNode* pNode, std::vector<CqParseNode*>& candidates )
+{
+	if ( IsCseCandidate( pNode ) )
+		candidates.push_back( pNode );
+	CqParseNode* pChild = pNode->pFirstChild();
+	CqParseNode* pEnd = 0;
+	if ( pNode->NodeType() == ParseNode_ConditionalExpression && pChild != 0 )
+		pEnd = pChild->pNext();
+	for ( ; pChild != pEnd; pChild = pChild->pNext() )
+		CollectCseCandidates( pChild, candidates );
+}
+
+bool SameExpression( const CqParseNode* pA, const CqParseNode* pB )
+{
+	TqInt type = pA->NodeType();
+	if ( type != pB->NodeType() || ( pA->ResType() & Type_Mask ) != ( pB->ResType() & Type_Mask ) )
+		return ( false );
+	switch ( type )
+	{
+			case ParseNode_ConstantFloat:
+			if ( static_cast<const CqParseNodeFloatConst*>( pA )->Value() !=
+			        static_cast<const CqParseNodeFloatConst*>( pB )->Value() )
+				return ( false );
+			break;
+			case ParseNode_ConstantString:
+			if ( std::strcmp( static_cast<const CqParseNodeStringConst*>( pA )->strValue(),
+			                  static_cast<const CqParseNodeStringConst*>( pB )->strValue() ) != 0 )
+				return ( false );
+			break;
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			{
+				SqVarRef refA = static_cast<const CqParseNodeVariable*>( pA )->VarRef();
+				SqVarRef refB = static_cast<const CqParseNodeVariable*>( pB )->VarRef();
+				if ( refA.m_Type != refB.m_Type || refA.m_Index != refB.m_Index )
+					return ( false );
+			}
+			break;
+			case ParseNode_MathOp:
+			case ParseNode_RelationalOp:
+			case ParseNode_UnaryOp:
+			case ParseNode_LogicalOp:
+			if ( static_cast<const CqParseNodeOp*>( pA )->Operator() !=
+			        static_cast<const CqParseNodeOp*>( pB )->Operator() )
+				return ( false );
+			break;
+			case ParseNode_TypeCast:
+			if ( static_cast<const CqParseNodeCast*>( pA )->CastTo() !=
+			        static_cast<const CqParseNodeCast*>( pB )->CastTo() )
+				return ( false );
+			break;
+			case ParseNode_FunctionCall:
+			{
+				const IqFuncDef* pFuncA = CalledFunction( pA );
+				const IqFuncDef* pFuncB = CalledFunction( pB );
+				if ( pFuncA == 0 || pFuncB == 0 ||
+				        std::strcmp( pFuncA->strVMName(), pFuncB->strVMName() ) != 0 )
+					return ( false );
+			}
+			break;
+			default:
+			break;
+	}
+	const CqParseNode* pChildA = pA->pFirstChild();
+	const CqParseNode* pChildB = pB->pFirstChild();
+	while ( pChildA != 0 && pChildB != 0 )
+	{
+		if ( !SameExpression( pChildA, pChildB ) )
+			return ( false );
+		pChildA = pChildA->pNext();
+		pChildB = pChildB->pNext();
+	}
+	return ( pChildA == 0 && pChildB == 0 );
+}
+
+/// Calculate a repeated expression once into a new temporary variable just
+/// before the statement, and use the variable in its place.  Returns the new
+/// parent of the statement.
+CqParseNode* HoistExpression( CqParseNode* pStmt, CqParseNode* pParent,
+                              const std::vector<CqParseNode*>& matches )
+{
+	CqParseNode* pExpr = matches[ 0 ];
+
+	TqInt type = ( pExpr->ResType() & Type_Mask ) |
+	             ( IsVaryingExpr( pExpr ) ? Type_Varying : Type_Uniform );
+	SqVarRef ref;
+	TqInt iTemp = gLocalVars.size();
+	CqString strName;
+	do
+	{
+		strName = CqString( "_cse" ) + CqString( iTemp++ );
+	}
+	while ( CqVarDef::FindVariable( strName.c_str(), ref ) );
+	CqVarDef def( type, strName.c_str() );
+	ref.m_Type = VarTypeLocal;
+	ref.m_Index = CqVarDef::AddVariable( def );
+
+	CqParseNodeAssign* pAssign = new CqParseNodeAssign( ref );
+	pAssign->SetPos( pStmt->LineNo(), pStmt->strFileName() );
+	pAssign->NoDup();
+	CqParseNode* pVar = new CqParseNodeVariable( ref );
+	pVar->LinkAfter( pExpr );
+	pExpr->UnLink();
+	pAssign->AddLastChild( pExpr );
+	for ( TqUint i = 1; i < matches.size(); ++i )
+		matches[ i ]->ReplaceWith( new CqParseNodeVariable( ref ) );
+
+	// Statements outside of a list need one made to hold the new assignment.
+	if ( pParent->NodeType() != ParseNode_Base )
+	{
+		CqParseNode* pBlock = new CqParseNode();
+		pBlock->SetPos( pStmt->LineNo(), pStmt->strFileName() );
+		pStmt->LinkParent( pBlock );
+		pParent = pBlock;
+	}
+	if ( pStmt->pPrevious() != 0 )
+		pAssign->LinkAfter( pStmt->pPrevious() );
+	else
+		pParent->AddFirstChild( pAssign );
+	return ( pParent );
+}
+
+void EliminateCommonSubexpressions( CqParseNode* pTree )
+{
+	TqStatementList statements;
+	CollectStatements( pTree, 0, statements );
+
+	// Adding variables mustn't reallocate gLocalVars, as the default values of
+	// the shader arguments are shared with the tree, so make room for as many
+	// temporaries as there could possibly be first.
+	TqInt cNodes = 0;
+	for ( TqStatementList::iterator i = statements.begin(); i != statements.end(); ++i )
+		cNodes += TreeSize( i->first );
+	gLocalVars.reserve( gLocalVars.size() + cNodes );
+
+	for ( TqStatementList::iterator i = statements.begin(); i != statements.end(); ++i )
+	{
+		CqParseNode* pStmt = i->first;
+		CqParseNode* pParent = i->second;
+		if ( pParent == 0 || !IsStatementAssign( pStmt ) )
+			continue;
+		bool fSafe = true;
+		for ( const CqParseNode* pChild = pStmt->pFirstChild(); pChild != 0 && fSafe; pChild = pChild->pNext() )
+			fSafe = !HasSideEffects( pChild );
+		if ( !fSafe )
+			continue;
+
+		while ( true )
+		{
+			std::vector<CqParseNode*> candidates;
+			for ( CqParseNode* pChild = pStmt->pFirstChild(); pChild != 0; pChild = pChild->pNext() )
+				CollectCseCandidates( pChild, candidates );
+
+			// Find the largest expression which is repeated.
+			std::vector<CqParseNode*> matches;
+			TqInt bestSize = 0;
+			for ( TqUint a = 0; a < candidates.size(); ++a )
+			{
+				TqInt size = TreeSize( candidates[ a ] );
+				if ( size <= bestSize )
+					continue;
+				std::vector<CqParseNode*> found( 1, candidates[ a ] );
+				for ( TqUint b = a + 1; b < candidates.size(); ++b )
+				{
+					if ( SameExpression( candidates[ a ], candidates[ b ] ) )
+						found.push_back( candidates[ b ] );
+				}
+				if ( found.size() > 1 )
+				{
+					matches.swap( found );
+					bestSize = size;
+				}
+			}
+			if ( matches.empty() )
+				break;
+			pParent = HoistExpression( pStmt, pParent, matches );
+		}
+	}
+}
+
+
+///---------------------------------------------------------------------
+/// Storage class inference.
+
+void DemoteUniformVariables( CqParseNode* pTree )
+{
+	std::vector<SqVariableUsage> usage;
+	CollectUsage( pTree, usage );
+
+	// Optimistically make every local which might hold a uniform value
+	// uniform, then put back those which turn out to be assigned varying
+	// values until nothing changes.
+	std::vector<TqUint> candidates;
+	for ( TqUint i = 0; i < gLocalVars.size(); ++i )
+	{
+		CqVarDef& var = gLocalVars[ i ];
+		const SqVariableUsage& use = usage[ i ];
+		if ( var.fExtern() || ( var.Type() & ( Type_Param | Type_Output | Type_Array ) ) ||
+		        !( var.Type() & Type_Varying ) )
+			continue;
+		if ( use.m_fEscapes || use.m_fInFunction || use.m_cAssigns == 0 )
+			continue;
+		var.SetType( ( var.Type() & ~Storage_Mask ) | Type_Uniform );
+		candidates.push_back( i );
+	}
+
+	bool fChanged = !candidates.empty();
+	while ( fChanged )
+	{
+		fChanged = false;
+		CollectUsage( pTree, usage );
+		std::vector<TqUint>::iterator i = candidates.begin();
+		while ( i != candidates.end() )
+		{
+			if ( usage[ *i ].m_fVaryingAssign )
+			{
+				CqVarDef& var = gLocalVars[ *i ];
+				var.SetType( ( var.Type() & ~Storage_Mask ) | Type_Varying );
+				i = candidates.erase( i );
+				fChanged = true;
+			}
+			else
+				++i;
+		}
+	}
+}
+
+} // anon namespace
+
+
+///---------------------------------------------------------------------
+/// OptimiseDataFlow
+/// Optimisations which need to know how every local variable is used.
+
+void OptimiseDataFlow( CqParseNode* pTree )
+{
+	if ( pTree == 0 )
+		return ;
+	EliminateDeadStores( pTree );
+	EliminateCommonSubexpressions( pTree );
+	DemoteUniformVariables( pTree );
+}
+
 } // namespace Aqsis
 //---------------------------------------------------------------------
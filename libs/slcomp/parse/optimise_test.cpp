@@ -0,0 +1,535 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the parse tree optimisations.
+ *
+ * The shaders are built directly as parse trees, in the form the parser and
+ * type checker leave them, and a small evaluator for float statements is
+ * used to check that optimising doesn't change what they compute.
+ */
+
+#include "parsenode.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <map>
+#include <string>
+
+#include "funcdef.h"
+#include "vardef.h"
+
+BOOST_AUTO_TEST_SUITE(optimise_tests)
+using namespace Aqsis;
+
+namespace {
+
+//------------------------------------------------------------------------------
+// Parse tree construction
+
+SqVarRef addVar(const char* name, TqInt type)
+{
+	CqVarDef def(type, name);
+	SqVarRef ref;
+	ref.m_Type = VarTypeLocal;
+	ref.m_Index = CqVarDef::AddVariable(def);
+	return ref;
+}
+
+CqParseNode* num(TqFloat value)
+{
+	return new CqParseNodeFloatConst(value);
+}
+
+CqParseNode* var(SqVarRef ref)
+{
+	return new CqParseNodeVariable(ref);
+}
+
+CqParseNode* math(EqMathOp op, CqParseNode* a, CqParseNode* b)
+{
+	CqParseNode* node = new CqParseNodeMathOp(op);
+	node->AddLastChild(a);
+	node->AddLastChild(b);
+	return node;
+}
+
+CqParseNode* rel(EqRelOp op, CqParseNode* a, CqParseNode* b)
+{
+	CqParseNode* node = new CqParseNodeRelOp(op);
+	node->AddLastChild(a);
+	node->AddLastChild(b);
+	return node;
+}
+
+CqParseNode* neg(CqParseNode* a)
+{
+	CqParseNode* node = new CqParseNodeUnaryOp(Op_Neg);
+	node->AddLastChild(a);
+	return node;
+}
+
+CqParseNode* qcond(CqParseNode* cond, CqParseNode* ifTrue, CqParseNode* ifFalse)
+{
+	CqParseNode* node = new CqParseNodeQCond();
+	node->AddLastChild(cond);
+	node->AddLastChild(ifTrue);
+	node->AddLastChild(ifFalse);
+	return node;
+}
+
+/// An assignment statement, whose value is discarded.
+CqParseNode* assign(SqVarRef ref, CqParseNode* value)
+{
+	CqParseNodeAssign* node = new CqParseNodeAssign(ref);
+	node->NoDup();
+	node->AddLastChild(value);
+	return node;
+}
+
+CqParseNode* ifElse(CqParseNode* cond, CqParseNode* ifTrue, CqParseNode* ifFalse = 0)
+{
+	CqParseNode* node = new CqParseNodeConditional();
+	node->AddLastChild(cond);
+	node->AddLastChild(ifTrue);
+	if(ifFalse)
+		node->AddLastChild(ifFalse);
+	return node;
+}
+
+CqParseNode* whileLoop(CqParseNode* cond, CqParseNode* body)
+{
+	CqParseNode* node = new CqParseNodeWhileConstruct();
+	node->AddLastChild(cond);
+	node->AddLastChild(body);
+	return node;
+}
+
+/// A parse tree holding a shader with the given statements, as built by the
+/// parser.  The shader body is followed by an (empty) list of formals.
+class CqTestShader
+{
+	public:
+		CqTestShader()
+			: m_root(new CqParseNode()),
+			m_body(new CqParseNode())
+		{
+			CqParseNode* shader = new CqParseNodeShader("test");
+			m_root->AddLastChild(shader);
+			shader->AddLastChild(m_body);
+			shader->AddLastChild(new CqParseNode());
+		}
+		~CqTestShader()
+		{
+			CqParseNode::DeleteTree(m_root);
+		}
+		CqTestShader& operator<<(CqParseNode* statement)
+		{
+			m_body->AddLastChild(statement);
+			return *this;
+		}
+		CqParseNode* root()
+		{
+			return m_root;
+		}
+		/// Statements of the shader body.
+		CqParseNode* body()
+		{
+			return m_root->pFirstChild()->pFirstChild();
+		}
+		/// Run both optimisation passes, as Optimise() in the parser does.
+		void optimise()
+		{
+			m_root->Optimise();
+			OptimiseDataFlow(m_root);
+		}
+	private:
+		CqParseNode* m_root;
+		CqParseNode* m_body;
+};
+
+/// Start each test with an empty symbol table.
+void resetSymbols()
+{
+	gLocalVars.clear();
+	gLocalFuncs.clear();
+}
+
+CqParseNode* child(CqParseNode* node, TqInt index)
+{
+	CqParseNode* c = node->pFirstChild();
+	for(TqInt i = 0; i < index && c; ++i)
+		c = c->pNext();
+	return c;
+}
+
+TqInt numChildren(const CqParseNode* node)
+{
+	TqInt count = 0;
+	for(const CqParseNode* c = node->pFirstChild(); c; c = c->pNext())
+		++count;
+	return count;
+}
+
+/// Find the first assignment to a variable in a statement list.
+CqParseNode* findAssign(CqParseNode* node, SqVarRef ref)
+{
+	if(node->NodeType() == ParseNode_VariableAssign &&
+			static_cast<CqParseNodeAssign*>(node)->VarRef() == ref)
+		return node;
+	for(CqParseNode* c = node->pFirstChild(); c; c = c->pNext())
+	{
+		if(CqParseNode* found = findAssign(c, ref))
+			return found;
+	}
+	return 0;
+}
+
+bool isConst(const CqParseNode* node, TqFloat value)
+{
+	return node && node->NodeType() == ParseNode_ConstantFloat &&
+		static_cast<const CqParseNodeFloatConst*>(node)->Value() == value;
+}
+
+bool isVar(const CqParseNode* node, SqVarRef ref)
+{
+	return node && node->NodeType() == ParseNode_Variable &&
+		static_cast<const CqParseNodeVariable*>(node)->VarRef() == ref;
+}
+
+bool isVarying(SqVarRef ref)
+{
+	return (CqVarDef::GetVariablePtr(ref)->Type() & Type_Varying) != 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Evaluation of float shaders at a single shading point.
+
+typedef std::map<TqUint, TqFloat> TqVarValues;
+
+TqFloat evaluate(const CqParseNode* node, TqVarValues& vars)
+{
+	const CqParseNode* c = node->pFirstChild();
+	switch(node->NodeType())
+	{
+		case ParseNode_Base:
+		case ParseNode_Shader:
+		{
+			TqFloat result = 0;
+			for(; c; c = c->pNext())
+				result = evaluate(c, vars);
+			return result;
+		}
+		case ParseNode_ConstantFloat:
+			return static_cast<const CqParseNodeFloatConst*>(node)->Value();
+		case ParseNode_Variable:
+		{
+			TqUint index = static_cast<const CqParseNodeVariable*>(node)->VarRef().m_Index;
+			BOOST_REQUIRE_MESSAGE(vars.count(index), "read of unset variable "
+					<< gLocalVars[index].strName());
+			return vars[index];
+		}
+		case ParseNode_VariableAssign:
+			return vars[static_cast<const CqParseNodeAssign*>(node)->VarRef().m_Index]
+				= evaluate(c, vars);
+		case ParseNode_MathOp:
+		{
+			TqFloat a = evaluate(c, vars);
+			TqFloat b = evaluate(c->pNext(), vars);
+			switch(static_cast<const CqParseNodeMathOp*>(node)->Operator())
+			{
+				case Op_Add: return a + b;
+				case Op_Sub: return a - b;
+				case Op_Mul: return a * b;
+				case Op_Div: return a / b;
+				default: break;
+			}
+			break;
+		}
+		case ParseNode_RelationalOp:
+		{
+			TqFloat a = evaluate(c, vars);
+			TqFloat b = evaluate(c->pNext(), vars);
+			switch(static_cast<const CqParseNodeRelOp*>(node)->Operator())
+			{
+				case Op_EQ: return a == b;
+				case Op_NE: return a != b;
+				case Op_L: return a < b;
+				case Op_G: return a > b;
+				case Op_GE: return a >= b;
+				case Op_LE: return a <= b;
+				default: break;
+			}
+			break;
+		}
+		case ParseNode_UnaryOp:
+			if(static_cast<const CqParseNodeUnaryOp*>(node)->Operator() == Op_Neg)
+				return -evaluate(c, vars);
+			break;
+		case ParseNode_Conditional:
+			if(evaluate(c, vars) != 0)
+				evaluate(c->pNext(), vars);
+			else if(c->pNext()->pNext())
+				evaluate(c->pNext()->pNext(), vars);
+			return 0;
+		case ParseNode_WhileConstruct:
+			for(TqInt i = 0; evaluate(c, vars) != 0; ++i)
+			{
+				BOOST_REQUIRE(i < 1000);
+				evaluate(c->pNext(), vars);
+			}
+			return 0;
+		default:
+			break;
+	}
+	BOOST_FAIL("can't evaluate node type " << node->NodeType());
+	return 0;
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(optimise_folds_constants)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef a = addVar("a", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef b = addVar("b", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef c = addVar("c", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef d = addVar("d", Type_Float | Type_Varying | Type_Param | Type_Output);
+
+	CqTestShader shader;
+	// a = 2*3 + 1;
+	shader << assign(a, math(Op_Add, math(Op_Mul, num(2), num(3)), num(1)));
+	// b = (x + 0) * 1;
+	shader << assign(b, math(Op_Mul, math(Op_Add, var(x), num(0)), num(1)));
+	// if(1 < 2) c = -4; else c = 5;
+	shader << ifElse(rel(Op_L, num(1), num(2)), assign(c, neg(num(4))), assign(c, num(5)));
+	// d = 1/0; is left for the shader to produce at run time.
+	shader << assign(d, math(Op_Div, num(1), num(0)));
+	// while(0) x = 1;
+	shader << whileLoop(num(0), assign(x, num(1)));
+	shader.optimise();
+
+	BOOST_CHECK(isConst(child(findAssign(shader.root(), a), 0), 7));
+	BOOST_CHECK(isVar(child(findAssign(shader.root(), b), 0), x));
+	CqParseNode* cAssign = findAssign(shader.root(), c);
+	BOOST_REQUIRE(cAssign);
+	BOOST_CHECK(isConst(child(cAssign, 0), -4));
+	BOOST_CHECK(cAssign->pParent() == shader.body() ||
+			cAssign->pParent()->pParent() == shader.body());
+	BOOST_CHECK_EQUAL(child(findAssign(shader.root(), d), 0)->NodeType(), ParseNode_MathOp);
+	BOOST_CHECK(!findAssign(shader.root(), x));
+}
+
+BOOST_AUTO_TEST_CASE(optimise_removes_dead_stores)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef out = addVar("out", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef unused = addVar("unused", Type_Float | Type_Varying);
+	SqVarRef t = addVar("t", Type_Float | Type_Varying);
+	SqVarRef u = addVar("u", Type_Float | Type_Varying);
+	SqVarRef live = addVar("live", Type_Float | Type_Varying);
+
+	CqTestShader shader;
+	// unused = 5;
+	shader << assign(unused, num(5));
+	// t = x*2; u = t + 1;  (u is never read, which leaves t unread as well)
+	shader << assign(t, math(Op_Mul, var(x), num(2)));
+	shader << assign(u, math(Op_Add, var(t), num(1)));
+	// live = x - 1; out = live;
+	shader << assign(live, math(Op_Sub, var(x), num(1)));
+	shader << assign(out, var(live));
+	// out = 3; in a conditional, where the statement must be kept.
+	shader << ifElse(rel(Op_G, var(x), num(0)), assign(out, num(3)));
+	shader.optimise();
+
+	BOOST_CHECK(!findAssign(shader.root(), unused));
+	BOOST_CHECK(!findAssign(shader.root(), t));
+	BOOST_CHECK(!findAssign(shader.root(), u));
+	BOOST_CHECK(findAssign(shader.root(), live));
+	BOOST_CHECK(findAssign(shader.root(), out));
+	BOOST_CHECK_EQUAL(numChildren(shader.body()), 3);
+}
+
+BOOST_AUTO_TEST_CASE(optimise_hoists_common_subexpressions)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef y = addVar("y", Type_Float | Type_Uniform | Type_Param);
+	SqVarRef out = addVar("out", Type_Float | Type_Varying | Type_Param | Type_Output);
+	TqUint numVars = gLocalVars.size();
+
+	CqTestShader shader;
+	// out = (x*y - 1) + (x*y - 1)*x;
+	shader << assign(out, math(Op_Add,
+				math(Op_Sub, math(Op_Mul, var(x), var(y)), num(1)),
+				math(Op_Mul, math(Op_Sub, math(Op_Mul, var(x), var(y)), num(1)), var(x))));
+	shader.optimise();
+
+	// The repeated expression is computed once, into a varying temporary
+	// assigned just before the statement.
+	BOOST_REQUIRE_EQUAL(gLocalVars.size(), numVars + 1);
+	SqVarRef temp;
+	temp.m_Type = VarTypeLocal;
+	temp.m_Index = numVars;
+	BOOST_CHECK(isVarying(temp));
+	CqParseNode* tempAssign = child(shader.body(), 0);
+	BOOST_REQUIRE(tempAssign && findAssign(tempAssign, temp) == tempAssign);
+	BOOST_CHECK_EQUAL(child(tempAssign, 0)->NodeType(), ParseNode_MathOp);
+	CqParseNode* outAssign = child(shader.body(), 1);
+	BOOST_REQUIRE(outAssign && findAssign(outAssign, out) == outAssign);
+	CqParseNode* sum = child(outAssign, 0);
+	BOOST_CHECK(isVar(child(sum, 0), temp));
+	BOOST_CHECK(isVar(child(child(sum, 1), 0), temp));
+}
+
+BOOST_AUTO_TEST_CASE(optimise_leaves_conditional_expressions_in_place)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef y = addVar("y", Type_Float | Type_Uniform | Type_Param);
+	SqVarRef out = addVar("out", Type_Float | Type_Varying | Type_Param | Type_Output);
+	TqUint numVars = gLocalVars.size();
+
+	CqTestShader shader;
+	// out = (x*y > 1 ? 1/x + 1/x : 0) + x*y;
+	shader << assign(out, math(Op_Add,
+				qcond(rel(Op_G, math(Op_Mul, var(x), var(y)), num(1)),
+					math(Op_Add, math(Op_Div, num(1), var(x)),
+						math(Op_Div, num(1), var(x))),
+					num(0)),
+				math(Op_Mul, var(x), var(y))));
+	shader.optimise();
+
+	// Only x*y, which is always computed, is hoisted.  1/x stays in the arm
+	// of the ?:, so it's only computed where x*y > 1.
+	BOOST_REQUIRE_EQUAL(gLocalVars.size(), numVars + 1);
+	SqVarRef temp;
+	temp.m_Type = VarTypeLocal;
+	temp.m_Index = numVars;
+	CqParseNode* outAssign = child(shader.body(), 1);
+	BOOST_REQUIRE(outAssign && findAssign(outAssign, out) == outAssign);
+	CqParseNode* cond = child(child(outAssign, 0), 0);
+	BOOST_REQUIRE_EQUAL(cond->NodeType(), ParseNode_ConditionalExpression);
+	BOOST_CHECK(isVar(child(child(cond, 0), 0), temp));
+	CqParseNode* armSum = child(cond, 1);
+	BOOST_CHECK_EQUAL(child(armSum, 0)->NodeType(), ParseNode_MathOp);
+	BOOST_CHECK_EQUAL(child(armSum, 1)->NodeType(), ParseNode_MathOp);
+}
+
+BOOST_AUTO_TEST_CASE(optimise_demotes_uniform_locals)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef y = addVar("y", Type_Float | Type_Uniform | Type_Param);
+	SqVarRef out = addVar("out", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef k = addVar("k", Type_Float | Type_Varying);
+	SqVarRef fromK = addVar("fromK", Type_Float | Type_Varying);
+	SqVarRef fromX = addVar("fromX", Type_Float | Type_Varying);
+	SqVarRef underVaryingIf = addVar("underVaryingIf", Type_Float | Type_Varying);
+	SqVarRef underUniformIf = addVar("underUniformIf", Type_Float | Type_Varying);
+
+	CqTestShader shader;
+	shader << assign(k, math(Op_Mul, var(y), num(2)));
+	shader << assign(fromK, math(Op_Add, var(k), num(1)));
+	shader << assign(fromX, math(Op_Add, var(fromK), var(x)));
+	shader << assign(underVaryingIf, num(0));
+	shader << ifElse(rel(Op_G, var(x), num(0)), assign(underVaryingIf, num(1)));
+	shader << assign(underUniformIf, num(0));
+	shader << ifElse(rel(Op_G, var(y), num(0)), assign(underUniformIf, num(1)));
+	shader << assign(out, math(Op_Add, math(Op_Add, var(fromX), var(underVaryingIf)),
+				var(underUniformIf)));
+	shader.optimise();
+
+	BOOST_CHECK(!isVarying(k));
+	BOOST_CHECK(!isVarying(fromK));
+	BOOST_CHECK(isVarying(fromX));
+	BOOST_CHECK(isVarying(underVaryingIf));
+	BOOST_CHECK(!isVarying(underUniformIf));
+	// Shader arguments keep the storage they were declared with.
+	BOOST_CHECK(isVarying(out));
+	BOOST_CHECK(!isVarying(y));
+}
+
+BOOST_AUTO_TEST_CASE(optimise_preserves_results)
+{
+	resetSymbols();
+	SqVarRef x = addVar("x", Type_Float | Type_Varying | Type_Param);
+	SqVarRef y = addVar("y", Type_Float | Type_Uniform | Type_Param);
+	SqVarRef out1 = addVar("out1", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef out2 = addVar("out2", Type_Float | Type_Varying | Type_Param | Type_Output);
+	SqVarRef a = addVar("a", Type_Float | Type_Varying);
+	SqVarRef i = addVar("i", Type_Float | Type_Varying);
+	SqVarRef dead = addVar("dead", Type_Float | Type_Varying);
+
+	CqTestShader shader;
+	// a = y*(2 + 3) - 0;
+	shader << assign(a, math(Op_Sub, math(Op_Mul, var(y), math(Op_Add, num(2), num(3))), num(0)));
+	// dead = a*x;
+	shader << assign(dead, math(Op_Mul, var(a), var(x)));
+	// out1 = (a + x)*(a + x) - (a + x)/(y + 1);
+	shader << assign(out1, math(Op_Sub,
+				math(Op_Mul, math(Op_Add, var(a), var(x)), math(Op_Add, var(a), var(x))),
+				math(Op_Div, math(Op_Add, var(a), var(x)), math(Op_Add, var(y), num(1)))));
+	// out2 = 0; i = 0;
+	// while(i < 4) { if(x > i) out2 = out2 + (x - i)*(x - i); i = i + 1; }
+	shader << assign(out2, num(0));
+	shader << assign(i, num(0));
+	CqParseNode* loopBody = new CqParseNode();
+	loopBody->AddLastChild(ifElse(rel(Op_G, var(x), var(i)),
+				assign(out2, math(Op_Add, var(out2),
+						math(Op_Mul, math(Op_Sub, var(x), var(i)), math(Op_Sub, var(x), var(i)))))));
+	loopBody->AddLastChild(assign(i, math(Op_Add, var(i), num(1))));
+	shader << whileLoop(rel(Op_L, var(i), num(4)), loopBody);
+	// if(1 == 1) out2 = out2*-1; else out2 = 0;
+	shader << ifElse(rel(Op_EQ, num(1), num(1)),
+			assign(out2, math(Op_Mul, var(out2), neg(num(1)))),
+			assign(out2, num(0)));
+
+	const TqFloat inputs[][2] = { {0, 0}, {1.5f, 2}, {-3, 0.5f}, {2.25f, -1.5f}, {7, 3} };
+	const TqInt numInputs = sizeof(inputs)/sizeof(inputs[0]);
+	TqVarValues expected[numInputs];
+	for(TqInt n = 0; n < numInputs; ++n)
+	{
+		expected[n][x.m_Index] = inputs[n][0];
+		expected[n][y.m_Index] = inputs[n][1];
+		evaluate(shader.root(), expected[n]);
+	}
+
+	shader.optimise();
+	BOOST_CHECK(!findAssign(shader.root(), dead));
+	BOOST_CHECK(gLocalVars.size() > dead.m_Index + 1);
+
+	for(TqInt n = 0; n < numInputs; ++n)
+	{
+		TqVarValues result;
+		result[x.m_Index] = inputs[n][0];
+		result[y.m_Index] = inputs[n][1];
+		evaluate(shader.root(), result);
+		BOOST_CHECK_EQUAL(result[out1.m_Index], expected[n][out1.m_Index]);
+		BOOST_CHECK_EQUAL(result[out2.m_Index], expected[n][out2.m_Index]);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
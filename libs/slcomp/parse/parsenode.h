@@ -181,6 +181,10 @@ class CqParseNode : public CqListEntry<CqParseNode>, public IqParseNode
 		{
 			m_pChild = 0;
 		}
+		/// Put pN in the tree in place of this node, then delete this node and its remaining children.
+		void	ReplaceWith( CqParseNode* pN );
+		/// Unlink a node from the tree and delete it along with all of its children.
+		static	void	DeleteTree( CqParseNode* pNode );
 		void	SetPos( TqInt LineNo, const char* strFileName )
 		{
 			m_LineNo = LineNo;
@@ -831,6 +835,7 @@ class CqParseNodeMathOp : public CqParseNodeOp, public IqParseNodeMathOp
 
 
 		virtual	TqInt	ResType() const;
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeMathOp * pNew = new CqParseNodeMathOp( *this );
@@ -922,6 +927,7 @@ class CqParseNodeRelOp : public CqParseNodeOp, public IqParseNodeRelationalOp
 			pNew->m_pParent = pParent;
 			return ( pNew );
 		}
+		virtual	bool	Optimise();
 		virtual	TqInt	TypeCheck( TqInt* pTypes, TqInt Count, bool& needsCast, bool CheckOnly );
 
 	protected:
@@ -974,6 +980,7 @@ class CqParseNodeUnaryOp : public CqParseNodeOp, public IqParseNodeUnaryOp
 
 
 		virtual	TqInt	TypeCheck( TqInt* pTypes, TqInt Count, bool& needsCast, bool CheckOnly );
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeUnaryOp * pNew = new CqParseNodeUnaryOp( *this );
@@ -1037,6 +1044,7 @@ class CqParseNodeLogicalOp : public CqParseNodeOp, public IqParseNodeLogicalOp
 
 
 
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeLogicalOp * pNew = new CqParseNodeLogicalOp( *this );
@@ -1284,6 +1292,7 @@ class CqParseNodeWhileConstruct : public CqParseNode, public IqParseNodeWhileCon
 		}
 
 
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeWhileConstruct * pNew = new CqParseNodeWhileConstruct( *this );
@@ -1610,6 +1619,7 @@ class CqParseNodeConditional : public CqParseNode, public IqParseNodeConditional
 		}
 
 
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeConditional * pNew = new CqParseNodeConditional( *this );
@@ -1680,6 +1690,7 @@ class CqParseNodeQCond : public CqParseNode, public IqParseNodeConditionalExpres
 
 
 		virtual	TqInt	TypeCheck( TqInt* pTypes, TqInt Count, bool& needsCast, bool CheckOnly );
+		virtual	bool	Optimise();
 		virtual	CqParseNode*	Clone( CqParseNode* pParent = 0 )
 		{
 			CqParseNodeQCond * pNew = new CqParseNodeQCond( *this );
@@ -2062,6 +2073,16 @@ class CqParseNodeTextureNameWithChannel : public CqParseNode
 };
 
 
+///----------------------------------------------------------------------
+/// OptimiseDataFlow
+/// Optimisations which need to see every use of each local variable in the
+/// shader: dead store elimination, common subexpression elimination and
+/// demotion of varying local variables which only ever hold uniform values.
+/// Should be run after the Optimise() pass over the whole parse tree.
+
+void	OptimiseDataFlow( CqParseNode* pTree );
+
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
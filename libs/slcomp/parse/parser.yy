@@ -2135,7 +2135,11 @@ void Optimise()
 	}
 
 	if(ParseTreePointer)
+	{
 		ParseTreePointer->Optimise();
+		// Now the expressions are simplified, look at how the variables are used.
+		OptimiseDataFlow(ParseTreePointer);
+	}
 }
 
 
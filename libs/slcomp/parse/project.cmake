@@ -54,5 +54,10 @@ set(parse_hdrs
 set(parse_hdrs ${parse_hdrs} ${_parser_hpp_name})
 make_absolute(parse_hdrs ${parse_SOURCE_DIR})
 
+set(parse_test_srcs
+	optimise_test.cpp
+)
+make_absolute(parse_test_srcs ${parse_SOURCE_DIR})
+
 include_directories(${parse_SOURCE_DIR})
 include_directories(${parse_BINARY_DIR})
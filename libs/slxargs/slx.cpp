@@ -37,7 +37,6 @@
 #pragma warning (disable : 4786)
 #endif //AQSIS_COMPILER_MSVC6
 
-#include <fstream>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -671,15 +670,14 @@ static RtInt GetCurrentShaderInfo( char * name, char * filePath )
 	int theNArgs;
 	SLX_TYPE theShaderType;
 
-	std::ifstream slxFile(filePath);
 	result = RIE_NOERROR;
 	theNArgs = 0;
 
-	if ( slxFile )
+	if ( filePath )
 	{
 		try
 		{
-			boost::shared_ptr<IqShader> pShader = createShaderVM(0, slxFile, DSOPath ? DSOPath : "");
+			boost::shared_ptr<IqShader> pShader = createShaderVM(0, filePath, DSOPath ? DSOPath : "");
 			pShader->SetstrName( filePath );
 			pShader->PrepareDefArgs();
 
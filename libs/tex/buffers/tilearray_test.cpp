@@ -0,0 +1,254 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for prefetching and iterating over tiled texture arrays.
+ */
+
+#include <aqsis/tex/buffers/tilearray.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+namespace {
+
+using Aqsis::SqFilterSupport;
+
+const TqInt tileSize = 4;
+const TqInt widthInTiles = 8;
+
+// 32x32 single channel file, where reads may be held up until released.
+class CqFakeTiledFile : public Aqsis::IqTiledTexInputFile
+{
+	public:
+		CqFakeTiledFile(bool blockReads)
+			: m_header(),
+			m_blockReads(blockReads),
+			m_numBlocked(0)
+		{
+			m_header.channelList().addUnnamedChannels(Aqsis::Channel_Unsigned8, 1);
+		}
+
+		virtual Aqsis::boostfs::path fileName() const { return "fake.tex"; }
+		virtual Aqsis::EqImageFileType fileType() const { return Aqsis::ImageFile_Tiff; }
+		virtual const Aqsis::CqTexFileHeader& header(TqInt index = 0) const
+		{
+			return m_header;
+		}
+		virtual Aqsis::SqTileInfo tileInfo() const
+		{
+			return Aqsis::SqTileInfo(tileSize, tileSize);
+		}
+		virtual TqInt numSubImages() const { return 1; }
+		virtual TqInt width(TqInt index) const { return tileSize*widthInTiles; }
+		virtual TqInt height(TqInt index) const { return tileSize*widthInTiles; }
+
+		/// Wait until the given number of reads are held up.
+		void waitForBlockedReads(TqInt numReads)
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while(m_numBlocked < numReads)
+				m_changed.wait(lock);
+		}
+		/// Let all reads run.
+		void releaseReads()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_blockReads = false;
+			m_changed.notify_all();
+		}
+		/// Tile indices in the order their reads started.
+		std::vector<TqInt> reads()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			return m_reads;
+		}
+
+	protected:
+		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
+				TqInt subImageIdx, const Aqsis::SqTileInfo tileSize) const
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_reads.push_back(tileY*widthInTiles + tileX);
+			++m_numBlocked;
+			m_changed.notify_all();
+			while(m_blockReads)
+				m_changed.wait(lock);
+			--m_numBlocked;
+			std::fill(buffer, buffer + tileSize.width*tileSize.height,
+					TqUint8(tileY*widthInTiles + tileX));
+		}
+
+	private:
+		Aqsis::CqTexFileHeader m_header;
+		mutable boost::mutex m_mutex;
+		mutable boost::condition m_changed;
+		bool m_blockReads;
+		mutable TqInt m_numBlocked;
+		mutable std::vector<TqInt> m_reads;
+};
+
+typedef Aqsis::CqTileArray<TqUint8> TqArray;
+
+// Support covering a single pixel of the given tile.
+SqFilterSupport tileSupport(TqInt tileX, TqInt tileY)
+{
+	return SqFilterSupport(tileX*tileSize + 1, tileX*tileSize + 2,
+			tileY*tileSize + 1, tileY*tileSize + 2);
+}
+
+void destroyArray(TqArray* array)
+{
+	delete array;
+}
+
+bool prefetchEnabled()
+{
+	if(Aqsis::CqTilePrefetcher::instance().enabled())
+		return true;
+	BOOST_TEST_MESSAGE("Prefetching is disabled, skipping test");
+	return false;
+}
+
+// Record the pixels visited by a stochastic iteration over a support.
+void stochasticPositions(const TqArray* array, SqFilterSupport support,
+		TqInt numSamples, std::vector<TqInt>* positions)
+{
+	for(TqArray::TqStochasticIterator i = array->beginStochastic(support,
+				numSamples); i.inSupport(); ++i)
+		positions->push_back(i.y()*tileSize*widthInTiles + i.x());
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(tilearray_tests)
+
+BOOST_AUTO_TEST_CASE(CqTileArray_prefetch_in_use_order)
+{
+	if(!prefetchEnabled())
+		return;
+	boost::shared_ptr<CqFakeTiledFile> file(new CqFakeTiledFile(true));
+	std::vector<TqInt> started;
+	{
+		TqArray array(file, 0);
+		std::vector<SqFilterSupport> supports;
+		// Supports touching tiles 63, 0, 43, 14, 18 and then 63 again.
+		supports.push_back(tileSupport(7,7));
+		supports.push_back(tileSupport(0,0));
+		supports.push_back(tileSupport(3,5));
+		supports.push_back(tileSupport(0,0));
+		supports.push_back(tileSupport(6,1));
+		supports.push_back(tileSupport(2,2));
+		supports.push_back(tileSupport(7,7));
+		array.prefetch(supports);
+		// The I/O threads start on the tiles needed first.
+		const TqInt numThreads = Aqsis::CqTilePrefetcher::defaultNumThreads;
+		file->waitForBlockedReads(std::min(numThreads, 5));
+		started = file->reads();
+		file->releaseReads();
+		// Using a tile being prefetched waits for the read.
+		array(29, 29);
+		array(1, 1);
+	}
+	const TqInt useOrder[] = {63, 0, 43, 14, 18};
+	std::sort(started.begin(), started.end());
+	std::vector<TqInt> expected(useOrder, useOrder + started.size());
+	std::sort(expected.begin(), expected.end());
+	BOOST_CHECK(started == expected);
+	// Each tile was read exactly once.
+	BOOST_CHECK_EQUAL(file->reads().size(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileArray_destructor_waits_for_own_prefetches)
+{
+	if(!prefetchEnabled())
+		return;
+	boost::shared_ptr<CqFakeTiledFile> file(new CqFakeTiledFile(true));
+	TqArray* array = new TqArray(file, 0);
+	array->prefetch(std::vector<SqFilterSupport>(1, tileSupport(1,1)));
+	file->waitForBlockedReads(1);
+	// The queued read refers to the array, so destruction must wait for it.
+	boost::thread destroyThread(boost::bind(&destroyArray, array));
+	BOOST_CHECK(!destroyThread.timed_join(boost::posix_time::milliseconds(100)));
+	file->releaseReads();
+	destroyThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(CqTileArray_destructor_ignores_other_prefetches)
+{
+	if(!prefetchEnabled())
+		return;
+	boost::shared_ptr<CqFakeTiledFile> blockedFile(new CqFakeTiledFile(true));
+	TqArray blockedArray(blockedFile, 0);
+	blockedArray.prefetch(std::vector<SqFilterSupport>(1, tileSupport(0,0)));
+	blockedFile->waitForBlockedReads(1);
+	// Destroying another array mustn't wait for the blocked read.
+	boost::shared_ptr<CqFakeTiledFile> file(new CqFakeTiledFile(false));
+	TqArray* array = new TqArray(file, 0);
+	array->prefetch(std::vector<SqFilterSupport>(1, tileSupport(2,3)));
+	boost::thread destroyThread(boost::bind(&destroyArray, array));
+	bool destroyed = destroyThread.timed_join(boost::posix_time::seconds(5));
+	blockedFile->releaseReads();
+	if(!destroyed)
+		destroyThread.join();
+	BOOST_CHECK(destroyed);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileArray_stochastic_iteration_is_repeatable)
+{
+	boost::shared_ptr<CqFakeTiledFile> file(new CqFakeTiledFile(false));
+	TqArray array(file, 0);
+	// Support straddling four tiles, so samples are divided between them.
+	SqFilterSupport support(2, 7, 3, 9);
+	std::vector<TqInt> expected;
+	stochasticPositions(&array, support, 13, &expected);
+	BOOST_CHECK_EQUAL(expected.size(), 13U);
+	// Iterating again, or from another thread, visits the same pixels.
+	std::vector<TqInt> again;
+	stochasticPositions(&array, support, 13, &again);
+	BOOST_CHECK(again == expected);
+	std::vector<TqInt> otherThread;
+	boost::thread thread(boost::bind(&stochasticPositions, &array, support,
+				13, &otherThread));
+	thread.join();
+	BOOST_CHECK(otherThread == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,225 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/**
+ * \file
+ *
+ * \brief Texture tile cache implementation.
+ */
+
+#include <aqsis/tex/buffers/tilecache.h>
+
+#include <algorithm>
+
+#include <aqsis/util/logging.h>
+
+namespace Aqsis {
+
+const std::size_t CqTileCache::defaultMaxMemory;
+
+CqTileCache::CqTileCache(std::size_t maxMemory)
+	: m_mutex(),
+	m_slots(),
+	m_freeSlots(),
+	m_clockHand(0),
+	m_maxMemory(maxMemory),
+	m_memoryUsed(0),
+	m_lastGeneration(0),
+	m_stats(),
+	m_hits(0),
+	m_hitsAtReset(0)
+{ }
+
+CqTileCache::~CqTileCache()
+{
+	for(TqInt i = 0, end = m_slots.size(); i < end; ++i)
+		delete m_slots[i];
+}
+
+CqTileCache& CqTileCache::instance()
+{
+	static CqTileCache cache;
+	return cache;
+}
+
+void CqTileCache::setMaxMemory(std::size_t maxMemory)
+{
+	std::vector<SqVictim> victims;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_maxMemory = maxMemory;
+		makeSpace(0, victims);
+	}
+	evict(victims);
+}
+
+std::size_t CqTileCache::maxMemory() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_maxMemory;
+}
+
+std::size_t CqTileCache::memoryUsed() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_memoryUsed;
+}
+
+CqTileCache::SqHandle CqTileCache::insert(IqTileOwner* owner, TqInt tileIndex,
+		std::size_t size)
+{
+	assert(owner);
+	std::vector<SqVictim> victims;
+	SqSlot* slot = 0;
+	TqUlong generation = 0;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_stats.misses;
+		if(size > m_maxMemory)
+		{
+			Aqsis::log() << warning << "Exceeding allocated texture memory: tile of "
+				<< size << " bytes is larger than the limit of " << m_maxMemory
+				<< " bytes\n";
+		}
+		makeSpace(size, victims);
+		if(m_freeSlots.empty())
+		{
+			slot = new SqSlot();
+			m_slots.push_back(slot);
+		}
+		else
+		{
+			slot = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		generation = ++m_lastGeneration;
+		slot->owner = owner;
+		slot->tileIndex = tileIndex;
+		slot->generation = generation;
+		slot->size = size;
+		// New tiles start out unreferenced, so that tiles which are only used
+		// once don't push out tiles which are used repeatedly.
+		slot->referenced = false;
+		m_memoryUsed += size;
+		if(m_memoryUsed > m_stats.peakMemory)
+			m_stats.peakMemory = m_memoryUsed;
+	}
+	evict(victims);
+	return SqHandle(slot, generation);
+}
+
+void CqTileCache::remove(IqTileOwner* owner, const SqHandle& handle)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	// The tile may already have been evicted, and the slot given to
+	// another tile.
+	SqSlot* slot = handle.slot;
+	if(slot && slot->owner == owner && slot->generation == handle.generation)
+		freeSlot(slot);
+}
+
+void CqTileCache::waitForEvictions(IqTileOwner* owner)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	while(std::find(m_evicting.begin(), m_evicting.end(), owner)
+			!= m_evicting.end())
+		m_evictionsDone.wait(lock);
+}
+
+SqTileCacheStats CqTileCache::stats() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	SqTileCacheStats stats = m_stats;
+	stats.hits = m_hits - m_hitsAtReset;
+	return stats;
+}
+
+void CqTileCache::resetStats()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_stats = SqTileCacheStats();
+	m_stats.peakMemory = m_memoryUsed;
+	m_hitsAtReset = m_hits;
+}
+
+void CqTileCache::makeSpace(std::size_t required, std::vector<SqVictim>& victims)
+{
+	const TqInt numSlots = m_slots.size();
+	// Any memory in use belongs to some tile, so this loop will always find a
+	// tile to evict within two turns of the clock hand.
+	while(m_memoryUsed > 0 && (required > m_maxMemory
+				|| m_memoryUsed > m_maxMemory - required))
+	{
+		if(m_clockHand >= numSlots)
+			m_clockHand = 0;
+		SqSlot* slot = m_slots[m_clockHand];
+		if(slot->owner)
+		{
+			if(slot->referenced)
+				slot->referenced = false;
+			else
+			{
+				SqVictim victim = {slot->owner, slot->tileIndex, slot->generation};
+				victims.push_back(victim);
+				m_evicting.push_back(slot->owner);
+				freeSlot(slot);
+				++m_stats.evictions;
+			}
+		}
+		++m_clockHand;
+	}
+}
+
+void CqTileCache::evict(const std::vector<SqVictim>& victims)
+{
+	if(victims.empty())
+		return;
+	for(TqInt i = 0, end = victims.size(); i < end; ++i)
+		victims[i].owner->evictTile(victims[i].tileIndex, victims[i].generation);
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(TqInt i = 0, end = victims.size(); i < end; ++i)
+	{
+		m_evicting.erase(std::find(m_evicting.begin(), m_evicting.end(),
+					victims[i].owner));
+	}
+	m_evictionsDone.notify_all();
+}
+
+void CqTileCache::freeSlot(SqSlot* slot)
+{
+	assert(slot->owner);
+	m_memoryUsed -= slot->size;
+	slot->owner = 0;
+	slot->generation = 0;
+	slot->size = 0;
+	m_freeSlots.push_back(slot);
+}
+
+} // namespace Aqsis
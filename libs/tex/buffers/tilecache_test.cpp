@@ -0,0 +1,227 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for the texture tile cache.
+ */
+
+#include <aqsis/tex/buffers/tilecache.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+namespace {
+
+// Tile owner recording which tiles it has been asked to evict.
+class CqFakeTileOwner : public Aqsis::IqTileOwner
+{
+	public:
+		virtual void evictTile(TqInt tileIndex, TqUlong generation)
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			evicted.push_back(tileIndex);
+		}
+		boost::mutex mutex;
+		std::vector<TqInt> evicted;
+};
+
+// Insert and touch a number of tiles from one thread.
+void insertTiles(Aqsis::CqTileCache* cache, CqFakeTileOwner* owner)
+{
+	for(TqInt i = 0; i < 1000; ++i)
+		cache->touch(cache->insert(owner, i, 10));
+}
+
+// Touch a tile a number of times from one thread.
+void touchTile(Aqsis::CqTileCache* cache, Aqsis::CqTileCache::SqHandle handle)
+{
+	for(TqInt i = 0; i < 10000; ++i)
+		cache->touch(handle);
+}
+
+// Tile owner which evicts slowly, to keep the eviction in progress.
+class CqSlowTileOwner : public Aqsis::IqTileOwner
+{
+	public:
+		CqSlowTileOwner() : numEvicted(0) {}
+		virtual void evictTile(TqInt tileIndex, TqUlong generation)
+		{
+			boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+			boost::mutex::scoped_lock lock(mutex);
+			++numEvicted;
+		}
+		boost::mutex mutex;
+		TqInt numEvicted;
+};
+
+} // anon namespace
+
+//------------------------------------------------------------------------------
+// CqTileCache test cases
+
+BOOST_AUTO_TEST_SUITE(tilecache_tests)
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_memory_limit)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner;
+	for(TqInt i = 0; i < 10; ++i)
+		cache.insert(&owner, i, 30);
+	// Only three 30 byte tiles fit in 100 bytes.
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 90U);
+	BOOST_CHECK_EQUAL(owner.evicted.size(), 7U);
+	BOOST_CHECK_EQUAL(cache.stats().misses, 10U);
+	BOOST_CHECK_EQUAL(cache.stats().evictions, 7U);
+	BOOST_CHECK_EQUAL(cache.stats().peakMemory, 90U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_referenced_tiles_kept)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner;
+	Aqsis::CqTileCache::SqHandle handle0 = cache.insert(&owner, 0, 30);
+	cache.insert(&owner, 1, 30);
+	cache.insert(&owner, 2, 30);
+	cache.touch(handle0);
+	cache.insert(&owner, 3, 30);
+	// Tile 0 was used since insertion, so tile 1 should go first.
+	BOOST_REQUIRE_EQUAL(owner.evicted.size(), 1U);
+	BOOST_CHECK_EQUAL(owner.evicted[0], 1);
+	BOOST_CHECK_EQUAL(cache.stats().hits, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_remove)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner;
+	Aqsis::CqTileCache::SqHandle handle0 = cache.insert(&owner, 0, 60);
+	cache.remove(&owner, handle0);
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 0U);
+	cache.insert(&owner, 1, 60);
+	BOOST_CHECK(owner.evicted.empty());
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_remove_after_slot_reuse)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner1;
+	CqFakeTileOwner owner2;
+	Aqsis::CqTileCache::SqHandle handle1 = cache.insert(&owner1, 0, 60);
+	// Evicts the tile of owner1, and reuses its slot.
+	Aqsis::CqTileCache::SqHandle handle2 = cache.insert(&owner2, 0, 60);
+	BOOST_REQUIRE_EQUAL(owner1.evicted.size(), 1U);
+	BOOST_CHECK(handle1.slot == handle2.slot);
+	BOOST_CHECK(handle1.generation != handle2.generation);
+	// Removing the stale handle, or a handle of another owner, must leave the
+	// new tile alone.
+	cache.remove(&owner1, handle1);
+	cache.remove(&owner1, handle2);
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 60U);
+	cache.remove(&owner2, handle2);
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 0U);
+	// Removing twice does nothing either.
+	cache.insert(&owner1, 1, 30);
+	cache.remove(&owner2, handle2);
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 30U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_wait_for_evictions)
+{
+	Aqsis::CqTileCache cache(100);
+	CqSlowTileOwner slowOwner;
+	CqFakeTileOwner owner;
+	Aqsis::CqTileCache::SqHandle handle = cache.insert(&slowOwner, 0, 60);
+	boost::thread evictThread(boost::bind(&Aqsis::CqTileCache::insert, &cache,
+				&owner, 0, 60));
+	// Wait until the eviction has been chosen, then check that waiting for
+	// it returns only once the owner has been told.
+	while(cache.stats().evictions == 0)
+		boost::this_thread::yield();
+	cache.remove(&slowOwner, handle);
+	cache.waitForEvictions(&slowOwner);
+	{
+		boost::mutex::scoped_lock lock(slowOwner.mutex);
+		BOOST_CHECK_EQUAL(slowOwner.numEvicted, 1);
+	}
+	evictThread.join();
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 60U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_concurrent_hits)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner;
+	Aqsis::CqTileCache::SqHandle handle = cache.insert(&owner, 0, 10);
+	boost::thread_group threads;
+	for(TqInt i = 0; i < 4; ++i)
+		threads.create_thread(boost::bind(&touchTile, &cache, handle));
+	threads.join_all();
+	BOOST_CHECK_EQUAL(cache.stats().hits, 40000U);
+	cache.resetStats();
+	BOOST_CHECK_EQUAL(cache.stats().hits, 0U);
+	cache.touch(handle);
+	BOOST_CHECK_EQUAL(cache.stats().hits, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_set_max_memory)
+{
+	Aqsis::CqTileCache cache(100);
+	CqFakeTileOwner owner;
+	cache.insert(&owner, 0, 40);
+	cache.insert(&owner, 1, 40);
+	cache.setMaxMemory(50);
+	BOOST_CHECK_EQUAL(owner.evicted.size(), 1U);
+	BOOST_CHECK(cache.memoryUsed() <= 50U);
+}
+
+BOOST_AUTO_TEST_CASE(CqTileCache_test_concurrent_insert)
+{
+	Aqsis::CqTileCache cache(1000);
+	CqFakeTileOwner owner;
+	boost::thread_group threads;
+	for(TqInt i = 0; i < 4; ++i)
+		threads.create_thread(boost::bind(&insertTiles, &cache, &owner));
+	threads.join_all();
+	// Every tile is either still in the cache or was evicted exactly once.
+	BOOST_CHECK_EQUAL(cache.memoryUsed(), 1000U);
+	BOOST_CHECK_EQUAL(owner.evicted.size(), 4000U - 100U);
+	BOOST_CHECK_EQUAL(cache.stats().misses, 4000U);
+	BOOST_CHECK_EQUAL(cache.stats().evictions, 4000U - 100U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+/**
+ * \file
+ *
+ * \brief Background tile reading implementation.
+ */
+
+#include <aqsis/tex/buffers/tileprefetcher.h>
+
+#include <boost/bind.hpp>
+
+namespace Aqsis {
+
+const TqInt CqTilePrefetcher::defaultNumThreads;
+
+CqTilePrefetcher::CqTilePrefetcher(TqInt numThreads)
+	: m_pool(numThreads),
+	m_tasks(m_pool)
+{ }
+
+CqTilePrefetcher::~CqTilePrefetcher()
+{
+	wait();
+}
+
+CqTilePrefetcher& CqTilePrefetcher::instance()
+{
+	static CqTilePrefetcher prefetcher;
+	return prefetcher;
+}
+
+void CqTilePrefetcher::run(const boost::function0<void>& task)
+{
+	m_tasks.run(boost::bind(&CqTilePrefetcher::runTask, task));
+}
+
+void CqTilePrefetcher::wait()
+{
+	m_tasks.wait();
+}
+
+void CqTilePrefetcher::runTask(const boost::function0<void>& task)
+{
+	try
+	{
+		task();
+	}
+	catch(...)
+	{
+		// The error will be reported when the tile is used.
+	}
+}
+
+} // namespace Aqsis
@@ -0,0 +1,81 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+/** \file
+ *
+ * \brief Unit tests for background tile reading.
+ */
+
+#include <aqsis/tex/buffers/tileprefetcher.h>
+
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+namespace {
+
+boost::mutex countMutex;
+
+void countTask(TqInt* count)
+{
+	boost::mutex::scoped_lock lock(countMutex);
+	++*count;
+}
+
+void throwingTask()
+{
+	throw std::runtime_error("tile read failed");
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqTilePrefetcher_run_test)
+{
+	Aqsis::CqTilePrefetcher prefetcher(2);
+	TqInt count = 0;
+	for(TqInt i = 0; i < 100; ++i)
+		prefetcher.run(boost::bind(&countTask, &count));
+	prefetcher.wait();
+	BOOST_CHECK_EQUAL(count, 100);
+}
+
+BOOST_AUTO_TEST_CASE(CqTilePrefetcher_exception_test)
+{
+	Aqsis::CqTilePrefetcher prefetcher(2);
+	TqInt count = 0;
+	prefetcher.run(&throwingTask);
+	prefetcher.run(boost::bind(&countTask, &count));
+	// Errors are left for the thread using the tile to discover.
+	BOOST_CHECK_NO_THROW(prefetcher.wait());
+	BOOST_CHECK_EQUAL(count, 1);
+}
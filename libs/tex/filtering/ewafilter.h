@@ -42,7 +42,13 @@
 
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define AQSIS_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
 #include <aqsis/math/math.h>
+#include <aqsis/util/autobuffer.h>
 #include <aqsis/tex/buffers/filtersupport.h>
 #include <aqsis/math/matrix2d.h>
 #include <aqsis/tex/filtering/samplequad.h>
@@ -93,6 +99,17 @@ class CqEwaFilter
 		 *            don't have to)
 		 */
 		TqFloat operator()(TqFloat x, TqFloat y) const;
+		/** \brief Evaluate the filter along part of a row of pixels.
+		 *
+		 * The weights are the same as those given by operator(), but four
+		 * are computed at a time using SSE where it's available.
+		 *
+		 * \param xStart - x-coordinate of the first pixel
+		 * \param xEnd - one past the x-coordinate of the last pixel
+		 * \param y - y-coordinate of the row
+		 * \param weights - output array of length xEnd - xStart
+		 */
+		void rowWeights(TqInt xStart, TqInt xEnd, TqInt y, TqFloat* weights) const;
 		/// Get the extent of the filter in integer raster coordinates.
 		SqFilterSupport support() const;
 
@@ -105,6 +122,99 @@ class CqEwaFilter
 		const TqFloat m_logEdgeWeight;
 };
 
+//------------------------------------------------------------------------------
+/** \brief EWA filter weights cached over a whole filter support.
+ *
+ * The weights for every row of the support are computed once with
+ * CqEwaFilter::rowWeights() when the adaptor is constructed, so they may be
+ * looked up in any order.  In particular, tiled pixel iterators visit each
+ * row once for every tile the support crosses, and the rows needn't be
+ * recomputed each time.  It's a drop in replacement for CqEwaFilter in
+ * CqSampleAccum, but may only be used for pixels inside the support.
+ */
+class CqEwaRowWeights
+{
+	public:
+		/** \brief Compute the weights of a filter over the given support.
+		 *
+		 * \param filter - filter to evaluate.
+		 * \param support - support which the pixels will lie within.
+		 */
+		CqEwaRowWeights(const CqEwaFilter& filter, const SqFilterSupport& support);
+
+		/// EWA filters are never pre-noramlized; return false.
+		static bool isNormalized() { return false; }
+
+		/// Get the filter weight for the pixel at (x,y).
+		TqFloat operator()(TqInt x, TqInt y) const;
+
+		/// Get the sum of the weights over the whole support.
+		TqFloat totalWeight() const;
+
+	private:
+		/// Support which the weights are held for.
+		const SqFilterSupport m_support;
+		/// Number of weights held for each row.
+		const TqInt m_rowLength;
+		/// Sum of all the weights.
+		TqFloat m_totWeight;
+		/// Weights for the pixels of the support, stored by rows.
+		CqAutoBuffer<TqFloat, 256> m_weights;
+};
+
+//------------------------------------------------------------------------------
+/** \brief Sample accumulator for EWA filtering with cached weights.
+ *
+ * This models SampleAccumulatorConcept, and gives the same results as
+ * CqSampleAccum<CqEwaRowWeights> up to rounding.  Where SSE is available, the
+ * channels of each pixel are weighted and accumulated together in a single
+ * register, which covers results of up to four channels; longer results are
+ * accumulated a channel at a time.  Since the weights are normalised by their
+ * precomputed total, every pixel of the support must be accumulated.
+ */
+class CqEwaSampleAccum
+{
+	public:
+		/** \brief Construct an accumulator.
+		 *
+		 * \param weights - filter weights for the support.
+		 * \param startChan - channel index to begin extracting data from the
+		 *                    accumulated sample vectors
+		 * \param numChans - number of channels in the result
+		 * \param resultBuf - float buffer to place the filtered result into.
+		 * \param fill - value to fill nonexistant channels with.
+		 */
+		CqEwaSampleAccum(const CqEwaRowWeights& weights, TqInt startChan,
+				TqInt numChans, TqFloat* resultBuf, TqFloat fill = 0);
+
+		/// Set length for sample vectors, as for CqSampleAccum.
+		bool setSampleVectorLength(TqInt sampleVectorLength);
+
+		/// Accumulate a sample into the output buffer at the given position.
+		template<typename SampleVectorT>
+		void accumulate(TqInt x, TqInt y, const SampleVectorT& inSamples);
+
+		/// Store and renormalize the accumulated data.
+		~CqEwaSampleAccum();
+	private:
+		/// Filter weights
+		const CqEwaRowWeights& m_weights;
+		/// Start channel in the source data
+		TqInt m_startChan;
+		/// Number of channels in dest buffer
+		TqInt m_numChans;
+		/// Number of channels at the end of dest buffer which get the fill value.
+		TqInt m_numChansFill;
+		/// Array to fill with accumulated data
+		TqFloat* m_resultBuf;
+		/// Fill value for filling extra source data channels.
+		TqFloat m_fill;
+#		ifdef AQSIS_SIMD_SSE2
+		/// Accumulated channels when there are at most four.
+		__m128 m_sum;
+#		endif
+};
+
 //------------------------------------------------------------------------------
 /** \brief A class encapsulating Elliptically Weighted Average (EWA) filter
  * weight computation.
@@ -387,8 +497,10 @@ class CqNegExpTable
 			m_rangeMax(rangeMax)
 		{
 			TqFloat res = 1/m_invRes;
-			m_values.resize(numPoints);
-			for(int i = 0; i < numPoints; ++i)
+			// An extra point at the end allows for rounding of inputs just
+			// below rangeMax up to the final table index.
+			m_values.resize(numPoints+1);
+			for(int i = 0; i <= numPoints; ++i)
 			{
 				m_values[i] = exp(-i*res);
 			}
@@ -410,6 +522,28 @@ class CqNegExpTable
 			TqFloat interp = xRescaled - index;
 			return (1-interp)*m_values[index] + interp*m_values[index+1];
 		}
+#		ifdef AQSIS_SIMD_SSE2
+		/// Look up exp(-x) for four values of x >= 0, as for operator().
+		__m128 operator()(__m128 x) const
+		{
+			const __m128 inRange = _mm_cmplt_ps(x, _mm_set1_ps(m_rangeMax));
+			// Lanes outside the table use index 0 and are masked out below.
+			const __m128 xRescaled = _mm_and_ps(inRange,
+					_mm_mul_ps(_mm_max_ps(x, _mm_setzero_ps()),
+						_mm_set1_ps(m_invRes)));
+			const __m128i index = _mm_cvttps_epi32(xRescaled);
+			const __m128 interp = _mm_sub_ps(xRescaled, _mm_cvtepi32_ps(index));
+			TqInt i[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(i), index);
+			const TqFloat* v = &m_values[0];
+			const __m128 v0 = _mm_setr_ps(v[i[0]], v[i[1]], v[i[2]], v[i[3]]);
+			const __m128 v1 = _mm_setr_ps(v[i[0]+1], v[i[1]+1], v[i[2]+1], v[i[3]+1]);
+			const __m128 value = _mm_add_ps(
+					_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), interp), v0),
+					_mm_mul_ps(interp, v1));
+			return _mm_and_ps(inRange, value);
+		}
+#		endif
 };
 extern CqNegExpTable negExpTable;
 
@@ -441,6 +575,37 @@ inline TqFloat CqEwaFilter::operator()(TqFloat x, TqFloat y) const
 	return 0;
 }
 
+inline void CqEwaFilter::rowWeights(TqInt xStart, TqInt xEnd, TqInt y,
+		TqFloat* weights) const
+{
+	TqInt x = xStart;
+#	ifdef AQSIS_SIMD_SSE2
+	// The quadratic form is evaluated with the same sequence of operations as
+	// operator(), so the weights are identical.
+	const TqFloat yRel = y - m_filterCenter.y();
+	const __m128 a = _mm_set1_ps(m_quadForm.a);
+	const __m128 bc = _mm_set1_ps(m_quadForm.b + m_quadForm.c);
+	const __m128 yRel4 = _mm_set1_ps(yRel);
+	const __m128 dyy = _mm_set1_ps(m_quadForm.d*yRel*yRel);
+	const __m128 xCenter = _mm_set1_ps(m_filterCenter.x());
+	const __m128 cutoff = _mm_set1_ps(m_logEdgeWeight);
+	const __m128i laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+	for(; x + 4 <= xEnd; x += 4)
+	{
+		__m128 xRel = _mm_sub_ps(_mm_cvtepi32_ps(
+					_mm_add_epi32(_mm_set1_epi32(x), laneOffsets)), xCenter);
+		__m128 q = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_mul_ps(a, xRel), xRel),
+					_mm_mul_ps(_mm_mul_ps(bc, xRel), yRel4)),
+				dyy);
+		__m128 w = _mm_and_ps(_mm_cmplt_ps(q, cutoff), detail::negExpTable(q));
+		_mm_storeu_ps(weights + (x - xStart), w);
+	}
+#	endif
+	for(; x < xEnd; ++x)
+		weights[x - xStart] = (*this)(x, y);
+}
+
 inline SqFilterSupport CqEwaFilter::support() const
 {
 	TqFloat detQ = m_quadForm.det();
@@ -455,6 +620,140 @@ inline SqFilterSupport CqEwaFilter::support() const
 		);
 }
 
+
+//------------------------------------------------------------------------------
+// CqEwaRowWeights implementation
+inline CqEwaRowWeights::CqEwaRowWeights(const CqEwaFilter& filter,
+		const SqFilterSupport& support)
+	: m_support(support),
+	m_rowLength(max(support.sx.range(), 0)),
+	m_totWeight(0),
+	m_weights(m_rowLength*max(support.sy.range(), 0))
+{
+	TqFloat* row = m_weights.get();
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y, row += m_rowLength)
+	{
+		filter.rowWeights(support.sx.start, support.sx.end, y, row);
+		for(TqInt i = 0; i < m_rowLength; ++i)
+			m_totWeight += row[i];
+	}
+}
+
+inline TqFloat CqEwaRowWeights::operator()(TqInt x, TqInt y) const
+{
+	assert(x >= m_support.sx.start && x < m_support.sx.end);
+	assert(y >= m_support.sy.start && y < m_support.sy.end);
+	return m_weights[(y - m_support.sy.start)*m_rowLength
+		+ x - m_support.sx.start];
+}
+
+inline TqFloat CqEwaRowWeights::totalWeight() const
+{
+	return m_totWeight;
+}
+
+//------------------------------------------------------------------------------
+// CqEwaSampleAccum implementation
+inline CqEwaSampleAccum::CqEwaSampleAccum(const CqEwaRowWeights& weights,
+		TqInt startChan, TqInt numChans, TqFloat* resultBuf, TqFloat fill)
+	: m_weights(weights),
+	m_startChan(startChan),
+	m_numChans(numChans),
+	m_numChansFill(0),
+	m_resultBuf(resultBuf),
+	m_fill(fill)
+{
+#	ifdef AQSIS_SIMD_SSE2
+	m_sum = _mm_setzero_ps();
+#	endif
+	for(TqInt i = 0; i < m_numChans; ++i)
+		m_resultBuf[i] = 0;
+}
+
+inline bool CqEwaSampleAccum::setSampleVectorLength(TqInt sampleVectorLength)
+{
+	assert(sampleVectorLength > 0);
+	TqInt totNumChans = m_numChans + m_numChansFill;
+	if(m_startChan + totNumChans <= sampleVectorLength)
+	{
+		m_numChans = totNumChans;
+		m_numChansFill = 0;
+	}
+	else if(m_startChan >= sampleVectorLength)
+	{
+		m_numChans = 0;
+		m_numChansFill = totNumChans;
+		return false;
+	}
+	else
+	{
+		m_numChans = sampleVectorLength - m_startChan;
+		m_numChansFill = totNumChans - m_numChans;
+	}
+	return true;
+}
+
+template<typename SampleVectorT>
+inline void CqEwaSampleAccum::accumulate(TqInt x, TqInt y,
+		const SampleVectorT& inSamples)
+{
+	TqFloat weight = m_weights(x,y);
+	// Much of the support of an EWA filter lies outside the cutoff.
+	if(weight == 0)
+		return;
+	const TqInt c = m_startChan;
+#	ifdef AQSIS_SIMD_SSE2
+	if(m_numChans <= 4)
+	{
+		// The switch is on a fixed channel count, so is well predicted.
+		__m128 samples;
+		switch(m_numChans)
+		{
+			case 1:
+				samples = _mm_set_ss(inSamples[c]);
+				break;
+			case 2:
+				samples = _mm_setr_ps(inSamples[c], inSamples[c+1], 0, 0);
+				break;
+			case 3:
+				samples = _mm_setr_ps(inSamples[c], inSamples[c+1],
+						inSamples[c+2], 0);
+				break;
+			default:
+				samples = _mm_setr_ps(inSamples[c], inSamples[c+1],
+						inSamples[c+2], inSamples[c+3]);
+				break;
+		}
+		m_sum = _mm_add_ps(m_sum, _mm_mul_ps(_mm_set1_ps(weight), samples));
+		return;
+	}
+#	endif
+	for(TqInt i = 0; i < m_numChans; ++i)
+		m_resultBuf[i] += weight*inSamples[i + c];
+}
+
+inline CqEwaSampleAccum::~CqEwaSampleAccum()
+{
+#	ifdef AQSIS_SIMD_SSE2
+	if(m_numChans <= 4)
+	{
+		TqFloat sum[4];
+		_mm_storeu_ps(sum, m_sum);
+		for(TqInt i = 0; i < m_numChans; ++i)
+			m_resultBuf[i] = sum[i];
+	}
+#	endif
+	TqFloat totWeight = m_weights.totalWeight();
+	if(totWeight != 0)
+	{
+		TqFloat renorm = 1/totWeight;
+		for(TqInt i = 0; i < m_numChans; ++i)
+			m_resultBuf[i] *= renorm;
+	}
+	for(TqInt i = 0; i < m_numChansFill; ++i)
+		m_resultBuf[i+m_numChans] = m_fill;
+}
+
 } // namespace Aqsis
 
 #endif // EWAFILTER_H_INCLUDED
@@ -0,0 +1,139 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for EWA filter weights.
+ */
+#include "ewafilter.h"
+
+#include <vector>
+
+#include <aqsis/tex/filtering/sampleaccum.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(ewafilter_tests)
+
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_CASE(CqEwaFilter_rowWeights_test)
+{
+	// An anisotropic filter rotated with respect to the axes.
+	CqEwaFilter filter(SqMatrix2D(0.05, 0.03, 0.03, 0.2),
+			CqVector2D(10.3, 7.6), 4);
+	SqFilterSupport support = filter.support();
+	BOOST_REQUIRE(support.sx.range() > 4);
+	// Include pixels outside the support, and a row length which isn't a
+	// multiple of four.
+	TqInt xStart = support.sx.start - 3;
+	TqInt xEnd = support.sx.end + 2;
+	std::vector<TqFloat> weights(xEnd - xStart);
+	for(TqInt y = support.sy.start - 1; y <= support.sy.end; ++y)
+	{
+		filter.rowWeights(xStart, xEnd, y, &weights[0]);
+		for(TqInt x = xStart; x < xEnd; ++x)
+			BOOST_CHECK_EQUAL(weights[x - xStart], filter(x, y));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqEwaRowWeights_test)
+{
+	CqEwaFilter filter(SqMatrix2D(0.1, 0, 0, 0.1), CqVector2D(3, 4), 4);
+	SqFilterSupport support = filter.support();
+	CqEwaRowWeights rowWeights(filter, support);
+	// Visit the columns in two pieces, as a tiled pixel iterator would for a
+	// support crossing a tile boundary.
+	TqInt xSplit = (support.sx.start + support.sx.end)/2;
+	TqFloat totWeight = 0;
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y)
+	{
+		for(TqInt x = support.sx.start; x < xSplit; ++x)
+		{
+			BOOST_CHECK_EQUAL(rowWeights(x, y), filter(x, y));
+			totWeight += filter(x, y);
+		}
+	}
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y)
+	{
+		for(TqInt x = xSplit; x < support.sx.end; ++x)
+		{
+			BOOST_CHECK_EQUAL(rowWeights(x, y), filter(x, y));
+			totWeight += filter(x, y);
+		}
+	}
+	BOOST_CHECK_CLOSE(rowWeights.totalWeight(), totWeight, 1e-4);
+}
+
+// Filter some made-up pixel data with both CqEwaSampleAccum and CqSampleAccum.
+void checkEwaSampleAccum(TqInt numPixelChans, TqInt startChan, TqInt numChans)
+{
+	CqEwaFilter filter(SqMatrix2D(0.05, 0.03, 0.03, 0.2),
+			CqVector2D(10.3, 7.6), 4);
+	SqFilterSupport support = filter.support();
+	CqEwaRowWeights rowWeights(filter, support);
+	std::vector<TqFloat> ewaResult(numChans);
+	std::vector<TqFloat> expected(numChans);
+	{
+		CqEwaSampleAccum ewaAccum(rowWeights, startChan, numChans,
+				&ewaResult[0], 0.5);
+		CqSampleAccum<CqEwaFilter> accum(filter, startChan, numChans,
+				&expected[0], 0.5);
+		bool ewaAccumulate = ewaAccum.setSampleVectorLength(numPixelChans);
+		BOOST_CHECK_EQUAL(ewaAccumulate, accum.setSampleVectorLength(numPixelChans));
+		std::vector<TqFloat> pixel(numPixelChans);
+		for(TqInt y = support.sy.start; ewaAccumulate && y < support.sy.end; ++y)
+		{
+			for(TqInt x = support.sx.start; x < support.sx.end; ++x)
+			{
+				for(TqInt c = 0; c < numPixelChans; ++c)
+					pixel[c] = 0.1*x + 0.01*y + c;
+				ewaAccum.accumulate(x, y, &pixel[0]);
+				accum.accumulate(x, y, &pixel[0]);
+			}
+		}
+	}
+	for(TqInt c = 0; c < numChans; ++c)
+		BOOST_CHECK_CLOSE(ewaResult[c], expected[c], 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(CqEwaSampleAccum_test)
+{
+	checkEwaSampleAccum(1, 0, 1);
+	checkEwaSampleAccum(3, 0, 3);
+	checkEwaSampleAccum(4, 1, 3);
+	checkEwaSampleAccum(6, 0, 6);
+	// Channels beyond the end of the pixels get the fill value.
+	checkEwaSampleAccum(3, 1, 3);
+	checkEwaSampleAccum(2, 2, 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -75,6 +75,14 @@ boost::shared_ptr<IqOcclusionSampler> IqOcclusionSampler::createDummy()
 	return boost::shared_ptr<IqOcclusionSampler>(new CqDummyOcclusionSampler());
 }
 
+void IqOcclusionSampler::sampleBatch(const Sq3DSamplePllgram* regions,
+		const CqVector3D* normals, TqInt numRegions,
+		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	for(TqInt i = 0; i < numRegions; ++i)
+		sample(regions[i], normals[i], sampleOpts, outSamps + i);
+}
+
 const CqShadowSampleOptions& IqOcclusionSampler::defaultSampleOptions() const
 {
 	static const CqShadowSampleOptions defaultOptions;
@@ -81,4 +81,10 @@ const CqShadowSampleOptions& IqShadowSampler::defaultSampleOptions() const
 	return defaultOptions;
 }
 
+bool IqShadowSampler::depthBehindSurface(const CqVector3D& /*P*/,
+		TqFloat& /*depth*/) const
+{
+	return false;
+}
+
 } // namespace Aqsis
@@ -80,6 +80,19 @@ void IqTextureSampler::sample(const SqSampleQuad& sampleQuad,
 	sample(SqSamplePllgram(sampleQuad), sampleOpts, outSamps);
 }
 
+void IqTextureSampler::sampleBatch(const SqSamplePllgram* regions,
+		TqInt numRegions, const CqTextureSampleOptions& sampleOpts,
+		TqFloat* outSamps) const
+{
+	const TqInt numChannels = sampleOpts.numChannels();
+	for(TqInt i = 0; i < numRegions; ++i)
+		sample(regions[i], sampleOpts, outSamps + i*numChannels);
+}
+
+void IqTextureSampler::prefetch(const SqSamplePllgram* regions,
+		TqInt numRegions, const CqTextureSampleOptions& sampleOpts) const
+{ }
+
 const CqTextureSampleOptions& IqTextureSampler::defaultSampleOptions() const
 {
 	static const CqTextureSampleOptions defaultOptions;
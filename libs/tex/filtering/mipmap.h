@@ -40,13 +40,16 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/util/autobuffer.h>
 #include <aqsis/util/exception.h>
+#include "ewafilter.h"
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include <aqsis/util/logging.h>
@@ -118,11 +121,75 @@ class CqMipmap
 		template<typename FilterFactoryT>
 		void applyFilter(const FilterFactoryT& filterFactory,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps);
+		/** \brief Apply a batch of filters to the mipmap.
+		 *
+		 * The results are the same as those of applyFilter() for each filter
+		 * in turn.  The levels for the whole batch are chosen first, and the
+		 * filters are then applied a level at a time, so that consecutive
+		 * filters use the same tiles where possible, even when results are
+		 * interpolated between levels.
+		 *
+		 * \param filterFactories - array of factories, as for applyFilter().
+		 * \param numFilters - length of the filterFactories array.
+		 * \param sampleOpts - Sample options structure.
+		 * \param outSamps - Output variable - sampleOpts.numChannels()
+		 *            filtered samples for each filter will be placed here.
+		 */
+		template<typename FilterFactoryT>
+		void applyFilterBatch(const FilterFactoryT* filterFactories,
+				TqInt numFilters, const CqTextureSampleOptions& sampleOpts,
+				TqFloat* outSamps);
+
+		//--------------------------------------------------
+		/// \name Prefetching
+		//@{
+		/// Filter supports on each mipmap level, as collected for prefetch().
+		typedef std::vector<std::vector<SqFilterSupport> > TqLevelSupports;
+		/** \brief Add the pixels needed by a filter to a set of supports.
+		 *
+		 * The mipmap levels are chosen exactly as in applyFilter().
+		 *
+		 * \param filterFactory - factory for the filter, as for applyFilter().
+		 * \param sampleOpts - Sample options structure.
+		 * \param supports - supports for the filter are added to this.
+		 */
+		template<typename FilterFactoryT>
+		void addFilterSupport(const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts,
+				TqLevelSupports& supports) const;
+		/** \brief Start reading the pixels in a set of supports in the
+		 * background.
+		 *
+		 * \param supports - supports collected with addFilterSupport().
+		 */
+		void prefetch(const TqLevelSupports& supports) const;
+		//@}
 
 	private:
 		/// Initialize all mipmap levels
 		void initLevels();
 
+		/** \brief Choose the mipmap level to filter on.
+		 *
+		 * \param filterFactory - factory for the filter, as for applyFilter().
+		 * \param sampleOpts - Sample options structure.
+		 * \param levelCts - set to the continuous version of the level.
+		 * \param interpLevels - set to true if the result should be
+		 *            interpolated with the next level down.
+		 * \return The mipmap level.
+		 */
+		template<typename FilterFactoryT>
+		TqInt selectLevel(const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts, TqFloat& levelCts,
+				bool& interpLevels) const;
+
+		/** \brief Get the region of a mipmap level to filter over.
+		 *
+		 * \param level - mipmap level to filter over.
+		 * \param weights - filter weights for the level.
+		 */
+		SqFilterSupport levelSupport(TqInt level, const CqEwaFilter& weights) const;
+
 		/** \brief Filter the given mipmap level into a sample array.
 		 *
 		 * \param level - mipmap level to filter over.
@@ -152,10 +219,11 @@ class CqMipmap
 		boost::shared_ptr<IqTiledTexInputFile> m_texFile;
 		/** \brief List of samplers for mipmap levels.
 		 *
-		 * The pointers to these may be NULL since they are created only on
-		 * demand.  Mutable so that levels can be added on demand.
+		 * All levels are created up front so that the list may be used
+		 * concurrently without locking.  This is cheap since tiled levels
+		 * only read their pixel data on demand.
 		 */
-		mutable std::vector<boost::shared_ptr<TextureBufferT> > m_levels;
+		std::vector<boost::shared_ptr<TextureBufferT> > m_levels;
 		/// Transformation information for each level.
 		std::vector<SqLevelTrans> m_levelTransforms;
 		/// Width of the first mipmap level
@@ -258,40 +326,16 @@ template<typename FilterFactoryT>
 void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
 {
-	// Select mipmap level to use.
-	//
-	// The minimum filter width is the minimum number of pixels over which the
-	// shortest length scale of the filter should extend.
-	TqFloat minFilterWidth = sampleOpts.minWidth();
-	// Blur ratio ranges from 0 at no blur to 1 for a "lot" of blur.
-	TqFloat blurRatio = 0;
-	if(sampleOpts.lerp() == Lerp_Auto && (sampleOpts.sBlur() != 0 || sampleOpts.tBlur() != 0))
-	{
-		// When using blur, the minimum filter width needs to be increased.
-		//
-		// Experiments show that for large blur factors minFilterWidth should
-		// be about 4 for good results.
-		TqFloat maxBlur = max(sampleOpts.sBlur()*m_width0,
-				sampleOpts.tBlur()*m_height0);
-		// To estimate how much to increase the blur, we take the ratio of the
-		// the blur to the computed width of the minor axis of the filter.
-		// This should be near 0 for blur which doesn't effect the filtering
-		// much, and a asymptote to a positive constant when the blur is the
-		// dominant factor.
-		blurRatio = clamp(2*maxBlur/filterFactory.minorAxisWidth(), 0.0f, 1.0f);
-		minFilterWidth += 2*blurRatio;
-	}
-	TqFloat levelCts = log2(filterFactory.minorAxisWidth()/minFilterWidth);
-	TqInt level = clamp<TqInt>(lfloor(levelCts), 0, numLevels()-1);
+	TqFloat levelCts = 0;
+	bool interpLevels = false;
+	TqInt level = selectLevel(filterFactory, sampleOpts, levelCts, interpLevels);
 
 	filterLevel(level, filterFactory, sampleOpts, outSamps);
 
 	// Sometimes we might want to interpolate between the filtered result
 	// already computed above and the next lower mipmap level.  We do that now
 	// if necessary.
-	if( ( sampleOpts.lerp() == Lerp_Always
-		|| (sampleOpts.lerp() == Lerp_Auto && blurRatio > 0.2) )
-		&& level < numLevels()-1 && levelCts > 0)
+	if(interpLevels)
 	{
 		// Use interpolation between the results of filtering on two different
 		// mipmap levels.  This should only be necessary if using filter blur,
@@ -328,20 +372,148 @@ void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 	// outSamps[level%sampleOpts.numCahnnels()] += 0.1;
 }
 
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+void CqMipmap<TextureBufferT>::applyFilterBatch(
+		const FilterFactoryT* filterFactories, TqInt numFilters,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	// Each filtering job is a (level, 2*filterIndex + lerp) pair, where lerp
+	// is 1 for jobs which filter the next level down to interpolate with.
+	// Sorting them puts the jobs for each level together, and puts each
+	// interpolation after the filtering on the level above it.
+	std::vector<std::pair<TqInt, TqInt> > jobs;
+	jobs.reserve(numFilters);
+	std::vector<TqFloat> levelInterps(numFilters, 0);
+	for(TqInt i = 0; i < numFilters; ++i)
+	{
+		TqFloat levelCts = 0;
+		bool interpLevels = false;
+		TqInt level = selectLevel(filterFactories[i], sampleOpts, levelCts,
+				interpLevels);
+		jobs.push_back(std::make_pair(level, 2*i));
+		if(interpLevels)
+		{
+			jobs.push_back(std::make_pair(level+1, 2*i + 1));
+			// Bias the interpolation toward the higher resolution level, as
+			// in applyFilter().
+			levelInterps[i] = (levelCts - level)*(levelCts - level);
+		}
+	}
+	std::sort(jobs.begin(), jobs.end());
+
+	const TqInt numChans = sampleOpts.numChannels();
+	CqAutoBuffer<TqFloat, 16> tmpSamps(numChans);
+	for(TqInt j = 0, numJobs = jobs.size(); j < numJobs; ++j)
+	{
+		const TqInt level = jobs[j].first;
+		const TqInt i = jobs[j].second / 2;
+		TqFloat* samps = outSamps + i*numChans;
+		if(jobs[j].second % 2 == 0)
+		{
+			filterLevel(level, filterFactories[i], sampleOpts, samps);
+		}
+		else
+		{
+			filterLevel(level, filterFactories[i], sampleOpts, tmpSamps.get());
+			TqFloat levelInterp = levelInterps[i];
+			for(TqInt c = 0; c < numChans; ++c)
+				samps[c] = (1-levelInterp) * samps[c] + levelInterp*tmpSamps[c];
+		}
+	}
+}
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+void CqMipmap<TextureBufferT>::addFilterSupport(
+		const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts, TqLevelSupports& supports) const
+{
+	TqFloat levelCts = 0;
+	bool interpLevels = false;
+	TqInt level = selectLevel(filterFactory, sampleOpts, levelCts, interpLevels);
+	if(static_cast<TqInt>(supports.size()) < numLevels())
+		supports.resize(numLevels());
+	for(TqInt l = level, end = interpLevels ? level+1 : level; l <= end; ++l)
+	{
+		const SqLevelTrans& trans = levelTrans(l);
+		CqEwaFilter weights = filterFactory.createFilter(
+			trans.xScale, trans.xOffset,
+			trans.yScale, trans.yOffset
+		);
+		supports[l].push_back(levelSupport(l, weights));
+	}
+}
+
+template<typename TextureBufferT>
+void CqMipmap<TextureBufferT>::prefetch(const TqLevelSupports& supports) const
+{
+	for(TqInt level = 0, end = supports.size(); level < end; ++level)
+	{
+		if(!supports[level].empty())
+			getLevel(level).prefetch(supports[level]);
+	}
+}
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+TqInt CqMipmap<TextureBufferT>::selectLevel(const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts, TqFloat& levelCts,
+		bool& interpLevels) const
+{
+	// Select mipmap level to use.
+	//
+	// The minimum filter width is the minimum number of pixels over which the
+	// shortest length scale of the filter should extend.
+	TqFloat minFilterWidth = sampleOpts.minWidth();
+	// Blur ratio ranges from 0 at no blur to 1 for a "lot" of blur.
+	TqFloat blurRatio = 0;
+	if(sampleOpts.lerp() == Lerp_Auto && (sampleOpts.sBlur() != 0 || sampleOpts.tBlur() != 0))
+	{
+		// When using blur, the minimum filter width needs to be increased.
+		//
+		// Experiments show that for large blur factors minFilterWidth should
+		// be about 4 for good results.
+		TqFloat maxBlur = max(sampleOpts.sBlur()*m_width0,
+				sampleOpts.tBlur()*m_height0);
+		// To estimate how much to increase the blur, we take the ratio of the
+		// the blur to the computed width of the minor axis of the filter.
+		// This should be near 0 for blur which doesn't effect the filtering
+		// much, and a asymptote to a positive constant when the blur is the
+		// dominant factor.
+		blurRatio = clamp(2*maxBlur/filterFactory.minorAxisWidth(), 0.0f, 1.0f);
+		minFilterWidth += 2*blurRatio;
+	}
+	levelCts = log2(filterFactory.minorAxisWidth()/minFilterWidth);
+	TqInt level = clamp<TqInt>(lfloor(levelCts), 0, numLevels()-1);
+	interpLevels = ( sampleOpts.lerp() == Lerp_Always
+		|| (sampleOpts.lerp() == Lerp_Auto && blurRatio > 0.2) )
+		&& level < numLevels()-1 && levelCts > 0;
+	return level;
+}
+
+template<typename TextureBufferT>
+SqFilterSupport CqMipmap<TextureBufferT>::levelSupport(TqInt level,
+		const CqEwaFilter& weights) const
+{
+	SqFilterSupport support = weights.support();
+	if(level == numLevels() - 1)
+	{
+		// Truncate the support to a maximum size of 20x20 if we're on the
+		// highest mipmap level.  If we don't do this, the support can
+		// occasionally be very large, resulting in very long filter times.
+		TqInt cx = (support.sx.start + support.sx.end)/2;
+		TqInt cy = (support.sy.start + support.sy.end)/2;
+		support = intersect(support, SqFilterSupport(cx-10, cx+11, cy-10, cy+11));
+	}
+	return support;
+}
+
 template<typename TextureBufferT>
 const TextureBufferT& CqMipmap<TextureBufferT>::getLevel(TqInt levelNum) const
 {
 	assert(levelNum < static_cast<TqInt>(m_levels.size()));
 	assert(levelNum >= 0);
-	if(!m_levels[levelNum])
-	{
-		// read in requested level if it's not loaded yet.
-		m_levels[levelNum].reset(new TextureBufferT(m_texFile, levelNum));
-		Aqsis::log() << debug << "initialized subtexture " << levelNum
-			<< " [" << m_levels[levelNum]->width() << "x"
-			<< m_levels[levelNum]->width() << "] " 
-			<< "from texture " << m_texFile->fileName() << "\n";
-	}
 	return *m_levels[levelNum];
 }
 
@@ -415,6 +587,8 @@ void CqMipmap<TextureBufferT>::initLevels()
 			<< "has less than the expected number of mipmap levels. "
 			<< "(smallest level: " << levelWidth << "x" << levelHeight << ")\n";
 	}
+	for(TqInt i = 0, end = m_levels.size(); i < end; ++i)
+		m_levels[i].reset(new TextureBufferT(m_texFile, i));
 }
 
 template<typename TextureBufferT>
@@ -429,6 +603,24 @@ void CqMipmap<TextureBufferT>::filterLevel(
 		trans.xScale, trans.xOffset,
 		trans.yScale, trans.yOffset
 	);
+	const TextureBufferT& buffer = getLevel(level);
+	SqFilterSupport support = levelSupport(level, weights);
+	if(support.inRange(0, buffer.width(), 0, buffer.height()))
+	{
+		// The usual case: the support lies inside the level, so every pixel
+		// of it is visited.  The weights are computed a row at a time up
+		// front, and the channels of each pixel are accumulated together.
+		CqEwaRowWeights rowWeights(weights, support);
+		CqEwaSampleAccum accumulator(
+			rowWeights,
+			sampleOpts.startChannel(),
+			sampleOpts.numChannels(),
+			outSamps,
+			sampleOpts.fill()
+		);
+		filterTextureNowrap(accumulator, buffer, support);
+		return;
+	}
 	// Create an accumulator for the samples.
 	CqSampleAccum<CqEwaFilter> accumulator(
 		weights,
@@ -437,20 +629,10 @@ void CqMipmap<TextureBufferT>::filterLevel(
 		outSamps,
 		sampleOpts.fill()
 	);
-	SqFilterSupport support = weights.support();
-	if(level == numLevels() - 1)
-	{
-		// Truncate the support to a maximum size of 20x20 if we're on the
-		// highest mipmap level.  If we don't do this, the support can
-		// occasionally be very large, resulting in very long filter times.
-		TqInt cx = (support.sx.start + support.sx.end)/2;
-		TqInt cy = (support.sy.start + support.sy.end)/2;
-		support = intersect(support, SqFilterSupport(cx-10, cx+11, cy-10, cy+11));
-	}
 	// filter the texture
 	filterTexture(
 		accumulator,
-		getLevel(level),
+		buffer,
 		support,
 		SqWrapModes(sampleOpts.sWrapMode(), sampleOpts.tWrapMode())
 	);
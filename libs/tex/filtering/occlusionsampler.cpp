@@ -44,6 +44,8 @@
 #include <aqsis/tex/buffers/tilearray.h>
 
 #include "depthapprox.h"
+#include "pcfaverage.h"
+#include "randomtable.h"
 
 namespace Aqsis {
 
@@ -198,7 +200,7 @@ class CqOcclusionSampler::CqOccView
 		 *
 		 * \param N - surface normal.
 		 */
-		TqFloat weight(const CqVector3D& N)
+		TqFloat weight(const CqVector3D& N) const
 		{
 			return N*m_negViewDirec;
 		}
@@ -235,12 +237,7 @@ class CqOcclusionSampler::CqOccView
 
 			// TODO: Fix the above calculation so that the width is actually
 			// taken into account properly.
-			CqVector3D center = m_currToRaster*sampleRegion.c;
-			TqFloat sWidthOn2 = 0.5*(sampleOpts.sBlur()*m_pixels.width());
-			TqFloat tWidthOn2 = 0.5*(sampleOpts.tBlur()*m_pixels.height());
-			SqFilterSupport support(
-					lround(center.x()-sWidthOn2), lround(center.x()+sWidthOn2) + 1,
-					lround(center.y()-tWidthOn2), lround(center.y()+tWidthOn2) + 1);
+			SqFilterSupport support = filterSupport(sampleRegion, sampleOpts);
 			// percentage closer accumulator
 			CqPcfAccum<CqConstFilter, CqConstDepthApprox> accumulator(
 					filterWeights, depthFunc, sampleOpts.startChannel(),
@@ -248,8 +245,76 @@ class CqOcclusionSampler::CqOccView
 			// accumulate occlusion over the filter support.
 			filterTextureNowrapStochastic(accumulator, m_pixels, support, numSamples);
 		}
+
+		/** \brief Compute occlusion from the current view direction for a
+		 * batch of sample regions.
+		 *
+		 * The regions are sampled one after another, so the tiles they share
+		 * stay hot.  Map depths for each region are gathered into depthBuf
+		 * and compared with the surface depth in bulk by pcfAverage().
+		 *
+		 * \param regions - parallelogram regions over which to sample the map
+		 * \param numSamples - number of samples for each region; regions with
+		 *                     no samples are skipped.
+		 * \param numRegions - length of the regions and numSamples arrays.
+		 * \param sampleOpts - set of sampling options
+		 * \param outSamps - Return parameter; amount of occlusion for each
+		 *                   region with a nonzero number of samples.
+		 * \param depthBuf - scratch space for the map depths.
+		 */
+		void sampleBatch(const Sq3DSamplePllgram* regions, const TqInt* numSamples,
+				TqInt numRegions, const CqShadowSampleOptions& sampleOpts,
+				TqFloat* outSamps, std::vector<TqFloat>& depthBuf) const
+		{
+			const TqInt chan = sampleOpts.startChannel();
+			const bool hasChan = chan < m_pixels.numChannels();
+			for(TqInt i = 0; i < numRegions; ++i)
+			{
+				if(numSamples[i] <= 0)
+					continue;
+				depthBuf.clear();
+				if(hasChan)
+				{
+					SqFilterSupport support = filterSupport(regions[i], sampleOpts);
+					for(CqTileArray<TqFloat>::TqStochasticIterator
+							p = m_pixels.beginStochastic(support, numSamples[i]);
+							p.inSupport(); ++p)
+						depthBuf.push_back((*p)[chan]);
+				}
+				TqFloat surfDepth = (m_currToLight*regions[i].c).z();
+				outSamps[i] = pcfAverage(depthBuf.empty() ? 0 : &depthBuf[0],
+						depthBuf.size(), surfDepth, sampleOpts.biasLow(),
+						sampleOpts.biasHigh());
+			}
+		}
+
+	private:
+		/// Texture-aligned box filter support for the given region.
+		SqFilterSupport filterSupport(const Sq3DSamplePllgram& sampleRegion,
+				const CqShadowSampleOptions& sampleOpts) const
+		{
+			CqVector3D center = m_currToRaster*sampleRegion.c;
+			TqFloat sWidthOn2 = 0.5*(sampleOpts.sBlur()*m_pixels.width());
+			TqFloat tWidthOn2 = 0.5*(sampleOpts.tBlur()*m_pixels.height());
+			return SqFilterSupport(
+					lround(center.x()-sWidthOn2), lround(center.x()+sWidthOn2) + 1,
+					lround(center.y()-tWidthOn2), lround(center.y()+tWidthOn2) + 1);
+		}
 };
 
+/** \brief Random number deciding whether a map gets an extra sample.
+ *
+ * The sampler is shared by all the shading threads, so rather than drawing
+ * from a random number stream the number is hashed from the sample position
+ * and the map.  sample() and sampleBatch() then also agree for each region.
+ */
+static TqFloat extraSampleChance(const Sq3DSamplePllgram& region, TqInt map)
+{
+	TqUint h = hashMixFloat(hashMixFloat(hashMixFloat(hashMix(0, map),
+					region.c.x()), region.c.y()), region.c.z());
+	return hashToUnitFloat(h);
+}
+
 //------------------------------------------------------------------------------
 // CqOcclusionSampler implementation
 
@@ -257,8 +322,7 @@ CqOcclusionSampler::CqOcclusionSampler(
 		const boost::shared_ptr<IqTiledTexInputFile>& file,
 		const CqMatrix& currToWorld)
 	: m_maps(),
-	m_defaultSampleOptions(),
-	m_random()
+	m_defaultSampleOptions()
 {
 	// Connect the multiple shadow maps to the input file.
 	TqInt numMaps = file->numSubImages();
@@ -311,8 +375,8 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 			TqFloat numSampFlt = sampNumMult*weight;
 			// This isn't an integer though, so we take the floor,
 			TqInt numSamples = lfloor(numSampFlt);
-			// TODO: Investigate performance impact of using RandomFloat() here.
-			if(m_random.RandomFloat() < numSampFlt - numSamples)
+			if(extraSampleChance(samplePllgram, map - m_maps.begin())
+					< numSampFlt - numSamples)
 			{
 				// And increment with a probability equal to the extra fraction
 				// of samples that the current map should have.
@@ -351,6 +415,80 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 	*outSamps = totOcc / totNumSamples;
 }
 
+void CqOcclusionSampler::sampleBatch(const Sq3DSamplePllgram* regions,
+		const CqVector3D* normals, TqInt numRegions,
+		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	assert(sampleOpts.numChannels() == 1);
+
+	// This follows sample(), but with the views as the outer loop so that
+	// each view's tiles are used for all the regions while they're cached.
+	std::vector<CqVector3D> N(normals, normals + numRegions);
+	std::vector<TqFloat> totOcc(numRegions, 0);
+	std::vector<TqInt> totNumSamples(numRegions, 0);
+	std::vector<TqFloat> maxWeight(numRegions, 0);
+	std::vector<TqInt> maxWeightMap(numRegions, 0);
+	std::vector<TqInt> numSamples(numRegions, 0);
+	std::vector<TqFloat> occ(numRegions, 0);
+	std::vector<TqFloat> depthBuf;
+	for(TqInt i = 0; i < numRegions; ++i)
+		N[i].Unit();
+
+	const TqFloat sampNumMult = 4.0 * sampleOpts.numSamples() / m_maps.size();
+
+	for(TqInt map = 0, numMaps = m_maps.size(); map < numMaps; ++map)
+	{
+		const CqOccView& view = *m_maps[map];
+		bool anySamples = false;
+		for(TqInt i = 0; i < numRegions; ++i)
+		{
+			numSamples[i] = 0;
+			TqFloat weight = view.weight(N[i]);
+			if(weight > 0)
+			{
+				// See sample() for the choice of the number of samples.
+				TqFloat numSampFlt = sampNumMult*weight;
+				numSamples[i] = lfloor(numSampFlt);
+				if(extraSampleChance(regions[i], map) < numSampFlt - numSamples[i])
+					++numSamples[i];
+				anySamples |= numSamples[i] > 0;
+				if(weight > maxWeight[i])
+				{
+					maxWeight[i] = weight;
+					maxWeightMap[i] = map;
+				}
+			}
+		}
+		if(!anySamples)
+			continue;
+		view.sampleBatch(regions, &numSamples[0], numRegions, sampleOpts,
+				&occ[0], depthBuf);
+		for(TqInt i = 0; i < numRegions; ++i)
+		{
+			if(numSamples[i] > 0)
+			{
+				totOcc[i] += occ[i]*numSamples[i];
+				totNumSamples[i] += numSamples[i];
+			}
+		}
+	}
+
+	for(TqInt i = 0; i < numRegions; ++i)
+	{
+		// As in sample(), fall back to a single sample from the most highly
+		// weighted map.
+		if(totNumSamples[i] == 0 && maxWeight[i] > 0)
+		{
+			TqInt one = 1;
+			m_maps[maxWeightMap[i]]->sampleBatch(regions + i, &one, 1,
+					sampleOpts, &occ[i], depthBuf);
+			totOcc[i] += occ[i];
+			totNumSamples[i] += 1;
+		}
+		outSamps[i] = totOcc[i] / totNumSamples[i];
+	}
+}
+
 const CqShadowSampleOptions& CqOcclusionSampler::defaultSampleOptions() const
 {
 	return m_defaultSampleOptions;
@@ -46,7 +46,6 @@
 
 #include <aqsis/tex/filtering/iocclusionsampler.h>
 #include <aqsis/math/matrix.h>
-#include <aqsis/math/random.h>
 #include <aqsis/tex/filtering/texturesampleoptions.h>
 
 namespace Aqsis
@@ -83,6 +82,9 @@ class AQSIS_TEX_SHARE CqOcclusionSampler : public IqOcclusionSampler
 		virtual void sample(const Sq3DSamplePllgram& samplePllgram,
 				const CqVector3D& normal, const CqShadowSampleOptions& sampleOpts,
 				TqFloat* outSamps) const;
+		virtual void sampleBatch(const Sq3DSamplePllgram* regions,
+				const CqVector3D* normals, TqInt numRegions,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
 	private:
 		class CqOccView;
@@ -92,8 +94,6 @@ class AQSIS_TEX_SHARE CqOcclusionSampler : public IqOcclusionSampler
 		TqViewVec m_maps;
 		/// Default occlusion sampling options.
 		CqShadowSampleOptions m_defaultSampleOptions;
-		/// Random number stream for importance sampling.
-		mutable CqRandom m_random;
 };
 
 
@@ -0,0 +1,127 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Bulk percentage closer filtering with constant weights.
+ */
+
+#ifndef PCFAVERAGE_H_INCLUDED
+#define PCFAVERAGE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define AQSIS_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace Aqsis {
+
+/** \brief Average percentage closer result for a set of map depths.
+ *
+ * This gives the same result as accumulating the depths with a CqPcfAccum
+ * using constant filter weights and depth, but evaluates four depth
+ * comparisons at a time where SSE2 is available.
+ *
+ * \param mapDepths - depths from the occlusion map
+ * \param numDepths - length of mapDepths
+ * \param surfDepth - depth of the surface being shadowed
+ * \param biasLow, biasHigh - shadow biases; see CqPcfAccum.
+ */
+inline TqFloat pcfAverage(const TqFloat* mapDepths, TqInt numDepths, TqFloat surfDepth,
+		TqFloat biasLow, TqFloat biasHigh)
+{
+	if(numDepths == 0)
+		return 0;
+	TqFloat total = 0;
+	TqInt i = 0;
+	if(biasLow == biasHigh)
+	{
+		// Counting comparisons is enough when there's no bias ramp.
+#		ifdef AQSIS_SIMD_SSE2
+		const __m128 surf = _mm_set1_ps(surfDepth);
+		const __m128 bias = _mm_set1_ps(biasLow);
+		const __m128 one = _mm_set1_ps(1);
+		__m128 count = _mm_setzero_ps();
+		for(; i + 4 <= numDepths; i += 4)
+		{
+			// Add the bias to the map depth rather than subtracting it from
+			// the surface depth, so that rounding matches CqPcfAccum.
+			__m128 shad = _mm_add_ps(_mm_loadu_ps(mapDepths + i), bias);
+			count = _mm_add_ps(count, _mm_and_ps(_mm_cmpgt_ps(surf, shad), one));
+		}
+		TqFloat lanes[4];
+		_mm_storeu_ps(lanes, count);
+		total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#		endif
+		for(; i < numDepths; ++i)
+			total += surfDepth > mapDepths[i] + biasLow;
+	}
+	else
+	{
+		// Interpolate from 0 at surfDepth <= shadDepth + biasLow to 1 at
+		// surfDepth >= shadDepth + biasHigh.
+		const TqFloat invRange = 1/(biasHigh - biasLow);
+#		ifdef AQSIS_SIMD_SSE2
+		const __m128 surf = _mm_set1_ps(surfDepth);
+		const __m128 bLow = _mm_set1_ps(biasLow);
+		const __m128 bHigh = _mm_set1_ps(biasHigh);
+		const __m128 invR = _mm_set1_ps(invRange);
+		const __m128 one = _mm_set1_ps(1);
+		__m128 sum = _mm_setzero_ps();
+		for(; i + 4 <= numDepths; i += 4)
+		{
+			__m128 shad = _mm_loadu_ps(mapDepths + i);
+			__m128 full = _mm_cmpge_ps(surf, _mm_add_ps(shad, bHigh));
+			__m128 part = _mm_cmpgt_ps(surf, _mm_add_ps(shad, bLow));
+			__m128 ramp = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(surf, shad), bLow), invR);
+			sum = _mm_add_ps(sum, _mm_or_ps(_mm_and_ps(full, one),
+						_mm_andnot_ps(full, _mm_and_ps(part, ramp))));
+		}
+		TqFloat lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#		endif
+		for(; i < numDepths; ++i)
+		{
+			TqFloat shadDepth = mapDepths[i];
+			if(surfDepth >= shadDepth + biasHigh)
+				total += 1;
+			else if(surfDepth > shadDepth + biasLow)
+				total += (surfDepth - shadDepth - biasLow)*invRange;
+		}
+	}
+	return total/numDepths;
+}
+
+} // namespace Aqsis
+
+#endif // PCFAVERAGE_H_INCLUDED
@@ -0,0 +1,154 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests comparing bulk percentage closer filtering with
+ * CqPcfAccum.
+ */
+
+#include "pcfaverage.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/tex/filtering/sampleaccum.h>
+
+#include "depthapprox.h"
+
+BOOST_AUTO_TEST_SUITE(pcfaverage_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+// Lengths around the 4-wide SSE groups.
+const TqInt testLengths[] = {0, 1, 3, 4, 5, 8, 13, 64, 67};
+const TqInt numTestLengths = sizeof(testLengths)/sizeof(testLengths[0]);
+
+// (biasLow, biasHigh) pairs covering no bias, a step bias and a bias ramp.
+const TqFloat testBiases[][2] = {{0, 0}, {0.1f, 0.1f}, {-0.05f, 0.2f}, {0, 0.3f}};
+const TqInt numTestBiases = sizeof(testBiases)/sizeof(testBiases[0]);
+
+/// Unnormalized constant filter weights, as used for occlusion maps.
+struct SqConstFilter
+{
+	TqFloat operator()(TqFloat x, TqFloat y) const { return 1; }
+	bool isNormalized() const { return false; }
+};
+
+/// Percentage closer result for the depths, accumulated by CqPcfAccum.
+TqFloat accumResult(const std::vector<TqFloat>& depths, TqFloat surfDepth,
+		TqFloat biasLow, TqFloat biasHigh)
+{
+	SqConstFilter weights;
+	CqConstDepthApprox depthFunc(surfDepth);
+	TqFloat result = -1;
+	{
+		CqPcfAccum<SqConstFilter, CqConstDepthApprox> accum(weights,
+				depthFunc, 0, biasLow, biasHigh, &result);
+		for(TqInt i = 0; i < static_cast<TqInt>(depths.size()); ++i)
+			accum.accumulate(i, 0, &depths[i]);
+	}
+	return result;
+}
+
+/** Random map depths around the surface, including depths on and to either
+ * side of the bias thresholds, where rounding decides the comparisons.
+ */
+std::vector<TqFloat> testDepths(TqInt length, TqFloat surfDepth,
+		TqFloat biasLow, TqFloat biasHigh)
+{
+	std::vector<TqFloat> depths(length);
+	for(TqInt i = 0; i < length; ++i)
+	{
+		TqFloat threshold = surfDepth - (std::rand() % 2 ? biasLow : biasHigh);
+		switch(std::rand() % 4)
+		{
+			case 0: depths[i] = threshold; break;
+			case 1: depths[i] = nextafterf(threshold, 0); break;
+			case 2: depths[i] = nextafterf(threshold, 2*surfDepth); break;
+			default: depths[i] = 2*surfDepth*std::rand()/RAND_MAX; break;
+		}
+	}
+	return depths;
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(pcfAverage_matches_CqPcfAccum)
+{
+	std::srand(42);
+	for(TqInt b = 0; b < numTestBiases; ++b)
+	{
+		const TqFloat biasLow = testBiases[b][0];
+		const TqFloat biasHigh = testBiases[b][1];
+		for(TqInt l = 0; l < numTestLengths; ++l)
+		{
+			const TqInt length = testLengths[l];
+			for(TqInt trial = 0; trial < 20; ++trial)
+			{
+				TqFloat surfDepth = 0.1f + 10.0f*std::rand()/RAND_MAX;
+				std::vector<TqFloat> depths = testDepths(length, surfDepth,
+						biasLow, biasHigh);
+				TqFloat expected = accumResult(depths, surfDepth, biasLow, biasHigh);
+				TqFloat result = pcfAverage(length ? &depths[0] : 0, length,
+						surfDepth, biasLow, biasHigh);
+				if(length == 0)
+					BOOST_CHECK_EQUAL(result, 0);
+				// Step comparisons just count depths, so must agree exactly;
+				// ramps differ in rounding.
+				if(biasLow == biasHigh)
+					BOOST_CHECK_EQUAL(result, expected);
+				else
+					BOOST_CHECK_SMALL(result - expected, 1e-6f);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(pcfAverage_extremes)
+{
+	const TqFloat surfDepth = 1;
+	const TqFloat front[] = {2, 3, 1.5f, 4, 2, 1.01f};
+	const TqFloat behind[] = {0.5f, 0, 0.9f, 0.2f, 0.3f, 0.1f};
+	BOOST_CHECK_EQUAL(pcfAverage(front, 6, surfDepth, 0, 0), 0);
+	BOOST_CHECK_EQUAL(pcfAverage(behind, 6, surfDepth, 0, 0), 1);
+	BOOST_CHECK_EQUAL(pcfAverage(behind, 6, surfDepth, -0.1f, 0.05f), 1);
+	// Biases large enough to move every depth in front of the surface.
+	BOOST_CHECK_EQUAL(pcfAverage(behind, 6, surfDepth, 1, 1), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,7 @@ set(filtering_hdrs
 	latlongenvironmentsampler.h
 	mipmap.h
 	occlusionsampler.h
+	pcfaverage.h
 	randomtable.h
 	shadowsampler.h
 	texturecache.h
@@ -34,6 +35,9 @@ make_absolute(filtering_hdrs ${filtering_SOURCE_DIR})
 include_directories(${filtering_SOURCE_DIR})
 
 set(filtering_test_srcs
+	ewafilter_test.cpp
+	pcfaverage_test.cpp
 	samplequad_test.cpp
+	shadowsampler_test.cpp
 )
 make_absolute(filtering_test_srcs ${filtering_SOURCE_DIR})
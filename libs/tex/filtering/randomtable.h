@@ -40,8 +40,9 @@
 
 #include <aqsis/aqsis.h>
 
+#include <cstring>
+
 #include <aqsis/math/lowdiscrep.h>
-#include <aqsis/math/random.h>
 
 namespace Aqsis {
 
@@ -57,8 +58,9 @@ namespace Aqsis {
  * Randomized quasi-monte-carlo gets around this problem by somehow
  * "randomizing" the fixed low-discrepency sequence.  One way to do this is to
  * add an offset in the interval [0,1), and map the result back onto the
- * interval [0,1) modulo 1.  Relevant offsets can be obtained by simply using a
- * normal psuedo random number generator.
+ * interval [0,1) modulo 1.  The offsets are chosen by the caller, usually by
+ * hashing the filter region with hashToUnitFloat(), so the table itself is
+ * immutable and may be shared between threads.
  */
 class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 {
@@ -66,13 +68,10 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		/// Initialize the table with quasi random numbers.
 		Cq2dQuasiRandomTable();
 
-		/// "randomize" the low-discrepency sequence by resetting the offset.
-		void randomize();
-
-		/// Get the x sample point at the given index.
-		TqFloat x(TqUint index) const;
-		/// Get the y sample point at the given index.
-		TqFloat y(TqUint index) const;
+		/// Get the x sample point at the given index, offset by offsetX.
+		TqFloat x(TqUint index, TqFloat offsetX) const;
+		/// Get the y sample point at the given index, offset by offsetY.
+		TqFloat y(TqUint index, TqFloat offsetY) const;
 	private:
 		/// Note that this table size
 		static const TqUint m_tableSize = (1 << 10);
@@ -80,46 +79,70 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		TqFloat m_x[m_tableSize];
 		/// Table of y-positions
 		TqFloat m_y[m_tableSize];
-		/// Random numbers for randomizing the offsets
-		CqRandom m_rand;
-		/// Psudo-random x-offset
-		TqFloat m_offsetX;
-		/// Psudo-random y-offset
-		TqFloat m_offsetY;
 };
 
+/** \brief Mix an integer into a hash.
+ *
+ * Stochastic texture filtering draws its random numbers from hashes of the
+ * filter region rather than from a CqRandom stream.  Samplers are shared
+ * between the shading threads, so this keeps them free of mutable state, and
+ * a lookup gives the same result whichever thread makes it.
+ */
+inline TqUint hashMix(TqUint h, TqUint x);
+/// Mix the bits of a float into a hash.
+inline TqUint hashMixFloat(TqUint h, TqFloat x);
+/// Map a hash to a float in [0,1).
+inline TqFloat hashToUnitFloat(TqUint h);
+
 
 //==============================================================================
 // Implementation details
 //==============================================================================
 namespace detail {
 
-/// \todo Multithreading - This cannot be a singleton.
-//
-// It would be possible to make the table itself a singleton, and have another
-// object holding the randomized QMC offsets.
+// The table is immutable once constructed, so one instance serves all
+// threads.
 extern Cq2dQuasiRandomTable g_randTab;
 
 }
 
 // Cq2dQuasiRandomTable
 
-inline void Cq2dQuasiRandomTable::randomize()
+inline TqFloat Cq2dQuasiRandomTable::x(TqUint index, TqFloat offsetX) const
 {
-	m_offsetX = m_rand.RandomFloat();
-	m_offsetY = m_rand.RandomFloat();
+	TqFloat res = m_x[index & (m_tableSize-1)] + offsetX;
+	return res - (res >= 1);
 }
 
-inline TqFloat Cq2dQuasiRandomTable::x(TqUint index) const
+inline TqFloat Cq2dQuasiRandomTable::y(TqUint index, TqFloat offsetY) const
 {
-	TqFloat res = m_x[index & (m_tableSize-1)] + m_offsetX;
+	TqFloat res = m_y[index & (m_tableSize-1)] + offsetY;
 	return res - (res >= 1);
 }
 
-inline TqFloat Cq2dQuasiRandomTable::y(TqUint index) const
+inline TqUint hashMix(TqUint h, TqUint x)
 {
-	TqFloat res = m_y[index & (m_tableSize-1)] + m_offsetY;
-	return res - (res >= 1);
+	h ^= x + 0x9e3779b9U + (h << 6) + (h >> 2);
+	return h;
+}
+
+inline TqUint hashMixFloat(TqUint h, TqFloat x)
+{
+	TqUint bits = 0;
+	std::memcpy(&bits, &x, sizeof(bits));
+	return hashMix(h, bits);
+}
+
+inline TqFloat hashToUnitFloat(TqUint h)
+{
+	// Finalise the hash so that every input bit affects the result.
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	h *= 0x846ca68bU;
+	h ^= h >> 16;
+	// Use the top 24 bits, which a float holds exactly.
+	return (h >> 8)*(1.0f/16777216.0f);
 }
 
 } // namespace Aqsis
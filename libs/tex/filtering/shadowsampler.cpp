@@ -37,11 +37,15 @@
 
 #include "shadowsampler.h"
 
+#include <cfloat>
+#include <cmath>
+
 #include <aqsis/tex/io/itexinputfile.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/texexception.h>
 #include <aqsis/tex/buffers/tilearray.h>
+#include <aqsis/math/math.h>
 
 #include "depthapprox.h"
 #include "ewafilter.h"
@@ -118,6 +122,82 @@ class CqShadowSampler::CqShadowView
 		CqVector3D m_lightPos;
 		/// Pixel data for shadow map.
 		CqTileArray<TqFloat> m_pixels;
+		typedef std::vector<boost::shared_ptr<CqTileArray<TqFloat> > > TqRangeLevels;
+		/** \brief Optional pyramid of (min,max) depths.
+		 *
+		 * Entry i holds the depth range over 2^(i+1) x 2^(i+1) blocks of
+		 * m_pixels.
+		 */
+		TqRangeLevels m_depthRange;
+
+		/** \brief Find the range of map depths over the given support.
+		 *
+		 * The support should be wholly inside the map, and the pyramid
+		 * nonempty.  The result is conservative: the true range over the
+		 * support lies within [zMin,zMax].
+		 */
+		void mapDepthRange(const SqFilterSupport& support, TqFloat& zMin,
+				TqFloat& zMax) const
+		{
+			// Choose a level where the support covers only a few blocks.
+			TqFloat size = max(support.sx.range(), support.sy.range());
+			TqInt level = max<TqInt>(1, lceil(std::log(size)/std::log(2.0f)) - 1);
+			level = min(level, TqInt(m_depthRange.size()));
+			const CqTileArray<TqFloat>& range = *m_depthRange[level-1];
+			zMin = FLT_MAX;
+			zMax = -FLT_MAX;
+			for(TqInt y = support.sy.start >> level,
+					yEnd = (support.sy.end-1) >> level; y <= yEnd; ++y)
+			{
+				for(TqInt x = support.sx.start >> level,
+						xEnd = (support.sx.end-1) >> level; x <= xEnd; ++x)
+				{
+					CqTileArray<TqFloat>::TqSampleVector r = range(x,y);
+					zMin = min(zMin, r[0]);
+					zMax = max(zMax, r[1]);
+				}
+			}
+		}
+
+		/** \brief Try to determine the PCF result from the depth pyramid.
+		 *
+		 * If the surface lies wholly in front of or wholly behind the map
+		 * depths over the support, the result is 0 or 1 and percentage
+		 * closer filtering is unnecessary.
+		 *
+		 * \return true if outSamps[0] was set.
+		 */
+		template<typename DApprox>
+		bool cullPCF(const SqFilterSupport& support, const DApprox& depthFunc,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+		{
+			if(m_depthRange.empty() || sampleOpts.startChannel() != 0
+					|| support.area() <= 4)
+				return false;
+			SqFilterSupport clipped = intersect(support,
+					SqFilterSupport(0, m_pixels.width(), 0, m_pixels.height()));
+			// Surface depth range; depthFunc is linear so the extremes are
+			// found at the corners.
+			TqFloat x0 = clipped.sx.start, x1 = clipped.sx.end-1;
+			TqFloat y0 = clipped.sy.start, y1 = clipped.sy.end-1;
+			TqFloat d00 = depthFunc(x0,y0), d10 = depthFunc(x1,y0);
+			TqFloat d01 = depthFunc(x0,y1), d11 = depthFunc(x1,y1);
+			TqFloat surfMin = min(min(d00, d10), min(d01, d11));
+			TqFloat surfMax = max(max(d00, d10), max(d01, d11));
+			TqFloat mapMin = 0, mapMax = 0;
+			mapDepthRange(clipped, mapMin, mapMax);
+			if(surfMax <= mapMin + sampleOpts.biasLow())
+			{
+				*outSamps = 0;
+				return true;
+			}
+			if(surfMin > mapMax + sampleOpts.biasHigh())
+			{
+				*outSamps = 1;
+				return true;
+			}
+			return false;
+		}
 
 	public:
 		/** \brief Create a view from imageNum of the provided file.
@@ -132,7 +212,8 @@ class CqShadowSampler::CqShadowView
 			m_currToRaster(),
 			m_currToRasterVec(),
 			m_viewDirec(),
-			m_pixels(file, imageNum)
+			m_pixels(file, imageNum),
+			m_depthRange()
 		{
 			// TODO refactor with CqShadowSampler, also refactor this function,
 			// since it's a bit unweildly...
@@ -191,6 +272,17 @@ class CqShadowSampler::CqShadowView
 			m_viewDirec.Unit();
 		}
 
+		/** \brief Attach a level of the min/max depth pyramid to the view.
+		 *
+		 * Levels must be added in order, starting from the finest.
+		 */
+		void addDepthRangeLevel(const boost::shared_ptr<IqTiledTexInputFile>& file,
+				TqInt imageNum)
+		{
+			m_depthRange.push_back(boost::shared_ptr<CqTileArray<TqFloat> >(
+						new CqTileArray<TqFloat>(file, imageNum)));
+		}
+
 		/** \brief Visibility of the specified point to the lightsource.
 		 *
 		 * If multiple maps are specified, this is used as a factor to 
@@ -240,11 +332,6 @@ class CqShadowSampler::CqShadowView
 					m_pixels.height(), sampleOpts.sBlur(), sampleOpts.tBlur(), 2);
 			CqEwaFilter ewaWeights = ewaFactory.createFilter();
 
-			/** \todo Optimization: Cull the query if it's outside the [min,max] depth
-			 * range of the support.  Being able to determine the range from the tiles
-			 * covered by the filter support will be a big advantage.
-			 */
-
 			SqFilterSupport support = ewaWeights.support();
 			if(support.intersectsRange(0, m_pixels.width(), 0, m_pixels.height()))
 			{
@@ -252,7 +339,8 @@ class CqShadowSampler::CqShadowView
 				{
 					// Functor which approximates the surface depth using a constant.
 					CqConstDepthApprox depthFunc(quadLightCoord.center().z());
-					applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
+					if(!cullPCF(support, depthFunc, sampleOpts, outSamps))
+						applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
 				}
 				else
 				{
@@ -262,7 +350,8 @@ class CqShadowSampler::CqShadowView
 					quadLightCoord.copy2DCoords(texQuad);
 					CqSampleQuadDepthApprox depthFunc(quadLightCoord, m_pixels.width(),
 							m_pixels.height());
-					applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
+					if(!cullPCF(support, depthFunc, sampleOpts, outSamps))
+						applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
 				}
 			}
 			else
@@ -272,6 +361,43 @@ class CqShadowSampler::CqShadowView
 				*outSamps = 0;
 			}
 		}
+
+		/** \brief Distance of P behind the stored depth along the light z axis.
+		 *
+		 * The distance is averaged over the map pixels in the 3x3 block
+		 * around P which occlude it; pixels in front of which P lies don't
+		 * contribute, so the result is never negative.
+		 *
+		 * \see IqShadowSampler::depthBehindSurface
+		 */
+		bool depthBehindSurface(const CqVector3D& P, TqFloat& depth) const
+		{
+			TqFloat z = (m_currToLight*P).z();
+			if(z <= 0)
+				return false;
+			// m_currToRaster maps onto the unit square, not the pixel grid.
+			CqVector3D texP = m_currToRaster*P;
+			TqInt x = lfloor(texP.x()*m_pixels.width());
+			TqInt y = lfloor(texP.y()*m_pixels.height());
+			if(x < 0 || x >= m_pixels.width() || y < 0 || y >= m_pixels.height())
+				return false;
+			TqFloat totDepth = 0;
+			TqInt numOccluded = 0;
+			for(TqInt j = max(0, y-1), jEnd = min(m_pixels.height(), y+2); j < jEnd; ++j)
+			{
+				for(TqInt i = max(0, x-1), iEnd = min(m_pixels.width(), x+2); i < iEnd; ++i)
+				{
+					TqFloat mapZ = m_pixels(i, j)[0];
+					if(z > mapZ)
+					{
+						totDepth += z - mapZ;
+						++numOccluded;
+					}
+				}
+			}
+			depth = numOccluded > 0 ? totDepth/numOccluded : 0;
+			return true;
+		}
 };
 
 
@@ -283,13 +409,25 @@ CqShadowSampler::CqShadowSampler(const boost::shared_ptr<IqTiledTexInputFile>& f
 	: m_maps(),
 	m_defaultSampleOptions()
 {
-	// Connect the multiple shadow maps to the input file.
-	TqInt numMaps = file->numSubImages();
-	m_maps.reserve(numMaps);
-	for(TqInt i = 0; i < numMaps; ++i)
+	// Connect the multiple shadow maps to the input file.  Depth range
+	// pyramid levels follow the map which they summarize.
+	TqInt numImages = file->numSubImages();
+	for(TqInt i = 0; i < numImages; ++i)
 	{
-		m_maps.push_back(
+		if(file->header(i).find<Attr::TextureFormat>(TextureFormat_Unknown)
+				== TextureFormat_ShadowDepthRange)
+		{
+			if(m_maps.empty())
+				AQSIS_THROW_XQERROR(XqBadTexture, EqE_BadFile,
+						"Depth range subimage without shadow map in file \""
+						<< file->fileName() << "\"");
+			m_maps.back()->addDepthRangeLevel(file, i);
+		}
+		else
+		{
+			m_maps.push_back(
 				boost::shared_ptr<CqShadowView>(new CqShadowView(file, i, currToWorld)) );
+		}
 	}
 
 	m_defaultSampleOptions.fillFromFileHeader(file->header());
@@ -297,15 +435,23 @@ CqShadowSampler::CqShadowSampler(const boost::shared_ptr<IqTiledTexInputFile>& f
 
 void CqShadowSampler::sample(const Sq3DSampleQuad& sampleQuad,
 		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	// Sample the shadow map for the best view of the region center.
+	selectView(sampleQuad.center()).sample(sampleQuad, sampleOpts, outSamps);
+}
+
+bool CqShadowSampler::depthBehindSurface(const CqVector3D& P, TqFloat& depth) const
+{
+	return selectView(P).depthBehindSurface(P, depth);
+}
+
+const CqShadowSampler::CqShadowView& CqShadowSampler::selectView(
+		const CqVector3D& P) const
 {
 	// Get a suitable shadow map from the multi-map.
 	const CqShadowView* view = m_maps[0].get();
 	if(m_maps.size() > 1)
 	{
-		// Get the center of the sample region, we'll use
-		// this to determine which is the best view to use.
-		CqVector3D PC = sampleQuad.center();
-
 		// Choose the shadow view that sees the point most clearly,
 		// the more the point is in the periphery of a view, the
 		// less likely it is to be chosen.
@@ -313,7 +459,7 @@ void CqShadowSampler::sample(const Sq3DSampleQuad& sampleQuad,
 		
 		for(TqViewVec::const_iterator i = m_maps.begin(), end = m_maps.end(); i != end; ++i)
 		{
-			TqFloat weight = (*i)->weight(PC);
+			TqFloat weight = (*i)->weight(P);
 			if(weight > maxWeight)
 			{
 				maxWeight = weight;
@@ -321,8 +467,7 @@ void CqShadowSampler::sample(const Sq3DSampleQuad& sampleQuad,
 			}
 		}
 	}
-	// Sample the shadow map for the chosen view.
-	view->sample(sampleQuad, sampleOpts, outSamps);
+	return *view;
 }
 
 const CqShadowSampleOptions& CqShadowSampler::defaultSampleOptions() const
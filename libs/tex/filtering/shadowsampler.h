@@ -72,8 +72,12 @@ class AQSIS_TEX_SHARE CqShadowSampler : public IqShadowSampler
 		virtual void sample(const Sq3DSampleQuad& sampleQuad,
 				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
+		virtual bool depthBehindSurface(const CqVector3D& P, TqFloat& depth) const;
 	private:
 		class CqShadowView;
+
+		/// Choose the view which sees the point P most clearly.
+		const CqShadowView& selectView(const CqVector3D& P) const;
 		typedef std::vector<boost::shared_ptr<CqShadowView> > TqViewVec;
 
 		/// List of map views, used for point shadows, which have 6 subimages.
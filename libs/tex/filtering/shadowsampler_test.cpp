@@ -0,0 +1,308 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for shadow map lookups.
+ */
+#include "shadowsampler.h"
+
+#include <cfloat>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/tex/io/itiledtexinputfile.h>
+
+BOOST_AUTO_TEST_SUITE(shadowsampler_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+const TqInt mapSize = 64;
+const TqInt tileSize = 4;
+
+// In-memory shadow map, with the light looking down the z axis and
+// projecting onto the map with an identity world -> screen matrix.  The map
+// may be followed by a min/max depth pyramid, built as makeShadow() does.
+class CqFakeShadowFile : public IqTiledTexInputFile
+{
+	public:
+		CqFakeShadowFile(const std::vector<TqFloat>& depths, bool depthRange)
+			: m_images(),
+			m_tileReads()
+		{
+			SqImage map = {CqTexFileHeader(), mapSize, mapSize, 1, depths};
+			map.header.setWidth(mapSize);
+			map.header.setHeight(mapSize);
+			map.header.channelList().addUnnamedChannels(Channel_Float32, 1);
+			map.header.set<Attr::TextureFormat>(TextureFormat_Shadow);
+			map.header.set<Attr::WorldToCameraMatrix>(CqMatrix());
+			map.header.set<Attr::WorldToScreenMatrix>(CqMatrix());
+			m_images.push_back(map);
+			if(depthRange)
+			{
+				do
+					addRangeLevel();
+				while(m_images.back().width > 1);
+			}
+			m_tileReads.resize(m_images.size(), 0);
+		}
+
+		/// Number of tiles read from the given subimage.
+		TqInt tileReads(TqInt index) const { return m_tileReads[index]; }
+
+		virtual boostfs::path fileName() const { return "fake.shad"; }
+		virtual EqImageFileType fileType() const { return ImageFile_AqsisTex; }
+		virtual const CqTexFileHeader& header(TqInt index = 0) const
+		{
+			return m_images[index].header;
+		}
+		virtual SqTileInfo tileInfo() const
+		{
+			return SqTileInfo(tileSize, tileSize);
+		}
+		virtual TqInt numSubImages() const { return m_images.size(); }
+		virtual TqInt width(TqInt index) const { return m_images[index].width; }
+		virtual TqInt height(TqInt index) const { return m_images[index].height; }
+
+	protected:
+		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
+				TqInt subImageIdx, const SqTileInfo tInfo) const
+		{
+			++m_tileReads[subImageIdx];
+			const SqImage& image = m_images[subImageIdx];
+			TqFloat* out = reinterpret_cast<TqFloat*>(buffer);
+			const TqInt nChans = image.numChannels;
+			for(TqInt y = 0; y < tInfo.height; ++y)
+			{
+				for(TqInt x = 0; x < tInfo.width; ++x)
+				{
+					TqInt imageX = tileX*tileSize + x;
+					TqInt imageY = tileY*tileSize + y;
+					for(TqInt c = 0; c < nChans; ++c)
+					{
+						out[(y*tInfo.width + x)*nChans + c]
+							= image.data[(imageY*image.width + imageX)*nChans + c];
+					}
+				}
+			}
+		}
+
+	private:
+		struct SqImage
+		{
+			CqTexFileHeader header;
+			TqInt width;
+			TqInt height;
+			TqInt numChannels;
+			std::vector<TqFloat> data;
+		};
+
+		// Add the next level of the min/max pyramid, reducing 2x2 blocks of
+		// the previous level.
+		void addRangeLevel()
+		{
+			const SqImage& prev = m_images.back();
+			SqImage level = {prev.header, (prev.width+1)/2, (prev.height+1)/2, 2,
+				std::vector<TqFloat>()};
+			level.header.setWidth(level.width);
+			level.header.setHeight(level.height);
+			level.header.channelList() = CqChannelList();
+			level.header.channelList().addUnnamedChannels(Channel_Float32, 2);
+			level.header.set<Attr::TextureFormat>(TextureFormat_ShadowDepthRange);
+			for(TqInt y = 0; y < level.height; ++y)
+			{
+				for(TqInt x = 0; x < level.width; ++x)
+				{
+					TqFloat zMin = FLT_MAX;
+					TqFloat zMax = -FLT_MAX;
+					for(TqInt j = 2*y; j < min(2*y+2, prev.height); ++j)
+					{
+						for(TqInt i = 2*x; i < min(2*x+2, prev.width); ++i)
+						{
+							const TqFloat* z = &prev.data[(j*prev.width + i)*prev.numChannels];
+							zMin = min(zMin, z[0]);
+							zMax = max(zMax, z[prev.numChannels-1]);
+						}
+					}
+					level.data.push_back(zMin);
+					level.data.push_back(zMax);
+				}
+			}
+			m_images.push_back(level);
+		}
+
+		std::vector<SqImage> m_images;
+		mutable std::vector<TqInt> m_tileReads;
+};
+
+// Map with depth 2 in columns [0,32) and depth 4 in columns [32,64).
+boost::shared_ptr<CqFakeShadowFile> createSteppedFile(bool depthRange = false)
+{
+	std::vector<TqFloat> depths(mapSize*mapSize);
+	for(TqInt y = 0; y < mapSize; ++y)
+		for(TqInt x = 0; x < mapSize; ++x)
+			depths[y*mapSize + x] = x < 32 ? 2 : 4;
+	return boost::shared_ptr<CqFakeShadowFile>(
+			new CqFakeShadowFile(depths, depthRange));
+}
+
+boost::shared_ptr<CqShadowSampler> createSampler(
+		const boost::shared_ptr<CqFakeShadowFile>& file)
+{
+	return boost::shared_ptr<CqShadowSampler>(new CqShadowSampler(file, CqMatrix()));
+}
+
+// Point projecting onto the center of map pixel (x,y) at light depth z.
+CqVector3D pixelPoint(TqFloat x, TqFloat y, TqFloat z)
+{
+	return CqVector3D(2*(x + 0.5f)/mapSize - 1, 1 - 2*(y + 0.5f)/mapSize, z);
+}
+
+// Square sample region centered on map pixel (x,y), at light depth z.
+Sq3DSampleQuad pixelQuad(TqFloat x, TqFloat y, TqFloat halfWidth, TqFloat z)
+{
+	return Sq3DSampleQuad(pixelPoint(x - halfWidth, y - halfWidth, z),
+			pixelPoint(x + halfWidth, y - halfWidth, z),
+			pixelPoint(x - halfWidth, y + halfWidth, z),
+			pixelPoint(x + halfWidth, y + halfWidth, z));
+}
+
+CqShadowSampleOptions deterministicOptions()
+{
+	CqShadowSampleOptions opts;
+	// Negative sample counts select deterministic filtering, so results with
+	// and without culling can be compared exactly.
+	opts.setNumSamples(-1);
+	return opts;
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(CqShadowSampler_depthBehindSurface_test)
+{
+	boost::shared_ptr<CqShadowSampler> sampler = createSampler(createSteppedFile());
+	TqFloat depth = -1;
+
+	// In front of the surface the old depth map lookups gave zero, since
+	// only occluded samples contributed to the depth.
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(1,2,1), depth));
+	BOOST_CHECK_EQUAL(depth, 0);
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(40,2,3), depth));
+	BOOST_CHECK_EQUAL(depth, 0);
+
+	// Wholly behind the surface.
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(1,2,3), depth));
+	BOOST_CHECK_CLOSE(depth, 1.0f, 1e-4);
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(50,60,4.5), depth));
+	BOOST_CHECK_CLOSE(depth, 0.5f, 1e-4);
+
+	// Next to the step, only the nearer pixels occlude the point.
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(32,2,3), depth));
+	BOOST_CHECK_CLOSE(depth, 1.0f, 1e-4);
+	BOOST_REQUIRE(sampler->depthBehindSurface(pixelPoint(31,2,5), depth));
+	BOOST_CHECK_CLOSE(depth, (6*3.0f + 3*1.0f)/9, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(CqShadowSampler_depthBehindSurface_outside_test)
+{
+	boost::shared_ptr<CqShadowSampler> sampler = createSampler(createSteppedFile());
+	// Points behind the light or off the map leave the depth untouched.
+	TqFloat depth = -1;
+	BOOST_CHECK(!sampler->depthBehindSurface(pixelPoint(1,2,-3), depth));
+	BOOST_CHECK(!sampler->depthBehindSurface(pixelPoint(-1,2,3), depth));
+	BOOST_CHECK(!sampler->depthBehindSurface(pixelPoint(1,mapSize,3), depth));
+	BOOST_CHECK_EQUAL(depth, -1);
+}
+
+BOOST_AUTO_TEST_CASE(CqShadowSampler_cull_test)
+{
+	// Regions lying wholly in front of or behind the map depths are resolved
+	// from the depth pyramid, without reading the map itself.
+	boost::shared_ptr<CqFakeShadowFile> file = createSteppedFile(true);
+	boost::shared_ptr<CqShadowSampler> sampler = createSampler(file);
+	CqShadowSampleOptions opts = deterministicOptions();
+	TqFloat occl = -1;
+	sampler->sample(pixelQuad(12, 30, 3, 1), opts, &occl);
+	BOOST_CHECK_EQUAL(occl, 0);
+	sampler->sample(pixelQuad(12, 30, 3, 3), opts, &occl);
+	BOOST_CHECK_EQUAL(occl, 1);
+	sampler->sample(pixelQuad(48, 10, 5, 4.5), opts, &occl);
+	BOOST_CHECK_EQUAL(occl, 1);
+	BOOST_CHECK_EQUAL(file->tileReads(0), 0);
+	TqInt rangeReads = 0;
+	for(TqInt i = 1; i < file->numSubImages(); ++i)
+		rangeReads += file->tileReads(i);
+	BOOST_CHECK(rangeReads > 0);
+
+	// The bias is allowed for when culling.
+	opts.setBias(2);
+	sampler->sample(pixelQuad(12, 30, 3, 3), opts, &occl);
+	BOOST_CHECK_EQUAL(occl, 0);
+	BOOST_CHECK_EQUAL(file->tileReads(0), 0);
+
+	// A region straddling the step must be filtered from the map.
+	opts.setBias(0);
+	sampler->sample(pixelQuad(32, 30, 3, 3), opts, &occl);
+	BOOST_CHECK(occl > 0 && occl < 1);
+	BOOST_CHECK(file->tileReads(0) > 0);
+}
+
+BOOST_AUTO_TEST_CASE(CqShadowSampler_cull_matches_pcf_test)
+{
+	// Culling must give the same results as full percentage closer
+	// filtering, for regions of all sizes over the map.
+	boost::shared_ptr<CqShadowSampler> culled = createSampler(createSteppedFile(true));
+	boost::shared_ptr<CqShadowSampler> unculled = createSampler(createSteppedFile(false));
+	CqShadowSampleOptions opts = deterministicOptions();
+	const TqFloat depths[] = {1, 3, 5};
+	const TqFloat halfWidths[] = {0.5, 2, 4.5, 9};
+	for(TqInt d = 0; d < 3; ++d)
+	{
+		for(TqInt w = 0; w < 4; ++w)
+		{
+			for(TqFloat x = 2; x < mapSize; x += 7)
+			{
+				Sq3DSampleQuad quad = pixelQuad(x, 20.5, halfWidths[w], depths[d]);
+				TqFloat culledOccl = -1;
+				TqFloat unculledOccl = -1;
+				culled->sample(quad, opts, &culledOccl);
+				unculled->sample(quad, opts, &unculledOccl);
+				BOOST_CHECK_SMALL(culledOccl - unculledOccl, 1e-5f);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
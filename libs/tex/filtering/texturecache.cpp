@@ -37,6 +37,8 @@
 
 #include "texturecache.h"
 
+#include <boost/bind.hpp>
+
 #include <aqsis/util/exception.h>
 #include <aqsis/util/file.h>
 #include <aqsis/tex/filtering/ienvironmentsampler.h>
@@ -124,55 +126,46 @@ void CqTextureCache::setCurrToWorldMatrix(const CqMatrix& currToWorld)
 //--------------------------------------------------
 // Private methods
 template<typename SamplerT>
-SamplerT& CqTextureCache::findSampler(
-		std::map<TqUlong, boost::shared_ptr<SamplerT> >& samplerMap,
+SamplerT& CqTextureCache::findSampler(CqConcurrentHashCache<SamplerT>& samplerMap,
 		const char* name)
 {
-	TqUlong hash = CqString::hash(name);
-	typename std::map<TqUlong, boost::shared_ptr<SamplerT> >::const_iterator
-		texIter = samplerMap.find(hash);
-	if(texIter != samplerMap.end())
+	// The sampler is owned by the map, which is only cleared by flush(), so
+	// it's safe to return a reference.
+	return *samplerMap.find(CqString::hash(name),
+			boost::bind(&CqTextureCache::newSampler<SamplerT>, this, name));
+}
+
+template<typename SamplerT>
+boost::shared_ptr<SamplerT> CqTextureCache::newSampler(const char* name)
+{
+	try
 	{
-		// The desired texture sampler is already created - return it.
-		return *(texIter->second);
+		// Find the file in the current file cache.
+		return newSamplerFromFile<SamplerT>(getTextureFile(name));
 	}
-	else
+	catch(XqInvalidFile& e)
 	{
-		// Couldn't find in the currently open texture samplers - create a new
-		// instance.
-		boost::shared_ptr<SamplerT> newTex;
-		try
-		{
-			// Find the file in the current file cache.
-			newTex = newSamplerFromFile<SamplerT>(getTextureFile(name));
-		}
-		catch(XqInvalidFile& e)
-		{
-			Aqsis::log() << error
-				<< "Invalid texture file - " << e.what() << "\n";
-			newTex = SamplerT::createDummy();
-		}
-		catch(XqBadTexture& e)
-		{
-			Aqsis::log() << error
-				<< "Bad texture file - " << e.what() << "\n";
-			newTex = SamplerT::createDummy();
-		}
-		samplerMap[CqString::hash(name)] = newTex;
-		return *newTex;
+		Aqsis::log() << error
+			<< "Invalid texture file - " << e.what() << "\n";
 	}
+	catch(XqBadTexture& e)
+	{
+		Aqsis::log() << error
+			<< "Bad texture file - " << e.what() << "\n";
+	}
+	return SamplerT::createDummy();
 }
 
 boost::shared_ptr<IqTiledTexInputFile> CqTextureCache::getTextureFile(
 		const char* name)
 {
-	TqUlong hash = CqString::hash(name);
-	std::map<TqUlong, boost::shared_ptr<IqTiledTexInputFile> >::const_iterator
-		fileIter = m_texFileCache.find(hash);
-	if(fileIter != m_texFileCache.end())
-		// File exists in the cache; return it.
-		return fileIter->second;
-	// Else try to open the file and store it in the cache before returning it.
+	return m_texFileCache.find(CqString::hash(name),
+			boost::bind(&CqTextureCache::openTextureFile, this, name));
+}
+
+boost::shared_ptr<IqTiledTexInputFile> CqTextureCache::openTextureFile(
+		const char* name)
+{
 	boostfs::path fullName = findFile(name, m_searchPathCallback());
 	boost::shared_ptr<IqTiledTexInputFile> file;
 	try
@@ -187,7 +180,6 @@ boost::shared_ptr<IqTiledTexInputFile> CqTextureCache::getTextureFile(
 		Aqsis::log() << warning << "Could not open file as a tiled texture: "
 			<< e.what() << ".  Rendering will continue, but may be slower.\n";
 	}
-	m_texFileCache[hash] = file;
 	return file;
 }
 
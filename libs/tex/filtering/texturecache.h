@@ -42,6 +42,8 @@
 
 #include <map>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 
 #include <aqsis/tex/filtering/itexturecache.h>
@@ -56,7 +58,57 @@ class IqEnvironmentSampler;
 class IqTiledTexInputFile;
 class CqTexFileHeader;
 
+//------------------------------------------------------------------------------
+/** \brief A map from string hashes to lazily created objects, safe for
+ * concurrent use.
+ *
+ * The map is split into shards by hash, each with its own mutex, so lookups
+ * from different threads rarely contend.  Each entry also has its own mutex
+ * which is held while the value is created, so that a value is only created
+ * once, and slow creation (eg, opening a file) doesn't block lookups of other
+ * entries in the same shard.
+ */
+template<typename ValueT>
+class CqConcurrentHashCache : boost::noncopyable
+{
+	public:
+		/** \brief Find the value for a key, creating it if necessary.
+		 *
+		 * \param key - hash of the value name
+		 * \param create - functor returning a boost::shared_ptr<ValueT> for
+		 *                 the new value; any exception it throws is passed on
+		 *                 to the caller and the value is left uncreated.
+		 */
+		template<typename CreatorT>
+		boost::shared_ptr<ValueT> find(TqUlong key, const CreatorT& create);
+		/// Remove all values.  Must not be called concurrently with find().
+		void clear();
+
+	private:
+		/// A value, along with the mutex protecting its creation.
+		struct SqEntry
+		{
+			boost::mutex mutex;
+			boost::shared_ptr<ValueT> value;
+		};
+		typedef std::map<TqUlong, boost::shared_ptr<SqEntry> > TqEntryMap;
+		struct SqShard
+		{
+			boost::mutex mutex;
+			TqEntryMap entries;
+		};
+
+		static const TqInt m_numShards = 16;
+		SqShard m_shards[m_numShards];
+};
+
+
+//------------------------------------------------------------------------------
 /** \brief A cache managing the various types of texture samplers.
+ *
+ * Samplers and files may be looked up concurrently from several threads.
+ * flush() and setCurrToWorldMatrix() should only be called when no other
+ * thread is using the cache.
  */
 #ifdef AQSIS_SYSTEM_WIN32
 class AQSIS_TEX_SHARE boost::noncopyable_::noncopyable;
@@ -83,15 +135,19 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 	private:
 		/** \brief Find a sampler in the given map, or create one from file if needed.
 		 *
-		 * If the file isn't found, we issue a warning, and a dummy sampler
-		 * should be created instead so that the render can continue.
-		 *
-		 * \param samplerMap - std::map to find the sampler in.
+		 * \param samplerMap - map to find the sampler in.
 		 * \param name - name of the texture.
 		 */
 		template<typename SamplerT>
-		SamplerT& findSampler(std::map<TqUlong, boost::shared_ptr<SamplerT> >&
-				samplerMap, const char* name);
+		SamplerT& findSampler(CqConcurrentHashCache<SamplerT>& samplerMap,
+				const char* name);
+		/** \brief Create a sampler for the named texture.
+		 *
+		 * If the file isn't found, we issue a warning, and a dummy sampler
+		 * is created instead so that the render can continue.
+		 */
+		template<typename SamplerT>
+		boost::shared_ptr<SamplerT> newSampler(const char* name);
 		/** \brief Retrive a texture file from the cache, or open it from file.
 		 *
 		 * First search for the given file name in the cache.  If it's not
@@ -101,6 +157,8 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		 * \param name - file name to open.
 		 */
 		boost::shared_ptr<IqTiledTexInputFile> getTextureFile(const char* name);
+		/// Open a texture file from disk.
+		boost::shared_ptr<IqTiledTexInputFile> openTextureFile(const char* name);
 		/** \brief Create a sampler of the given type from a file.
 		 *
 		 * SamplerT - is a sampler type to instantiate.
@@ -112,12 +170,12 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 				const boost::shared_ptr<IqTiledTexInputFile>& file);
 
 		/// Cached textures live in here
-		std::map<TqUlong, boost::shared_ptr<IqTextureSampler> > m_textureCache;
-		std::map<TqUlong, boost::shared_ptr<IqEnvironmentSampler> > m_environmentCache;
-		std::map<TqUlong, boost::shared_ptr<IqShadowSampler> > m_shadowCache;
-		std::map<TqUlong, boost::shared_ptr<IqOcclusionSampler> > m_occlusionCache;
+		CqConcurrentHashCache<IqTextureSampler> m_textureCache;
+		CqConcurrentHashCache<IqEnvironmentSampler> m_environmentCache;
+		CqConcurrentHashCache<IqShadowSampler> m_shadowCache;
+		CqConcurrentHashCache<IqOcclusionSampler> m_occlusionCache;
 		/// Cached texture files live in here:
-		std::map<TqUlong, boost::shared_ptr<IqTiledTexInputFile> > m_texFileCache;
+		CqConcurrentHashCache<IqTiledTexInputFile> m_texFileCache;
 		/// Camera -> world transformation - used for creating shadow maps.
 		CqMatrix m_currToWorld;
 		/// Callback function to obtain the current texture search path.
@@ -125,6 +183,37 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 };
 
 
+//==============================================================================
+// Implementation details
+//==============================================================================
+template<typename ValueT>
+template<typename CreatorT>
+boost::shared_ptr<ValueT> CqConcurrentHashCache<ValueT>::find(TqUlong key,
+		const CreatorT& create)
+{
+	boost::shared_ptr<SqEntry> entry;
+	{
+		SqShard& shard = m_shards[key % m_numShards];
+		boost::mutex::scoped_lock lock(shard.mutex);
+		boost::shared_ptr<SqEntry>& entryRef = shard.entries[key];
+		if(!entryRef)
+			entryRef.reset(new SqEntry());
+		entry = entryRef;
+	}
+	boost::mutex::scoped_lock lock(entry->mutex);
+	if(!entry->value)
+		entry->value = create();
+	return entry->value;
+}
+
+template<typename ValueT>
+void CqConcurrentHashCache<ValueT>::clear()
+{
+	for(TqInt i = 0; i < m_numShards; ++i)
+		m_shards[i].entries.clear();
+}
+
+
 } // namespace Aqsis
 
 #endif // TEXTURECACHE_H_INCLUDED
@@ -40,9 +40,12 @@
 
 #include <aqsis/aqsis.h>
 
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 
 #include "ewafilter.h"
+#include <aqsis/tex/buffers/tileprefetcher.h>
 #include <aqsis/tex/filtering/itexturesampler.h>
 #include "mipmap.h"
 
@@ -65,8 +68,17 @@ class AQSIS_TEX_SHARE CqTextureSampler : public IqTextureSampler
 		// from IqTextureSampler
 		virtual void sample(const SqSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleBatch(const SqSamplePllgram* regions,
+				TqInt numRegions, const CqTextureSampleOptions& sampleOpts,
+				TqFloat* outSamps) const;
+		virtual void prefetch(const SqSamplePllgram* regions, TqInt numRegions,
+				const CqTextureSampleOptions& sampleOpts) const;
 		virtual const CqTextureSampleOptions& defaultSampleOptions() const;
 	private:
+		/// Create the EWA filter factory for sampling over a region.
+		CqEwaFilterFactory filterFactory(const SqSamplePllgram& samplePllgram,
+				const CqTextureSampleOptions& sampleOpts) const;
+
 		boost::shared_ptr<LevelCacheT> m_levels;
 };
 
@@ -84,6 +96,45 @@ CqTextureSampler<LevelCacheT>::CqTextureSampler(
 template<typename LevelCacheT>
 void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	// Call through to the mipmap class to do the main filtering work.
+	m_levels->applyFilter(filterFactory(samplePllgram, sampleOpts),
+			sampleOpts, outSamps);
+}
+
+template<typename LevelCacheT>
+void CqTextureSampler<LevelCacheT>::sampleBatch(const SqSamplePllgram* regions,
+		TqInt numRegions, const CqTextureSampleOptions& sampleOpts,
+		TqFloat* outSamps) const
+{
+	std::vector<CqEwaFilterFactory> factories;
+	factories.reserve(numRegions);
+	for(TqInt i = 0; i < numRegions; ++i)
+		factories.push_back(filterFactory(regions[i], sampleOpts));
+	if(numRegions > 0)
+		m_levels->applyFilterBatch(&factories[0], numRegions, sampleOpts,
+				outSamps);
+}
+
+template<typename LevelCacheT>
+void CqTextureSampler<LevelCacheT>::prefetch(const SqSamplePllgram* regions,
+		TqInt numRegions, const CqTextureSampleOptions& sampleOpts) const
+{
+	if(!CqTilePrefetcher::instance().enabled())
+		return;
+	typename LevelCacheT::TqLevelSupports supports;
+	for(TqInt i = 0; i < numRegions; ++i)
+	{
+		m_levels->addFilterSupport(filterFactory(regions[i], sampleOpts),
+				sampleOpts, supports);
+	}
+	m_levels->prefetch(supports);
+}
+
+template<typename LevelCacheT>
+CqEwaFilterFactory CqTextureSampler<LevelCacheT>::filterFactory(
+		const SqSamplePllgram& samplePllgram,
+		const CqTextureSampleOptions& sampleOpts) const
 {
 	// Scale width if necessary
 	SqSamplePllgram pllgram(samplePllgram);
@@ -93,12 +144,9 @@ void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 			sampleOpts.tWrapMode() == WrapMode_Periodic);
 
 	// Construct EWA filter factory
-	CqEwaFilterFactory ewaFactory(pllgram, m_levels->width0(), m_levels->height0(),
+	return CqEwaFilterFactory(pllgram, m_levels->width0(), m_levels->height0(),
 			ewaBlurMatrix(sampleOpts.sBlur(), sampleOpts.tBlur()),
 			-sampleOpts.logTruncAmount());
-
-	// Call through to the mipmap class to do the main filtering work.
-	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
 }
 
 template<typename LevelCacheT>
@@ -0,0 +1,141 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/**
+ * \file
+ *
+ * \brief Texture file handle cache implementation.
+ */
+
+#include <aqsis/tex/io/filehandlecache.h>
+
+#include <vector>
+
+#include <aqsis/math/math.h>
+
+namespace Aqsis {
+
+const TqInt CqFileHandleCache::defaultMaxOpenFiles;
+
+CqFileHandleCache::CqFileHandleCache(TqInt maxOpenFiles)
+	: m_mutex(),
+	m_lruList(),
+	m_owners(),
+	m_maxOpenFiles(maxOpenFiles)
+{ }
+
+CqFileHandleCache& CqFileHandleCache::instance()
+{
+	static CqFileHandleCache cache;
+	return cache;
+}
+
+void CqFileHandleCache::setMaxOpenFiles(TqInt maxOpenFiles)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		// At least one file has to be open to read anything.
+		m_maxOpenFiles = max(maxOpenFiles, 1);
+	}
+	closeExcess(0);
+}
+
+TqInt CqFileHandleCache::maxOpenFiles() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_maxOpenFiles;
+}
+
+TqInt CqFileHandleCache::numOpenFiles() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_lruList.size();
+}
+
+void CqFileHandleCache::markUsed(IqFileHandleOwner* owner)
+{
+	bool overLimit = false;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		TqOwnerMap::iterator pos = m_owners.find(owner);
+		if(pos != m_owners.end())
+		{
+			// Move to the front of the list.
+			m_lruList.splice(m_lruList.begin(), m_lruList, pos->second);
+			return;
+		}
+		m_lruList.push_front(owner);
+		m_owners[owner] = m_lruList.begin();
+		overLimit = static_cast<TqInt>(m_owners.size()) > m_maxOpenFiles;
+	}
+	if(overLimit)
+		closeExcess(owner);
+}
+
+void CqFileHandleCache::remove(IqFileHandleOwner* owner)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqOwnerMap::iterator pos = m_owners.find(owner);
+	if(pos != m_owners.end())
+	{
+		m_lruList.erase(pos->second);
+		m_owners.erase(pos);
+	}
+}
+
+void CqFileHandleCache::closeExcess(IqFileHandleOwner* current)
+{
+	// Owners are closed with the lock held: closeHandle() never blocks, and
+	// an owner chosen here can't be removed, destroyed or used again until
+	// it's been closed and the list is consistent again.
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqInt numToClose = static_cast<TqInt>(m_owners.size()) - m_maxOpenFiles;
+	std::vector<TqLruList::iterator> busy;
+	TqLruList::iterator i = m_lruList.end();
+	while(numToClose > 0 && i != m_lruList.begin())
+	{
+		--i;
+		if(*i == current)
+			continue;
+		--numToClose;
+		if((*i)->closeHandle())
+		{
+			m_owners.erase(*i);
+			i = m_lruList.erase(i);
+		}
+		else
+			busy.push_back(i);
+	}
+	// Files in use are obviously not idle; they go back in as recently used.
+	for(TqInt j = 0, end = busy.size(); j < end; ++j)
+		m_lruList.splice(m_lruList.begin(), m_lruList, busy[j]);
+}
+
+} // namespace Aqsis
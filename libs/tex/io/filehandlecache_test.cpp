@@ -0,0 +1,176 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for the texture file handle cache.
+ */
+
+#include <aqsis/tex/io/filehandlecache.h>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+namespace {
+
+// File handle owner recording whether its handle is open.
+class CqFakeFile : public Aqsis::IqFileHandleOwner
+{
+	public:
+		CqFakeFile() : isOpen(false), isBusy(false) {}
+		void use(Aqsis::CqFileHandleCache& cache)
+		{
+			isOpen = true;
+			cache.markUsed(this);
+		}
+		virtual bool closeHandle()
+		{
+			if(isBusy)
+				return false;
+			isOpen = false;
+			return true;
+		}
+		bool isOpen;
+		bool isBusy;
+};
+
+// File handle owner locking its handle like the real texture files.
+class CqLockedFakeFile : public Aqsis::IqFileHandleOwner
+{
+	public:
+		CqLockedFakeFile() : isOpen(false) {}
+		void use(Aqsis::CqFileHandleCache& cache)
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			isOpen = true;
+			cache.markUsed(this);
+		}
+		virtual bool closeHandle()
+		{
+			boost::mutex::scoped_try_lock lock(mutex);
+			if(!lock.owns_lock())
+				return false;
+			isOpen = false;
+			return true;
+		}
+		boost::mutex mutex;
+		bool isOpen;
+};
+
+// Use a few files repeatedly from one thread.
+void useFiles(Aqsis::CqFileHandleCache* cache, CqLockedFakeFile* files, TqInt numFiles)
+{
+	for(TqInt i = 0; i < 2000; ++i)
+		files[i % numFiles].use(*cache);
+}
+
+} // anon namespace
+
+BOOST_AUTO_TEST_SUITE(filehandlecache_tests)
+
+BOOST_AUTO_TEST_CASE(CqFileHandleCache_test_lru_closed)
+{
+	Aqsis::CqFileHandleCache cache(2);
+	CqFakeFile f1, f2, f3;
+	f1.use(cache);
+	f2.use(cache);
+	f1.use(cache);
+	f3.use(cache);
+	// f2 was the least recently used.
+	BOOST_CHECK(f1.isOpen);
+	BOOST_CHECK(!f2.isOpen);
+	BOOST_CHECK(f3.isOpen);
+	BOOST_CHECK_EQUAL(cache.numOpenFiles(), 2);
+	// Reopening f2 should close f1.
+	f2.use(cache);
+	BOOST_CHECK(!f1.isOpen);
+	BOOST_CHECK(f2.isOpen);
+	BOOST_CHECK(f3.isOpen);
+}
+
+BOOST_AUTO_TEST_CASE(CqFileHandleCache_test_busy_kept)
+{
+	Aqsis::CqFileHandleCache cache(2);
+	CqFakeFile f1, f2, f3;
+	f1.use(cache);
+	f2.use(cache);
+	f1.isBusy = true;
+	f3.use(cache);
+	// f1 can't be closed, so stays open along with f3.
+	BOOST_CHECK(f1.isOpen);
+	BOOST_CHECK(f3.isOpen);
+	BOOST_CHECK_EQUAL(cache.numOpenFiles(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(CqFileHandleCache_test_set_max)
+{
+	Aqsis::CqFileHandleCache cache(3);
+	CqFakeFile f1, f2, f3;
+	f1.use(cache);
+	f2.use(cache);
+	f3.use(cache);
+	cache.remove(&f3);
+	cache.setMaxOpenFiles(1);
+	BOOST_CHECK(!f1.isOpen);
+	BOOST_CHECK(f2.isOpen);
+	BOOST_CHECK_EQUAL(cache.numOpenFiles(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(CqFileHandleCache_test_concurrent_use)
+{
+	Aqsis::CqFileHandleCache cache(3);
+	const TqInt numThreads = 4;
+	const TqInt filesPerThread = 3;
+	CqLockedFakeFile files[numThreads*filesPerThread];
+	boost::thread_group threads;
+	for(TqInt i = 0; i < numThreads; ++i)
+	{
+		threads.create_thread(boost::bind(&useFiles, &cache,
+					files + i*filesPerThread, filesPerThread));
+	}
+	threads.join_all();
+	// Every file recorded as open is open, and vice versa.
+	TqInt numOpen = 0;
+	for(TqInt i = 0; i < numThreads*filesPerThread; ++i)
+		numOpen += files[i].isOpen;
+	BOOST_CHECK_EQUAL(cache.numOpenFiles(), numOpen);
+	BOOST_CHECK(numOpen >= 1);
+	for(TqInt i = 0; i < numThreads*filesPerThread; ++i)
+		cache.remove(&files[i]);
+	BOOST_CHECK_EQUAL(cache.numOpenFiles(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
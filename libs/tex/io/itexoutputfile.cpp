@@ -38,6 +38,7 @@
 #include <aqsis/tex/io/itexoutputfile.h>
 
 #include <aqsis/util/exception.h>
+#include "mappedtexfile.h"
 #include "tiffoutputfile.h"
 
 namespace Aqsis {
@@ -60,6 +61,9 @@ boost::shared_ptr<IqMultiTexOutputFile> openMultiOutputFile(
 		case ImageFile_Tiff:
 			return boost::shared_ptr<IqMultiTexOutputFile>(
 					new CqTiffOutputFile(fileName, header));
+		case ImageFile_AqsisTex:
+			return boost::shared_ptr<IqMultiTexOutputFile>(
+					new CqMappedTexOutputFile(fileName, header));
 		// case ...:  // Add new output formats here!
 		default:
 			return boost::shared_ptr<IqMultiTexOutputFile>();
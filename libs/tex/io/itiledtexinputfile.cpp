@@ -38,6 +38,7 @@
 #include <aqsis/tex/io/itiledtexinputfile.h>
 
 #include "magicnumber.h"
+#include "mappedtexfile.h"
 #include "tiledanyinputfile.h"
 #include "tiledtiffinputfile.h"
 #include <aqsis/tex/texexception.h>
@@ -53,6 +54,9 @@ boost::shared_ptr<IqTiledTexInputFile> IqTiledTexInputFile::open(
 		case ImageFile_Tiff:
 			return boost::shared_ptr<IqTiledTexInputFile>(new
 					CqTiledTiffInputFile(fileName));
+		case ImageFile_AqsisTex:
+			return boost::shared_ptr<IqTiledTexInputFile>(new
+					CqMappedTexInputFile(fileName));
 		case ImageFile_Unknown:
 			AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
 				"File \"" << fileName << "\" is not a recognised image type");
@@ -67,6 +71,12 @@ boost::shared_ptr<IqTiledTexInputFile> IqTiledTexInputFile::open(
 	return boost::shared_ptr<IqTiledTexInputFile>();
 }
 
+boost::shared_ptr<const TqUint8> IqTiledTexInputFile::mappedTile(TqInt tileX,
+		TqInt tileY, TqInt subImageIdx) const
+{
+	return boost::shared_ptr<const TqUint8>();
+}
+
 boost::shared_ptr<IqTiledTexInputFile> IqTiledTexInputFile::openAny(
 		const boostfs::path& fileName)
 {
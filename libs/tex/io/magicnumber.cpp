@@ -113,6 +113,11 @@ EqImageFileType guessFileType(std::istream& inStream)
 	{
 		return ImageFile_AqsisZfile;
 	}
+	else if( magicNum.size() >= 8
+		&& std::equal(magicNum.begin(), magicNum.begin()+8, "AQSISTEX") )
+	{
+		return ImageFile_AqsisTex;
+	}
 	// Add further magic number matches here
 	else
 	{
@@ -0,0 +1,618 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Uncompressed tiled texture files read by mapping them into memory.
+ */
+
+#include "mappedtexfile.h"
+
+#include <climits>
+#include <cstring>
+
+#include <aqsis/math/matrix.h>
+#include <aqsis/tex/texexception.h>
+#include <aqsis/util/logging.h>
+#include <aqsis/util/mappedfile.h>
+
+namespace Aqsis {
+
+namespace {
+
+const char mappedTexMagic[8] = {'A','Q','S','I','S','T','E','X'};
+const TqUint32 mappedTexByteOrder = 0x01020304;
+
+/// Tags for the metadata records of a subimage.
+enum EqMappedTexTag
+{
+	MetaTag_Channel = 1,     ///< TqUint32 EqChannelType, then the name.
+	MetaTag_Software,        ///< string
+	MetaTag_HostName,        ///< string
+	MetaTag_Description,     ///< string
+	MetaTag_DateTime,        ///< string
+	MetaTag_WrapModes,       ///< 2 x TqUint32 EqWrapMode
+	MetaTag_TextureFormat,   ///< TqUint32 EqTextureFormat
+	MetaTag_FieldOfViewCot,  ///< TqFloat
+	MetaTag_PixelAspectRatio,///< TqFloat
+	MetaTag_DisplayWindow,   ///< 4 x TqInt32 width, height, topLeftX, topLeftY
+	MetaTag_WorldToScreen,   ///< 16 x TqFloat
+	MetaTag_WorldToCamera    ///< 16 x TqFloat
+};
+
+/** \brief Builder for the metadata records of a subimage.
+ *
+ * Each record is a TqUint32 tag and TqUint32 length, followed by the data
+ * padded to a multiple of four bytes.  Readers skip records with unknown
+ * tags.
+ */
+class CqMetadataWriter
+{
+	public:
+		void add(EqMappedTexTag tag, const void* data, TqUint32 size)
+		{
+			TqUint32 recordHead[2] = {tag, size};
+			append(recordHead, sizeof(recordHead));
+			append(data, size);
+			m_data.resize((m_data.size() + 3) & ~std::size_t(3), 0);
+		}
+		template<typename T>
+		void addValue(EqMappedTexTag tag, const T& value)
+		{
+			add(tag, &value, sizeof(value));
+		}
+		void addString(EqMappedTexTag tag, const std::string& str)
+		{
+			add(tag, str.data(), str.size());
+		}
+		template<typename AttrTagT>
+		void addStringAttr(EqMappedTexTag tag, const CqTexFileHeader& header)
+		{
+			if(const std::string* str = header.findPtr<AttrTagT>())
+				addString(tag, *str);
+		}
+		template<typename AttrTagT>
+		void addMatrixAttr(EqMappedTexTag tag, const CqTexFileHeader& header)
+		{
+			if(const CqMatrix* mat = header.findPtr<AttrTagT>())
+				add(tag, mat->pElements(), 16*sizeof(TqFloat));
+		}
+		const std::vector<char>& data() const
+		{
+			return m_data;
+		}
+	private:
+		void append(const void* data, std::size_t size)
+		{
+			const char* c = static_cast<const char*>(data);
+			m_data.insert(m_data.end(), c, c + size);
+		}
+		std::vector<char> m_data;
+};
+
+/// Encode the attributes of a header which are stored in mapped files.
+std::vector<char> encodeMetadata(const CqTexFileHeader& header)
+{
+	CqMetadataWriter meta;
+	const CqChannelList& channels = header.channelList();
+	for(TqInt i = 0; i < channels.numChannels(); ++i)
+	{
+		std::vector<char> chan(sizeof(TqUint32) + channels[i].name.size());
+		TqUint32 type = channels[i].type;
+		std::memcpy(&chan[0], &type, sizeof(type));
+		std::copy(channels[i].name.begin(), channels[i].name.end(),
+				chan.begin() + sizeof(type));
+		meta.add(MetaTag_Channel, &chan[0], chan.size());
+	}
+	meta.addStringAttr<Attr::Software>(MetaTag_Software, header);
+	meta.addStringAttr<Attr::HostName>(MetaTag_HostName, header);
+	meta.addStringAttr<Attr::Description>(MetaTag_Description, header);
+	meta.addStringAttr<Attr::DateTime>(MetaTag_DateTime, header);
+	if(const SqWrapModes* modes = header.findPtr<Attr::WrapModes>())
+	{
+		TqUint32 m[2] = {modes->sWrap, modes->tWrap};
+		meta.add(MetaTag_WrapModes, m, sizeof(m));
+	}
+	if(const EqTextureFormat* format = header.findPtr<Attr::TextureFormat>())
+		meta.addValue(MetaTag_TextureFormat, TqUint32(*format));
+	if(const TqFloat* cot = header.findPtr<Attr::FieldOfViewCot>())
+		meta.addValue(MetaTag_FieldOfViewCot, *cot);
+	if(const TqFloat* aspect = header.findPtr<Attr::PixelAspectRatio>())
+		meta.addValue(MetaTag_PixelAspectRatio, *aspect);
+	if(const SqImageRegion* window = header.findPtr<Attr::DisplayWindow>())
+	{
+		TqInt32 w[4] = {window->width, window->height, window->topLeftX,
+			window->topLeftY};
+		meta.add(MetaTag_DisplayWindow, w, sizeof(w));
+	}
+	meta.addMatrixAttr<Attr::WorldToScreenMatrix>(MetaTag_WorldToScreen, header);
+	meta.addMatrixAttr<Attr::WorldToCameraMatrix>(MetaTag_WorldToCamera, header);
+	return meta.data();
+}
+
+void throwBadFile(const boostfs::path& fileName, const char* reason)
+{
+	AQSIS_THROW_XQERROR(XqBadTexture, EqE_BadFile, "Mapped texture file \""
+			<< fileName << "\" is invalid: " << reason);
+}
+
+/// Copy a value out of the mapped file, checking that it lies inside it.
+template<typename T>
+T readMapped(const CqMappedFile& file, boost::uint64_t offset,
+		const boostfs::path& fileName)
+{
+	if(offset > file.size() || file.size() - offset < sizeof(T))
+		throwBadFile(fileName, "data lies outside the file");
+	T value;
+	std::memcpy(&value, file.data() + offset, sizeof(T));
+	return value;
+}
+
+/// Decode the metadata records of a subimage into header.
+void decodeMetadata(const char* data, TqUint32 size, CqTexFileHeader& header,
+		const boostfs::path& fileName)
+{
+	const char* end = data + size;
+	while(end - data >= TqInt(2*sizeof(TqUint32)))
+	{
+		TqUint32 recordHead[2];
+		std::memcpy(recordHead, data, sizeof(recordHead));
+		data += sizeof(recordHead);
+		const TqUint32 len = recordHead[1];
+		if(TqUint32(end - data) < len)
+			throwBadFile(fileName, "truncated metadata");
+		const char* value = data;
+		data += (len + 3) & ~TqUint32(3);
+		switch(recordHead[0])
+		{
+			case MetaTag_Channel:
+				if(len >= sizeof(TqUint32))
+				{
+					TqUint32 type = 0;
+					std::memcpy(&type, value, sizeof(type));
+					header.channelList().addChannel(SqChannelInfo(
+						std::string(value + sizeof(type), value + len),
+						static_cast<EqChannelType>(type)));
+				}
+				break;
+			case MetaTag_Software:
+				header.set<Attr::Software>(std::string(value, value + len));
+				break;
+			case MetaTag_HostName:
+				header.set<Attr::HostName>(std::string(value, value + len));
+				break;
+			case MetaTag_Description:
+				header.set<Attr::Description>(std::string(value, value + len));
+				break;
+			case MetaTag_DateTime:
+				header.set<Attr::DateTime>(std::string(value, value + len));
+				break;
+			case MetaTag_WrapModes:
+				if(len == 2*sizeof(TqUint32))
+				{
+					TqUint32 m[2];
+					std::memcpy(m, value, sizeof(m));
+					header.set<Attr::WrapModes>(SqWrapModes(
+						static_cast<EqWrapMode>(m[0]), static_cast<EqWrapMode>(m[1])));
+				}
+				break;
+			case MetaTag_TextureFormat:
+				if(len == sizeof(TqUint32))
+				{
+					TqUint32 format;
+					std::memcpy(&format, value, sizeof(format));
+					header.set<Attr::TextureFormat>(static_cast<EqTextureFormat>(format));
+				}
+				break;
+			case MetaTag_FieldOfViewCot:
+			case MetaTag_PixelAspectRatio:
+				if(len == sizeof(TqFloat))
+				{
+					TqFloat f;
+					std::memcpy(&f, value, sizeof(f));
+					if(recordHead[0] == MetaTag_FieldOfViewCot)
+						header.set<Attr::FieldOfViewCot>(f);
+					else
+						header.set<Attr::PixelAspectRatio>(f);
+				}
+				break;
+			case MetaTag_DisplayWindow:
+				if(len == 4*sizeof(TqInt32))
+				{
+					TqInt32 w[4];
+					std::memcpy(w, value, sizeof(w));
+					header.set<Attr::DisplayWindow>(SqImageRegion(w[0], w[1], w[2], w[3]));
+				}
+				break;
+			case MetaTag_WorldToScreen:
+			case MetaTag_WorldToCamera:
+				if(len == 16*sizeof(TqFloat))
+				{
+					TqFloat m[16];
+					std::memcpy(m, value, sizeof(m));
+					if(recordHead[0] == MetaTag_WorldToScreen)
+						header.set<Attr::WorldToScreenMatrix>(CqMatrix(m));
+					else
+						header.set<Attr::WorldToCameraMatrix>(CqMatrix(m));
+				}
+				break;
+			default:
+				// Skip records from newer writers.
+				break;
+		}
+	}
+}
+
+} // unnamed namespace
+
+
+//------------------------------------------------------------------------------
+// CqMappedTexInputFile implementation
+
+CqMappedTexInputFile::CqMappedTexInputFile(const boostfs::path& fileName)
+	: m_fileName(fileName),
+	m_file(new CqMappedFile(native(fileName))),
+	m_headers(),
+	m_tileInfo(0,0),
+	m_tileOffsets()
+{
+	const CqMappedFile& file = *m_file;
+	SqMappedTexHeader fileHeader
+		= readMapped<SqMappedTexHeader>(file, 0, fileName);
+	if(std::memcmp(fileHeader.magic, mappedTexMagic, sizeof(mappedTexMagic)) != 0)
+		throwBadFile(fileName, "bad magic number");
+	if(fileHeader.byteOrder != mappedTexByteOrder)
+		throwBadFile(fileName, "written on a machine with different byte order");
+	if(fileHeader.version != AQSIS_MAPPED_TEX_VERSION)
+		throwBadFile(fileName, "unsupported version");
+	if(fileHeader.numSubImages == 0 || fileHeader.tileWidth == 0
+			|| fileHeader.tileHeight == 0)
+		throwBadFile(fileName, "no image data");
+	if(fileHeader.tileWidth > TqUint32(INT_MAX)
+			|| fileHeader.tileHeight > TqUint32(INT_MAX))
+		throwBadFile(fileName, "tiles too large");
+	m_tileInfo = SqTileInfo(fileHeader.tileWidth, fileHeader.tileHeight);
+	// Check the sizes of tables against the file before allocating space for
+	// them, since a corrupt file could otherwise ask for huge allocations.
+	if(fileHeader.imagesOffset > file.size()
+			|| (file.size() - fileHeader.imagesOffset)/sizeof(SqMappedTexImage)
+				< fileHeader.numSubImages)
+		throwBadFile(fileName, "data lies outside the file");
+
+	const TqInt numImages = fileHeader.numSubImages;
+	m_headers.reserve(numImages);
+	m_tileOffsets.resize(numImages);
+	for(TqInt i = 0; i < numImages; ++i)
+	{
+		SqMappedTexImage image = readMapped<SqMappedTexImage>(file,
+				fileHeader.imagesOffset + i*sizeof(SqMappedTexImage), fileName);
+		if(image.width == 0 || image.height == 0)
+			throwBadFile(fileName, "empty subimage");
+		if(image.width > TqUint32(INT_MAX) || image.height > TqUint32(INT_MAX))
+			throwBadFile(fileName, "subimage too large");
+		boost::shared_ptr<CqTexFileHeader> header(new CqTexFileHeader());
+		header->setWidth(image.width);
+		header->setHeight(image.height);
+		if(image.metadataOffset > file.size()
+				|| file.size() - image.metadataOffset < image.metadataSize)
+			throwBadFile(fileName, "data lies outside the file");
+		decodeMetadata(file.data() + image.metadataOffset, image.metadataSize,
+				*header, fileName);
+		header->set<Attr::TileInfo>(m_tileInfo);
+		const TqInt bytesPerPixel = header->channelList().bytesPerPixel();
+		if(bytesPerPixel == 0)
+			throwBadFile(fileName, "no channels");
+
+		// Read and check the tile offsets, so that mapped tiles can be used
+		// without further checks.
+		const TqInt widthInTiles = (image.width - 1)/m_tileInfo.width + 1;
+		const TqInt heightInTiles = (image.height - 1)/m_tileInfo.height + 1;
+		const boost::uint64_t numTiles = boost::uint64_t(widthInTiles)*heightInTiles;
+		if(numTiles > TqUint32(INT_MAX))
+			throwBadFile(fileName, "too many tiles");
+		if(image.tileTableOffset > file.size()
+				|| (file.size() - image.tileTableOffset)/sizeof(boost::uint64_t)
+					< numTiles)
+			throwBadFile(fileName, "data lies outside the file");
+		std::vector<boost::uint64_t>& offsets = m_tileOffsets[i];
+		offsets.resize(widthInTiles*heightInTiles);
+		for(TqInt ty = 0; ty < heightInTiles; ++ty)
+		{
+			const TqInt th = min<TqInt>(m_tileInfo.height,
+					image.height - ty*m_tileInfo.height);
+			for(TqInt tx = 0; tx < widthInTiles; ++tx)
+			{
+				const TqInt tw = min<TqInt>(m_tileInfo.width,
+						image.width - tx*m_tileInfo.width);
+				const TqInt idx = ty*widthInTiles + tx;
+				boost::uint64_t offset = readMapped<boost::uint64_t>(file,
+						image.tileTableOffset + idx*sizeof(boost::uint64_t), fileName);
+				const boost::uint64_t tileBytes = boost::uint64_t(tw)*th*bytesPerPixel;
+				if(offset % mappedTexTileAlign != 0)
+					throwBadFile(fileName, "misaligned tile");
+				if(offset > file.size() || file.size() - offset < tileBytes)
+					throwBadFile(fileName, "data lies outside the file");
+				offsets[idx] = offset;
+			}
+		}
+		m_headers.push_back(header);
+	}
+}
+
+boostfs::path CqMappedTexInputFile::fileName() const
+{
+	return m_fileName;
+}
+
+EqImageFileType CqMappedTexInputFile::fileType() const
+{
+	return ImageFile_AqsisTex;
+}
+
+const CqTexFileHeader& CqMappedTexInputFile::header(TqInt index) const
+{
+	if(index >= 0 && index < numSubImages())
+		return *m_headers[index];
+	else
+		return *m_headers[0];
+}
+
+SqTileInfo CqMappedTexInputFile::tileInfo() const
+{
+	return m_tileInfo;
+}
+
+TqInt CqMappedTexInputFile::numSubImages() const
+{
+	return m_headers.size();
+}
+
+TqInt CqMappedTexInputFile::width(TqInt index) const
+{
+	assert(index < numSubImages());
+	return m_headers[index]->width();
+}
+
+TqInt CqMappedTexInputFile::height(TqInt index) const
+{
+	assert(index < numSubImages());
+	return m_headers[index]->height();
+}
+
+const TqUint8* CqMappedTexInputFile::tileData(TqInt tileX, TqInt tileY,
+		TqInt subImageIdx) const
+{
+	const TqInt widthInTiles = (width(subImageIdx) - 1)/m_tileInfo.width + 1;
+	return reinterpret_cast<const TqUint8*>(m_file->data())
+		+ m_tileOffsets[subImageIdx][tileY*widthInTiles + tileX];
+}
+
+boost::shared_ptr<const TqUint8> CqMappedTexInputFile::mappedTile(TqInt tileX,
+		TqInt tileY, TqInt subImageIdx) const
+{
+	// Share ownership with the mapping so that it outlives the tile.
+	return boost::shared_ptr<const TqUint8>(m_file,
+			tileData(tileX, tileY, subImageIdx));
+}
+
+void CqMappedTexInputFile::readTileImpl(TqUint8* buffer, TqInt tileX,
+		TqInt tileY, TqInt subImageIdx, const SqTileInfo tileSize) const
+{
+	std::memcpy(buffer, tileData(tileX, tileY, subImageIdx),
+			std::size_t(tileSize.width)*tileSize.height
+			*m_headers[subImageIdx]->channelList().bytesPerPixel());
+}
+
+
+//------------------------------------------------------------------------------
+// CqMappedTexOutputFile implementation
+
+CqMappedTexOutputFile::CqMappedTexOutputFile(const boostfs::path& fileName,
+		const CqTexFileHeader& header)
+	: m_fileName(fileName),
+	m_out(native(fileName).c_str(), std::ios::out | std::ios::binary),
+	m_header(header),
+	m_tileInfo(header.find<Attr::TileInfo>(SqTileInfo(32,32))),
+	m_currentLine(0),
+	m_lineBuf(),
+	m_bufferedLines(0),
+	m_tileOffsets(),
+	m_images()
+{
+	if(!m_out)
+	{
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_NoFile,
+			"Could not open file \"" << fileName << "\" for writing");
+	}
+	if(m_tileInfo.width <= 0 || m_tileInfo.height <= 0)
+		m_tileInfo = SqTileInfo(32,32);
+	m_header.set<Attr::TileInfo>(m_tileInfo);
+	// Timestamp the file.
+	m_header.setTimestamp();
+	// Leave space for the header, which is written last.
+	SqMappedTexHeader fileHeader;
+	std::memset(&fileHeader, 0, sizeof(fileHeader));
+	m_out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+}
+
+CqMappedTexOutputFile::~CqMappedTexOutputFile()
+{
+	try
+	{
+		finish();
+	}
+	catch(const XqException& e)
+	{
+		Aqsis::log() << error << e.what() << "\n";
+	}
+}
+
+boostfs::path CqMappedTexOutputFile::fileName() const
+{
+	return m_fileName;
+}
+
+EqImageFileType CqMappedTexOutputFile::fileType()
+{
+	return ImageFile_AqsisTex;
+}
+
+const CqTexFileHeader& CqMappedTexOutputFile::header() const
+{
+	return m_header;
+}
+
+TqInt CqMappedTexOutputFile::currentLine() const
+{
+	return m_currentLine;
+}
+
+void CqMappedTexOutputFile::newSubImage(TqInt width, TqInt height)
+{
+	endSubImage();
+	m_header.setWidth(width);
+	m_header.setHeight(height);
+}
+
+void CqMappedTexOutputFile::newSubImage(const CqTexFileHeader& header)
+{
+	endSubImage();
+	m_header = header;
+	m_header.set<Attr::TileInfo>(m_tileInfo);
+}
+
+void CqMappedTexOutputFile::writePixelsImpl(const CqMixedImageBuffer& buffer)
+{
+	const TqInt bytesPerPixel = m_header.channelList().bytesPerPixel();
+	if(buffer.channelList().bytesPerPixel() != bytesPerPixel)
+	{
+		AQSIS_THROW_XQERROR(XqInternal, EqE_Bug, "Cannot put pixels into file \""
+				<< m_fileName << "\": buffer channels don't match the file");
+	}
+	const TqInt rowStride = bytesPerPixel*m_header.width();
+	const TqUint8* src = buffer.rawData();
+	for(TqInt line = 0; line < buffer.height(); ++line, src += rowStride)
+	{
+		m_lineBuf.insert(m_lineBuf.end(), src, src + rowStride);
+		++m_bufferedLines;
+		++m_currentLine;
+		if(m_bufferedLines == m_tileInfo.height || m_currentLine == m_header.height())
+			writeTileRow();
+	}
+}
+
+void CqMappedTexOutputFile::writeTileRow()
+{
+	const TqInt bytesPerPixel = m_header.channelList().bytesPerPixel();
+	const TqInt rowStride = bytesPerPixel*m_header.width();
+	for(TqInt x = 0; x < m_header.width(); x += m_tileInfo.width)
+	{
+		padTo(mappedTexTileAlign);
+		m_tileOffsets.push_back(m_out.tellp());
+		const TqInt tileRowBytes = bytesPerPixel*min(m_tileInfo.width,
+				m_header.width() - x);
+		const char* src = reinterpret_cast<const char*>(&m_lineBuf[0])
+			+ x*bytesPerPixel;
+		for(TqInt line = 0; line < m_bufferedLines; ++line, src += rowStride)
+			m_out.write(src, tileRowBytes);
+	}
+	m_lineBuf.clear();
+	m_bufferedLines = 0;
+}
+
+void CqMappedTexOutputFile::endSubImage()
+{
+	if(m_currentLine != m_header.height())
+	{
+		AQSIS_THROW_XQERROR(XqInternal, EqE_Bug, "Subimage " << m_images.size()
+				<< " of file \"" << m_fileName << "\" is incomplete");
+	}
+	m_images.push_back(SqImageRecord());
+	m_images.back().header = m_header;
+	m_images.back().tileOffsets.swap(m_tileOffsets);
+	m_currentLine = 0;
+}
+
+void CqMappedTexOutputFile::finish()
+{
+	if(!m_out.is_open())
+		return;
+	endSubImage();
+	std::vector<SqMappedTexImage> images(m_images.size());
+	for(TqInt i = 0, end = m_images.size(); i < end; ++i)
+	{
+		const SqImageRecord& record = m_images[i];
+		SqMappedTexImage& image = images[i];
+		std::memset(&image, 0, sizeof(image));
+		image.width = record.header.width();
+		image.height = record.header.height();
+		std::vector<char> metadata = encodeMetadata(record.header);
+		padTo(sizeof(boost::uint64_t));
+		image.metadataOffset = m_out.tellp();
+		image.metadataSize = metadata.size();
+		if(!metadata.empty())
+			m_out.write(&metadata[0], metadata.size());
+		padTo(sizeof(boost::uint64_t));
+		image.tileTableOffset = m_out.tellp();
+		m_out.write(reinterpret_cast<const char*>(&record.tileOffsets[0]),
+				record.tileOffsets.size()*sizeof(boost::uint64_t));
+	}
+	padTo(sizeof(boost::uint64_t));
+	SqMappedTexHeader fileHeader;
+	std::memset(&fileHeader, 0, sizeof(fileHeader));
+	std::memcpy(fileHeader.magic, mappedTexMagic, sizeof(mappedTexMagic));
+	fileHeader.version = AQSIS_MAPPED_TEX_VERSION;
+	fileHeader.byteOrder = mappedTexByteOrder;
+	fileHeader.numSubImages = images.size();
+	fileHeader.tileWidth = m_tileInfo.width;
+	fileHeader.tileHeight = m_tileInfo.height;
+	fileHeader.imagesOffset = m_out.tellp();
+	m_out.write(reinterpret_cast<const char*>(&images[0]),
+			images.size()*sizeof(SqMappedTexImage));
+	m_out.seekp(0);
+	m_out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	m_out.close();
+	if(m_out.fail())
+	{
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_System,
+			"Could not write file \"" << m_fileName << "\"");
+	}
+}
+
+void CqMappedTexOutputFile::padTo(TqInt alignment)
+{
+	std::streamoff pos = m_out.tellp();
+	std::streamoff padding = (alignment - pos % alignment) % alignment;
+	static const char zeros[mappedTexTileAlign] = {0};
+	assert(padding <= mappedTexTileAlign);
+	m_out.write(zeros, padding);
+}
+
+} // namespace Aqsis
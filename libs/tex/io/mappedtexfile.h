@@ -0,0 +1,235 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Uncompressed tiled texture files which are read by mapping them
+ * into memory.
+ *
+ * The layout of a mapped texture file is
+ *
+ * \verbatim
+ *   SqMappedTexHeader   header
+ *   ...                 tiles, each starting on a mappedTexTileAlign boundary
+ *   ...                 metadata and tile offset tables for each subimage
+ *   SqMappedTexImage    images[header.numSubImages]
+ * \endverbatim
+ *
+ * Each tile holds the pixels of the tile in scanline order with interleaved
+ * channels, exactly as returned by IqTiledTexInputFile::readTile().  Tiles
+ * on the right and bottom edges of an image are truncated to the image
+ * rather than padded, so that every tile may be used in place.  All values
+ * are stored in the byte order of the machine which wrote the file; files
+ * with a different byte order are rejected.
+ */
+
+#ifndef MAPPEDTEXFILE_H_INCLUDED
+#define MAPPEDTEXFILE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <fstream>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/tex/io/itexoutputfile.h>
+#include <aqsis/tex/io/itiledtexinputfile.h>
+
+namespace Aqsis {
+
+class CqMappedFile;
+
+/// Version of the mapped texture container.
+#define AQSIS_MAPPED_TEX_VERSION 1
+
+/** \brief Alignment of tiles within a mapped texture file.
+ *
+ * This is a common page size, so tiles don't share pages and each tile is
+ * read from disk only when it's used.
+ */
+const TqInt mappedTexTileAlign = 4096;
+
+/// Header at the start of a mapped texture file.
+struct SqMappedTexHeader
+{
+	/// Always "AQSISTEX".
+	char magic[8];
+	/// AQSIS_MAPPED_TEX_VERSION of the writer.
+	TqUint32 version;
+	/// 0x01020304 in the byte order of the writer.
+	TqUint32 byteOrder;
+	TqUint32 numSubImages;
+	TqUint32 tileWidth;
+	TqUint32 tileHeight;
+	TqUint32 reserved;
+	/// Offset of the SqMappedTexImage array.
+	boost::uint64_t imagesOffset;
+};
+
+/// Description of one subimage of a mapped texture file.
+struct SqMappedTexImage
+{
+	TqUint32 width;
+	TqUint32 height;
+	/// Length of the metadata for the subimage in bytes.
+	TqUint32 metadataSize;
+	TqUint32 reserved;
+	/// Offset of the metadata records for the subimage.
+	boost::uint64_t metadataOffset;
+	/// Offset of the tile offset table (one boost::uint64_t per tile, in
+	/// scanline order).
+	boost::uint64_t tileTableOffset;
+};
+
+//------------------------------------------------------------------------------
+/** \brief Input interface for mapped texture files.
+ *
+ * The whole file is mapped with CqMappedFile when it's opened.  Tiles are
+ * handed out in place by mappedTile(), so reading a tile never copies or
+ * decodes anything, and the pages of the file are shared through the
+ * operating system page cache between all processes using the texture.
+ */
+class AQSIS_TEX_SHARE CqMappedTexInputFile : public IqTiledTexInputFile
+{
+	public:
+		/** \brief Map a texture file and read its headers.
+		 *
+		 * \throw XqInvalidFile if the file can't be opened.
+		 * \throw XqBadTexture if the file isn't a valid mapped texture.
+		 */
+		CqMappedTexInputFile(const boostfs::path& fileName);
+
+		virtual boostfs::path fileName() const;
+		virtual EqImageFileType fileType() const;
+		virtual const CqTexFileHeader& header(TqInt index = 0) const;
+		virtual SqTileInfo tileInfo() const;
+
+		virtual TqInt numSubImages() const;
+		virtual TqInt width(TqInt index) const;
+		virtual TqInt height(TqInt index) const;
+
+		virtual boost::shared_ptr<const TqUint8> mappedTile(TqInt tileX,
+				TqInt tileY, TqInt subImageIdx) const;
+	private:
+		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
+				TqInt subImageIdx, const SqTileInfo tileSize) const;
+
+		/// Location of the tile with the given coordinates.
+		const TqUint8* tileData(TqInt tileX, TqInt tileY, TqInt subImageIdx) const;
+
+		/// Name of the file
+		const boostfs::path m_fileName;
+		/// Mapping of the whole file.
+		boost::shared_ptr<CqMappedFile> m_file;
+		/// Header information for each subimage
+		std::vector<boost::shared_ptr<CqTexFileHeader> > m_headers;
+		/// Tile information
+		SqTileInfo m_tileInfo;
+		/// Offsets of the tiles in each subimage.
+		std::vector<std::vector<boost::uint64_t> > m_tileOffsets;
+};
+
+//------------------------------------------------------------------------------
+/** \brief Output interface for mapped texture files.
+ *
+ * Scanlines are collected until a whole row of tiles is available, and the
+ * tiles are then written out.  The subimage descriptions are written and
+ * the file completed when the output file is destroyed.
+ */
+class AQSIS_TEX_SHARE CqMappedTexOutputFile : public IqMultiTexOutputFile
+{
+	public:
+		/** \brief Create a mapped texture file with the given name.
+		 *
+		 * The tile size is taken from the TileInfo attribute of the header
+		 * if present, and is the same for all subimages.
+		 *
+		 * \throw XqInvalidFile if the file cannot be opened for writing.
+		 *
+		 * \param fileName - name for the new file.
+		 * \param header - header data.
+		 */
+		CqMappedTexOutputFile(const boostfs::path& fileName,
+				const CqTexFileHeader& header);
+		virtual ~CqMappedTexOutputFile();
+
+		// inherited
+		virtual boostfs::path fileName() const;
+		virtual EqImageFileType fileType();
+		virtual const CqTexFileHeader& header() const;
+		virtual TqInt currentLine() const;
+		virtual void newSubImage(TqInt width, TqInt height);
+		virtual void newSubImage(const CqTexFileHeader& header);
+
+	private:
+		// inherited
+		virtual void writePixelsImpl(const CqMixedImageBuffer& buffer);
+
+		/// Write out the tiles for the buffered scanlines.
+		void writeTileRow();
+		/// Check that the current subimage is complete and record it.
+		void endSubImage();
+		/// Write the metadata and subimage table, and fill in the header.
+		void finish();
+		/// Pad the file with zeros up to the next multiple of alignment.
+		void padTo(TqInt alignment);
+
+		/// Data recorded for each finished subimage.
+		struct SqImageRecord
+		{
+			CqTexFileHeader header;
+			std::vector<boost::uint64_t> tileOffsets;
+		};
+
+		/// Name of the file
+		const boostfs::path m_fileName;
+		/// Output stream for the file.
+		std::ofstream m_out;
+		/// Header for the current subimage
+		CqTexFileHeader m_header;
+		/// Tile size for all subimages.
+		SqTileInfo m_tileInfo;
+		/// Scanline at which next output will be written to.
+		TqInt m_currentLine;
+		/// Scanlines which don't yet make up a whole row of tiles.
+		std::vector<TqUint8> m_lineBuf;
+		/// Number of scanlines held in m_lineBuf.
+		TqInt m_bufferedLines;
+		/// Tile offsets of the current subimage.
+		std::vector<boost::uint64_t> m_tileOffsets;
+		/// Finished subimages
+		std::vector<SqImageRecord> m_images;
+};
+
+} // namespace Aqsis
+
+#endif // MAPPEDTEXFILE_H_INCLUDED
@@ -0,0 +1,276 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for mapped texture files.
+ */
+
+#include "mappedtexfile.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <aqsis/tex/buffers/texturebuffer.h>
+#include <aqsis/tex/buffers/tilearray.h>
+#include <aqsis/tex/texexception.h>
+#include "magicnumber.h"
+
+BOOST_AUTO_TEST_SUITE(mappedtexfile_tests)
+using namespace Aqsis;
+
+namespace {
+
+// Fill a buffer with a pattern depending on the position and channel.
+CqTextureBuffer<TqFloat> testImage(TqInt width, TqInt height, TqInt numChans)
+{
+	CqTextureBuffer<TqFloat> buf(width, height, numChans);
+	for(TqInt y = 0; y < height; ++y)
+		for(TqInt x = 0; x < width; ++x)
+			for(TqInt c = 0; c < numChans; ++c)
+				buf.value(x,y)[c] = 1000*y + x + 0.25f*c;
+	return buf;
+}
+
+CqTexFileHeader testHeader(TqInt width, TqInt height)
+{
+	CqTexFileHeader header;
+	header.setWidth(width);
+	header.setHeight(height);
+	header.channelList().addChannel(SqChannelInfo("r", Channel_Float32));
+	header.channelList().addChannel(SqChannelInfo("z", Channel_Float32));
+	header.set<Attr::TileInfo>(SqTileInfo(16,8));
+	header.set<Attr::WrapModes>(SqWrapModes(WrapMode_Periodic, WrapMode_Clamp));
+	header.set<Attr::TextureFormat>(TextureFormat_Shadow);
+	header.set<Attr::WorldToCameraMatrix>(CqMatrix(1,2,3));
+	header.set<Attr::Description>("mapped\ntexture");
+	return header;
+}
+
+// Write two subimages, the first in bands which don't match the tile height.
+void writeTestFile(const char* fileName)
+{
+	CqMappedTexOutputFile out(fileName, testHeader(37, 21));
+	CqTextureBuffer<TqFloat> image = testImage(37, 21, 2);
+	CqTextureBuffer<TqFloat> band(37, 5, 2);
+	for(TqInt y = 0; y < 21; y += 5)
+	{
+		TqInt numLines = std::min(5, 21 - y);
+		band.resize(37, numLines, 2);
+		for(TqInt j = 0; j < numLines; ++j)
+			for(TqInt x = 0; x < 37; ++x)
+				band.setPixel(x, j, image.value(x, y+j));
+		out.writePixels(band);
+	}
+	out.newSubImage(19, 11);
+	out.writePixels(testImage(19, 11, 2));
+}
+
+std::string readFile(const char* fileName)
+{
+	std::ifstream in(fileName, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in),
+			std::istreambuf_iterator<char>());
+}
+
+void writeFile(const char* fileName, const std::string& contents)
+{
+	std::ofstream out(fileName, std::ios::binary);
+	out.write(contents.data(), contents.size());
+}
+
+/** Write a copy of the test file with the first subimage record modified,
+ * and check that opening it is an error.
+ */
+template<typename ModifierT>
+void checkCorruptImage(const ModifierT& modify)
+{
+	writeTestFile("mappedtexfile_test.tex");
+	std::string contents = readFile("mappedtexfile_test.tex");
+	SqMappedTexHeader header;
+	std::memcpy(&header, contents.data(), sizeof(header));
+	SqMappedTexImage image;
+	std::memcpy(&image, contents.data() + header.imagesOffset, sizeof(image));
+	modify(header, image);
+	std::memcpy(&contents[0], &header, sizeof(header));
+	std::memcpy(&contents[header.imagesOffset], &image, sizeof(image));
+	writeFile("mappedtexfile_corrupt_test.tex", contents);
+	BOOST_CHECK_THROW(CqMappedTexInputFile("mappedtexfile_corrupt_test.tex"),
+			XqBadTexture);
+}
+
+struct SqManySubImages
+{
+	void operator()(SqMappedTexHeader& header, SqMappedTexImage& image) const
+	{
+		header.numSubImages = 0xFFFFFFFF;
+	}
+};
+
+struct SqHugeSubImage
+{
+	void operator()(SqMappedTexHeader& header, SqMappedTexImage& image) const
+	{
+		image.width = 0xFFFFFFF0;
+	}
+};
+
+struct SqManyTiles
+{
+	void operator()(SqMappedTexHeader& header, SqMappedTexImage& image) const
+	{
+		// Overflows a 32 bit tile count.
+		image.width = 0x7FFFFFFF;
+		image.height = 0x7FFFFFFF;
+	}
+};
+
+struct SqLargeTileTable
+{
+	void operator()(SqMappedTexHeader& header, SqMappedTexImage& image) const
+	{
+		// Many more tiles than the file has space for.
+		image.width = 16*100000;
+		image.height = 8*1000;
+	}
+};
+
+struct SqTileTableOutside
+{
+	void operator()(SqMappedTexHeader& header, SqMappedTexImage& image) const
+	{
+		image.tileTableOffset = boost::uint64_t(1) << 62;
+	}
+};
+
+} // anon namespace
+
+BOOST_AUTO_TEST_CASE(CqMappedTexFile_roundtrip_test)
+{
+	writeTestFile("mappedtexfile_test.tex");
+	BOOST_CHECK_EQUAL(guessFileType("mappedtexfile_test.tex"), ImageFile_AqsisTex);
+
+	CqMappedTexInputFile in("mappedtexfile_test.tex");
+	BOOST_REQUIRE_EQUAL(in.numSubImages(), 2);
+	BOOST_CHECK_EQUAL(in.width(0), 37);
+	BOOST_CHECK_EQUAL(in.height(0), 21);
+	BOOST_CHECK_EQUAL(in.width(1), 19);
+	BOOST_CHECK_EQUAL(in.height(1), 11);
+	BOOST_CHECK_EQUAL(in.tileInfo().width, 16);
+	BOOST_CHECK_EQUAL(in.tileInfo().height, 8);
+
+	const CqTexFileHeader& header = in.header(1);
+	BOOST_REQUIRE_EQUAL(header.channelList().numChannels(), 2);
+	BOOST_CHECK_EQUAL(header.channelList()[1].name, "z");
+	BOOST_CHECK_EQUAL(header.channelList()[1].type, Channel_Float32);
+	BOOST_CHECK_EQUAL(header.find<Attr::WrapModes>().sWrap, WrapMode_Periodic);
+	BOOST_CHECK_EQUAL(header.find<Attr::WrapModes>().tWrap, WrapMode_Clamp);
+	BOOST_CHECK_EQUAL(header.find<Attr::TextureFormat>(), TextureFormat_Shadow);
+	BOOST_CHECK_EQUAL(header.find<Attr::WorldToCameraMatrix>(), CqMatrix(1,2,3));
+	BOOST_CHECK_EQUAL(header.find<Attr::Description>(), "mapped\ntexture");
+
+	// Check a tile on the bottom right edge of each subimage.
+	for(TqInt i = 0; i < 2; ++i)
+	{
+		CqTextureBuffer<TqFloat> expected = testImage(in.width(i), in.height(i), 2);
+		TqInt tx = (in.width(i)-1)/16;
+		TqInt ty = (in.height(i)-1)/8;
+		CqTextureBuffer<TqFloat> tile;
+		in.readTile(tile, tx, ty, i);
+		BOOST_REQUIRE_EQUAL(tile.width(), in.width(i) - 16*tx);
+		BOOST_REQUIRE_EQUAL(tile.height(), in.height(i) - 8*ty);
+		boost::shared_ptr<const TqUint8> mapped = in.mappedTile(tx, ty, i);
+		BOOST_REQUIRE(mapped);
+		BOOST_CHECK_EQUAL(reinterpret_cast<std::size_t>(mapped.get())
+				% mappedTexTileAlign, 0U);
+		const TqFloat* mappedPix = reinterpret_cast<const TqFloat*>(mapped.get());
+		for(TqInt y = 0; y < tile.height(); ++y)
+		{
+			for(TqInt x = 0; x < tile.width(); ++x)
+			{
+				for(TqInt c = 0; c < 2; ++c)
+				{
+					TqFloat e = expected.value(16*tx + x, 8*ty + y)[c];
+					BOOST_CHECK_EQUAL(tile.value(x,y)[c], e);
+					BOOST_CHECK_EQUAL(mappedPix[(y*tile.width() + x)*2 + c], e);
+				}
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqMappedTexFile_tilearray_test)
+{
+	// Tile arrays use the tiles in place from the mapping.
+	writeTestFile("mappedtexfile_test.tex");
+	boost::shared_ptr<IqTiledTexInputFile> in(
+			new CqMappedTexInputFile("mappedtexfile_test.tex"));
+	for(TqInt i = 0; i < 2; ++i)
+	{
+		CqTileArray<TqFloat> array(in, i);
+		BOOST_REQUIRE_EQUAL(array.numChannels(), 2);
+		CqTextureBuffer<TqFloat> expected = testImage(in->width(i), in->height(i), 2);
+		for(TqInt y = 0; y < in->height(i); ++y)
+		{
+			for(TqInt x = 0; x < in->width(i); ++x)
+			{
+				BOOST_CHECK_EQUAL(array(x,y)[0], expected.value(x,y)[0]);
+				BOOST_CHECK_EQUAL(array(x,y)[1], expected.value(x,y)[1]);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqMappedTexFile_truncated_test)
+{
+	writeTestFile("mappedtexfile_test.tex");
+	std::string contents = readFile("mappedtexfile_test.tex");
+	writeFile("mappedtexfile_truncated_test.tex",
+			contents.substr(0, 3*mappedTexTileAlign));
+	BOOST_CHECK_THROW(CqMappedTexInputFile("mappedtexfile_truncated_test.tex"),
+			XqBadTexture);
+}
+
+BOOST_AUTO_TEST_CASE(CqMappedTexFile_corrupt_sizes_test)
+{
+	// Sizes which would overflow or lead to huge allocations are rejected
+	// before anything is allocated.
+	checkCorruptImage(SqManySubImages());
+	checkCorruptImage(SqHugeSubImage());
+	checkCorruptImage(SqManyTiles());
+	checkCorruptImage(SqLargeTileTable());
+	checkCorruptImage(SqTileTableOutside());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,10 @@
 set(io_srcs
+	filehandlecache.cpp
 	itexinputfile.cpp
 	itexoutputfile.cpp
 	itiledtexinputfile.cpp
 	magicnumber.cpp
+	mappedtexfile.cpp
 	texfileheader.cpp
 	tiffdirhandle.cpp
 	tiffinputfile.cpp
@@ -23,6 +25,7 @@ make_absolute(io_srcs ${io_SOURCE_DIR})
 set(io_hdrs
 	exrinputfile.h
 	magicnumber.h
+	mappedtexfile.h
 	tiffdirhandle.h
 	tifffile_test.h
 	tiffinputfile.h
@@ -36,7 +39,9 @@ make_absolute(io_hdrs ${io_SOURCE_DIR})
 include_directories(${io_SOURCE_DIR})
 
 set(io_test_srcs
+	filehandlecache_test.cpp
 	magicnumber_test.cpp
+	mappedtexfile_test.cpp
 	texfileheader_test.cpp
 	tiffdirhandle_test.cpp
 	tiffinputfile_test.cpp
@@ -64,6 +64,7 @@ const char* cubeEnvTextureFormatStr = "CubeFace Environment";
 const char* latlongEnvTextureFormatStr = "LatLong Environment";
 const char* shadowTextureFormatStr = "Shadow";
 const char* occlusionTextureFormatStr = "Occlusion";
+const char* shadowDepthRangeTextureFormatStr = "Shadow Depth Range";
 
 /// Convert from a string to an EqTextureFormat
 EqTextureFormat texFormatFromString(const std::string& str)
@@ -78,6 +79,8 @@ EqTextureFormat texFormatFromString(const std::string& str)
 		return TextureFormat_Shadow;
 	else if(str == occlusionTextureFormatStr)
 		return TextureFormat_Occlusion;
+	else if(str == shadowDepthRangeTextureFormatStr)
+		return TextureFormat_ShadowDepthRange;
 	return TextureFormat_Unknown;
 }
 
@@ -96,6 +99,8 @@ const char* texFormatToString(EqTextureFormat format)
 			return shadowTextureFormatStr;
 		case TextureFormat_Occlusion:
 			return occlusionTextureFormatStr;
+		case TextureFormat_ShadowDepthRange:
+			return shadowDepthRangeTextureFormatStr;
 		case TextureFormat_Unknown:
 			return "unknown";
 	}
@@ -147,7 +152,8 @@ const char* tiffCompressionNameFromTag(uint16 compressionType)
 //------------------------------------------------------------------------------
 
 CqTiffDirHandle::CqTiffDirHandle(const boost::shared_ptr<CqTiffFileHandle>& fileHandle, const tdir_t dirIdx)
-	: m_fileHandle(fileHandle)
+	: m_fileHandle(fileHandle),
+	m_lock(fileHandle->m_mutex)
 {
 	fileHandle->setDirectory(dirIdx);
 }
@@ -774,6 +780,7 @@ CqTiffFileHandle::CqTiffFileHandle(std::ostream& outputStream)
 
 void CqTiffFileHandle::writeDirectory()
 {
+	boost::mutex::scoped_lock lock(m_mutex);
 	assert(!m_isInputFile);
 	if(!TIFFWriteDirectory(m_tiffPtr.get()))
 		AQSIS_THROW_XQERROR(XqInternal, EqE_BadFile,
@@ -784,6 +791,7 @@ void CqTiffFileHandle::writeDirectory()
 
 tdir_t CqTiffFileHandle::numDirectories()
 {
+	boost::mutex::scoped_lock lock(m_mutex);
 	return TIFFNumberOfDirectories(m_tiffPtr.get());
 }
 
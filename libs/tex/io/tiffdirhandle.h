@@ -43,6 +43,7 @@
 #include <string>
 
 #include <boost/shared_array.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 #include <tiffio.h>
 
@@ -78,13 +79,12 @@ namespace Attr {
  * functions directly on the TIFF* which is accessible with the tiffPtr()
  * function.
  *
- * Warning! at the moment this isn't thread-safe (but it's easy to make it so).
- *
  * Use this to obtain a handle to a specific directory inside a tiff file.  For
- * threading, the underlying tiff file handle will be locked so that only one
+ * threading, the underlying tiff file handle is locked so that only one
  * directory handle can be obtained at any one time.  This means that an
  * instance of this class blocks access to the underlying tiff file until its
- * destructor is called.
+ * destructor is called, so a thread must never hold two handles to the same
+ * file at once.
  */
 #ifdef AQSIS_SYSTEM_WIN32
 class AQSIS_TEX_SHARE boost::noncopyable_::noncopyable;
@@ -237,7 +237,7 @@ class AQSIS_TEX_SHARE CqTiffDirHandle : boost::noncopyable
 
 		//----------------------------------------------------------------------
 		boost::shared_ptr<CqTiffFileHandle> m_fileHandle; ///< underlying file handle
-		/// \todo: multithreading - add a lock here!
+		boost::mutex::scoped_lock m_lock;  ///< lock on the underlying file
 		/// \todo: add a pointer to a TIFFRGBAimage
 };
 
@@ -290,6 +290,9 @@ class AQSIS_TEX_SHARE CqTiffFileHandle : boost::noncopyable
 		void writeDirectory();
 
 		/** \brief Determine the number of directories present for this TIFF file.
+		 *
+		 * This locks the file, so mustn't be called while holding a
+		 * CqTiffDirHandle for it.
 		 */
 		tdir_t numDirectories();
 
@@ -303,7 +306,7 @@ class AQSIS_TEX_SHARE CqTiffFileHandle : boost::noncopyable
 		boost::shared_ptr<TIFF> m_tiffPtr;  ///< underlying TIFF structure
 		bool m_isInputFile;                 ///< true if the file is open for input
 		tdir_t m_currDir;                   ///< current directory index
-		/// \todo: multithreading - add a mutex!
+		boost::mutex m_mutex;               ///< held by CqTiffDirHandle
 };
 
 //------------------------------------------------------------------------------
@@ -43,23 +43,34 @@
 namespace Aqsis {
 
 CqTiledAnyInputFile::CqTiledAnyInputFile(const boostfs::path& fileName)
-	: m_texFile(IqTexInputFile::open(fileName)),
-	m_tileInfo(m_texFile->header().width(), m_texFile->header().height())
-{ }
+	: m_fileName(fileName),
+	m_handleMutex(),
+	m_texFile(IqTexInputFile::open(fileName)),
+	m_fileType(m_texFile->fileType()),
+	m_header(m_texFile->header()),
+	m_tileInfo(m_header.width(), m_header.height())
+{
+	CqFileHandleCache::instance().markUsed(this);
+}
+
+CqTiledAnyInputFile::~CqTiledAnyInputFile()
+{
+	CqFileHandleCache::instance().remove(this);
+}
 
 boostfs::path CqTiledAnyInputFile::fileName() const
 {
-	return m_texFile->fileName();
+	return m_fileName;
 }
 
 EqImageFileType CqTiledAnyInputFile::fileType() const
 {
-	return m_texFile->fileType();
+	return m_fileType;
 }
 
 const CqTexFileHeader& CqTiledAnyInputFile::header(TqInt index) const
 {
-	return m_texFile->header();
+	return m_header;
 }
 
 SqTileInfo CqTiledAnyInputFile::tileInfo() const
@@ -91,8 +102,21 @@ void CqTiledAnyInputFile::readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY
 	assert(tileY == 0);
 	assert(m_tileInfo.width == tileSize.width);
 	assert(m_tileInfo.height == tileSize.height);
+	boost::mutex::scoped_lock lock(m_handleMutex);
+	if(!m_texFile)
+		m_texFile = IqTexInputFile::open(m_fileName);
+	CqFileHandleCache::instance().markUsed(const_cast<CqTiledAnyInputFile*>(this));
 	m_texFile->readPixelsImpl(buffer, 0, tileSize.height);
 }
 
+bool CqTiledAnyInputFile::closeHandle()
+{
+	boost::mutex::scoped_try_lock lock(m_handleMutex);
+	if(!lock.owns_lock())
+		return false;
+	m_texFile.reset();
+	return true;
+}
+
 } // namespace Aqsis
 
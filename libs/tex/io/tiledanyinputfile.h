@@ -41,8 +41,11 @@
 #include <aqsis/aqsis.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
+#include <aqsis/tex/io/filehandlecache.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
+#include <aqsis/tex/io/texfileheader.h>
 
 namespace Aqsis {
 
@@ -56,8 +59,13 @@ class IqTexInputFile;
  * memory usage.  However, we will warn when using the interface and if the
  * user persists in not correctly mipmapping their files then they probably
  * deserve what they get ;-)
+ *
+ * The underlying file is registered with CqFileHandleCache, which may close it
+ * when too many files are open.  It's reopened transparently when the tile is
+ * next read, and the header is kept so that metadata never requires the file.
  */
-class AQSIS_TEX_SHARE CqTiledAnyInputFile : public IqTiledTexInputFile
+class AQSIS_TEX_SHARE CqTiledAnyInputFile : public IqTiledTexInputFile,
+	public IqFileHandleOwner
 {
 	public:
 		/** \brief Open any texture file and interpret as a tiled file.
@@ -66,6 +74,7 @@ class AQSIS_TEX_SHARE CqTiledAnyInputFile : public IqTiledTexInputFile
 		 * same ways.
 		 */
 		CqTiledAnyInputFile(const boostfs::path& fileName);
+		virtual ~CqTiledAnyInputFile();
 
 		virtual boostfs::path fileName() const;
 		virtual EqImageFileType fileType() const;
@@ -75,12 +84,22 @@ class AQSIS_TEX_SHARE CqTiledAnyInputFile : public IqTiledTexInputFile
 		virtual TqInt numSubImages() const;
 		virtual TqInt width(TqInt index) const;
 		virtual TqInt height(TqInt index) const;
+
+		virtual bool closeHandle();
 	private:
 		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx, const SqTileInfo tileSize) const;
 
-		/// Underlying input file which does the real work.
-		boost::shared_ptr<IqTexInputFile> m_texFile;
+		/// Name of the file, for reopening.
+		const boostfs::path m_fileName;
+		/// Protects m_texFile from being closed while in use.
+		mutable boost::mutex m_handleMutex;
+		/// Underlying input file which does the real work; null when closed.
+		mutable boost::shared_ptr<IqTexInputFile> m_texFile;
+		/// Type of the underlying file.
+		EqImageFileType m_fileType;
+		/// Copy of the file header, valid when the file is closed.
+		CqTexFileHeader m_header;
 		/// Tile information
 		SqTileInfo m_tileInfo;
 };
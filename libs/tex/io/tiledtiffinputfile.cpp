@@ -45,6 +45,8 @@ namespace Aqsis {
 
 CqTiledTiffInputFile::CqTiledTiffInputFile(const boostfs::path& fileName)
 	: m_headers(),
+	m_fileName(fileName),
+	m_handleMutex(),
 	m_fileHandle(new CqTiffFileHandle(fileName, "r")),
 	m_numDirs(m_fileHandle->numDirectories()),
 	m_tileInfo(0,0),
@@ -99,11 +101,17 @@ CqTiledTiffInputFile::CqTiledTiffInputFile(const boostfs::path& fileName)
 		// interface a bit.
 		m_headers.push_back(tmpHeader);
 	}
+	CqFileHandleCache::instance().markUsed(this);
+}
+
+CqTiledTiffInputFile::~CqTiledTiffInputFile()
+{
+	CqFileHandleCache::instance().remove(this);
 }
 
 boostfs::path CqTiledTiffInputFile::fileName() const
 {
-	return m_fileHandle->fileName();
+	return m_fileName;
 }
 
 EqImageFileType CqTiledTiffInputFile::fileType() const
@@ -141,9 +149,22 @@ TqInt CqTiledTiffInputFile::height(TqInt index) const
 	return m_heights[index];
 }
 
+bool CqTiledTiffInputFile::closeHandle()
+{
+	boost::mutex::scoped_try_lock lock(m_handleMutex);
+	if(!lock.owns_lock())
+		return false;
+	m_fileHandle.reset();
+	return true;
+}
+
 void CqTiledTiffInputFile::readTileImpl(TqUint8* buffer, TqInt x, TqInt y,
 		TqInt subImageIdx, const SqTileInfo tileSize) const
 {
+	boost::mutex::scoped_lock lock(m_handleMutex);
+	if(!m_fileHandle)
+		m_fileHandle.reset(new CqTiffFileHandle(m_fileName, "r"));
+	CqFileHandleCache::instance().markUsed(const_cast<CqTiledTiffInputFile*>(this));
 	CqTiffDirHandle dirHandle(m_fileHandle, subImageIdx);
 	if((x+1)*m_tileInfo.width > m_widths[subImageIdx]
 			|| (y+1)*m_tileInfo.height > m_heights[subImageIdx])
@@ -42,6 +42,9 @@
 
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
+#include <aqsis/tex/io/filehandlecache.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include "tiffdirhandle.h"
 
@@ -59,8 +62,13 @@ namespace Aqsis {
  *   - The pixel format is directly addressable (8, 16, 32 bits per channel)
  *   - Pixel channels are stored interleaved rather than "planar"
  *   - Probably misc. other restrictions (see tiffdirhandle.cpp)
+ *
+ * The underlying TIFF handle is registered with CqFileHandleCache, which may
+ * close it when too many files are open; it's reopened on the next tile read.
+ * The headers are read up front, so metadata never requires the file.
  */
-class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
+class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile,
+	public IqFileHandleOwner
 {
 	public:
 		/** \brief Open a tiled TIFF file and setup the input interface.
@@ -69,6 +77,7 @@ class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 		 * assumptions.
 		 */
 		CqTiledTiffInputFile(const boostfs::path& fileName);
+		virtual ~CqTiledTiffInputFile();
 
 		virtual boostfs::path fileName() const;
 		virtual EqImageFileType fileType() const;
@@ -78,14 +87,20 @@ class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 		virtual TqInt numSubImages() const;
 		virtual TqInt width(TqInt index) const;
 		virtual TqInt height(TqInt index) const;
+
+		virtual bool closeHandle();
 	private:
 		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx, const SqTileInfo tileSize) const;
 
 		/// Header information
 		std::vector<boost::shared_ptr<CqTexFileHeader> > m_headers;
-		/// Handle to the underlying TIFF structure.
-		boost::shared_ptr<CqTiffFileHandle> m_fileHandle;
+		/// Name of the file, for reopening.
+		const boostfs::path m_fileName;
+		/// Protects m_fileHandle from being closed while in use.
+		mutable boost::mutex m_handleMutex;
+		/// Handle to the underlying TIFF structure; null when closed.
+		mutable boost::shared_ptr<CqTiffFileHandle> m_fileHandle;
 		/// Number of directories in the TIFF file.
 		tdir_t m_numDirs;
 		/// Tile information
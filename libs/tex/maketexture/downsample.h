@@ -40,64 +40,305 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define AQSIS_SIMD_SSE2
+#	include <emmintrin.h>
+#endif
+
 #include <aqsis/math/math.h>
 #include "cachedfilter.h"
-#include <aqsis/tex/filtering/sampleaccum.h>
-#include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/buffers/texturebuffer.h>
 #include <aqsis/tex/filtering/wrapmode.h>
+#include <aqsis/tex/texexception.h>
+#include <aqsis/util/threadpool.h>
 
 namespace Aqsis
 {
 
 //------------------------------------------------------------------------------
-/** \brief Input iterator for creating a sequence of downsampled images for
- * mipmapping.
+/** \brief Cached filter kernel applied to rows of interleaved float pixels.
+ *
+ * The weights of a CqCachedFilter are expanded so that there's one weight for
+ * each channel of each pixel.  A row of the kernel then covers a contiguous
+ * span of interleaved source data, and the inner filtering loop can work on
+ * four floats at a time with SSE.
+ */
+class CqDownsampleKernel
+{
+	public:
+		/// Number of floats of slack which source rows need after their end.
+		static const TqInt rowSlack = 3;
+
+		/** \brief Expand the weights of the given filter.
+		 *
+		 * \param filter - filter weights; the top left of the support is
+		 *                 ignored.
+		 * \param numChannels - number of channels per pixel.
+		 */
+		CqDownsampleKernel(const CqCachedFilter& filter, TqInt numChannels);
+
+		/// Number of pixels in the x-direction of the kernel.
+		TqInt width() const;
+		/// Number of pixels in the y-direction of the kernel.
+		TqInt height() const;
+		/// Number of floats of scratch space needed by apply().
+		TqInt spanLength() const;
+
+		/** \brief Filter a single pixel.
+		 *
+		 * \param srcRows - height() pointers to the source rows, each pointing
+		 *                  at the top left pixel of the support in that row.
+		 * \param scratch - spanLength() floats of scratch space.
+		 * \param outPix - filtered channels are placed here.
+		 */
+		void apply(const TqFloat* const* srcRows, TqFloat* scratch,
+				TqFloat* outPix) const;
+
+	private:
+		TqInt m_width;
+		TqInt m_height;
+		TqInt m_numChannels;
+		/// Floats in each kernel row, rounded up to a multiple of four.
+		TqInt m_spanLength;
+		/// Expanded weights, one row of m_spanLength floats per kernel row.
+		std::vector<TqFloat> m_weights;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief A set of rows taken from an image.
  *
- * To create each downsampled image level in the mipmap, downsample() is called
- * on the previous image level to reduce the size by a factor of 2.  The buffer
- * is set to null when the size of the previous buffer reaches 1x1.
+ * The rows may be held in several buffers; this lets the downsampler work
+ * from a window of scanlines while the rest of the image is still in the
+ * source file.
  */
 template<typename ArrayT>
-class CqDownsampleIterator
+class CqRowSource
 {
 	public:
-		/** \brief Construct the null downsampler iterator
+		/// Create a source holding no rows.
+		CqRowSource();
+		/// Create a source holding the rows of buf, starting at startRow.
+		CqRowSource(const ArrayT& buf, TqInt startRow = 0);
+		/// Add the rows of buf, starting at startRow.
+		void addRows(const ArrayT& buf, TqInt startRow);
+		/** \brief Find the buffer holding row y of the image.
 		 *
-		 * The null downsampler iterator is to be used as the "end" iterator in
-		 * the sequence generated from any input image, after the last image of
-		 * dimensions 1x1.
+		 * \param y - row of the image.
+		 * \param localY - return parameter for the row index inside the
+		 *                 returned buffer.
 		 */
-		CqDownsampleIterator();
-		/** \brief Construct a downsampler iterator
+		const ArrayT& find(TqInt y, TqInt& localY) const;
+	private:
+		struct SqRows
+		{
+			const ArrayT* buf;
+			TqInt startRow;
+		};
+		std::vector<SqRows> m_rows;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Filter for reducing one mipmap level to the next.
+ *
+ * Output rows may be computed in any order and in parallel, from whichever
+ * source rows are at hand; sourceRows() tells the caller which ones are
+ * needed.
+ */
+template<typename ArrayT>
+class CqDownsampler
+{
+	public:
+		/** \brief Set up a downsampler for a source image of the given size.
 		 *
-		 * \param buf - source buffer to downsample
 		 * \param filterInfo - information about which filter type and size to use
 		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 * \param srcWidth
+		 * \param srcHeight - dimensions of the source image
+		 * \param numChannels - number of channels in the source image
 		 */
-		CqDownsampleIterator(boost::shared_ptr<ArrayT> buf,
-				const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
-		/** \brief Advance to the next image in the sequence
+		CqDownsampler(const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+				TqInt srcWidth, TqInt srcHeight, TqInt numChannels);
+
+		/// Width of the downsampled image.
+		TqInt width() const;
+		/// Height of the downsampled image.
+		TqInt height() const;
+
+		/** \brief Get the source rows needed for a range of output rows.
 		 *
-		 * The current image is downsampled to obtain the next one.
+		 * Rows reached by wrapping around the image edges are not included.
+		 *
+		 * \param yBegin
+		 * \param yEnd - range [yBegin,yEnd) of output rows
+		 * \param srcBegin
+		 * \param srcEnd - return parameters for the range of source rows.
+		 */
+		void sourceRows(TqInt yBegin, TqInt yEnd, TqInt& srcBegin,
+				TqInt& srcEnd) const;
+		/** \brief Number of rows at the top and bottom of the source which
+		 * may be reached by wrapping around the opposite edge.
 		 */
-		CqDownsampleIterator& operator++();
-		/// Return the current buffer.
-		const boost::shared_ptr<ArrayT>& operator*();
-		/** \brief Test if this iterator is equal to another.
+		TqInt wrapRows() const;
+
+		/** \brief Filter a range of output rows.
 		 *
-		 * Useful for testing the ending condition.  A default-constructed
-		 * CqDownsampleIterator acts as the "end" iterator in a range.
+		 * \param src - source rows covering at least sourceRows(yBegin, yEnd),
+		 *              along with any rows reached by wrapping.
+		 * \param destBuf - destination buffer of width width(), holding the
+		 *                  output rows starting from row destStart.
+		 * \param yBegin
+		 * \param yEnd - range [yBegin,yEnd) of output rows
+		 * \param destStart - output row held in the first row of destBuf.
 		 */
-		bool operator!=(const CqDownsampleIterator<ArrayT>& rhs);
+		void filterRows(const CqRowSource<ArrayT>& src, ArrayT& destBuf,
+				TqInt yBegin, TqInt yEnd, TqInt destStart = 0) const;
+		/// Filter a range of output rows in parallel on the given pool.
+		void filterRows(const CqRowSource<ArrayT>& src, ArrayT& destBuf,
+				TqInt yBegin, TqInt yEnd, CqThreadPool& pool,
+				TqInt destStart = 0) const;
+
 	private:
-		boost::shared_ptr<ArrayT> m_buf;
-		SqFilterInfo m_filterInfo;
+		/// Convert a source row to float, wrapping in the x-direction.
+		void fillRow(const CqRowSource<ArrayT>& src, TqInt y, TqFloat* row) const;
+		/// Filter output rows [yBegin,yEnd) on the calling thread.
+		void filterBand(const CqRowSource<ArrayT>& src, ArrayT& destBuf,
+				TqInt yBegin, TqInt yEnd, TqInt destStart) const;
+
+		/// Amount to scale the image by.  Fixed at a factor of 2 for now.
+		static const TqInt m_ratio = 2;
+
+		CqDownsampleKernel m_kernel;
 		SqWrapModes m_wrapModes;
+		TqInt m_srcWidth;
+		TqInt m_srcHeight;
+		TqInt m_numChannels;
+		TqInt m_width;
+		TqInt m_height;
+		/// Offset from 2*(output position) to the top left of the support.
+		TqInt m_offsetX;
+		TqInt m_offsetY;
+		/// Number of pixels held in each converted source row.
+		TqInt m_rowPixels;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Filter the levels of a mipmap from a stream of source rows.
+ *
+ * Rows of the source image are pushed from the top down, and each push
+ * filters as many rows of each smaller level as the rows seen so far allow.
+ * Only the rows which are still needed by the filters are kept, so a level
+ * several steps below the source can be computed without holding any level
+ * in memory as a whole.
+ */
+template<typename ArrayT>
+class CqMipmapStream
+{
+	public:
+		/** \brief Set up a stream for a source image of the given size.
+		 *
+		 * \param filterInfo - information about which filter type and size to use
+		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 * \param srcWidth
+		 * \param srcHeight - dimensions of the source image
+		 * \param numChannels - number of channels in the source image
+		 * \param numLevels - number of levels to compute below the source.
+		 */
+		CqMipmapStream(const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+				TqInt srcWidth, TqInt srcHeight, TqInt numChannels,
+				TqInt numLevels);
+
+		/// Number of levels computed below the source.
+		TqInt numLevels() const;
+		/// Width of the given level, where level 0 is the source.
+		TqInt width(TqInt level) const;
+		/// Height of the given level, where level 0 is the source.
+		TqInt height(TqInt level) const;
+
+		/** \brief Number of rows at the top and bottom of the source which
+		 * are reached by wrapping.
+		 *
+		 * When this is nonzero, the rows must be passed to setEdgeRows()
+		 * before any rows are pushed.
+		 */
+		TqInt edgeRows() const;
+		/** \brief Provide the rows of the source reached by wrapping.
+		 *
+		 * The matching rows of each smaller level are filtered from these.
+		 *
+		 * \param topRows - the first edgeRows() rows of the source.
+		 * \param bottomRows - the last edgeRows() rows of the source.
+		 * \param pool - threads to use for filtering.
+		 */
+		void setEdgeRows(const ArrayT& topRows, const ArrayT& bottomRows,
+				CqThreadPool& pool);
+
+		/** \brief Push the next rows of the source, filtering the levels below.
+		 *
+		 * \param rows - source rows following those already pushed.
+		 * \param pool - threads to use for filtering.
+		 */
+		void push(const ArrayT& rows, CqThreadPool& pool);
+		/** \brief Rows of a level which were completed by the last push.
+		 *
+		 * \param level - level to get the rows of; level 0 is the source.
+		 * \param startRow - return parameter for the index of the first row.
+		 */
+		const ArrayT& newRows(TqInt level, TqInt& startRow) const;
+
+	private:
+		/// Filter state for one level below the source.
+		struct SqStage
+		{
+			SqStage(const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+					TqInt srcWidth, TqInt srcHeight, TqInt numChannels);
+
+			/// Filter from the level above to this level.
+			CqDownsampler<ArrayT> downsampler;
+			/// Height of the level above.
+			TqInt srcHeight;
+			/// Rows of the level above reached by wrapping.
+			ArrayT topRows;
+			ArrayT bottomRows;
+			/// Rows of the level above which are still needed, and their starts.
+			std::deque<ArrayT> chunks;
+			std::deque<TqInt> chunkStarts;
+			/// Number of rows of the level above pushed so far.
+			TqInt rowsSeen;
+			/// Rows of this level which have been filtered.
+			TqInt rowsDone;
+			/// Rows completed by the last push.
+			ArrayT newRows;
+			TqInt newRowsStart;
+
+			/// Collect the available rows of the level above.
+			CqRowSource<ArrayT> rowSource() const;
+			/// Push rows of the level above, filtering rows of this level.
+			void push(const ArrayT& rows, CqThreadPool& pool);
+		};
+
+		std::vector<SqStage> m_stages;
+		/// Number of wrapped rows needed at each edge of each level.
+		std::vector<TqInt> m_edgeRows;
+		/// Source rows from the last push.
+		ArrayT m_srcRows;
+		TqInt m_srcRowsStart;
+		/// Number of source rows pushed so far.
+		TqInt m_srcRowsSeen;
+		TqInt m_srcWidth;
+		TqInt m_srcHeight;
 };
 
+
 /** \brief Downsample an image to the next smaller mipmap size.
  *
  * The size of the new image is ceil(width/2) x ceil(height/2).  This is one
@@ -115,118 +356,521 @@ template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
 		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
 
+/// Downsample an image, splitting the work over the given thread pool.
+template<typename ArrayT>
+boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+		CqThreadPool& pool);
+
 
 
 //==============================================================================
 // Implementation details
 //==============================================================================
-// CqDownsampleIterator implementation
-template<typename ArrayT>
-CqDownsampleIterator<ArrayT>::CqDownsampleIterator()
-	: m_buf(),
-	m_filterInfo(),
-	m_wrapModes()
-{ }
+// CqDownsampleKernel implementation
+inline CqDownsampleKernel::CqDownsampleKernel(const CqCachedFilter& filter,
+		TqInt numChannels)
+	: m_width(filter.width()),
+	m_height(filter.height()),
+	m_numChannels(numChannels),
+	m_spanLength((filter.width()*numChannels + 3) & ~3),
+	m_weights(m_height*m_spanLength, 0)
+{
+	SqFilterSupport support = filter.support();
+	for(TqInt j = 0; j < m_height; ++j)
+	{
+		for(TqInt i = 0; i < m_width; ++i)
+		{
+			TqFloat w = filter(support.sx.start + i, support.sy.start + j);
+			for(TqInt c = 0; c < m_numChannels; ++c)
+				m_weights[j*m_spanLength + i*m_numChannels + c] = w;
+		}
+	}
+}
+
+inline TqInt CqDownsampleKernel::width() const
+{
+	return m_width;
+}
+
+inline TqInt CqDownsampleKernel::height() const
+{
+	return m_height;
+}
+
+inline TqInt CqDownsampleKernel::spanLength() const
+{
+	return m_spanLength;
+}
 
+inline void CqDownsampleKernel::apply(const TqFloat* const* srcRows,
+		TqFloat* scratch, TqFloat* outPix) const
+{
+	// Sum the weighted kernel rows down each column of the span.  The
+	// result holds a partial sum for each channel of each kernel column.
+	const TqFloat* weights = &m_weights[0];
+#	ifdef AQSIS_SIMD_SSE2
+	for(TqInt i = 0; i < m_spanLength; i += 4)
+	{
+		__m128 sum = _mm_setzero_ps();
+		const TqFloat* w = weights + i;
+		for(TqInt j = 0; j < m_height; ++j, w += m_spanLength)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(w),
+						_mm_loadu_ps(srcRows[j] + i)));
+		_mm_storeu_ps(scratch + i, sum);
+	}
+#	else
+	for(TqInt i = 0; i < m_spanLength; ++i)
+	{
+		TqFloat sum = 0;
+		const TqFloat* w = weights + i;
+		for(TqInt j = 0; j < m_height; ++j, w += m_spanLength)
+			sum += *w * srcRows[j][i];
+		scratch[i] = sum;
+	}
+#	endif
+	// Gather the partial sums for each channel.
+	for(TqInt c = 0; c < m_numChannels; ++c)
+	{
+		TqFloat sum = 0;
+		for(TqInt i = c, end = m_width*m_numChannels; i < end; i += m_numChannels)
+			sum += scratch[i];
+		outPix[c] = sum;
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// CqRowSource implementation
 template<typename ArrayT>
-CqDownsampleIterator<ArrayT>::CqDownsampleIterator(boost::shared_ptr<ArrayT> buf,
-		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes)
-	: m_buf(buf),
-	m_filterInfo(filterInfo),
-	m_wrapModes(wrapModes)
+inline CqRowSource<ArrayT>::CqRowSource()
+	: m_rows()
 { }
 
 template<typename ArrayT>
-CqDownsampleIterator<ArrayT>& CqDownsampleIterator<ArrayT>::operator++()
+inline CqRowSource<ArrayT>::CqRowSource(const ArrayT& buf, TqInt startRow)
+	: m_rows()
 {
-	if(!m_buf)
-		return *this;
-	if(m_buf->width() > 1 || m_buf->height() > 1)
-		m_buf = downsample(*m_buf, m_filterInfo, m_wrapModes);
-	else
-		m_buf.reset();
-	return *this;
+	addRows(buf, startRow);
 }
 
 template<typename ArrayT>
-const boost::shared_ptr<ArrayT>& CqDownsampleIterator<ArrayT>::operator*()
+inline void CqRowSource<ArrayT>::addRows(const ArrayT& buf, TqInt startRow)
 {
-	return m_buf;
+	SqRows rows = {&buf, startRow};
+	m_rows.push_back(rows);
 }
 
 template<typename ArrayT>
-bool CqDownsampleIterator<ArrayT>::operator!=(const CqDownsampleIterator<ArrayT>& rhs)
+inline const ArrayT& CqRowSource<ArrayT>::find(TqInt y, TqInt& localY) const
 {
-	return m_buf != rhs.m_buf;
+	for(typename std::vector<SqRows>::const_iterator i = m_rows.begin(),
+			end = m_rows.end(); i != end; ++i)
+	{
+		localY = y - i->startRow;
+		if(localY >= 0 && localY < i->buf->height())
+			return *i->buf;
+	}
+	AQSIS_THROW_XQERROR(XqInternal, EqE_Bug,
+			"Row " << y << " not available for downsampling");
+	return *m_rows[0].buf;
 }
 
 
 //------------------------------------------------------------------------------
-// free functions implementation
+// CqDownsampler implementation
 
 namespace detail {
 
-/** \brief Downsample a buffer for mipmapping via a nonseperable convolution.
- *
- * Nonseperable convolution is the most general way of forming a weighted
- * average during filtering.  A seperable convolution should be faster, but is
- * more complicated to implement.
+/** \brief Map a coordinate into the range [0,size) according to a wrap mode.
  *
- * \param srcBuf - input texture buffer.
- * \param mipmapRatio - scale factor for the new file (0.5 for normal mipmapping)
- * \param filterWeights - precomputed kernel of filter weights
- * \param wrapModes - specify how the texture will be wrapped at the edges.
+ * \return The wrapped coordinate, or -1 if the wrapped pixel is black.
  */
+inline TqInt wrapCoord(TqInt c, TqInt size, EqWrapMode wrapMode)
+{
+	if(c >= 0 && c < size)
+		return c;
+	switch(wrapMode)
+	{
+		case WrapMode_Black:
+			return -1;
+		case WrapMode_Clamp:
+			return c < 0 ? 0 : size - 1;
+		default:
+			{
+				// Anything else wraps periodically, as in filterTexture().
+				TqInt r = c % size;
+				return r < 0 ? r + size : r;
+			}
+	}
+}
+
+} // namespace detail
+
+template<typename ArrayT>
+CqDownsampler<ArrayT>::CqDownsampler(const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes, TqInt srcWidth, TqInt srcHeight,
+		TqInt numChannels)
+	: m_kernel(CqCachedFilter(filterInfo, srcWidth % 2 != 0,
+				srcHeight % 2 != 0, 1.0f/m_ratio), numChannels),
+	m_wrapModes(wrapModes),
+	m_srcWidth(srcWidth),
+	m_srcHeight(srcHeight),
+	m_numChannels(numChannels),
+	m_width(lceil(TqFloat(srcWidth)/m_ratio)),
+	m_height(lceil(TqFloat(srcHeight)/m_ratio)),
+	m_offsetX((m_kernel.width()-1) / 2),
+	m_offsetY((m_kernel.height()-1) / 2),
+	m_rowPixels((m_width-1)*m_ratio + m_kernel.width())
+{ }
+
+template<typename ArrayT>
+inline TqInt CqDownsampler<ArrayT>::width() const
+{
+	return m_width;
+}
+
+template<typename ArrayT>
+inline TqInt CqDownsampler<ArrayT>::height() const
+{
+	return m_height;
+}
+
+template<typename ArrayT>
+inline void CqDownsampler<ArrayT>::sourceRows(TqInt yBegin, TqInt yEnd,
+		TqInt& srcBegin, TqInt& srcEnd) const
+{
+	srcBegin = max(0, m_ratio*yBegin - m_offsetY);
+	srcEnd = min(m_srcHeight, m_ratio*(yEnd-1) - m_offsetY + m_kernel.height());
+}
+
+template<typename ArrayT>
+inline TqInt CqDownsampler<ArrayT>::wrapRows() const
+{
+	return min(m_srcHeight, m_kernel.height());
+}
+
+template<typename ArrayT>
+void CqDownsampler<ArrayT>::filterRows(const CqRowSource<ArrayT>& src,
+		ArrayT& destBuf, TqInt yBegin, TqInt yEnd, TqInt destStart) const
+{
+	filterBand(src, destBuf, yBegin, yEnd, destStart);
+}
+
 template<typename ArrayT>
-boost::shared_ptr<ArrayT> downsampleNonseperable(
-		const ArrayT& srcBuf, TqInt mipmapRatio,
-		CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
-{
-	TqInt newWidth = lceil(TqFloat(srcBuf.width())/mipmapRatio);
-	TqInt newHeight = lceil(TqFloat(srcBuf.height())/mipmapRatio);
-	TqInt numChannels = srcBuf.numChannels();
-	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight, numChannels));
-	TqInt filterOffsetX = (filterWeights.width()-1) / 2;
-	TqInt filterOffsetY = (filterWeights.height()-1) / 2;
-	std::vector<TqFloat> accumBuf(numChannels);
-	// Loop over pixels in the output image.
-	for(TqInt y = 0; y < newHeight; ++y)
-	{
-		for(TqInt x = 0; x < newWidth; ++x)
+void CqDownsampler<ArrayT>::filterRows(const CqRowSource<ArrayT>& src,
+		ArrayT& destBuf, TqInt yBegin, TqInt yEnd, CqThreadPool& pool,
+		TqInt destStart) const
+{
+	// Bands of rows are large enough to amortize the cost of converting the
+	// source rows which overlap between neighbouring bands.
+	const TqInt bandHeight = 16;
+	CqTaskGroup tasks(pool);
+	for(TqInt y = yBegin; y < yEnd; y += bandHeight)
+	{
+		tasks.run(boost::bind(&CqDownsampler<ArrayT>::filterBand, this,
+					boost::cref(src), boost::ref(destBuf), y,
+					min(y + bandHeight, yEnd), destStart));
+	}
+	tasks.wait();
+}
+
+template<typename ArrayT>
+void CqDownsampler<ArrayT>::fillRow(const CqRowSource<ArrayT>& src, TqInt y,
+		TqFloat* row) const
+{
+	TqInt wrappedY = detail::wrapCoord(y, m_srcHeight, m_wrapModes.tWrap);
+	if(wrappedY < 0)
+	{
+		std::fill(row, row + m_rowPixels*m_numChannels, TqFloat(0));
+		return;
+	}
+	TqInt localY = 0;
+	const ArrayT& buf = src.find(wrappedY, localY);
+	const TqInt xStart = -m_offsetX;
+	for(TqInt i = 0; i < m_rowPixels; ++i, row += m_numChannels)
+	{
+		TqInt x = detail::wrapCoord(xStart + i, m_srcWidth, m_wrapModes.sWrap);
+		if(x < 0)
 		{
-			// Filter the source buffer to get the channels for a single pixel
-			// in the destination buffer.
-			filterWeights.setSupportTopLeft(2*x-filterOffsetX, 2*y-filterOffsetY);
-			CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0, numChannels, &accumBuf[0]);
-			filterTexture(accumulator, srcBuf, filterWeights.support(),
-					SqWrapModes(wrapModes.sWrap, wrapModes.tWrap));
-			destBuf->setPixel(x, y, &accumBuf[0]);
+			std::fill(row, row + m_numChannels, TqFloat(0));
+			continue;
+		}
+		typename ArrayT::TqSampleVector pixel = buf(x, localY);
+		for(TqInt c = 0; c < m_numChannels; ++c)
+			row[c] = pixel[c];
+	}
+}
+
+template<typename ArrayT>
+void CqDownsampler<ArrayT>::filterBand(const CqRowSource<ArrayT>& src,
+		ArrayT& destBuf, TqInt yBegin, TqInt yEnd, TqInt destStart) const
+{
+	const TqInt kernHeight = m_kernel.height();
+	const TqInt rowLength = m_rowPixels*m_numChannels
+		+ CqDownsampleKernel::rowSlack;
+	// Converted source rows, used as a ring buffer indexed by source row.
+	std::vector<TqFloat> rowStore(kernHeight*rowLength, 0);
+	std::vector<TqInt> rowIndex(kernHeight, -m_srcHeight - kernHeight - 1);
+	std::vector<const TqFloat*> rows(kernHeight);
+	std::vector<const TqFloat*> support(kernHeight);
+	std::vector<TqFloat> scratch(m_kernel.spanLength());
+	std::vector<TqFloat> pixel(m_numChannels);
+	const TqInt pixelStep = m_ratio*m_numChannels;
+	for(TqInt y = yBegin; y < yEnd; ++y)
+	{
+		// Make sure the rows covered by the kernel are converted.
+		for(TqInt j = 0; j < kernHeight; ++j)
+		{
+			TqInt srcY = m_ratio*y - m_offsetY + j;
+			TqInt slot = srcY % kernHeight;
+			if(slot < 0)
+				slot += kernHeight;
+			TqFloat* row = &rowStore[slot*rowLength];
+			if(rowIndex[slot] != srcY)
+			{
+				fillRow(src, srcY, row);
+				rowIndex[slot] = srcY;
+			}
+			rows[j] = row;
+		}
+		// Filter each pixel in the output row.
+		for(TqInt x = 0; x < m_width; ++x)
+		{
+			for(TqInt j = 0; j < kernHeight; ++j)
+				support[j] = rows[j] + x*pixelStep;
+			m_kernel.apply(&support[0], &scratch[0], &pixel[0]);
+			destBuf.setPixel(x, y - destStart, &pixel[0]);
 		}
 	}
-	return destBuf;
 }
 
-} // namespace detail
 
+//------------------------------------------------------------------------------
+// CqMipmapStream implementation
 
 template<typename ArrayT>
-boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
-		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes)
+CqMipmapStream<ArrayT>::SqStage::SqStage(const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes, TqInt srcWidth, TqInt srcHeight,
+		TqInt numChannels)
+	: downsampler(filterInfo, wrapModes, srcWidth, srcHeight, numChannels),
+	srcHeight(srcHeight),
+	topRows(),
+	bottomRows(),
+	chunks(),
+	chunkStarts(),
+	rowsSeen(0),
+	rowsDone(0),
+	newRows(),
+	newRowsStart(0)
+{ }
+
+template<typename ArrayT>
+CqRowSource<ArrayT> CqMipmapStream<ArrayT>::SqStage::rowSource() const
+{
+	CqRowSource<ArrayT> src;
+	for(TqInt i = 0, end = chunks.size(); i < end; ++i)
+		src.addRows(chunks[i], chunkStarts[i]);
+	if(topRows.height() > 0)
+	{
+		src.addRows(topRows, 0);
+		src.addRows(bottomRows, srcHeight - bottomRows.height());
+	}
+	return src;
+}
+
+template<typename ArrayT>
+void CqMipmapStream<ArrayT>::SqStage::push(const ArrayT& rows,
+		CqThreadPool& pool)
+{
+	if(rows.height() > 0)
+	{
+		chunks.push_back(rows);
+		chunkStarts.push_back(rowsSeen);
+		rowsSeen += rows.height();
+	}
+	// Find the output rows whose source rows have all arrived.
+	const TqInt height = downsampler.height();
+	TqInt yEnd = rowsDone;
+	TqInt srcBegin = 0;
+	TqInt srcEnd = 0;
+	for(; yEnd < height; ++yEnd)
+	{
+		downsampler.sourceRows(yEnd, yEnd+1, srcBegin, srcEnd);
+		if(srcEnd > rowsSeen)
+			break;
+	}
+	newRowsStart = rowsDone;
+	if(yEnd > rowsDone)
+	{
+		newRows = ArrayT(downsampler.width(), yEnd - rowsDone, rows.numChannels());
+		downsampler.filterRows(rowSource(), newRows, rowsDone, yEnd, pool,
+				rowsDone);
+		rowsDone = yEnd;
+	}
+	else
+		newRows = ArrayT();
+	// Drop the source rows which no remaining output row needs.
+	if(rowsDone < height)
+		downsampler.sourceRows(rowsDone, rowsDone+1, srcBegin, srcEnd);
+	else
+		srcBegin = srcHeight;
+	while(!chunks.empty() && chunkStarts.front() + chunks.front().height() <= srcBegin)
+	{
+		chunks.pop_front();
+		chunkStarts.pop_front();
+	}
+}
+
+template<typename ArrayT>
+CqMipmapStream<ArrayT>::CqMipmapStream(const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes, TqInt srcWidth, TqInt srcHeight,
+		TqInt numChannels, TqInt numLevels)
+	: m_stages(),
+	m_edgeRows(numLevels, 0),
+	m_srcRows(),
+	m_srcRowsStart(0),
+	m_srcRowsSeen(0),
+	m_srcWidth(srcWidth),
+	m_srcHeight(srcHeight)
+{
+	m_stages.reserve(numLevels);
+	TqInt width = srcWidth;
+	TqInt height = srcHeight;
+	for(TqInt i = 0; i < numLevels; ++i)
+	{
+		m_stages.push_back(SqStage(filterInfo, wrapModes, width, height,
+					numChannels));
+		width = m_stages.back().downsampler.width();
+		height = m_stages.back().downsampler.height();
+	}
+	if(numLevels == 0 || wrapModes.tWrap == WrapMode_Black
+			|| wrapModes.tWrap == WrapMode_Clamp)
+		return;
+	// Work upward from the smallest level, finding how many rows at each
+	// edge are needed to filter the edge rows of the level below.
+	m_edgeRows[numLevels-1] = m_stages[numLevels-1].downsampler.wrapRows();
+	for(TqInt i = numLevels-2; i >= 0; --i)
+	{
+		const CqDownsampler<ArrayT>& downsampler = m_stages[i].downsampler;
+		TqInt numRows = m_edgeRows[i+1];
+		TqInt topBegin = 0, topEnd = 0, bottomBegin = 0, bottomEnd = 0;
+		downsampler.sourceRows(0, numRows, topBegin, topEnd);
+		downsampler.sourceRows(downsampler.height() - numRows,
+				downsampler.height(), bottomBegin, bottomEnd);
+		TqInt srcHeight = m_stages[i].srcHeight;
+		m_edgeRows[i] = min(srcHeight, max(downsampler.wrapRows(),
+					max(topEnd, srcHeight - bottomBegin)));
+	}
+}
+
+template<typename ArrayT>
+inline TqInt CqMipmapStream<ArrayT>::numLevels() const
+{
+	return m_stages.size();
+}
+
+template<typename ArrayT>
+inline TqInt CqMipmapStream<ArrayT>::width(TqInt level) const
+{
+	return level == 0 ? m_srcWidth : m_stages[level-1].downsampler.width();
+}
+
+template<typename ArrayT>
+inline TqInt CqMipmapStream<ArrayT>::height(TqInt level) const
+{
+	return level == 0 ? m_srcHeight : m_stages[level-1].downsampler.height();
+}
+
+template<typename ArrayT>
+inline TqInt CqMipmapStream<ArrayT>::edgeRows() const
+{
+	return m_edgeRows.empty() ? 0 : m_edgeRows[0];
+}
+
+template<typename ArrayT>
+void CqMipmapStream<ArrayT>::setEdgeRows(const ArrayT& topRows,
+		const ArrayT& bottomRows, CqThreadPool& pool)
 {
-	// Amount to scale the image by.  Fixed at a factor of 2 for now.
-	TqInt mipmapRatio = 2;
-	TqFloat scale = 1.0f/mipmapRatio;
+	for(TqInt i = 0, numLevels = m_stages.size(); i < numLevels; ++i)
+	{
+		SqStage& stage = m_stages[i];
+		if(i == 0)
+		{
+			stage.topRows = topRows;
+			stage.bottomRows = bottomRows;
+		}
+		if(i+1 == numLevels)
+			break;
+		// Filter the edge rows of the next level from those of this one.
+		const CqDownsampler<ArrayT>& downsampler = stage.downsampler;
+		TqInt numRows = m_edgeRows[i+1];
+		TqInt height = downsampler.height();
+		CqRowSource<ArrayT> src = stage.rowSource();
+		SqStage& next = m_stages[i+1];
+		next.topRows = ArrayT(downsampler.width(), numRows, topRows.numChannels());
+		next.bottomRows = ArrayT(downsampler.width(), numRows, topRows.numChannels());
+		downsampler.filterRows(src, next.topRows, 0, numRows, pool, 0);
+		downsampler.filterRows(src, next.bottomRows, height - numRows, height,
+				pool, height - numRows);
+	}
+}
+
+template<typename ArrayT>
+void CqMipmapStream<ArrayT>::push(const ArrayT& rows, CqThreadPool& pool)
+{
+	m_srcRows = rows;
+	m_srcRowsStart = m_srcRowsSeen;
+	m_srcRowsSeen += rows.height();
+	const ArrayT* stageRows = &rows;
+	for(TqInt i = 0, numLevels = m_stages.size(); i < numLevels; ++i)
+	{
+		m_stages[i].push(*stageRows, pool);
+		stageRows = &m_stages[i].newRows;
+	}
+}
+
+template<typename ArrayT>
+const ArrayT& CqMipmapStream<ArrayT>::newRows(TqInt level, TqInt& startRow) const
+{
+	if(level == 0)
+	{
+		startRow = m_srcRowsStart;
+		return m_srcRows;
+	}
+	startRow = m_stages[level-1].newRowsStart;
+	return m_stages[level-1].newRows;
+}
 
-	/// \todo Optimize for seperable filters.  This should also give some idea
-	/// about how to optimize the analogous filtering operations in the core renderer.
-	//
-	// if(FilterFunctorT::isSeperable()) ...
 
-	// General case: Non-seperable filter.
+//------------------------------------------------------------------------------
+// free functions implementation
 
-	CqCachedFilter weights(filterInfo, srcBuf.width() % 2 != 0,
-			srcBuf.height() % 2 != 0, scale);
-	return detail::downsampleNonseperable(srcBuf, mipmapRatio, weights, wrapModes);
+template<typename ArrayT>
+boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes)
+{
+	CqDownsampler<ArrayT> downsampler(filterInfo, wrapModes, srcBuf.width(),
+			srcBuf.height(), srcBuf.numChannels());
+	boost::shared_ptr<ArrayT> destBuf(new ArrayT(downsampler.width(),
+				downsampler.height(), srcBuf.numChannels()));
+	downsampler.filterRows(CqRowSource<ArrayT>(srcBuf), *destBuf,
+			0, downsampler.height());
+	return destBuf;
+}
+
+template<typename ArrayT>
+boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+		CqThreadPool& pool)
+{
+	CqDownsampler<ArrayT> downsampler(filterInfo, wrapModes, srcBuf.width(),
+			srcBuf.height(), srcBuf.numChannels());
+	boost::shared_ptr<ArrayT> destBuf(new ArrayT(downsampler.width(),
+				downsampler.height(), srcBuf.numChannels()));
+	downsampler.filterRows(CqRowSource<ArrayT>(srcBuf), *destBuf,
+			0, downsampler.height(), pool);
+	return destBuf;
 }
 
 } // namespace Aqsis
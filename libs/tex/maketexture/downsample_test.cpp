@@ -0,0 +1,278 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for mipmap downsampling.
+ */
+#include "downsample.h"
+
+#include <cmath>
+#include <vector>
+
+#include <aqsis/tex/filtering/filtertexture.h>
+#include <aqsis/tex/filtering/sampleaccum.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(downsample_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+RtFloat gaussianFilter(RtFloat x, RtFloat y, RtFloat xwidth, RtFloat ywidth)
+{
+	x *= 2.0f / xwidth;
+	y *= 2.0f / ywidth;
+	return std::exp(-2.0f * (x*x + y*y));
+}
+
+// Fill a buffer with an arbitrary pattern.
+template<typename ChannelT>
+void fillPattern(CqTextureBuffer<ChannelT>& buf)
+{
+	std::vector<TqFloat> pix(buf.numChannels());
+	for(TqInt y = 0; y < buf.height(); ++y)
+	{
+		for(TqInt x = 0; x < buf.width(); ++x)
+		{
+			for(TqInt c = 0; c < buf.numChannels(); ++c)
+				pix[c] = 0.5f + 0.5f*std::sin(0.7f*x + 1.3f*y + c);
+			buf.setPixel(x, y, &pix[0]);
+		}
+	}
+}
+
+// Downsample one pixel at a time using the general texture filtering
+// machinery.
+template<typename ChannelT>
+boost::shared_ptr<CqTextureBuffer<ChannelT> > referenceDownsample(
+		const CqTextureBuffer<ChannelT>& srcBuf, const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes)
+{
+	CqCachedFilter filterWeights(filterInfo, srcBuf.width() % 2 != 0,
+			srcBuf.height() % 2 != 0, 0.5f);
+	TqInt newWidth = lceil(srcBuf.width()/2.0f);
+	TqInt newHeight = lceil(srcBuf.height()/2.0f);
+	TqInt numChannels = srcBuf.numChannels();
+	boost::shared_ptr<CqTextureBuffer<ChannelT> > destBuf(
+			new CqTextureBuffer<ChannelT>(newWidth, newHeight, numChannels));
+	TqInt filterOffsetX = (filterWeights.width()-1) / 2;
+	TqInt filterOffsetY = (filterWeights.height()-1) / 2;
+	std::vector<TqFloat> accumBuf(numChannels);
+	for(TqInt y = 0; y < newHeight; ++y)
+	{
+		for(TqInt x = 0; x < newWidth; ++x)
+		{
+			filterWeights.setSupportTopLeft(2*x-filterOffsetX, 2*y-filterOffsetY);
+			CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0,
+					numChannels, &accumBuf[0]);
+			filterTexture(accumulator, srcBuf, filterWeights.support(), wrapModes);
+			destBuf->setPixel(x, y, &accumBuf[0]);
+		}
+	}
+	return destBuf;
+}
+
+template<typename ChannelT>
+void checkBuffersClose(const CqTextureBuffer<ChannelT>& a,
+		const CqTextureBuffer<ChannelT>& b, TqFloat tol)
+{
+	BOOST_REQUIRE_EQUAL(a.width(), b.width());
+	BOOST_REQUIRE_EQUAL(a.height(), b.height());
+	for(TqInt y = 0; y < a.height(); ++y)
+		for(TqInt x = 0; x < a.width(); ++x)
+			for(TqInt c = 0; c < a.numChannels(); ++c)
+				BOOST_CHECK_SMALL(a(x,y)[c] - b(x,y)[c], tol);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(downsample_matches_filterTexture_test)
+{
+	// filterTexture() drops the corner regions when periodic and clamped
+	// wrapping are mixed, so only compare the other combinations.
+	const SqWrapModes wrapModes[] = {
+		SqWrapModes(WrapMode_Black, WrapMode_Periodic),
+		SqWrapModes(WrapMode_Periodic, WrapMode_Periodic),
+		SqWrapModes(WrapMode_Clamp, WrapMode_Clamp),
+		SqWrapModes(WrapMode_Clamp, WrapMode_Black)
+	};
+	// Odd and even sizes give odd and even sized filter kernels.
+	const TqInt sizes[][2] = {{16, 12}, {13, 9}, {7, 1}};
+	SqFilterInfo filterInfo(gaussianFilter, 3, 2);
+	for(TqInt s = 0; s < 3; ++s)
+	{
+		CqTextureBuffer<TqFloat> srcBuf(sizes[s][0], sizes[s][1], 3);
+		fillPattern(srcBuf);
+		for(TqInt i = 0; i < 4; ++i)
+		{
+			checkBuffersClose(*downsample(srcBuf, filterInfo, wrapModes[i]),
+					*referenceDownsample(srcBuf, filterInfo, wrapModes[i]), 1e-5f);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(downsample_integer_channels_test)
+{
+	CqTextureBuffer<TqUint8> srcBuf(21, 10, 4);
+	fillPattern(srcBuf);
+	SqFilterInfo filterInfo(gaussianFilter, 2, 2);
+	SqWrapModes wrapModes(WrapMode_Periodic, WrapMode_Black);
+	// Allow for rounding to differ in the last place.
+	checkBuffersClose(*downsample(srcBuf, filterInfo, wrapModes),
+			*referenceDownsample(srcBuf, filterInfo, wrapModes), 1.01f/255);
+}
+
+BOOST_AUTO_TEST_CASE(CqDownsampler_bands_test)
+{
+	// Filtering from separate bands of source rows, in parallel, should give
+	// the same result as filtering the whole image at once.
+	CqTextureBuffer<TqFloat> srcBuf(19, 40, 2);
+	fillPattern(srcBuf);
+	SqFilterInfo filterInfo(gaussianFilter, 4, 4);
+	SqWrapModes wrapModes(WrapMode_Clamp, WrapMode_Periodic);
+	CqDownsampler<CqTextureBuffer<TqFloat> > downsampler(filterInfo, wrapModes,
+			srcBuf.width(), srcBuf.height(), srcBuf.numChannels());
+	CqTextureBuffer<TqFloat> destBuf(downsampler.width(), downsampler.height(), 2);
+	CqThreadPool pool(2);
+	TqInt numRows = downsampler.wrapRows();
+	CqTextureBuffer<TqFloat> topRows(srcBuf.width(), numRows, 2);
+	CqTextureBuffer<TqFloat> bottomRows(srcBuf.width(), numRows, 2);
+	for(TqInt y = 0; y < numRows; ++y)
+	{
+		for(TqInt x = 0; x < srcBuf.width(); ++x)
+		{
+			topRows.setPixel(x, y, srcBuf(x, y));
+			bottomRows.setPixel(x, y, srcBuf(x, srcBuf.height() - numRows + y));
+		}
+	}
+	const TqInt bandHeight = 6;
+	for(TqInt y = 0; y < downsampler.height(); y += bandHeight)
+	{
+		TqInt yEnd = min(y + bandHeight, downsampler.height());
+		TqInt srcBegin = 0;
+		TqInt srcEnd = 0;
+		downsampler.sourceRows(y, yEnd, srcBegin, srcEnd);
+		CqTextureBuffer<TqFloat> band(srcBuf.width(), srcEnd - srcBegin, 2);
+		for(TqInt j = srcBegin; j < srcEnd; ++j)
+			for(TqInt x = 0; x < srcBuf.width(); ++x)
+				band.setPixel(x, j - srcBegin, srcBuf(x, j));
+		CqRowSource<CqTextureBuffer<TqFloat> > rowSource(band, srcBegin);
+		rowSource.addRows(topRows, 0);
+		rowSource.addRows(bottomRows, srcBuf.height() - numRows);
+		downsampler.filterRows(rowSource, destBuf, y, yEnd, pool);
+	}
+	checkBuffersClose(destBuf, *downsample(srcBuf, filterInfo, wrapModes), 1e-6f);
+}
+
+BOOST_AUTO_TEST_CASE(CqMipmapStream_matches_downsample_test)
+{
+	// Streaming several levels from bands of source rows should give the
+	// same levels as downsampling whole images one after another.
+	const SqWrapModes wrapModes[] = {
+		SqWrapModes(WrapMode_Black, WrapMode_Black),
+		SqWrapModes(WrapMode_Clamp, WrapMode_Clamp),
+		SqWrapModes(WrapMode_Clamp, WrapMode_Periodic),
+		SqWrapModes(WrapMode_Periodic, WrapMode_Periodic)
+	};
+	typedef CqTextureBuffer<TqFloat> TqBuffer;
+	TqBuffer srcBuf(37, 53, 2);
+	fillPattern(srcBuf);
+	SqFilterInfo filterInfo(gaussianFilter, 4, 4);
+	CqThreadPool pool(2);
+	const TqInt numLevels = 4;
+	for(TqInt w = 0; w < 4; ++w)
+	{
+		std::vector<boost::shared_ptr<TqBuffer> > expected;
+		expected.push_back(boost::shared_ptr<TqBuffer>(new TqBuffer(srcBuf)));
+		for(TqInt i = 0; i < numLevels; ++i)
+			expected.push_back(downsample(*expected.back(), filterInfo, wrapModes[w]));
+
+		CqMipmapStream<TqBuffer> stream(filterInfo, wrapModes[w],
+				srcBuf.width(), srcBuf.height(), srcBuf.numChannels(), numLevels);
+		BOOST_REQUIRE_EQUAL(stream.numLevels(), numLevels);
+		if(stream.edgeRows() > 0)
+		{
+			BOOST_CHECK_EQUAL(wrapModes[w].tWrap, WrapMode_Periodic);
+			TqInt numRows = stream.edgeRows();
+			TqBuffer topRows(srcBuf.width(), numRows, 2);
+			TqBuffer bottomRows(srcBuf.width(), numRows, 2);
+			for(TqInt y = 0; y < numRows; ++y)
+			{
+				for(TqInt x = 0; x < srcBuf.width(); ++x)
+				{
+					topRows.setPixel(x, y, srcBuf(x, y));
+					bottomRows.setPixel(x, y, srcBuf(x, srcBuf.height() - numRows + y));
+				}
+			}
+			stream.setEdgeRows(topRows, bottomRows, pool);
+		}
+		std::vector<boost::shared_ptr<TqBuffer> > levels;
+		std::vector<TqInt> rowsDone(numLevels + 1, 0);
+		for(TqInt i = 0; i <= numLevels; ++i)
+		{
+			levels.push_back(boost::shared_ptr<TqBuffer>(new TqBuffer(
+						stream.width(i), stream.height(i), 2)));
+		}
+		// Push the source in uneven bands.
+		const TqInt bandHeight = 5;
+		for(TqInt y = 0, bandNum = 0; y < srcBuf.height(); ++bandNum)
+		{
+			TqInt yEnd = min(y + bandHeight + bandNum % 3, srcBuf.height());
+			TqBuffer band(srcBuf.width(), yEnd - y, 2);
+			for(TqInt j = y; j < yEnd; ++j)
+				for(TqInt x = 0; x < srcBuf.width(); ++x)
+					band.setPixel(x, j - y, srcBuf(x, j));
+			stream.push(band, pool);
+			y = yEnd;
+			for(TqInt i = 0; i <= numLevels; ++i)
+			{
+				TqInt startRow = -1;
+				const TqBuffer& rows = stream.newRows(i, startRow);
+				// Rows of each level arrive in order.
+				BOOST_CHECK_EQUAL(startRow, rowsDone[i]);
+				for(TqInt j = 0; j < rows.height(); ++j)
+					for(TqInt x = 0; x < rows.width(); ++x)
+						levels[i]->setPixel(x, startRow + j, rows(x, j));
+				rowsDone[i] += rows.height();
+			}
+		}
+		for(TqInt i = 0; i <= numLevels; ++i)
+		{
+			BOOST_CHECK_EQUAL(rowsDone[i], expected[i]->height());
+			checkBuffersClose(*levels[i], *expected[i], 1e-5f);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
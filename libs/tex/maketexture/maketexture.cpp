@@ -38,7 +38,9 @@
 #include <aqsis/tex/maketexture.h>
 
 #include <algorithm>
+#include <cfloat>
 
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/math/math.h>
@@ -48,6 +50,7 @@
 #include <aqsis/util/logging.h>
 #include "magicnumber.h"
 #include "downsample.h"
+#include <aqsis/util/threadpool.h>
 #include <aqsis/tex/buffers/texturebuffer.h>
 #include <aqsis/tex/texexception.h>
 #include <aqsis/version.h>
@@ -61,48 +64,230 @@ namespace {
 // Helper functions and classes
 //------------------------------------------------------------------------------
 
+/// Write a whole buffer of scanlines to the output file.
+template<typename ArrayT>
+void writeScanlines(IqTexOutputFile& outFile, const ArrayT& buf)
+{
+	outFile.writePixels(buf);
+}
+
+/** \brief Read scanlines from a texture source, converting the channel type.
+ *
+ * FileChannelT is the channel type of the texture source, while ChannelT is
+ * the channel type used for mipmapping.
+ */
+template<typename FileChannelT, typename ChannelT>
+struct SqScanlineReader
+{
+	template<typename TexSrcT>
+	static void read(const TexSrcT& texSrc, CqTextureBuffer<ChannelT>& buf,
+			TqInt startLine, TqInt numScanlines)
+	{
+		CqTextureBuffer<FileChannelT> fileBuf;
+		texSrc.readPixels(fileBuf, startLine, numScanlines);
+		buf = fileBuf;
+	}
+};
+
+template<typename ChannelT>
+struct SqScanlineReader<ChannelT, ChannelT>
+{
+	template<typename TexSrcT>
+	static void read(const TexSrcT& texSrc, CqTextureBuffer<ChannelT>& buf,
+			TqInt startLine, TqInt numScanlines)
+	{
+		texSrc.readPixels(buf, startLine, numScanlines);
+	}
+};
+
+/// Copy whole rows between two texture buffers of the same width.
+template<typename ChannelT>
+void copyRows(const CqTextureBuffer<ChannelT>& src, TqInt srcRow, TqInt numRows,
+		CqTextureBuffer<ChannelT>& dest, TqInt destRow)
+{
+	if(numRows <= 0)
+		return;
+	assert(src.width() == dest.width());
+	assert(src.numChannels() == dest.numChannels());
+	TqInt rowStride = src.width()*src.numChannels()*sizeof(ChannelT);
+	const TqUint8* rawSrc = src.rawData() + srcRow*rowStride;
+	std::copy(rawSrc, rawSrc + numRows*rowStride,
+			dest.rawData() + destRow*rowStride);
+}
+
 /** \brief Downsample the provided buffer into the given output file.
  *
- * \param buf - Pointer to source data.  This smart pointer is reset to save
- *              memory during the mipmapping process, so make sure a copy of it
- *              is kept elsewhere if desired.
+ * Each level is written to the file in the background while the next level
+ * is being computed.
+ *
+ * \param buf - Pointer to the next mipmap level, which is written to a new
+ *              subimage of the file.  This smart pointer is reset to save
+ *              memory during the mipmapping process.
  * \param outFile - output file for the mipmapped data
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ * \param pool - threads to use for downsampling and writing.
  */
 template<typename ChannelT>
 void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
 		IqMultiTexOutputFile& outFile, const SqFilterInfo& filterInfo,
-		const SqWrapModes wrapModes)
+		const SqWrapModes wrapModes, CqThreadPool& pool)
 {
-	outFile.writePixels(*buf);
-	typedef CqDownsampleIterator<CqTextureBuffer<ChannelT> > TqDownsampleIter;
-	for(TqDownsampleIter i = ++TqDownsampleIter(buf, filterInfo, wrapModes),
-			end = TqDownsampleIter(); i != end; ++i)
+	typedef CqTextureBuffer<ChannelT> TqBuffer;
+	CqTaskGroup writes(pool);
+	while(true)
 	{
-		buf = *i;
 		outFile.newSubImage(buf->width(), buf->height());
-		outFile.writePixels(*buf);
+		writes.run(boost::bind(&writeScanlines<TqBuffer>, boost::ref(outFile),
+					boost::cref(*buf)));
+		if(buf->width() == 1 && buf->height() == 1)
+			break;
+		boost::shared_ptr<TqBuffer> nextBuf = downsample(*buf, filterInfo,
+				wrapModes, pool);
+		writes.wait();
+		buf = nextBuf;
 	}
+	writes.wait();
 }
 
-/** \brief Create a mipmap from pixel data in the given input file.
+/// Largest mipmap level, in bytes, which is held in memory as a whole.
+const TqDouble maxInMemoryLevelSize = 64*1024*1024;
+
+/** \brief Stream one level of a mipmap from a texture source to a file.
+ *
+ * The source is read a band of scanlines at a time, and the level is filtered
+ * from each band through a chain of downsamplers, so that only a few rows of
+ * each level are held in memory.  The rows of the level are written to the
+ * file while the next band is read and filtered.
+ *
+ * \param texSrc - source of the top level scanlines.
+ * \param width
+ * \param height - dimensions of the source
+ * \param numChannels - number of channels in the source
+ * \param outFile - output file for the mipmapped data
+ * \param level - level to write, where level 0 is the source.
+ * \param nextBuf - if non-null, the level below is also filtered into this
+ *                  buffer, which is resized to hold it.
+ * \param filterInfo - information about which filter type and size to use
+ * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ * \param pool - threads to use for downsampling and writing.
+ */
+template<typename FileChannelT, typename ChannelT, typename TexSrcT>
+void streamMipLevel(const TexSrcT& texSrc, TqInt width, TqInt height,
+		TqInt numChannels, IqMultiTexOutputFile& outFile, TqInt level,
+		CqTextureBuffer<ChannelT>* nextBuf, const SqFilterInfo& filterInfo,
+		const SqWrapModes wrapModes, CqThreadPool& pool)
+{
+	typedef CqTextureBuffer<ChannelT> TqBuffer;
+	typedef SqScanlineReader<FileChannelT, ChannelT> TqReader;
+	const TqInt numLevels = nextBuf ? level + 1 : level;
+	CqMipmapStream<TqBuffer> stream(filterInfo, wrapModes, width, height,
+			numChannels, numLevels);
+
+	// With periodic wrapping the filters reach rows at the opposite edge of
+	// the image, which won't be in the current band; read them up front.
+	if(stream.edgeRows() > 0)
+	{
+		TqInt numRows = stream.edgeRows();
+		TqBuffer topRows;
+		TqBuffer bottomRows;
+		TqReader::read(texSrc, topRows, 0, numRows);
+		TqReader::read(texSrc, bottomRows, height - numRows, numRows);
+		stream.setEdgeRows(topRows, bottomRows, pool);
+	}
+	if(level > 0)
+		outFile.newSubImage(stream.width(level), stream.height(level));
+	if(nextBuf)
+	{
+		nextBuf->resize(stream.width(level+1), stream.height(level+1),
+				numChannels);
+	}
+
+	// Number of source scanlines read at a time.
+	const TqInt bandHeight = 128;
+	CqTaskGroup writes(pool);
+	TqBuffer levelRows;
+	for(TqInt y = 0; y < height; y += bandHeight)
+	{
+		TqBuffer band;
+		TqReader::read(texSrc, band, y, min(bandHeight, height - y));
+		stream.push(band, pool);
+		// The previous rows must be written before the next ones.
+		writes.wait();
+		TqInt startRow = 0;
+		levelRows = stream.newRows(level, startRow);
+		if(levelRows.height() > 0)
+		{
+			writes.run(boost::bind(&writeScanlines<TqBuffer>,
+						boost::ref(outFile), boost::cref(levelRows)));
+		}
+		if(nextBuf)
+		{
+			const TqBuffer& nextRows = stream.newRows(level+1, startRow);
+			copyRows(nextRows, 0, nextRows.height(), *nextBuf, startRow);
+		}
+	}
+	writes.wait();
+}
+
+/** \brief Create a mipmap from pixel data in the given texture source.
+ *
+ * Large levels are streamed from the source one at a time by
+ * streamMipLevel(), so no level is held in memory as a whole until one small
+ * enough to fit within maxInMemoryLevelSize is reached.  That level is
+ * filtered while streaming the level above it, and the remaining levels are
+ * computed from it in memory.
  *
- * ChannelT is the pixel component type.
+ * FileChannelT is the pixel component type of the source, and ChannelT is
+ * the pixel component type of the mipmap.
  *
- * \param inFile - input file from which the data should be read
- * \param outFile - name of output file for the mipmapped data
+ * \param texSrc - source of the top level scanlines.  Needs one method,
+ *                 readPixels(buffer, startLine, numScanlines).
+ * \param outFile - output file for the mipmapped data; the header of the
+ *                  file provides the dimensions of the source.
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
  */
-template<typename TexSrcT, typename ChannelT>
+template<typename FileChannelT, typename ChannelT, typename TexSrcT>
 void createMipmapTyped(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
 {
-	// Read pixels into the input buffer.
-	boost::shared_ptr<CqTextureBuffer<ChannelT> > buf(new CqTextureBuffer<ChannelT>());
-	texSrc.readPixels(*buf);
-	downsampleToFile(buf, outFile, filterInfo, wrapModes);
+	typedef CqTextureBuffer<ChannelT> TqBuffer;
+	typedef SqScanlineReader<FileChannelT, ChannelT> TqReader;
+	const TqInt width = outFile.header().width();
+	const TqInt height = outFile.header().height();
+	const TqInt numChannels = outFile.header().channelList().numChannels();
+	if(width == 1 && height == 1)
+	{
+		TqBuffer buf;
+		TqReader::read(texSrc, buf, 0, 1);
+		outFile.writePixels(buf);
+		return;
+	}
+
+	// Find the first level below the source which is small enough to hold
+	// in memory.  Each level above it is streamed from the source.
+	TqInt numStreamed = 1;
+	for(TqInt levelWidth = width, levelHeight = height; ; ++numStreamed)
+	{
+		levelWidth = lceil(levelWidth/2.0f);
+		levelHeight = lceil(levelHeight/2.0f);
+		if(TqDouble(levelWidth)*levelHeight*numChannels*sizeof(ChannelT)
+				<= maxInMemoryLevelSize)
+			break;
+	}
+
+	CqThreadPool pool(0);
+	for(TqInt level = 0; level < numStreamed - 1; ++level)
+	{
+		streamMipLevel<FileChannelT>(texSrc, width, height, numChannels,
+				outFile, level, static_cast<TqBuffer*>(0), filterInfo,
+				wrapModes, pool);
+	}
+	boost::shared_ptr<TqBuffer> nextBuf(new TqBuffer());
+	streamMipLevel<FileChannelT>(texSrc, width, height, numChannels, outFile,
+			numStreamed - 1, nextBuf.get(), filterInfo, wrapModes, pool);
+	downsampleToFile(nextBuf, outFile, filterInfo, wrapModes, pool);
 }
 
 /// Specialization for OpenEXR half data format (TIFF can't handle half data)
@@ -111,13 +296,9 @@ void createMipmapTypedHalf(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
 {
 #	ifdef USE_OPENEXR
-	// Read pixels into the input buffer and convert to 32-bit floating point
+	// Convert the input scanlines to 32-bit floating point as they're read,
 	// since TIFF can't the half data type.
-	CqTextureBuffer<half> halfBuf;
-	texSrc.readPixels(halfBuf);
-	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf(
-			new CqTextureBuffer<TqFloat>(halfBuf));
-	downsampleToFile(buf, outFile, filterInfo, wrapModes);
+	createMipmapTyped<half, TqFloat>(texSrc, outFile, filterInfo, wrapModes);
 #	else
 	assert(0 && "Compiled without OpenEXR support");
 #	endif
@@ -143,25 +324,25 @@ void createMipmap(const TexSrcT& texSrc, const EqChannelType chanType,
 	switch(chanType)
 	{
 		case Channel_Float32:
-			createMipmapTyped<TexSrcT,TqFloat>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqFloat,TqFloat>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned32:
-			createMipmapTyped<TexSrcT,TqUint32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint32,TqUint32>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed32:
-			createMipmapTyped<TexSrcT,TqInt32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt32,TqInt32>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned16:
-			createMipmapTyped<TexSrcT,TqUint16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint16,TqUint16>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed16:
-			createMipmapTyped<TexSrcT,TqInt16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt16,TqInt16>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned8:
-			createMipmapTyped<TexSrcT,TqUint8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint8,TqUint8>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed8:
-			createMipmapTyped<TexSrcT,TqInt8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt8,TqInt8>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Float16:
 			createMipmapTypedHalf(texSrc, outFile, filterInfo, wrapModes);
@@ -172,6 +353,47 @@ void createMipmap(const TexSrcT& texSrc, const EqChannelType chanType,
 	}
 }
 
+/** \brief Accumulate rows of depths into the next level of a min/max pyramid.
+ *
+ * Each output pixel holds the minimum and maximum depth over the 2x2 block
+ * of source pixels which it covers.  As for mipmaps, dest should have size
+ * ceil(width/2) x ceil(height/2) for a width x height source.  The source
+ * may be passed in several bands, so that it needn't be held in memory all
+ * at once.
+ *
+ * \param src - band of source rows, holding either plain depths or
+ *              (min,max) depth pairs.
+ * \param srcStartRow - row of the whole source at which src starts; must be
+ *                      even.
+ * \param dest - two channel buffer of minimum and maximum depths.
+ */
+void downsampleDepthRange(const CqTextureBuffer<TqFloat>& src, TqInt srcStartRow,
+		CqTextureBuffer<TqFloat>& dest)
+{
+	assert(srcStartRow % 2 == 0);
+	// Channel holding the maximum depth; plain depths have only one.
+	const TqInt maxChan = src.numChannels() - 1;
+	for(TqInt y = srcStartRow/2, yEnd = (srcStartRow + src.height() + 1)/2;
+			y < yEnd; ++y)
+	{
+		const TqInt srcY = 2*y - srcStartRow;
+		for(TqInt x = 0; x < dest.width(); ++x)
+		{
+			TqFloat range[2] = {FLT_MAX, -FLT_MAX};
+			for(TqInt j = srcY, jEnd = min(srcY+2, src.height()); j < jEnd; ++j)
+			{
+				for(TqInt i = 2*x, iEnd = min(2*x+2, src.width()); i < iEnd; ++i)
+				{
+					const TqFloat* srcRange = src.value(i, j);
+					range[0] = min(range[0], srcRange[0]);
+					range[1] = max(range[1], srcRange[maxChan]);
+				}
+			}
+			dest.setPixel(x, y, range);
+		}
+	}
+}
+
 /** Copy pixels of one texture buffer onto part of another.
  */
 template<typename ChannelT>
@@ -204,10 +426,10 @@ void copyPixels(const CqTextureBuffer<ChannelT>& src, TqInt topLeftX, TqInt topL
  *
  * This class is a proxy for a texture input file.  We need it because it's
  * convenient to assume (for the other functions) that the input texture for
- * mipmapping will come from a single call to readPixels().  The readPixels()
- * in this class therefore stands in for IqTexInputFile::readPixels(),
- * performing texture concatenation in the correct order for cube face
- * environment texture generation.
+ * mipmapping comes from calls to readPixels().  The readPixels() in this
+ * class therefore stands in for IqTexInputFile::readPixels(), performing
+ * texture concatenation in the correct order for cube face environment
+ * texture generation.
  */
 class CqCubeFaceTextureSource
 {
@@ -218,6 +440,28 @@ class CqCubeFaceTextureSource
 		const IqTexInputFile& m_ny;
 		const IqTexInputFile& m_pz;
 		const IqTexInputFile& m_nz;
+
+		/** \brief Copy scanlines from a row of three faces into buf.
+		 *
+		 * \param faces - the faces to copy, from left to right.
+		 * \param startLine - first scanline to read from the faces
+		 * \param numScanlines - number of scanlines to read
+		 * \param destRow - row of buf to place the first scanline.
+		 */
+		template<typename ChannelT>
+		static void readFaces(const IqTexInputFile* const faces[3],
+				TqInt startLine, TqInt numScanlines,
+				CqTextureBuffer<ChannelT>& buf, TqInt destRow)
+		{
+			if(numScanlines <= 0)
+				return;
+			CqTextureBuffer<ChannelT> tmpBuf;
+			for(TqInt i = 0; i < 3; ++i)
+			{
+				faces[i]->readPixels(tmpBuf, startLine, numScanlines);
+				copyPixels(tmpBuf, i*tmpBuf.width(), destRow, buf);
+			}
+		}
 	public:
 		/// \brief Create from six input files, one for each cube face.
 		CqCubeFaceTextureSource(
@@ -228,12 +472,18 @@ class CqCubeFaceTextureSource
 			m_py(py), m_ny(ny),
 			m_pz(pz), m_nz(nz)
 		{ }
-		/** \brief Read pixels from the six faces and concatenate into buf.
+		/** \brief Read scanlines from the six faces and concatenate into buf.
+		 *
+		 * The faces are laid out as two rows of three, with the positive
+		 * faces on the top row.
 		 *
 		 * \param buf - output buffer for pixel data.
+		 * \param startLine - first scanline of the concatenated image to read.
+		 * \param numScanlines - number of scanlines to read.
 		 */
 		template<typename ChannelT>
-		void readPixels(CqTextureBuffer<ChannelT>& buf) const
+		void readPixels(CqTextureBuffer<ChannelT>& buf, TqInt startLine,
+				TqInt numScanlines) const
 		{
 			assert(m_px.header().channelList().sharedChannelType()
 					== getChannelTypeEnum<ChannelT>());
@@ -242,16 +492,17 @@ class CqCubeFaceTextureSource
 			TqInt faceWidth = m_px.header().width();
 			TqInt faceHeight = m_px.header().height();
 			TqInt numChans = m_px.header().channelList().numChannels();
-			buf.resize(faceWidth*3, faceHeight*2, numChans);
+			buf.resize(faceWidth*3, numScanlines, numChans);
 
 			// Extract pixels from the input files and copy into buf.
-			CqTextureBuffer<ChannelT> tmpBuf;
-			m_px.readPixels(tmpBuf); copyPixels(tmpBuf, 0, 0, buf);
-			m_nx.readPixels(tmpBuf); copyPixels(tmpBuf, 0, faceHeight, buf);
-			m_py.readPixels(tmpBuf); copyPixels(tmpBuf, faceWidth, 0, buf);
-			m_ny.readPixels(tmpBuf); copyPixels(tmpBuf, faceWidth, faceHeight, buf);
-			m_pz.readPixels(tmpBuf); copyPixels(tmpBuf, 2*faceWidth, 0, buf);
-			m_nz.readPixels(tmpBuf); copyPixels(tmpBuf, 2*faceWidth, faceHeight, buf);
+			const IqTexInputFile* const posFaces[3] = {&m_px, &m_py, &m_pz};
+			const IqTexInputFile* const negFaces[3] = {&m_nx, &m_ny, &m_nz};
+			TqInt endLine = startLine + numScanlines;
+			TqInt numTop = min(endLine, faceHeight) - startLine;
+			readFaces(posFaces, startLine, numTop, buf, 0);
+			TqInt negStart = max(startLine, faceHeight);
+			readFaces(negFaces, negStart - faceHeight, endLine - negStart, buf,
+					negStart - startLine);
 		}
 };
 
@@ -312,6 +563,23 @@ void fillOutputHeader(CqTexFileHeader& header, const SqWrapModes& wrapModes,
 	}
 }
 
+/** \brief Determine the output file type from the "format" parameter.
+ *
+ * Unknown formats are reported and replaced with TIFF.
+ */
+EqImageFileType outputFileType(const CqRiParamList& paramList)
+{
+	if(const char* const* format = paramList.find<const char*>("format"))
+	{
+		EqImageFileType type = enumCast<EqImageFileType>(*format);
+		if(type == ImageFile_Tiff || type == ImageFile_AqsisTex)
+			return type;
+		Aqsis::log() << warning << "Unknown texture format \"" << *format
+			<< "\"; using tiff.\n";
+	}
+	return ImageFile_Tiff;
+}
+
 void clampFilterWidth(SqFilterInfo& filterInfo, const boostfs::path& outFileName)
 {
 	if(filterInfo.xWidth < 1 || filterInfo.yWidth < 1)
@@ -360,7 +628,8 @@ void makeTexture(const boostfs::path& inFileName, const boostfs::path& outFileNa
 
 	// Create the output file.
 	boost::shared_ptr<IqMultiTexOutputFile> outFile
-		= IqMultiTexOutputFile::open(outFileName, ImageFile_Tiff, header);
+		= IqMultiTexOutputFile::open(outFileName,
+			outputFileType(paramList), header);
 
 	// Create mipmap, saving to the output file.
 	createMipmap(*inFile, inFile->header().channelList().sharedChannelType(),
@@ -401,7 +670,8 @@ void makeCubeFaceEnvironment(
 
 	// Create the output file.
 	boost::shared_ptr<IqMultiTexOutputFile> outFile
-		= IqMultiTexOutputFile::open(outFileName, ImageFile_Tiff, header);
+		= IqMultiTexOutputFile::open(outFileName,
+			outputFileType(paramList), header);
 
 	// Create mipmap, saving to the output file.
 	createMipmap(CqCubeFaceTextureSource(*inPx, *inNx, *inPy, *inNy, *inPz, *inNz),
@@ -426,7 +696,8 @@ void makeLatLongEnvironment(const boostfs::path& inFileName,
 
 	// Create the output file.
 	boost::shared_ptr<IqMultiTexOutputFile> outFile
-		= IqMultiTexOutputFile::open(outFileName, ImageFile_Tiff, header);
+		= IqMultiTexOutputFile::open(outFileName,
+			outputFileType(paramList), header);
 
 	// Create mipmap, saving to the output file.
 	createMipmap(*inFile, inFile->header().channelList().sharedChannelType(),
@@ -463,13 +734,54 @@ void makeShadow(const boostfs::path& inFileName, const boostfs::path& outFileNam
 	fillOutputHeader(header, SqWrapModes(WrapMode_Trunc, WrapMode_Trunc),
 			TextureFormat_Shadow, paramList);
 
-	// Read all pixels into a buffer (not particularly memory efficient...)
-	CqTextureBuffer<TqFloat> pixelBuf;
-	inFile->readPixels(pixelBuf);
-	// Open output file and write pixel data.
-	boost::shared_ptr<IqTexOutputFile> outFile
-		= IqTexOutputFile::open(outFileName, ImageFile_Tiff, header);
-	outFile->writePixels(pixelBuf);
+	// Open output file.
+	boost::shared_ptr<IqMultiTexOutputFile> outFile
+		= IqMultiTexOutputFile::open(outFileName,
+			outputFileType(paramList), header);
+
+	// Copy the depths across a band at a time.  When the min/max depth
+	// pyramid is wanted, its first level is accumulated from the same bands,
+	// so that the full depth map is never held in memory.
+	const bool depthRange = paramList.find<TqFloat>("depthrange", 0) != 0;
+	const TqInt width = header.width();
+	const TqInt height = header.height();
+	CqTextureBuffer<TqFloat> rangeBuf;
+	if(depthRange)
+		rangeBuf.resize(lceil(width/2.0f), lceil(height/2.0f), 2);
+	// Number of scanlines read at a time; even, so that bands start on the
+	// boundaries of the 2x2 blocks reduced by downsampleDepthRange().
+	const TqInt bandHeight = 128;
+	for(TqInt y = 0; y < height; y += bandHeight)
+	{
+		CqTextureBuffer<TqFloat> band;
+		inFile->readPixels(band, y, min(bandHeight, height - y));
+		outFile->writePixels(band);
+		if(depthRange)
+			downsampleDepthRange(band, y, rangeBuf);
+	}
+
+	if(depthRange)
+	{
+		// Append the min/max depth pyramid, building each level after the
+		// first from the previous one.
+		header.channelList() = CqChannelList();
+		header.channelList().addChannel(SqChannelInfo("zmin", Channel_Float32));
+		header.channelList().addChannel(SqChannelInfo("zmax", Channel_Float32));
+		header.set<Attr::TextureFormat>(TextureFormat_ShadowDepthRange);
+		while(true)
+		{
+			header.setWidth(rangeBuf.width());
+			header.setHeight(rangeBuf.height());
+			outFile->newSubImage(header);
+			outFile->writePixels(rangeBuf);
+			if(rangeBuf.width() == 1 && rangeBuf.height() == 1)
+				break;
+			CqTextureBuffer<TqFloat> nextBuf(lceil(rangeBuf.width()/2.0f),
+					lceil(rangeBuf.height()/2.0f), 2);
+			downsampleDepthRange(rangeBuf, 0, nextBuf);
+			rangeBuf = nextBuf;
+		}
+	}
 }
 
 void makeOcclusion(const std::vector<boostfs::path>& inFiles,
@@ -507,7 +819,8 @@ void makeOcclusion(const std::vector<boostfs::path>& inFiles,
 		if(!outFile)
 		{
 			// Open output file
-			outFile = IqMultiTexOutputFile::open(outFileName, ImageFile_Tiff, header);
+			outFile = IqMultiTexOutputFile::open(outFileName,
+				outputFileType(paramList), header);
 		}
 		else
 		{
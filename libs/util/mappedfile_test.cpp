@@ -0,0 +1,64 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for memory mapped files.
+ */
+
+#include <aqsis/util/mappedfile.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <fstream>
+#include <string>
+
+#include <aqsis/util/exception.h>
+
+BOOST_AUTO_TEST_SUITE(mappedfile_tests)
+using namespace Aqsis;
+
+BOOST_AUTO_TEST_CASE(CqMappedFile_contents_test)
+{
+	std::string contents("mapped\0file\ncontents", 20);
+	{
+		std::ofstream out("mappedfile_test.dat", std::ios::binary);
+		out << contents;
+	}
+	CqMappedFile file("mappedfile_test.dat");
+	BOOST_REQUIRE_EQUAL(file.size(), contents.size());
+	BOOST_CHECK_EQUAL(std::string(file.data(), file.size()), contents);
+}
+
+BOOST_AUTO_TEST_CASE(CqMappedFile_empty_test)
+{
+	{
+		std::ofstream out("mappedfile_empty_test.dat");
+	}
+	CqMappedFile file("mappedfile_empty_test.dat");
+	BOOST_CHECK_EQUAL(file.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(CqMappedFile_nonexistant_test)
+{
+	BOOST_CHECK_THROW(CqMappedFile("some_nonexistant_file.dat"), XqInvalidFile);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
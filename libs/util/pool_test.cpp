@@ -0,0 +1,151 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the object pools.
+ */
+
+#include <aqsis/util/pool.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <set>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(pool_tests)
+using namespace Aqsis;
+
+namespace {
+
+struct SqPoolObject
+{
+	TqInt data[5];
+};
+
+typedef CqThreadLocalObjectPool<SqPoolObject, 1> TqTestPool;
+
+// Allocate some objects and record the addresses.
+void allocObjects(TqTestPool* pool, std::vector<void*>* objects, TqInt num)
+{
+	for(TqInt i = 0; i < num; ++i)
+		objects->push_back(pool->alloc());
+}
+
+// Free a set of objects.
+void freeObjects(TqTestPool* pool, std::vector<void*>* objects)
+{
+	for(TqInt i = 0, end = objects->size(); i < end; ++i)
+		pool->free((*objects)[i]);
+	objects->clear();
+}
+
+// Free a set of objects, then stay alive until the barrier is passed twice.
+void freeObjectsAndWait(TqTestPool* pool, std::vector<void*>* objects,
+		boost::barrier* barrier)
+{
+	freeObjects(pool, objects);
+	barrier->wait();
+	barrier->wait();
+}
+
+} // anon namespace
+
+
+BOOST_AUTO_TEST_CASE(CqThreadLocalObjectPool_reuse_test)
+{
+	TqTestPool pool;
+	void* a = pool.alloc();
+	pool.free(a);
+	BOOST_CHECK_EQUAL(pool.alloc(), a);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadLocalObjectPool_distinct_test)
+{
+	// Allocate enough objects across several threads to need several chunks
+	// each, and check that no two allocations overlap.
+	TqTestPool pool;
+	const TqInt numThreads = 4;
+	const TqInt numPerThread = 500;
+	std::vector<std::vector<void*> > objects(numThreads);
+	boost::thread_group threads;
+	for(TqInt i = 0; i < numThreads; ++i)
+		threads.create_thread(boost::bind(&allocObjects, &pool, &objects[i], numPerThread));
+	threads.join_all();
+	std::set<char*> addresses;
+	for(TqInt i = 0; i < numThreads; ++i)
+	{
+		for(TqInt j = 0; j < numPerThread; ++j)
+			addresses.insert(static_cast<char*>(objects[i][j]));
+	}
+	BOOST_REQUIRE_EQUAL(addresses.size(), std::size_t(numThreads*numPerThread));
+	char* prev = 0;
+	for(std::set<char*>::iterator i = addresses.begin(); i != addresses.end(); ++i)
+	{
+		if(prev)
+			BOOST_CHECK(*i - prev >= static_cast<std::ptrdiff_t>(sizeof(SqPoolObject)));
+		prev = *i;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadLocalObjectPool_cross_thread_free_test)
+{
+	// Objects freed by another thread should be handed back to the pool when
+	// that thread exits, and then reused.
+	TqTestPool pool;
+	std::vector<void*> objects;
+	allocObjects(&pool, &objects, 10);
+	std::set<void*> freed(objects.begin(), objects.end());
+	boost::thread freeThread(boost::bind(&freeObjects, &pool, &objects));
+	freeThread.join();
+	// Exhaust the current chunk of this thread, after which the orphaned
+	// objects should be reused.
+	bool reused = false;
+	for(TqInt i = 0; i < 1000 && !reused; ++i)
+		reused = freed.count(pool.alloc()) != 0;
+	BOOST_CHECK(reused);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadLocalObjectPool_long_lived_free_test)
+{
+	// A thread which frees many objects but never exits should hand most of
+	// them back to the pool, so that reallocating them doesn't need any new
+	// chunks.
+	TqTestPool pool;
+	const TqInt numObjects = 2000;
+	std::vector<void*> objects;
+	allocObjects(&pool, &objects, numObjects);
+	std::size_t numChunks = pool.numChunks();
+	boost::barrier barrier(2);
+	boost::thread freeThread(boost::bind(&freeObjectsAndWait, &pool,
+				&objects, &barrier));
+	barrier.wait();
+	allocObjects(&pool, &objects, numObjects);
+	// Only the capped free list of the freeing thread may be missing.
+	BOOST_CHECK_LE(pool.numChunks(), numChunks + 3);
+	barrier.wait();
+	freeThread.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
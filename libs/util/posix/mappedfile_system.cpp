@@ -0,0 +1,81 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Posix implementation of CqMappedFile, using mmap().
+ */
+
+#include <aqsis/util/mappedfile.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include <aqsis/util/exception.h>
+
+namespace Aqsis {
+
+CqMappedFile::CqMappedFile(const std::string& fileName)
+	: m_data(0),
+	m_size(0),
+	m_handle(0)
+{
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_NoFile,
+			"Could not open file \"" << fileName << "\": " << std::strerror(errno));
+	}
+	struct stat st;
+	if(::fstat(fd, &st) != 0)
+	{
+		int err = errno;
+		::close(fd);
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_System,
+			"Could not stat file \"" << fileName << "\": " << std::strerror(err));
+	}
+	m_size = st.st_size;
+	// mmap() refuses zero length mappings; an empty file simply has no data.
+	if(m_size > 0)
+	{
+		void* addr = ::mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(addr == MAP_FAILED)
+		{
+			int err = errno;
+			::close(fd);
+			AQSIS_THROW_XQERROR(XqInvalidFile, EqE_System,
+				"Could not map file \"" << fileName << "\": " << std::strerror(err));
+		}
+		m_data = static_cast<const char*>(addr);
+	}
+	// The mapping stays valid after the descriptor is closed.
+	::close(fd);
+}
+
+CqMappedFile::~CqMappedFile()
+{
+	if(m_data)
+		::munmap(const_cast<char*>(m_data), m_size);
+}
+
+} // namespace Aqsis
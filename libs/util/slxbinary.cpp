@@ -0,0 +1,411 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Reading compiled shaders in the text and binary slx formats.
+ */
+
+#include <aqsis/util/slxbinary.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <aqsis/util/exception.h>
+
+namespace Aqsis {
+
+namespace {
+
+const char slxBinaryMagic[8] = {'A','Q','S','L','X','B','I','N'};
+const TqUint32 slxByteOrder = 0x01020304;
+
+bool isSpace(int c)
+{
+	return c == 0x20 || (c >= 0x09 && c <= 0x0D);
+}
+
+/// Accumulates interned strings and tokens for a binary slx file.
+class CqSlxBinaryWriter
+{
+	public:
+		void addToken(EqSlxTokenType type, const std::string& text)
+		{
+			SqSlxBinaryToken tok;
+			tok.type = type;
+			tok.text = intern(text);
+			tok.intValue = 0;
+			tok.floatValue = 0;
+			if(type == SlxToken_Word)
+			{
+				// Words which parse completely as numbers may also be
+				// read as numbers by the loader.
+				const char* begin = text.c_str();
+				char* end = 0;
+				double value = std::strtod(begin, &end);
+				if(end != begin && *end == '\0')
+				{
+					tok.type = SlxToken_Number;
+					tok.floatValue = static_cast<TqFloat>(value);
+					tok.intValue = static_cast<TqInt32>(std::strtol(begin, 0, 10));
+				}
+			}
+			m_tokens.push_back(tok);
+		}
+
+		void write(std::ostream& out) const
+		{
+			SqSlxBinaryHeader header;
+			std::memcpy(header.magic, slxBinaryMagic, sizeof(header.magic));
+			header.version = AQSIS_SLX_BINARY_VERSION;
+			header.byteOrder = slxByteOrder;
+			header.numStrings = m_offsets.size();
+			header.numTokens = m_tokens.size();
+			header.stringDataSize = m_stringData.size();
+			header.reserved = 0;
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			if(!m_offsets.empty())
+				out.write(reinterpret_cast<const char*>(&m_offsets[0]),
+						m_offsets.size()*sizeof(TqUint32));
+			if(!m_tokens.empty())
+				out.write(reinterpret_cast<const char*>(&m_tokens[0]),
+						m_tokens.size()*sizeof(SqSlxBinaryToken));
+			if(!m_stringData.empty())
+				out.write(&m_stringData[0], m_stringData.size());
+		}
+
+	private:
+		TqUint32 intern(const std::string& s)
+		{
+			std::map<std::string, TqUint32>::const_iterator i = m_strings.find(s);
+			if(i != m_strings.end())
+				return i->second;
+			TqUint32 index = m_offsets.size();
+			m_strings[s] = index;
+			m_offsets.push_back(m_stringData.size());
+			m_stringData.insert(m_stringData.end(), s.begin(), s.end());
+			m_stringData.push_back('\0');
+			return index;
+		}
+
+		std::map<std::string, TqUint32> m_strings;
+		std::vector<TqUint32> m_offsets;
+		std::vector<char> m_stringData;
+		std::vector<SqSlxBinaryToken> m_tokens;
+};
+
+} // anon namespace
+
+
+bool isSlxBinary(const char* data, std::size_t size)
+{
+	return size >= sizeof(slxBinaryMagic)
+		&& std::memcmp(data, slxBinaryMagic, sizeof(slxBinaryMagic)) == 0;
+}
+
+void slxTextToBinary(std::istream& text, std::ostream& out)
+{
+	const std::string contents((std::istreambuf_iterator<char>(text)),
+			std::istreambuf_iterator<char>());
+	CqSlxTextReader reader(contents.data(), contents.size());
+	CqSlxBinaryWriter writer;
+	while(!reader.atEnd())
+	{
+		EqSlxTokenType type = reader.nextToken();
+		writer.addToken(type, reader.token());
+	}
+	writer.write(out);
+}
+
+
+//------------------------------------------------------------------------------
+// CqSlxBinaryReader implementation
+CqSlxBinaryReader::CqSlxBinaryReader(const char* data, std::size_t size)
+	: m_stringOffsets(0),
+	m_tokens(0),
+	m_stringData(0),
+	m_numStrings(0),
+	m_numTokens(0),
+	m_pos(0)
+{
+	if(!isSlxBinary(data, size) || size < sizeof(SqSlxBinaryHeader))
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Not a binary slx file");
+	SqSlxBinaryHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if(header.byteOrder != slxByteOrder)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Binary slx file has the wrong byte order.  Please recompile.");
+	if(header.version != AQSIS_SLX_BINARY_VERSION)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Incompatible binary slx format " << header.version
+			<< " found (expected version " << AQSIS_SLX_BINARY_VERSION
+			<< ").  Please recompile.");
+	// Check the layout using 64 bit sizes, so that a corrupt header can't
+	// overflow the calculation.
+	boost::uint64_t offsetsStart = sizeof(SqSlxBinaryHeader);
+	boost::uint64_t tokensStart = offsetsStart + boost::uint64_t(header.numStrings)*sizeof(TqUint32);
+	boost::uint64_t stringsStart = tokensStart + boost::uint64_t(header.numTokens)*sizeof(SqSlxBinaryToken);
+	if(stringsStart + header.stringDataSize != size)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Binary slx file is truncated or corrupt");
+	m_stringOffsets = reinterpret_cast<const TqUint32*>(data + offsetsStart);
+	m_tokens = reinterpret_cast<const SqSlxBinaryToken*>(data + tokensStart);
+	m_stringData = data + stringsStart;
+	m_numStrings = header.numStrings;
+	m_numTokens = header.numTokens;
+	// Make sure every string and token lies inside the file, so that no
+	// further checking is needed when reading.
+	if(header.stringDataSize > 0 && m_stringData[header.stringDataSize-1] != '\0')
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Binary slx file has an unterminated string table");
+	for(TqInt i = 0; i < m_numStrings; ++i)
+	{
+		if(m_stringOffsets[i] >= header.stringDataSize)
+			AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+				"Binary slx file has a corrupt string table");
+	}
+	for(TqInt i = 0; i < m_numTokens; ++i)
+	{
+		if(m_tokens[i].text >= header.numStrings
+				|| m_tokens[i].type > SlxToken_String)
+			AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+				"Binary slx file has a corrupt token");
+	}
+}
+
+const char* CqSlxBinaryReader::word(TqInt* id)
+{
+	const SqSlxBinaryToken& tok = next(SlxToken_Word, SlxToken_Number);
+	if(id)
+		*id = tok.text;
+	return m_stringData + m_stringOffsets[tok.text];
+}
+
+TqFloat CqSlxBinaryReader::number()
+{
+	return next(SlxToken_Number, SlxToken_Number).floatValue;
+}
+
+TqInt CqSlxBinaryReader::integer()
+{
+	return next(SlxToken_Number, SlxToken_Number).intValue;
+}
+
+const char* CqSlxBinaryReader::string()
+{
+	const SqSlxBinaryToken& tok = next(SlxToken_String, SlxToken_String);
+	return m_stringData + m_stringOffsets[tok.text];
+}
+
+const SqSlxBinaryToken& CqSlxBinaryReader::next(EqSlxTokenType minType,
+		EqSlxTokenType maxType)
+{
+	if(m_pos >= m_numTokens)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Unexpected end of compiled shader");
+	const SqSlxBinaryToken& tok = m_tokens[m_pos++];
+	if(tok.type < TqUint32(minType) || tok.type > TqUint32(maxType))
+	{
+		static const char* typeNames[] = {"word", "number", "string"};
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Expected " << typeNames[minType] << " but found "
+			<< typeNames[tok.type] << " \""
+			<< m_stringData + m_stringOffsets[tok.text]
+			<< "\" in compiled shader");
+	}
+	return tok;
+}
+
+
+//------------------------------------------------------------------------------
+// CqSlxTextReader implementation
+CqSlxTextReader::CqSlxTextReader(const char* data, std::size_t size)
+	: m_pos(data),
+	m_end(data + size),
+	m_token()
+{ }
+
+bool CqSlxTextReader::atEnd()
+{
+	skipSpace();
+	return m_pos == m_end;
+}
+
+const char* CqSlxTextReader::word(TqInt* id)
+{
+	if(nextToken() != SlxToken_Word)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Expected word but found string \"" << m_token
+			<< "\" in compiled shader");
+	if(id)
+		*id = -1;
+	return m_token.c_str();
+}
+
+TqFloat CqSlxTextReader::number()
+{
+	return static_cast<TqFloat>(std::strtod(numericWord(), 0));
+}
+
+TqInt CqSlxTextReader::integer()
+{
+	// As for binary files, numbers are read as integers by their leading
+	// integer part.
+	return static_cast<TqInt>(std::strtol(numericWord(), 0, 10));
+}
+
+const char* CqSlxTextReader::string()
+{
+	if(nextToken() != SlxToken_String)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Expected string but found word \"" << m_token
+			<< "\" in compiled shader");
+	return m_token.c_str();
+}
+
+EqSlxTokenType CqSlxTextReader::nextToken()
+{
+	skipSpace();
+	if(m_pos == m_end)
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Unexpected end of compiled shader");
+	m_token.clear();
+	if(*m_pos == ':')
+	{
+		// Labels are marked by a colon which needn't be separated from the
+		// label number.
+		++m_pos;
+		m_token = ":";
+		return SlxToken_Word;
+	}
+	if(*m_pos == '"')
+	{
+		++m_pos;
+		readStringLiteral();
+		return SlxToken_String;
+	}
+	const char* begin = m_pos;
+	while(m_pos != m_end && !isSpace(*m_pos))
+		++m_pos;
+	m_token.assign(begin, m_pos);
+	return SlxToken_Word;
+}
+
+void CqSlxTextReader::skipSpace()
+{
+	while(m_pos != m_end && isSpace(*m_pos))
+		++m_pos;
+}
+
+/** Read a quoted string literal into m_token, interpreting escaped
+ * characters.  m_pos should be just after the leading quote.
+ */
+void CqSlxTextReader::readStringLiteral()
+{
+	while(m_pos != m_end && *m_pos != '"')
+	{
+		char c = *m_pos++;
+		if(c != '\\')
+		{
+			m_token += c;
+			continue;
+		}
+		if(m_pos == m_end)
+			break;
+		c = *m_pos++;
+		switch(c)
+		{
+			case 'a': m_token += '\a'; break;
+			case 'b': m_token += '\b'; break;
+			case 'f': m_token += '\f'; break;
+			case 'n': m_token += '\n'; break;
+			case 'r': m_token += '\r'; break;
+			case 't': m_token += '\t'; break;
+			case 'v': m_token += '\v'; break;
+			case '\'': m_token += '\''; break;
+			case '?': m_token += '?'; break;
+			case '"': m_token += '"'; break;
+			case '\\': m_token += '\\'; break;
+			case 'x':
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+				{
+					// Hexadecimal escapes take up to two digits, and octal
+					// ones up to three including the first.
+					bool isHexadecimal = (c == 'x');
+					std::string digits;
+					std::string::size_type maxLength = 2;
+					if(!isHexadecimal)
+					{
+						digits += c;
+						maxLength = 3;
+					}
+					while(digits.length() < maxLength && m_pos != m_end)
+					{
+						char d = *m_pos;
+						if(!( (d >= '0' && d <= '9') || (isHexadecimal
+								&& ((d >= 'a' && d <= 'f') || (d >= 'A' && d <= 'F'))) ))
+							break;
+						digits += d;
+						++m_pos;
+					}
+					char e = static_cast<char>(std::strtoul(digits.c_str(),
+								NULL, isHexadecimal ? 16 : 8));
+					if(e != 0)
+						m_token += e;
+				}
+				break;
+			default:
+				// Unknown escapes are dropped.
+				break;
+		}
+	}
+	// Skip the closing quote.
+	if(m_pos != m_end)
+		++m_pos;
+}
+
+/** Read the next token, which must be a word parsing completely as a number.
+ *
+ * \return the token text.
+ */
+const char* CqSlxTextReader::numericWord()
+{
+	bool isWord = nextToken() == SlxToken_Word;
+	const char* begin = m_token.c_str();
+	char* numEnd = 0;
+	std::strtod(begin, &numEnd);
+	if(!isWord || numEnd == begin || *numEnd != '\0')
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_BadFile,
+			"Expected number but found " << (isWord ? "word" : "string")
+			<< " \"" << m_token << "\" in compiled shader");
+	return begin;
+}
+
+} // namespace Aqsis
@@ -0,0 +1,183 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the text and binary slx readers.
+ */
+
+#include <aqsis/util/slxbinary.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include <aqsis/util/exception.h>
+
+BOOST_AUTO_TEST_SUITE(slxbinary_tests)
+using namespace Aqsis;
+
+namespace {
+
+const char* testProgram =
+	"surface\n"
+	"AQSIS_V 2\n"
+	"\n"
+	"segment Data\n"
+	"USES 460803\n"
+	"param uniform  float Kd\n"
+	"varying  float a[3]\n"
+	"\n"
+	"segment Init\n"
+	"\tpushif 0.8\n"
+	"\tpop Kd\n"
+	"\n"
+	"segment Code\n"
+	":0\n"
+	"\tpushif -1.5e2\n"
+	"\tpushis \"tab\\there \\\"q\\\" \\x41\\101\\n\"\n"
+	"\tjz 1\n"
+	": 1\n"
+	"\texternal \"f\" \"v\" \"fp\"\n";
+
+// Read the test program with either reader, recording each token and the
+// way it was read.
+template<typename ReaderT>
+std::string readTestProgram(ReaderT& reader)
+{
+	std::ostringstream out;
+	// surface AQSIS_V 2
+	out << reader.word() << "|" << reader.word() << "|" << reader.word() << "|";
+	// segment Data USES
+	out << reader.word() << "|" << reader.word() << "|" << reader.word() << "|";
+	out << reader.integer() << "|";
+	for(int i = 0; i < 4 + 3; ++i)
+		out << reader.word() << "|";
+	// segment Init pushif
+	out << reader.word() << "|" << reader.word() << "|" << reader.word() << "|";
+	out << reader.number() << "|";
+	out << reader.word() << "|" << reader.word() << "|";
+	// segment Code : 0 pushif
+	out << reader.word() << "|" << reader.word() << "|";
+	out << reader.word() << "|" << reader.integer() << "|";
+	out << reader.word() << "|" << reader.number() << "|";
+	out << reader.word() << "|" << reader.string() << "|";
+	out << reader.word() << "|" << reader.number() << "|";
+	out << reader.word() << "|" << reader.integer() << "|";
+	out << reader.word() << "|" << reader.string() << "|"
+		<< reader.string() << "|" << reader.string() << "|";
+	BOOST_CHECK(reader.atEnd());
+	return out.str();
+}
+
+const char* expectedTokens =
+	"surface|AQSIS_V|2|segment|Data|USES|460803|param|uniform|float|Kd|"
+	"varying|float|a[3]|segment|Init|pushif|0.8|pop|Kd|segment|Code|:|0|"
+	"pushif|-150|pushis|tab\there \"q\" AA\n|jz|1|:|1|external|f|v|fp|";
+
+std::string toBinary(const std::string& text)
+{
+	std::istringstream in(text);
+	std::ostringstream out;
+	slxTextToBinary(in, out);
+	return out.str();
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(slxbinary_text_reader)
+{
+	CqSlxTextReader reader(testProgram, std::strlen(testProgram));
+	BOOST_CHECK_EQUAL(readTestProgram(reader), expectedTokens);
+}
+
+BOOST_AUTO_TEST_CASE(slxbinary_binary_reader_matches_text)
+{
+	std::string binary = toBinary(testProgram);
+	BOOST_REQUIRE(isSlxBinary(binary.data(), binary.size()));
+	BOOST_CHECK(!isSlxBinary(testProgram, std::strlen(testProgram)));
+	CqSlxBinaryReader reader(binary.data(), binary.size());
+	BOOST_CHECK_EQUAL(readTestProgram(reader), expectedTokens);
+}
+
+BOOST_AUTO_TEST_CASE(slxbinary_word_ids)
+{
+	// Identical words share a string table entry in binary files, while
+	// text files have no ids.
+	std::string binary = toBinary("segment Code segment");
+	CqSlxBinaryReader binReader(binary.data(), binary.size());
+	TqInt id1 = -1, id2 = -1, id3 = -1;
+	binReader.word(&id1);
+	binReader.word(&id2);
+	binReader.word(&id3);
+	BOOST_CHECK_EQUAL(id1, id3);
+	BOOST_CHECK(id1 != id2);
+	BOOST_CHECK_EQUAL(binReader.numStrings(), 2);
+
+	const char* text = "segment Code";
+	CqSlxTextReader textReader(text, std::strlen(text));
+	TqInt id = 0;
+	textReader.word(&id);
+	BOOST_CHECK_EQUAL(id, -1);
+	BOOST_CHECK_EQUAL(textReader.numStrings(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(slxbinary_type_errors)
+{
+	const char* text = "word \"string\" 1.5x";
+	CqSlxTextReader textReader(text, std::strlen(text));
+	BOOST_CHECK_THROW(textReader.number(), XqInvalidFile);
+	BOOST_CHECK_THROW(textReader.word(), XqInvalidFile);
+	BOOST_CHECK_THROW(textReader.integer(), XqInvalidFile);
+	BOOST_CHECK(textReader.atEnd());
+	BOOST_CHECK_THROW(textReader.word(), XqInvalidFile);
+
+	std::string binary = toBinary(text);
+	CqSlxBinaryReader binReader(binary.data(), binary.size());
+	BOOST_CHECK_THROW(binReader.number(), XqInvalidFile);
+	BOOST_CHECK_THROW(binReader.word(), XqInvalidFile);
+	BOOST_CHECK_THROW(binReader.integer(), XqInvalidFile);
+	BOOST_CHECK(binReader.atEnd());
+	BOOST_CHECK_THROW(binReader.word(), XqInvalidFile);
+}
+
+BOOST_AUTO_TEST_CASE(slxbinary_corrupt_files)
+{
+	std::string binary = toBinary(testProgram);
+	// Truncated files
+	BOOST_CHECK_THROW(CqSlxBinaryReader(binary.data(), binary.size() - 1),
+			XqInvalidFile);
+	BOOST_CHECK_THROW(CqSlxBinaryReader(binary.data(), 12), XqInvalidFile);
+	// Wrong version
+	std::string badVersion = binary;
+	badVersion[8] += 1;
+	BOOST_CHECK_THROW(CqSlxBinaryReader(badVersion.data(), badVersion.size()),
+			XqInvalidFile);
+	// Unterminated string table
+	std::string unterminated = binary;
+	unterminated[unterminated.size() - 1] = 'x';
+	BOOST_CHECK_THROW(CqSlxBinaryReader(unterminated.data(), unterminated.size()),
+			XqInvalidFile);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,276 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Persistent work-stealing thread pool.
+ */
+
+#include <aqsis/util/threadpool.h>
+
+#include <boost/bind.hpp>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+// CqTaskGroup implementation
+CqTaskGroup::CqTaskGroup(CqThreadPool& pool)
+	: m_pool(pool),
+	m_pending(0),
+	m_error(),
+	m_mutex(),
+	m_finished()
+{ }
+
+CqTaskGroup::~CqTaskGroup()
+{
+	try
+	{
+		wait();
+	}
+	catch(...)
+	{
+		// Errors should be retrieved with an explicit wait(); never throw
+		// from a destructor.
+	}
+}
+
+void CqTaskGroup::run(const boost::function0<void>& task)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		++m_pending;
+	}
+	CqThreadPool::SqTask t;
+	t.func = task;
+	t.group = this;
+	if(m_pool.numThreads() == 0)
+		CqThreadPool::runTask(t);
+	else
+		m_pool.submit(t);
+}
+
+void CqTaskGroup::wait()
+{
+	// Pool threads run queued work until the group is done, rather than
+	// blocking while other workers have tasks waiting.
+	if(m_pool.isWorker())
+		m_pool.helpUntilFinished(*this);
+	boost::mutex::scoped_lock lock(m_mutex);
+	while(m_pending > 0)
+		m_finished.wait(lock);
+	if(m_error)
+	{
+		boost::exception_ptr error = m_error;
+		m_error = boost::exception_ptr();
+		boost::rethrow_exception(error);
+	}
+}
+
+void CqTaskGroup::taskFinished(const boost::exception_ptr& error)
+{
+	CqThreadPool& pool = m_pool;
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(error && !m_error)
+			m_error = error;
+		--m_pending;
+		if(m_pending > 0)
+			return;
+		// Notify with the lock held: the group may be destroyed as soon as
+		// a waiter sees m_pending reach zero.
+		m_finished.notify_all();
+	}
+	pool.notifyGroupFinished();
+}
+
+bool CqTaskGroup::finished()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_pending == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// CqThreadPool implementation
+CqThreadPool::CqThreadPool(TqInt numThreads)
+	: m_queues(),
+	m_workerIndex(),
+	m_threads(),
+	m_numThreads(numThreads > 0 ? numThreads : hardwareThreads()),
+	m_sleepMutex(),
+	m_workAvailable(),
+	m_numQueued(0),
+	m_numWorkerQueued(0),
+	m_helpAvailable(),
+	m_shutdown(false)
+{
+#ifndef ENABLE_THREADING
+	// Run everything in the submitting thread.
+	m_numThreads = 0;
+#endif
+	for(TqInt i = 0; i <= m_numThreads; ++i)
+		m_queues.push_back(new SqTaskQueue());
+	for(TqInt i = 0; i < m_numThreads; ++i)
+		m_threads.create_thread(boost::bind(&CqThreadPool::workerLoop, this, i));
+}
+
+CqThreadPool::~CqThreadPool()
+{
+	{
+		boost::mutex::scoped_lock lock(m_sleepMutex);
+		m_shutdown = true;
+	}
+	m_workAvailable.notify_all();
+	m_threads.join_all();
+	for(TqInt i = 0, end = m_queues.size(); i < end; ++i)
+		delete m_queues[i];
+}
+
+TqInt CqThreadPool::hardwareThreads()
+{
+	TqInt n = boost::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+void CqThreadPool::submit(const SqTask& task)
+{
+	const TqInt* index = m_workerIndex.get();
+	SqTaskQueue& queue = *m_queues[index ? *index : m_numThreads];
+	{
+		boost::mutex::scoped_lock lock(queue.mutex);
+		queue.tasks.push_back(task);
+	}
+	{
+		boost::mutex::scoped_lock lock(m_sleepMutex);
+		++m_numQueued;
+		if(index)
+			++m_numWorkerQueued;
+	}
+	m_workAvailable.notify_one();
+	if(index)
+		m_helpAvailable.notify_all();
+}
+
+void CqThreadPool::runTask(SqTask& task)
+{
+	boost::exception_ptr error;
+	try
+	{
+		task.func();
+	}
+	catch(...)
+	{
+		error = boost::current_exception();
+	}
+	// Release anything bound into the task before the group is notified.
+	task.func.clear();
+	task.group->taskFinished(error);
+}
+
+bool CqThreadPool::popLocal(SqTask& task)
+{
+	const TqInt* index = m_workerIndex.get();
+	if(!index)
+		return false;
+	{
+		SqTaskQueue& queue = *m_queues[*index];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		if(queue.tasks.empty())
+			return false;
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+	}
+	boost::mutex::scoped_lock lock(m_sleepMutex);
+	--m_numQueued;
+	--m_numWorkerQueued;
+	return true;
+}
+
+bool CqThreadPool::steal(SqTask& task, TqInt thief, bool includeShared)
+{
+	// Visit the other queues starting with our neighbour, so that thieves
+	// spread out over the victims.
+	TqInt numQueues = m_queues.size();
+	for(TqInt i = 1; i < numQueues; ++i)
+	{
+		TqInt victim = (thief + i) % numQueues;
+		bool shared = victim == m_numThreads;
+		if(shared && !includeShared)
+			continue;
+		SqTaskQueue& queue = *m_queues[victim];
+		{
+			boost::mutex::scoped_lock lock(queue.mutex);
+			if(queue.tasks.empty())
+				continue;
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		boost::mutex::scoped_lock lock(m_sleepMutex);
+		--m_numQueued;
+		if(!shared)
+			--m_numWorkerQueued;
+		return true;
+	}
+	return false;
+}
+
+void CqThreadPool::helpUntilFinished(CqTaskGroup& group)
+{
+	TqInt index = *m_workerIndex;
+	SqTask task;
+	while(!group.finished())
+	{
+		if(popLocal(task) || steal(task, index, false))
+		{
+			runTask(task);
+			continue;
+		}
+		boost::mutex::scoped_lock lock(m_sleepMutex);
+		while(m_numWorkerQueued <= 0 && !group.finished())
+			m_helpAvailable.wait(lock);
+	}
+}
+
+void CqThreadPool::notifyGroupFinished()
+{
+	boost::mutex::scoped_lock lock(m_sleepMutex);
+	m_helpAvailable.notify_all();
+}
+
+void CqThreadPool::workerLoop(TqInt index)
+{
+	m_workerIndex.reset(new TqInt(index));
+	SqTask task;
+	while(true)
+	{
+		if(popLocal(task) || steal(task, index, true))
+		{
+			runTask(task);
+			continue;
+		}
+		boost::mutex::scoped_lock lock(m_sleepMutex);
+		while(m_numQueued <= 0 && !m_shutdown)
+			m_workAvailable.wait(lock);
+		if(m_shutdown && m_numQueued <= 0)
+			break;
+	}
+}
+
+} // namespace Aqsis
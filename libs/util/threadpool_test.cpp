@@ -0,0 +1,212 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the work-stealing thread pool.
+ */
+
+#include <aqsis/util/threadpool.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread_time.hpp>
+
+BOOST_AUTO_TEST_SUITE(threadpool_tests)
+using namespace Aqsis;
+
+namespace {
+
+// Counter which may be incremented from several threads.
+struct Counter
+{
+	TqInt value;
+	boost::mutex mutex;
+	Counter() : value(0) {}
+	void increment()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		++value;
+	}
+};
+
+void incrementCounter(Counter* counter)
+{
+	counter->increment();
+}
+
+// Task which runs a nested group of tasks and waits for them.
+void spawnNested(CqThreadPool* pool, Counter* counter, TqInt numChildren)
+{
+	CqTaskGroup group(*pool);
+	for(TqInt i = 0; i < numChildren; ++i)
+		group.run(boost::bind(&incrementCounter, counter));
+	group.wait();
+	counter->increment();
+}
+
+void throwError()
+{
+	throw std::runtime_error("task error");
+}
+
+// Flags raised by one task and waited for by another.  Waits time out, so
+// that a pool which doesn't run the tasks fails the test instead of hanging.
+struct Signals
+{
+	TqInt raised;
+	boost::mutex mutex;
+	boost::condition changed;
+	Counter timeouts;
+	Signals() : raised(0) {}
+	void raise(TqInt flag)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		raised |= flag;
+		changed.notify_all();
+	}
+	void waitFor(TqInt flags)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		boost::system_time timeout = boost::get_system_time()
+			+ boost::posix_time::seconds(5);
+		while((raised & flags) != flags)
+		{
+			if(!changed.timed_wait(lock, timeout))
+			{
+				timeouts.increment();
+				return;
+			}
+		}
+	}
+};
+
+const TqInt firstStarted = 1;
+const TqInt secondStarted = 2;
+const TqInt blockerStarted = 4;
+const TqInt stolenTaskRan = 8;
+
+void raiseSignal(Signals* signals, TqInt flag)
+{
+	signals->raise(flag);
+}
+
+void raiseAndWait(Signals* signals, TqInt flag, TqInt waitFlags)
+{
+	signals->raise(flag);
+	signals->waitFor(waitFlags);
+}
+
+// Outer task whose nested task is taken by another worker, so that it has to
+// wait with an empty deque.
+void waitForStolenTask(CqThreadPool* pool, Signals* signals)
+{
+	raiseAndWait(signals, secondStarted, firstStarted | secondStarted);
+	CqTaskGroup group(*pool);
+	group.run(boost::bind(&raiseAndWait, signals, blockerStarted, stolenTaskRan));
+	signals->waitFor(blockerStarted);
+	group.wait();
+}
+
+// Outer task queueing one task it runs itself, which only finishes once the
+// other has been run by another worker.
+void queueTaskToSteal(CqThreadPool* pool, Signals* signals)
+{
+	raiseAndWait(signals, firstStarted, firstStarted | secondStarted | blockerStarted);
+	CqTaskGroup group(*pool);
+	group.run(boost::bind(&raiseSignal, signals, stolenTaskRan));
+	group.run(boost::bind(&Signals::waitFor, signals, stolenTaskRan));
+	group.wait();
+}
+
+} // anon namespace
+
+
+BOOST_AUTO_TEST_CASE(CqThreadPool_runs_all_tasks)
+{
+	CqThreadPool pool(4);
+	Counter counter;
+	CqTaskGroup group(pool);
+	for(TqInt i = 0; i < 1000; ++i)
+		group.run(boost::bind(&incrementCounter, &counter));
+	group.wait();
+	BOOST_CHECK_EQUAL(counter.value, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadPool_nested_groups)
+{
+	// More nested waits than worker threads must not deadlock.
+	CqThreadPool pool(2);
+	Counter counter;
+	CqTaskGroup group(pool);
+	for(TqInt i = 0; i < 20; ++i)
+		group.run(boost::bind(&spawnNested, &pool, &counter, 10));
+	group.wait();
+	BOOST_CHECK_EQUAL(counter.value, 20*11);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadPool_waiting_workers_steal)
+{
+	// All three workers are busy: two in outer tasks and one in a nested task
+	// which blocks.  The worker waiting for that blocked task must run the
+	// task queued by the other outer task, which is blocked until it runs.
+	CqThreadPool pool(3);
+	if(pool.numThreads() == 0)
+		return;
+	Signals signals;
+	CqTaskGroup group(pool);
+	group.run(boost::bind(&queueTaskToSteal, &pool, &signals));
+	group.run(boost::bind(&waitForStolenTask, &pool, &signals));
+	group.wait();
+	BOOST_CHECK_EQUAL(signals.timeouts.value, 0);
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadPool_group_reuse)
+{
+	CqThreadPool pool(3);
+	Counter counter;
+	CqTaskGroup group(pool);
+	for(TqInt pass = 0; pass < 5; ++pass)
+	{
+		for(TqInt i = 0; i < 10; ++i)
+			group.run(boost::bind(&incrementCounter, &counter));
+		group.wait();
+		BOOST_CHECK_EQUAL(counter.value, (pass+1)*10);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqThreadPool_propagates_exceptions)
+{
+	CqThreadPool pool(2);
+	Counter counter;
+	CqTaskGroup group(pool);
+	group.run(&throwError);
+	for(TqInt i = 0; i < 10; ++i)
+		group.run(boost::bind(&incrementCounter, &counter));
+	BOOST_CHECK_THROW(group.wait(), std::runtime_error);
+	// The remaining tasks still run, and the error is only reported once.
+	BOOST_CHECK_EQUAL(counter.value, 10);
+	group.wait();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Windows implementation of CqMappedFile, using file mapping objects.
+ */
+
+#include <aqsis/util/mappedfile.h>
+
+#include <windows.h>
+
+#include <aqsis/util/exception.h>
+
+namespace Aqsis {
+
+CqMappedFile::CqMappedFile(const std::string& fileName)
+	: m_data(0),
+	m_size(0),
+	m_handle(0)
+{
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_NoFile,
+			"Could not open file \"" << fileName << "\"");
+	}
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		AQSIS_THROW_XQERROR(XqInvalidFile, EqE_System,
+			"Could not get size of file \"" << fileName << "\"");
+	}
+	m_size = static_cast<std::size_t>(fileSize.QuadPart);
+	// Zero length mappings aren't allowed; an empty file simply has no data.
+	if(m_size > 0)
+	{
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* addr = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+		if(!addr)
+		{
+			if(mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			AQSIS_THROW_XQERROR(XqInvalidFile, EqE_System,
+				"Could not map file \"" << fileName << "\"");
+		}
+		m_data = static_cast<const char*>(addr);
+		m_handle = mapping;
+	}
+	// The view keeps the file open for as long as it's needed.
+	CloseHandle(file);
+}
+
+CqMappedFile::~CqMappedFile()
+{
+	if(m_data)
+	{
+		UnmapViewOfFile(m_data);
+		CloseHandle(static_cast<HANDLE>(m_handle));
+	}
+}
+
+} // namespace Aqsis
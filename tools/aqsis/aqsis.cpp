@@ -116,6 +116,7 @@ ArgParse::apint g_cl_endofframe = -1;
 #endif
 ArgParse::apflag g_cl_help = 0;
 ArgParse::apint g_cl_priority = 1;
+ArgParse::apint g_cl_threads = -1;
 ArgParse::apflag g_cl_version = 0;
 ArgParse::apflag g_cl_fb = 0;
 ArgParse::apflag g_cl_progress = 0;
@@ -376,6 +377,11 @@ class PreWorldFilter : public Aqsis::PassthroughFilter
 			if(g_cl_res.size() == 2)
 				ri.Format(g_cl_res[0], g_cl_res[1], 1.0f);
 
+			// Pass the number of render threads onto Aqsis.
+			if( g_cl_threads >= 0 )
+				ri.Option("limits", Aqsis::ParamListBuilder()
+						  ("threads", g_cl_threads));
+
 #if ENABLE_MPDUMP
 			if(g_cl_mpdump)
 				ri.Option("mpdump",
@@ -536,6 +542,7 @@ int main( int argc, const char** argv )
 			"\a2 = high\n"
 			"\a3 = RT", &g_cl_priority);
 		ap.alias( "priority", "z");
+		ap.argInt( "threads", "=integer\aNumber of buckets to render concurrently (0 = one per core)", &g_cl_threads );
 		
 		ap.argString( "type", "=string\aSpecify a display device type to use", &g_cl_type );
 		ap.argString( "addtype", "=string\aSpecify a display device type to add", &g_cl_addtype );
@@ -93,8 +93,9 @@ int main( int argc, const char** argv )
 	ap.argStrings( "I", "%s \aSet path for #include files.", &g_includes );
 	ap.argStrings( "D", "Sym[=value] \adefine symbol <string> to have value <value> (default: 1).", &g_defines );
 	ap.argStrings( "U", "Sym \aUndefine an initial symbol.", &g_undefines );
-	ap.argString( "backend", " %s \aCompiler backend (default %default).  Possibilities include \"slx\" or \"dot\":\a"
+	ap.argString( "backend", " %s \aCompiler backend (default %default).  Possibilities include \"slx\", \"slxbin\" or \"dot\":\a"
 			      "slx - produce a compiled shader (in the aqsis shader VM stack language)\a"
+			      "slxbin - produce a compiled shader in the binary format, which loads faster\a"
 				  "dot - make a graphviz visualization of the parse tree (useful for debugging only).", &g_backendName );
 	ap.argFlag( "help", "\aPrint this help and exit", &g_help );
 	ap.alias("help", "h");
@@ -172,6 +173,8 @@ int main( int argc, const char** argv )
 				// Create a code generator for the requested backend.
 				if(g_backendName == "slx")
 					codeGenerator.reset(new CqCodeGenVM());
+				else if(g_backendName == "slxbin")
+					codeGenerator.reset(new CqCodeGenVM(true));
 				else if(g_backendName == "dot")
 					codeGenerator.reset(new CqCodeGenGraphviz());
 				else
@@ -46,6 +46,7 @@ bool	g_help = false;
 bool	g_envcube = false;
 bool	g_envlatl = false;
 bool	g_shadow = false;
+bool	g_depthrange = false;
 
 ArgParse::apint g_cl_verbose = 1;
 ArgParse::apstring	g_swrap = "black";
@@ -58,6 +59,7 @@ ArgParse::apfloat g_twidth = 1.0;
 ArgParse::apfloat g_fov = 90.0;
 ArgParse::apfloat g_width = -1.0;
 ArgParse::apstring g_compress = "none";
+ArgParse::apstring g_format = "tiff";
 ArgParse::apfloat g_quality = 70.0;
 ArgParse::apfloat g_bake = 128.0;
 
@@ -85,9 +87,11 @@ int main( int argc, const char** argv )
 		"\a3 = debug", &g_cl_verbose );
 	ap.alias( "verbose" , "v" );
 	ap.argString( "compression", "=string\a[none|lzw|packbits|deflate] (default: %default)", &g_compress );
+	ap.argString( "format", "=string\a[tiff|aqsistex] output file format; aqsistex files are uncompressed and memory mapped by the renderer (default: %default)", &g_format );
 	ap.argFlag( "envcube", " px nx py ny pz nz\aproduce a cubeface environment map from 6 images.", &g_envcube );
 	ap.argFlag( "envlatl", "\aproduce a latlong environment map from an image file.", &g_envlatl );
 	ap.argFlag( "shadow", "\aproduce a shadow map from a z file.", &g_shadow );
+	ap.argFlag( "depthrange", "\astore a min/max depth pyramid with the shadow map to speed up lookups.", &g_depthrange );
 	ap.argString( "swrap", "=string\as wrap [black|periodic|clamp] (default: %default)", &g_swrap );
 	ap.argString( "smode", "=string\a(equivalent to swrap for BMRT compatibility)", &g_swrap );
 	ap.argString( "twrap", "=string\at wrap [black|periodic|clamp] (default: %default)", &g_twrap );
@@ -220,6 +224,7 @@ int main( int argc, const char** argv )
 		g_bake = 2048.0;
 
 	char *compression = ( char * ) g_compress.c_str();
+	char *format = ( char * ) g_format.c_str();
 	float quality = ( float ) g_quality;
 
 
@@ -274,6 +279,8 @@ int main( int argc, const char** argv )
 		    &compression,
 		    "quality",
 		    &quality,
+		    "string format",
+		    &format,
 		    RI_NULL );
 	}
 	else if ( g_shadow )
@@ -285,7 +292,8 @@ int main( int argc, const char** argv )
 
 
 
-		RiMakeShadow( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(), ( float ) g_twidth, "compression", &compression, "quality", &quality, RI_NULL );
+		float depthrange = g_depthrange ? 1 : 0;
+		RiMakeShadow( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(), "compression", &compression, "quality", &quality, "float depthrange", &depthrange, "string format", &format, RI_NULL );
 	}
 	else if ( g_envlatl )
 	{
@@ -295,7 +303,7 @@ int main( int argc, const char** argv )
 		        ( char* ) g_compress.c_str() );
 
 		RiMakeLatLongEnvironment( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(), filterfunc,
-		                          ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, RI_NULL );
+		                          ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, "string format", &format, RI_NULL );
 	}
 	else
 	{
@@ -314,7 +322,7 @@ int main( int argc, const char** argv )
 
 		RiMakeTexture( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(),
 		               ( char* ) g_swrap.c_str(), ( char* ) g_twrap.c_str(), filterfunc,
-		               ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, "float bake", &bake, RI_NULL );
+		               ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, "float bake", &bake, "string format", &format, RI_NULL );
 	}
 
 	RiEnd();